@@ -56,11 +56,20 @@
 #include "platform.h"
 #include "pxp_monitor.h"
 #include "console_serial.h"
+#include "trace_ring.h"
 
+static at_ble_status_t pxp_monitor_timeline_enable(at_ble_handle_t conn_handle);
+static bool pxp_monitor_service_changed_discovery(at_ble_handle_t conn_handle);
+static at_ble_status_t pxp_monitor_service_changed_enable(at_ble_handle_t conn_handle);
+static bool pxp_monitor_cache_apply(at_ble_handle_t conn_handle);
+static void pxp_monitor_cache_save(at_ble_handle_t conn_handle);
+static at_ble_status_t pxp_monitor_cache_drop(at_ble_handle_t conn_handle);
+static at_ble_status_t pxp_monitor_connect_address(at_ble_addr_t *addr);
+static at_ble_status_t pxp_monitor_auto_connect(void);
 
 static const ble_event_callback_t pxp_gap_handle[] = {
 	NULL,
-	NULL,
+	pxp_monitor_scan_info_handler,
 	pxp_monitor_scan_data_handler,
 	NULL,
 	NULL,
@@ -84,13 +93,13 @@ static const ble_event_callback_t pxp_gatt_client_handle[] = {
 	pxp_monitor_service_found_handler,
 	NULL,
 	pxp_monitor_characteristic_found_handler,
-	NULL,
+	pxp_monitor_descriptor_found_handler,
 	pxp_monitor_discovery_complete_handler,
 	pxp_monitor_characteristic_read_response,
 	NULL,
-	NULL,
-	NULL,
-	NULL
+	pxp_monitor_characteristic_write_response,
+	pxp_monitor_notification_handler,
+	pxp_monitor_indication_handler
 };
 
 /*#if defined TX_POWER_SERVICE
@@ -108,6 +117,21 @@ static const ble_event_callback_t pxp_gatt_client_handle[] = {
 /* pxp reporter device address to connect */
 at_ble_addr_t pxp_reporter_address;
 
+/* address of the connected reporter, key of the handle cache */
+static at_ble_addr_t pxp_peer_address;
+
+/* handles discovered on bonded reporters */
+static gatt_cache_t pxp_gatt_cache;
+
+/* best Perception advertiser of the current scan window */
+static adv_candidate_t pxp_auto_candidate;
+
+/* fast reconnect windows and backoff of the auto scan */
+static scan_sched_t pxp_scan_sched;
+
+/* Link to the reporter, used for diagnostics writes */
+static at_ble_handle_t pxp_conn_handle;
+
 uint8_t pxp_supp_scan_index[MAX_SCAN_DEVICE];
 uint8_t scan_index = 0;
 
@@ -137,16 +161,21 @@ uint8_t ias_char_data[MAX_IAS_CHAR_SIZE];
 
 
 gatt_perception_char_handler_t perception_handle =
-{0, 0, 0, 0, 0, 0, AT_BLE_INVALID_PARAM, NULL, NULL, NULL, NULL};
+{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, AT_BLE_INVALID_PARAM, AT_BLE_INVALID_PARAM, PXP_HANDLES_UNKNOWN, NULL, NULL, NULL, NULL};
 uint8_t perception_char_data1[MAX_PERCEPTION_CHAR_SIZE];
 uint8_t perception_char_data2[MAX_PERCEPTION_CHAR_SIZE];
 uint8_t perception_char_data3[MAX_PERCEPTION_CHAR_SIZE];
 uint8_t perception_char_data4[MAX_PERCEPTION_CHAR_SIZE];
 
+/* Service changed indications of the reporter */
+static gatt_service_changed_char_handler_t service_changed_handle =
+{0, 0, 0, 0, 0, AT_BLE_INVALID_PARAM, AT_BLE_INVALID_PARAM};
+
 
 hw_timer_start_func_cb_t hw_timer_start_func_cb = NULL;
 hw_timer_stop_func_cb_t hw_timer_stop_func_cb = NULL;
 peripheral_state_cb_t peripheral_state_callback = NULL;
+haptic_timeline_cb_t haptic_timeline_callback = NULL;
 
 /* *@brief Initializes Proximity profile
 * handler Pointer reference to respective variables
@@ -164,6 +193,10 @@ void pxp_monitor_init(void *param)
 	perception_handle.char_data3 = perception_char_data3;
 	perception_handle.char_data4 = perception_char_data4;
 	
+	gatt_cache_init(&pxp_gatt_cache);
+	scan_sched_init(&pxp_scan_sched, PXP_FAST_RECONNECT_SCANS,
+	PXP_SCAN_BACKOFF_MIN, PXP_SCAN_BACKOFF_MAX);
+	
 	ble_mgr_events_callback_handler(REGISTER_CALL_BACK, BLE_GAP_EVENT_TYPE, pxp_gap_handle);
 	ble_mgr_events_callback_handler(REGISTER_CALL_BACK, BLE_GATT_CLIENT_EVENT_TYPE, pxp_gatt_client_handle);
 }
@@ -184,8 +217,12 @@ void pxp_monitor_init(void *param)
 at_ble_status_t pxp_monitor_connect_request(at_ble_scan_info_t *scan_buffer,
 uint8_t index)
 {
-	memcpy((uint8_t *)&pxp_reporter_address,
-	(uint8_t *)&scan_buffer[index].dev_addr,
+	return pxp_monitor_connect_address(&scan_buffer[index].dev_addr);
+}
+
+static at_ble_status_t pxp_monitor_connect_address(at_ble_addr_t *addr)
+{
+	memcpy((uint8_t *)&pxp_reporter_address, (uint8_t *)addr,
 	sizeof(at_ble_addr_t));
 
 	if (gap_dev_connect(&pxp_reporter_address) == AT_BLE_SUCCESS) {
@@ -213,6 +250,11 @@ uint8_t index)
 */
 at_ble_status_t pxp_monitor_scan_data_handler(void *params)
 {
+#if PXP_AUTO_CONNECT
+	/* Scan window over */
+	ALL_UNUSED(params);
+	return pxp_monitor_auto_connect();
+#else
 	uint8_t scan_device[MAX_SCAN_DEVICE];
 	uint8_t pxp_scan_device_count = 0;
 	uint8_t scanned_dev_count = scan_response_count;
@@ -319,6 +361,130 @@ at_ble_status_t pxp_monitor_scan_data_handler(void *params)
 	}		
         ALL_UNUSED(params);
 	return AT_BLE_FAILURE;
+#endif
+}
+
+/**@brief Handles each advertising report while scanning
+*
+* Connects right away to a bonded or near Perception advertiser and keeps
+* the best of the others for the end of the scan window.
+*/
+at_ble_status_t pxp_monitor_scan_info_handler(void *params)
+{
+	at_ble_scan_info_t *scan_param;
+	adv_report_t report;
+	bool known;
+	scan_param = (at_ble_scan_info_t *)params;
+	
+	if ((!PXP_AUTO_CONNECT) || (pxp_connect_request_flag != PXP_DEV_SCANNING)) {
+		return AT_BLE_SUCCESS;
+	}
+	
+	/* Bonded, or the reporter the link was just lost to */
+	known = ble_check_bonded_address(&scan_param->dev_addr) ||
+	(pxp_scan_sched.reconnect_pending && !memcmp((uint8_t *)&scan_param->dev_addr,
+	(uint8_t *)&pxp_reporter_address, sizeof(at_ble_addr_t)));
+	
+	switch (scan_param->type) {
+		case AT_BLE_ADV_TYPE_DIRECTED:
+		case AT_BLE_ADV_TYPE_DIRECTED_LDC:
+		/* Directed advertising carries no data, only a known peer counts */
+		if (!known) {
+			return AT_BLE_SUCCESS;
+		}
+		break;
+		
+		case AT_BLE_ADV_TYPE_UNDIRECTED:
+		case AT_BLE_ADV_TYPE_SCAN_RESPONSE:
+		adv_parse(scan_param->adv_data, scan_param->adv_data_len,
+		PERCEPTION_SERVICE_UUID, &report);
+		if (!report.service_found) {
+			return AT_BLE_SUCCESS;
+		}
+		break;
+		
+		default:
+		return AT_BLE_SUCCESS;
+	}
+	
+	if (adv_select_offer(&pxp_auto_candidate, scan_param->dev_addr.type,
+	scan_param->dev_addr.addr, scan_param->rssi, known)) {
+		DBG_LOG_DEV("Perception advertiser 0x%02X%02X%02X%02X%02X%02X rssi %d",
+		scan_param->dev_addr.addr[5],
+		scan_param->dev_addr.addr[4],
+		scan_param->dev_addr.addr[3],
+		scan_param->dev_addr.addr[2],
+		scan_param->dev_addr.addr[1],
+		scan_param->dev_addr.addr[0],
+		scan_param->rssi);
+	}
+	
+	/* No need to wait for the scan window to end */
+	if (known || (scan_param->rssi >= PXP_AUTO_CONNECT_NEAR_RSSI)) {
+		at_ble_scan_stop();
+		return pxp_monitor_auto_connect();
+	}
+	return AT_BLE_SUCCESS;
+}
+
+/**@brief Starts a scan window for Perception advertisers
+*/
+at_ble_status_t pxp_monitor_auto_scan(void)
+{
+	at_ble_status_t status;
+	
+	adv_select_reset(&pxp_auto_candidate);
+	scan_response_count = 0;
+	
+	if (scan_sched_window(&pxp_scan_sched) == SCAN_WINDOW_FAST) {
+		status = at_ble_scan_start(SCAN_INTERVAL, SCAN_WINDOW, PXP_FAST_SCAN_TIMEOUT,
+		SCAN_TYPE, AT_BLE_SCAN_GEN_DISCOVERY, false, true);
+	} else {
+		status = at_ble_scan_start(PXP_SLOW_SCAN_INTERVAL, PXP_SLOW_SCAN_WINDOW,
+		PXP_AUTO_SCAN_TIMEOUT, SCAN_TYPE, AT_BLE_SCAN_GEN_DISCOVERY, false, true);
+	}
+	if (status == AT_BLE_SUCCESS) {
+		DBG_LOG("Scanning for Perception devices...");
+		pxp_connect_request_flag = PXP_DEV_SCANNING;
+	} else {
+		DBG_LOG("Perception scan start failed, reason %d", status);
+	}
+	return status;
+}
+
+/**@brief Connects to the scan window candidate or schedules the next scan
+*/
+static at_ble_status_t pxp_monitor_auto_connect(void)
+{
+	at_ble_addr_t addr;
+	uint8_t backoff_s;
+	
+	/* Already connecting to an advertiser picked during the scan */
+	if (pxp_connect_request_flag != PXP_DEV_SCANNING) {
+		return AT_BLE_SUCCESS;
+	}
+	
+	if (pxp_auto_candidate.valid) {
+		addr.type = (at_ble_addr_type_t)pxp_auto_candidate.addr_type;
+		memcpy(addr.addr, pxp_auto_candidate.addr, AT_BLE_ADDR_LEN);
+		DBG_LOG("Connecting to Perception device rssi %d%s",
+		pxp_auto_candidate.rssi, pxp_auto_candidate.bonded ? " (bonded)" : "");
+		if (pxp_monitor_connect_address(&addr) == AT_BLE_SUCCESS) {
+			return AT_BLE_SUCCESS;
+		}
+	} else {
+		DBG_LOG("Perception supported device not found");
+	}
+	
+	scan_sched_window_end(&pxp_scan_sched, pxp_auto_candidate.valid, &backoff_s);
+	if (backoff_s == 0) {
+		return pxp_monitor_auto_scan();
+	}
+	
+	DBG_LOG("Next scan in %d s", backoff_s);
+	pxp_connect_request_flag = PXP_DEV_SCAN_BACKOFF;
+	hw_timer_start_func_cb(backoff_s);
+	return AT_BLE_FAILURE;
 }
 
 at_ble_status_t pxp_monitor_start_scan(void)
@@ -332,6 +498,10 @@ at_ble_status_t pxp_monitor_start_scan(void)
 		}
 	}
 	
+#if PXP_AUTO_CONNECT
+	hw_timer_stop_func_cb();
+	return pxp_monitor_auto_scan();
+#else
 	char index_value;
 	hw_timer_stop_func_cb();
 	do
@@ -355,6 +525,7 @@ at_ble_status_t pxp_monitor_start_scan(void)
 		return gap_dev_scan();
 	}
 	return AT_BLE_FAILURE;
+#endif
 }
 
 /**@brief peer device connection terminated
@@ -380,7 +551,13 @@ at_ble_status_t pxp_disconnect_event_handler(void *params)
 		pxp_monitor_start_scan();
 		return AT_BLE_FAILURE;
 	}
-	else if(peripheral_state_callback != NULL)
+	
+	perception_handle.handles_state = PXP_HANDLES_UNKNOWN;
+	
+	scan_sched_link_lost(&pxp_scan_sched,
+	disconnect->reason == AT_BLE_TERMINATED_BY_USER);
+	
+	if(peripheral_state_callback != NULL)
 	{
 		peripheral_state = peripheral_state_callback();
 	}
@@ -415,6 +592,18 @@ at_ble_status_t pxp_disconnect_event_handler(void *params)
 at_ble_status_t pxp_monitor_service_discover(at_ble_handle_t handle)
 {
 	at_ble_status_t status;
+	
+	perception_handle.timeline_handle = 0;
+	perception_handle.timeline_end_handle = 0;
+	perception_handle.timeline_cccd_handle = 0;
+	perception_handle.diag_handle = 0;
+	perception_handle.desc_discovery = AT_BLE_INVALID_PARAM;
+	perception_handle.handles_state = PXP_HANDLES_DISCOVERING;
+	
+	memset(&service_changed_handle, 0, sizeof(service_changed_handle));
+	service_changed_handle.char_discovery = AT_BLE_INVALID_PARAM;
+	service_changed_handle.desc_discovery = AT_BLE_INVALID_PARAM;
+	
 	status = at_ble_primary_service_discover_all(
 					handle,
 					GATT_DISCOVERY_STARTING_HANDLE,
@@ -422,6 +611,8 @@ at_ble_status_t pxp_monitor_service_discover(at_ble_handle_t handle)
 	if (status == AT_BLE_SUCCESS) {
 		DBG_LOG_DEV("GATT Discovery request started ");
 	} else {
+		/* Nothing queued, pairing or encryption tries again */
+		perception_handle.handles_state = PXP_HANDLES_UNKNOWN;
 		DBG_LOG("GATT Discovery request failed");
 	}
 	
@@ -442,7 +633,18 @@ at_ble_status_t pxp_monitor_pair_done_handler(void *params)
 	hw_timer_stop_func_cb();
 	
 	if (pair_done_val->status == AT_BLE_SUCCESS) {
-		discovery_status = pxp_monitor_service_discover(pair_done_val->handle);
+		if (perception_handle.handles_state == PXP_HANDLES_DISCOVERED) {
+			/* Bonded now, keep the handles for the next connection */
+			pxp_monitor_cache_save(pair_done_val->handle);
+			discovery_status = AT_BLE_SUCCESS;
+		} else if ((perception_handle.handles_state == PXP_HANDLES_CACHED) ||
+				(perception_handle.handles_state == PXP_HANDLES_DISCOVERING)) {
+			/* A discovery in progress caches the handles when it completes,
+			 * restarting it would run two on the link */
+			discovery_status = AT_BLE_SUCCESS;
+		} else {
+			discovery_status = pxp_monitor_service_discover(pair_done_val->handle);
+		}
 	} else {
 			return AT_BLE_FAILURE;
 	}
@@ -464,7 +666,15 @@ at_ble_status_t pxp_monitor_encryption_change_handler(void *params)
 	}
 	hw_timer_stop_func_cb();
 	if (encryption_status->status == AT_BLE_SUCCESS) {
-		discovery_status = pxp_monitor_service_discover(encryption_status->handle);
+		if (perception_handle.handles_state == PXP_HANDLES_DISCOVERED) {
+			pxp_monitor_cache_save(encryption_status->handle);
+			discovery_status = AT_BLE_SUCCESS;
+		} else if ((perception_handle.handles_state == PXP_HANDLES_CACHED) ||
+				(perception_handle.handles_state == PXP_HANDLES_DISCOVERING)) {
+			discovery_status = AT_BLE_SUCCESS;
+		} else {
+			discovery_status = pxp_monitor_service_discover(encryption_status->handle);
+		}
 	}
 	return discovery_status;
 }
@@ -491,6 +701,19 @@ at_ble_status_t pxp_monitor_connected_state_handler(void *params)
 	}
 
 	pxp_connect_request_flag = PXP_DEV_CONNECTED;
+	scan_sched_connected(&pxp_scan_sched);
+	pxp_conn_handle = conn_params->handle;
+	
+	/* Negotiate the largest MTU so a haptic timeline fits one notification */
+	ble_mtu_exchange(conn_params->handle);
+	
+	memcpy((uint8_t *)&pxp_peer_address, (uint8_t *)&conn_params->peer_addr,
+	sizeof(at_ble_addr_t));
+	
+	/* Bonded reporter seen before, skip the discovery */
+	if (pxp_monitor_cache_apply(conn_params->handle)) {
+		return AT_BLE_SUCCESS;
+	}
 
 	at_ble_status_t discovery_status = AT_BLE_FAILURE;
 	discovery_status = pxp_monitor_service_discover(conn_params->handle);
@@ -545,6 +768,18 @@ at_ble_status_t pxp_monitor_service_found_handler(void *params)
 			}
 			break;
 			
+			/* Generic Attribute service, for the Service Changed characteristic */
+			case GENERIC_ATTRIBUTE_SERVICE_UUID:
+			{
+				service_changed_handle.start_handle
+				= primary_service_params->start_handle;
+				service_changed_handle.end_handle
+				= primary_service_params->end_handle;
+				DBG_LOG_DEV("Generic Attribute service discovered");
+				service_changed_handle.char_discovery=(at_ble_status_t)DISCOVER_SUCCESS;
+			}
+			break;
+			
 			/* for link loss service Handler */
 			/*case LINK_LOSS_SERVICE_UUID:
 			{
@@ -625,6 +860,11 @@ at_ble_status_t pxp_monitor_discovery_complete_handler(void *params)
 	DBG_LOG_DEV("discover complete operation %d and %d",discover_status->operation,discover_status->status);
 	if ((discover_status->status == DISCOVER_SUCCESS) || (discover_status->status == AT_BLE_SUCCESS)) {
 		at_ble_status_t status;
+		/* Service changed indications are set up before the Perception
+		 * characteristics are discovered */
+		if (pxp_monitor_service_changed_discovery(discover_status->conn_handle)) {
+			return AT_BLE_SUCCESS;
+		}
 		if ((perception_handle.char_discovery == DISCOVER_SUCCESS) && (discover_char_flag)) {
 			/*at_ble_uuid_t c_uuid;
 			c_uuid.type = AT_BLE_UUID_16;
@@ -730,7 +970,13 @@ at_ble_status_t pxp_monitor_discovery_complete_handler(void *params)
 			at_ble_disconnect(discover_status->conn_handle, AT_BLE_TERMINATED_BY_USER);
 		}*/
 		
-		if (discover_char_flag) {
+		if (discover_char_flag && (perception_handle.desc_discovery == DISCOVER_SUCCESS)) {
+			/* Timeline descriptor discovery completed */
+			perception_handle.desc_discovery = AT_BLE_SUCCESS;
+			perception_handle.handles_state = PXP_HANDLES_DISCOVERED;
+			pxp_monitor_cache_save(discover_status->conn_handle);
+			pxp_monitor_timeline_enable(discover_status->conn_handle);
+		} else if (discover_char_flag && (perception_handle.desc_discovery == AT_BLE_INVALID_PARAM)) {
 			//DBG_LOG("GOT HERE!!!!!");
 			DBG_LOG_DEV("GATT characteristic discovery completed");
 			/*#if defined LINK_LOSS_SERVICE
@@ -776,6 +1022,23 @@ at_ble_status_t pxp_monitor_discovery_complete_handler(void *params)
 			PERCEPTION_READ_LENGTH) == AT_BLE_SUCCESS)) {
 				DBG_LOG("Vibe Motor 4 Characteristic Read Request Failed");
 			}
+			
+			if (perception_handle.timeline_handle) {
+				if ((status = at_ble_descriptor_discover_all(discover_status->conn_handle,
+				perception_handle.timeline_handle + 1,
+				perception_handle.timeline_end_handle)) == AT_BLE_SUCCESS) {
+					DBG_LOG_DEV("Haptic Timeline Descriptor Discovery Started");
+					perception_handle.desc_discovery = (at_ble_status_t)DISCOVER_SUCCESS;
+				} else {
+					DBG_LOG("Haptic Timeline Descriptor Discovery Failed: %02x", status);
+					perception_handle.desc_discovery = AT_BLE_INVALID_STATE;
+				}
+			} else {
+				DBG_LOG("Haptic Timeline not supported by peer, using intensity reads");
+				perception_handle.desc_discovery = AT_BLE_INVALID_STATE;
+				perception_handle.handles_state = PXP_HANDLES_DISCOVERED;
+				pxp_monitor_cache_save(discover_status->conn_handle);
+			}
 		}
 	}
 	return AT_BLE_SUCCESS;
@@ -797,45 +1060,25 @@ at_ble_status_t pxp_monitor_characteristic_read_response(void *params)
 		return AT_BLE_FAILURE;
 	}
 
-	DBG_LOG("Read Resp handle %x",
+	TRACE_EVENT(TRACE_ID_READ_RESP, char_read_resp->char_len,
 	char_read_resp->char_handle);
 	
 	if (char_read_resp->char_handle == perception_handle.char_handle1) {
-		DBG_LOG(" ");
 		memcpy(&perception_handle.char_data1[0],
 		&char_read_resp->char_value[PERCEPTION_READ_OFFSET],
 		PERCEPTION_READ_LENGTH);
-		for (int i = 0; i < PERCEPTION_READ_LENGTH; i++) {
-			DBG_LOG_CONT("%c", perception_handle.char_data1[i]);
-		}
-		DBG_LOG(" ");
 	} else if (char_read_resp->char_handle == perception_handle.char_handle2) {
-		DBG_LOG(" ");
 		memcpy(perception_handle.char_data2,
 		&char_read_resp->char_value[PERCEPTION_READ_OFFSET],
 		PERCEPTION_READ_LENGTH);
-		for (int i = 0; i < PERCEPTION_READ_LENGTH; i++) {
-			DBG_LOG_CONT("%c", perception_handle.char_data2[i]);
-		}
-		DBG_LOG(" ");
 	} else if (char_read_resp->char_handle == perception_handle.char_handle3) {
-		DBG_LOG(" ");
 		memcpy(perception_handle.char_data3,
 		&char_read_resp->char_value[PERCEPTION_READ_OFFSET],
 		PERCEPTION_READ_LENGTH);
-		for (int i = 0; i < PERCEPTION_READ_LENGTH; i++) {
-			DBG_LOG_CONT("%c", perception_handle.char_data3[i]);
-		}
-		DBG_LOG(" ");
 	} else if (char_read_resp->char_handle == perception_handle.char_handle4) {
-		DBG_LOG(" ");
 		memcpy(perception_handle.char_data4,
 		&char_read_resp->char_value[PERCEPTION_READ_OFFSET],
 		PERCEPTION_READ_LENGTH);
-		for (int i = 0; i < PERCEPTION_READ_LENGTH; i++) {
-			DBG_LOG_CONT("%c", char_read_resp->char_value[i]/*perception_handle.char_data4[i]*/);
-		}
-		DBG_LOG(" ");
 	}
 	return AT_BLE_SUCCESS;
 }
@@ -864,8 +1107,31 @@ at_ble_status_t pxp_monitor_characteristic_found_handler(void *params)
 
 	charac_16_uuid = (uint16_t)((characteristic_found->char_uuid.uuid[0]) |	\
 	(characteristic_found->char_uuid.uuid[1] << 8));
+	
+	/* Characteristics are reported in handle order, the first declaration
+	 * after the timeline value closes the timeline descriptor range */
+	if ((perception_handle.timeline_handle) &&
+	(perception_handle.timeline_end_handle == perception_handle.end_handle) &&
+	(characteristic_found->char_handle > perception_handle.timeline_handle) &&
+	(characteristic_found->char_handle <= perception_handle.end_handle)) {
+		perception_handle.timeline_end_handle = characteristic_found->char_handle - 1;
+	}
+	
+	/* Same for the Service Changed descriptors */
+	if ((service_changed_handle.char_handle) &&
+	(service_changed_handle.char_end_handle == service_changed_handle.end_handle) &&
+	(characteristic_found->char_handle > service_changed_handle.char_handle) &&
+	(characteristic_found->char_handle <= service_changed_handle.end_handle)) {
+		service_changed_handle.char_end_handle = characteristic_found->char_handle - 1;
+	}
 
-	if (charac_16_uuid == VIBE1_INTENSITY_CHAR_UUID) {
+	if ((charac_16_uuid == SERVICE_CHANGED_CHAR_UUID) &&
+	(characteristic_found->char_handle > service_changed_handle.start_handle) &&
+	(characteristic_found->char_handle <= service_changed_handle.end_handle)) {
+		service_changed_handle.char_handle = characteristic_found->value_handle;
+		service_changed_handle.char_end_handle = service_changed_handle.end_handle;
+		DBG_LOG_DEV("Service changed characteristics: handle %x", service_changed_handle.char_handle);
+	} else if (charac_16_uuid == VIBE1_INTENSITY_CHAR_UUID) {
 		perception_handle.char_handle1 = characteristic_found->value_handle;
 		DBG_LOG("Vibe 1 intensity characteristics: Attrib handle %x property %x handle: %x uuid : %x",
 		characteristic_found->char_handle, characteristic_found->properties,
@@ -885,6 +1151,15 @@ at_ble_status_t pxp_monitor_characteristic_found_handler(void *params)
 		DBG_LOG("Vibe 4 intensity characteristics: Attrib handle %x property %x handle: %x uuid : %x",
 		characteristic_found->char_handle, characteristic_found->properties,
 		perception_handle.char_handle4, charac_16_uuid);
+	} else if (charac_16_uuid == HAPTIC_TIMELINE_CHAR_UUID) {
+		perception_handle.timeline_handle = characteristic_found->value_handle;
+		perception_handle.timeline_end_handle = perception_handle.end_handle;
+		DBG_LOG("Haptic timeline characteristics: Attrib handle %x property %x handle: %x uuid : %x",
+		characteristic_found->char_handle, characteristic_found->properties,
+		perception_handle.timeline_handle, charac_16_uuid);
+	} else if (charac_16_uuid == PERCEPTION_DIAG_CHAR_UUID) {
+		perception_handle.diag_handle = characteristic_found->value_handle;
+		DBG_LOG_DEV("Diagnostics characteristics: handle %x", perception_handle.diag_handle);
 	} /*else if (charac_16_uuid == TX_POWER_LEVEL_CHAR_UUID) {
 		txps_handle.char_handle = characteristic_found->value_handle;
 		DBG_LOG_PTS("Tx power characteristics: Attrib handle %x property %x handle: %x uuid : %x",
@@ -907,6 +1182,346 @@ at_ble_status_t pxp_monitor_characteristic_found_handler(void *params)
 	return AT_BLE_SUCCESS;
 }
 
+/**@brief Handles all Discovered descriptors of the haptic timeline and
+* Service Changed characteristics
+*
+* Stores the client characteristic configuration descriptor handles
+*
+* @param[in] descriptor_found Discovered descriptor params of a connected
+* device
+*
+*/
+at_ble_status_t pxp_monitor_descriptor_found_handler(void *params)
+{
+	uint16_t desc_16_uuid;
+	at_ble_descriptor_found_t *descriptor_found;
+	descriptor_found = (at_ble_descriptor_found_t *)params;
+	
+	if(!ble_check_iscentral(descriptor_found->conn_handle))
+	{
+		return AT_BLE_FAILURE;
+	}
+	
+	desc_16_uuid = (uint16_t)((descriptor_found->desc_uuid.uuid[0]) | \
+	(descriptor_found->desc_uuid.uuid[1] << 8));
+	
+	if (desc_16_uuid != CLIENT_CHAR_CONFIG_DESC_UUID) {
+		return AT_BLE_SUCCESS;
+	}
+	
+	if ((service_changed_handle.char_handle) &&
+	(descriptor_found->desc_handle > service_changed_handle.char_handle) &&
+	(descriptor_found->desc_handle <= service_changed_handle.char_end_handle)) {
+		if (service_changed_handle.cccd_handle == 0) {
+			service_changed_handle.cccd_handle = descriptor_found->desc_handle;
+			DBG_LOG_DEV("Service changed CCCD handle: %x", descriptor_found->desc_handle);
+		}
+	} else if ((perception_handle.timeline_handle) &&
+	(descriptor_found->desc_handle > perception_handle.timeline_handle) &&
+	(descriptor_found->desc_handle <= perception_handle.timeline_end_handle) &&
+	(perception_handle.timeline_cccd_handle == 0)) {
+		perception_handle.timeline_cccd_handle = descriptor_found->desc_handle;
+		DBG_LOG_DEV("Haptic timeline CCCD handle: %x", descriptor_found->desc_handle);
+	}
+	return AT_BLE_SUCCESS;
+}
+
+/**@brief Enables the haptic timeline notifications on the peer
+*
+* @param[in] conn_handle connection handle
+*
+* @return @ref AT_BLE_SUCCESS write request sent
+* @return @ref AT_BLE_FAILURE descriptor not found or write failed
+*/
+static at_ble_status_t pxp_monitor_timeline_enable(at_ble_handle_t conn_handle)
+{
+	at_ble_status_t status;
+	uint8_t cccd_value[2] = {(uint8_t)PERCEPTION_CCCD_NOTIFY,
+				(uint8_t)(PERCEPTION_CCCD_NOTIFY >> 8)};
+	
+	if (!perception_handle.timeline_cccd_handle) {
+		DBG_LOG("Haptic Timeline CCCD not found");
+		return AT_BLE_FAILURE;
+	}
+	
+	if ((status = at_ble_characteristic_write(conn_handle,
+	perception_handle.timeline_cccd_handle,
+	0, sizeof(cccd_value), cccd_value,
+	false, true)) != AT_BLE_SUCCESS) {
+		DBG_LOG("Haptic Timeline Notification Enable Failed: %02x", status);
+		return AT_BLE_FAILURE;
+	}
+	
+	DBG_LOG("Haptic Timeline Notifications Enabled, MTU %d", ble_mtu_get(conn_handle));
+	return AT_BLE_SUCCESS;
+}
+
+/**@brief Runs the discovery of the Service Changed characteristic
+*
+* Steps through the characteristic and descriptor discovery of the Generic
+* Attribute service, one step per completed discovery, and enables the
+* service changed indications at the end.
+*
+* @param[in] conn_handle connection handle
+*
+* @return true if a discovery was started and is still to complete
+*/
+static bool pxp_monitor_service_changed_discovery(at_ble_handle_t conn_handle)
+{
+	at_ble_status_t status;
+	
+	if (service_changed_handle.char_discovery == DISCOVER_SUCCESS) {
+		service_changed_handle.char_discovery = AT_BLE_FAILURE;
+		if ((status = at_ble_characteristic_discover_all(conn_handle,
+		service_changed_handle.start_handle,
+		service_changed_handle.end_handle)) == AT_BLE_SUCCESS) {
+			DBG_LOG_DEV("Service Changed Characteristic Discovery Started");
+			return true;
+		}
+		DBG_LOG("Service Changed Characteristic Discovery Failed: %02x", status);
+		service_changed_handle.char_discovery = AT_BLE_INVALID_STATE;
+		return false;
+	}
+	
+	if ((service_changed_handle.char_discovery == AT_BLE_FAILURE) &&
+	(service_changed_handle.desc_discovery == AT_BLE_INVALID_PARAM)) {
+		/* Characteristic discovery completed */
+		service_changed_handle.desc_discovery = AT_BLE_INVALID_STATE;
+		if ((service_changed_handle.char_handle == 0) ||
+		(service_changed_handle.char_end_handle <= service_changed_handle.char_handle)) {
+			DBG_LOG("Service Changed not supported by peer");
+			return false;
+		}
+		if ((status = at_ble_descriptor_discover_all(conn_handle,
+		service_changed_handle.char_handle + 1,
+		service_changed_handle.char_end_handle)) == AT_BLE_SUCCESS) {
+			DBG_LOG_DEV("Service Changed Descriptor Discovery Started");
+			service_changed_handle.desc_discovery = (at_ble_status_t)DISCOVER_SUCCESS;
+			return true;
+		}
+		DBG_LOG("Service Changed Descriptor Discovery Failed: %02x", status);
+		return false;
+	}
+	
+	if (service_changed_handle.desc_discovery == DISCOVER_SUCCESS) {
+		/* Descriptor discovery completed */
+		service_changed_handle.desc_discovery = AT_BLE_SUCCESS;
+		pxp_monitor_service_changed_enable(conn_handle);
+	}
+	return false;
+}
+
+/**@brief Enables the service changed indications on the peer
+*
+* @param[in] conn_handle connection handle
+*
+* @return @ref AT_BLE_SUCCESS write request sent
+* @return @ref AT_BLE_FAILURE descriptor not found or write failed
+*/
+static at_ble_status_t pxp_monitor_service_changed_enable(at_ble_handle_t conn_handle)
+{
+	at_ble_status_t status;
+	uint8_t cccd_value[2] = {(uint8_t)PXP_CCCD_INDICATE,
+				(uint8_t)(PXP_CCCD_INDICATE >> 8)};
+	
+	if (!service_changed_handle.cccd_handle) {
+		DBG_LOG("Service Changed CCCD not found");
+		service_changed_handle.char_handle = 0;
+		return AT_BLE_FAILURE;
+	}
+	
+	if ((status = at_ble_characteristic_write(conn_handle,
+	service_changed_handle.cccd_handle,
+	0, sizeof(cccd_value), cccd_value,
+	false, true)) != AT_BLE_SUCCESS) {
+		DBG_LOG("Service Changed Indication Enable Failed: %02x", status);
+		service_changed_handle.char_handle = 0;
+		return AT_BLE_FAILURE;
+	}
+	
+	DBG_LOG_DEV("Service Changed Indications Enabled");
+	return AT_BLE_SUCCESS;
+}
+
+/**@brief Restores the handles cached for a bonded reporter
+*
+* Enables the haptic timeline straight away when the handles are found.
+*
+* @return true if discovery can be skipped
+*/
+static bool pxp_monitor_cache_apply(at_ble_handle_t conn_handle)
+{
+	gatt_cache_handles_t handles;
+	
+	if (!ble_check_bonded(conn_handle)) {
+		return false;
+	}
+	
+	if (!gatt_cache_lookup(&pxp_gatt_cache, pxp_peer_address.type,
+	pxp_peer_address.addr, &handles)) {
+		DBG_LOG_DEV("No cached handles for bonded reporter");
+		return false;
+	}
+	
+	perception_handle.start_handle = handles.start_handle;
+	perception_handle.end_handle = handles.end_handle;
+	perception_handle.char_handle1 = handles.char_handle[0];
+	perception_handle.char_handle2 = handles.char_handle[1];
+	perception_handle.char_handle3 = handles.char_handle[2];
+	perception_handle.char_handle4 = handles.char_handle[3];
+	perception_handle.timeline_handle = handles.timeline_handle;
+	perception_handle.timeline_end_handle = handles.end_handle;
+	perception_handle.timeline_cccd_handle = handles.timeline_cccd_handle;
+	perception_handle.diag_handle = handles.diag_handle;
+	/* A bonded server keeps the service changed indications enabled */
+	service_changed_handle.char_handle = handles.service_changed_handle;
+	perception_handle.char_discovery = AT_BLE_SUCCESS;
+	perception_handle.desc_discovery = AT_BLE_SUCCESS;
+	perception_handle.handles_state = PXP_HANDLES_CACHED;
+	pxp_connect_request_flag = PXP_DEV_SERVICE_FOUND;
+	
+	DBG_LOG("Perception handles restored from cache");
+	
+	if (perception_handle.timeline_handle) {
+		if (pxp_monitor_timeline_enable(conn_handle) != AT_BLE_SUCCESS) {
+			pxp_monitor_cache_drop(conn_handle);
+		}
+	}
+	return true;
+}
+
+/**@brief Stores the discovered handles once the reporter is bonded
+*/
+static void pxp_monitor_cache_save(at_ble_handle_t conn_handle)
+{
+	gatt_cache_handles_t handles;
+	
+	if (!ble_check_bonded(conn_handle)) {
+		return;
+	}
+	
+	handles.start_handle = perception_handle.start_handle;
+	handles.end_handle = perception_handle.end_handle;
+	handles.char_handle[0] = perception_handle.char_handle1;
+	handles.char_handle[1] = perception_handle.char_handle2;
+	handles.char_handle[2] = perception_handle.char_handle3;
+	handles.char_handle[3] = perception_handle.char_handle4;
+	handles.timeline_handle = perception_handle.timeline_handle;
+	handles.timeline_cccd_handle = perception_handle.timeline_cccd_handle;
+	handles.diag_handle = perception_handle.diag_handle;
+	handles.service_changed_handle = service_changed_handle.char_handle;
+	
+	if (gatt_cache_store(&pxp_gatt_cache, pxp_peer_address.type,
+	pxp_peer_address.addr, &handles)) {
+		DBG_LOG_DEV("Perception handles cached");
+	} else {
+		DBG_LOG("Perception handles incomplete, not cached");
+	}
+}
+
+/**@brief Forgets the cached handles of the reporter and discovers again
+*/
+static at_ble_status_t pxp_monitor_cache_drop(at_ble_handle_t conn_handle)
+{
+	gatt_cache_invalidate(&pxp_gatt_cache, pxp_peer_address.type,
+	pxp_peer_address.addr);
+	DBG_LOG("Perception handles stale, rediscovering");
+	return pxp_monitor_service_discover(conn_handle);
+}
+
+/**@brief Handles the write response from the peer/connected device
+*
+*/
+at_ble_status_t pxp_monitor_characteristic_write_response(void *params)
+{
+	at_ble_characteristic_write_response_t *write_resp;
+	write_resp = (at_ble_characteristic_write_response_t *)params;
+	
+	if(!ble_check_iscentral(write_resp->conn_handle))
+	{
+		return AT_BLE_FAILURE;
+	}
+	
+	if (write_resp->status != AT_BLE_SUCCESS) {
+		TRACE_EVENT(TRACE_ID_WRITE_RESP_FAILED, write_resp->status,
+		write_resp->char_handle);
+		/* A cached handle that no longer points at the CCCD */
+		if ((perception_handle.handles_state == PXP_HANDLES_CACHED) &&
+		((write_resp->status == AT_BLE_ATT_INVALID_HANDLE) ||
+		(write_resp->status == AT_BLE_ATT_WRITE_NOT_PERMITTED) ||
+		(write_resp->status == AT_BLE_ATT_ATTRIBUTE_NOT_FOUND))) {
+			pxp_monitor_cache_drop(write_resp->conn_handle);
+		}
+		return AT_BLE_FAILURE;
+	}
+	return AT_BLE_SUCCESS;
+}
+
+/**@brief Handles the notifications from the peer/connected device
+*
+* Haptic timeline notifications are forwarded to the registered callback
+*/
+at_ble_status_t pxp_monitor_notification_handler(void *params)
+{
+	at_ble_notification_recieved_t *notification;
+	notification = (at_ble_notification_recieved_t *)params;
+	
+	if(!ble_check_iscentral(notification->conn_handle))
+	{
+		return AT_BLE_FAILURE;
+	}
+	
+	TRACE_EVENT(TRACE_ID_NOTIFICATION, notification->char_len,
+	notification->char_handle);
+	
+	if ((notification->char_handle == perception_handle.timeline_handle) &&
+	(haptic_timeline_callback != NULL)) {
+		haptic_timeline_callback(notification->char_value, notification->char_len);
+	}
+	return AT_BLE_SUCCESS;
+}
+
+/**@brief Handles the indications from the peer/connected device
+*
+* The reporter sends a service changed indication with the affected handle
+* range when its attribute table changes. Indications of other
+* characteristics are ignored.
+*/
+at_ble_status_t pxp_monitor_indication_handler(void *params)
+{
+	at_ble_indication_recieved_t *indication;
+	at_ble_handle_t start_handle;
+	at_ble_handle_t end_handle;
+	indication = (at_ble_indication_recieved_t *)params;
+	
+	if(!ble_check_iscentral(indication->conn_handle))
+	{
+		return AT_BLE_FAILURE;
+	}
+	
+	if ((service_changed_handle.char_handle == 0) ||
+	(indication->char_handle != service_changed_handle.char_handle) ||
+	(indication->char_len != PXP_SERVICE_CHANGED_LEN)) {
+		return AT_BLE_SUCCESS;
+	}
+	
+	start_handle = (at_ble_handle_t)(indication->char_value[0] |
+	(indication->char_value[1] << 8));
+	end_handle = (at_ble_handle_t)(indication->char_value[2] |
+	(indication->char_value[3] << 8));
+	
+	DBG_LOG("Service changed 0x%04x - 0x%04x", start_handle, end_handle);
+	
+	if ((perception_handle.handles_state == PXP_HANDLES_UNKNOWN) ||
+	(perception_handle.handles_state == PXP_HANDLES_DISCOVERING) ||
+	(start_handle > perception_handle.end_handle) ||
+	(end_handle < perception_handle.start_handle)) {
+		return AT_BLE_SUCCESS;
+	}
+	
+	return pxp_monitor_cache_drop(indication->conn_handle);
+}
+
 /**@brief Registers callback for hardware timer start.
 *
 * @param[in] Callback for hardware timer start function.
@@ -933,3 +1548,28 @@ void register_peripheral_state_cb(peripheral_state_cb_t peripheral_state_cb)
 {
 	peripheral_state_callback = peripheral_state_cb;
 }
+
+/**@brief Registers callback for received haptic timelines.
+*
+* @param[in] Callback receiving the raw timeline notification payload.
+*
+* @return none.
+*/
+void register_haptic_timeline_cb(haptic_timeline_cb_t timeline_cb)
+{
+	haptic_timeline_callback = timeline_cb;
+}
+
+at_ble_status_t pxp_monitor_diag_write(const uint8_t *data, uint16_t len)
+{
+	if (((perception_handle.handles_state != PXP_HANDLES_DISCOVERED) &&
+	(perception_handle.handles_state != PXP_HANDLES_CACHED)) ||
+	(perception_handle.diag_handle == 0)) {
+		return AT_BLE_INVALID_STATE;
+	}
+	
+	return at_ble_characteristic_write(pxp_conn_handle,
+	perception_handle.diag_handle,
+	0, len, (uint8_t *)data,
+	false, false);
+}
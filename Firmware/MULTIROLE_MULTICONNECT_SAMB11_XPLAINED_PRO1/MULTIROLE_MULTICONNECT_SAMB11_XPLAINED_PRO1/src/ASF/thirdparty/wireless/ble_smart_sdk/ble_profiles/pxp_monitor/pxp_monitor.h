@@ -53,6 +53,9 @@
 #define __PXP_MONITOR_H__
 
 #include "ble_manager.h"
+#include "gatt_cache.h"
+#include "adv_parse.h"
+#include "scan_sched.h"
 
 typedef enum {
 	AD_TYPE_FLAGS = 01,
@@ -65,9 +68,18 @@ typedef enum {
 	PXP_DEV_CONNECTING,
 	PXP_DEV_CONNECTED,
 	PXP_DEV_PAIRED,
-	PXP_DEV_SERVICE_FOUND
+	PXP_DEV_SERVICE_FOUND,
+	PXP_DEV_SCANNING,
+	PXP_DEV_SCAN_BACKOFF
 } PXP_DEV;
 
+typedef enum {
+	PXP_HANDLES_UNKNOWN,
+	PXP_HANDLES_DISCOVERING,
+	PXP_HANDLES_DISCOVERED,
+	PXP_HANDLES_CACHED
+} PXP_HANDLES;
+
 //   <o> Rssi Prameter Update Interval <1-10>
 //   <i> Defines inteval at which rssi value get updated.
 //   <i> Default: 1
@@ -88,6 +100,44 @@ typedef enum {
 
 #define PXP_CONNECT_REQ_INTERVAL        (20)
 
+//   <q> Auto Connect
+//   <i> Connect to the best Perception advertiser without console input.
+//   <i> Default: 1
+#define PXP_AUTO_CONNECT                (1)
+
+//   <o> Auto Connect Scan Window in seconds <1-10>
+//   <i> Time spent collecting advertisers before connecting to the best.
+//   <i> Default: 2
+#define PXP_AUTO_SCAN_TIMEOUT           (2)
+
+//   <o> Near Advertiser RSSI
+//   <i> An advertiser at or above this RSSI is connected without waiting
+//   <i> for the scan window to end.
+//   <i> Default: -60
+#define PXP_AUTO_CONNECT_NEAR_RSSI      (-60)
+
+//   <o> Scan Backoff in seconds <1-60>
+//   <i> Pause after a scan window without a Perception advertiser, doubled
+//   <i> after every empty window up to the maximum.
+//   <i> Default: 1, 32
+#define PXP_SCAN_BACKOFF_MIN            (1)
+#define PXP_SCAN_BACKOFF_MAX            (32)
+
+//   <o> Fast Reconnect Scans <0-20>
+//   <i> Back to back continuous scan windows after power up or a link loss,
+//   <i> before falling back to duty cycled scanning with backoff.
+//   <i> Default: 5
+#define PXP_FAST_RECONNECT_SCANS        (5)
+
+//   <o> Fast Reconnect Scan Window in seconds <1-10>
+//   <i> Default: 1
+#define PXP_FAST_SCAN_TIMEOUT           (1)
+
+//   <o> Duty Cycled Scan Interval and Window in 625us units
+//   <i> Default: 320 (200 ms), 48 (30 ms)
+#define PXP_SLOW_SCAN_INTERVAL          (320)
+#define PXP_SLOW_SCAN_WINDOW            (48)
+
 #define DISCOVER_SUCCESS				(10)
 #ifdef ENABLE_PTS
 #define DBG_LOG_PTS 					DBG_LOG
@@ -98,6 +148,7 @@ typedef enum {
 typedef void (*hw_timer_start_func_cb_t)(uint32_t);
 typedef void (*hw_timer_stop_func_cb_t)(void);
 typedef ble_peripheral_state_t (*peripheral_state_cb_t)(void);
+typedef void (*haptic_timeline_cb_t)(const uint8_t *, uint16_t);
 
 
 #define MAX_PERCEPTION_CHAR_SIZE        (6)
@@ -106,6 +157,15 @@ typedef ble_peripheral_state_t (*peripheral_state_cb_t)(void);
 
 #define PERCEPTION_READ_OFFSET          (0)
 
+/* Client characteristic configuration value enabling notifications */
+#define PERCEPTION_CCCD_NOTIFY          (0x0001)
+
+/* Client characteristic configuration value enabling indications */
+#define PXP_CCCD_INDICATE               (0x0002)
+
+/* Service changed indication value: affected start and end handle */
+#define PXP_SERVICE_CHANGED_LEN         (4)
+
 typedef struct gatt_perception_char_handler
 {
 	at_ble_handle_t start_handle;
@@ -114,13 +174,31 @@ typedef struct gatt_perception_char_handler
 	at_ble_handle_t char_handle2;
 	at_ble_handle_t char_handle3;
 	at_ble_handle_t char_handle4;
+	at_ble_handle_t timeline_handle;
+	at_ble_handle_t timeline_end_handle;
+	at_ble_handle_t timeline_cccd_handle;
+	at_ble_handle_t diag_handle;
 	at_ble_status_t char_discovery;
+	at_ble_status_t desc_discovery;
+	PXP_HANDLES handles_state;
 	uint8_t *char_data1;
 	uint8_t *char_data2;
 	uint8_t *char_data3;
 	uint8_t *char_data4;
 }gatt_perception_char_handler_t;
 
+/* Service Changed characteristic of the reporter's Generic Attribute service */
+typedef struct gatt_service_changed_char_handler
+{
+	at_ble_handle_t start_handle;
+	at_ble_handle_t end_handle;
+	at_ble_handle_t char_handle;
+	at_ble_handle_t char_end_handle;
+	at_ble_handle_t cccd_handle;
+	at_ble_status_t char_discovery;
+	at_ble_status_t desc_discovery;
+}gatt_service_changed_char_handler_t;
+
 
 /* *@brief Initializes Proximity profile
  * handler Pointer reference to respective variables
@@ -142,6 +220,23 @@ void pxp_monitor_init(void *param);
  */
 at_ble_status_t pxp_monitor_scan_data_handler(void *params);
 
+/**@brief Handles each advertising report while scanning
+ *
+ * In auto connect mode the report is parsed as it arrives; a bonded or near
+ * Perception advertiser is connected immediately, others are kept as the
+ * candidate for the end of the scan window.
+ *
+ * @param[in] at_ble_scan_info_t advertising report
+ */
+at_ble_status_t pxp_monitor_scan_info_handler(void *params);
+
+/**@brief Start a bounded scan for Perception advertisers
+ *
+ * @return @ref AT_BLE_SUCCESS scan started
+ * @return @ref AT_BLE_FAILURE Generic error.
+ */
+at_ble_status_t pxp_monitor_auto_scan(void);
+
 /**@brief peer device connection terminated
  *
  * handler for disconnect notification
@@ -211,6 +306,42 @@ at_ble_status_t pxp_monitor_characteristic_read_response(void *params);
  */
 at_ble_status_t pxp_monitor_characteristic_found_handler(void *params);
 
+/**@brief Handles the descriptors discovered for the haptic timeline and
+ * Service Changed characteristics
+ *
+ * Stores their client characteristic configuration descriptor handles so
+ * the timeline notifications and service changed indications can be
+ * enabled once discovery completes.
+ *
+ * @param[in] at_ble_descriptor_found_t descriptor found on the peer
+ */
+at_ble_status_t pxp_monitor_descriptor_found_handler(void *params);
+
+/**@brief Handles the write response from the peer device
+ *
+ * @param[in] at_ble_characteristic_write_response_t status of the write
+ */
+at_ble_status_t pxp_monitor_characteristic_write_response(void *params);
+
+/**@brief Handles the notifications received from the peer device
+ *
+ * Haptic timeline notifications are passed to the callback registered with
+ * @ref register_haptic_timeline_cb
+ *
+ * @param[in] at_ble_notification_recieved_t received notification
+ */
+at_ble_status_t pxp_monitor_notification_handler(void *params);
+
+/**@brief Handles the indications received from the peer device
+ *
+ * A service changed indication on the discovered Service Changed handle
+ * that covers the Perception service drops the cached handles of the peer
+ * and starts a new discovery.
+ *
+ * @param[in] at_ble_indication_recieved_t received indication
+ */
+at_ble_status_t pxp_monitor_indication_handler(void *params);
+
 /**@brief Discover the Proximity services
  *
  * Search will go from start_handle to end_handle, whenever a service is found
@@ -257,6 +388,20 @@ at_ble_status_t pxp_monitor_start_scan(void);
 void register_hw_timer_start_func_cb(hw_timer_start_func_cb_t timer_start_fn);
 void register_hw_timer_stop_func_cb(hw_timer_stop_func_cb_t timer_stop_fn);
 void register_peripheral_state_cb(peripheral_state_cb_t peripheral_state_cb);
+void register_haptic_timeline_cb(haptic_timeline_cb_t timeline_cb);
+
+/**@brief Writes a diagnostics record to the connected reporter
+ *
+ * The record goes out as a write command; it is dropped when the link is
+ * busy, the next report carries newer counters.
+ *
+ * @param[in] data record, its first byte tells the record type
+ * @param[in] len record length
+ *
+ * @return @ref AT_BLE_SUCCESS write queued
+ * @return @ref AT_BLE_INVALID_STATE no reporter with the characteristic
+ */
+at_ble_status_t pxp_monitor_diag_write(const uint8_t *data, uint16_t len);
 #endif /*__PXP_MONITOR_H__*/
 // </h>
 
@@ -55,6 +55,7 @@
 #include "timer.h"
 #include "platform.h"
 #include "console_serial.h"
+#include "trace_ring.h"
 
 #if BLE_DEVICE_ROLE == BLE_ROLE_ALL
 #ifndef ATT_DB_MEMORY
@@ -141,7 +142,7 @@ static void init_global_var(void)
 	memset(&connected_state_info, 0, sizeof(at_ble_connected_t));
 		
 #if defined ATT_DB_MEMORY
-	memset(att_db_data, 0, sizeof(uint32_t) * BLE_ATT_DB_MEMORY_SIZE/4);
+	memset(att_db_data, 0, sizeof(att_db_data));
 #endif
 
 	scan_response_count = 0;
@@ -650,6 +651,40 @@ bool ble_check_disconnected_iscentral(at_ble_handle_t handle)
 	return false;
 }
 
+bool ble_check_bonded(at_ble_handle_t handle)
+{
+	uint8_t idx;
+	
+	for (idx = 0; idx < BLE_MAX_DEVICE_CONNECTED; idx++)
+	{
+		if((ble_dev_info[idx].conn_state != BLE_DEVICE_DEFAULT_IDLE) && 
+		  (ble_dev_info[idx].conn_state != BLE_DEVICE_DISCONNECTED) &&
+		  (ble_dev_info[idx].conn_info.handle == handle))
+		{
+			return ((ble_dev_info[idx].bond_info.status == AT_BLE_SUCCESS) &&
+				(ble_dev_info[idx].bond_info.auth & AT_BLE_AUTH_NO_MITM_BOND));
+		}
+	}
+	return false;
+}
+
+bool ble_check_bonded_address(at_ble_addr_t *addr)
+{
+	uint8_t idx;
+	
+	for (idx = 0; idx < BLE_MAX_DEVICE_CONNECTED; idx++)
+	{
+		if((ble_dev_info[idx].conn_state != BLE_DEVICE_DEFAULT_IDLE) &&
+		  (ble_dev_info[idx].bond_info.status == AT_BLE_SUCCESS) &&
+		  (ble_dev_info[idx].bond_info.auth & AT_BLE_AUTH_NO_MITM_BOND) &&
+		  (!memcmp((uint8_t *)&ble_dev_info[idx].conn_info.peer_addr, (uint8_t *)addr, sizeof(at_ble_addr_t))))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 at_ble_status_t ble_connected_device_role(at_ble_handle_t conn_handle, at_ble_dev_role_t *dev_role)
 {
 	uint8_t idx;
@@ -720,7 +755,7 @@ at_ble_status_t ble_connected_state_handler(void *params)
 		conn_params->peer_addr.addr[1],
 		conn_params->peer_addr.addr[0]);
 		
-		DBG_LOG("Connection Handle %d", conn_params->handle);
+		TRACE_EVENT(TRACE_ID_CONNECTED, conn_params->conn_status, conn_params->handle);
 		
 		memcpy((uint8_t *)&connected_state_info, (uint8_t *)conn_params, sizeof(at_ble_connected_t));	
 		if(memcmp((uint8_t *)&ble_peripheral_dev_address, (uint8_t *)&conn_params->peer_addr, sizeof(at_ble_addr_t)))
@@ -768,6 +803,7 @@ at_ble_status_t ble_connected_state_handler(void *params)
 				if(!memcmp((uint8_t *)&ble_dev_info[idx].conn_info.peer_addr, (uint8_t *)&conn_params->peer_addr, sizeof(at_ble_addr_t)))
 				{
 					ble_dev_info[idx].conn_state = BLE_DEVICE_CONNECTED;
+					ble_dev_info[idx].att_mtu = AT_MTU_VAL_MIN;
 					conn_exists = true;
 					break;
 				}
@@ -783,6 +819,7 @@ at_ble_status_t ble_connected_state_handler(void *params)
 						memcpy(&ble_dev_info[idx].conn_info, (uint8_t *)conn_params, sizeof(at_ble_connected_t));
 						ble_device_count++;
 						ble_dev_info[idx].conn_state = BLE_DEVICE_CONNECTED;
+						ble_dev_info[idx].att_mtu = AT_MTU_VAL_MIN;
 						break;
 					}
 				}
@@ -885,13 +922,55 @@ at_ble_status_t ble_resolv_rand_addr_handler(void *params)
 at_ble_status_t ble_mtu_changed_indication_handler(void *params)
 {
 	at_ble_mtu_changed_ind_t *mtu_changed_ind;
+	uint8_t idx;
 	mtu_changed_ind = (at_ble_mtu_changed_ind_t *)params;
-	DBG_LOG_DEV("BLE-MTU Changed, Connection Handle: %d, New Value: %d", 
-										mtu_changed_ind->conhdl, 
-										mtu_changed_ind->mtu_value);
+	TRACE_EVENT(TRACE_ID_MTU_CHANGED, mtu_changed_ind->conhdl,
+	mtu_changed_ind->mtu_value);
+	
+	for (idx = 0; idx < BLE_MAX_DEVICE_CONNECTED; idx++)
+	{
+		if ((ble_dev_info[idx].conn_info.handle == mtu_changed_ind->conhdl) &&
+			(ble_dev_info[idx].conn_state != BLE_DEVICE_DEFAULT_IDLE))
+		{
+			ble_dev_info[idx].att_mtu = mtu_changed_ind->mtu_value;
+			break;
+		}
+	}
 	return AT_BLE_SUCCESS;
 }
 
+at_ble_status_t ble_mtu_exchange(at_ble_handle_t conn_handle)
+{
+	at_ble_status_t status;
+	
+	status = at_ble_exchange_mtu(conn_handle);
+	if (status == AT_BLE_SUCCESS)
+	{
+		DBG_LOG_DEV("MTU exchange requested, Connection Handle:%d", conn_handle);
+	}
+	else
+	{
+		DBG_LOG("MTU exchange request failed, reason %d", status);
+	}
+	return status;
+}
+
+uint16_t ble_mtu_get(at_ble_handle_t conn_handle)
+{
+	uint8_t idx;
+	
+	for (idx = 0; idx < BLE_MAX_DEVICE_CONNECTED; idx++)
+	{
+		if ((ble_dev_info[idx].conn_info.handle == conn_handle) &&
+			(ble_dev_info[idx].conn_state != BLE_DEVICE_DEFAULT_IDLE) &&
+			(ble_dev_info[idx].conn_state != BLE_DEVICE_DISCONNECTED))
+		{
+			return ble_dev_info[idx].att_mtu;
+		}
+	}
+	return AT_MTU_VAL_MIN;
+}
+
 at_ble_status_t ble_mtu_changed_cmd_complete_handler(void *params)
 {
 	at_ble_cmd_complete_event_t *cmd_complete_event;
@@ -906,9 +985,8 @@ at_ble_status_t ble_mtu_changed_cmd_complete_handler(void *params)
 	}
 	else
 	{
-		DBG_LOG("MTU Change Failed, Connection Handle:%d, Operation:%d",
-		cmd_complete_event->conn_handle,
-		cmd_complete_event->operation);
+		TRACE_EVENT(TRACE_ID_MTU_CMD_FAILED, cmd_complete_event->operation,
+		cmd_complete_event->conn_handle);
 	}
 	return AT_BLE_FAILURE;
 }
@@ -926,9 +1004,8 @@ at_ble_status_t ble_characteristic_write_cmd_complete_handler(void *params)
 	}
 	else
 	{
-		DBG_LOG_DEV("Char Write Cmd Failed, Connection Handle:%d, Operation:%d",
-		cmd_complete_event->conn_handle,
-		cmd_complete_event->operation);
+		TRACE_EVENT(TRACE_ID_WRITE_CMD_FAILED, cmd_complete_event->operation,
+		cmd_complete_event->conn_handle);
 	}
 	return AT_BLE_FAILURE;
 }
@@ -977,7 +1054,7 @@ at_ble_status_t ble_disconnected_state_handler(void *params)
 		} 
 	}
 	
-	DBG_LOG("Device disconnected Reason:0x%02x Handle=0x%x", disconnect->reason, disconnect->handle);
+	TRACE_EVENT(TRACE_ID_DISCONNECTED, disconnect->reason, disconnect->handle);
 	return AT_BLE_SUCCESS;
 }
 
@@ -1434,7 +1511,15 @@ at_ble_status_t ble_encryption_request_handler(void *params)
 
 void ble_event_manager(at_ble_events_t events, void *event_params)
 {
-	DBG_LOG_DEV("BLE-Event:%d", events);
+	/* events is rebased to the subscriber tables below */
+	uint8_t traced_event = (uint8_t)events;
+	/* Draining the trace completes write commands, tracing those would
+	 * keep the drain busy forever */
+	bool traced = (events != AT_BLE_CHARACTERISTIC_WRITE_CMD_CMP);
+	
+	if (traced) {
+		TRACE_EVENT(TRACE_ID_BLE_EVENT_BEGIN, traced_event, 0);
+	}
 	switch(events)
 	{		
 	 /* GAP events */
@@ -1631,6 +1716,10 @@ void ble_event_manager(at_ble_events_t events, void *event_params)
 	}
 	break;		
 	}
+	
+	if (traced) {
+		TRACE_EVENT(TRACE_ID_BLE_EVENT_END, traced_event, 0);
+	}
 }
 
 /* Advertisement Data will be set based on the advertisement configuration */
@@ -337,6 +337,9 @@ typedef enum
 
 /** @brief Service UUID's */
 
+/* Generic Attribute service UUID */
+#define GENERIC_ATTRIBUTE_SERVICE_UUID          (0x1801)
+
 /* Blood Pressure Service UUID */
 #define BLOOD_PRESSURE_SERVICE_UUID             (0x1810)
 
@@ -405,6 +408,15 @@ typedef enum
 /* Vibe 4 Intensity Characteristic UUID */
 #define VIBE4_INTENSITY_CHAR_UUID               (0xE7CA)
 
+/* Haptic Timeline Characteristic UUID */
+#define HAPTIC_TIMELINE_CHAR_UUID               (0x5B7C)
+
+/* Perception Diagnostics Characteristic UUID */
+#define PERCEPTION_DIAG_CHAR_UUID               (0xD1A6)
+
+/* Service Changed Characteristic UUID */
+#define SERVICE_CHANGED_CHAR_UUID               (0x2A05)
+
 /* Alert Level Characteristic UUID */
 #define ALERT_LEVEL_CHAR_UUID					(0x2A06)
 
@@ -457,6 +469,9 @@ typedef enum
 #define DIS_CHAR_PNP_ID_UUID					(0x2A50)
 
 #define HID_REPORT_REF_DESC						(0x2908)
+
+/** Client Characteristic Configuration descriptor UUID */
+#define CLIENT_CHAR_CONFIG_DESC_UUID			(0x2902)
 /** HID Protocol Mode Characteristic UUID. */
 #define HID_UUID_CHAR_PROTOCOL_MODE				(0x2A4E)
 
@@ -523,7 +538,7 @@ typedef enum
 //	<i> Defines SuperVision Timeout for GAP Connection.
 //	<i> Default: 0x1f4
 //	<id> gap_supervision_timout												
-#define GAP_SUPERVISION_TIMOUT			(0x1f4)		// 500 for supervision time-out
+#define GAP_SUPERVISION_TIMOUT			(0x64)		// 1s supervision time-out, detects a lost phone quickly
 
 /** number of connections */ 
 #define GAP_CONNECT_PEER_COUNT			(1)
@@ -579,6 +594,7 @@ typedef struct ble_connected_dev_info
 	at_ble_pair_done_t bond_info;
 	ble_device_state_t conn_state;
 	at_ble_LTK_t host_ltk;
+	uint16_t att_mtu;
 }ble_connected_dev_info_t;
 
 
@@ -1652,6 +1668,24 @@ at_ble_status_t ble_connected_device_role(at_ble_handle_t conn_handle, at_ble_de
 
 bool ble_check_disconnected_iscentral(at_ble_handle_t handle);
 
+/** @brief function to check whether a connected peer has bonded
+  *
+  * @param[in] handle connection handle of the peer
+  *
+  * @return true if keys were exchanged or restored with bonding
+  *
+  */
+bool ble_check_bonded(at_ble_handle_t handle);
+
+/** @brief function to check whether an address belongs to a bonded peer
+  *
+  * @param[in] addr peer address as seen while scanning
+  *
+  * @return true if bonding information is stored for the address
+  *
+  */
+bool ble_check_bonded_address(at_ble_addr_t *addr);
+
 at_ble_status_t ble_disconnected_device_role(at_ble_handle_t conn_handle, at_ble_dev_role_t *dev_role);
 
 at_ble_status_t ble_check_device_state(at_ble_handle_t conn_handle, ble_device_state_t state);
@@ -1666,6 +1700,26 @@ at_ble_status_t ble_mtu_changed_indication_handler(void *params);
 
 at_ble_status_t ble_mtu_changed_cmd_complete_handler(void *params);
 
+/** @brief function to request the ATT MTU exchange, the link settles on the
+  * smaller of the local and peer maximum.
+  *
+  * @param[in] conn_handle connection handle.
+  *
+  * @return @ref AT_BLE_SUCCESS operation completed successfully.
+  * @return @ref AT_BLE_FAILURE Generic error.
+  *
+  */
+at_ble_status_t ble_mtu_exchange(at_ble_handle_t conn_handle);
+
+/** @brief function to get the ATT MTU in use on a connection.
+  *
+  * @param[in] conn_handle connection handle.
+  *
+  * @return negotiated MTU, @ref AT_MTU_VAL_MIN until an exchange completes.
+  *
+  */
+uint16_t ble_mtu_get(at_ble_handle_t conn_handle);
+
 at_ble_status_t ble_characteristic_write_cmd_complete_handler(void *params);
 
 at_ble_status_t ble_undefined_event_handler(void *params);
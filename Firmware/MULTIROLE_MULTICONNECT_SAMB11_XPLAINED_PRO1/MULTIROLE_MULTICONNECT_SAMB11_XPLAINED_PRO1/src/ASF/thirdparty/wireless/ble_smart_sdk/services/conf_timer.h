@@ -49,4 +49,19 @@
 
 #define CONF_TIMER_RELOAD_VALUE    26000000
 
+/* Period of the free running millisecond tick */
+#define CONF_TIMER_TICK_MS         5
+#define CONF_TIMER_TICK_RELOAD     (CONF_TIMER_RELOAD_VALUE / 1000 * CONF_TIMER_TICK_MS)
+
+/* Timer counts to microseconds as a Q16 multiplier, the core has no divider */
+#define CONF_TIMER_CLK_MHZ         (CONF_TIMER_RELOAD_VALUE / 1000000)
+#define CONF_TIMER_US_Q16          ((65536 + (CONF_TIMER_CLK_MHZ / 2)) / CONF_TIMER_CLK_MHZ)
+
+/* AON sleep timer clock, keeps the millisecond tick across ULP */
+#define CONF_AON_SLEEP_CLK_BITS    15
+#define CONF_AON_SLEEP_CLK_HZ      (1ul << CONF_AON_SLEEP_CLK_BITS)
+
+/* Longest suspend in one go; the loop wakes and suspends again */
+#define CONF_AON_SLEEP_MAX_MS      100000
+
 #endif /* CONF_TIMER_H_INCLUDED */
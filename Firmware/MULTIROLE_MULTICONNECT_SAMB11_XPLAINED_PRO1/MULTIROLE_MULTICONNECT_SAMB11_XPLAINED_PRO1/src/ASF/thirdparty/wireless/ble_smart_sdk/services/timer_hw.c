@@ -6,6 +6,14 @@
 
 extern struct uart_module uart_instance;
 
+static volatile uint32_t hw_tick_ms = 0;
+static hw_timer_callback_t hw_tick_callback = NULL;
+
+/* AON sleep timer count programmed by hw_tick_suspend() */
+static bool hw_tick_suspended = false;
+static uint32_t hw_tick_sleep_count;
+static uint32_t hw_tick_sleep_frac = 0;
+
 void dualtimer_callback2(void)
 {
 	puts("Timer2 trigger\r\n");
@@ -47,3 +55,134 @@ void hw_timer_stop(void)
 {
 	dualtimer_disable(DUALTIMER_TIMER1);
 }
+
+static void hw_tick_handler(void)
+{
+	hw_tick_ms += CONF_TIMER_TICK_MS;
+
+	if (hw_tick_callback) {
+		hw_tick_callback();
+	}
+}
+
+static void hw_tick_aon_handler(void)
+{
+	AON_SLEEP_TIMER0->CONTROL.reg |= AON_SLEEP_TIMER_CONTROL_IRQ_CLEAR;
+
+	/* Wake the event loop so the scheduled deadline is served */
+	send_plf_int_msg_ind(USER_TIMER_CALLBACK, TIMER_EXPIRED_CALLBACK_TYPE_DETECT, NULL, 0);
+}
+
+static void hw_tick_start(void)
+{
+	struct timer_config config_timer;
+	timer_get_config_defaults(&config_timer);
+
+	config_timer.reload_value = CONF_TIMER_TICK_RELOAD;
+
+	timer_init(&config_timer);
+	timer_register_callback(hw_tick_handler);
+
+	NVIC_EnableIRQ(TIMER0_IRQn);
+	timer_enable();
+}
+
+void hw_tick_init(hw_timer_callback_t tick_callback)
+{
+	hw_tick_callback = tick_callback;
+
+	system_register_isr(RAM_ISR_TABLE_AON_SLEEP_TIMER_INDEX,
+			(uint32_t)hw_tick_aon_handler);
+	NVIC_EnableIRQ(AON_SLEEP_TIMER_IRQn);
+
+	hw_tick_start();
+}
+
+void hw_tick_suspend(uint32_t wake_ms)
+{
+	if ((wake_ms == 0) || (wake_ms > CONF_AON_SLEEP_MAX_MS)) {
+		wake_ms = CONF_AON_SLEEP_MAX_MS;
+	}
+
+	timer_disable();
+
+	/* The sleep timer runs through ULP; it measures the time the tick
+	 * misses and raises the wakeup when it expires */
+	hw_tick_sleep_count = (wake_ms << CONF_AON_SLEEP_CLK_BITS) / 1000;
+	AON_SLEEP_TIMER0->CONTROL.reg = 0;
+	AON_SLEEP_TIMER0->SINGLE_COUNT_DURATION.reg = hw_tick_sleep_count;
+	AON_SLEEP_TIMER0->CONTROL.reg = AON_SLEEP_TIMER_CONTROL_SINGLE_COUNT_ENABLE;
+	hw_tick_suspended = true;
+}
+
+bool hw_tick_resume(void)
+{
+	uint32_t remaining;
+	uint32_t elapsed = 0;
+	uint32_t frac;
+
+	if (!hw_tick_suspended) {
+		return false;
+	}
+
+	remaining = AON_SLEEP_TIMER0->CURRENT_COUNT_VALUE.reg;
+	AON_SLEEP_TIMER0->CONTROL.reg = 0;
+	if (remaining < hw_tick_sleep_count) {
+		elapsed = hw_tick_sleep_count - remaining;
+	}
+
+	/* Sleep clock ticks to ms, carrying the fraction to the next resume */
+	frac = ((elapsed & (CONF_AON_SLEEP_CLK_HZ - 1)) * 1000) + hw_tick_sleep_frac;
+	hw_tick_ms += ((elapsed >> CONF_AON_SLEEP_CLK_BITS) * 1000)
+			+ (frac >> CONF_AON_SLEEP_CLK_BITS);
+	hw_tick_sleep_frac = frac & (CONF_AON_SLEEP_CLK_HZ - 1);
+
+	/* ULP does not retain the timer configuration */
+	hw_tick_start();
+	hw_tick_suspended = false;
+	return true;
+}
+
+uint32_t hw_tick_get_ms(void)
+{
+	return hw_tick_ms;
+}
+
+/* Milliseconds and microseconds into the current tick */
+static void hw_tick_read(uint32_t *ms, uint32_t *frac_us)
+{
+	uint32_t count;
+
+	/* Read the count again if the tick advanced in between */
+	do {
+		*ms = hw_tick_ms;
+		count = timer_get_value();
+	} while (*ms != hw_tick_ms);
+
+	if (hw_tick_suspended) {
+		*frac_us = 0;
+		return;
+	}
+
+	/* The timer counts down from the reload value within the tick */
+	*frac_us = ((CONF_TIMER_TICK_RELOAD - count) * CONF_TIMER_US_Q16) >> 16;
+}
+
+uint32_t hw_tick_get_us(void)
+{
+	uint32_t ms;
+	uint32_t frac_us;
+
+	hw_tick_read(&ms, &frac_us);
+	return (ms * 1000) + frac_us;
+}
+
+uint64_t hw_tick_get_us64(void)
+{
+	uint32_t ms;
+	uint32_t frac_us;
+
+	/* Low 32 bits of the milliseconds are hw_tick_get_ms() */
+	hw_tick_read(&ms, &frac_us);
+	return ((uint64_t)ms * 1000) + frac_us;
+}
@@ -8,6 +8,13 @@ void hw_timer_register_callback(hw_timer_callback_t cb_ptr);
 void hw_timer_start(uint32_t delay);
 void hw_timer_stop(void);
 
+void hw_tick_init(hw_timer_callback_t cb_ptr);
+uint32_t hw_tick_get_ms(void);
+uint32_t hw_tick_get_us(void);
+uint64_t hw_tick_get_us64(void);
+void hw_tick_suspend(uint32_t wake_ms);
+bool hw_tick_resume(void);
+
 void dualtimer_callback2(void);
 
 #define PWR_WAKEUP_DOMAIN_ARM   (1)
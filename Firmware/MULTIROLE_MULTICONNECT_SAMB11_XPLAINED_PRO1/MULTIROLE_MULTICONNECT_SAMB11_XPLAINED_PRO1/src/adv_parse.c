@@ -0,0 +1,103 @@
+/**
+ * \file
+ *
+ * \brief Advertising data parser and connect candidate selection
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "adv_parse.h"
+
+bool adv_parse(const uint8_t *data, uint8_t len, uint16_t service_uuid,
+		adv_report_t *report)
+{
+	uint8_t index = 0;
+
+	memset(report, 0, sizeof(adv_report_t));
+
+	while (index < len) {
+		uint8_t field_len = data[index];
+		const uint8_t *field;
+		uint8_t data_len;
+
+		/* Zero length marks the end of significant data */
+		if (field_len == 0) {
+			break;
+		}
+		if (field_len > (uint8_t)(len - index - 1)) {
+			return false;
+		}
+
+		field = &data[index + 2];
+		data_len = field_len - 1;
+
+		switch (data[index + 1]) {
+		case ADV_TYPE_FLAGS:
+			if (data_len) {
+				report->has_flags = true;
+				report->flags = field[0];
+			}
+			break;
+
+		case ADV_TYPE_INCOMPLETE_UUID16:
+		case ADV_TYPE_COMPLETE_UUID16:
+		{
+			uint8_t pos;
+
+			for (pos = 0; (pos + 1) < data_len; pos += 2) {
+				if ((uint16_t)(field[pos] | (field[pos + 1] << 8)) == service_uuid) {
+					report->service_found = true;
+					break;
+				}
+			}
+		}
+		break;
+
+		case ADV_TYPE_SHORTENED_LOCAL_NAME:
+		case ADV_TYPE_COMPLETE_LOCAL_NAME:
+			report->name = field;
+			report->name_len = data_len;
+			break;
+
+		case ADV_TYPE_TX_POWER:
+			if (data_len) {
+				report->has_tx_power = true;
+				report->tx_power = (int8_t)field[0];
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		index += field_len + 1;
+	}
+
+	return true;
+}
+
+void adv_select_reset(adv_candidate_t *best)
+{
+	memset(best, 0, sizeof(adv_candidate_t));
+}
+
+bool adv_select_offer(adv_candidate_t *best, uint8_t addr_type,
+		const uint8_t *addr, int8_t rssi, bool bonded)
+{
+	if (best->valid) {
+		if (best->bonded && !bonded) {
+			return false;
+		}
+		if ((best->bonded == bonded) && (rssi <= best->rssi)) {
+			return false;
+		}
+	}
+
+	best->valid = true;
+	best->bonded = bonded;
+	best->rssi = rssi;
+	best->addr_type = addr_type;
+	memcpy(best->addr, addr, ADV_ADDR_LEN);
+	return true;
+}
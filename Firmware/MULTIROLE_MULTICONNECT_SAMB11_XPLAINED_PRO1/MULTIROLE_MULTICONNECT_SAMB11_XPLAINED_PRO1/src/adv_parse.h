@@ -0,0 +1,84 @@
+/**
+ * \file
+ *
+ * \brief Advertising data parser and connect candidate selection
+ *
+ * adv_parse() walks the AD structures of one advertising or scan response
+ * payload once and records everything the Perception central needs to
+ * decide on a connection: the flags, whether a 16-bit service UUID is
+ * listed, the TX power and the local name. Truncated structures end the
+ * walk instead of reading past the payload.
+ *
+ * The candidate selection keeps the best advertiser seen during a scan
+ * window: a bonded peer wins over any other, otherwise the strongest RSSI.
+ *
+ * Plain C without BLE stack dependencies so it builds on a host for testing.
+ */
+
+#ifndef __ADV_PARSE_H__
+#define __ADV_PARSE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADV_TYPE_FLAGS                  (0x01)
+#define ADV_TYPE_INCOMPLETE_UUID16      (0x02)
+#define ADV_TYPE_COMPLETE_UUID16        (0x03)
+#define ADV_TYPE_SHORTENED_LOCAL_NAME   (0x08)
+#define ADV_TYPE_COMPLETE_LOCAL_NAME    (0x09)
+#define ADV_TYPE_TX_POWER               (0x0A)
+
+#define ADV_ADDR_LEN                    (6)
+
+typedef struct adv_report {
+	bool has_flags;
+	uint8_t flags;
+	bool service_found;
+	bool has_tx_power;
+	int8_t tx_power;
+	/* points into the parsed payload, NULL if absent */
+	const uint8_t *name;
+	uint8_t name_len;
+} adv_report_t;
+
+typedef struct adv_candidate {
+	bool valid;
+	bool bonded;
+	int8_t rssi;
+	uint8_t addr_type;
+	uint8_t addr[ADV_ADDR_LEN];
+} adv_candidate_t;
+
+/**@brief Parse an advertising or scan response payload
+ *
+ * @param[in] data AD structures
+ * @param[in] len payload length
+ * @param[in] service_uuid 16-bit service UUID to look for
+ * @param[out] report parsed fields
+ *
+ * @return false if the payload was malformed; fields found before the
+ * malformed structure are still reported
+ */
+bool adv_parse(const uint8_t *data, uint8_t len, uint16_t service_uuid,
+		adv_report_t *report);
+
+/**@brief Forget the current candidate
+ */
+void adv_select_reset(adv_candidate_t *best);
+
+/**@brief Offer an advertiser of the wanted service
+ *
+ * @return true if it became the new candidate
+ */
+bool adv_select_offer(adv_candidate_t *best, uint8_t addr_type,
+		const uint8_t *addr, int8_t rssi, bool bonded);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ADV_PARSE_H__ */
@@ -0,0 +1,179 @@
+/**
+ * \file
+ *
+ * \brief Wearable battery estimate and motor power budget
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "battery_gov.h"
+
+/* Charge of 1 uAh */
+#define UAMS_PER_UAH                    (3600000UL)
+
+static void put_le16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+}
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+	put_le16(buf, (uint16_t)value);
+	put_le16(&buf[2], (uint16_t)(value >> 16));
+}
+
+static uint32_t gov_current(const battery_gov_t *gov, uint32_t duty_sum)
+{
+	return gov->conf.base_ua + (uint32_t)(((uint64_t)gov->conf.motor_ua
+			* duty_sum) / BATTERY_GOV_DUTY_MAX);
+}
+
+/* Rounded up, so 0 percent means empty */
+static uint8_t gov_level(const battery_gov_t *gov)
+{
+	if (gov->conf.capacity_uah == 0) {
+		return 0;
+	}
+	return (uint8_t)(((uint64_t)gov->remaining_uah * 100
+			+ gov->conf.capacity_uah - 1) / gov->conf.capacity_uah);
+}
+
+static uint8_t gov_budget(const battery_gov_t *gov)
+{
+	const battery_gov_config_t *conf = &gov->conf;
+
+	if (gov->level_pct >= conf->low_pct) {
+		return 100;
+	}
+	if ((gov->level_pct <= conf->critical_pct) ||
+			(conf->low_pct <= conf->critical_pct)) {
+		return conf->min_budget_pct;
+	}
+	return (uint8_t)(conf->min_budget_pct + ((uint32_t)(100 - conf->min_budget_pct)
+			* (gov->level_pct - conf->critical_pct))
+			/ (conf->low_pct - conf->critical_pct));
+}
+
+void battery_gov_init(battery_gov_t *gov, const battery_gov_config_t *conf,
+		uint32_t now_ms, uint8_t level_pct)
+{
+	memset(gov, 0, sizeof(battery_gov_t));
+	gov->conf = *conf;
+	if (gov->conf.min_budget_pct > 100) {
+		gov->conf.min_budget_pct = 100;
+	}
+	if (level_pct > 100) {
+		level_pct = 100;
+	}
+
+	gov->last_ms = now_ms;
+	gov->current_ua = gov_current(gov, 0);
+	gov->avg_ua = gov->current_ua;
+	gov->remaining_uah = (uint32_t)(((uint64_t)conf->capacity_uah
+			* level_pct) / 100);
+	gov->level_pct = gov_level(gov);
+	gov->budget_pct = gov_budget(gov);
+	gov->flags = BATTERY_GOV_FLAG_ESTIMATED;
+}
+
+bool battery_gov_update(battery_gov_t *gov, uint32_t now_ms,
+		uint32_t duty_sum)
+{
+	uint32_t elapsed_ms = now_ms - gov->last_ms;
+	uint64_t interval_uams = (uint64_t)gov->current_ua * elapsed_ms;
+	uint64_t charge_uams = interval_uams + gov->charge_uams;
+	uint8_t previous = gov->level_pct;
+	uint32_t used_uah;
+
+	gov->last_ms = now_ms;
+	gov->elapsed_ms += elapsed_ms;
+	gov->current_ua = gov_current(gov, duty_sum);
+
+	used_uah = (uint32_t)(charge_uams / UAMS_PER_UAH);
+	gov->charge_uams = (uint32_t)(charge_uams % UAMS_PER_UAH);
+	gov->remaining_uah = (used_uah < gov->remaining_uah) ?
+			(gov->remaining_uah - used_uah) : 0;
+
+	/* Average per window, smoothed over the last few windows */
+	gov->window_uams += interval_uams;
+	gov->window_ms += elapsed_ms;
+	if (gov->window_ms >= BATTERY_GOV_AVG_WINDOW_MS) {
+		uint32_t window_ua = (uint32_t)(gov->window_uams / gov->window_ms);
+
+		gov->avg_ua = (uint32_t)(((uint64_t)gov->avg_ua * 3 + window_ua) / 4);
+		gov->window_uams = 0;
+		gov->window_ms = 0;
+	}
+
+	gov->level_pct = gov_level(gov);
+	gov->budget_pct = gov_budget(gov);
+	return gov->level_pct != previous;
+}
+
+bool battery_gov_scale(battery_gov_t *gov, uint8_t *level, uint8_t count)
+{
+	uint32_t budget;
+	uint32_t sum = 0;
+	uint8_t idx;
+
+	if (gov->budget_pct >= 100) {
+		return false;
+	}
+
+	for (idx = 0; idx < count; idx++) {
+		sum += level[idx];
+	}
+	budget = ((uint32_t)gov->conf.level_budget * gov->budget_pct) / 100;
+	if (sum <= budget) {
+		return false;
+	}
+
+	/* One factor for every motor keeps their order */
+	for (idx = 0; idx < count; idx++) {
+		if (level[idx]) {
+			uint8_t scaled = (uint8_t)(((uint32_t)level[idx] * budget) / sum);
+
+			level[idx] = scaled ? scaled : 1;
+		}
+	}
+	gov->scaled_outputs++;
+	return true;
+}
+
+uint16_t battery_gov_runtime_min(const battery_gov_t *gov)
+{
+	uint32_t runtime_min;
+
+	if (gov->avg_ua == 0) {
+		return BATTERY_GOV_RUNTIME_MAX;
+	}
+	runtime_min = (uint32_t)(((uint64_t)gov->remaining_uah * 60) / gov->avg_ua);
+	return (runtime_min > BATTERY_GOV_RUNTIME_MAX) ?
+			BATTERY_GOV_RUNTIME_MAX : (uint16_t)runtime_min;
+}
+
+uint16_t battery_gov_elapsed_min(const battery_gov_t *gov)
+{
+	uint64_t elapsed_min = gov->elapsed_ms / 60000;
+
+	return (elapsed_min > 0xFFFF) ? 0xFFFF : (uint16_t)elapsed_min;
+}
+
+uint8_t battery_gov_encode(const battery_gov_t *gov, uint8_t *buf,
+		uint8_t buf_len)
+{
+	if (buf_len < BATTERY_GOV_RECORD_SIZE) {
+		return 0;
+	}
+
+	buf[0] = BATTERY_GOV_RECORD;
+	buf[1] = gov->level_pct;
+	put_le16(&buf[2], battery_gov_runtime_min(gov));
+	put_le32(&buf[4], gov->avg_ua);
+	buf[8] = gov->budget_pct;
+	buf[9] = gov->flags;
+	put_le16(&buf[10], battery_gov_elapsed_min(gov));
+	return BATTERY_GOV_RECORD_SIZE;
+}
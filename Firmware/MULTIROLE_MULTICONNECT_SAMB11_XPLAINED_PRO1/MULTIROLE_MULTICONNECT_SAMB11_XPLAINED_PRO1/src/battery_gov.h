@@ -0,0 +1,141 @@
+/**
+ * \file
+ *
+ * \brief Wearable battery estimate and motor power budget
+ *
+ * The wearable has no battery gauge, but the motors dominate its current
+ * and their duty is known. The governor counts the charge drawn since it
+ * was started from a full battery: a base current for the MCU and radio
+ * plus motor_ua for every motor at full duty, scaled by the duty actually
+ * driven. From that it keeps the battery level, an average current and the
+ * runtime left at that average.
+ *
+ * Below low_pct the sum of the motor levels is capped at a share of
+ * level_budget that shrinks linearly to min_budget_pct at critical_pct.
+ * An output over the cap is scaled down as a whole, so a stronger alert
+ * never ends up weaker than a lesser one and a driven motor never stops.
+ *
+ * The level is only as good as the start level given to
+ * battery_gov_init(), a reset starts the count again. The record says so
+ * with BATTERY_GOV_FLAG_ESTIMATED and the minutes counted since the start.
+ *
+ * The estimate is reported as a diagnostics record:
+ *
+ *   offset  size  field
+ *   0       1     BATTERY_GOV_RECORD
+ *   1       1     level, percent
+ *   2       2     runtime left, minutes
+ *   4       4     average current, uA
+ *   8       1     motor budget, percent
+ *   9       1     flags
+ *   10      2     minutes counted since the start, saturates
+ *
+ * Plain C so a discharge can be simulated on a host.
+ */
+
+#ifndef __BATTERY_GOV_H__
+#define __BATTERY_GOV_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* First byte of the battery record on the diagnostics characteristic */
+#define BATTERY_GOV_RECORD              (0x03)
+
+#define BATTERY_GOV_RECORD_SIZE         (12)
+
+/* Level counted from an assumed start level since the last reset, not
+ * measured */
+#define BATTERY_GOV_FLAG_ESTIMATED      (0x01)
+
+/* Averaging window of the current; every window moves the average a
+ * quarter of the way, within 5 percent of a step 12 windows after it */
+#define BATTERY_GOV_AVG_WINDOW_MS       (10000)
+
+/* Full scale of a motor duty, as in motor_ctrl.h */
+#define BATTERY_GOV_DUTY_MAX            (1023)
+
+/* Runtime reported when no current is drawn */
+#define BATTERY_GOV_RUNTIME_MAX         (0xFFFF)
+
+typedef struct battery_gov_config {
+	uint32_t capacity_uah;
+	/* MCU and radio, averaged over connection events and sleep */
+	uint32_t base_ua;
+	/* one motor at full duty */
+	uint32_t motor_ua;
+	uint8_t low_pct;
+	uint8_t critical_pct;
+	uint8_t min_budget_pct;
+	/* sum of the motor levels allowed at a 100 percent budget */
+	uint16_t level_budget;
+} battery_gov_config_t;
+
+typedef struct battery_gov {
+	battery_gov_config_t conf;
+	uint32_t last_ms;
+	/* current drawn since last_ms */
+	uint32_t current_ua;
+	uint32_t remaining_uah;
+	/* charge below 1 uAh not yet taken from remaining_uah */
+	uint32_t charge_uams;
+	uint32_t avg_ua;
+	uint64_t window_uams;
+	uint32_t window_ms;
+	uint8_t level_pct;
+	uint8_t budget_pct;
+	uint8_t flags;
+	/* time counted since the start */
+	uint64_t elapsed_ms;
+	/* statistics */
+	uint16_t scaled_outputs;
+} battery_gov_t;
+
+/**@brief Start from a battery assumed at level_pct with the motors off
+ */
+void battery_gov_init(battery_gov_t *gov, const battery_gov_config_t *conf,
+		uint32_t now_ms, uint8_t level_pct);
+
+/**@brief Count the charge drawn up to now_ms
+ *
+ * Call whenever the motor duty changes and regularly in between.
+ *
+ * @param[in] duty_sum sum of the duties of the driven motors from now on
+ *
+ * @return true if the battery level changed
+ */
+bool battery_gov_update(battery_gov_t *gov, uint32_t now_ms,
+		uint32_t duty_sum);
+
+/**@brief Apply the motor budget to an output
+ *
+ * @param[in,out] level one level per motor
+ *
+ * @return true if the output was scaled down
+ */
+bool battery_gov_scale(battery_gov_t *gov, uint8_t *level, uint8_t count);
+
+/**@brief Minutes left at the average current
+ */
+uint16_t battery_gov_runtime_min(const battery_gov_t *gov);
+
+/**@brief Minutes counted since the start, saturated at 0xFFFF
+ */
+uint16_t battery_gov_elapsed_min(const battery_gov_t *gov);
+
+/**@brief Serialize the battery record
+ *
+ * @return number of bytes written, 0 if buf_len is too small
+ */
+uint8_t battery_gov_encode(const battery_gov_t *gov, uint8_t *buf,
+		uint8_t buf_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BATTERY_GOV_H__ */
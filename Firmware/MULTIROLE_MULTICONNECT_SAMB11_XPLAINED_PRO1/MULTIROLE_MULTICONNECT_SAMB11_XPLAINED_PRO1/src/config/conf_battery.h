@@ -0,0 +1,31 @@
+/**
+ * \file
+ *
+ * \brief Perception battery estimate and motor budget configuration
+ *
+ */
+
+#ifndef CONF_BATTERY_H_INCLUDED
+#define CONF_BATTERY_H_INCLUDED
+
+/* Cell capacity; the estimate starts from a full cell at every reset */
+#define CONF_BATTERY_CAPACITY_MAH       (150)
+
+/* MCU and radio while connected, averaged over sleep and connection
+ * events */
+#define CONF_BATTERY_BASE_UA            (1200)
+
+/* One coin motor at full duty */
+#define CONF_BATTERY_MOTOR_UA           (75000)
+
+/* Level below which the motor budget starts to shrink, and the level at
+ * which it reaches CONF_BATTERY_MIN_BUDGET_PCT */
+#define CONF_BATTERY_LOW_PCT            (30)
+#define CONF_BATTERY_CRITICAL_PCT       (10)
+#define CONF_BATTERY_MIN_BUDGET_PCT     (40)
+
+/* Sum of the motor levels allowed at full budget, two motors at full
+ * strength */
+#define CONF_BATTERY_LEVEL_BUDGET       (510)
+
+#endif /* CONF_BATTERY_H_INCLUDED */
@@ -0,0 +1,24 @@
+/**
+ * \file
+ *
+ * \brief Perception haptic output filter configuration
+ *
+ */
+
+#ifndef CONF_HAPTIC_FILTER_H_INCLUDED
+#define CONF_HAPTIC_FILTER_H_INCLUDED
+
+/* Second order Butterworth low-pass, 12 Hz at the 200 Hz tick, in the
+ * CMSIS DF1 q15 layout {b0, 0, b1, b2, -a1, -a2} with a postShift of 1;
+ * b1 is rounded up so the DC gain is exactly one. Recompute when
+ * CONF_TIMER_TICK_MS changes. */
+#define CONF_HAPTIC_FILTER_COEFFS       { 456, 0, 914, 456, 24174, -9616 }
+
+/* Largest change of a motor's level per tick, in levels; 0 disables the
+ * limit. 32 levels a tick covers the full range in 40 ms. */
+#define CONF_HAPTIC_FILTER_MAX_STEP     (32)
+
+/* Gain of every motor in q15, 0x7FFF for unity */
+#define CONF_HAPTIC_FILTER_GAIN         { 0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF }
+
+#endif /* CONF_HAPTIC_FILTER_H_INCLUDED */
@@ -0,0 +1,41 @@
+/**
+ * \file
+ *
+ * \brief Perception vibration motor driver configuration
+ *
+ */
+
+#ifndef CONF_MOTOR_H_INCLUDED
+#define CONF_MOTOR_H_INCLUDED
+
+#include <board.h>
+
+/* Motor n is driven by hardware PWM channel n (PWM1..PWM4) routed through
+ * the mega mux to CONF_MOTOR_PWM_PIN_n; CONF_MOTOR_STATIC_PIN_n is the
+ * second H-bridge input. */
+#define CONF_MOTOR_PWM_PIN_0            PIN_LP_GPIO_10
+#define CONF_MOTOR_PWM_PIN_1            PIN_LP_GPIO_11
+#define CONF_MOTOR_PWM_PIN_2            PIN_LP_GPIO_12
+#define CONF_MOTOR_PWM_PIN_3            PIN_LP_GPIO_13
+
+#define CONF_MOTOR_STATIC_PIN_0         PIN_LP_GPIO_16
+#define CONF_MOTOR_STATIC_PIN_1         PIN_LP_GPIO_17
+#define CONF_MOTOR_STATIC_PIN_2         PIN_LP_GPIO_18
+#define CONF_MOTOR_STATIC_PIN_3         PIN_LP_GPIO_19
+
+/* PWM source clock, 26 MHz */
+#define CONF_MOTOR_PWM_CLOCK_SEL        LPMCU_MISC_REGS_PWM_1_CONTROL_CLOCK_SEL_0_Val
+
+/* PWM update period field, 0 for the shortest period (above the audible
+ * range at 26 MHz) */
+#define CONF_MOTOR_PWM_PERIOD           (0)
+
+/* Output for level 0: MOTOR_STOP_BRAKE stops the motor within a few
+ * revolutions, MOTOR_STOP_COAST lets it spin down */
+#define CONF_MOTOR_STOP_MODE            MOTOR_STOP_BRAKE
+
+/* Duty for the lowest non-zero level, out of MOTOR_CTRL_DUTY_MAX; below
+ * this the motors do not start reliably */
+#define CONF_MOTOR_MIN_DUTY             (300)
+
+#endif /* CONF_MOTOR_H_INCLUDED */
@@ -0,0 +1,136 @@
+/**
+ * \file
+ *
+ * \brief Parameter record in the SPI flash
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include <asf.h>
+#include "flash_store.h"
+
+#define FLASH_STORE_ADDRESS             (SPI_FLASH0_FLASH_SIZE - FLASH_STORE_SECTOR_SIZE)
+
+#define FLASH_CMD_PAGE_PROGRAM          (0x02)
+#define FLASH_CMD_READ                  (0x03)
+#define FLASH_CMD_READ_STATUS           (0x05)
+#define FLASH_CMD_WRITE_ENABLE          (0x06)
+#define FLASH_CMD_SECTOR_ERASE          (0x20)
+#define FLASH_CMD_RELEASE_POWER_DOWN    (0xAB)
+
+/* Write in progress bit of the status register */
+#define FLASH_STATUS_BUSY               (0x01)
+
+/* Polls of a transaction, and of the status during an erase, before the
+ * flash is given up on */
+#define FLASH_TRANS_POLLS               (100000)
+#define FLASH_BUSY_POLLS                (1000000)
+
+/* The controller moves the data by DMA, from and to word aligned RAM */
+static uint32_t flash_buf[FLASH_STORE_PAGE_SIZE / 4];
+
+/* Command byte followed by the address, most significant byte first */
+static uint32_t flash_cmd(uint8_t cmd, uint32_t address)
+{
+	return (uint32_t)cmd | (((address >> 16) & 0xFF) << 8) |
+			(((address >> 8) & 0xFF) << 16) | ((address & 0xFF) << 24);
+}
+
+/* Sends cmd_len command bytes, then writes or reads len bytes of flash_buf */
+static bool flash_transaction(uint32_t cmd, uint8_t cmd_len, uint16_t len, bool write)
+{
+	uint32_t polls = 0;
+
+	SPI_FLASH0->READ_CTRL.reg = write ? 0 : SPI_FLASH_READ_CTRL_RDATA_COUNT(len);
+	SPI_FLASH0->CMD_BUFFER0.reg = cmd;
+	SPI_FLASH0->DIRECTION.reg = (uint8_t)((1 << cmd_len) - 1);
+	SPI_FLASH0->DMA_START_ADDRESS.reg = (uint32_t)flash_buf;
+	SPI_FLASH0->TRANSACTION_CTRL.reg = SPI_FLASH_TRANSACTION_CTRL_FLASH_TRANS_START |
+			SPI_FLASH_TRANSACTION_CTRL_CMD_COUNT(cmd_len) |
+			(write ? SPI_FLASH_TRANSACTION_CTRL_WDATA_COUNT(len) : 0);
+
+	while (!(SPI_FLASH0->IRQ_STATUS.reg & SPI_FLASH_IRQ_STATUS_FLASH_TRANS_DONE)) {
+		if (++polls >= FLASH_TRANS_POLLS) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool flash_wait_ready(void)
+{
+	uint32_t polls;
+
+	for (polls = 0; polls < FLASH_BUSY_POLLS; polls++) {
+		if (!flash_transaction(FLASH_CMD_READ_STATUS, 1, 1, false)) {
+			return false;
+		}
+		if (!(*(uint8_t *)flash_buf & FLASH_STATUS_BUSY)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* The flash may be left powered down after the boot loader */
+static bool flash_wake(void)
+{
+	system_clock_peripheral_enable(PERIPHERAL_SPI_FLASH);
+	return flash_transaction(FLASH_CMD_RELEASE_POWER_DOWN, 1, 0, true) &&
+			flash_wait_ready();
+}
+
+bool flash_store_load(void *data, uint16_t len)
+{
+	uint16_t offset;
+	uint16_t chunk;
+
+	if ((len > FLASH_STORE_SECTOR_SIZE) || !flash_wake()) {
+		return false;
+	}
+
+	for (offset = 0; offset < len; offset += chunk) {
+		chunk = len - offset;
+		if (chunk > FLASH_STORE_PAGE_SIZE) {
+			chunk = FLASH_STORE_PAGE_SIZE;
+		}
+		if (!flash_transaction(flash_cmd(FLASH_CMD_READ, FLASH_STORE_ADDRESS + offset),
+				4, chunk, false)) {
+			return false;
+		}
+		memcpy((uint8_t *)data + offset, flash_buf, chunk);
+	}
+	return true;
+}
+
+bool flash_store_save(const void *data, uint16_t len)
+{
+	uint16_t offset;
+	uint16_t chunk;
+
+	if ((len > FLASH_STORE_SECTOR_SIZE) || !flash_wake()) {
+		return false;
+	}
+
+	if (!flash_transaction(FLASH_CMD_WRITE_ENABLE, 1, 0, true) ||
+			!flash_transaction(flash_cmd(FLASH_CMD_SECTOR_ERASE, FLASH_STORE_ADDRESS),
+			4, 0, true) || !flash_wait_ready()) {
+		return false;
+	}
+
+	for (offset = 0; offset < len; offset += chunk) {
+		chunk = len - offset;
+		if (chunk > FLASH_STORE_PAGE_SIZE) {
+			chunk = FLASH_STORE_PAGE_SIZE;
+		}
+		memcpy(flash_buf, (const uint8_t *)data + offset, chunk);
+		if (!flash_transaction(FLASH_CMD_WRITE_ENABLE, 1, 0, true) ||
+				!flash_transaction(flash_cmd(FLASH_CMD_PAGE_PROGRAM,
+				FLASH_STORE_ADDRESS + offset), 4, chunk, true) ||
+				!flash_wait_ready()) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,49 @@
+/**
+ * \file
+ *
+ * \brief Parameter record in the SPI flash
+ *
+ * Keeps one record, up to a flash sector, in the last sector of the SPI
+ * flash the firmware is loaded from, through the SPI flash controller.
+ * The boot loader copies the image at the start of the flash into the
+ * 94 KB of RAM, so the image never reaches the last sector of the 128 KB.
+ *
+ * A save erases the sector and programs the record page by page, the loop
+ * is held for the erase, tens of milliseconds, so records that change only
+ * on a user action belong here. The record is not checked: erased flash
+ * reads back as 0xFF bytes and a record must carry its own magic and
+ * checksum, like motor_calib_image_t.
+ */
+
+#ifndef __FLASH_STORE_H__
+#define __FLASH_STORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_STORE_SECTOR_SIZE         (4096)
+
+/* Programmed per transaction, never crosses a flash page */
+#define FLASH_STORE_PAGE_SIZE           (64)
+
+/**@brief Read the record
+ *
+ * @return false if the flash did not answer or len exceeds a sector
+ */
+bool flash_store_load(void *data, uint16_t len);
+
+/**@brief Replace the record
+ *
+ * @return false if the flash did not answer or len exceeds a sector
+ */
+bool flash_store_save(const void *data, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLASH_STORE_H__ */
@@ -0,0 +1,176 @@
+/**
+ * \file
+ *
+ * \brief Perception GATT handle cache
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stddef.h>
+#include <string.h>
+#include "gatt_cache.h"
+
+/* Fletcher-16 over the image, checksum field excluded */
+static uint16_t cache_checksum(const gatt_cache_t *cache)
+{
+	const uint8_t *ptr = (const uint8_t *)cache;
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	uint16_t idx;
+
+	for (idx = 0; idx < sizeof(gatt_cache_t); idx++) {
+		if ((idx >= offsetof(gatt_cache_t, checksum)) &&
+				(idx < offsetof(gatt_cache_t, checksum) + sizeof(cache->checksum))) {
+			continue;
+		}
+		sum1 = (uint16_t)((sum1 + ptr[idx]) % 255);
+		sum2 = (uint16_t)((sum2 + sum1) % 255);
+	}
+	return (uint16_t)((sum2 << 8) | sum1);
+}
+
+static void cache_seal(gatt_cache_t *cache)
+{
+	cache->checksum = cache_checksum(cache);
+}
+
+static gatt_cache_entry_t *cache_find(gatt_cache_t *cache, uint8_t addr_type,
+		const uint8_t *addr)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < GATT_CACHE_ENTRIES; idx++) {
+		gatt_cache_entry_t *entry = &cache->entries[idx];
+
+		if (entry->valid && (entry->addr_type == addr_type) &&
+				!memcmp(entry->addr, addr, GATT_CACHE_ADDR_LEN)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+void gatt_cache_init(gatt_cache_t *cache)
+{
+	memset(cache, 0, sizeof(gatt_cache_t));
+	cache->magic = GATT_CACHE_MAGIC;
+	cache->version = GATT_CACHE_VERSION;
+	cache_seal(cache);
+}
+
+bool gatt_cache_restore(gatt_cache_t *cache)
+{
+	if ((cache->magic != GATT_CACHE_MAGIC) ||
+			(cache->version != GATT_CACHE_VERSION) ||
+			(cache->checksum != cache_checksum(cache))) {
+		gatt_cache_init(cache);
+		return false;
+	}
+	return true;
+}
+
+bool gatt_cache_handles_valid(const gatt_cache_handles_t *handles)
+{
+	uint8_t idx;
+
+	if ((handles->start_handle == 0) ||
+			(handles->end_handle < handles->start_handle)) {
+		return false;
+	}
+
+	for (idx = 0; idx < GATT_CACHE_VIBE_CHARS; idx++) {
+		if ((handles->char_handle[idx] <= handles->start_handle) ||
+				(handles->char_handle[idx] > handles->end_handle)) {
+			return false;
+		}
+	}
+
+	if ((handles->diag_handle != 0) &&
+			((handles->diag_handle <= handles->start_handle) ||
+			(handles->diag_handle > handles->end_handle))) {
+		return false;
+	}
+
+	if ((handles->service_changed_handle >= handles->start_handle) &&
+			(handles->service_changed_handle <= handles->end_handle)) {
+		return false;
+	}
+
+	if (handles->timeline_handle == 0) {
+		return (handles->timeline_cccd_handle == 0);
+	}
+	return ((handles->timeline_handle > handles->start_handle) &&
+			(handles->timeline_cccd_handle > handles->timeline_handle) &&
+			(handles->timeline_cccd_handle <= handles->end_handle));
+}
+
+bool gatt_cache_lookup(gatt_cache_t *cache, uint8_t addr_type,
+		const uint8_t *addr, gatt_cache_handles_t *handles)
+{
+	gatt_cache_entry_t *entry = cache_find(cache, addr_type, addr);
+
+	if (entry == NULL) {
+		return false;
+	}
+
+	memcpy(handles, &entry->handles, sizeof(gatt_cache_handles_t));
+	entry->last_used = ++cache->use_counter;
+	cache_seal(cache);
+	return true;
+}
+
+bool gatt_cache_store(gatt_cache_t *cache, uint8_t addr_type,
+		const uint8_t *addr, const gatt_cache_handles_t *handles)
+{
+	gatt_cache_entry_t *entry;
+	uint8_t idx;
+
+	if (!gatt_cache_handles_valid(handles)) {
+		return false;
+	}
+
+	entry = cache_find(cache, addr_type, addr);
+
+	for (idx = 0; (entry == NULL) && (idx < GATT_CACHE_ENTRIES); idx++) {
+		if (!cache->entries[idx].valid) {
+			entry = &cache->entries[idx];
+		}
+	}
+
+	if (entry == NULL) {
+		/* Age is taken relative to the counter so wrap around is harmless */
+		uint16_t oldest = 0;
+
+		entry = &cache->entries[0];
+		for (idx = 0; idx < GATT_CACHE_ENTRIES; idx++) {
+			uint16_t age = (uint16_t)(cache->use_counter
+					- cache->entries[idx].last_used);
+			if (age > oldest) {
+				oldest = age;
+				entry = &cache->entries[idx];
+			}
+		}
+	}
+
+	entry->valid = true;
+	entry->addr_type = addr_type;
+	memcpy(entry->addr, addr, GATT_CACHE_ADDR_LEN);
+	memcpy(&entry->handles, handles, sizeof(gatt_cache_handles_t));
+	entry->last_used = ++cache->use_counter;
+	cache_seal(cache);
+	return true;
+}
+
+bool gatt_cache_invalidate(gatt_cache_t *cache, uint8_t addr_type,
+		const uint8_t *addr)
+{
+	gatt_cache_entry_t *entry = cache_find(cache, addr_type, addr);
+
+	if (entry == NULL) {
+		return false;
+	}
+
+	memset(entry, 0, sizeof(gatt_cache_entry_t));
+	cache_seal(cache);
+	return true;
+}
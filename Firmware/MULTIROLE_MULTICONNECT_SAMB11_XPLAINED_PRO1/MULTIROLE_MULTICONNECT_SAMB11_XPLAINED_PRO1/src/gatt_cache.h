@@ -0,0 +1,122 @@
+/**
+ * \file
+ *
+ * \brief Perception GATT handle cache
+ *
+ * Remembers the attribute handles discovered on a bonded phone so a
+ * reconnect can enable the haptic timeline straight away instead of running
+ * primary service, characteristic and descriptor discovery again. Entries
+ * are keyed by the peer address and replaced least recently used first.
+ *
+ * The cache is a flat structure with a magic and checksum so the image can
+ * be copied to non-volatile storage as is and checked with
+ * gatt_cache_restore() after it is read back. It does not depend on the BLE
+ * stack and builds on a host for testing.
+ */
+
+#ifndef __GATT_CACHE_H__
+#define __GATT_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GATT_CACHE_MAGIC                (0x4743)
+
+#define GATT_CACHE_VERSION              (2)
+
+/* Bonded phones remembered */
+#define GATT_CACHE_ENTRIES              (4)
+
+#define GATT_CACHE_ADDR_LEN             (6)
+
+#define GATT_CACHE_VIBE_CHARS           (4)
+
+typedef struct gatt_cache_handles {
+	uint16_t start_handle;
+	uint16_t end_handle;
+	uint16_t char_handle[GATT_CACHE_VIBE_CHARS];
+	/* zero when the peer has no haptic timeline characteristic */
+	uint16_t timeline_handle;
+	uint16_t timeline_cccd_handle;
+	/* zero when the peer has no diagnostics characteristic */
+	uint16_t diag_handle;
+	/* Service Changed value handle, outside the service range, zero when
+	 * the peer has none */
+	uint16_t service_changed_handle;
+} gatt_cache_handles_t;
+
+typedef struct gatt_cache_entry {
+	uint8_t valid;
+	uint8_t addr_type;
+	uint8_t addr[GATT_CACHE_ADDR_LEN];
+	/* use stamp, the smallest is evicted first */
+	uint16_t last_used;
+	gatt_cache_handles_t handles;
+} gatt_cache_entry_t;
+
+typedef struct gatt_cache {
+	uint16_t magic;
+	uint8_t version;
+	uint8_t reserved;
+	uint16_t use_counter;
+	uint16_t checksum;
+	gatt_cache_entry_t entries[GATT_CACHE_ENTRIES];
+} gatt_cache_t;
+
+/**@brief Clear all entries
+ */
+void gatt_cache_init(gatt_cache_t *cache);
+
+/**@brief Check a cache image read back from storage
+ *
+ * The cache is cleared if the magic, version or checksum does not match.
+ *
+ * @return true if the image was valid
+ */
+bool gatt_cache_restore(gatt_cache_t *cache);
+
+/**@brief Look up the handles stored for a peer
+ *
+ * @param[in] cache handle cache
+ * @param[in] addr_type peer address type
+ * @param[in] addr peer address, GATT_CACHE_ADDR_LEN bytes
+ * @param[out] handles stored handles
+ *
+ * @return true on a hit
+ */
+bool gatt_cache_lookup(gatt_cache_t *cache, uint8_t addr_type,
+		const uint8_t *addr, gatt_cache_handles_t *handles);
+
+/**@brief Store the handles discovered on a peer
+ *
+ * Replaces the entry of the same peer, a free entry or the least recently
+ * used one, in that order.
+ *
+ * @return false if the handles are not consistent and were not stored
+ */
+bool gatt_cache_store(gatt_cache_t *cache, uint8_t addr_type,
+		const uint8_t *addr, const gatt_cache_handles_t *handles);
+
+/**@brief Forget the handles of a peer
+ *
+ * @return true if an entry was removed
+ */
+bool gatt_cache_invalidate(gatt_cache_t *cache, uint8_t addr_type,
+		const uint8_t *addr);
+
+/**@brief Check a handle set for use without discovery
+ *
+ * All handles must be non zero and inside the service range, the Service
+ * Changed handle outside of it.
+ */
+bool gatt_cache_handles_valid(const gatt_cache_handles_t *handles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GATT_CACHE_H__ */
@@ -0,0 +1,560 @@
+/**
+ * \file
+ *
+ * \brief Perception haptic application
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <asf.h>
+#include "platform.h"
+#include "console_serial.h"
+#include "ble_manager.h"
+#include "pxp_monitor.h"
+#include "timer_hw.h"
+#include "haptic_batch.h"
+#include "link_supervisor.h"
+#include "motor_drv.h"
+#include "haptic_pattern.h"
+#include "motor_calib.h"
+#include "flash_store.h"
+#include "power_mgr.h"
+#include "battery_gov.h"
+#include "conf_battery.h"
+#include "haptic_filter.h"
+#include "conf_haptic_filter.h"
+#include "time_sync.h"
+#include "latency_echo.h"
+#include "haptic_app.h"
+
+/* Wrap-safe "a is at or after b" for the 32-bit millisecond clock */
+#define TIME_AFTER_EQ(a, b)     ((int32_t)((uint32_t)(a) - (uint32_t)(b)) >= 0)
+
+static at_ble_status_t haptic_app_connected_handler(void *params);
+static at_ble_status_t haptic_app_disconnected_handler(void *params);
+
+static const ble_event_callback_t haptic_app_gap_handle[] = {
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	haptic_app_connected_handler,
+	haptic_app_disconnected_handler,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+static haptic_playout_t haptic_playout;
+static haptic_batch_t haptic_rx_batch;
+static link_sup_t haptic_link;
+static haptic_pattern_engine_t haptic_patterns;
+static power_mgr_t haptic_power;
+static uint32_t haptic_power_report_ms;
+static battery_gov_t haptic_battery;
+static uint32_t haptic_battery_report_ms;
+static uint8_t haptic_battery_reported_pct;
+static haptic_filter_t haptic_filter;
+/* Output before the filter, stepped towards on every tick */
+static uint8_t haptic_target[HAPTIC_MOTOR_COUNT];
+/* Calibration of the motors, the image saved to flash */
+static motor_calib_image_t haptic_calib;
+/* Phone clock, batches play at their base time once it is known */
+static time_sync_t haptic_sync;
+/* Sampled batches on their way to the motors, echoed to the phone */
+static latency_echo_t haptic_latency;
+static volatile bool haptic_tick_done = false;
+
+/* Next time the supervisor changes the output, checked by the tick */
+static volatile bool haptic_wake_armed = false;
+static volatile uint32_t haptic_wake_ms;
+
+uint8_t haptic_motor_level[HAPTIC_MOTOR_COUNT];
+
+static const battery_gov_config_t haptic_battery_conf = {
+	.capacity_uah = CONF_BATTERY_CAPACITY_MAH * 1000UL,
+	.base_ua = CONF_BATTERY_BASE_UA,
+	.motor_ua = CONF_BATTERY_MOTOR_UA,
+	.low_pct = CONF_BATTERY_LOW_PCT,
+	.critical_pct = CONF_BATTERY_CRITICAL_PCT,
+	.min_budget_pct = CONF_BATTERY_MIN_BUDGET_PCT,
+	.level_budget = CONF_BATTERY_LEVEL_BUDGET
+};
+
+static const q15_t haptic_filter_coeffs[HAPTIC_FILTER_COEFFS] =
+		CONF_HAPTIC_FILTER_COEFFS;
+static const q15_t haptic_filter_gain[HAPTIC_MOTOR_COUNT] =
+		CONF_HAPTIC_FILTER_GAIN;
+
+static uint32_t haptic_app_now(void);
+
+static void haptic_motor_update(const uint8_t *level)
+{
+	memcpy(haptic_motor_level, level, HAPTIC_MOTOR_COUNT);
+	motor_drv_set(haptic_motor_level);
+	/* Charge the old duty up to now, the new one from now on */
+	battery_gov_update(&haptic_battery, haptic_app_now(), motor_drv_duty_sum());
+	DBG_LOG_DEV("Motors %3d %3d %3d %3d", haptic_motor_level[0],
+			haptic_motor_level[1], haptic_motor_level[2], haptic_motor_level[3]);
+}
+
+/* Local time; the first call after a wakeup from sleep restarts the tick */
+static uint32_t haptic_app_now(void)
+{
+	if (hw_tick_resume()) {
+		/* ULP does not retain the PWM and pin configuration */
+		motor_drv_resume();
+	}
+	return hw_tick_get_ms();
+}
+
+/* Local microseconds for the clock sync, milliseconds match haptic_app_now */
+static uint64_t haptic_app_now_us(void)
+{
+	haptic_app_now();
+	return hw_tick_get_us64();
+}
+
+/* Called from the TIMER0 interrupt */
+static void haptic_tick_handler(void)
+{
+	haptic_tick_done = true;
+
+	/* Only wake the event loop while there is something to play */
+	if (haptic_playout.count ||
+			(haptic_wake_armed && TIME_AFTER_EQ(hw_tick_get_ms(), haptic_wake_ms))) {
+		send_plf_int_msg_ind(USER_TIMER_CALLBACK, TIMER_EXPIRED_CALLBACK_TYPE_DETECT, NULL, 0);
+	}
+}
+
+/* Combine the supervised playout output and the local patterns into the
+ * target of the output filter */
+static void haptic_app_output(uint32_t now_ms)
+{
+	uint8_t level[HAPTIC_MOTOR_COUNT];
+	uint8_t pattern[HAPTIC_MOTOR_COUNT];
+	uint32_t wake_ms;
+	uint8_t idx;
+
+	link_sup_apply(&haptic_link, now_ms, haptic_playout.current, level,
+			HAPTIC_MOTOR_COUNT);
+	haptic_pattern_render(&haptic_patterns, now_ms, pattern);
+	for (idx = 0; idx < HAPTIC_MOTOR_COUNT; idx++) {
+		if (pattern[idx] > level[idx]) {
+			level[idx] = pattern[idx];
+		}
+	}
+	battery_gov_scale(&haptic_battery, level, HAPTIC_MOTOR_COUNT);
+	memcpy(haptic_target, level, HAPTIC_MOTOR_COUNT);
+
+	haptic_wake_armed = false;
+	if (link_sup_next_event(&haptic_link, now_ms, &wake_ms)) {
+		haptic_wake_ms = wake_ms;
+		haptic_wake_armed = true;
+	}
+	/* Patterns, dead-reckoning and the filter change the output on every
+	 * tick */
+	if (haptic_pattern_active(&haptic_patterns) ||
+			haptic_playout_extrapolating(&haptic_playout, now_ms) ||
+			!haptic_filter_settled(&haptic_filter, haptic_target)) {
+		haptic_wake_ms = now_ms;
+		haptic_wake_armed = true;
+	}
+}
+
+static at_ble_status_t haptic_app_connected_handler(void *params)
+{
+	at_ble_connected_t *conn_params;
+	conn_params = (at_ble_connected_t *)params;
+
+	if ((conn_params->conn_status == AT_BLE_SUCCESS) &&
+			ble_check_iscentral(conn_params->handle)) {
+		link_sup_connected(&haptic_link, haptic_app_now());
+		if (haptic_link.recovering) {
+			DBG_LOG("Haptic link reconnected after %lu ms",
+					haptic_link.last_reconnect_ms);
+		}
+		haptic_app_output(haptic_app_now());
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t haptic_app_disconnected_handler(void *params)
+{
+	at_ble_disconnected_t *disconnect;
+	disconnect = (at_ble_disconnected_t *)params;
+
+	if (ble_check_disconnected_iscentral(disconnect->handle)) {
+		haptic_app_link_reset();
+	}
+	return AT_BLE_SUCCESS;
+}
+
+/* The calibration kept in flash, applied before the first output */
+static void haptic_app_calib_restore(void)
+{
+	uint8_t idx;
+
+	if (!flash_store_load(&haptic_calib, sizeof(haptic_calib))) {
+		DBG_LOG("Motor calibration not read, flash error");
+		motor_calib_image_init(&haptic_calib);
+		return;
+	}
+	/* Erased flash or a damaged image leaves every motor uncalibrated */
+	if (!motor_calib_restore(&haptic_calib)) {
+		return;
+	}
+	for (idx = 0; idx < HAPTIC_MOTOR_COUNT; idx++) {
+		if (haptic_calib.valid_mask & (1 << idx)) {
+			motor_drv_set_curve(idx, &haptic_calib.curve[idx]);
+		}
+	}
+	DBG_LOG("Motor calibration restored, motors %02X", haptic_calib.valid_mask);
+}
+
+void haptic_app_init(void)
+{
+	haptic_playout_reset(&haptic_playout);
+	link_sup_init(&haptic_link, hw_tick_get_ms());
+	haptic_pattern_init(&haptic_patterns, HAPTIC_MOTOR_COUNT);
+	memset(haptic_motor_level, 0, sizeof(haptic_motor_level));
+	memset(haptic_target, 0, sizeof(haptic_target));
+	haptic_filter_init(&haptic_filter, HAPTIC_MOTOR_COUNT, haptic_filter_coeffs,
+			CONF_HAPTIC_FILTER_MAX_STEP, haptic_filter_gain);
+	motor_drv_init(HAPTIC_MOTOR_COUNT);
+	haptic_app_calib_restore();
+
+	register_haptic_timeline_cb(haptic_app_timeline_received);
+	ble_mgr_events_callback_handler(REGISTER_CALL_BACK, BLE_GAP_EVENT_TYPE, haptic_app_gap_handle);
+
+	hw_tick_init(haptic_tick_handler);
+	power_mgr_init(&haptic_power, hw_tick_get_ms());
+	haptic_power_report_ms = hw_tick_get_ms();
+	battery_gov_init(&haptic_battery, &haptic_battery_conf, hw_tick_get_ms(), 100);
+	haptic_battery_report_ms = hw_tick_get_ms();
+	haptic_battery_reported_pct = haptic_battery.level_pct;
+	time_sync_init(&haptic_sync, hw_tick_get_us64());
+	latency_echo_init(&haptic_latency);
+}
+
+static void haptic_app_pattern_received(const uint8_t *data, uint16_t len)
+{
+	haptic_pattern_params_t params;
+	haptic_pattern_status_t status;
+
+	status = haptic_pattern_decode(data, len, &params);
+	if (status != HAPTIC_PATTERN_OK) {
+		DBG_LOG("Haptic pattern rejected, reason %d length %d", status, len);
+		return;
+	}
+
+	if (!haptic_pattern_start(&haptic_patterns, &params, haptic_app_now())) {
+		DBG_LOG("Haptic pattern %d dropped, all slots busy", params.id);
+		return;
+	}
+
+	/* A pattern message shows the link is alive just like a timeline */
+	if (link_sup_frame(&haptic_link, haptic_app_now())) {
+		DBG_LOG("Haptic link recovered in %lu ms", haptic_link.last_recovery_ms);
+	}
+	haptic_app_output(haptic_app_now());
+}
+
+static void haptic_app_calib_received(const uint8_t *data, uint16_t len)
+{
+	motor_calib_curve_t curve;
+	motor_calib_status_t status;
+	uint8_t motor;
+	bool clear;
+	uint8_t idx;
+
+	status = motor_calib_decode(data, len, &motor, &clear, &curve);
+	if ((status == MOTOR_CALIB_OK) && (motor != MOTOR_CALIB_ALL_MOTORS) &&
+			(motor >= HAPTIC_MOTOR_COUNT)) {
+		status = MOTOR_CALIB_ERR_MOTOR;
+	}
+	if (status != MOTOR_CALIB_OK) {
+		DBG_LOG("Motor calibration rejected, reason %d length %d", status, len);
+		return;
+	}
+
+	/* Tables are rebuilt here, never on the output path */
+	for (idx = 0; idx < HAPTIC_MOTOR_COUNT; idx++) {
+		if ((motor == MOTOR_CALIB_ALL_MOTORS) || (motor == idx)) {
+			motor_calib_image_set(&haptic_calib, idx, clear ? NULL : &curve);
+			motor_drv_set_curve(idx, clear ? NULL : &curve);
+		}
+	}
+	DBG_LOG("Motor %d calibration %s, duty %d..%d", motor,
+			clear ? "cleared" : "set", curve.start_duty, curve.sat_duty);
+
+	/* Holds the loop for the sector erase, calibration is a bench step */
+	if (!flash_store_save(&haptic_calib, sizeof(haptic_calib))) {
+		DBG_LOG("Motor calibration not saved, flash error");
+	}
+}
+
+/* Send a clock sync request if one is due; right after a notification it
+ * leaves at the next connection event like the phone's reply */
+static void haptic_app_sync_poll(uint64_t now_us)
+{
+	uint8_t request[TIME_SYNC_REQUEST_SIZE];
+	uint8_t len;
+
+	if (haptic_link.state == LINK_SUP_DOWN) {
+		return;
+	}
+
+	len = time_sync_poll(&haptic_sync, now_us, request, sizeof(request));
+	if (len && (pxp_monitor_diag_write(request, len) != AT_BLE_SUCCESS)) {
+		DBG_LOG_DEV("Clock sync request not sent");
+	}
+}
+
+static void haptic_app_sync_received(const uint8_t *data, uint16_t len,
+		uint64_t now_us)
+{
+	bool synced = haptic_sync.synced;
+	time_sync_status_t status;
+
+	status = time_sync_reply(&haptic_sync, data, len, now_us);
+	if (status != TIME_SYNC_OK) {
+		DBG_LOG_DEV("Clock sync reply dropped, reason %d", status);
+		return;
+	}
+
+	if (!synced && haptic_sync.synced) {
+		DBG_LOG("Phone clock synchronized, delay %lu us",
+				haptic_sync.last_delay_us);
+	}
+}
+
+void haptic_app_timeline_received(const uint8_t *data, uint16_t len)
+{
+	/* t4 of a clock sync reply, stamped before anything else delays it */
+	uint64_t now_us = haptic_app_now_us();
+	haptic_batch_status_t status;
+	uint32_t local_ms;
+
+	if (len && (data[0] == TIME_SYNC_MSG)) {
+		haptic_app_sync_received(data, len, now_us);
+		haptic_app_sync_poll(now_us);
+		return;
+	}
+	/* Any notification marks a connection event to align a request to */
+	time_sync_event(&haptic_sync, now_us);
+	haptic_app_sync_poll(now_us);
+
+	if (len && (data[0] == HAPTIC_PATTERN_MSG)) {
+		haptic_app_pattern_received(data, len);
+		return;
+	}
+	if (len && (data[0] == MOTOR_CALIB_MSG)) {
+		haptic_app_calib_received(data, len);
+		return;
+	}
+
+	status = haptic_batch_decode(data, len, &haptic_rx_batch);
+	if (status != HAPTIC_BATCH_OK) {
+		DBG_LOG("Haptic timeline rejected, reason %d length %d", status, len);
+		return;
+	}
+
+	if (link_sup_frame(&haptic_link, haptic_app_now())) {
+		DBG_LOG("Haptic link recovered in %lu ms", haptic_link.last_recovery_ms);
+	}
+
+	/* With the phone clock known the base time is the actuation time, the
+	 * same on every wearable however late the notification got through */
+	if (time_sync_local_ms(&haptic_sync, haptic_rx_batch.base_ms,
+			haptic_app_now_us(), &local_ms)) {
+		haptic_playout_set_offset(&haptic_playout,
+				local_ms - haptic_rx_batch.base_ms + HAPTIC_PLAYOUT_DELAY_MS);
+	}
+	haptic_playout_submit(&haptic_playout, &haptic_rx_batch, haptic_app_now());
+
+	if (haptic_rx_batch.frame_count) {
+		latency_echo_received(&haptic_latency, haptic_rx_batch.sequence, now_us,
+				haptic_rx_batch.base_ms + haptic_rx_batch.frames[0].offset_ms
+				+ haptic_playout.offset_ms, haptic_app_now());
+	}
+}
+
+/* Echo the batches whose first frame the last tick played */
+static void haptic_app_latency_task(bool changed)
+{
+	uint8_t record[LATENCY_ECHO_RECORD_SIZE];
+	latency_echo_entry_t entry;
+	uint64_t arrival_us;
+	bool synced;
+	uint8_t len;
+
+	while (latency_echo_actuated(&haptic_latency, haptic_app_now(),
+			haptic_app_now_us(), changed, &entry)) {
+		synced = time_sync_to_remote(&haptic_sync, entry.arrival_us, &arrival_us);
+		len = latency_echo_encode(&entry, synced ? arrival_us : entry.arrival_us,
+				synced, record, sizeof(record));
+		if (pxp_monitor_diag_write(record, len) != AT_BLE_SUCCESS) {
+			DBG_LOG_DEV("Latency echo %d not sent", entry.sequence);
+		}
+	}
+}
+
+void haptic_app_task(void)
+{
+	uint8_t level[HAPTIC_MOTOR_COUNT];
+	bool changed;
+
+	if (!haptic_tick_done) {
+		return;
+	}
+	haptic_tick_done = false;
+
+	haptic_playout_tick(&haptic_playout, haptic_app_now());
+	haptic_app_output(haptic_app_now());
+
+	/* The filter runs at the tick rate its coefficients are designed for */
+	haptic_filter_step(&haptic_filter, haptic_target, level);
+	changed = (memcmp(level, haptic_motor_level, HAPTIC_MOTOR_COUNT) != 0);
+	if (changed) {
+		haptic_motor_update(level);
+	}
+	haptic_app_latency_task(changed);
+}
+
+void haptic_app_link_reset(void)
+{
+	DBG_LOG_DEV("Haptic playout: %lu batches, %lu late, %lu replaced, %lu overflow, %lu gaps, %lu resyncs, %lu underruns",
+			haptic_playout.batches, haptic_playout.late_frames,
+			haptic_playout.replaced_frames, haptic_playout.overflow_frames,
+			haptic_playout.sequence_gaps, haptic_playout.resyncs,
+			haptic_playout.underruns);
+
+	DBG_LOG_DEV("Clock sync: %u samples, %u rejected, %u rounds, %u steps, drift %ld ppb",
+			haptic_sync.samples, haptic_sync.rejected, haptic_sync.rounds,
+			haptic_sync.steps, haptic_sync.drift_ppb);
+
+	DBG_LOG_DEV("Haptic link: %lu drops, %lu stalls, %lu recoveries, max %lu ms, total %lu ms",
+			haptic_link.disconnects, haptic_link.stalls, haptic_link.recoveries,
+			haptic_link.max_recovery_ms, haptic_link.total_recovery_ms);
+
+	haptic_playout_reset(&haptic_playout);
+	haptic_pattern_stop(&haptic_patterns, 0xFF);
+	link_sup_disconnected(&haptic_link, haptic_app_now());
+	/* The next phone may run another clock */
+	time_sync_init(&haptic_sync, haptic_app_now_us());
+	latency_echo_init(&haptic_latency);
+	haptic_app_output(haptic_app_now());
+}
+
+static void haptic_app_power_report(uint32_t now_ms)
+{
+	uint8_t record[POWER_MGR_RECORD_SIZE];
+	uint8_t len;
+
+	if ((now_ms - haptic_power_report_ms) < HAPTIC_POWER_REPORT_MS) {
+		return;
+	}
+	haptic_power_report_ms = now_ms;
+
+	len = power_mgr_encode(&haptic_power, now_ms, record, sizeof(record));
+	if (pxp_monitor_diag_write(record, len) == AT_BLE_SUCCESS) {
+		DBG_LOG_DEV("Power record sent");
+	}
+}
+
+static void haptic_app_battery_report(uint32_t now_ms)
+{
+	uint8_t record[BATTERY_GOV_RECORD_SIZE];
+	uint8_t len;
+
+	battery_gov_update(&haptic_battery, now_ms, motor_drv_duty_sum());
+	if ((haptic_battery.level_pct == haptic_battery_reported_pct) &&
+			((now_ms - haptic_battery_report_ms) < HAPTIC_BATTERY_REPORT_MS)) {
+		return;
+	}
+	haptic_battery_report_ms = now_ms;
+
+	len = battery_gov_encode(&haptic_battery, record, sizeof(record));
+	if (pxp_monitor_diag_write(record, len) == AT_BLE_SUCCESS) {
+		haptic_battery_reported_pct = haptic_battery.level_pct;
+		DBG_LOG_DEV("Battery %d%% estimated since reset, %d min left",
+				haptic_battery.level_pct, battery_gov_runtime_min(&haptic_battery));
+	}
+}
+
+/* Ping the phone for its clock while the link is up, a request that found
+ * no notification to align to goes out unaligned */
+static void haptic_app_sync_task(uint32_t now_ms)
+{
+	uint64_t now_us;
+	int64_t wait_us;
+	uint32_t when_ms;
+
+	if (haptic_link.state == LINK_SUP_DOWN) {
+		return;
+	}
+
+	now_us = haptic_app_now_us();
+	if ((int64_t)(time_sync_next_poll(&haptic_sync) - now_us) <= 0) {
+		haptic_app_sync_poll(now_us);
+	}
+
+	/* Wake up by the next deadline, sleep keeps the clock running */
+	wait_us = (int64_t)(time_sync_next_poll(&haptic_sync) - now_us);
+	when_ms = now_ms + ((wait_us > 0) ? (uint32_t)(wait_us / 1000) : 0);
+	if (!haptic_wake_armed || TIME_AFTER_EQ(haptic_wake_ms, when_ms)) {
+		haptic_wake_ms = when_ms;
+		haptic_wake_armed = true;
+	}
+}
+
+void haptic_app_power_task(bool busy)
+{
+	uint32_t now_ms = haptic_app_now();
+	power_state_t previous = haptic_power.state;
+	bool motors_active = false;
+	uint32_t when_ms;
+	uint8_t idx;
+
+	for (idx = 0; idx < HAPTIC_MOTOR_COUNT; idx++) {
+		if (haptic_motor_level[idx]) {
+			motors_active = true;
+		}
+	}
+
+	haptic_app_power_report(now_ms);
+	haptic_app_battery_report(now_ms);
+	haptic_app_sync_task(now_ms);
+
+	if (power_mgr_update(&haptic_power, now_ms, motors_active,
+			busy || haptic_playout_pending(&haptic_playout),
+			haptic_wake_armed, haptic_wake_ms)) {
+		DBG_LOG_DEV("Power state %d -> %d", previous, haptic_power.state);
+		if (haptic_power.state == POWER_SLEEP) {
+			release_sleep_lock();
+		} else if (previous == POWER_SLEEP) {
+			acquire_sleep_lock();
+		}
+	}
+
+	if (haptic_power.state == POWER_SLEEP) {
+		/* The sleep timer wakes the loop for the next deadline */
+		hw_tick_suspend(haptic_wake_armed ? (haptic_wake_ms - now_ms) : 0);
+	} else if (power_mgr_next_event(&haptic_power, &when_ms) &&
+			(!haptic_wake_armed || TIME_AFTER_EQ(haptic_wake_ms, when_ms))) {
+		/* Run again once the holdoff ends */
+		haptic_wake_ms = when_ms;
+		haptic_wake_armed = true;
+	}
+}
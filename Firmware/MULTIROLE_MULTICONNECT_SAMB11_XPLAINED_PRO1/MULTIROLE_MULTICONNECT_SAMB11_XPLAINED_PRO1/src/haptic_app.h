@@ -0,0 +1,56 @@
+/**
+ * \file
+ *
+ * \brief Perception haptic application
+ *
+ * Receives haptic timelines from the phone, plays them out on the local
+ * millisecond tick and drives the vibration motor outputs through the output
+ * filter of haptic_filter.h. The link
+ * supervisor fades the motors out when timelines stop arriving. When the
+ * motors and the playout are idle the tick is stopped and the sleep lock
+ * released so the MCU reaches ULP between connection events.
+ */
+
+#ifndef __HAPTIC_APP_H__
+#define __HAPTIC_APP_H__
+
+#include "haptic_playout.h"
+
+/* Vibration motors on the wearable, one PWM channel each (motor_drv.h) */
+#define HAPTIC_MOTOR_COUNT              (4)
+
+/* Period of the power record on the diagnostics characteristic */
+#define HAPTIC_POWER_REPORT_MS          (60000)
+
+/* Longest time between battery records, a level change is sent at once */
+#define HAPTIC_BATTERY_REPORT_MS        (300000)
+
+/**@brief Initialize the playout buffer, the millisecond tick and register
+ * for timeline notifications and link events
+ */
+void haptic_app_init(void);
+
+/**@brief Decode a timeline notification and queue it for playout
+ *
+ * @param[in] data notification payload
+ * @param[in] len payload length
+ */
+void haptic_app_timeline_received(const uint8_t *data, uint16_t len);
+
+/**@brief Play out the frames that became due since the last call, run from
+ * the application main loop
+ */
+void haptic_app_task(void);
+
+/**@brief Pick the power state and enter or leave sleep, run from the
+ * application main loop after the other tasks
+ *
+ * @param[in] busy other application work needs the MCU awake
+ */
+void haptic_app_power_task(bool busy);
+
+/**@brief Drop the queued timeline and signal the link loss on the motors
+ */
+void haptic_app_link_reset(void);
+
+#endif /* __HAPTIC_APP_H__ */
@@ -0,0 +1,144 @@
+/**
+ * \file
+ *
+ * \brief Haptic timeline batch encoder/decoder
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "haptic_batch.h"
+
+static void put_u16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+	buf[2] = (uint8_t)(value >> 16);
+	buf[3] = (uint8_t)(value >> 24);
+}
+
+static uint16_t get_u16(const uint8_t *buf)
+{
+	return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+	return ((uint32_t)buf[0]) | ((uint32_t)buf[1] << 8) |
+			((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+uint8_t haptic_batch_frames_per_mtu(uint16_t att_mtu, uint8_t motor_count)
+{
+	uint16_t payload;
+	uint16_t frames;
+
+	if ((motor_count == 0) || (motor_count > HAPTIC_BATCH_MAX_MOTORS)) {
+		return 0;
+	}
+	if (att_mtu <= (HAPTIC_BATCH_ATT_OVERHEAD + HAPTIC_BATCH_HEADER_SIZE)) {
+		return 0;
+	}
+
+	payload = att_mtu - HAPTIC_BATCH_ATT_OVERHEAD - HAPTIC_BATCH_HEADER_SIZE;
+	frames = payload / HAPTIC_BATCH_FRAME_SIZE(motor_count);
+	if (frames > HAPTIC_BATCH_MAX_FRAMES) {
+		frames = HAPTIC_BATCH_MAX_FRAMES;
+	}
+	return (uint8_t)frames;
+}
+
+uint16_t haptic_batch_encode(const haptic_batch_t *batch, uint8_t *buf,
+		uint16_t buf_len)
+{
+	uint16_t size;
+	uint8_t *ptr;
+	uint8_t idx;
+
+	if ((batch->motor_count == 0) ||
+			(batch->motor_count > HAPTIC_BATCH_MAX_MOTORS) ||
+			(batch->frame_count == 0) ||
+			(batch->frame_count > HAPTIC_BATCH_MAX_FRAMES)) {
+		return 0;
+	}
+
+	size = HAPTIC_BATCH_SIZE(batch->frame_count, batch->motor_count);
+	if (size > buf_len) {
+		return 0;
+	}
+
+	for (idx = 1; idx < batch->frame_count; idx++) {
+		if (batch->frames[idx].offset_ms <= batch->frames[idx - 1].offset_ms) {
+			return 0;
+		}
+	}
+
+	buf[0] = HAPTIC_BATCH_VERSION;
+	buf[1] = batch->sequence;
+	put_u32(&buf[2], batch->base_ms);
+	buf[6] = batch->motor_count;
+	buf[7] = batch->frame_count;
+
+	ptr = &buf[HAPTIC_BATCH_HEADER_SIZE];
+	for (idx = 0; idx < batch->frame_count; idx++) {
+		put_u16(ptr, batch->frames[idx].offset_ms);
+		memcpy(&ptr[2], batch->frames[idx].intensity, batch->motor_count);
+		ptr += HAPTIC_BATCH_FRAME_SIZE(batch->motor_count);
+	}
+
+	return size;
+}
+
+haptic_batch_status_t haptic_batch_decode(const uint8_t *buf, uint16_t len,
+		haptic_batch_t *batch)
+{
+	const uint8_t *ptr;
+	uint8_t motors;
+	uint8_t frames;
+	uint8_t idx;
+
+	if (len < HAPTIC_BATCH_HEADER_SIZE) {
+		return HAPTIC_BATCH_ERR_LENGTH;
+	}
+	if (buf[0] != HAPTIC_BATCH_VERSION) {
+		return HAPTIC_BATCH_ERR_VERSION;
+	}
+
+	motors = buf[6];
+	frames = buf[7];
+	if ((motors == 0) || (motors > HAPTIC_BATCH_MAX_MOTORS)) {
+		return HAPTIC_BATCH_ERR_MOTORS;
+	}
+	if ((frames == 0) || (frames > HAPTIC_BATCH_MAX_FRAMES)) {
+		return HAPTIC_BATCH_ERR_FRAMES;
+	}
+	if (len != HAPTIC_BATCH_SIZE(frames, motors)) {
+		return HAPTIC_BATCH_ERR_LENGTH;
+	}
+
+	batch->sequence = buf[1];
+	batch->base_ms = get_u32(&buf[2]);
+	batch->motor_count = motors;
+	batch->frame_count = frames;
+
+	ptr = &buf[HAPTIC_BATCH_HEADER_SIZE];
+	for (idx = 0; idx < frames; idx++) {
+		haptic_frame_t *frame = &batch->frames[idx];
+
+		frame->offset_ms = get_u16(ptr);
+		if ((idx > 0) && (frame->offset_ms <= batch->frames[idx - 1].offset_ms)) {
+			return HAPTIC_BATCH_ERR_ORDER;
+		}
+		memset(frame->intensity, 0, sizeof(frame->intensity));
+		memcpy(frame->intensity, &ptr[2], motors);
+		ptr += HAPTIC_BATCH_FRAME_SIZE(motors);
+	}
+
+	return HAPTIC_BATCH_OK;
+}
@@ -0,0 +1,112 @@
+/**
+ * \file
+ *
+ * \brief Haptic timeline batch encoder/decoder
+ *
+ * A batch carries a short timeline of motor envelopes (for example the next
+ * 100 ms) in a single notification so the wearable can play it out locally
+ * and absorb radio jitter. The codec is plain C so the same source builds
+ * for the SAMB11 firmware and the iOS application.
+ *
+ * Wire format, all multi-byte fields little endian:
+ *
+ *   offset  size  field
+ *   0       1     version (HAPTIC_BATCH_VERSION)
+ *   1       1     sequence number
+ *   2       4     timeline base time in sender milliseconds
+ *   6       1     motor count M
+ *   7       1     frame count N
+ *   8       N*(2+M) frames: uint16 offset from base in ms, M intensities
+ *
+ * Frame offsets must be strictly increasing.
+ */
+
+#ifndef __HAPTIC_BATCH_H__
+#define __HAPTIC_BATCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HAPTIC_BATCH_VERSION            (1)
+
+/* Number of motors a frame can address */
+#define HAPTIC_BATCH_MAX_MOTORS         (8)
+
+/* Frames per batch; keeps the worst case batch below the 255 byte
+ * notification length reported by the BLE stack */
+#define HAPTIC_BATCH_MAX_FRAMES         (24)
+
+#define HAPTIC_BATCH_HEADER_SIZE        (8)
+
+#define HAPTIC_BATCH_FRAME_SIZE(motors) (2 + (motors))
+
+#define HAPTIC_BATCH_SIZE(frames, motors) \
+	(HAPTIC_BATCH_HEADER_SIZE + ((frames) * HAPTIC_BATCH_FRAME_SIZE(motors)))
+
+/* ATT notification header: opcode and attribute handle */
+#define HAPTIC_BATCH_ATT_OVERHEAD       (3)
+
+typedef enum {
+	HAPTIC_BATCH_OK = 0,
+	HAPTIC_BATCH_ERR_LENGTH,
+	HAPTIC_BATCH_ERR_VERSION,
+	HAPTIC_BATCH_ERR_MOTORS,
+	HAPTIC_BATCH_ERR_FRAMES,
+	HAPTIC_BATCH_ERR_ORDER
+} haptic_batch_status_t;
+
+typedef struct haptic_frame {
+	/* Offset from the batch base time in milliseconds */
+	uint16_t offset_ms;
+	uint8_t intensity[HAPTIC_BATCH_MAX_MOTORS];
+} haptic_frame_t;
+
+typedef struct haptic_batch {
+	uint8_t sequence;
+	uint32_t base_ms;
+	uint8_t motor_count;
+	uint8_t frame_count;
+	haptic_frame_t frames[HAPTIC_BATCH_MAX_FRAMES];
+} haptic_batch_t;
+
+/**@brief Number of frames that fit in one notification
+ *
+ * @param[in] att_mtu negotiated ATT MTU of the link
+ * @param[in] motor_count motors carried per frame
+ *
+ * @return frames that fit, capped at @ref HAPTIC_BATCH_MAX_FRAMES
+ */
+uint8_t haptic_batch_frames_per_mtu(uint16_t att_mtu, uint8_t motor_count);
+
+/**@brief Serialize a batch
+ *
+ * @param[in] batch batch to encode
+ * @param[out] buf destination buffer
+ * @param[in] buf_len size of buf
+ *
+ * @return number of bytes written, 0 if the batch is invalid or does not fit
+ */
+uint16_t haptic_batch_encode(const haptic_batch_t *batch, uint8_t *buf,
+		uint16_t buf_len);
+
+/**@brief Parse a received batch
+ *
+ * @param[in] buf received notification payload
+ * @param[in] len payload length
+ * @param[out] batch decoded batch, intensities of unused motors are zeroed
+ *
+ * @return @ref HAPTIC_BATCH_OK on success, otherwise the reason the payload
+ * was rejected
+ */
+haptic_batch_status_t haptic_batch_decode(const uint8_t *buf, uint16_t len,
+		haptic_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAPTIC_BATCH_H__ */
@@ -0,0 +1,117 @@
+/**
+ * \file
+ *
+ * \brief Haptic output filter
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "haptic_filter.h"
+
+/* Distance between input and output at which the low-pass counts as
+ * settled, half a level */
+#define HAPTIC_FILTER_SETTLE            (1 << (HAPTIC_FILTER_SHIFT - 1))
+
+static q15_t filter_abs(q15_t value)
+{
+	return (value < 0) ? (q15_t)-value : value;
+}
+
+void haptic_filter_init(haptic_filter_t *filter, uint8_t count,
+		const q15_t *coeffs, uint8_t max_step, const q15_t *gain)
+{
+	uint8_t idx;
+
+	memset(filter, 0, sizeof(haptic_filter_t));
+	filter->count = (count > HAPTIC_FILTER_MAX) ? HAPTIC_FILTER_MAX : count;
+	filter->max_step = max_step ? (q15_t)(max_step << HAPTIC_FILTER_SHIFT)
+			: INT16_MAX;
+	memcpy(filter->coeffs, coeffs, sizeof(filter->coeffs));
+	memcpy(filter->gain, gain, filter->count * sizeof(q15_t));
+	filter->settled = true;
+
+	/* The motors share the coefficients, each keeps its own state */
+	for (idx = 0; idx < filter->count; idx++) {
+		arm_biquad_cascade_df1_init_q15(&filter->stage[idx], 1,
+				filter->coeffs, filter->state[idx], HAPTIC_FILTER_POST_SHIFT);
+	}
+}
+
+void haptic_filter_step(haptic_filter_t *filter, const uint8_t *target,
+		uint8_t *level)
+{
+	q15_t x[HAPTIC_FILTER_MAX];
+	q15_t delta[HAPTIC_FILTER_MAX];
+	q15_t y[HAPTIC_FILTER_MAX];
+	uint8_t idx;
+
+	for (idx = 0; idx < filter->count; idx++) {
+		x[idx] = (q15_t)(target[idx] << HAPTIC_FILTER_SHIFT);
+	}
+
+	/* Rate limit */
+	arm_sub_q15(x, filter->in, delta, filter->count);
+	for (idx = 0; idx < filter->count; idx++) {
+		if (delta[idx] > filter->max_step) {
+			delta[idx] = filter->max_step;
+		} else if (delta[idx] < -filter->max_step) {
+			delta[idx] = (q15_t)-filter->max_step;
+		}
+	}
+	arm_add_q15(filter->in, delta, filter->in, filter->count);
+
+	/* Low-pass, a sample per motor */
+	filter->settled = true;
+	for (idx = 0; idx < filter->count; idx++) {
+		arm_biquad_cascade_df1_q15(&filter->stage[idx], &filter->in[idx],
+				&filter->out[idx], 1);
+		if ((filter->in[idx] != x[idx]) ||
+				(filter_abs((q15_t)(filter->out[idx] - x[idx])) > HAPTIC_FILTER_SETTLE)) {
+			filter->settled = false;
+		}
+	}
+
+	/* Hold a settled input: the DF1 state {x1, x2, y1, y2} at the input is
+	 * its own next state, the stage passing DC unchanged, so the low-pass
+	 * can not ring past half a level again */
+	if (filter->settled) {
+		for (idx = 0; idx < filter->count; idx++) {
+			filter->state[idx][0] = x[idx];
+			filter->state[idx][1] = x[idx];
+			filter->state[idx][2] = x[idx];
+			filter->state[idx][3] = x[idx];
+			filter->out[idx] = x[idx];
+		}
+	}
+
+	/* Gain */
+	arm_mult_q15(filter->out, filter->gain, y, filter->count);
+
+	for (idx = 0; idx < filter->count; idx++) {
+		int32_t value = (y[idx] + HAPTIC_FILTER_SETTLE) >> HAPTIC_FILTER_SHIFT;
+
+		if (value < 0) {
+			value = 0;
+		} else if (value > UINT8_MAX) {
+			value = UINT8_MAX;
+		}
+		level[idx] = (uint8_t)value;
+	}
+}
+
+bool haptic_filter_settled(const haptic_filter_t *filter,
+		const uint8_t *target)
+{
+	uint8_t idx;
+
+	if (!filter->settled) {
+		return false;
+	}
+	for (idx = 0; idx < filter->count; idx++) {
+		if (filter->in[idx] != (q15_t)(target[idx] << HAPTIC_FILTER_SHIFT)) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,96 @@
+/**
+ * \file
+ *
+ * \brief Haptic output filter
+ *
+ * Smooths the motor levels next to the actuators, once per tick of
+ * CONF_TIMER_TICK_MS (5 ms), the 200 Hz the coefficients in
+ * conf_haptic_filter.h are designed for, with the CMSIS-DSP q15 routines
+ * the firmware links anyway:
+ *
+ *   - the levels of all motors form one q15 vector
+ *   - its change per tick is limited to max_step
+ *   - every motor runs through the same second order low-pass, one
+ *     arm_biquad_cascade_df1_q15() instance and state each
+ *   - arm_mult_q15() applies the per-motor gain to the whole vector
+ *
+ * Levels are scaled by 1 << HAPTIC_FILTER_SHIFT, which leaves headroom for
+ * the overshoot of the low-pass so it never saturates. Once every motor
+ * has settled within half a level of its input the filter holds the
+ * input: the output is the input itself and the low-pass state is loaded
+ * with it, so a held level stays exact and the tick may stop.
+ *
+ * The tree carries the CMSIS-DSP headers and the prebuilt Cortex-M0
+ * library only. On a host the module builds against
+ * tools/stubs/arm_math_stub.c, the Cortex-M0 paths of the CMSIS-DSP
+ * sources of the same version for the routines above, and
+ * tools/haptic_filter_check.c compares it bit for bit with a fixed-point
+ * model:
+ *
+ *   cc -DARM_MATH_CM0 -I../src/ASF/thirdparty/CMSIS/Include ...
+ *       stubs/arm_math_stub.c ../src/haptic_filter.c
+ */
+
+#ifndef __HAPTIC_FILTER_H__
+#define __HAPTIC_FILTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arm_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Motors filtered, one biquad state each */
+#define HAPTIC_FILTER_MAX               (4)
+
+/* q15 value of level 1 is 1 << HAPTIC_FILTER_SHIFT */
+#define HAPTIC_FILTER_SHIFT             (6)
+
+/* Coefficients of one DF1 stage */
+#define HAPTIC_FILTER_COEFFS            (6)
+
+/* Coefficients are q14, see arm_biquad_cascade_df1_init_q15() */
+#define HAPTIC_FILTER_POST_SHIFT        (1)
+
+typedef struct haptic_filter {
+	uint8_t count;
+	q15_t max_step;
+	q15_t coeffs[HAPTIC_FILTER_COEFFS];
+	arm_biquad_casd_df1_inst_q15 stage[HAPTIC_FILTER_MAX];
+	q15_t state[HAPTIC_FILTER_MAX][4];
+	q15_t gain[HAPTIC_FILTER_MAX];
+	/* rate limited input and low-pass output of the last tick */
+	q15_t in[HAPTIC_FILTER_MAX];
+	q15_t out[HAPTIC_FILTER_MAX];
+	bool settled;
+} haptic_filter_t;
+
+/**@brief Start with every motor at level 0
+ *
+ * @param[in] coeffs one DF1 stage, {b0, 0, b1, b2, -a1, -a2} in q14
+ * @param[in] max_step largest change per tick in levels, 0 for no limit
+ * @param[in] gain q15 gain of every motor
+ */
+void haptic_filter_init(haptic_filter_t *filter, uint8_t count,
+		const q15_t *coeffs, uint8_t max_step, const q15_t *gain);
+
+/**@brief Run one tick
+ *
+ * @param[in] target level of every motor
+ * @param[out] level filtered level of every motor
+ */
+void haptic_filter_step(haptic_filter_t *filter, const uint8_t *target,
+		uint8_t *level);
+
+/**@brief The filter holds target and needs no further ticks
+ */
+bool haptic_filter_settled(const haptic_filter_t *filter,
+		const uint8_t *target);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAPTIC_FILTER_H__ */
@@ -0,0 +1,294 @@
+/**
+ * \file
+ *
+ * \brief Haptic pattern synthesizer
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "haptic_pattern.h"
+
+#define PHASE_BITS                      (24)
+#define PHASE_MASK                      ((1ul << PHASE_BITS) - 1)
+
+/* Beat width when the message leaves duty at 0, 1/8 of the period */
+#define HEARTBEAT_DEFAULT_DUTY          (32)
+
+/* Widest beat: beat, gap and second beat fill the period */
+#define HEARTBEAT_MAX_DUTY              (85)
+
+static uint16_t get_le16(const uint8_t *buf)
+{
+	return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static void put_le16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+}
+
+static uint8_t scale(uint8_t amplitude, uint32_t shape_q8)
+{
+	/* shape_q8 is 0..256 */
+	return (uint8_t)((amplitude * shape_q8) >> 8);
+}
+
+/* Triangle over one beat of width beat_q16, peak 256 in the middle */
+static uint32_t beat_shape(uint32_t rel_q16, uint32_t beat_q16,
+		uint32_t beat_scale)
+{
+	uint32_t half = beat_q16 >> 1;
+	uint32_t dist;
+
+	if (rel_q16 >= beat_q16) {
+		return 0;
+	}
+	dist = (rel_q16 > half) ? (rel_q16 - half) : (half - rel_q16);
+	return ((half - dist) * beat_scale) >> 16;
+}
+
+static void render_sweep(const haptic_pattern_slot_t *slot, uint32_t x_q16,
+		uint8_t motor_count, uint8_t *level)
+{
+	uint8_t mask = slot->params.motor_mask;
+	uint32_t count = 0;
+	uint32_t span;
+	uint32_t pos;
+	uint32_t k = 0;
+	uint8_t idx;
+
+	for (idx = 0; idx < motor_count; idx++) {
+		if (mask & (1 << idx)) {
+			count++;
+		}
+	}
+	span = count << 8;
+	pos = (x_q16 * count) >> 8;
+
+	for (idx = 0; idx < motor_count; idx++) {
+		uint32_t centre;
+		uint32_t dist;
+
+		if (!(mask & (1 << idx))) {
+			continue;
+		}
+		centre = (k << 8) + 128;
+		dist = (pos > centre) ? (pos - centre) : (centre - pos);
+		/* the peak wraps from the last motor back to the first */
+		if (dist > (span >> 1)) {
+			dist = span - dist;
+		}
+		if (dist < 256) {
+			uint8_t out = scale(slot->params.amplitude, 256 - dist);
+			if (out > level[idx]) {
+				level[idx] = out;
+			}
+		}
+		k++;
+	}
+}
+
+static uint8_t render_shape(const haptic_pattern_slot_t *slot, uint32_t x_q16)
+{
+	const haptic_pattern_params_t *params = &slot->params;
+	uint32_t shape;
+
+	switch (params->id) {
+	case HAPTIC_PATTERN_CONSTANT:
+		return params->amplitude;
+
+	case HAPTIC_PATTERN_PULSE:
+		return ((x_q16 >> 8) < params->duty) ? params->amplitude : 0;
+
+	case HAPTIC_PATTERN_RAMP:
+		return scale(params->amplitude, (x_q16 >> 8) + 1);
+
+	case HAPTIC_PATTERN_BREATHE:
+		/* squared triangle: slow start, soft peak */
+		shape = (x_q16 < 0x8000) ? (x_q16 >> 7) : ((0x10000 - x_q16) >> 7);
+		return (uint8_t)((params->amplitude * shape * shape) >> 16);
+
+	case HAPTIC_PATTERN_HEARTBEAT:
+	{
+		uint32_t beat_q16 = (uint32_t)params->duty << 8;
+
+		shape = beat_shape(x_q16, beat_q16, slot->beat_scale);
+		if (shape) {
+			return scale(params->amplitude, shape);
+		}
+		if (x_q16 >= 2 * beat_q16) {
+			shape = beat_shape(x_q16 - 2 * beat_q16, beat_q16, slot->beat_scale);
+			return scale(params->amplitude, (shape * 3) >> 2);
+		}
+		return 0;
+	}
+
+	default:
+		return 0;
+	}
+}
+
+void haptic_pattern_init(haptic_pattern_engine_t *engine, uint8_t motor_count)
+{
+	memset(engine, 0, sizeof(haptic_pattern_engine_t));
+	engine->motor_count = (motor_count > HAPTIC_PATTERN_MAX_MOTORS) ?
+			HAPTIC_PATTERN_MAX_MOTORS : motor_count;
+}
+
+uint8_t haptic_pattern_encode(const haptic_pattern_params_t *params,
+		uint8_t *buf, uint8_t buf_len)
+{
+	if (buf_len < HAPTIC_PATTERN_MSG_SIZE) {
+		return 0;
+	}
+
+	buf[0] = HAPTIC_PATTERN_MSG;
+	buf[1] = params->id;
+	buf[2] = params->motor_mask;
+	buf[3] = params->amplitude;
+	put_le16(&buf[4], params->period_ms);
+	buf[6] = params->duty;
+	put_le16(&buf[7], params->duration_ms);
+	return HAPTIC_PATTERN_MSG_SIZE;
+}
+
+haptic_pattern_status_t haptic_pattern_decode(const uint8_t *buf, uint16_t len,
+		haptic_pattern_params_t *params)
+{
+	if (len != HAPTIC_PATTERN_MSG_SIZE) {
+		return HAPTIC_PATTERN_ERR_LENGTH;
+	}
+	if (buf[0] != HAPTIC_PATTERN_MSG) {
+		return HAPTIC_PATTERN_ERR_TYPE;
+	}
+	if (buf[1] >= HAPTIC_PATTERN_COUNT) {
+		return HAPTIC_PATTERN_ERR_ID;
+	}
+
+	params->id = buf[1];
+	params->motor_mask = buf[2];
+	params->amplitude = buf[3];
+	params->period_ms = get_le16(&buf[4]);
+	params->duty = buf[6];
+	params->duration_ms = get_le16(&buf[7]);
+
+	if ((params->id != HAPTIC_PATTERN_STOP) &&
+			(params->id != HAPTIC_PATTERN_CONSTANT) &&
+			(params->period_ms < HAPTIC_PATTERN_MIN_PERIOD_MS)) {
+		return HAPTIC_PATTERN_ERR_PERIOD;
+	}
+	return HAPTIC_PATTERN_OK;
+}
+
+void haptic_pattern_stop(haptic_pattern_engine_t *engine, uint8_t motor_mask)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < HAPTIC_PATTERN_SLOTS; idx++) {
+		haptic_pattern_slot_t *slot = &engine->slot[idx];
+
+		slot->params.motor_mask &= ~motor_mask;
+		if (!slot->params.motor_mask) {
+			slot->active = false;
+		}
+	}
+}
+
+bool haptic_pattern_start(haptic_pattern_engine_t *engine,
+		const haptic_pattern_params_t *params, uint32_t now_ms)
+{
+	uint8_t mask = params->motor_mask & (uint8_t)((1 << engine->motor_count) - 1);
+	haptic_pattern_slot_t *slot;
+	uint8_t idx;
+
+	haptic_pattern_stop(engine, mask);
+	if ((params->id == HAPTIC_PATTERN_STOP) || !mask) {
+		return true;
+	}
+
+	for (idx = 0; idx < HAPTIC_PATTERN_SLOTS; idx++) {
+		if (!engine->slot[idx].active) {
+			break;
+		}
+	}
+	if (idx == HAPTIC_PATTERN_SLOTS) {
+		return false;
+	}
+
+	slot = &engine->slot[idx];
+	slot->params = *params;
+	slot->params.motor_mask = mask;
+	slot->start_ms = now_ms;
+	slot->step_q24 = 0;
+	slot->beat_scale = 0;
+	if (params->period_ms) {
+		slot->step_q24 = (1ul << PHASE_BITS) / params->period_ms;
+	}
+	if (params->id == HAPTIC_PATTERN_HEARTBEAT) {
+		/* A wider beat would push the second one past the period */
+		if (!slot->params.duty) {
+			slot->params.duty = HEARTBEAT_DEFAULT_DUTY;
+		} else if (slot->params.duty > HEARTBEAT_MAX_DUTY) {
+			slot->params.duty = HEARTBEAT_MAX_DUTY;
+		}
+		/* half a beat maps onto 256 */
+		slot->beat_scale = (512ul << 16) / ((uint32_t)slot->params.duty << 8);
+	}
+	slot->active = true;
+	return true;
+}
+
+bool haptic_pattern_active(const haptic_pattern_engine_t *engine)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < HAPTIC_PATTERN_SLOTS; idx++) {
+		if (engine->slot[idx].active) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void haptic_pattern_render(haptic_pattern_engine_t *engine, uint32_t now_ms,
+		uint8_t *level)
+{
+	uint8_t idx;
+
+	memset(level, 0, engine->motor_count);
+
+	for (idx = 0; idx < HAPTIC_PATTERN_SLOTS; idx++) {
+		haptic_pattern_slot_t *slot = &engine->slot[idx];
+		uint32_t elapsed;
+		uint32_t x_q16;
+		uint8_t out;
+		uint8_t motor;
+
+		if (!slot->active) {
+			continue;
+		}
+
+		elapsed = now_ms - slot->start_ms;
+		if (slot->params.duration_ms && (elapsed >= slot->params.duration_ms)) {
+			slot->active = false;
+			continue;
+		}
+
+		/* The product wraps modulo 2^32, a multiple of the 2^24 cycle */
+		x_q16 = ((elapsed * slot->step_q24) & PHASE_MASK) >> 8;
+
+		if (slot->params.id == HAPTIC_PATTERN_SWEEP) {
+			render_sweep(slot, x_q16, engine->motor_count, level);
+			continue;
+		}
+
+		out = render_shape(slot, x_q16);
+		for (motor = 0; motor < engine->motor_count; motor++) {
+			if ((slot->params.motor_mask & (1 << motor)) && (out > level[motor])) {
+				level[motor] = out;
+			}
+		}
+	}
+}
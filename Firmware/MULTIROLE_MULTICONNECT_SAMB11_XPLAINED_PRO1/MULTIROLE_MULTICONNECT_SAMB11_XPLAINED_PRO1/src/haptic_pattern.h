@@ -0,0 +1,152 @@
+/**
+ * \file
+ *
+ * \brief Haptic pattern synthesizer
+ *
+ * Instead of streaming every level, the phone can start a pattern with a
+ * single message and the wearable synthesizes the envelope locally. A
+ * pattern runs on the motors of its mask until its duration elapses or
+ * another pattern takes those motors over; up to HAPTIC_PATTERN_SLOTS
+ * patterns run side by side on disjoint motors.
+ *
+ * Rendering uses only integer math: the phase is the elapsed time times a
+ * Q24 per-millisecond step taken modulo 2^24, so it needs no division per
+ * tick and stays exact across the 32-bit millisecond wrap.
+ *
+ * Pattern message, shares the haptic timeline characteristic and is told
+ * apart by its first byte, all multi-byte fields little endian:
+ *
+ *   offset  size  field
+ *   0       1     HAPTIC_PATTERN_MSG
+ *   1       1     pattern id (haptic_pattern_id_t)
+ *   2       1     motor mask, bit n for motor n
+ *   3       1     amplitude 0..255
+ *   4       2     period in ms
+ *   6       1     duty 0..255 of the period (pulse on time, beat width)
+ *   7       2     duration in ms, 0 runs until stopped
+ *
+ * Plain C so it builds on a host to render timelines for inspection.
+ */
+
+#ifndef __HAPTIC_PATTERN_H__
+#define __HAPTIC_PATTERN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* First byte of a pattern message; haptic batches start with their
+ * version, which never takes this value */
+#define HAPTIC_PATTERN_MSG              (0x50)
+
+#define HAPTIC_PATTERN_MSG_SIZE         (9)
+
+/* Patterns running at once */
+#define HAPTIC_PATTERN_SLOTS            (4)
+
+#define HAPTIC_PATTERN_MAX_MOTORS       (8)
+
+/* Shortest period accepted */
+#define HAPTIC_PATTERN_MIN_PERIOD_MS    (20)
+
+typedef enum {
+	/* Stop whatever runs on the motors of the mask */
+	HAPTIC_PATTERN_STOP = 0,
+	/* Steady amplitude */
+	HAPTIC_PATTERN_CONSTANT,
+	/* On for duty of the period, off for the rest */
+	HAPTIC_PATTERN_PULSE,
+	/* Rises from 0 to amplitude over each period */
+	HAPTIC_PATTERN_RAMP,
+	/* Smooth swell and fade over each period */
+	HAPTIC_PATTERN_BREATHE,
+	/* Two beats per period, the second one weaker; a beat is at most a
+	 * third of the period so the second one always fits */
+	HAPTIC_PATTERN_HEARTBEAT,
+	/* A peak travelling across the motors of the mask once per period */
+	HAPTIC_PATTERN_SWEEP,
+	HAPTIC_PATTERN_COUNT
+} haptic_pattern_id_t;
+
+typedef enum {
+	HAPTIC_PATTERN_OK = 0,
+	HAPTIC_PATTERN_ERR_LENGTH,
+	HAPTIC_PATTERN_ERR_TYPE,
+	HAPTIC_PATTERN_ERR_ID,
+	HAPTIC_PATTERN_ERR_PERIOD
+} haptic_pattern_status_t;
+
+typedef struct haptic_pattern_params {
+	uint8_t id;
+	uint8_t motor_mask;
+	uint8_t amplitude;
+	uint8_t duty;
+	uint16_t period_ms;
+	uint16_t duration_ms;
+} haptic_pattern_params_t;
+
+typedef struct haptic_pattern_slot {
+	bool active;
+	haptic_pattern_params_t params;
+	uint32_t start_ms;
+	/* phase advance per millisecond, Q24 cycles */
+	uint32_t step_q24;
+	/* heartbeat: beat slope, so ticks need no division */
+	uint32_t beat_scale;
+} haptic_pattern_slot_t;
+
+typedef struct haptic_pattern_engine {
+	uint8_t motor_count;
+	haptic_pattern_slot_t slot[HAPTIC_PATTERN_SLOTS];
+} haptic_pattern_engine_t;
+
+/**@brief Stop all patterns
+ */
+void haptic_pattern_init(haptic_pattern_engine_t *engine, uint8_t motor_count);
+
+/**@brief Serialize a pattern message
+ *
+ * @return number of bytes written, 0 if buf_len is too small
+ */
+uint8_t haptic_pattern_encode(const haptic_pattern_params_t *params,
+		uint8_t *buf, uint8_t buf_len);
+
+/**@brief Parse a pattern message
+ */
+haptic_pattern_status_t haptic_pattern_decode(const uint8_t *buf, uint16_t len,
+		haptic_pattern_params_t *params);
+
+/**@brief Start a pattern, or stop the mask's motors for HAPTIC_PATTERN_STOP
+ *
+ * Motors in the mask are taken away from patterns already running.
+ *
+ * @return false if every slot is in use
+ */
+bool haptic_pattern_start(haptic_pattern_engine_t *engine,
+		const haptic_pattern_params_t *params, uint32_t now_ms);
+
+/**@brief Stop the patterns on the motors of motor_mask
+ */
+void haptic_pattern_stop(haptic_pattern_engine_t *engine, uint8_t motor_mask);
+
+/**@brief true while a pattern runs
+ */
+bool haptic_pattern_active(const haptic_pattern_engine_t *engine);
+
+/**@brief Render the pattern output at now_ms
+ *
+ * Patterns whose duration elapsed are retired.
+ *
+ * @param[out] level one level per motor, 0 where no pattern runs
+ */
+void haptic_pattern_render(haptic_pattern_engine_t *engine, uint32_t now_ms,
+		uint8_t *level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAPTIC_PATTERN_H__ */
@@ -0,0 +1,233 @@
+/**
+ * \file
+ *
+ * \brief Haptic timeline playout buffer
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "haptic_playout.h"
+
+/* Wrap-safe "a is at or after b" for the 32-bit millisecond clock */
+#define TIME_AFTER_EQ(a, b)     ((int32_t)((uint32_t)(a) - (uint32_t)(b)) >= 0)
+
+static uint8_t playout_index(const haptic_playout_t *playout, uint8_t pos)
+{
+	return (uint8_t)((playout->head + pos) % HAPTIC_PLAYOUT_DEPTH);
+}
+
+static void playout_anchor(haptic_playout_t *playout,
+		const haptic_batch_t *batch, uint32_t now_ms)
+{
+	playout->offset_ms = now_ms + HAPTIC_PLAYOUT_DELAY_MS
+			- (batch->base_ms + batch->frames[0].offset_ms);
+	playout->anchored = true;
+}
+
+/* Make frame the set-point the outputs move on from */
+static void playout_reach(haptic_playout_t *playout, uint32_t due_ms,
+		const uint8_t *intensity)
+{
+	uint32_t span = due_ms - playout->from_ms;
+	uint8_t idx;
+
+	for (idx = 0; idx < playout->motor_count; idx++) {
+		int32_t slope = 0;
+
+		if (playout->has_from && span && (span <= HAPTIC_PLAYOUT_INTERP_MAX_MS)) {
+			slope = (((int32_t)intensity[idx] - playout->from[idx]) * 256)
+					/ (int32_t)span;
+		}
+		playout->slope_q8[idx] = slope;
+	}
+
+	memcpy(playout->from, intensity, sizeof(playout->from));
+	playout->from_ms = due_ms;
+	playout->has_from = true;
+}
+
+static void playout_interpolate(const haptic_playout_t *playout,
+		uint32_t now_ms, uint8_t *level)
+{
+	const haptic_playout_frame_t *next = &playout->frames[playout->head];
+	uint32_t span = next->due_ms - playout->from_ms;
+	uint32_t frac_q8;
+	uint8_t idx;
+
+	if (span > HAPTIC_PLAYOUT_INTERP_MAX_MS) {
+		memcpy(level, playout->from, playout->motor_count);
+		return;
+	}
+
+	/* next is not due yet, so the fraction stays below 1 */
+	frac_q8 = ((now_ms - playout->from_ms) << 8) / span;
+	for (idx = 0; idx < playout->motor_count; idx++) {
+		int32_t delta = (int32_t)next->intensity[idx] - playout->from[idx];
+
+		level[idx] = (uint8_t)(playout->from[idx]
+				+ (delta * (int32_t)frac_q8) / 256);
+	}
+}
+
+static void playout_extrapolate(const haptic_playout_t *playout,
+		uint32_t now_ms, uint8_t *level)
+{
+	uint32_t elapsed = now_ms - playout->from_ms;
+	uint8_t idx;
+
+	if (elapsed > HAPTIC_PLAYOUT_EXTRAPOLATE_MS) {
+		elapsed = HAPTIC_PLAYOUT_EXTRAPOLATE_MS;
+	}
+
+	for (idx = 0; idx < playout->motor_count; idx++) {
+		int32_t value = playout->from[idx]
+				+ (playout->slope_q8[idx] * (int32_t)elapsed) / 256;
+
+		if (value < 0) {
+			value = 0;
+		} else if (value > 255) {
+			value = 255;
+		}
+		level[idx] = (uint8_t)value;
+	}
+}
+
+void haptic_playout_reset(haptic_playout_t *playout)
+{
+	memset(playout, 0, sizeof(haptic_playout_t));
+}
+
+void haptic_playout_set_offset(haptic_playout_t *playout, uint32_t offset_ms)
+{
+	playout->offset_ms = offset_ms;
+	playout->anchored = true;
+}
+
+void haptic_playout_submit(haptic_playout_t *playout,
+		const haptic_batch_t *batch, uint32_t now_ms)
+{
+	uint32_t first_due;
+	uint32_t last_due;
+	uint8_t idx;
+
+	if (batch->frame_count == 0) {
+		return;
+	}
+
+	if (playout->batches &&
+			(batch->sequence != (uint8_t)(playout->last_sequence + 1))) {
+		playout->sequence_gaps++;
+	}
+	playout->last_sequence = batch->sequence;
+	playout->batches++;
+
+	if (batch->motor_count > playout->motor_count) {
+		playout->motor_count = batch->motor_count;
+	}
+
+	if (!playout->anchored) {
+		playout_anchor(playout, batch, now_ms);
+	}
+
+	first_due = batch->base_ms + batch->frames[0].offset_ms + playout->offset_ms;
+	last_due = batch->base_ms
+			+ batch->frames[batch->frame_count - 1].offset_ms + playout->offset_ms;
+
+	/* The sender clock jumped or the link stalled; start a new anchor
+	 * rather than playing a stale or far future timeline */
+	if (TIME_AFTER_EQ(first_due, now_ms + HAPTIC_PLAYOUT_DELAY_MS + HAPTIC_PLAYOUT_RESYNC_MS) ||
+			!TIME_AFTER_EQ(last_due, now_ms - HAPTIC_PLAYOUT_RESYNC_MS)) {
+		playout_anchor(playout, batch, now_ms);
+		playout->resyncs++;
+		first_due = batch->base_ms + batch->frames[0].offset_ms + playout->offset_ms;
+	}
+
+	/* The new timeline supersedes everything queued from its start on */
+	while (playout->count) {
+		haptic_playout_frame_t *tail
+				= &playout->frames[playout_index(playout, playout->count - 1)];
+		if (!TIME_AFTER_EQ(tail->due_ms, first_due)) {
+			break;
+		}
+		playout->count--;
+		playout->replaced_frames++;
+	}
+
+	for (idx = 0; idx < batch->frame_count; idx++) {
+		haptic_playout_frame_t *slot;
+		uint32_t due = batch->base_ms + batch->frames[idx].offset_ms
+				+ playout->offset_ms;
+
+		if (!TIME_AFTER_EQ(due, now_ms)) {
+			playout->late_frames++;
+		}
+
+		if (playout->count == HAPTIC_PLAYOUT_DEPTH) {
+			playout->head = playout_index(playout, 1);
+			playout->count--;
+			playout->overflow_frames++;
+		}
+
+		slot = &playout->frames[playout_index(playout, playout->count)];
+		slot->due_ms = due;
+		memcpy(slot->intensity, batch->frames[idx].intensity,
+				sizeof(slot->intensity));
+		playout->count++;
+	}
+}
+
+bool haptic_playout_tick(haptic_playout_t *playout, uint32_t now_ms)
+{
+	uint8_t level[HAPTIC_BATCH_MAX_MOTORS];
+
+	/* A late timeline arrived; carry on from where the motors are rather
+	 * than jumping back to the last set-point */
+	if (playout->extrapolating && playout->count) {
+		playout_reach(playout, now_ms, playout->current);
+		playout->extrapolating = false;
+	}
+
+	while (playout->count) {
+		haptic_playout_frame_t *frame = &playout->frames[playout->head];
+
+		if (!TIME_AFTER_EQ(now_ms, frame->due_ms)) {
+			break;
+		}
+		playout_reach(playout, frame->due_ms, frame->intensity);
+		playout->head = playout_index(playout, 1);
+		playout->count--;
+	}
+
+	if (!playout->has_from) {
+		return false;
+	}
+
+	if (playout->count) {
+		playout_interpolate(playout, now_ms, level);
+	} else {
+		if (!playout->extrapolating) {
+			playout->extrapolating = true;
+			playout->underruns++;
+		}
+		playout_extrapolate(playout, now_ms, level);
+	}
+
+	if (memcmp(playout->current, level, playout->motor_count)) {
+		memcpy(playout->current, level, playout->motor_count);
+		return true;
+	}
+	return false;
+}
+
+bool haptic_playout_pending(const haptic_playout_t *playout)
+{
+	return (playout->count != 0);
+}
+
+bool haptic_playout_extrapolating(const haptic_playout_t *playout,
+		uint32_t now_ms)
+{
+	return playout->extrapolating &&
+			((now_ms - playout->from_ms) < HAPTIC_PLAYOUT_EXTRAPOLATE_MS);
+}
@@ -0,0 +1,125 @@
+/**
+ * \file
+ *
+ * \brief Haptic timeline playout buffer
+ *
+ * Schedules the frames of received haptic batches on the local millisecond
+ * clock. The first batch after a reset anchors the sender timeline to local
+ * time plus a fixed playout delay; later batches keep that mapping so
+ * notification jitter up to the delay does not reach the motors. A newer
+ * timeline replaces any queued frames it overlaps. Once the sender clock is
+ * known, haptic_playout_set_offset() replaces the arrival anchor so every
+ * batch plays at its own base time plus the playout delay.
+ *
+ * Between set-points the outputs move linearly from the frame reached last
+ * to the next queued one, so motors do not step at the frame rate. When the
+ * queue runs dry because a timeline is late, the outputs continue along the
+ * trend of the last two set-points for up to HAPTIC_PLAYOUT_EXTRAPOLATE_MS
+ * and then hold; a late timeline continues from wherever the motors are.
+ */
+
+#ifndef __HAPTIC_PLAYOUT_H__
+#define __HAPTIC_PLAYOUT_H__
+
+#include "haptic_batch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Jitter absorbed between notification arrival and actuation */
+#define HAPTIC_PLAYOUT_DELAY_MS         (40)
+
+/* Queued frames; two full batches */
+#define HAPTIC_PLAYOUT_DEPTH            (2 * HAPTIC_BATCH_MAX_FRAMES)
+
+/* Re-anchor when a batch lands further than this outside the window */
+#define HAPTIC_PLAYOUT_RESYNC_MS        (500)
+
+/* Longest dead-reckoning past the last set-point, 0 holds it instead */
+#define HAPTIC_PLAYOUT_EXTRAPOLATE_MS   (60)
+
+/* Set-points further apart than this are steps, not ramps */
+#define HAPTIC_PLAYOUT_INTERP_MAX_MS    (100)
+
+typedef struct haptic_playout_frame {
+	uint32_t due_ms;
+	uint8_t intensity[HAPTIC_BATCH_MAX_MOTORS];
+} haptic_playout_frame_t;
+
+typedef struct haptic_playout {
+	haptic_playout_frame_t frames[HAPTIC_PLAYOUT_DEPTH];
+	uint8_t head;
+	uint8_t count;
+	uint8_t motor_count;
+	bool anchored;
+	/* local_ms = sender_ms + offset_ms */
+	uint32_t offset_ms;
+	uint8_t last_sequence;
+	uint8_t current[HAPTIC_BATCH_MAX_MOTORS];
+	/* last set-point reached, outputs move on from it */
+	bool has_from;
+	uint32_t from_ms;
+	uint8_t from[HAPTIC_BATCH_MAX_MOTORS];
+	/* trend between the last two set-points, Q8 levels per ms */
+	int32_t slope_q8[HAPTIC_BATCH_MAX_MOTORS];
+	bool extrapolating;
+	/* statistics */
+	uint32_t batches;
+	uint32_t late_frames;
+	uint32_t replaced_frames;
+	uint32_t overflow_frames;
+	uint32_t sequence_gaps;
+	uint32_t resyncs;
+	uint32_t underruns;
+} haptic_playout_t;
+
+/**@brief Clear the queue and forget the timeline anchor
+ *
+ * Motor outputs are reset to zero.
+ */
+void haptic_playout_reset(haptic_playout_t *playout);
+
+/**@brief Anchor the sender timeline to a known clock offset
+ *
+ * @param[in] playout playout buffer
+ * @param[in] offset_ms local_ms minus sender_ms of a frame due now
+ */
+void haptic_playout_set_offset(haptic_playout_t *playout, uint32_t offset_ms);
+
+/**@brief Queue the frames of a decoded batch
+ *
+ * @param[in] playout playout buffer
+ * @param[in] batch decoded batch
+ * @param[in] now_ms local time the batch arrived
+ */
+void haptic_playout_submit(haptic_playout_t *playout,
+		const haptic_batch_t *batch, uint32_t now_ms);
+
+/**@brief Apply every frame due at now_ms and interpolate towards the next
+ *
+ * @param[in] playout playout buffer
+ * @param[in] now_ms current local time
+ *
+ * @return true if the motor outputs in playout->current changed
+ */
+bool haptic_playout_tick(haptic_playout_t *playout, uint32_t now_ms);
+
+/**@brief Check for queued frames
+ *
+ * @return true while frames are waiting to be played
+ */
+bool haptic_playout_pending(const haptic_playout_t *playout);
+
+/**@brief Check for dead-reckoning past the last set-point
+ *
+ * @return true while the outputs still follow the last trend and need a tick
+ */
+bool haptic_playout_extrapolating(const haptic_playout_t *playout,
+		uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAPTIC_PLAYOUT_H__ */
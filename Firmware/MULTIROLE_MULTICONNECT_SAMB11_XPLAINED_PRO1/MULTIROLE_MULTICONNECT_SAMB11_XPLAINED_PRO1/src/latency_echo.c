@@ -0,0 +1,117 @@
+/**
+ * \file
+ *
+ * \brief Motion to vibration latency echo
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "latency_echo.h"
+
+/* Wrap-safe "a is at or after b" for the 32-bit millisecond clock */
+#define TIME_AFTER_EQ(a, b)     ((int32_t)((uint32_t)(a) - (uint32_t)(b)) >= 0)
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+	buf[2] = (uint8_t)(value >> 16);
+	buf[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8)
+			| ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+void latency_echo_init(latency_echo_t *echo)
+{
+	memset(echo, 0, sizeof(latency_echo_t));
+}
+
+bool latency_echo_received(latency_echo_t *echo, uint8_t sequence,
+		uint64_t arrival_us, uint32_t due_ms, uint32_t now_ms)
+{
+	latency_echo_entry_t *entry;
+
+	if (sequence % LATENCY_ECHO_EVERY) {
+		return false;
+	}
+
+	if (echo->count == LATENCY_ECHO_PENDING) {
+		memmove(&echo->pending[0], &echo->pending[1],
+				(LATENCY_ECHO_PENDING - 1) * sizeof(latency_echo_entry_t));
+		echo->count--;
+		echo->dropped++;
+	}
+
+	entry = &echo->pending[echo->count++];
+	entry->sequence = sequence;
+	entry->flags = TIME_AFTER_EQ(due_ms, now_ms) ? 0 : LATENCY_ECHO_FLAG_LATE;
+	entry->arrival_us = arrival_us;
+	entry->due_ms = due_ms;
+	entry->actuation_us = 0;
+	return true;
+}
+
+bool latency_echo_actuated(latency_echo_t *echo, uint32_t now_ms,
+		uint64_t now_us, bool changed, latency_echo_entry_t *entry)
+{
+	uint8_t idx;
+
+	/* A newer batch may be due before an older one it replaced */
+	for (idx = 0; idx < echo->count; idx++) {
+		if (TIME_AFTER_EQ(now_ms, echo->pending[idx].due_ms)) {
+			break;
+		}
+	}
+	if (idx == echo->count) {
+		return false;
+	}
+
+	*entry = echo->pending[idx];
+	entry->actuation_us = (uint32_t)(now_us - entry->arrival_us);
+	if (!changed) {
+		entry->flags |= LATENCY_ECHO_FLAG_UNCHANGED;
+	}
+
+	echo->count--;
+	memmove(&echo->pending[idx], &echo->pending[idx + 1],
+			(echo->count - idx) * sizeof(latency_echo_entry_t));
+	return true;
+}
+
+uint8_t latency_echo_encode(const latency_echo_entry_t *entry,
+		uint64_t arrival_us, bool synced, uint8_t *buf, uint8_t buf_len)
+{
+	if (buf_len < LATENCY_ECHO_RECORD_SIZE) {
+		return 0;
+	}
+
+	buf[0] = LATENCY_ECHO_RECORD;
+	buf[1] = entry->sequence;
+	buf[2] = entry->flags | (synced ? LATENCY_ECHO_FLAG_SYNCED : 0);
+	buf[3] = 0;
+	put_le32(&buf[4], (uint32_t)arrival_us);
+	put_le32(&buf[8], (uint32_t)(arrival_us >> 32));
+	put_le32(&buf[12], entry->actuation_us);
+	return LATENCY_ECHO_RECORD_SIZE;
+}
+
+bool latency_echo_decode(const uint8_t *buf, uint16_t len,
+		latency_echo_entry_t *entry)
+{
+	if ((len != LATENCY_ECHO_RECORD_SIZE) || (buf[0] != LATENCY_ECHO_RECORD)) {
+		return false;
+	}
+
+	memset(entry, 0, sizeof(latency_echo_entry_t));
+	entry->sequence = buf[1];
+	entry->flags = buf[2];
+	entry->arrival_us = (uint64_t)get_le32(&buf[4])
+			| ((uint64_t)get_le32(&buf[8]) << 32);
+	entry->actuation_us = get_le32(&buf[12]);
+	return true;
+}
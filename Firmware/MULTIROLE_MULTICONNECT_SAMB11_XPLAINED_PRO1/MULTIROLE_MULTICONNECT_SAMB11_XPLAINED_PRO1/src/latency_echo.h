@@ -0,0 +1,131 @@
+/**
+ * \file
+ *
+ * \brief Motion to vibration latency echo
+ *
+ * The phone stamps every depth frame on its way to the radio: capture,
+ * processing, enqueue and the successful notification. The wearable
+ * closes the chain: for a sample of the received batches it notes when the
+ * batch arrived and when the output tick that plays its first frame ran,
+ * and echoes both times back as a diagnostics record. With the phone clock
+ * known (time_sync.h) the arrival is given on the phone clock so the phone
+ * can line it up with its own stamps; before that only the time from
+ * arrival to actuation is meaningful.
+ *
+ * The actuation time includes the playout delay of haptic_playout.h, which
+ * is deliberate buffering rather than processing, and the first step of
+ * the output filter; the motor itself spins up after that.
+ *
+ * Echo, diagnostics record:
+ *
+ *   offset  size  field
+ *   0       1     LATENCY_ECHO_RECORD
+ *   1       1     batch sequence
+ *   2       1     flags, LATENCY_ECHO_FLAG_*
+ *   3       1     reserved, 0
+ *   4       8     arrival, microseconds
+ *   12      4     actuation minus arrival, microseconds
+ *
+ * Multi-byte fields little endian. Plain C so the phone decodes the echo
+ * with the same source.
+ */
+
+#ifndef __LATENCY_ECHO_H__
+#define __LATENCY_ECHO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* First byte of the echo on the diagnostics characteristic */
+#define LATENCY_ECHO_RECORD             (0x05)
+
+#define LATENCY_ECHO_RECORD_SIZE        (16)
+
+/* Batches whose sequence is a multiple of this are echoed; every fourth
+ * keeps the uplink below ten writes a second at the depth frame rate */
+#define LATENCY_ECHO_EVERY              (4)
+
+/* Batches waiting for their first frame to play */
+#define LATENCY_ECHO_PENDING            (4)
+
+/* The arrival is on the phone clock, otherwise on the wearable's */
+#define LATENCY_ECHO_FLAG_SYNCED        (0x01)
+/* The first frame was due before the batch arrived */
+#define LATENCY_ECHO_FLAG_LATE          (0x02)
+/* The tick left the motor outputs as they were, e.g. an unchanged level */
+#define LATENCY_ECHO_FLAG_UNCHANGED     (0x04)
+
+typedef struct latency_echo_entry {
+	uint8_t sequence;
+	uint8_t flags;
+	uint64_t arrival_us;
+	/* local time the first frame is due */
+	uint32_t due_ms;
+	uint32_t actuation_us;
+} latency_echo_entry_t;
+
+typedef struct latency_echo {
+	latency_echo_entry_t pending[LATENCY_ECHO_PENDING];
+	uint8_t count;
+	/* statistics */
+	uint16_t dropped;
+} latency_echo_t;
+
+/**@brief Forget the pending batches
+ */
+void latency_echo_init(latency_echo_t *echo);
+
+/**@brief Note the arrival of a batch
+ *
+ * Only batches with a sequence that is a multiple of LATENCY_ECHO_EVERY are
+ * tracked; when all slots are busy the oldest is dropped.
+ *
+ * @param[in] sequence sequence of the batch
+ * @param[in] arrival_us local time the notification arrived
+ * @param[in] due_ms local time its first frame is due
+ * @param[in] now_ms local time
+ *
+ * @return true if the batch is tracked
+ */
+bool latency_echo_received(latency_echo_t *echo, uint8_t sequence,
+		uint64_t arrival_us, uint32_t due_ms, uint32_t now_ms);
+
+/**@brief Take a batch whose first frame was played by the tick at now_ms
+ *
+ * Call after every output tick until it returns false.
+ *
+ * @param[in] now_ms local time of the tick
+ * @param[in] now_us local time the outputs were updated
+ * @param[in] changed the tick changed the motor outputs
+ * @param[out] entry the batch, with the actuation time set
+ *
+ * @return true if a batch was taken
+ */
+bool latency_echo_actuated(latency_echo_t *echo, uint32_t now_ms,
+		uint64_t now_us, bool changed, latency_echo_entry_t *entry);
+
+/**@brief Serialize an echo
+ *
+ * @param[in] arrival_us arrival to report, on the phone clock if synced
+ *
+ * @return number of bytes written, 0 if buf_len is too small
+ */
+uint8_t latency_echo_encode(const latency_echo_entry_t *entry,
+		uint64_t arrival_us, bool synced, uint8_t *buf, uint8_t buf_len);
+
+/**@brief Parse an echo
+ *
+ * @return false if the record is not a well-formed echo
+ */
+bool latency_echo_decode(const uint8_t *buf, uint16_t len,
+		latency_echo_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LATENCY_ECHO_H__ */
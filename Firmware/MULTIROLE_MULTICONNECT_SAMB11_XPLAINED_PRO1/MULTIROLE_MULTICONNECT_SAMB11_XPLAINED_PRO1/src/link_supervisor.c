@@ -0,0 +1,189 @@
+/**
+ * \file
+ *
+ * \brief Haptic link supervision
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "link_supervisor.h"
+
+#define PATTERN_ACTIVE_MS       (2 * LINK_SUP_PULSE_MS * LINK_SUP_PULSES)
+#define PATTERN_TOTAL_MS        (LINK_SUP_PATTERN_PERIOD_MS * LINK_SUP_PATTERN_REPEATS)
+
+static uint32_t elapsed_ms(uint32_t now_ms, uint32_t since_ms)
+{
+	return (uint32_t)(now_ms - since_ms);
+}
+
+static void sup_enter(link_sup_t *sup, link_sup_state_t state, uint32_t at_ms)
+{
+	sup->state = state;
+	sup->state_ms = at_ms;
+}
+
+static uint8_t pattern_level(uint32_t t_ms)
+{
+	uint32_t cycle;
+
+	if (t_ms >= PATTERN_TOTAL_MS) {
+		return 0;
+	}
+	cycle = t_ms % LINK_SUP_PATTERN_PERIOD_MS;
+	if ((cycle < PATTERN_ACTIVE_MS) &&
+			((cycle % (2 * LINK_SUP_PULSE_MS)) < LINK_SUP_PULSE_MS)) {
+		return LINK_SUP_PULSE_LEVEL;
+	}
+	return 0;
+}
+
+/* Move to the timeout states that became due */
+static void sup_update(link_sup_t *sup, uint32_t now_ms)
+{
+	if ((sup->state == LINK_SUP_ACTIVE) &&
+			(elapsed_ms(now_ms, sup->last_frame_ms) >= LINK_SUP_FRAME_TIMEOUT_MS)) {
+		sup_enter(sup, LINK_SUP_FADING,
+				sup->last_frame_ms + LINK_SUP_FRAME_TIMEOUT_MS);
+		sup->stalls++;
+		sup->recovering = true;
+		sup->lost_ms = sup->last_frame_ms;
+	}
+
+	if ((sup->state == LINK_SUP_FADING) &&
+			(elapsed_ms(now_ms, sup->state_ms) >= LINK_SUP_FADE_MS)) {
+		sup_enter(sup, LINK_SUP_STALE, sup->state_ms + LINK_SUP_FADE_MS);
+	}
+}
+
+void link_sup_init(link_sup_t *sup, uint32_t now_ms)
+{
+	memset(sup, 0, sizeof(link_sup_t));
+	sup_enter(sup, LINK_SUP_DOWN, now_ms);
+}
+
+void link_sup_connected(link_sup_t *sup, uint32_t now_ms)
+{
+	if (sup->recovering) {
+		sup->last_reconnect_ms = elapsed_ms(now_ms, sup->lost_ms);
+	}
+	sup->ever_connected = true;
+	sup_enter(sup, LINK_SUP_WAITING, now_ms);
+}
+
+void link_sup_disconnected(link_sup_t *sup, uint32_t now_ms)
+{
+	if (sup->state == LINK_SUP_DOWN) {
+		return;
+	}
+
+	sup->disconnects++;
+	/* A stall before the drop already started the outage */
+	if (!sup->recovering) {
+		sup->recovering = true;
+		sup->lost_ms = now_ms;
+	}
+	sup_enter(sup, LINK_SUP_DOWN, now_ms);
+}
+
+bool link_sup_frame(link_sup_t *sup, uint32_t now_ms)
+{
+	bool recovered = false;
+
+	if (sup->recovering) {
+		uint32_t outage = elapsed_ms(now_ms, sup->lost_ms);
+
+		sup->last_recovery_ms = outage;
+		sup->total_recovery_ms += outage;
+		if (outage > sup->max_recovery_ms) {
+			sup->max_recovery_ms = outage;
+		}
+		sup->recoveries++;
+		sup->recovering = false;
+		recovered = true;
+	}
+
+	sup->last_frame_ms = now_ms;
+	sup_enter(sup, LINK_SUP_ACTIVE, now_ms);
+	return recovered;
+}
+
+void link_sup_apply(link_sup_t *sup, uint32_t now_ms, const uint8_t *level,
+		uint8_t *out, uint8_t count)
+{
+	uint8_t idx;
+
+	sup_update(sup, now_ms);
+
+	switch (sup->state) {
+	case LINK_SUP_ACTIVE:
+		if (out != level) {
+			memcpy(out, level, count);
+		}
+		break;
+
+	case LINK_SUP_FADING:
+	{
+		uint32_t remaining = LINK_SUP_FADE_MS
+				- elapsed_ms(now_ms, sup->state_ms);
+
+		for (idx = 0; idx < count; idx++) {
+			out[idx] = (uint8_t)((level[idx] * remaining) / LINK_SUP_FADE_MS);
+		}
+	}
+	break;
+
+	case LINK_SUP_DOWN:
+	{
+		uint8_t pulse = 0;
+
+		if (sup->ever_connected) {
+			pulse = pattern_level(elapsed_ms(now_ms, sup->state_ms));
+		}
+		memset(out, pulse, count);
+	}
+	break;
+
+	default:
+		memset(out, 0, count);
+		break;
+	}
+}
+
+bool link_sup_next_event(const link_sup_t *sup, uint32_t now_ms,
+		uint32_t *when_ms)
+{
+	uint32_t t_ms;
+	uint32_t cycle;
+
+	switch (sup->state) {
+	case LINK_SUP_ACTIVE:
+		*when_ms = sup->last_frame_ms + LINK_SUP_FRAME_TIMEOUT_MS;
+		return true;
+
+	case LINK_SUP_FADING:
+		/* The level steps down on every tick */
+		*when_ms = now_ms;
+		return true;
+
+	case LINK_SUP_DOWN:
+		if (!sup->ever_connected) {
+			return false;
+		}
+		t_ms = elapsed_ms(now_ms, sup->state_ms);
+		if (t_ms >= PATTERN_TOTAL_MS) {
+			return false;
+		}
+		cycle = t_ms % LINK_SUP_PATTERN_PERIOD_MS;
+		if (cycle < PATTERN_ACTIVE_MS) {
+			*when_ms = now_ms - cycle
+					+ ((cycle / LINK_SUP_PULSE_MS) + 1) * LINK_SUP_PULSE_MS;
+		} else {
+			*when_ms = now_ms - cycle + LINK_SUP_PATTERN_PERIOD_MS;
+		}
+		return true;
+
+	default:
+		return false;
+	}
+}
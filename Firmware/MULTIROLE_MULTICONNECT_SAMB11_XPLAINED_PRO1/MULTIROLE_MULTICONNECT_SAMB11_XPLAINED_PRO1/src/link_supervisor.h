@@ -0,0 +1,120 @@
+/**
+ * \file
+ *
+ * \brief Haptic link supervision
+ *
+ * Watches the flow of valid haptic timelines and decides what the motors
+ * may do when it stops. While frames arrive the playout output passes
+ * through unchanged. LINK_SUP_FRAME_TIMEOUT_MS after the last frame the
+ * output fades to zero over LINK_SUP_FADE_MS, so a phone that disappears
+ * never leaves a motor running. When the connection drops the motors play a
+ * short pulse train that the wearer can tell apart from depth feedback.
+ *
+ * The supervisor also measures how long the wearer was without feedback:
+ * from the loss (disconnect or frame timeout) to the reconnection and to
+ * the first valid frame afterwards.
+ *
+ * Plain C driven by millisecond timestamps, so it can be run on a host
+ * against a simulated link.
+ */
+
+#ifndef __LINK_SUPERVISOR_H__
+#define __LINK_SUPERVISOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Silence after the last valid frame before the output starts to fade */
+#define LINK_SUP_FRAME_TIMEOUT_MS       (250)
+
+/* Fade from the last level to zero */
+#define LINK_SUP_FADE_MS                (200)
+
+/* Link loss pattern: LINK_SUP_PULSES pulses of LINK_SUP_PULSE_MS, repeated
+ * every LINK_SUP_PATTERN_PERIOD_MS, LINK_SUP_PATTERN_REPEATS times */
+#define LINK_SUP_PULSES                 (3)
+#define LINK_SUP_PULSE_MS               (80)
+#define LINK_SUP_PULSE_LEVEL            (180)
+#define LINK_SUP_PATTERN_PERIOD_MS      (4000)
+#define LINK_SUP_PATTERN_REPEATS        (3)
+
+typedef enum {
+	/* no connection, loss pattern while repeats remain */
+	LINK_SUP_DOWN,
+	/* connected, waiting for the first frame */
+	LINK_SUP_WAITING,
+	/* frames arriving */
+	LINK_SUP_ACTIVE,
+	/* frame timeout, output fading */
+	LINK_SUP_FADING,
+	/* frame timeout, output off */
+	LINK_SUP_STALE
+} link_sup_state_t;
+
+typedef struct link_sup {
+	link_sup_state_t state;
+	/* time the current state was entered */
+	uint32_t state_ms;
+	uint32_t last_frame_ms;
+	/* start of the current outage, valid while recovering */
+	uint32_t lost_ms;
+	bool recovering;
+	bool ever_connected;
+	/* metrics */
+	uint32_t disconnects;
+	uint32_t stalls;
+	uint32_t recoveries;
+	uint32_t last_reconnect_ms;
+	uint32_t last_recovery_ms;
+	uint32_t max_recovery_ms;
+	uint32_t total_recovery_ms;
+} link_sup_t;
+
+/**@brief Reset the supervisor and its metrics, link down
+ */
+void link_sup_init(link_sup_t *sup, uint32_t now_ms);
+
+/**@brief The link to the phone is up
+ */
+void link_sup_connected(link_sup_t *sup, uint32_t now_ms);
+
+/**@brief The link to the phone dropped
+ */
+void link_sup_disconnected(link_sup_t *sup, uint32_t now_ms);
+
+/**@brief A valid haptic timeline was received
+ *
+ * @return true if this frame ended an outage; the duration is in
+ * sup->last_recovery_ms
+ */
+bool link_sup_frame(link_sup_t *sup, uint32_t now_ms);
+
+/**@brief Compute the motor output allowed at now_ms
+ *
+ * @param[in] sup supervisor
+ * @param[in] now_ms current time
+ * @param[in] level playout output
+ * @param[out] out motor output, may be the same buffer as level
+ * @param[in] count number of motors
+ */
+void link_sup_apply(link_sup_t *sup, uint32_t now_ms, const uint8_t *level,
+		uint8_t *out, uint8_t count);
+
+/**@brief Next time link_sup_apply() must run for the output to stay correct
+ *
+ * @param[out] when_ms time of the next change
+ *
+ * @return false if the output does not change until the next event
+ */
+bool link_sup_next_event(const link_sup_t *sup, uint32_t now_ms,
+		uint32_t *when_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LINK_SUPERVISOR_H__ */
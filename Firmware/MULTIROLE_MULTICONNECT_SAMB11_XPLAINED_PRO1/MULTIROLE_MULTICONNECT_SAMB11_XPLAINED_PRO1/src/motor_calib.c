@@ -0,0 +1,193 @@
+/**
+ * \file
+ *
+ * \brief Vibration motor calibration
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stddef.h>
+#include <string.h>
+#include "motor_calib.h"
+
+/* Curve position of level 255, Q8 points */
+#define CALIB_POS_MAX                   ((MOTOR_CALIB_POINTS - 1) << 8)
+
+/* Curve value scale, Q8 of 0..255 */
+#define CALIB_VALUE_MAX                 (255 << 8)
+
+/* Fletcher-16 over the image, checksum field excluded */
+static uint16_t calib_checksum(const motor_calib_image_t *image)
+{
+	const uint8_t *ptr = (const uint8_t *)image;
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	uint16_t idx;
+
+	for (idx = 0; idx < sizeof(motor_calib_image_t); idx++) {
+		if ((idx >= offsetof(motor_calib_image_t, checksum)) &&
+				(idx < offsetof(motor_calib_image_t, checksum) + sizeof(image->checksum))) {
+			continue;
+		}
+		sum1 = (uint16_t)((sum1 + ptr[idx]) % 255);
+		sum2 = (uint16_t)((sum2 + sum1) % 255);
+	}
+	return (uint16_t)((sum2 << 8) | sum1);
+}
+
+static void calib_seal(motor_calib_image_t *image)
+{
+	image->checksum = calib_checksum(image);
+}
+
+static uint16_t calib_duty_from_byte(uint8_t value)
+{
+	return (uint16_t)(((uint32_t)value * MOTOR_CALIB_DUTY_MAX + 127) / 255);
+}
+
+static uint8_t calib_duty_to_byte(uint16_t duty)
+{
+	if (duty >= MOTOR_CALIB_DUTY_MAX) {
+		return 255;
+	}
+	return (uint8_t)(((uint32_t)duty * 255 + (MOTOR_CALIB_DUTY_MAX / 2))
+			/ MOTOR_CALIB_DUTY_MAX);
+}
+
+void motor_calib_linear(uint16_t min_duty, uint16_t *duty)
+{
+	uint16_t level;
+
+	if (min_duty > MOTOR_CALIB_DUTY_MAX) {
+		min_duty = MOTOR_CALIB_DUTY_MAX;
+	}
+
+	duty[0] = 0;
+	for (level = 1; level < MOTOR_CALIB_LEVELS; level++) {
+		duty[level] = min_duty + (uint16_t)(((uint32_t)(level - 1)
+				* (MOTOR_CALIB_DUTY_MAX - min_duty)) / 254);
+	}
+}
+
+void motor_calib_build(const motor_calib_curve_t *curve, uint16_t *duty)
+{
+	uint32_t span = curve->sat_duty - curve->start_duty;
+	uint16_t level;
+
+	duty[0] = 0;
+	for (level = 1; level < MOTOR_CALIB_LEVELS; level++) {
+		uint32_t pos = ((uint32_t)(level - 1) * CALIB_POS_MAX) / 254;
+		uint8_t seg = (uint8_t)(pos >> 8);
+		uint32_t value = (uint32_t)curve->point[seg] << 8;
+
+		/* Interpolate between the two points around the level */
+		if (seg < MOTOR_CALIB_POINTS - 1) {
+			value += (uint32_t)(curve->point[seg + 1] - curve->point[seg])
+					* (pos & 0xFF);
+		}
+		duty[level] = curve->start_duty + (uint16_t)(((span * value)
+				+ (CALIB_VALUE_MAX / 2)) / CALIB_VALUE_MAX);
+	}
+}
+
+motor_calib_status_t motor_calib_check(const motor_calib_curve_t *curve)
+{
+	uint8_t idx;
+
+	if ((curve->sat_duty > MOTOR_CALIB_DUTY_MAX) ||
+			(curve->start_duty > curve->sat_duty)) {
+		return MOTOR_CALIB_ERR_RANGE;
+	}
+	for (idx = 1; idx < MOTOR_CALIB_POINTS; idx++) {
+		if (curve->point[idx] < curve->point[idx - 1]) {
+			return MOTOR_CALIB_ERR_CURVE;
+		}
+	}
+	return MOTOR_CALIB_OK;
+}
+
+uint8_t motor_calib_encode(uint8_t motor, const motor_calib_curve_t *curve,
+		uint8_t *buf, uint8_t buf_len)
+{
+	if (buf_len < MOTOR_CALIB_MSG_SIZE) {
+		return 0;
+	}
+
+	buf[0] = MOTOR_CALIB_MSG;
+	buf[1] = motor;
+	buf[2] = calib_duty_to_byte(curve->start_duty);
+	buf[3] = calib_duty_to_byte(curve->sat_duty);
+	memcpy(&buf[4], curve->point, MOTOR_CALIB_POINTS);
+	return MOTOR_CALIB_MSG_SIZE;
+}
+
+motor_calib_status_t motor_calib_decode(const uint8_t *buf, uint16_t len,
+		uint8_t *motor, bool *clear, motor_calib_curve_t *curve)
+{
+	if (len != MOTOR_CALIB_MSG_SIZE) {
+		return MOTOR_CALIB_ERR_LENGTH;
+	}
+	if (buf[0] != MOTOR_CALIB_MSG) {
+		return MOTOR_CALIB_ERR_TYPE;
+	}
+	if ((buf[1] >= MOTOR_CALIB_MOTORS) && (buf[1] != MOTOR_CALIB_ALL_MOTORS)) {
+		return MOTOR_CALIB_ERR_MOTOR;
+	}
+
+	*motor = buf[1];
+	*clear = (buf[2] == 0) && (buf[3] == 0);
+	curve->start_duty = calib_duty_from_byte(buf[2]);
+	curve->sat_duty = calib_duty_from_byte(buf[3]);
+	memcpy(curve->point, &buf[4], MOTOR_CALIB_POINTS);
+
+	if (*clear) {
+		return MOTOR_CALIB_OK;
+	}
+	return motor_calib_check(curve);
+}
+
+void motor_calib_image_init(motor_calib_image_t *image)
+{
+	memset(image, 0, sizeof(motor_calib_image_t));
+	image->magic = MOTOR_CALIB_MAGIC;
+	image->version = MOTOR_CALIB_VERSION;
+	calib_seal(image);
+}
+
+void motor_calib_image_set(motor_calib_image_t *image, uint8_t motor,
+		const motor_calib_curve_t *curve)
+{
+	if (motor >= MOTOR_CALIB_MOTORS) {
+		return;
+	}
+
+	if (curve) {
+		image->curve[motor] = *curve;
+		image->valid_mask |= (uint8_t)(1 << motor);
+	} else {
+		memset(&image->curve[motor], 0, sizeof(motor_calib_curve_t));
+		image->valid_mask &= (uint8_t)~(1 << motor);
+	}
+	calib_seal(image);
+}
+
+bool motor_calib_restore(motor_calib_image_t *image)
+{
+	uint8_t idx;
+
+	if ((image->magic != MOTOR_CALIB_MAGIC) ||
+			(image->version != MOTOR_CALIB_VERSION) ||
+			(image->checksum != calib_checksum(image))) {
+		motor_calib_image_init(image);
+		return false;
+	}
+
+	for (idx = 0; idx < MOTOR_CALIB_MOTORS; idx++) {
+		if ((image->valid_mask & (1 << idx)) &&
+				(motor_calib_check(&image->curve[idx]) != MOTOR_CALIB_OK)) {
+			motor_calib_image_init(image);
+			return false;
+		}
+	}
+	return true;
+}
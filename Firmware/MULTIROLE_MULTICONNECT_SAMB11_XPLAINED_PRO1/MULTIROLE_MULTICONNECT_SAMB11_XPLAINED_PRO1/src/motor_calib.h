@@ -0,0 +1,157 @@
+/**
+ * \file
+ *
+ * \brief Vibration motor calibration
+ *
+ * Coin motors do not start below a duty threshold, stop getting stronger
+ * above a saturation duty and in between feel far from linear; all three
+ * vary from unit to unit. A motor's calibration gives its start and
+ * saturation duty and a 16 point response curve: point n is the position
+ * in [start_duty, sat_duty], 0..255, that feels like n/15 of full
+ * strength. Points must not decrease.
+ *
+ * The curve is expanded into a 256 entry duty table per motor once, when
+ * the calibration changes, so turning a level into a duty is a single
+ * lookup on every update.
+ *
+ * Calibration message, shares the haptic timeline characteristic and is
+ * told apart by its first byte:
+ *
+ *   offset  size  field
+ *   0       1     MOTOR_CALIB_MSG
+ *   1       1     motor index, MOTOR_CALIB_ALL_MOTORS for every motor
+ *   2       1     start duty, 0..255 of MOTOR_CALIB_DUTY_MAX
+ *   3       1     saturation duty, 0..255 of MOTOR_CALIB_DUTY_MAX
+ *   4       16    response curve
+ *
+ * A start and saturation duty of 0 clears the calibration.
+ *
+ * The calibration of all motors is kept in a flat image with a magic and
+ * checksum, like gatt_cache.h. The application saves it to flash as is
+ * with flash_store.h on every change and checks it with
+ * motor_calib_restore() when it is read back at start up.
+ *
+ * Plain C so the tables can be checked on a host.
+ */
+
+#ifndef __MOTOR_CALIB_H__
+#define __MOTOR_CALIB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* First byte of a calibration message; haptic batches start with their
+ * version and patterns with HAPTIC_PATTERN_MSG */
+#define MOTOR_CALIB_MSG                 (0x43)
+
+#define MOTOR_CALIB_MSG_SIZE            (20)
+
+#define MOTOR_CALIB_ALL_MOTORS          (0xFF)
+
+#define MOTOR_CALIB_POINTS              (16)
+
+/* Levels of a duty table, level 0 is unused as it stops the motor */
+#define MOTOR_CALIB_LEVELS              (256)
+
+/* Same duty resolution as the motor control */
+#define MOTOR_CALIB_DUTY_MAX            (1023)
+
+#define MOTOR_CALIB_MOTORS              (4)
+
+#define MOTOR_CALIB_MAGIC               (0x4D43)
+
+#define MOTOR_CALIB_VERSION             (1)
+
+typedef enum {
+	MOTOR_CALIB_OK = 0,
+	MOTOR_CALIB_ERR_LENGTH,
+	MOTOR_CALIB_ERR_TYPE,
+	MOTOR_CALIB_ERR_MOTOR,
+	MOTOR_CALIB_ERR_RANGE,
+	MOTOR_CALIB_ERR_CURVE
+} motor_calib_status_t;
+
+typedef struct motor_calib_curve {
+	uint16_t start_duty;
+	uint16_t sat_duty;
+	uint8_t point[MOTOR_CALIB_POINTS];
+} motor_calib_curve_t;
+
+typedef struct motor_calib_image {
+	uint16_t magic;
+	uint8_t version;
+	/* bit n set when motor n is calibrated */
+	uint8_t valid_mask;
+	uint16_t checksum;
+	uint16_t reserved;
+	motor_calib_curve_t curve[MOTOR_CALIB_MOTORS];
+} motor_calib_image_t;
+
+/**@brief Fill a duty table with the uncalibrated linear map
+ *
+ * Levels 1..255 map onto [min_duty, MOTOR_CALIB_DUTY_MAX].
+ *
+ * @param[out] duty MOTOR_CALIB_LEVELS entries
+ */
+void motor_calib_linear(uint16_t min_duty, uint16_t *duty);
+
+/**@brief Fill a duty table from a calibration
+ *
+ * Levels 1..255 walk the response curve from its first to its last point;
+ * with points from 0 to 255 level 1 drives start_duty and level 255
+ * sat_duty.
+ *
+ * @param[out] duty MOTOR_CALIB_LEVELS entries
+ */
+void motor_calib_build(const motor_calib_curve_t *curve, uint16_t *duty);
+
+/**@brief Check a calibration before use
+ */
+motor_calib_status_t motor_calib_check(const motor_calib_curve_t *curve);
+
+/**@brief Serialize a calibration message
+ *
+ * The duties are rounded to the message resolution.
+ *
+ * @return number of bytes written, 0 if buf_len is too small
+ */
+uint8_t motor_calib_encode(uint8_t motor, const motor_calib_curve_t *curve,
+		uint8_t *buf, uint8_t buf_len);
+
+/**@brief Parse a calibration message
+ *
+ * @param[out] motor motor index or MOTOR_CALIB_ALL_MOTORS
+ * @param[out] clear the message clears the calibration
+ */
+motor_calib_status_t motor_calib_decode(const uint8_t *buf, uint16_t len,
+		uint8_t *motor, bool *clear, motor_calib_curve_t *curve);
+
+/**@brief Clear the calibration of every motor
+ */
+void motor_calib_image_init(motor_calib_image_t *image);
+
+/**@brief Store or clear the calibration of a motor
+ *
+ * @param[in] curve NULL clears it
+ */
+void motor_calib_image_set(motor_calib_image_t *image, uint8_t motor,
+		const motor_calib_curve_t *curve);
+
+/**@brief Check an image read back from storage
+ *
+ * The image is cleared if the magic, version, checksum or one of its
+ * curves is not valid.
+ *
+ * @return true if the image was valid
+ */
+bool motor_calib_restore(motor_calib_image_t *image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MOTOR_CALIB_H__ */
@@ -0,0 +1,100 @@
+/**
+ * \file
+ *
+ * \brief Vibration motor output control
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "motor_ctrl.h"
+
+static motor_out_t motor_ctrl_output(const motor_ctrl_t *ctrl, uint8_t idx,
+		uint8_t level)
+{
+	motor_out_t out;
+
+	if (level == 0) {
+		out.state = (ctrl->stop_mode == MOTOR_STOP_BRAKE) ?
+				MOTOR_OUT_BRAKE : MOTOR_OUT_COAST;
+		out.duty = 0;
+	} else {
+		out.state = MOTOR_OUT_DRIVE;
+		out.duty = ctrl->duty[idx][level];
+	}
+	return out;
+}
+
+static uint8_t motor_ctrl_update(motor_ctrl_t *ctrl)
+{
+	uint8_t changed = 0;
+	uint8_t idx;
+
+	for (idx = 0; idx < ctrl->count; idx++) {
+		motor_out_t out = motor_ctrl_output(ctrl, idx, ctrl->level[idx]);
+
+		if ((out.state != ctrl->out[idx].state) ||
+				(out.duty != ctrl->out[idx].duty)) {
+			ctrl->out[idx] = out;
+			changed |= (1 << idx);
+		}
+	}
+	return changed;
+}
+
+void motor_ctrl_init(motor_ctrl_t *ctrl, uint8_t count,
+		motor_stop_mode_t stop_mode, uint16_t min_duty)
+{
+	uint8_t idx;
+
+	memset(ctrl, 0, sizeof(motor_ctrl_t));
+	ctrl->count = (count > MOTOR_CTRL_MAX) ? MOTOR_CTRL_MAX : count;
+	ctrl->stop_mode = stop_mode;
+	ctrl->min_duty = (min_duty > MOTOR_CTRL_DUTY_MAX) ?
+			MOTOR_CTRL_DUTY_MAX : min_duty;
+
+	for (idx = 0; idx < ctrl->count; idx++) {
+		motor_calib_linear(ctrl->min_duty, ctrl->duty[idx]);
+		ctrl->out[idx] = motor_ctrl_output(ctrl, idx, 0);
+	}
+}
+
+uint8_t motor_ctrl_set(motor_ctrl_t *ctrl, const uint8_t *level)
+{
+	memcpy(ctrl->level, level, ctrl->count);
+	return motor_ctrl_update(ctrl);
+}
+
+uint8_t motor_ctrl_set_stop_mode(motor_ctrl_t *ctrl, motor_stop_mode_t mode)
+{
+	ctrl->stop_mode = mode;
+	return motor_ctrl_update(ctrl);
+}
+
+uint32_t motor_ctrl_duty_sum(const motor_ctrl_t *ctrl)
+{
+	uint32_t sum = 0;
+	uint8_t idx;
+
+	for (idx = 0; idx < ctrl->count; idx++) {
+		if (ctrl->out[idx].state == MOTOR_OUT_DRIVE) {
+			sum += ctrl->out[idx].duty;
+		}
+	}
+	return sum;
+}
+
+uint8_t motor_ctrl_set_curve(motor_ctrl_t *ctrl, uint8_t idx,
+		const motor_calib_curve_t *curve)
+{
+	if (idx >= ctrl->count) {
+		return 0;
+	}
+
+	if (curve) {
+		motor_calib_build(curve, ctrl->duty[idx]);
+	} else {
+		motor_calib_linear(ctrl->min_duty, ctrl->duty[idx]);
+	}
+	return motor_ctrl_update(ctrl);
+}
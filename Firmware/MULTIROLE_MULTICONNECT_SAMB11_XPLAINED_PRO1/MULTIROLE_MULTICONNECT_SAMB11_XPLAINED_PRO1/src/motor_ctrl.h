@@ -0,0 +1,107 @@
+/**
+ * \file
+ *
+ * \brief Vibration motor output control
+ *
+ * Turns haptic levels (0..255) into drive states for ERM vibration motors
+ * behind an H-bridge with one PWM input and one static input per motor:
+ *
+ *   state   PWM input       static input
+ *   DRIVE   duty cycle      low
+ *   COAST   low             low            motor spins down freely
+ *   BRAKE   high            high           motor terminals shorted
+ *
+ * Level 0 stops the motor in the configured stop mode. Levels 1..255 are
+ * looked up in a duty table per motor: uncalibrated they map linearly onto
+ * [min_duty, MOTOR_CTRL_DUTY_MAX] so that the lowest level still overcomes
+ * the motor's start-up friction, calibrated they follow the motor's
+ * response curve, see motor_calib.h.
+ *
+ * The control is plain C; motor_drv.c writes the result to the SAMB11 PWM
+ * and GPIO registers, a host build can check it against register stubs.
+ */
+
+#ifndef __MOTOR_CTRL_H__
+#define __MOTOR_CTRL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "motor_calib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Motors a controller can drive, one hardware PWM channel each */
+#define MOTOR_CTRL_MAX                  (4)
+
+/* Duty resolution of the PWM, full scale is always on */
+#define MOTOR_CTRL_DUTY_MAX             (1023)
+
+typedef enum {
+	MOTOR_STOP_COAST,
+	MOTOR_STOP_BRAKE
+} motor_stop_mode_t;
+
+typedef enum {
+	MOTOR_OUT_COAST,
+	MOTOR_OUT_DRIVE,
+	MOTOR_OUT_BRAKE
+} motor_out_state_t;
+
+typedef struct motor_out {
+	motor_out_state_t state;
+	/* PWM duty while driving, 0..MOTOR_CTRL_DUTY_MAX */
+	uint16_t duty;
+} motor_out_t;
+
+typedef struct motor_ctrl {
+	uint8_t count;
+	motor_stop_mode_t stop_mode;
+	uint16_t min_duty;
+	uint8_t level[MOTOR_CTRL_MAX];
+	motor_out_t out[MOTOR_CTRL_MAX];
+	/* duty of every level, rebuilt only when the calibration changes */
+	uint16_t duty[MOTOR_CTRL_MAX][MOTOR_CALIB_LEVELS];
+} motor_ctrl_t;
+
+/**@brief Initialize the controller with every motor stopped
+ *
+ * @param[in] ctrl controller
+ * @param[in] count motors, at most @ref MOTOR_CTRL_MAX
+ * @param[in] stop_mode output for level 0
+ * @param[in] min_duty duty for level 1
+ */
+void motor_ctrl_init(motor_ctrl_t *ctrl, uint8_t count,
+		motor_stop_mode_t stop_mode, uint16_t min_duty);
+
+/**@brief Set the level of every motor
+ *
+ * @return bit mask of the motors whose output changed
+ */
+uint8_t motor_ctrl_set(motor_ctrl_t *ctrl, const uint8_t *level);
+
+/**@brief Change how stopped motors are held
+ *
+ * @return bit mask of the motors whose output changed
+ */
+uint8_t motor_ctrl_set_stop_mode(motor_ctrl_t *ctrl, motor_stop_mode_t mode);
+
+/**@brief Sum of the duties of the driven motors
+ */
+uint32_t motor_ctrl_duty_sum(const motor_ctrl_t *ctrl);
+
+/**@brief Calibrate a motor
+ *
+ * @param[in] curve checked calibration, NULL restores the linear map
+ *
+ * @return bit mask of the motors whose output changed
+ */
+uint8_t motor_ctrl_set_curve(motor_ctrl_t *ctrl, uint8_t idx,
+		const motor_calib_curve_t *curve);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MOTOR_CTRL_H__ */
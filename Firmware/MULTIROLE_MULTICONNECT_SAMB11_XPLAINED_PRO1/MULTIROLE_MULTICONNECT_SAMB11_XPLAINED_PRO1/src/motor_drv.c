@@ -0,0 +1,154 @@
+/**
+ * \file
+ *
+ * \brief Vibration motor driver
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <asf.h>
+#include "conf_motor.h"
+#include "motor_drv.h"
+
+/* GPIO function of a pin, and the mega mux function carrying a signal */
+#define MOTOR_PINMUX_GPIO               (0)
+#define MOTOR_PINMUX_MEGAMUX(signal)    (((signal) << 8) | 1)
+
+static const uint8_t motor_pwm_pin[MOTOR_CTRL_MAX] = {
+	CONF_MOTOR_PWM_PIN_0,
+	CONF_MOTOR_PWM_PIN_1,
+	CONF_MOTOR_PWM_PIN_2,
+	CONF_MOTOR_PWM_PIN_3
+};
+
+static const uint8_t motor_static_pin[MOTOR_CTRL_MAX] = {
+	CONF_MOTOR_STATIC_PIN_0,
+	CONF_MOTOR_STATIC_PIN_1,
+	CONF_MOTOR_STATIC_PIN_2,
+	CONF_MOTOR_STATIC_PIN_3
+};
+
+static motor_ctrl_t motor_ctrl;
+
+/* State the pins were last set to */
+static motor_out_state_t motor_pin_state[MOTOR_CTRL_MAX];
+
+/* The four PWM control registers are consecutive and share one layout */
+static volatile uint32_t *motor_pwm_control(uint8_t idx)
+{
+	return &LPMCU_MISC_REGS0->PWM_1_CONTROL.reg + idx;
+}
+
+/* Hand the PWM pin to the PWM channel, or hold it at a static level */
+static void motor_drv_pwm_pin(uint8_t idx, bool pwm, bool level)
+{
+	if (pwm) {
+		gpio_pinmux_cofiguration(motor_pwm_pin[idx],
+				MOTOR_PINMUX_MEGAMUX(MEGAMUX_PWM1_OUT + idx));
+	} else {
+		gpio_pin_set_output_level(motor_pwm_pin[idx], level);
+		gpio_pinmux_cofiguration(motor_pwm_pin[idx], MOTOR_PINMUX_GPIO);
+	}
+}
+
+static void motor_drv_write(uint8_t idx)
+{
+	const motor_out_t *out = &motor_ctrl.out[idx];
+	bool pins = (out->state != motor_pin_state[idx]);
+
+	motor_pin_state[idx] = out->state;
+
+	switch (out->state) {
+	case MOTOR_OUT_DRIVE:
+		/* Full word write: the channel samples duty and enable together */
+		*motor_pwm_control(idx) = LPMCU_MISC_REGS_PWM_1_CONTROL_PWM_EN |
+				LPMCU_MISC_REGS_PWM_1_CONTROL_SAMPLE_METHOD_0 |
+				LPMCU_MISC_REGS_PWM_1_CONTROL_PWM_PERIOD(CONF_MOTOR_PWM_PERIOD) |
+				LPMCU_MISC_REGS_PWM_1_CONTROL_AGCDATA_IN(out->duty) |
+				LPMCU_MISC_REGS_PWM_1_CONTROL_CLOCK_SEL(CONF_MOTOR_PWM_CLOCK_SEL);
+		/* Static input low before the PWM input may go low, so the bridge
+		 * passes through forward drive and never reverse. Remuxing the pin
+		 * glitches it, so a duty change only touches the register. */
+		if (pins) {
+			gpio_pin_set_output_level(motor_static_pin[idx], false);
+			motor_drv_pwm_pin(idx, true, false);
+		}
+		break;
+
+	case MOTOR_OUT_BRAKE:
+		/* PWM input high before the static input goes high */
+		motor_drv_pwm_pin(idx, false, true);
+		gpio_pin_set_output_level(motor_static_pin[idx], true);
+		*motor_pwm_control(idx) = 0;
+		break;
+
+	case MOTOR_OUT_COAST:
+	default:
+		gpio_pin_set_output_level(motor_static_pin[idx], false);
+		motor_drv_pwm_pin(idx, false, false);
+		*motor_pwm_control(idx) = 0;
+		break;
+	}
+}
+
+static void motor_drv_apply(uint8_t changed)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < motor_ctrl.count; idx++) {
+		if (changed & (1 << idx)) {
+			motor_drv_write(idx);
+		}
+	}
+}
+
+static void motor_drv_configure(void)
+{
+	struct gpio_config config_gpio;
+	uint8_t idx;
+
+	gpio_get_config_defaults(&config_gpio);
+	config_gpio.direction = GPIO_PIN_DIR_OUTPUT;
+
+	for (idx = 0; idx < motor_ctrl.count; idx++) {
+		system_clock_peripheral_enable((enum system_peripheral)(PERIPHERAL_PWM1 + idx));
+		*motor_pwm_control(idx) = 0;
+
+		gpio_pin_set_config(motor_static_pin[idx], &config_gpio);
+		gpio_pin_set_config(motor_pwm_pin[idx], &config_gpio);
+		motor_pin_state[idx] = MOTOR_OUT_COAST;
+		motor_drv_write(idx);
+	}
+}
+
+void motor_drv_init(uint8_t count)
+{
+	motor_ctrl_init(&motor_ctrl, count, CONF_MOTOR_STOP_MODE,
+			CONF_MOTOR_MIN_DUTY);
+	motor_drv_configure();
+}
+
+void motor_drv_resume(void)
+{
+	motor_drv_configure();
+}
+
+void motor_drv_set(const uint8_t *level)
+{
+	motor_drv_apply(motor_ctrl_set(&motor_ctrl, level));
+}
+
+void motor_drv_set_stop_mode(motor_stop_mode_t mode)
+{
+	motor_drv_apply(motor_ctrl_set_stop_mode(&motor_ctrl, mode));
+}
+
+uint32_t motor_drv_duty_sum(void)
+{
+	return motor_ctrl_duty_sum(&motor_ctrl);
+}
+
+void motor_drv_set_curve(uint8_t idx, const motor_calib_curve_t *curve)
+{
+	motor_drv_apply(motor_ctrl_set_curve(&motor_ctrl, idx, curve));
+}
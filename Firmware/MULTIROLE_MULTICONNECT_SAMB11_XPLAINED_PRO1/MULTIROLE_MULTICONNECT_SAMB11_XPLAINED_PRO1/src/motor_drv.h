@@ -0,0 +1,52 @@
+/**
+ * \file
+ *
+ * \brief Vibration motor driver
+ *
+ * Drives the wearable's vibration motors from the SAMB11 hardware PWM
+ * channels, see motor_ctrl.h for the output states and conf_motor.h for
+ * the pins.
+ */
+
+#ifndef __MOTOR_DRV_H__
+#define __MOTOR_DRV_H__
+
+#include "motor_ctrl.h"
+
+/**@brief Configure the PWM channels and pins, all motors stopped
+ *
+ * @param[in] count motors to drive, at most @ref MOTOR_CTRL_MAX
+ */
+void motor_drv_init(uint8_t count);
+
+/**@brief Set the level of every motor
+ *
+ * Only the channels whose output changed are written. The PWM latches a
+ * new duty at the end of its current period, so an update never produces
+ * a runt pulse.
+ *
+ * @param[in] level one level per motor, 0 stops the motor
+ */
+void motor_drv_set(const uint8_t *level);
+
+/**@brief Brake or coast stopped motors
+ */
+void motor_drv_set_stop_mode(motor_stop_mode_t mode);
+
+/**@brief Sum of the duties currently driven, for the power estimate
+ */
+uint32_t motor_drv_duty_sum(void);
+
+/**@brief Calibrate a motor, takes effect on its current output
+ *
+ * @param[in] curve checked calibration, NULL restores the linear map
+ */
+void motor_drv_set_curve(uint8_t idx, const motor_calib_curve_t *curve);
+
+/**@brief Reconfigure the PWM channels and pins after sleep
+ *
+ * Restores the current outputs; levels and calibration are kept.
+ */
+void motor_drv_resume(void);
+
+#endif /* __MOTOR_DRV_H__ */
@@ -63,6 +63,8 @@
 #include "pxp_monitor.h"
 #include "immediate_alert.h"
 #include "timer_hw.h"
+#include "haptic_app.h"
+#include "trace_ring.h"
 //#include "button.h"
 
 #if defined IMMEDIATE_ALERT_SERVICE
@@ -81,23 +83,9 @@
 #include "pxp_reporter.h"
 #endif
 
-//#if defined BATTERY_SERVICE
-//#include "battery.h"
-//#endif
 
-
-/** @brief APP_BAS_FAST_ADV between 0x0020 and 0x4000 in 0.625 ms units (20ms to 10.24s). */
-#define APP_BAS_FAST_ADV				(100) //100 ms
-
-/** @brief APP_BAS_ADV_TIMEOUT Advertising time-out between 0x0001 and 0x3FFF in seconds, 0x0000 disables time-out.*/
-#define APP_BAS_ADV_TIMEOUT				(1000) // 100 Secs
-
-//#define BATTERY_UPDATE_INTERVAL	(1) //1 second
-//#define BATTERY_MAX_LEVEL		(100)
-//#define BATTERY_MIN_LEVEL		(0)
-
-
-//bat_gatt_service_handler_t bas_service_handler;
+/** @brief Trace packets sent per main loop pass */
+#define APP_TRACE_DRAIN_PACKETS			(4)
 
 extern gatt_txps_char_handler_t txps_handle;
 extern gatt_lls_char_handler_t lls_handle;
@@ -111,62 +99,6 @@ bool volatile app_timer_done = false;
 
 //bool volatile button_pressed = false;
 bool volatile timer_cb_done = false;
-//bool volatile bat_char_notification_confirmed = false;
-//bool volatile battery_flag = true;
-//uint8_t battery_level = BATTERY_MIN_LEVEL;
-//at_ble_handle_t battery_conn_handle = 0xFFFF;
-//bool volatile battery_stop_simulation = true;
-
-/*static at_ble_status_t bas_paired_app_event(void *param);
-static at_ble_status_t bas_encryption_status_changed_app_event(void *param);
-//static at_ble_status_t ble_disconnected_app_event(void *param);
-static at_ble_status_t battery_start_advertisement(void);
-static at_ble_status_t battery_set_advertisement_data(void);
-static at_ble_status_t ble_char_changed_app_event(void *param);
-static at_ble_status_t ble_notification_confirmed_app_event(void *param);
-static at_ble_status_t battery_simulation_task(void *param);
-//static at_ble_status_t ble_connected_app_event(void *param);
-static ble_peripheral_state_t peripheral_state = PERIPHERAL_IDLE_STATE;
-
-static ble_peripheral_state_t peripheral_advertising_cb(void)
-{
-	return peripheral_state;
-}*/
-
-/*static const ble_event_callback_t battery_app_gap_cb[] = {
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,//ble_connected_app_event,
-	NULL,//ble_disconnected_app_event,
-	NULL,
-	NULL,
-	NULL,//bas_paired_app_event,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,//bas_encryption_status_changed_app_event,
-	NULL,
-	NULL,
-	NULL,
-	NULL
-};
-
-static const ble_event_callback_t battery_app_gatt_server_cb[] = {
-	NULL,//ble_notification_confirmed_app_event,
-	NULL,
-	NULL,//ble_char_changed_app_event,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL
-};*/
 
 //void button_cb(void);
 
@@ -241,7 +173,11 @@ static void pxp_app_init(void)
 	at_ble_status_t scan_status;
 
 	/* Initialize the scanning procedure */
+#if PXP_AUTO_CONNECT
+	scan_status = pxp_monitor_auto_scan();
+#else
 	scan_status = gap_dev_scan();
+#endif
 
 	/* Check for scan status */
 	if (scan_status == AT_BLE_INVALID_PARAM) {
@@ -269,219 +205,35 @@ static void timer_callback_handler(void)
 	send_plf_int_msg_ind(USER_TIMER_CALLBACK, TIMER_EXPIRED_CALLBACK_TYPE_DETECT, NULL, 0);
 }
 
-/* Callback registered for AT_BLE_CONNECTED_DONE event from stack */
-/*static at_ble_status_t ble_connected_app_event(void *param)
-{
-	at_ble_connected_t *connected = (at_ble_connected_t *)param;
-	DBG_LOG("THIS FUNCTION DOES SOMETHING!!!");
-	if (connected->conn_status != AT_BLE_SUCCESS)
-	{
-		return AT_BLE_FAILURE;
-	}
-	if(!ble_check_iscentral(connected->handle))
-	{
-		peripheral_state = PERIPHERAL_CONNECTED_STATE;
-		battery_conn_handle = connected->handle;
-		#if !BLE_PAIR_ENABLE
-		bas_paired_app_event(param);
-		#else
-		ALL_UNUSED(param);
-		#endif
-	}
-	return AT_BLE_SUCCESS;
-}*/
-
-/* Callback registered for AT_BLE_PAIR_DONE event from stack */
-/*static at_ble_status_t bas_paired_app_event(void *param)
-{
-	at_ble_pair_done_t *ble_pair_done;
-	ble_pair_done = (at_ble_pair_done_t *)param;
-	if (ble_pair_done->status != AT_BLE_SUCCESS)
-	{
-		return AT_BLE_FAILURE;
-	}
-	if(ble_check_iscentral(ble_pair_done->handle))
-	{
-		if ((peripheral_state == PERIPHERAL_IDLE_STATE) || (peripheral_state == PERIPHERAL_DISCONNECTED_STATE))
-		{
-			battery_start_advertisement();
-			peripheral_state = PERIPHERAL_ADVERTISING_STATE;
-		}
-	}
-	else
-	{
-		peripheral_state = PERIPHERAL_PAIRED_STATE;
-		battery_conn_handle = ble_pair_done->handle;
-		timer_cb_done = false;
-		bat_char_notification_confirmed = true;
-		hw_timer_start(BATTERY_UPDATE_INTERVAL);
-		battery_stop_simulation = false;
-	}	
-	return AT_BLE_SUCCESS;
-}*/
-
-/*static at_ble_status_t bas_encryption_status_changed_app_event(void *param)
+/* Send the traced events over the diagnostics characteristic, records stay
+ * in the ring until the stack accepts their packet */
+static void app_trace_task(void)
 {
-	at_ble_encryption_status_changed_t *ble_enc_status;
-	ble_enc_status = (at_ble_encryption_status_changed_t *)param;
-	if (ble_enc_status->status != AT_BLE_SUCCESS)
-	{
-		return AT_BLE_FAILURE;
-	}
-	if(ble_check_iscentral(ble_enc_status->handle))
-	{
-		if ((peripheral_state == PERIPHERAL_IDLE_STATE) || (peripheral_state == PERIPHERAL_DISCONNECTED_STATE))
-		{
-			battery_start_advertisement();
-			peripheral_state = PERIPHERAL_ADVERTISING_STATE;
+	uint8_t packet[TRACE_PACKET_SIZE];
+	uint8_t records;
+	uint8_t idx;
+
+	for (idx = 0; idx < APP_TRACE_DRAIN_PACKETS; idx++) {
+		records = trace_ring_encode(packet, sizeof(packet));
+		if (records == 0) {
+			break;
 		}
-	}
-	else
-	{
-		peripheral_state = PERIPHERAL_ENCRYPTION_STATE;
-		battery_conn_handle = ble_enc_status->handle;
-		timer_cb_done = false;
-		bat_char_notification_confirmed = true;
-		hw_timer_start(BATTERY_UPDATE_INTERVAL);
-		battery_stop_simulation = false;
-	}	
-	return AT_BLE_SUCCESS;
-}*/
-
-/* Callback registered for AT_BLE_DISCONNECTED event from stack */
-/*static at_ble_status_t ble_disconnected_app_event(void *param)
-{
-	at_ble_disconnected_t *ble_disconnected;
-	ble_disconnected = (at_ble_disconnected_t *)param;
-	if (ble_disconnected->handle == battery_conn_handle)
-	{
-		battery_stop_simulation = true;
-		if (peripheral_state != PERIPHERAL_ADVERTISING_STATE)
-		{
-			battery_start_advertisement();
-			peripheral_state = PERIPHERAL_ADVERTISING_STATE;
+		if (pxp_monitor_diag_write(packet, TRACE_PACKET_LEN(records)) != AT_BLE_SUCCESS) {
+			break;
 		}
-		
-	}
-	ALL_UNUSED(param);
-	return AT_BLE_SUCCESS;
-}*/
-
-/* Advertisement start */
-/*static at_ble_status_t battery_start_advertisement(void)
-{
-	at_ble_status_t status = AT_BLE_FAILURE;
-	
-	// Start of advertisement
-	if((status = at_ble_adv_start(AT_BLE_ADV_TYPE_UNDIRECTED, AT_BLE_ADV_GEN_DISCOVERABLE, NULL, AT_BLE_ADV_FP_ANY, APP_BAS_FAST_ADV, APP_BAS_ADV_TIMEOUT, 0)) == AT_BLE_SUCCESS)
-	{
-		//Check the address
-		at_ble_addr_t address = {AT_BLE_ADDRESS_PUBLIC, {0xAB, 0xCD, 0xEF, 0xAB, 0xCD, 0xEF}};
-
-			// get BD address from BLE device
-			if(at_ble_addr_get(&address) != AT_BLE_SUCCESS)
-			{
-				DBG_LOG("BD address get failed");
-			}
-
-		
-		DBG_LOG("BD Address:0x%02X%02X%02X%02X%02X%02X, Address Type:%d",
-		address.addr[5],
-		address.addr[4],
-		address.addr[3],
-		address.addr[2],
-		address.addr[1],
-		address.addr[0], address.type);
-		DBG_LOG("BLE Started Advertisement");
-		return AT_BLE_SUCCESS;
+		trace_ring_consume(records);
 	}
-	else
-	{
-		DBG_LOG("BLE Advertisement start Failed reason :%d",status);
-	}
-	return status;
-}*/
-
-/* Advertisement data set and Advertisement start */
-/*static at_ble_status_t battery_set_advertisement_data(void)
-{
-	at_ble_status_t status = AT_BLE_FAILURE;
-	
-	if((status = ble_advertisement_data_set()) != AT_BLE_SUCCESS)
-	{
-		DBG_LOG("advertisement data set failed reason :%d",status);
-		return status;
-	}
-	
-	return status;
-}*/
-
-/* Callback registered for AT_BLE_NOTIFICATION_CONFIRMED event from stack */
-/*static at_ble_status_t ble_notification_confirmed_app_event(void *param)
-{
-	at_ble_cmd_complete_event_t *notification_status = (at_ble_cmd_complete_event_t *)param;
-	if(!notification_status->status)
-	{
-		bat_char_notification_confirmed = true;
-		DBG_LOG_DEV("sending notification to the peer success");
-	}
-	return AT_BLE_SUCCESS;
-}*/
-
-/* Callback registered for AT_BLE_CHARACTERISTIC_CHANGED event from stack */
-/*static at_ble_status_t ble_char_changed_app_event(void *param)
-{
-	at_ble_characteristic_changed_t *char_handle;
-	char_handle = (at_ble_characteristic_changed_t *)param;
-	if (char_handle->conn_handle != battery_conn_handle)
-	{
-		return AT_BLE_FAILURE;
-	}	
-	return bat_char_changed_event(char_handle->conn_handle, &bas_service_handler, char_handle, &bat_char_notification_confirmed);
-}*/
+}
 
-/*static at_ble_status_t battery_simulation_task(void *param)
+/* Peripherals lose their configuration in ULP, restore the console */
+static void app_resume_handler(void)
 {
-	if(battery_stop_simulation)
-	{
-		return AT_BLE_FAILURE;
-	}
-	if (timer_cb_done)
-	{
-		timer_cb_done = false;
-		// send the notification and Update the battery level
-		if(bat_char_notification_confirmed){
-			if(bat_update_char_value(battery_conn_handle, &bas_service_handler, battery_level, &bat_char_notification_confirmed) == AT_BLE_SUCCESS)
-			{
-				DBG_LOG("Battery Level:%d%%\r\n", battery_level);
-			}
-			if(battery_level == BATTERY_MAX_LEVEL)
-			{
-				battery_flag = false;
-			}
-			else if(battery_level == BATTERY_MIN_LEVEL)
-			{
-				battery_flag = true;
-			}
-			if(battery_flag)
-			{
-				battery_level++;
-			}
-			else
-			{
-				battery_level--;
-			}
-		}
-	}
-
-	ALL_UNUSED(param);
-	return AT_BLE_SUCCESS;
-}*/
+	init_port_list();
+	serial_console_init();
+}
 
 int main(void)
 {	
-	//uint8_t status;
-	
 	#if SAMG55
 	/* Initialize the SAM system. */
 	sysclk_init();
@@ -493,7 +245,10 @@ int main(void)
 	//button_init();
 	
 	platform_driver_init();
+	
+	/* Held until the haptic power manager finds the wearable idle */
 	acquire_sleep_lock();
+	register_resume_callback(app_resume_handler);
 	
 	/* Initialize serial console */
 	serial_console_init();
@@ -506,32 +261,17 @@ int main(void)
 
 	/* Register the callback */
 	hw_timer_register_callback(timer_callback_handler);
+	
+	/* Event trace, stamped by the millisecond tick */
+	trace_ring_init(hw_tick_get_us);
 
 	/* initialize the BLE chip  and Set the device mac address */
 	ble_device_init(NULL);
 	
-	/* Initialize the battery service */
-	//bat_init_service(&bas_service_handler, &battery_level);	
-
-	/* Define the primary service in the GATT server database */
-	/*if((status = bat_primary_service_define(&bas_service_handler))!= AT_BLE_SUCCESS)
-	{
-		DBG_LOG("defining battery service failed %d", status);
-	}*/
-	
-	//battery_set_advertisement_data();
-	
-	/* Register callbacks for gap related events */ 
-	/*ble_mgr_events_callback_handler(REGISTER_CALL_BACK,
-									BLE_GAP_EVENT_TYPE,
-									battery_app_gap_cb);*/
-									
-	/* Register callbacks for gatt server related events */
-	/*ble_mgr_events_callback_handler(REGISTER_CALL_BACK,
-									BLE_GATT_SERVER_EVENT_TYPE,
-									battery_app_gatt_server_cb);*/
-	
 	pxp_monitor_init(NULL);
+	
+	/* Initialize the haptic timeline playout */
+	haptic_app_init();
 
 	DBG_LOG("Initializing Perception Central Application");
 
@@ -540,12 +280,17 @@ int main(void)
 	
 	register_hw_timer_start_func_cb((hw_timer_start_func_cb_t)hw_timer_start);
 	register_hw_timer_stop_func_cb(hw_timer_stop);
-	//register_peripheral_state_cb(peripheral_advertising_cb);
 
 	while (1) {
 		/* BLE Event Task */
 		ble_event_task(BLE_EVENT_TIMEOUT);
 		
+		/* Haptic Playout Task */
+		haptic_app_task();
+		
+		/* Trace Drain Task */
+		app_trace_task();
+		
 		/*if (button_pressed)
 		{
 			uint8_t idx;
@@ -568,8 +313,6 @@ int main(void)
 						
 		}*/
 		
-		//battery_simulation_task(NULL);
-
 		/* Application Task */
 		if (app_timer_done) {
 			if (pxp_connect_request_flag == PXP_DEV_CONNECTING) {
@@ -586,18 +329,20 @@ int main(void)
 					DBG_LOG(
 							"Unable to connect with device");
 				}
+			} else if (pxp_connect_request_flag == PXP_DEV_SCAN_BACKOFF) {
+				/* Scan backoff elapsed */
+				pxp_monitor_start_scan();
 			} /*else if (pxp_connect_request_flag == PXP_DEV_SERVICE_FOUND) {
 				rssi_update(ble_dev_info[0].conn_info.handle);
 				hw_timer_start(PXP_RSSI_UPDATE_INTERVAL);
-			}*/ /*else if (pxp_connect_request_flag == PXP_DEV_UNCONNECTED) {
-				if(	peripheral_state == PERIPHERAL_ENCRYPTION_STATE 
-					||peripheral_state == PERIPHERAL_PAIRED_STATE) {
-					hw_timer_start(BATTERY_UPDATE_INTERVAL);
-					DBG_LOG("BATTERY_UPDATE_INTERVAL TIMER");
-				}
 			}*/
 
 			app_timer_done = false;
 		}
+		
+		/* Power management, after the tasks so it sees their work; the
+		 * connection timeout and scan backoff run on the dualtimer */
+		haptic_app_power_task((pxp_connect_request_flag == PXP_DEV_CONNECTING) ||
+				(pxp_connect_request_flag == PXP_DEV_SCAN_BACKOFF));
 	}
 }
@@ -0,0 +1,106 @@
+/**
+ * \file
+ *
+ * \brief Wearable power state manager
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "power_mgr.h"
+
+static void put_le16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+}
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+	put_le16(buf, (uint16_t)value);
+	put_le16(&buf[2], (uint16_t)(value >> 16));
+}
+
+static void pm_enter(power_mgr_t *pm, power_state_t state, uint32_t now_ms)
+{
+	pm->residency_ms[pm->state] += now_ms - pm->state_ms;
+	pm->state = state;
+	pm->state_ms = now_ms;
+	pm->entries[state]++;
+}
+
+void power_mgr_init(power_mgr_t *pm, uint32_t now_ms)
+{
+	memset(pm, 0, sizeof(power_mgr_t));
+	pm->state = POWER_ACTIVE;
+	pm->state_ms = now_ms;
+	pm->entries[POWER_ACTIVE] = 1;
+}
+
+bool power_mgr_update(power_mgr_t *pm, uint32_t now_ms, bool motors_active,
+		bool busy, bool wake_armed, uint32_t wake_ms)
+{
+	power_state_t next;
+
+	if (motors_active || busy) {
+		pm->quiet = false;
+		next = motors_active ? POWER_ACTIVE : POWER_IDLE;
+	} else {
+		if (!pm->quiet) {
+			pm->quiet = true;
+			pm->quiet_ms = now_ms;
+		}
+
+		next = POWER_SLEEP;
+		if ((now_ms - pm->quiet_ms) < POWER_MGR_SLEEP_HOLDOFF_MS) {
+			next = POWER_IDLE;
+		} else if (wake_armed &&
+				((int32_t)(wake_ms - now_ms) < POWER_MGR_MIN_SLEEP_MS)) {
+			next = POWER_IDLE;
+		}
+	}
+
+	if (next == pm->state) {
+		return false;
+	}
+	pm_enter(pm, next, now_ms);
+	return true;
+}
+
+bool power_mgr_next_event(const power_mgr_t *pm, uint32_t *when_ms)
+{
+	if ((pm->state != POWER_IDLE) || !pm->quiet) {
+		return false;
+	}
+	*when_ms = pm->quiet_ms + POWER_MGR_SLEEP_HOLDOFF_MS;
+	return true;
+}
+
+void power_mgr_residency(const power_mgr_t *pm, uint32_t now_ms,
+		uint32_t *residency_ms)
+{
+	memcpy(residency_ms, pm->residency_ms, sizeof(pm->residency_ms));
+	residency_ms[pm->state] += now_ms - pm->state_ms;
+}
+
+uint8_t power_mgr_encode(const power_mgr_t *pm, uint32_t now_ms, uint8_t *buf,
+		uint8_t buf_len)
+{
+	uint32_t residency_ms[POWER_STATE_COUNT];
+	uint8_t *ptr = &buf[2];
+	uint8_t idx;
+
+	if (buf_len < POWER_MGR_RECORD_SIZE) {
+		return 0;
+	}
+
+	power_mgr_residency(pm, now_ms, residency_ms);
+	buf[0] = POWER_MGR_RECORD;
+	buf[1] = (uint8_t)pm->state;
+	for (idx = 0; idx < POWER_STATE_COUNT; idx++) {
+		put_le32(ptr, residency_ms[idx]);
+		put_le16(&ptr[4], pm->entries[idx]);
+		ptr += 6;
+	}
+	return POWER_MGR_RECORD_SIZE;
+}
@@ -0,0 +1,103 @@
+/**
+ * \file
+ *
+ * \brief Wearable power state manager
+ *
+ * Decides from the haptic activity whether the MCU may leave the millisecond
+ * tick and drop into ULP between connection events:
+ *
+ *   POWER_ACTIVE  a motor is driven; sleep lock held, tick running
+ *   POWER_IDLE    motors off but work is queued or due soon; lock held,
+ *                 the core only waits for interrupts between ticks
+ *   POWER_SLEEP   nothing to do; sleep lock released and the tick stopped,
+ *                 the BLE stack or a scheduled wakeup resumes the loop
+ *
+ * SLEEP is entered only after POWER_MGR_SLEEP_HOLDOFF_MS without work so
+ * frame gaps do not bounce the platform in and out of ULP. Time spent and
+ * entries into every state are counted and can be serialized as a
+ * diagnostics record.
+ *
+ * Plain C so the state machine builds on a host for testing.
+ */
+
+#ifndef __POWER_MGR_H__
+#define __POWER_MGR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Quiet time before the lock is released */
+#define POWER_MGR_SLEEP_HOLDOFF_MS      (50)
+
+/* Deadlines closer than this are waited for with the tick running */
+#define POWER_MGR_MIN_SLEEP_MS          (20)
+
+/* First byte of the power record on the diagnostics characteristic */
+#define POWER_MGR_RECORD                (0x01)
+
+/* record id, state, per state: residency ms (4), entries (2) */
+#define POWER_MGR_RECORD_SIZE           (2 + (POWER_STATE_COUNT * 6))
+
+typedef enum {
+	POWER_ACTIVE = 0,
+	POWER_IDLE,
+	POWER_SLEEP,
+	POWER_STATE_COUNT
+} power_state_t;
+
+typedef struct power_mgr {
+	power_state_t state;
+	uint32_t state_ms;
+	/* start of the current stretch without work */
+	bool quiet;
+	uint32_t quiet_ms;
+	/* statistics, residency excludes the running stretch */
+	uint32_t residency_ms[POWER_STATE_COUNT];
+	uint16_t entries[POWER_STATE_COUNT];
+} power_mgr_t;
+
+/**@brief Start in POWER_ACTIVE, as the platform holds the sleep lock at boot
+ */
+void power_mgr_init(power_mgr_t *pm, uint32_t now_ms);
+
+/**@brief Pick the state for the current activity
+ *
+ * @param[in] motors_active a motor output is non zero
+ * @param[in] busy work is queued that needs the tick
+ * @param[in] wake_armed wake_ms holds the next deadline
+ * @param[in] wake_ms local time of the next deadline
+ *
+ * @return true if the state changed
+ */
+bool power_mgr_update(power_mgr_t *pm, uint32_t now_ms, bool motors_active,
+		bool busy, bool wake_armed, uint32_t wake_ms);
+
+/**@brief Time the holdoff ends and the manager wants to run again
+ *
+ * @return true while the state waits for the holdoff to expire
+ */
+bool power_mgr_next_event(const power_mgr_t *pm, uint32_t *when_ms);
+
+/**@brief Time spent in every state up to now_ms
+ *
+ * @param[out] residency_ms POWER_STATE_COUNT entries
+ */
+void power_mgr_residency(const power_mgr_t *pm, uint32_t now_ms,
+		uint32_t *residency_ms);
+
+/**@brief Serialize the power record
+ *
+ * @return number of bytes written, 0 if buf_len is too small
+ */
+uint8_t power_mgr_encode(const power_mgr_t *pm, uint32_t now_ms, uint8_t *buf,
+		uint8_t buf_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POWER_MGR_H__ */
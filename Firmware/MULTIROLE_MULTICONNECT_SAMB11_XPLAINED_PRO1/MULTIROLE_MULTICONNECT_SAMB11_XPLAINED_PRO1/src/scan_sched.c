@@ -0,0 +1,69 @@
+/**
+ * \file
+ *
+ * \brief Reconnect scan scheduling for the Perception central
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "scan_sched.h"
+
+void scan_sched_init(scan_sched_t *sched, uint8_t fast_scans,
+		uint8_t backoff_min_s, uint8_t backoff_max_s)
+{
+	memset(sched, 0, sizeof(scan_sched_t));
+	sched->fast_scans_max = fast_scans;
+	sched->backoff_min_s = backoff_min_s;
+	sched->backoff_max_s = backoff_max_s;
+	sched->fast_scans = fast_scans;
+	sched->backoff_s = backoff_min_s;
+}
+
+scan_window_t scan_sched_window(scan_sched_t *sched)
+{
+	sched->windows++;
+	if (sched->fast_scans) {
+		sched->fast_scans--;
+		return SCAN_WINDOW_FAST;
+	}
+	return SCAN_WINDOW_SLOW;
+}
+
+void scan_sched_window_end(scan_sched_t *sched, bool found,
+		uint8_t *backoff_s)
+{
+	if (!found) {
+		sched->empty_windows++;
+	}
+
+	/* Still in the fast reconnect phase, scan again right away */
+	if (!found && sched->fast_scans) {
+		*backoff_s = 0;
+		return;
+	}
+
+	*backoff_s = sched->backoff_s;
+	if (sched->backoff_s < sched->backoff_max_s) {
+		sched->backoff_s *= 2;
+		if (sched->backoff_s > sched->backoff_max_s) {
+			sched->backoff_s = sched->backoff_max_s;
+		}
+	}
+}
+
+void scan_sched_connected(scan_sched_t *sched)
+{
+	sched->backoff_s = sched->backoff_min_s;
+	sched->fast_scans = 0;
+	sched->reconnect_pending = false;
+}
+
+void scan_sched_link_lost(scan_sched_t *sched, bool by_user)
+{
+	/* Reconnect aggressively before duty cycling the scan */
+	if (!by_user) {
+		sched->fast_scans = sched->fast_scans_max;
+		sched->reconnect_pending = true;
+	}
+}
@@ -0,0 +1,86 @@
+/**
+ * \file
+ *
+ * \brief Reconnect scan scheduling for the Perception central
+ *
+ * Decides what kind of scan window to run next and how long to pause after
+ * a window without a Perception advertiser:
+ *
+ *   - after power up or a link loss, fast_scans continuous windows run back
+ *     to back so a reporter that is still around is found within a second
+ *   - then windows are duty cycled, with a pause after every empty window
+ *     that doubles from backoff_min_s up to backoff_max_s
+ *   - a connection resets the pause and ends the fast phase
+ *
+ * The profile keeps only the BLE stack calls; the decisions are plain C so
+ * they build on a host, together with adv_parse.h, gatt_cache.h and
+ * link_supervisor.h, and can be driven there by a recorded event timeline.
+ */
+
+#ifndef __SCAN_SCHED_H__
+#define __SCAN_SCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	/* continuous scanning, short window */
+	SCAN_WINDOW_FAST = 0,
+	/* duty cycled scanning, long window */
+	SCAN_WINDOW_SLOW
+} scan_window_t;
+
+typedef struct scan_sched {
+	uint8_t fast_scans_max;
+	uint8_t backoff_min_s;
+	uint8_t backoff_max_s;
+	/* fast windows left before duty cycling */
+	uint8_t fast_scans;
+	/* pause after the next empty window */
+	uint8_t backoff_s;
+	/* the link to the last reporter was lost, reconnect to it when seen */
+	bool reconnect_pending;
+	/* statistics */
+	uint16_t windows;
+	uint16_t empty_windows;
+} scan_sched_t;
+
+/**@brief Start in the fast phase, as after a link loss
+ */
+void scan_sched_init(scan_sched_t *sched, uint8_t fast_scans,
+		uint8_t backoff_min_s, uint8_t backoff_max_s);
+
+/**@brief Kind of the scan window about to start
+ */
+scan_window_t scan_sched_window(scan_sched_t *sched);
+
+/**@brief A scan window ended without a connection
+ *
+ * @param[in] found a candidate was found but the connect request failed;
+ * that always pauses, an empty window in the fast phase does not
+ * @param[out] backoff_s pause before the next window, 0 to scan again
+ * right away
+ */
+void scan_sched_window_end(scan_sched_t *sched, bool found,
+		uint8_t *backoff_s);
+
+/**@brief The central connected to a reporter
+ */
+void scan_sched_connected(scan_sched_t *sched);
+
+/**@brief The link to the reporter was lost
+ *
+ * @param[in] by_user the local user ended the link; scanning resumes duty
+ * cycled and the reporter is not chased
+ */
+void scan_sched_link_lost(scan_sched_t *sched, bool by_user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCAN_SCHED_H__ */
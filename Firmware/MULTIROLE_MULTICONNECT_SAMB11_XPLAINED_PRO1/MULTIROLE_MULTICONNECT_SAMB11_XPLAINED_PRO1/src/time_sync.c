@@ -0,0 +1,309 @@
+/**
+ * \file
+ *
+ * \brief Phone to wearable clock synchronization
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "time_sync.h"
+
+#define NS_PER_US_SCALE                 (1000000000LL)
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+	buf[2] = (uint8_t)(value >> 16);
+	buf[3] = (uint8_t)(value >> 24);
+}
+
+static void put_le64(uint8_t *buf, uint64_t value)
+{
+	put_le32(buf, (uint32_t)value);
+	put_le32(&buf[4], (uint32_t)(value >> 32));
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
+			((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *buf)
+{
+	return (uint64_t)get_le32(buf) | ((uint64_t)get_le32(&buf[4]) << 32);
+}
+
+/* Phone minus wearable clock at a local time */
+static int64_t sync_offset_at(const time_sync_t *sync, uint64_t local_us)
+{
+	int64_t span = (int64_t)(local_us - sync->ref_local_us);
+
+	return sync->ref_offset_us + (span * sync->drift_ppb) / NS_PER_US_SCALE;
+}
+
+static void sync_restart(time_sync_t *sync, const time_sync_sample_t *point)
+{
+	sync->synced = true;
+	sync->ref_local_us = point->local_us;
+	sync->ref_offset_us = point->offset_us;
+	sync->drift_ppb = 0;
+	sync->drift_valid = false;
+	sync->drift_local_us = point->local_us;
+	sync->drift_offset_us = point->offset_us;
+}
+
+/* Move the model to the median sample of a round */
+static void sync_commit(time_sync_t *sync, const time_sync_sample_t *point)
+{
+	int64_t predicted;
+	int64_t error;
+	int64_t limit;
+	int64_t span;
+
+	sync->rounds++;
+	if (!sync->synced) {
+		sync_restart(sync, point);
+		return;
+	}
+
+	predicted = sync_offset_at(sync, point->local_us);
+	error = point->offset_us - predicted;
+	sync->last_error_us = (int32_t)((error > INT32_MAX) ? INT32_MAX :
+			((error < INT32_MIN) ? INT32_MIN : error));
+	/* Until the drift is known the offset may run off at the largest rate */
+	limit = TIME_SYNC_STEP_US;
+	if (!sync->drift_valid) {
+		limit += ((int64_t)(point->local_us - sync->ref_local_us)
+				* TIME_SYNC_DRIFT_MAX_PPB) / NS_PER_US_SCALE;
+	}
+	if ((error > limit) || (error < -limit)) {
+		sync->steps++;
+		sync_restart(sync, point);
+		return;
+	}
+
+	span = (int64_t)(point->local_us - sync->drift_local_us);
+	if (span >= TIME_SYNC_DRIFT_MIN_US) {
+		int64_t drift_ppb = ((point->offset_us - sync->drift_offset_us)
+				* NS_PER_US_SCALE) / span;
+
+		if (drift_ppb > TIME_SYNC_DRIFT_MAX_PPB) {
+			drift_ppb = TIME_SYNC_DRIFT_MAX_PPB;
+		} else if (drift_ppb < -TIME_SYNC_DRIFT_MAX_PPB) {
+			drift_ppb = -TIME_SYNC_DRIFT_MAX_PPB;
+		}
+		if (sync->drift_valid) {
+			sync->drift_ppb += (int32_t)((drift_ppb - sync->drift_ppb) / 4);
+		} else {
+			sync->drift_ppb = (int32_t)drift_ppb;
+			sync->drift_valid = true;
+		}
+		sync->drift_local_us = point->local_us;
+		sync->drift_offset_us = point->offset_us;
+	}
+
+	/* Half way towards the new sample, the median still jitters */
+	sync->ref_local_us = point->local_us;
+	sync->ref_offset_us = predicted + (error / 2);
+}
+
+/* Commit the median offset of the round and schedule the next one */
+static void sync_round_end(time_sync_t *sync, uint64_t now_us)
+{
+	time_sync_sample_t sample;
+	uint8_t idx;
+	uint8_t pos;
+
+	/* Insertion sort by offset, a round holds a handful of samples */
+	for (idx = 1; idx < sync->round_samples; idx++) {
+		sample = sync->round[idx];
+		for (pos = idx; (pos > 0) &&
+				(sync->round[pos - 1].offset_us > sample.offset_us); pos--) {
+			sync->round[pos] = sync->round[pos - 1];
+		}
+		sync->round[pos] = sample;
+	}
+	if (sync->round_samples) {
+		sync_commit(sync, &sync->round[sync->round_samples / 2]);
+	}
+
+	sync->round_pings = 0;
+	sync->round_samples = 0;
+	sync->next_ping_us = now_us + (sync->synced ?
+			TIME_SYNC_ROUND_US : TIME_SYNC_UNSYNCED_ROUND_US);
+}
+
+void time_sync_init(time_sync_t *sync, uint64_t now_us)
+{
+	memset(sync, 0, sizeof(time_sync_t));
+	sync->next_ping_us = now_us;
+}
+
+void time_sync_event(time_sync_t *sync, uint64_t now_us)
+{
+	sync->has_event = true;
+	sync->event_us = now_us;
+}
+
+uint64_t time_sync_next_poll(const time_sync_t *sync)
+{
+	return sync->next_ping_us + TIME_SYNC_ALIGN_WAIT_US;
+}
+
+uint8_t time_sync_poll(time_sync_t *sync, uint64_t now_us, uint8_t *buf,
+		uint8_t buf_len)
+{
+	bool aligned = sync->has_event &&
+			((now_us - sync->event_us) <= TIME_SYNC_ALIGN_US);
+
+	if ((buf_len < TIME_SYNC_REQUEST_SIZE) ||
+			((int64_t)(now_us - sync->next_ping_us) < 0)) {
+		return 0;
+	}
+	if (!aligned &&
+			((int64_t)(now_us - sync->next_ping_us) < TIME_SYNC_ALIGN_WAIT_US)) {
+		return 0;
+	}
+
+	/* A lost request or reply; the last one of a round ends it */
+	sync->pending = false;
+	if (sync->round_pings == TIME_SYNC_ROUND_PINGS) {
+		sync_round_end(sync, now_us);
+		return 0;
+	}
+
+	sync->seq++;
+	sync->pending = true;
+	sync->aligned = aligned;
+	sync->t1_us = now_us;
+	sync->round_pings++;
+	sync->next_ping_us = now_us + TIME_SYNC_REPLY_TIMEOUT_US;
+
+	buf[0] = TIME_SYNC_REQUEST;
+	buf[1] = sync->seq;
+	put_le32(&buf[2], (uint32_t)now_us);
+	return TIME_SYNC_REQUEST_SIZE;
+}
+
+/* Add the sample of the reply to the pending request to the round */
+static time_sync_status_t sync_sample(time_sync_t *sync, const uint8_t *buf,
+		uint64_t now_us)
+{
+	time_sync_sample_t sample;
+	uint64_t t2_us = get_le64(&buf[6]);
+	uint32_t turnaround_us = get_le32(&buf[14]);
+	int64_t delay_us;
+
+	delay_us = (int64_t)(now_us - sync->t1_us) - turnaround_us;
+	if ((delay_us < 0) || (delay_us > TIME_SYNC_MAX_DELAY_US)) {
+		sync->rejected++;
+		return TIME_SYNC_ERR_DELAY;
+	}
+
+	sample.local_us = sync->t1_us + ((now_us - sync->t1_us) / 2);
+	sample.offset_us = ((int64_t)(t2_us - sync->t1_us)
+			+ (int64_t)(t2_us + turnaround_us - now_us)) / 2;
+	sample.delay_us = (uint32_t)delay_us;
+	sync->samples++;
+	sync->last_delay_us = sample.delay_us;
+
+	/* Sent at a random point of the interval, only primes the chain */
+	if (!sync->aligned) {
+		sync->unaligned++;
+		return TIME_SYNC_OK;
+	}
+	sync->round[sync->round_samples++] = sample;
+	return TIME_SYNC_OK;
+}
+
+time_sync_status_t time_sync_reply(time_sync_t *sync, const uint8_t *buf,
+		uint16_t len, uint64_t now_us)
+{
+	time_sync_status_t status;
+
+	if (len != TIME_SYNC_REPLY_SIZE) {
+		return TIME_SYNC_ERR_LENGTH;
+	}
+	if (buf[0] != TIME_SYNC_MSG) {
+		return TIME_SYNC_ERR_TYPE;
+	}
+	time_sync_event(sync, now_us);
+	if (!sync->pending || (buf[1] != sync->seq) ||
+			(get_le32(&buf[2]) != (uint32_t)sync->t1_us)) {
+		return TIME_SYNC_ERR_STALE;
+	}
+	sync->pending = false;
+
+	/* The next request follows right away, aligned to this event */
+	sync->next_ping_us = now_us;
+	status = sync_sample(sync, buf, now_us);
+	if (sync->round_pings == TIME_SYNC_ROUND_PINGS) {
+		sync_round_end(sync, now_us);
+	}
+	return status;
+}
+
+uint8_t time_sync_encode_reply(const uint8_t *request, uint16_t len,
+		uint64_t t2_us, uint64_t t3_us, uint8_t *buf, uint8_t buf_len)
+{
+	if ((len != TIME_SYNC_REQUEST_SIZE) || (request[0] != TIME_SYNC_REQUEST) ||
+			(buf_len < TIME_SYNC_REPLY_SIZE)) {
+		return 0;
+	}
+
+	buf[0] = TIME_SYNC_MSG;
+	buf[1] = request[1];
+	memcpy(&buf[2], &request[2], 4);
+	put_le64(&buf[6], t2_us);
+	put_le32(&buf[14], (uint32_t)(t3_us - t2_us));
+	return TIME_SYNC_REPLY_SIZE;
+}
+
+bool time_sync_to_remote(const time_sync_t *sync, uint64_t local_us,
+		uint64_t *remote_us)
+{
+	if (!sync->synced) {
+		return false;
+	}
+	*remote_us = local_us + sync_offset_at(sync, local_us);
+	return true;
+}
+
+bool time_sync_to_local(const time_sync_t *sync, uint64_t remote_us,
+		uint64_t *local_us)
+{
+	uint64_t guess_us;
+
+	if (!sync->synced) {
+		return false;
+	}
+	/* The drift term barely moves over one offset, one pass is enough */
+	guess_us = remote_us - sync->ref_offset_us;
+	*local_us = remote_us - sync_offset_at(sync, guess_us);
+	return true;
+}
+
+bool time_sync_local_ms(const time_sync_t *sync, uint32_t remote_ms,
+		uint64_t now_us, uint32_t *local_ms)
+{
+	uint64_t remote_now_us;
+	uint64_t remote_now_ms;
+	uint64_t remote_full_ms;
+	uint64_t local_us;
+
+	if (!time_sync_to_remote(sync, now_us, &remote_now_us)) {
+		return false;
+	}
+
+	/* Extend the 32-bit time to the one closest to the phone's now */
+	remote_now_ms = remote_now_us / 1000;
+	remote_full_ms = remote_now_ms
+			+ (int64_t)(int32_t)(remote_ms - (uint32_t)remote_now_ms);
+
+	time_sync_to_local(sync, remote_full_ms * 1000, &local_us);
+	*local_ms = (uint32_t)(local_us / 1000);
+	return true;
+}
@@ -0,0 +1,231 @@
+/**
+ * \file
+ *
+ * \brief Phone to wearable clock synchronization
+ *
+ * Haptic timelines are stamped with the phone's clock. Once the wearable
+ * knows that clock, the base time of a timeline plus the playout delay is
+ * the time its first frame is due, on every wearable alike, no matter when
+ * the notification got through.
+ *
+ * The wearable pings the phone NTP style. It writes a request to the
+ * diagnostics characteristic at local time t1, the phone stamps its receive
+ * time t2 and notifies the reply on the timeline characteristic at t3, the
+ * wearable receives it at t4:
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2    phone minus wearable clock
+ *   delay  = (t4 - t1) - (t3 - t2)          time on the air and in queues
+ *
+ * Packets only move at BLE connection events. A request written at a random
+ * time waits anywhere up to an interval while the reply, written by the
+ * phone right after the event that brought the request, always waits
+ * nearly a full one; the offset would be off by up to half an interval. So
+ * requests are aligned to connection events too: they go out right after
+ * a notification arrived, which happens at an event, and both directions
+ * wait about an interval. Within a round every reply triggers the next
+ * request, the first one aligns to a timeline notification or is sent
+ * unaligned to start the chain. Only aligned samples count and a round
+ * uses their median offset, what remains is the difference between the
+ * phone's and the wearable's notification processing.
+ *
+ * The rate difference between the two crystals is estimated from the
+ * offsets of rounds at least TIME_SYNC_DRIFT_MIN_US apart and applied
+ * between rounds.
+ *
+ * Request, diagnostics record:
+ *
+ *   offset  size  field
+ *   0       1     TIME_SYNC_REQUEST
+ *   1       1     sequence
+ *   2       4     t1, low 32 bits
+ *
+ * Reply, on the timeline characteristic, told apart by its first byte:
+ *
+ *   offset  size  field
+ *   0       1     TIME_SYNC_MSG
+ *   1       1     sequence of the request
+ *   2       4     t1 of the request
+ *   6       8     t2, phone microseconds
+ *   14      4     t3 - t2, microseconds
+ *
+ * All times are 64-bit microseconds, multi-byte fields little endian. Plain
+ * C so the phone encodes replies with the same source and skewed clocks
+ * can be simulated on a host.
+ */
+
+#ifndef __TIME_SYNC_H__
+#define __TIME_SYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* First byte of a request on the diagnostics characteristic */
+#define TIME_SYNC_REQUEST               (0x04)
+
+/* First byte of a reply; haptic batches start with their version */
+#define TIME_SYNC_MSG                   (0x54)
+
+#define TIME_SYNC_REQUEST_SIZE          (6)
+#define TIME_SYNC_REPLY_SIZE            (18)
+
+/* Pings per round */
+#define TIME_SYNC_ROUND_PINGS           (8)
+
+/* A request sent this soon after a notification is aligned to its event */
+#define TIME_SYNC_ALIGN_US              (3000)
+
+/* Longest wait for a notification to align a request to */
+#define TIME_SYNC_ALIGN_WAIT_US         (100000)
+
+/* A request without a reply by then is given up */
+#define TIME_SYNC_REPLY_TIMEOUT_US      (500000)
+
+/* Time between rounds, shorter until the first round succeeded */
+#define TIME_SYNC_ROUND_US              (10000000)
+#define TIME_SYNC_UNSYNCED_ROUND_US     (1000000)
+
+/* Samples slower than this are dropped, two connection intervals pass in
+ * an exchange */
+#define TIME_SYNC_MAX_DELAY_US          (300000)
+
+/* Shortest span the drift is measured over */
+#define TIME_SYNC_DRIFT_MIN_US          (30000000)
+
+/* Crystal tolerance of both sides, larger estimates are clamped */
+#define TIME_SYNC_DRIFT_MAX_PPB         (500000)
+
+/* A round this far off the model means a clock jumped; start over */
+#define TIME_SYNC_STEP_US               (5000)
+
+typedef enum {
+	TIME_SYNC_OK = 0,
+	TIME_SYNC_ERR_LENGTH,
+	TIME_SYNC_ERR_TYPE,
+	/* no request pending with this sequence and t1 */
+	TIME_SYNC_ERR_STALE,
+	/* delay negative or above TIME_SYNC_MAX_DELAY_US */
+	TIME_SYNC_ERR_DELAY
+} time_sync_status_t;
+
+typedef struct time_sync_sample {
+	uint64_t local_us;
+	int64_t offset_us;
+	uint32_t delay_us;
+} time_sync_sample_t;
+
+typedef struct time_sync {
+	/* last notification, marks a connection event */
+	bool has_event;
+	uint64_t event_us;
+	/* request in flight */
+	uint8_t seq;
+	bool pending;
+	bool aligned;
+	uint64_t t1_us;
+	/* the next request is due, aligned if possible */
+	uint64_t next_ping_us;
+	/* current round */
+	uint8_t round_pings;
+	uint8_t round_samples;
+	time_sync_sample_t round[TIME_SYNC_ROUND_PINGS];
+	/* remote = local + ref_offset_us + drift * (local - ref_local_us) */
+	bool synced;
+	uint64_t ref_local_us;
+	int64_t ref_offset_us;
+	int32_t drift_ppb;
+	bool drift_valid;
+	/* round the drift is measured from */
+	uint64_t drift_local_us;
+	int64_t drift_offset_us;
+	/* statistics */
+	uint16_t samples;
+	uint16_t rejected;
+	uint16_t unaligned;
+	uint16_t rounds;
+	uint16_t steps;
+	int32_t last_error_us;
+	uint32_t last_delay_us;
+} time_sync_t;
+
+/**@brief Forget the phone clock, the first round starts right away
+ */
+void time_sync_init(time_sync_t *sync, uint64_t now_us);
+
+/**@brief A notification other than a reply arrived
+ *
+ * @param[in] now_us local receive time
+ */
+void time_sync_event(time_sync_t *sync, uint64_t now_us);
+
+/**@brief Latest local time time_sync_poll() has to run again
+ *
+ * Polling after every notification and by this time is enough.
+ */
+uint64_t time_sync_next_poll(const time_sync_t *sync);
+
+/**@brief Build the next request when one is due
+ *
+ * Run right after a notification was handed to time_sync_event() or
+ * time_sync_reply() so the request is aligned to its connection event, and
+ * by time_sync_next_poll(), which sends an unaligned request once no
+ * notification came within TIME_SYNC_ALIGN_WAIT_US.
+ *
+ * @return number of bytes written, 0 if no request is due or buf_len is
+ * too small
+ */
+uint8_t time_sync_poll(time_sync_t *sync, uint64_t now_us, uint8_t *buf,
+		uint8_t buf_len);
+
+/**@brief Take in a reply
+ *
+ * Also marks a connection event.
+ *
+ * @param[in] now_us local receive time, t4
+ */
+time_sync_status_t time_sync_reply(time_sync_t *sync, const uint8_t *buf,
+		uint16_t len, uint64_t now_us);
+
+/**@brief Build the reply to a request, phone side
+ *
+ * @param[in] t2_us receive time of the request
+ * @param[in] t3_us time the reply is handed to the radio
+ *
+ * @return number of bytes written, 0 if the request is malformed or
+ * buf_len is too small
+ */
+uint8_t time_sync_encode_reply(const uint8_t *request, uint16_t len,
+		uint64_t t2_us, uint64_t t3_us, uint8_t *buf, uint8_t buf_len);
+
+/**@brief Phone time at a local time
+ *
+ * @return false until the first round succeeded
+ */
+bool time_sync_to_remote(const time_sync_t *sync, uint64_t local_us,
+		uint64_t *remote_us);
+
+/**@brief Local time at a phone time
+ *
+ * @return false until the first round succeeded
+ */
+bool time_sync_to_local(const time_sync_t *sync, uint64_t remote_us,
+		uint64_t *local_us);
+
+/**@brief Local milliseconds at a 32-bit phone millisecond time
+ *
+ * Maps the base time of a haptic batch, which carries the low 32 bits of
+ * the phone's millisecond clock, to the low 32 bits of the local one.
+ *
+ * @return false until the first round succeeded
+ */
+bool time_sync_local_ms(const time_sync_t *sync, uint32_t remote_ms,
+		uint64_t now_us, uint32_t *local_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIME_SYNC_H__ */
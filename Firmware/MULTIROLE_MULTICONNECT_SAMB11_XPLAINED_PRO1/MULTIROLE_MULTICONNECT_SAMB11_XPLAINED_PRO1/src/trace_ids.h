@@ -0,0 +1,47 @@
+/**
+ * \file
+ *
+ * \brief Trace event table
+ *
+ * Every traced event is one line of TRACE_ID_LIST: its id name and the
+ * format the host decoder prints it with. Formats take the two record
+ * arguments in order, the 8-bit one first, and may use fewer. Ids are
+ * assigned by position and travel as one byte, so append new events at the
+ * end to keep older traces decodable.
+ *
+ * TRACE_SPAN_LIST pairs a begin and an end event; the decoder matches them
+ * by their 8-bit argument and histograms the time between them.
+ *
+ * The table is shared by the firmware and the host decoder
+ * (tools/trace_decode.c).
+ */
+
+#ifndef __TRACE_IDS_H__
+#define __TRACE_IDS_H__
+
+#define TRACE_ID_LIST(X) \
+	X(TRACE_ID_DROPPED,         "records dropped from id %u on: %u") \
+	X(TRACE_ID_BLE_EVENT_BEGIN, "ble event %u") \
+	X(TRACE_ID_BLE_EVENT_END,   "ble event %u done") \
+	X(TRACE_ID_CONNECTED,       "connected status 0x%02x handle %u") \
+	X(TRACE_ID_DISCONNECTED,    "disconnected reason 0x%02x handle %u") \
+	X(TRACE_ID_MTU_CHANGED,     "mtu changed handle %u mtu %u") \
+	X(TRACE_ID_MTU_CMD_FAILED,  "mtu exchange failed operation %u handle %u") \
+	X(TRACE_ID_WRITE_CMD_FAILED, "write command failed operation %u handle %u") \
+	X(TRACE_ID_READ_RESP,       "read response len %u handle 0x%04x") \
+	X(TRACE_ID_WRITE_RESP_FAILED, "write response status 0x%02x handle 0x%04x") \
+	X(TRACE_ID_NOTIFICATION,    "notification len %u handle 0x%04x")
+
+#define TRACE_SPAN_LIST(X) \
+	X(TRACE_ID_BLE_EVENT_BEGIN, TRACE_ID_BLE_EVENT_END, "ble event")
+
+#define TRACE_ID_ENUM(name, format)     name,
+
+typedef enum {
+	TRACE_ID_LIST(TRACE_ID_ENUM)
+	TRACE_ID_COUNT
+} trace_id_t;
+
+#undef TRACE_ID_ENUM
+
+#endif /* __TRACE_IDS_H__ */
@@ -0,0 +1,180 @@
+/**
+ * \file
+ *
+ * \brief Binary event trace
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "trace_ring.h"
+
+#define TRACE_RING_MASK                 (TRACE_RING_RECORDS - 1)
+
+/* Keeps the compiler from moving record stores past the index update */
+#if defined(__GNUC__)
+#define TRACE_BARRIER()                 __asm__ __volatile__("" ::: "memory")
+#else
+#define TRACE_BARRIER()
+#endif
+
+typedef struct trace_ring {
+	trace_clock_t clock;
+	/* free running, the writer owns head and the reader tail */
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	/* writer side: records lost since the last TRACE_ID_DROPPED */
+	uint16_t dropped;
+	uint8_t drop_id;
+	/* reader side */
+	uint8_t seq;
+	trace_rec_t rec[TRACE_RING_RECORDS];
+} trace_ring_t;
+
+static trace_ring_t trace_ring;
+
+static void put_le16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+}
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+	put_le16(buf, (uint16_t)value);
+	put_le16(&buf[2], (uint16_t)(value >> 16));
+}
+
+static uint16_t get_le16(const uint8_t *buf)
+{
+	return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+	return get_le16(buf) | ((uint32_t)get_le16(&buf[2]) << 16);
+}
+
+static void trace_put(uint16_t head, uint32_t time_us, uint8_t id,
+		uint8_t arg8, uint16_t arg16)
+{
+	trace_rec_t *rec = &trace_ring.rec[head & TRACE_RING_MASK];
+
+	rec->time_us = time_us;
+	rec->id = id;
+	rec->arg8 = arg8;
+	rec->arg16 = arg16;
+}
+
+void trace_ring_init(trace_clock_t clock)
+{
+	memset(&trace_ring, 0, sizeof(trace_ring));
+	trace_ring.clock = clock;
+}
+
+void trace_ring_event(trace_id_t id, uint8_t arg8, uint16_t arg16)
+{
+	uint16_t head = trace_ring.head;
+	uint16_t space = TRACE_RING_RECORDS - (uint16_t)(head - trace_ring.tail);
+	uint32_t time_us = trace_ring.clock ? trace_ring.clock() : 0;
+
+	/* The drop report goes ahead of the first record that fits again */
+	if ((space == 0) || (trace_ring.dropped && (space < 2))) {
+		if (!trace_ring.dropped) {
+			trace_ring.drop_id = (uint8_t)id;
+		}
+		if (trace_ring.dropped < 0xFFFF) {
+			trace_ring.dropped++;
+		}
+		return;
+	}
+
+	if (trace_ring.dropped) {
+		trace_put(head++, time_us, TRACE_ID_DROPPED, trace_ring.drop_id,
+				trace_ring.dropped);
+		trace_ring.dropped = 0;
+	}
+	trace_put(head++, time_us, (uint8_t)id, arg8, arg16);
+
+	TRACE_BARRIER();
+	trace_ring.head = head;
+}
+
+uint16_t trace_ring_pending(void)
+{
+	return (uint16_t)(trace_ring.head - trace_ring.tail);
+}
+
+uint8_t trace_ring_encode(uint8_t *buf, uint16_t buf_len)
+{
+	uint16_t tail = trace_ring.tail;
+	uint16_t pending = (uint16_t)(trace_ring.head - tail);
+	uint8_t count = 0;
+	uint8_t *out;
+
+	TRACE_BARRIER();
+	if ((pending == 0) || (buf_len < TRACE_PACKET_LEN(1))) {
+		return 0;
+	}
+
+	buf[0] = TRACE_RECORD;
+	buf[1] = trace_ring.seq;
+	out = &buf[TRACE_PACKET_HEADER_SIZE];
+
+	while ((count < pending) && (count < 0xFF) &&
+			(TRACE_PACKET_LEN(count + 1) <= buf_len)) {
+		const trace_rec_t *rec = &trace_ring.rec[(tail + count) & TRACE_RING_MASK];
+
+		put_le32(out, rec->time_us);
+		out[4] = rec->id;
+		out[5] = rec->arg8;
+		put_le16(&out[6], rec->arg16);
+		out += TRACE_RECORD_SIZE;
+		count++;
+	}
+	return count;
+}
+
+void trace_ring_consume(uint8_t records)
+{
+	uint16_t pending = trace_ring_pending();
+
+	if (records > pending) {
+		records = (uint8_t)pending;
+	}
+	if (records == 0) {
+		return;
+	}
+
+	TRACE_BARRIER();
+	trace_ring.tail = (uint16_t)(trace_ring.tail + records);
+	trace_ring.seq++;
+}
+
+int trace_ring_decode(const uint8_t *buf, uint16_t len, uint8_t *seq,
+		trace_rec_t *rec, uint8_t max_records)
+{
+	int count;
+	int idx;
+
+	if ((len < TRACE_PACKET_HEADER_SIZE) || (buf[0] != TRACE_RECORD) ||
+			((len - TRACE_PACKET_HEADER_SIZE) % TRACE_RECORD_SIZE)) {
+		return -1;
+	}
+
+	count = (len - TRACE_PACKET_HEADER_SIZE) / TRACE_RECORD_SIZE;
+	if (count > max_records) {
+		return -1;
+	}
+
+	*seq = buf[1];
+	buf += TRACE_PACKET_HEADER_SIZE;
+	for (idx = 0; idx < count; idx++) {
+		rec[idx].time_us = get_le32(buf);
+		rec[idx].id = buf[4];
+		rec[idx].arg8 = buf[5];
+		rec[idx].arg16 = get_le16(&buf[6]);
+		buf += TRACE_RECORD_SIZE;
+	}
+	return count;
+}
@@ -0,0 +1,114 @@
+/**
+ * \file
+ *
+ * \brief Binary event trace
+ *
+ * Replaces console logging in the BLE event handlers, where a printf over
+ * the UART stalls event processing for milliseconds. A traced event is an
+ * 8-byte record: microsecond timestamp, event id from trace_ids.h and two
+ * small arguments. Formatting happens on the host.
+ *
+ * Records go to a RAM ring with one writer and one reader: the writer only
+ * moves the head and the reader only moves the tail, so neither waits for
+ * the other. Events are traced from the main loop, interrupt handlers must
+ * not trace. A full ring drops new records and reports how many with a
+ * TRACE_ID_DROPPED record once space frees up.
+ *
+ * The application drains the ring from the main loop as diagnostics
+ * packets, all multi-byte fields little endian:
+ *
+ *   offset  size  field
+ *   0       1     TRACE_RECORD
+ *   1       1     packet sequence, counts the packets consumed
+ *   2       8*n   records: time us (4), id (1), arg8 (1), arg16 (2)
+ *
+ * Plain C so it builds on a host with the decoder.
+ */
+
+#ifndef __TRACE_RING_H__
+#define __TRACE_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "trace_ids.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Set to 0 to compile the trace points out */
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE                    (1)
+#endif
+
+/* Records held, a power of two */
+#define TRACE_RING_RECORDS              (256)
+
+/* First byte of a trace packet on the diagnostics characteristic */
+#define TRACE_RECORD                    (0x02)
+
+#define TRACE_RECORD_SIZE               (8)
+#define TRACE_PACKET_HEADER_SIZE        (2)
+
+/* Fits the default ATT MTU */
+#define TRACE_PACKET_SIZE               (20)
+
+#define TRACE_PACKET_LEN(records) \
+	(TRACE_PACKET_HEADER_SIZE + ((records) * TRACE_RECORD_SIZE))
+
+#if TRACE_ENABLE
+#define TRACE_EVENT(id, arg8, arg16) \
+	trace_ring_event((id), (uint8_t)(arg8), (uint16_t)(arg16))
+#else
+#define TRACE_EVENT(id, arg8, arg16) \
+	do { (void)(arg8); (void)(arg16); } while (0)
+#endif
+
+/* Microsecond clock stamped on the records, wraps every 71 minutes */
+typedef uint32_t (*trace_clock_t)(void);
+
+typedef struct trace_rec {
+	uint32_t time_us;
+	uint8_t id;
+	uint8_t arg8;
+	uint16_t arg16;
+} trace_rec_t;
+
+/**@brief Empty the ring and set the timestamp source
+ */
+void trace_ring_init(trace_clock_t clock);
+
+/**@brief Record an event, drops it if the ring is full
+ */
+void trace_ring_event(trace_id_t id, uint8_t arg8, uint16_t arg16);
+
+/**@brief Records waiting to be drained
+ */
+uint16_t trace_ring_pending(void);
+
+/**@brief Pack the oldest records into a trace packet without consuming them
+ *
+ * @return number of records packed, 0 if the ring is empty or buf_len
+ * holds none
+ */
+uint8_t trace_ring_encode(uint8_t *buf, uint16_t buf_len);
+
+/**@brief Release the records of the last packet once it was sent
+ */
+void trace_ring_consume(uint8_t records);
+
+/**@brief Unpack the records of a trace packet
+ *
+ * @param[out] seq packet sequence
+ * @param[out] rec max_records entries
+ *
+ * @return number of records unpacked, -1 if the packet is malformed
+ */
+int trace_ring_decode(const uint8_t *buf, uint16_t len, uint8_t *seq,
+		trace_rec_t *rec, uint8_t max_records);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_RING_H__ */
@@ -0,0 +1,238 @@
+/**
+ * \file
+ *
+ * \brief Host checks of the advertising parser and the candidate selection
+ *
+ * Runs adv_parse.c on the host:
+ *
+ *  - the fields of well formed advertising and scan response payloads
+ *  - malformed AD structures: a length running past the payload, a type
+ *    without data, odd UUID lists, fields found before the bad structure
+ *  - random payloads in buffers of their exact size, so a build with
+ *    -fsanitize=address catches any read past the payload
+ *  - the candidate of a scan window: the strongest RSSI, the first of equal
+ *    RSSIs, a bonded peer over any stronger one
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o adv_parse_check adv_parse_check.c ../src/adv_parse.c
+ *   ./adv_parse_check [-r seed]
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adv_parse.h"
+#include "stubs/check.h"
+
+#define PERCEPTION_UUID         (0x6314)
+
+/* Parses a copy of the payload in a buffer of exactly its size */
+static bool parse(const uint8_t *data, uint8_t len, adv_report_t *report)
+{
+	uint8_t *copy = malloc(len ? len : 1);
+	bool ok;
+
+	memcpy(copy, data, len);
+	ok = adv_parse(copy, len, PERCEPTION_UUID, report);
+	/* The name must point into the payload, check and rebase it */
+	if (report->name != NULL) {
+		CHECK((report->name >= copy) && (report->name + report->name_len <= copy + len),
+				"name outside the payload");
+		report->name = data + (report->name - copy);
+	}
+	free(copy);
+	return ok;
+}
+
+static void check_well_formed(void)
+{
+	/* Flags, 16-bit UUIDs with Perception second, TX power, name */
+	static const uint8_t adv[] = {
+		0x02, 0x01, 0x06,
+		0x05, 0x03, 0x0F, 0x18, 0x14, 0x63,
+		0x02, 0x0A, 0xF4,
+		0x0B, 0x09, 'P', 'e', 'r', 'c', 'e', 'p', 't', 'i', 'o', 'n'
+	};
+	/* Scan response: manufacturer data and an incomplete UUID list */
+	static const uint8_t scan_rsp[] = {
+		0x04, 0xFF, 0x4C, 0x00, 0x02,
+		0x03, 0x02, 0x14, 0x63
+	};
+	/* Zero length ends the significant part, the padding is not parsed */
+	static const uint8_t padded[] = {
+		0x02, 0x01, 0x05,
+		0x00,
+		0x03, 0x03, 0x14, 0x63
+	};
+	/* Other services only, and the UUID split across two structures */
+	static const uint8_t other[] = {
+		0x03, 0x03, 0x0F, 0x18,
+		0x02, 0x03, 0x14,
+		0x02, 0x16, 0x63
+	};
+	adv_report_t report;
+
+	CHECK(parse(adv, sizeof(adv), &report), "advertising payload rejected");
+	CHECK(report.has_flags && (report.flags == 0x06), "flags %d 0x%02x", report.has_flags, report.flags);
+	CHECK(report.service_found, "Perception UUID not found in the list");
+	CHECK(report.has_tx_power && (report.tx_power == -12), "tx power %d", report.tx_power);
+	CHECK((report.name_len == 10) && (report.name != NULL) && !memcmp(report.name, "Perception", 10),
+			"name length %u", report.name_len);
+
+	CHECK(parse(scan_rsp, sizeof(scan_rsp), &report), "scan response rejected");
+	CHECK(report.service_found, "Perception UUID not found in the incomplete list");
+	CHECK(!report.has_flags && !report.has_tx_power && (report.name == NULL), "fields invented");
+
+	CHECK(parse(padded, sizeof(padded), &report), "zero padded payload rejected");
+	CHECK(report.has_flags && (report.flags == 0x05), "flags before the padding lost");
+	CHECK(!report.service_found, "UUID after the end of significant data taken");
+
+	CHECK(parse(other, sizeof(other), &report), "payload of another device rejected");
+	CHECK(!report.service_found, "UUID assembled across two structures");
+
+	CHECK(parse(adv, 0, &report), "empty payload rejected");
+	CHECK(!report.has_flags && !report.service_found, "fields in an empty payload");
+}
+
+static void check_malformed(void)
+{
+	/* Length one past the payload, after a good flags structure */
+	static const uint8_t overrun[] = {
+		0x02, 0x01, 0x06,
+		0x05, 0x03, 0x14, 0x63, 0x0F
+	};
+	/* Length byte alone at the end */
+	static const uint8_t dangling[] = {
+		0x03, 0x03, 0x14, 0x63,
+		0x04
+	};
+	/* Types without data, and a UUID list with an odd byte */
+	static const uint8_t empty_fields[] = {
+		0x01, 0x01,
+		0x01, 0x0A,
+		0x01, 0x09,
+		0x04, 0x03, 0x0F, 0x18, 0x14
+	};
+	static const uint8_t odd_list[] = {
+		0x04, 0x03, 0x0F, 0x18, 0x63,
+		0x02, 0x14, 0x63
+	};
+	/* 255 as length in a full size payload */
+	uint8_t longest[255];
+	adv_report_t report;
+
+	CHECK(!parse(overrun, sizeof(overrun), &report), "overrunning structure accepted");
+	CHECK(report.has_flags && (report.flags == 0x06), "flags before the bad structure lost");
+	CHECK(!report.service_found, "UUID of a truncated structure taken");
+
+	CHECK(!parse(dangling, sizeof(dangling), &report), "dangling length byte accepted");
+	CHECK(report.service_found, "UUID before the dangling byte lost");
+
+	CHECK(parse(empty_fields, sizeof(empty_fields), &report), "fields without data rejected");
+	CHECK(!report.has_flags && !report.has_tx_power, "flags or tx power read from an empty field");
+	CHECK((report.name != NULL) && (report.name_len == 0), "empty name %p %u",
+			(const void *)report.name, report.name_len);
+	CHECK(!report.service_found, "UUID assembled from a dangling byte");
+
+	CHECK(parse(odd_list, sizeof(odd_list), &report), "odd UUID list rejected");
+	CHECK(!report.service_found, "UUID assembled across structures");
+
+	memset(longest, 0xAA, sizeof(longest));
+	longest[0] = 0xFE;
+	longest[1] = 0xFF;
+	CHECK(parse(longest, sizeof(longest), &report), "a structure filling 255 bytes rejected");
+	longest[0] = 0xFF;
+	CHECK(!parse(longest, sizeof(longest), &report), "a structure of 256 bytes accepted");
+}
+
+/* Whether the structures up to the first zero length fit the payload */
+static bool well_formed(const uint8_t *data, uint8_t len)
+{
+	unsigned index = 0;
+
+	while (index < len) {
+		if (data[index] == 0) {
+			return true;
+		}
+		index += data[index] + 1u;
+	}
+	return index == len;
+}
+
+static void check_random(void)
+{
+	uint8_t data[255];
+	adv_report_t report;
+	int run;
+
+	for (run = 0; run < 200000; run++) {
+		uint8_t len = (uint8_t)(rand() % 40);
+		uint8_t idx;
+		bool ok;
+
+		for (idx = 0; idx < len; idx++) {
+			/* Mostly short lengths and the types the parser knows */
+			data[idx] = (uint8_t)((rand() % 4) ? rand() % 12 : rand());
+		}
+		ok = parse(data, len, &report);
+		CHECK(ok == well_formed(data, len), "payload %d of %u bytes %s", run, len,
+				ok ? "accepted" : "rejected");
+	}
+}
+
+static void check_select(void)
+{
+	static const uint8_t addr_a[ADV_ADDR_LEN] = {1, 2, 3, 4, 5, 6};
+	static const uint8_t addr_b[ADV_ADDR_LEN] = {6, 5, 4, 3, 2, 1};
+	static const uint8_t addr_c[ADV_ADDR_LEN] = {9, 9, 9, 9, 9, 9};
+	adv_candidate_t best;
+
+	adv_select_reset(&best);
+	CHECK(!best.valid, "candidate after reset");
+
+	CHECK(adv_select_offer(&best, 0, addr_a, -80, false), "first advertiser refused");
+	CHECK(adv_select_offer(&best, 1, addr_b, -70, false), "stronger advertiser refused");
+	CHECK((best.rssi == -70) && (best.addr_type == 1) && !memcmp(best.addr, addr_b, ADV_ADDR_LEN),
+			"candidate not replaced");
+	CHECK(!adv_select_offer(&best, 0, addr_a, -75, false), "weaker advertiser taken");
+
+	/* Ties keep the first one heard */
+	CHECK(!adv_select_offer(&best, 0, addr_c, -70, false), "equal RSSI replaced the candidate");
+	CHECK(!memcmp(best.addr, addr_b, ADV_ADDR_LEN), "candidate changed on a tie");
+
+	/* A bonded peer wins however weak */
+	CHECK(adv_select_offer(&best, 0, addr_c, -99, true), "weak bonded peer refused");
+	CHECK(best.bonded && (best.rssi == -99), "bonded candidate %d %d", best.bonded, best.rssi);
+	CHECK(!adv_select_offer(&best, 0, addr_a, -30, false), "unbonded advertiser displaced a bonded one");
+	CHECK(!adv_select_offer(&best, 1, addr_b, -99, true), "equal RSSI bonded peer replaced the candidate");
+	CHECK(adv_select_offer(&best, 1, addr_b, -98, true), "stronger bonded peer refused");
+	CHECK(!memcmp(best.addr, addr_b, ADV_ADDR_LEN), "stronger bonded peer not kept");
+
+	/* Next window starts over */
+	adv_select_reset(&best);
+	CHECK(adv_select_offer(&best, 0, addr_a, -128, false), "advertiser at -128 refused after reset");
+	CHECK(!best.bonded, "bonded flag kept across windows");
+}
+
+int main(int argc, char **argv)
+{
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-r") && (arg + 1 < argc)) {
+			srand((unsigned)atoi(argv[++arg]));
+		} else {
+			fprintf(stderr, "usage: %s [-r seed]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	check_well_formed();
+	check_malformed();
+	check_random();
+	check_select();
+
+	return check_report();
+}
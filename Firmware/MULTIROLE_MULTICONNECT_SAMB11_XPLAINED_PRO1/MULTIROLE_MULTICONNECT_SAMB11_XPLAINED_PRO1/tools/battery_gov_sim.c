@@ -0,0 +1,346 @@
+/**
+ * \file
+ *
+ * \brief Simulated discharge of the battery governor
+ *
+ * Runs battery_gov.c on the host with the configuration of conf_battery.h
+ * through a discharge of the cell, next to a reference that integrates the
+ * current of every interval exactly. The driver's duty map is stood in for
+ * by a linear one, level 255 at full duty. The script, from a full cell:
+ *
+ *   10 min idle, two motors at full strength until the motor budget holds
+ *   them below the critical level, 60 s of a four motor pattern set every
+ *   CONF_TIMER_TICK_MS, then idle until the cell is empty
+ *
+ * Checked on every update:
+ *
+ *  - the charge left against the reference, within the 1 uA the current is
+ *    truncated to per interval, never below 0
+ *  - the level against the reference charge, rounded up
+ *  - the motor budget against the rules in battery_gov.h, written out from
+ *    conf_battery.h, and a scaled output: within the budget, every driven
+ *    motor still driven, the order of the motors kept
+ *  - the record: level, runtime, average, budget, the estimated flag and
+ *    the minutes counted since the start
+ *
+ * And at a few points: the average current within 5 percent of a step
+ * 12 averaging windows after it, and the runtime announced once the
+ * average settled against the time the idle cell takes to empty.
+ *
+ * The script runs from time 0 and again with the millisecond clock
+ * wrapping during the motors.
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -I../src/config -o battery_gov_sim
+ *       battery_gov_sim.c ../src/battery_gov.c -lm
+ *   ./battery_gov_sim [-v]
+ *
+ * Options:
+ *   -v  print the estimate every 10 minutes of the run from time 0
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "battery_gov.h"
+#include "conf_battery.h"
+#include "stubs/check.h"
+
+/* Firmware tick, as CONF_TIMER_TICK_MS in conf_timer.h */
+#define TICK_MS                 (5)
+
+#define MOTORS                  (4)
+
+#define IDLE_MS                 (10ul * 60 * 1000)
+#define PATTERN_MS              (60ul * 1000)
+
+/* Updates while nothing changes, the battery report of haptic_app.c */
+#define STEP_MS                 (1000)
+
+/* Longest run, far past the runtime of an idle cell */
+#define END_MS                  (200ul * 3600 * 1000)
+
+/* Average within 5 percent of a step */
+#define SETTLE_MS               (12ul * BATTERY_GOV_AVG_WINDOW_MS)
+
+/* Idle before the runtime is taken, the average has forgotten the motors */
+#define ANNOUNCE_MS             (10ul * 60 * 1000)
+
+static const battery_gov_config_t conf = {
+	.capacity_uah = CONF_BATTERY_CAPACITY_MAH * 1000UL,
+	.base_ua = CONF_BATTERY_BASE_UA,
+	.motor_ua = CONF_BATTERY_MOTOR_UA,
+	.low_pct = CONF_BATTERY_LOW_PCT,
+	.critical_pct = CONF_BATTERY_CRITICAL_PCT,
+	.min_budget_pct = CONF_BATTERY_MIN_BUDGET_PCT,
+	.level_budget = CONF_BATTERY_LEVEL_BUDGET
+};
+
+typedef struct sim {
+	battery_gov_t gov;
+	uint32_t base_ms;
+	/* from the start */
+	uint64_t t_ms;
+	uint32_t duty_sum;
+	/* reference */
+	double used_uah;
+	/* worst drift of the charge left from the reference */
+	double drift_uah;
+	unsigned updates;
+	bool verbose;
+	uint64_t print_ms;
+} sim_t;
+
+static uint32_t duty_of(uint8_t level)
+{
+	return ((uint32_t)level * BATTERY_GOV_DUTY_MAX + 127) / 255;
+}
+
+static double current_of(uint32_t duty_sum)
+{
+	return CONF_BATTERY_BASE_UA + (double)CONF_BATTERY_MOTOR_UA * duty_sum
+			/ BATTERY_GOV_DUTY_MAX;
+}
+
+static double remaining_of(const sim_t *sim)
+{
+	double remaining = conf.capacity_uah - sim->used_uah;
+
+	return (remaining > 0) ? remaining : 0;
+}
+
+/* Budget written out from conf_battery.h */
+static uint8_t expected_budget(uint8_t level_pct)
+{
+	if (level_pct >= CONF_BATTERY_LOW_PCT) {
+		return 100;
+	}
+	if (level_pct <= CONF_BATTERY_CRITICAL_PCT) {
+		return CONF_BATTERY_MIN_BUDGET_PCT;
+	}
+	return (uint8_t)(CONF_BATTERY_MIN_BUDGET_PCT + (100 - CONF_BATTERY_MIN_BUDGET_PCT)
+			* (level_pct - CONF_BATTERY_CRITICAL_PCT)
+			/ (CONF_BATTERY_LOW_PCT - CONF_BATTERY_CRITICAL_PCT));
+}
+
+static void check_record(const sim_t *sim)
+{
+	const battery_gov_t *gov = &sim->gov;
+	uint8_t buf[BATTERY_GOV_RECORD_SIZE + 1];
+	uint16_t runtime_min;
+	uint16_t elapsed_min;
+	uint32_t avg_ua;
+
+	CHECK(battery_gov_encode(gov, buf, BATTERY_GOV_RECORD_SIZE - 1) == 0, "short buffer");
+	CHECK(battery_gov_encode(gov, buf, sizeof(buf)) == BATTERY_GOV_RECORD_SIZE, "encode");
+	runtime_min = (uint16_t)(buf[2] | (buf[3] << 8));
+	avg_ua = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t)buf[7] << 24);
+	elapsed_min = (uint16_t)(buf[10] | (buf[11] << 8));
+	CHECK((buf[0] == BATTERY_GOV_RECORD) && (buf[1] == gov->level_pct) &&
+			(runtime_min == battery_gov_runtime_min(gov)) && (avg_ua == gov->avg_ua) &&
+			(buf[8] == gov->budget_pct), "record fields");
+	CHECK(buf[9] == BATTERY_GOV_FLAG_ESTIMATED, "flags %02X", buf[9]);
+	CHECK(elapsed_min == sim->t_ms / 60000, "%llu ms: %u min counted",
+			(unsigned long long)sim->t_ms, elapsed_min);
+}
+
+/* Update at t_ms with the duty from then on, as the application does */
+static void update(sim_t *sim, uint64_t t_ms, uint32_t duty_sum)
+{
+	battery_gov_t *gov = &sim->gov;
+	double remaining;
+	double drift;
+	uint8_t level;
+
+	sim->used_uah += current_of(sim->duty_sum) * (double)(t_ms - sim->t_ms) / 3600000.0;
+	sim->t_ms = t_ms;
+	sim->duty_sum = duty_sum;
+	battery_gov_update(gov, (uint32_t)(sim->base_ms + t_ms), duty_sum);
+	sim->updates++;
+
+	/* The governor truncates the current to 1 uA, so it may lag behind by
+	 * up to 1 uAh an hour, and its charge below 1 uAh is not yet taken */
+	remaining = remaining_of(sim);
+	drift = remaining - gov->remaining_uah;
+	if (fabs(drift) > sim->drift_uah) {
+		sim->drift_uah = fabs(drift);
+	}
+	CHECK((drift <= 1.0) && (drift >= -(1.0 + (double)t_ms / 3600000.0)),
+			"%llu ms: %u uAh left, reference %.1f", (unsigned long long)t_ms,
+			gov->remaining_uah, remaining);
+
+	level = (uint8_t)ceil((double)gov->remaining_uah * 100 / conf.capacity_uah);
+	CHECK(gov->level_pct == level, "%llu ms: level %u, expected %u",
+			(unsigned long long)t_ms, gov->level_pct, level);
+	CHECK(gov->budget_pct == expected_budget(gov->level_pct), "level %u: budget %u, expected %u",
+			gov->level_pct, gov->budget_pct, expected_budget(gov->level_pct));
+	if ((sim->updates % 97) == 0) {
+		check_record(sim);
+	}
+
+	if (sim->verbose && (t_ms >= sim->print_ms)) {
+		printf("%6.1f min  level %3u%%  %6u uAh  avg %6u uA  %5u min left  budget %3u%%\n",
+				t_ms / 60000.0, gov->level_pct, gov->remaining_uah, gov->avg_ua,
+				battery_gov_runtime_min(gov), gov->budget_pct);
+		sim->print_ms += 10ul * 60 * 1000;
+	}
+}
+
+/* Hold a duty until to_ms, updating every STEP_MS */
+static void hold(sim_t *sim, uint64_t to_ms, uint32_t duty_sum)
+{
+	uint64_t t_ms = sim->t_ms;
+
+	while (t_ms < to_ms) {
+		t_ms = (t_ms + STEP_MS < to_ms) ? t_ms + STEP_MS : to_ms;
+		update(sim, t_ms, duty_sum);
+	}
+}
+
+/* Scale an output and check it against the budget, returns its duty */
+static uint32_t output(sim_t *sim, uint8_t *level)
+{
+	uint8_t before[MOTORS];
+	uint32_t budget = (uint32_t)conf.level_budget * sim->gov.budget_pct / 100;
+	uint32_t sum = 0;
+	uint32_t duty_sum = 0;
+	bool scaled;
+	uint8_t idx;
+	uint8_t other;
+
+	memcpy(before, level, MOTORS);
+	scaled = battery_gov_scale(&sim->gov, level, MOTORS);
+	for (idx = 0; idx < MOTORS; idx++) {
+		sum += before[idx];
+	}
+	CHECK(scaled == ((sim->gov.budget_pct < 100) && (sum > budget)),
+			"budget %u, sum %u: scaled %d", sim->gov.budget_pct, sum, scaled);
+
+	sum = 0;
+	for (idx = 0; idx < MOTORS; idx++) {
+		CHECK((level[idx] != 0) == (before[idx] != 0), "motor %u: %u scaled to %u",
+				idx, before[idx], level[idx]);
+		CHECK(level[idx] <= before[idx], "motor %u: %u raised to %u", idx, before[idx], level[idx]);
+		for (other = 0; other < MOTORS; other++) {
+			CHECK(!(before[idx] > before[other]) || (level[idx] >= level[other]),
+					"motors %u, %u: order lost", idx, other);
+		}
+		sum += level[idx];
+		duty_sum += duty_of(level[idx]);
+	}
+	CHECK(!scaled || (sum <= budget) || (sum <= MOTORS), "sum %u over budget %u", sum, budget);
+	return duty_sum;
+}
+
+static void check_average(const sim_t *sim, const char *what, double from_ua)
+{
+	double current = current_of(sim->duty_sum);
+
+	CHECK(fabs(sim->gov.avg_ua - current) <= fabs(current - from_ua) * 0.05 + 1.0,
+			"%s: average %u uA, current %.0f from %.0f", what, sim->gov.avg_ua,
+			current, from_ua);
+}
+
+static void run(uint32_t base_ms, bool verbose)
+{
+	sim_t sim;
+	uint8_t level[MOTORS];
+	uint64_t start_ms;
+	uint64_t empty_ms;
+	uint16_t announced_min;
+	double from_ua;
+	uint32_t step;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.base_ms = base_ms;
+	sim.verbose = verbose;
+	battery_gov_init(&sim.gov, &conf, base_ms, 100);
+	CHECK((sim.gov.level_pct == 100) && (sim.gov.budget_pct == 100) &&
+			(sim.gov.remaining_uah == conf.capacity_uah), "start %u%% %u uAh",
+			sim.gov.level_pct, sim.gov.remaining_uah);
+	check_record(&sim);
+
+	hold(&sim, IDLE_MS, 0);
+	check_average(&sim, "idle", current_of(0));
+	CHECK(sim.gov.level_pct == 100, "idle: level %u", sim.gov.level_pct);
+
+	/* Two motors, until the budget holds them at the minimum */
+	start_ms = sim.t_ms;
+	from_ua = sim.gov.avg_ua;
+	while (sim.gov.level_pct > CONF_BATTERY_CRITICAL_PCT - 1) {
+		level[0] = 255;
+		level[1] = 255;
+		level[2] = 0;
+		level[3] = 0;
+		update(&sim, sim.t_ms + STEP_MS, output(&sim, level));
+		if (sim.t_ms - start_ms == SETTLE_MS) {
+			check_average(&sim, "motors", from_ua);
+		}
+		CHECK(sim.t_ms < END_MS, "motors never reached the critical level");
+		if (sim.t_ms >= END_MS) {
+			return;
+		}
+	}
+	CHECK((sim.gov.budget_pct == CONF_BATTERY_MIN_BUDGET_PCT) &&
+			(level[0] == level[1]) && (level[0] + level[1] <= CONF_BATTERY_LEVEL_BUDGET
+			* CONF_BATTERY_MIN_BUDGET_PCT / 100), "critical: budget %u, levels %u %u",
+			sim.gov.budget_pct, level[0], level[1]);
+	CHECK(sim.gov.scaled_outputs > 0, "no output scaled");
+
+	/* Pattern set every tick, each motor on its own ramp */
+	start_ms = sim.t_ms;
+	for (step = 0; step < PATTERN_MS / TICK_MS; step++) {
+		uint8_t idx;
+
+		for (idx = 0; idx < MOTORS; idx++) {
+			level[idx] = (uint8_t)((step * (idx + 1) * 3) % 256);
+		}
+		update(&sim, start_ms + (uint64_t)(step + 1) * TICK_MS, output(&sim, level));
+	}
+
+	/* Idle until empty, against the runtime announced once settled; the
+	 * pattern's last window may be above the average */
+	from_ua = fmax(sim.gov.avg_ua, current_of(sim.duty_sum));
+	hold(&sim, sim.t_ms + SETTLE_MS, 0);
+	check_average(&sim, "idle again", from_ua);
+	hold(&sim, sim.t_ms + ANNOUNCE_MS - SETTLE_MS, 0);
+	announced_min = battery_gov_runtime_min(&sim.gov);
+	start_ms = sim.t_ms;
+	while ((sim.gov.remaining_uah > 0) && (sim.t_ms < END_MS)) {
+		hold(&sim, sim.t_ms + STEP_MS, 0);
+	}
+	empty_ms = sim.t_ms - start_ms;
+	CHECK(sim.gov.remaining_uah == 0, "not empty after %llu ms", (unsigned long long)sim.t_ms);
+	CHECK(fabs(announced_min - empty_ms / 60000.0) <= 1.0 + empty_ms / 60000.0 * 0.02,
+			"announced %u min, emptied in %.1f min", announced_min, empty_ms / 60000.0);
+
+	/* Empty stays empty */
+	hold(&sim, sim.t_ms + 10 * STEP_MS, 0);
+	CHECK((sim.gov.level_pct == 0) && (battery_gov_runtime_min(&sim.gov) == 0) &&
+			(sim.gov.budget_pct == CONF_BATTERY_MIN_BUDGET_PCT), "empty: %u%% %u min",
+			sim.gov.level_pct, battery_gov_runtime_min(&sim.gov));
+	check_record(&sim);
+
+	if (verbose) {
+		printf("emptied after %.1f h, %u updates, %u outputs scaled, "
+				"worst drift %.2f uAh\n", sim.t_ms / 3600000.0, sim.updates,
+				sim.gov.scaled_outputs, sim.drift_uah);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+
+	if (!check_verbose_arg(argc, argv, &verbose)) {
+		return 2;
+	}
+
+	run(0, verbose);
+	/* The clock wraps 20 minutes into the motors */
+	run((uint32_t)(0 - (IDLE_MS + 20ul * 60 * 1000)), false);
+
+	return check_report();
+}
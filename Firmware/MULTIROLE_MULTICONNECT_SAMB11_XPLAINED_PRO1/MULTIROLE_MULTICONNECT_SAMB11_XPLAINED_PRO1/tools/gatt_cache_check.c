@@ -0,0 +1,341 @@
+/**
+ * \file
+ *
+ * \brief Host checks of the Perception GATT handle cache
+ *
+ * Runs gatt_cache.c on the host through the calls pxp_monitor.c makes:
+ *
+ *  - save: the handles of a finished discovery are stored, an incomplete
+ *    or inconsistent set is refused
+ *  - apply: a reconnect of the same bonded peer finds its handles, other
+ *    peers and address types miss
+ *  - drop: a stale entry is forgotten and the next apply misses
+ *  - the least recently used entry is replaced once all are taken, also
+ *    across the use counter wrap
+ *  - an image read back from storage is accepted only with the right magic,
+ *    version and checksum, and any corrupted byte clears the cache
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o gatt_cache_check gatt_cache_check.c ../src/gatt_cache.c
+ *   ./gatt_cache_check
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "gatt_cache.h"
+#include "stubs/check.h"
+
+/* Public address type of the BLE stack */
+#define ADDR_PUBLIC             (0)
+#define ADDR_RANDOM             (1)
+
+/* Fletcher-16 written from the spec, the checksum field left out */
+static uint16_t reference_checksum(const gatt_cache_t *cache)
+{
+	const uint8_t *ptr = (const uint8_t *)cache;
+	unsigned sum1 = 0;
+	unsigned sum2 = 0;
+	size_t idx;
+
+	for (idx = 0; idx < sizeof(gatt_cache_t); idx++) {
+		if ((idx == offsetof(gatt_cache_t, checksum)) ||
+				(idx == offsetof(gatt_cache_t, checksum) + 1)) {
+			continue;
+		}
+		sum1 = (sum1 + ptr[idx]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+	return (uint16_t)((sum2 << 8) | sum1);
+}
+
+static void make_addr(uint8_t *addr, uint8_t peer)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < GATT_CACHE_ADDR_LEN; idx++) {
+		addr[idx] = (uint8_t)(0xA0 + peer + idx);
+	}
+}
+
+/* The layout of the Perception service with the timeline and diagnostics,
+ * behind the Generic Attribute service */
+static void make_handles(gatt_cache_handles_t *handles, uint16_t start)
+{
+	uint8_t idx;
+
+	memset(handles, 0, sizeof(*handles));
+	handles->start_handle = start;
+	for (idx = 0; idx < GATT_CACHE_VIBE_CHARS; idx++) {
+		handles->char_handle[idx] = (uint16_t)(start + 2 + 2 * idx);
+	}
+	handles->timeline_handle = (uint16_t)(start + 10);
+	handles->timeline_cccd_handle = (uint16_t)(start + 11);
+	handles->diag_handle = (uint16_t)(start + 13);
+	handles->end_handle = (uint16_t)(start + 13);
+	handles->service_changed_handle = (uint16_t)(start - 2);
+}
+
+static bool cache_empty(const gatt_cache_t *cache)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < GATT_CACHE_ENTRIES; idx++) {
+		if (cache->entries[idx].valid) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void check_handles_valid(void)
+{
+	gatt_cache_handles_t handles;
+
+	make_handles(&handles, 0x20);
+	CHECK(gatt_cache_handles_valid(&handles), "the full service layout is refused");
+
+	handles.diag_handle = 0;
+	CHECK(gatt_cache_handles_valid(&handles), "a service without diagnostics is refused");
+
+	handles.timeline_handle = 0;
+	handles.timeline_cccd_handle = 0;
+	CHECK(gatt_cache_handles_valid(&handles), "a service without the timeline is refused");
+
+	handles.service_changed_handle = 0;
+	CHECK(gatt_cache_handles_valid(&handles), "a peer without Service Changed is refused");
+
+	make_handles(&handles, 0x20);
+	handles.service_changed_handle = (uint16_t)(handles.end_handle + 2);
+	CHECK(gatt_cache_handles_valid(&handles), "Service Changed after the service refused");
+
+	make_handles(&handles, 0x20);
+	handles.start_handle = 0;
+	CHECK(!gatt_cache_handles_valid(&handles), "start handle 0 accepted");
+
+	make_handles(&handles, 0x20);
+	handles.end_handle = 0x1F;
+	CHECK(!gatt_cache_handles_valid(&handles), "end before start accepted");
+
+	make_handles(&handles, 0x20);
+	handles.char_handle[2] = 0;
+	CHECK(!gatt_cache_handles_valid(&handles), "an undiscovered intensity characteristic accepted");
+
+	make_handles(&handles, 0x20);
+	handles.char_handle[0] = handles.start_handle;
+	CHECK(!gatt_cache_handles_valid(&handles), "a value handle on the service declaration accepted");
+
+	make_handles(&handles, 0x20);
+	handles.char_handle[3] = (uint16_t)(handles.end_handle + 1);
+	CHECK(!gatt_cache_handles_valid(&handles), "a value handle past the service accepted");
+
+	make_handles(&handles, 0x20);
+	handles.diag_handle = (uint16_t)(handles.end_handle + 1);
+	CHECK(!gatt_cache_handles_valid(&handles), "a diagnostics handle past the service accepted");
+
+	make_handles(&handles, 0x20);
+	handles.service_changed_handle = handles.char_handle[1];
+	CHECK(!gatt_cache_handles_valid(&handles), "Service Changed inside the service accepted");
+
+	make_handles(&handles, 0x20);
+	handles.timeline_cccd_handle = 0;
+	CHECK(!gatt_cache_handles_valid(&handles), "a timeline without its CCCD accepted");
+
+	make_handles(&handles, 0x20);
+	handles.timeline_cccd_handle = handles.timeline_handle;
+	CHECK(!gatt_cache_handles_valid(&handles), "a CCCD on the timeline value accepted");
+
+	make_handles(&handles, 0x20);
+	handles.timeline_cccd_handle = (uint16_t)(handles.end_handle + 1);
+	CHECK(!gatt_cache_handles_valid(&handles), "a CCCD past the service accepted");
+
+	make_handles(&handles, 0x20);
+	handles.timeline_handle = 0;
+	CHECK(!gatt_cache_handles_valid(&handles), "a CCCD without the timeline accepted");
+}
+
+/* pxp_monitor_cache_save, _apply and _drop for one reporter */
+static void check_save_apply_drop(void)
+{
+	gatt_cache_t cache;
+	gatt_cache_handles_t discovered;
+	gatt_cache_handles_t restored;
+	uint8_t addr[GATT_CACHE_ADDR_LEN];
+	uint8_t other[GATT_CACHE_ADDR_LEN];
+
+	gatt_cache_init(&cache);
+	make_addr(addr, 1);
+	make_addr(other, 2);
+	make_handles(&discovered, 0x30);
+
+	/* First connection, nothing cached yet */
+	CHECK(!gatt_cache_lookup(&cache, ADDR_PUBLIC, addr, &restored), "hit on an empty cache");
+
+	/* Discovery incomplete, pxp logs "not cached" */
+	discovered.char_handle[1] = 0;
+	CHECK(!gatt_cache_store(&cache, ADDR_PUBLIC, addr, &discovered), "incomplete handles stored");
+	CHECK(cache_empty(&cache), "an incomplete set took an entry");
+
+	/* Discovery done and bonded */
+	make_handles(&discovered, 0x30);
+	CHECK(gatt_cache_store(&cache, ADDR_PUBLIC, addr, &discovered), "discovered handles refused");
+
+	/* Reconnect of the same reporter */
+	memset(&restored, 0, sizeof(restored));
+	CHECK(gatt_cache_lookup(&cache, ADDR_PUBLIC, addr, &restored), "miss on the bonded reporter");
+	CHECK(!memcmp(&restored, &discovered, sizeof(restored)), "handles changed in the cache");
+	CHECK(!gatt_cache_lookup(&cache, ADDR_RANDOM, addr, &restored),
+			"hit with the same address of another type");
+	CHECK(!gatt_cache_lookup(&cache, ADDR_PUBLIC, other, &restored), "hit on another reporter");
+
+	/* Bonding again after a new discovery replaces the entry */
+	make_handles(&discovered, 0x40);
+	CHECK(gatt_cache_store(&cache, ADDR_PUBLIC, addr, &discovered), "rediscovered handles refused");
+	CHECK(gatt_cache_lookup(&cache, ADDR_PUBLIC, addr, &restored) &&
+			(restored.start_handle == 0x40), "the entry was not replaced");
+	{
+		uint8_t idx;
+		uint8_t used = 0;
+
+		for (idx = 0; idx < GATT_CACHE_ENTRIES; idx++) {
+			used = (uint8_t)(used + (cache.entries[idx].valid ? 1 : 0));
+		}
+		CHECK(used == 1, "%u entries for one reporter", used);
+	}
+
+	/* CCCD write refused or service changed: drop, then rediscover */
+	CHECK(gatt_cache_invalidate(&cache, ADDR_PUBLIC, addr), "drop found no entry");
+	CHECK(!gatt_cache_lookup(&cache, ADDR_PUBLIC, addr, &restored), "hit after the drop");
+	CHECK(!gatt_cache_invalidate(&cache, ADDR_PUBLIC, addr), "second drop found an entry");
+	CHECK(cache_empty(&cache), "entries left after the drop");
+
+	/* Each change keeps the image sealed */
+	CHECK(cache.checksum == reference_checksum(&cache), "checksum 0x%04x, expected 0x%04x",
+			cache.checksum, reference_checksum(&cache));
+}
+
+static void check_replacement(void)
+{
+	gatt_cache_t cache;
+	gatt_cache_handles_t handles;
+	uint8_t addr[GATT_CACHE_ADDR_LEN];
+	uint16_t start_counter;
+	uint8_t run;
+	uint8_t peer;
+
+	/* From zero and just before the use counter wraps */
+	for (run = 0; run < 2; run++) {
+		gatt_cache_init(&cache);
+		start_counter = run ? (uint16_t)(0xFFFF - GATT_CACHE_ENTRIES) : 0;
+		cache.use_counter = start_counter;
+
+		for (peer = 0; peer < GATT_CACHE_ENTRIES; peer++) {
+			make_addr(addr, peer);
+			make_handles(&handles, (uint16_t)(0x10 * (peer + 1)));
+			CHECK(gatt_cache_store(&cache, ADDR_PUBLIC, addr, &handles), "peer %u refused", peer);
+		}
+
+		/* Peer 0 used again, peer 1 is now the oldest */
+		make_addr(addr, 0);
+		CHECK(gatt_cache_lookup(&cache, ADDR_PUBLIC, addr, &handles), "peer 0 missing");
+
+		make_addr(addr, GATT_CACHE_ENTRIES);
+		make_handles(&handles, 0x100);
+		CHECK(gatt_cache_store(&cache, ADDR_PUBLIC, addr, &handles), "new peer refused");
+
+		for (peer = 0; peer <= GATT_CACHE_ENTRIES; peer++) {
+			bool hit;
+
+			make_addr(addr, peer);
+			hit = gatt_cache_lookup(&cache, ADDR_PUBLIC, addr, &handles);
+			CHECK(hit == (peer != 1), "counter from 0x%04x: peer %u %s", start_counter, peer,
+					hit ? "kept, expected evicted" : "evicted");
+		}
+	}
+}
+
+static void check_restore(void)
+{
+	gatt_cache_t cache;
+	gatt_cache_t image;
+	gatt_cache_handles_t handles;
+	uint8_t addr[GATT_CACHE_ADDR_LEN];
+	uint8_t *bytes = (uint8_t *)&image;
+	size_t idx;
+	uint8_t peer;
+
+	gatt_cache_init(&cache);
+	for (peer = 0; peer < GATT_CACHE_ENTRIES - 1; peer++) {
+		make_addr(addr, peer);
+		make_handles(&handles, (uint16_t)(0x10 * (peer + 1)));
+		gatt_cache_store(&cache, ADDR_PUBLIC, addr, &handles);
+	}
+	make_addr(addr, 0);
+	gatt_cache_lookup(&cache, ADDR_PUBLIC, addr, &handles);
+
+	/* Read back intact */
+	memcpy(&image, &cache, sizeof(image));
+	CHECK(gatt_cache_restore(&image), "an intact image rejected");
+	CHECK(!memcmp(&image, &cache, sizeof(image)), "restore changed an intact image");
+	CHECK(gatt_cache_lookup(&image, ADDR_PUBLIC, addr, &handles) && (handles.start_handle == 0x10),
+			"restored image lost peer 0");
+
+	/* Erased storage */
+	memset(&image, 0xFF, sizeof(image));
+	CHECK(!gatt_cache_restore(&image), "erased storage accepted");
+	CHECK(cache_empty(&image) && (image.magic == GATT_CACHE_MAGIC), "erased storage not cleared");
+	CHECK(gatt_cache_restore(&image), "a cleared image rejected");
+
+	/* Magic and version of another layout, checksum made to match */
+	memcpy(&image, &cache, sizeof(image));
+	image.magic = (uint16_t)(GATT_CACHE_MAGIC ^ 0x0100);
+	image.checksum = reference_checksum(&image);
+	CHECK(!gatt_cache_restore(&image), "wrong magic accepted");
+	CHECK(cache_empty(&image), "wrong magic not cleared");
+
+	memcpy(&image, &cache, sizeof(image));
+	image.version = GATT_CACHE_VERSION - 1;
+	image.checksum = reference_checksum(&image);
+	CHECK(!gatt_cache_restore(&image), "version %u accepted", image.version);
+	CHECK(cache_empty(&image), "old version not cleared");
+
+	/* Any single corrupted byte, padding included */
+	for (idx = 0; idx < sizeof(image); idx++) {
+		uint8_t flip;
+
+		for (flip = 0x01; flip; flip = (uint8_t)(flip << 1)) {
+			memcpy(&image, &cache, sizeof(image));
+			bytes[idx] ^= flip;
+			if (gatt_cache_restore(&image)) {
+				CHECK(0, "bit 0x%02x of byte %u flipped and accepted", flip, (unsigned)idx);
+			} else {
+				CHECK(cache_empty(&image), "byte %u corrupted and entries kept", (unsigned)idx);
+			}
+		}
+	}
+
+	/* Swapped bytes, which a plain sum would miss */
+	memcpy(&image, &cache, sizeof(image));
+	idx = offsetof(gatt_cache_t, entries) + offsetof(gatt_cache_entry_t, addr);
+	bytes[idx] ^= bytes[idx + 1];
+	bytes[idx + 1] ^= bytes[idx];
+	bytes[idx] ^= bytes[idx + 1];
+	CHECK(!gatt_cache_restore(&image), "swapped address bytes accepted");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1) {
+		fprintf(stderr, "usage: %s\n", argv[0]);
+		return 2;
+	}
+
+	check_handles_valid();
+	check_save_apply_drop();
+	check_replacement();
+	check_restore();
+
+	return check_report();
+}
@@ -0,0 +1,314 @@
+/**
+ * \file
+ *
+ * \brief Host check of the haptic output filter against a fixed-point model
+ *
+ * Runs haptic_filter.c on the host, on the CMSIS-DSP routines of
+ * stubs/arm_math_stub.c, next to a model written out here from the
+ * arithmetic documented for the q15 routines: the rate limit saturated to
+ * 16 bits, the DF1 stage y = (b0 x + b1 x1 + b2 x2 + a1 y1 + a2 y2)
+ * >> (15 - postShift) on a 64 bit accumulator and saturated, the settle
+ * rule of haptic_filter.h, the q15 gain and the rounding to a level.
+ *
+ * Over steps, ramps, alternating full range steps and random targets, with
+ * the configuration of conf_haptic_filter.h, without a step limit and with
+ * gains below unity, on every tick:
+ *
+ *  - the levels, the rate limited input, the low-pass output and the
+ *    settled state equal the model bit for bit, and a settled low-pass
+ *    holds its input
+ *  - the low-pass output is within HAPTIC_LEVEL_BOUND levels of a double
+ *    precision Butterworth with the unquantized coefficients, a sanity
+ *    bound on the coefficients and the q15 scaling, not a reference
+ *  - a held target is output exactly once settled, on every later tick
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -DARM_MATH_CM0 -I../src -I../src/config
+ *       -I../src/ASF/thirdparty/CMSIS/Include -o haptic_filter_check
+ *       haptic_filter_check.c stubs/arm_math_stub.c ../src/haptic_filter.c
+ *       -lm
+ *   ./haptic_filter_check [-v]
+ *
+ * Options:
+ *   -v  print the levels of the step responses
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "haptic_filter.h"
+#include "conf_haptic_filter.h"
+#include "stubs/check.h"
+
+/* Tick and corner of the coefficients in conf_haptic_filter.h */
+#define TICK_HZ                 (200.0)
+#define CORNER_HZ               (12.0)
+
+#define MOTORS                  (HAPTIC_FILTER_MAX)
+
+/* Largest distance of the low-pass from the double model, in levels */
+#define HAPTIC_LEVEL_BOUND      (0.5)
+
+/* Ticks a held target may take to settle, the step limit of the gains run
+ * takes 32 to cross the range */
+#define SETTLE_TICKS            (80)
+
+/* Ticks a settled output is held and checked */
+#define HOLD_TICKS              (50)
+
+#define RANDOM_TICKS            (20000)
+
+static const q15_t coeffs[HAPTIC_FILTER_COEFFS] = CONF_HAPTIC_FILTER_COEFFS;
+
+typedef struct model {
+	uint8_t count;
+	int32_t max_step;
+	int32_t gain[MOTORS];
+	int32_t in[MOTORS];
+	int32_t x1[MOTORS];
+	int32_t x2[MOTORS];
+	int32_t y1[MOTORS];
+	int32_t y2[MOTORS];
+	bool settled;
+	/* double Butterworth of the same rate limited input */
+	double b[3];
+	double a[2];
+	double dx1[MOTORS];
+	double dx2[MOTORS];
+	double dy1[MOTORS];
+	double dy2[MOTORS];
+	double dy[MOTORS];
+} model_t;
+
+static int32_t sat16(int64_t value)
+{
+	if (value > INT16_MAX) {
+		return INT16_MAX;
+	}
+	if (value < INT16_MIN) {
+		return INT16_MIN;
+	}
+	return (int32_t)value;
+}
+
+static void model_init(model_t *model, uint8_t count, uint8_t max_step, const q15_t *gain)
+{
+	double k = tan(4.0 * atan(1.0) * CORNER_HZ / TICK_HZ);
+	double norm = 1.0 / (1.0 + sqrt(2.0) * k + k * k);
+	uint8_t idx;
+
+	memset(model, 0, sizeof(model_t));
+	model->count = count;
+	model->max_step = max_step ? (max_step << HAPTIC_FILTER_SHIFT) : INT16_MAX;
+	for (idx = 0; idx < count; idx++) {
+		model->gain[idx] = gain[idx];
+	}
+	model->settled = true;
+
+	model->b[0] = k * k * norm;
+	model->b[1] = 2.0 * model->b[0];
+	model->b[2] = model->b[0];
+	model->a[0] = -2.0 * (k * k - 1.0) * norm;
+	model->a[1] = -(1.0 - sqrt(2.0) * k + k * k) * norm;
+}
+
+static void model_step(model_t *model, const uint8_t *target, uint8_t *level)
+{
+	int32_t x[MOTORS];
+	int32_t y[MOTORS];
+	uint8_t idx;
+
+	model->settled = true;
+	for (idx = 0; idx < model->count; idx++) {
+		int32_t delta;
+		int64_t acc;
+
+		x[idx] = target[idx] << HAPTIC_FILTER_SHIFT;
+		delta = sat16((int64_t)x[idx] - model->in[idx]);
+		if (delta > model->max_step) {
+			delta = model->max_step;
+		} else if (delta < -model->max_step) {
+			delta = -model->max_step;
+		}
+		model->in[idx] = sat16((int64_t)model->in[idx] + delta);
+
+		acc = (int64_t)coeffs[0] * model->in[idx] + (int64_t)coeffs[2] * model->x1[idx] +
+				(int64_t)coeffs[3] * model->x2[idx] + (int64_t)coeffs[4] * model->y1[idx] +
+				(int64_t)coeffs[5] * model->y2[idx];
+		model->x2[idx] = model->x1[idx];
+		model->x1[idx] = model->in[idx];
+		model->y2[idx] = model->y1[idx];
+		model->y1[idx] = sat16(acc >> (15 - HAPTIC_FILTER_POST_SHIFT));
+
+		if ((model->in[idx] != x[idx]) ||
+				(abs(model->y1[idx] - x[idx]) > (1 << (HAPTIC_FILTER_SHIFT - 1)))) {
+			model->settled = false;
+		}
+
+		model->dy[idx] = model->b[0] * model->in[idx] + model->b[1] * model->dx1[idx] +
+				model->b[2] * model->dx2[idx] + model->a[0] * model->dy1[idx] +
+				model->a[1] * model->dy2[idx];
+		model->dx2[idx] = model->dx1[idx];
+		model->dx1[idx] = model->in[idx];
+		model->dy2[idx] = model->dy1[idx];
+		model->dy1[idx] = model->dy[idx];
+	}
+
+	for (idx = 0; idx < model->count; idx++) {
+		int32_t value;
+
+		if (model->settled) {
+			model->x1[idx] = x[idx];
+			model->x2[idx] = x[idx];
+			model->y1[idx] = x[idx];
+			model->y2[idx] = x[idx];
+			model->dx1[idx] = x[idx];
+			model->dx2[idx] = x[idx];
+			model->dy1[idx] = x[idx];
+			model->dy2[idx] = x[idx];
+			model->dy[idx] = x[idx];
+		}
+		value = model->y1[idx];
+
+		y[idx] = sat16(((int64_t)value * model->gain[idx]) >> 15);
+		value = (y[idx] + (1 << (HAPTIC_FILTER_SHIFT - 1))) >> HAPTIC_FILTER_SHIFT;
+		level[idx] = (uint8_t)((value < 0) ? 0 : ((value > UINT8_MAX) ? UINT8_MAX : value));
+	}
+}
+
+static void compare(const char *what, unsigned tick, const haptic_filter_t *filter,
+		const model_t *model, const uint8_t *target, const uint8_t *level,
+		const uint8_t *expected)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < model->count; idx++) {
+		CHECK(level[idx] == expected[idx], "%s tick %u motor %u: level %u, model %u",
+				what, tick, idx, level[idx], expected[idx]);
+		CHECK((filter->in[idx] == model->in[idx]) && (filter->out[idx] == model->y1[idx]),
+				"%s tick %u motor %u: in %d out %d, model %d %d", what, tick, idx,
+				filter->in[idx], filter->out[idx], model->in[idx], model->y1[idx]);
+		CHECK(fabs(filter->out[idx] - model->dy[idx]) <=
+				HAPTIC_LEVEL_BOUND * (1 << HAPTIC_FILTER_SHIFT),
+				"%s tick %u motor %u: out %d, double %.1f", what, tick, idx,
+				filter->out[idx], model->dy[idx]);
+	}
+	CHECK(haptic_filter_settled(filter, target) == model->settled,
+			"%s tick %u: settled %d, model %d", what, tick,
+			haptic_filter_settled(filter, target), model->settled);
+}
+
+typedef struct run {
+	const char *what;
+	uint8_t max_step;
+	q15_t gain[MOTORS];
+} run_t;
+
+static const run_t runs[] = {
+	{ "configured", CONF_HAPTIC_FILTER_MAX_STEP, CONF_HAPTIC_FILTER_GAIN },
+	{ "no step limit", 0, CONF_HAPTIC_FILTER_GAIN },
+	{ "gains", 8, { 0x4000, 0x6000, 0x7000, 0x1000 } }
+};
+
+/* Target of a motor at a tick of a pattern */
+static uint8_t pattern_target(unsigned pattern, unsigned tick, uint8_t motor, uint32_t *seed)
+{
+	switch (pattern) {
+	case 0:
+		/* Steps up, to another level, down */
+		return (tick < 60) ? 255 : ((tick < 120) ? (uint8_t)(37 + 50 * motor) : 0);
+	case 1:
+		/* Ramps of a different speed per motor, up and down */
+		return (uint8_t)(((tick * (motor + 1)) % 510 < 255) ? (tick * (motor + 1)) % 510 :
+				509 - (tick * (motor + 1)) % 510);
+	case 2:
+		/* Full range every other tick, the largest overshoot */
+		return ((tick + motor) & 1) ? 255 : 0;
+	default:
+		*seed = *seed * 1103515245u + 12345u;
+		/* Hold a random level for a few ticks */
+		return (uint8_t)(*seed >> 16);
+	}
+}
+
+static void check_run(const run_t *run, bool verbose)
+{
+	haptic_filter_t filter;
+	model_t model;
+	uint8_t target[MOTORS];
+	uint8_t level[MOTORS];
+	uint8_t expected[MOTORS];
+	uint32_t seed = 1;
+	unsigned pattern;
+	unsigned tick;
+	unsigned ticks;
+	uint8_t idx;
+
+	for (pattern = 0; pattern < 4; pattern++) {
+		haptic_filter_init(&filter, MOTORS, coeffs, run->max_step, run->gain);
+		model_init(&model, MOTORS, run->max_step, run->gain);
+		memset(target, 0, sizeof(target));
+		CHECK(haptic_filter_settled(&filter, target), "%s: not settled at init", run->what);
+
+		ticks = (pattern == 3) ? RANDOM_TICKS : 200;
+		for (tick = 0; tick < ticks; tick++) {
+			for (idx = 0; idx < MOTORS; idx++) {
+				if ((pattern != 3) || ((tick % 7) == 0)) {
+					target[idx] = pattern_target(pattern, tick, idx, &seed);
+				}
+			}
+			haptic_filter_step(&filter, target, level);
+			model_step(&model, target, expected);
+			compare(run->what, tick, &filter, &model, target, level, expected);
+			if (verbose && (pattern == 0) && (run == runs)) {
+				printf("%3u  %3u %3u %3u %3u\n", tick, level[0], level[1], level[2], level[3]);
+			}
+		}
+
+		/* Hold the last target until settled, then it is output exactly */
+		for (tick = 0; (tick < SETTLE_TICKS) && !haptic_filter_settled(&filter, target); tick++) {
+			haptic_filter_step(&filter, target, level);
+			model_step(&model, target, expected);
+			compare(run->what, ticks + tick, &filter, &model, target, level, expected);
+		}
+		CHECK(haptic_filter_settled(&filter, target), "%s pattern %u: not settled after %u ticks",
+				run->what, pattern, SETTLE_TICKS);
+		for (tick = 0; tick < HOLD_TICKS; tick++) {
+			haptic_filter_step(&filter, target, level);
+			model_step(&model, target, expected);
+			compare(run->what, ticks + SETTLE_TICKS + tick, &filter, &model, target, level,
+					expected);
+			for (idx = 0; idx < MOTORS; idx++) {
+				int32_t held = ((int32_t)(target[idx] << HAPTIC_FILTER_SHIFT)
+						* run->gain[idx]) >> 15;
+
+				CHECK(level[idx] == (uint8_t)((held + (1 << (HAPTIC_FILTER_SHIFT - 1)))
+						>> HAPTIC_FILTER_SHIFT), "%s pattern %u motor %u: held %u at %u",
+						run->what, pattern, idx, target[idx], level[idx]);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+	unsigned idx;
+
+	if (!check_verbose_arg(argc, argv, &verbose)) {
+		return 2;
+	}
+
+	/* The stage passes DC unchanged */
+	CHECK(coeffs[0] + coeffs[2] + coeffs[3] + coeffs[4] + coeffs[5] ==
+			(1 << (15 - HAPTIC_FILTER_POST_SHIFT)), "DC gain of the coefficients");
+
+	for (idx = 0; idx < sizeof(runs) / sizeof(runs[0]); idx++) {
+		check_run(&runs[idx], verbose);
+	}
+
+	return check_report();
+}
@@ -0,0 +1,360 @@
+/**
+ * \file
+ *
+ * \brief Host check of the haptic pattern synthesizer
+ *
+ * Renders haptic_pattern.c on the host every TICK_MS and checks:
+ *
+ *  - each of the six shapes over several periods against a floating point
+ *    model of its description in haptic_pattern.h, within LEVEL_TOLERANCE
+ *  - the heartbeat with every beat width, including widths of half the
+ *    period and more, where the second beat must still be rendered
+ *  - the Q24 phase across the 32-bit overflow of elapsed * step, against
+ *    the exact 64-bit phase, and across the millisecond clock wrap
+ *  - durations, motors taken over by a new pattern, full slots, and the
+ *    message encoding
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o haptic_pattern_check haptic_pattern_check.c ../src/haptic_pattern.c -lm
+ *   ./haptic_pattern_check [-v]
+ *
+ * Options:
+ *   -v  print the rendered timeline of every shape
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "haptic_pattern.h"
+#include "stubs/check.h"
+
+/* Firmware tick the application renders at */
+#define TICK_MS                 (5)
+
+#define MOTORS                  (4)
+
+/* Levels the integer rendering may differ from the model, mostly its
+ * chained truncations */
+#define LEVEL_TOLERANCE         (3)
+
+static const char *const shape_name[HAPTIC_PATTERN_COUNT] = {
+	"stop", "constant", "pulse", "ramp", "breathe", "heartbeat", "sweep"
+};
+
+static haptic_pattern_params_t make_params(uint8_t id, uint8_t mask,
+		uint8_t amplitude, uint16_t period_ms, uint8_t duty, uint16_t duration_ms)
+{
+	haptic_pattern_params_t params;
+
+	params.id = id;
+	params.motor_mask = mask;
+	params.amplitude = amplitude;
+	params.period_ms = period_ms;
+	params.duty = duty;
+	params.duration_ms = duration_ms;
+	return params;
+}
+
+/* Phase of the period the firmware's step reaches, 0..1 */
+static double model_phase(const haptic_pattern_params_t *params, uint32_t elapsed)
+{
+	uint64_t step = (1ull << 24) / params->period_ms;
+
+	return (double)(((uint64_t)elapsed * step) & 0xFFFFFF) / (double)(1 << 24);
+}
+
+/* Triangle of one beat starting at 0, peak 1 in its middle */
+static double model_beat(double phase, double width)
+{
+	if ((phase < 0) || (phase >= width)) {
+		return 0;
+	}
+	return 1.0 - fabs(phase - width / 2) / (width / 2);
+}
+
+/* Level of a motor from the shape descriptions in haptic_pattern.h */
+static double model_level(const haptic_pattern_params_t *params, uint32_t elapsed,
+		uint8_t motor)
+{
+	double amplitude = params->amplitude;
+	double phase = model_phase(params, elapsed);
+	double width;
+	double shape;
+
+	switch (params->id) {
+	case HAPTIC_PATTERN_CONSTANT:
+		return amplitude;
+
+	case HAPTIC_PATTERN_PULSE:
+		return (phase < params->duty / 256.0) ? amplitude : 0;
+
+	case HAPTIC_PATTERN_RAMP:
+		return amplitude * phase;
+
+	case HAPTIC_PATTERN_BREATHE:
+		shape = (phase < 0.5) ? 2 * phase : 2 - 2 * phase;
+		return amplitude * shape * shape;
+
+	case HAPTIC_PATTERN_HEARTBEAT:
+		/* Default and widest beat as documented */
+		width = (params->duty ? params->duty : 32) / 256.0;
+		if (width > 85 / 256.0) {
+			width = 85 / 256.0;
+		}
+		return amplitude * (model_beat(phase, width) + 0.75 * model_beat(phase - 2 * width, width));
+
+	case HAPTIC_PATTERN_SWEEP:
+	{
+		/* Peak at motor k's centre k + 0.5, travelling over the mask */
+		unsigned count = 0;
+		unsigned k = 0;
+		unsigned idx;
+		double dist;
+
+		for (idx = 0; idx < MOTORS; idx++) {
+			if (params->motor_mask & (1 << idx)) {
+				if (idx < motor) {
+					k++;
+				}
+				count++;
+			}
+		}
+		dist = fabs(phase * count - (k + 0.5));
+		if (dist > count / 2.0) {
+			dist = count - dist;
+		}
+		return (dist < 1) ? amplitude * (1 - dist) : 0;
+	}
+
+	default:
+		return 0;
+	}
+}
+
+/* Renders one pattern from start_ms for span_ms against the model */
+static void check_shape(const haptic_pattern_params_t *params, uint32_t start_ms,
+		uint32_t span_ms, bool verbose)
+{
+	haptic_pattern_engine_t engine;
+	uint8_t level[MOTORS];
+	uint32_t t;
+	uint8_t motor;
+
+	haptic_pattern_init(&engine, MOTORS);
+	CHECK(haptic_pattern_start(&engine, params, start_ms), "%s not started", shape_name[params->id]);
+
+	if (verbose) {
+		printf("%s, amplitude %u, period %u ms, duty %u, mask 0x%02x\n", shape_name[params->id],
+				params->amplitude, params->period_ms, params->duty, params->motor_mask);
+	}
+
+	for (t = 0; t < span_ms; t += TICK_MS) {
+		haptic_pattern_render(&engine, start_ms + t, level);
+
+		for (motor = 0; motor < MOTORS; motor++) {
+			double expected = 0;
+
+			if (params->motor_mask & (1 << motor)) {
+				expected = model_level(params, t, motor);
+			}
+			CHECK(fabs(level[motor] - expected) <= LEVEL_TOLERANCE,
+					"%s duty %u, %lu ms: motor %u at %u, model %.1f", shape_name[params->id],
+					params->duty, (unsigned long)t, motor, level[motor], expected);
+		}
+
+		if (verbose) {
+			printf("%6lu ms  %3u %3u %3u %3u\n", (unsigned long)t, level[0], level[1],
+					level[2], level[3]);
+		}
+	}
+}
+
+static void check_shapes(bool verbose)
+{
+	haptic_pattern_params_t params;
+	uint8_t id;
+
+	for (id = HAPTIC_PATTERN_CONSTANT; id < HAPTIC_PATTERN_COUNT; id++) {
+		params = make_params(id, 0x0F, 255, 400, 64, 0);
+		check_shape(&params, 0, 3 * params.period_ms, verbose);
+		params = make_params(id, 0x0B, 180, 1000, 200, 0);
+		check_shape(&params, 123456, 2 * params.period_ms, verbose);
+	}
+
+	/* Shortest period: a few ticks per cycle */
+	params = make_params(HAPTIC_PATTERN_PULSE, 0x01, 255, HAPTIC_PATTERN_MIN_PERIOD_MS, 128, 0);
+	check_shape(&params, 0, 200, false);
+}
+
+static void check_heartbeat(void)
+{
+	haptic_pattern_params_t params;
+	haptic_pattern_engine_t engine;
+	uint8_t level[MOTORS];
+	unsigned duty;
+
+	for (duty = 0; duty < 256; duty++) {
+		uint8_t width = (uint8_t)(duty ? ((duty > 85) ? 85 : duty) : 32);
+		uint32_t second_ms = 2u * width * 1000 / 256;
+		uint8_t first = 0;
+		uint8_t second = 0;
+		uint32_t t;
+
+		params = make_params(HAPTIC_PATTERN_HEARTBEAT, 0x01, 200, 1000, (uint8_t)duty, 0);
+		check_shape(&params, 0, params.period_ms, false);
+
+		/* Both beats within the period, the second at 3/4 of the first */
+		haptic_pattern_init(&engine, MOTORS);
+		haptic_pattern_start(&engine, &params, 0);
+		for (t = 0; t < params.period_ms; t++) {
+			haptic_pattern_render(&engine, t, level);
+			if (t < second_ms) {
+				first = (level[0] > first) ? level[0] : first;
+			} else {
+				second = (level[0] > second) ? level[0] : second;
+			}
+		}
+		if (width >= 16) {
+			CHECK((first >= 190) && (second >= 140) && (second <= 150),
+					"heartbeat duty %u: beats at %u and %u", duty, first, second);
+		}
+	}
+}
+
+/* The phase of a long running pattern where elapsed * step overflows */
+static void check_phase_overflow(void)
+{
+	static const uint16_t period[] = {20, 333, 1000, 4097, 65535};
+	haptic_pattern_params_t params;
+	haptic_pattern_engine_t engine;
+	uint8_t level[MOTORS];
+	unsigned idx;
+
+	for (idx = 0; idx < sizeof(period) / sizeof(period[0]); idx++) {
+		uint32_t step = (1ul << 24) / period[idx];
+		/* First elapsed time whose product does not fit 32 bits */
+		uint32_t overflow = (uint32_t)(0x100000000ull / step) + 1;
+		uint32_t start[2] = {7, (uint32_t)(0 - overflow + 2 * TICK_MS)};
+		unsigned run;
+
+		for (run = 0; run < 2; run++) {
+			uint8_t prev = 0;
+			uint32_t t;
+
+			/* The ramp level gives the phase away */
+			params = make_params(HAPTIC_PATTERN_RAMP, 0x01, 255, period[idx], 0, 0);
+			haptic_pattern_init(&engine, MOTORS);
+			haptic_pattern_start(&engine, &params, start[run]);
+
+			for (t = overflow - 20 * TICK_MS; t < overflow + 20 * TICK_MS; t += TICK_MS) {
+				uint64_t phase = ((uint64_t)t * step) & 0xFFFFFF;
+				uint8_t expected = (uint8_t)((255 * ((phase >> 16) + 1)) >> 8);
+
+				haptic_pattern_render(&engine, start[run] + t, level);
+				CHECK(level[0] == expected, "period %u, start 0x%08lx, %lu ms: ramp at %u, expected %u",
+						period[idx], (unsigned long)start[run], (unsigned long)t, level[0], expected);
+
+				/* One tick advances the phase by the same amount on both
+				 * sides of the overflow, unless the ramp restarts */
+				if ((t > overflow - 20 * TICK_MS) && (period[idx] >= 1000) && (level[0] >= prev)) {
+					CHECK(level[0] - prev <= 2, "period %u, %lu ms: ramp jumped from %u to %u",
+							period[idx], (unsigned long)t, prev, level[0]);
+				}
+				prev = level[0];
+			}
+		}
+	}
+}
+
+static void check_slots(void)
+{
+	haptic_pattern_engine_t engine;
+	haptic_pattern_params_t params;
+	uint8_t buf[HAPTIC_PATTERN_MSG_SIZE + 1];
+	haptic_pattern_params_t decoded;
+	uint8_t level[MOTORS];
+	uint32_t base = 0xFFFFFF00ul;
+	uint8_t idx;
+
+	haptic_pattern_init(&engine, MOTORS);
+
+	/* Duration across the clock wrap */
+	params = make_params(HAPTIC_PATTERN_CONSTANT, 0x01, 100, 0, 0, 500);
+	haptic_pattern_start(&engine, &params, base);
+	haptic_pattern_render(&engine, base + 495, level);
+	CHECK(level[0] == 100, "constant at %u before its end", level[0]);
+	haptic_pattern_render(&engine, base + 500, level);
+	CHECK((level[0] == 0) && !haptic_pattern_active(&engine), "pattern not retired at its end");
+
+	/* A new pattern takes motors over, overlapping slots keep the rest */
+	params = make_params(HAPTIC_PATTERN_CONSTANT, 0x0F, 50, 0, 0, 0);
+	haptic_pattern_start(&engine, &params, 0);
+	params = make_params(HAPTIC_PATTERN_CONSTANT, 0x06, 150, 0, 0, 0);
+	haptic_pattern_start(&engine, &params, 0);
+	haptic_pattern_render(&engine, 10, level);
+	CHECK((level[0] == 50) && (level[1] == 150) && (level[2] == 150) && (level[3] == 50),
+			"take over: %u %u %u %u", level[0], level[1], level[2], level[3]);
+
+	/* Motors beyond the count are dropped from the mask */
+	params = make_params(HAPTIC_PATTERN_STOP, 0xF9, 0, 0, 0, 0);
+	haptic_pattern_start(&engine, &params, 0);
+	haptic_pattern_render(&engine, 20, level);
+	CHECK((level[0] == 0) && (level[1] == 150) && (level[3] == 0), "stop left %u %u %u",
+			level[0], level[1], level[3]);
+
+	/* Full slots */
+	haptic_pattern_init(&engine, MOTORS);
+	for (idx = 0; idx < HAPTIC_PATTERN_SLOTS; idx++) {
+		params = make_params(HAPTIC_PATTERN_CONSTANT, (uint8_t)(1 << idx), 10, 0, 0, 0);
+		CHECK(haptic_pattern_start(&engine, &params, 0), "slot %u refused", idx);
+	}
+	haptic_pattern_init(&engine, 8);
+	for (idx = 0; idx < HAPTIC_PATTERN_SLOTS; idx++) {
+		params = make_params(HAPTIC_PATTERN_CONSTANT, (uint8_t)(1 << idx), 10, 0, 0, 0);
+		haptic_pattern_start(&engine, &params, 0);
+	}
+	params = make_params(HAPTIC_PATTERN_CONSTANT, 0x80, 10, 0, 0, 0);
+	CHECK(!haptic_pattern_start(&engine, &params, 0), "fifth pattern accepted");
+
+	/* Messages */
+	params = make_params(HAPTIC_PATTERN_HEARTBEAT, 0x05, 200, 0x1234, 40, 0xABCD);
+	CHECK(haptic_pattern_encode(&params, buf, HAPTIC_PATTERN_MSG_SIZE - 1) == 0, "short buffer filled");
+	CHECK(haptic_pattern_encode(&params, buf, sizeof(buf)) == HAPTIC_PATTERN_MSG_SIZE, "not encoded");
+	CHECK((haptic_pattern_decode(buf, HAPTIC_PATTERN_MSG_SIZE, &decoded) == HAPTIC_PATTERN_OK) &&
+			!memcmp(&decoded, &params, sizeof(params)), "round trip changed the pattern");
+	CHECK(haptic_pattern_decode(buf, HAPTIC_PATTERN_MSG_SIZE + 1, &decoded) == HAPTIC_PATTERN_ERR_LENGTH,
+			"long message accepted");
+	buf[1] = HAPTIC_PATTERN_COUNT;
+	CHECK(haptic_pattern_decode(buf, HAPTIC_PATTERN_MSG_SIZE, &decoded) == HAPTIC_PATTERN_ERR_ID,
+			"unknown pattern accepted");
+	buf[1] = HAPTIC_PATTERN_PULSE;
+	buf[4] = HAPTIC_PATTERN_MIN_PERIOD_MS - 1;
+	buf[5] = 0;
+	CHECK(haptic_pattern_decode(buf, HAPTIC_PATTERN_MSG_SIZE, &decoded) == HAPTIC_PATTERN_ERR_PERIOD,
+			"short period accepted");
+	buf[1] = HAPTIC_PATTERN_CONSTANT;
+	CHECK(haptic_pattern_decode(buf, HAPTIC_PATTERN_MSG_SIZE, &decoded) == HAPTIC_PATTERN_OK,
+			"constant refused for its period");
+	buf[0] = 0;
+	CHECK(haptic_pattern_decode(buf, HAPTIC_PATTERN_MSG_SIZE, &decoded) == HAPTIC_PATTERN_ERR_TYPE,
+			"batch taken for a pattern");
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+
+	if (!check_verbose_arg(argc, argv, &verbose)) {
+		return 2;
+	}
+
+	check_shapes(verbose);
+	check_heartbeat();
+	check_phase_overflow();
+	check_slots();
+
+	return check_report();
+}
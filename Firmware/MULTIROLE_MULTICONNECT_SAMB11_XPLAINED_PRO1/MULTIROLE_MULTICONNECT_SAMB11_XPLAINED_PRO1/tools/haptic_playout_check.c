@@ -0,0 +1,579 @@
+/**
+ * \file
+ *
+ * \brief Host checks of the haptic batch codec and the playout buffer
+ *
+ * Runs haptic_batch.c and haptic_playout.c on the host:
+ *
+ *  - frames per notification for the usual ATT MTUs
+ *  - encode/decode round trips of random batches, and the payloads the
+ *    decoder has to reject: truncated, too long, unknown version, bad
+ *    motor or frame counts, offsets that do not strictly increase
+ *  - a timeline streamed with random notification jitter below the
+ *    playout delay reaches the motors at the sender's times
+ *  - overlapping timelines replacing queued frames, the queue overflow,
+ *    sequence gaps, the resync on a sender clock jump and the hold after
+ *    the queue runs dry
+ *  - a trace of irregularly spaced set-points, checked on every tick
+ *    against straight lines between them and steps where they are further
+ *    apart than HAPTIC_PLAYOUT_INTERP_MAX_MS
+ *  - the trend followed for HAPTIC_PLAYOUT_EXTRAPOLATE_MS after the last
+ *    set-point, then held and clamped to 0..255, and a late timeline
+ *    continuing from the held level
+ *  - both traces again with the local and the sender millisecond clocks
+ *    wrapping at every TICK_MS step of them
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o haptic_playout_check haptic_playout_check.c ../src/haptic_batch.c ../src/haptic_playout.c
+ *   ./haptic_playout_check [-r seed]
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "haptic_batch.h"
+#include "haptic_playout.h"
+#include "stubs/check.h"
+
+/* Firmware tick the application runs the playout at */
+#define TICK_MS                 (5)
+
+#define TRACE_POINTS            (60)
+
+#define TRACE_FRAMES            (8)
+
+/* A batch of frames every period_ms from base_ms, level = f(time) */
+static void make_batch(haptic_batch_t *batch, uint8_t sequence,
+		uint32_t base_ms, uint8_t frames, uint16_t period_ms, uint8_t motors)
+{
+	uint8_t idx;
+	uint8_t motor;
+
+	memset(batch, 0, sizeof(*batch));
+	batch->sequence = sequence;
+	batch->base_ms = base_ms;
+	batch->motor_count = motors;
+	batch->frame_count = frames;
+	for (idx = 0; idx < frames; idx++) {
+		batch->frames[idx].offset_ms = (uint16_t)(idx * period_ms);
+		for (motor = 0; motor < motors; motor++) {
+			batch->frames[idx].intensity[motor] =
+					(uint8_t)((base_ms + idx * period_ms) / 10 + motor * 30);
+		}
+	}
+}
+
+static void check_frames_per_mtu(void)
+{
+	CHECK(haptic_batch_frames_per_mtu(23, 4) == 2, "MTU 23, 4 motors: %u",
+			haptic_batch_frames_per_mtu(23, 4));
+	CHECK(haptic_batch_frames_per_mtu(23, 8) == 1, "MTU 23, 8 motors: %u",
+			haptic_batch_frames_per_mtu(23, 8));
+	CHECK(haptic_batch_frames_per_mtu(185, 4) == HAPTIC_BATCH_MAX_FRAMES,
+			"MTU 185, 4 motors: %u", haptic_batch_frames_per_mtu(185, 4));
+	CHECK(haptic_batch_frames_per_mtu(247, 8) == 23, "MTU 247, 8 motors: %u",
+			haptic_batch_frames_per_mtu(247, 8));
+	CHECK(haptic_batch_frames_per_mtu(517, 1) == HAPTIC_BATCH_MAX_FRAMES,
+			"MTU 517 not capped: %u", haptic_batch_frames_per_mtu(517, 1));
+	CHECK(haptic_batch_frames_per_mtu(11, 1) == 0, "MTU 11 fits a frame");
+	CHECK(haptic_batch_frames_per_mtu(247, 0) == 0, "frames without motors");
+	CHECK(haptic_batch_frames_per_mtu(247, HAPTIC_BATCH_MAX_MOTORS + 1) == 0,
+			"frames with too many motors");
+
+	/* Every count returned fits the notification */
+	{
+		uint16_t mtu;
+		uint8_t motors;
+
+		for (mtu = 23; mtu <= 517; mtu++) {
+			for (motors = 1; motors <= HAPTIC_BATCH_MAX_MOTORS; motors++) {
+				uint8_t frames = haptic_batch_frames_per_mtu(mtu, motors);
+
+				if (frames) {
+					CHECK(HAPTIC_BATCH_SIZE(frames, motors) + HAPTIC_BATCH_ATT_OVERHEAD <= mtu,
+							"%u frames of %u motors overflow MTU %u", frames, motors, mtu);
+				}
+				if (frames < HAPTIC_BATCH_MAX_FRAMES) {
+					CHECK(HAPTIC_BATCH_SIZE(frames + 1, motors) + HAPTIC_BATCH_ATT_OVERHEAD > mtu,
+							"MTU %u fits more than %u frames of %u motors", mtu, frames, motors);
+				}
+			}
+		}
+	}
+}
+
+static void check_round_trip(void)
+{
+	uint8_t buf[HAPTIC_BATCH_SIZE(HAPTIC_BATCH_MAX_FRAMES, HAPTIC_BATCH_MAX_MOTORS) + 1];
+	haptic_batch_t batch;
+	haptic_batch_t decoded;
+	int run;
+
+	for (run = 0; run < 10000; run++) {
+		uint8_t motors = (uint8_t)(1 + rand() % HAPTIC_BATCH_MAX_MOTORS);
+		uint8_t frames = (uint8_t)(1 + rand() % HAPTIC_BATCH_MAX_FRAMES);
+		uint16_t offset = (uint16_t)(rand() % 100);
+		uint16_t len;
+		uint8_t idx;
+		uint8_t motor;
+
+		memset(&batch, 0, sizeof(batch));
+		batch.sequence = (uint8_t)rand();
+		batch.base_ms = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		batch.motor_count = motors;
+		batch.frame_count = frames;
+		for (idx = 0; idx < frames; idx++) {
+			batch.frames[idx].offset_ms = offset;
+			offset = (uint16_t)(offset + 1 + rand() % 2000);
+			for (motor = 0; motor < motors; motor++) {
+				batch.frames[idx].intensity[motor] = (uint8_t)rand();
+			}
+		}
+
+		len = haptic_batch_encode(&batch, buf, sizeof(buf));
+		CHECK(len == HAPTIC_BATCH_SIZE(frames, motors), "encoded %u bytes for %u frames of %u motors",
+				len, frames, motors);
+		CHECK(haptic_batch_encode(&batch, buf, (uint16_t)(len - 1)) == 0,
+				"encoded into a buffer one byte short");
+
+		memset(&decoded, 0xa5, sizeof(decoded));
+		CHECK(haptic_batch_decode(buf, len, &decoded) == HAPTIC_BATCH_OK, "round trip rejected");
+		CHECK(decoded.sequence == batch.sequence && decoded.base_ms == batch.base_ms &&
+				decoded.motor_count == motors && decoded.frame_count == frames,
+				"header changed in the round trip");
+		for (idx = 0; idx < frames; idx++) {
+			CHECK(!memcmp(&decoded.frames[idx], &batch.frames[idx], sizeof(haptic_frame_t)),
+					"frame %u changed in the round trip", idx);
+		}
+
+		/* Truncated and padded payloads */
+		CHECK(haptic_batch_decode(buf, (uint16_t)(len - 1), &decoded) == HAPTIC_BATCH_ERR_LENGTH,
+				"truncated payload accepted");
+		buf[len] = 0;
+		CHECK(haptic_batch_decode(buf, (uint16_t)(len + 1), &decoded) == HAPTIC_BATCH_ERR_LENGTH,
+				"padded payload accepted");
+	}
+
+	/* Offsets that do not strictly increase, on either side */
+	make_batch(&batch, 0, 1000, 4, 10, 2);
+	batch.frames[2].offset_ms = batch.frames[1].offset_ms;
+	CHECK(haptic_batch_encode(&batch, buf, sizeof(buf)) == 0, "encoded a repeated offset");
+	batch.frames[2].offset_ms = (uint16_t)(batch.frames[1].offset_ms - 1);
+	CHECK(haptic_batch_encode(&batch, buf, sizeof(buf)) == 0, "encoded a decreasing offset");
+
+	make_batch(&batch, 0, 1000, 4, 10, 2);
+	CHECK(haptic_batch_encode(&batch, buf, sizeof(buf)) == HAPTIC_BATCH_SIZE(4, 2), "valid batch rejected");
+	buf[HAPTIC_BATCH_HEADER_SIZE + 2 * HAPTIC_BATCH_FRAME_SIZE(2)] = 10;
+	buf[HAPTIC_BATCH_HEADER_SIZE + 2 * HAPTIC_BATCH_FRAME_SIZE(2) + 1] = 0;
+	CHECK(haptic_batch_decode(buf, HAPTIC_BATCH_SIZE(4, 2), &decoded) == HAPTIC_BATCH_ERR_ORDER,
+			"decoded a repeated offset");
+
+	/* Header fields */
+	make_batch(&batch, 0, 1000, 4, 10, 2);
+	haptic_batch_encode(&batch, buf, sizeof(buf));
+	CHECK(haptic_batch_decode(buf, HAPTIC_BATCH_HEADER_SIZE - 1, &decoded) == HAPTIC_BATCH_ERR_LENGTH,
+			"decoded a partial header");
+	buf[0] = HAPTIC_BATCH_VERSION + 1;
+	CHECK(haptic_batch_decode(buf, HAPTIC_BATCH_SIZE(4, 2), &decoded) == HAPTIC_BATCH_ERR_VERSION,
+			"decoded an unknown version");
+	buf[0] = HAPTIC_BATCH_VERSION;
+	buf[6] = 0;
+	CHECK(haptic_batch_decode(buf, HAPTIC_BATCH_SIZE(4, 2), &decoded) == HAPTIC_BATCH_ERR_MOTORS,
+			"decoded a batch without motors");
+	buf[6] = HAPTIC_BATCH_MAX_MOTORS + 1;
+	CHECK(haptic_batch_decode(buf, HAPTIC_BATCH_SIZE(4, 2), &decoded) == HAPTIC_BATCH_ERR_MOTORS,
+			"decoded a batch with too many motors");
+	buf[6] = 2;
+	buf[7] = 0;
+	CHECK(haptic_batch_decode(buf, HAPTIC_BATCH_SIZE(4, 2), &decoded) == HAPTIC_BATCH_ERR_FRAMES,
+			"decoded a batch without frames");
+	buf[7] = HAPTIC_BATCH_MAX_FRAMES + 1;
+	CHECK(haptic_batch_decode(buf, HAPTIC_BATCH_SIZE(4, 2), &decoded) == HAPTIC_BATCH_ERR_FRAMES,
+			"decoded a batch with too many frames");
+
+	batch.motor_count = 0;
+	CHECK(haptic_batch_encode(&batch, buf, sizeof(buf)) == 0, "encoded a batch without motors");
+	batch.motor_count = 2;
+	batch.frame_count = 0;
+	CHECK(haptic_batch_encode(&batch, buf, sizeof(buf)) == 0, "encoded a batch without frames");
+}
+
+/* A 100 ms timeline every 100 ms, each arriving up to jitter_ms late. At
+ * every frame's due time the motors are at its level, whatever the
+ * jitter, and nothing is late, replaced or resynced. */
+static void check_jitter(uint32_t start_ms, uint32_t jitter_ms)
+{
+	haptic_playout_t playout;
+	haptic_batch_t batches[50];
+	uint32_t arrival[50];
+	uint32_t offset_ms = 0;
+	uint32_t now;
+	unsigned next = 0;
+	unsigned count = sizeof(batches) / sizeof(batches[0]);
+	unsigned idx;
+	unsigned checked = 0;
+
+	haptic_playout_reset(&playout);
+	for (idx = 0; idx < count; idx++) {
+		/* Frames every 5 ms, on the tick, so each is seen at its due time */
+		make_batch(&batches[idx], (uint8_t)idx, 70000 + idx * 100, 20, 5, 3);
+		arrival[idx] = start_ms + idx * 100 + (idx ? (uint32_t)(rand() % (jitter_ms + 1)) : 0);
+	}
+
+	for (now = start_ms; now != start_ms + count * 100 + 200; now += TICK_MS) {
+		while ((next < count) && ((int32_t)(now - arrival[next]) >= 0)) {
+			haptic_playout_submit(&playout, &batches[next], now);
+			if (next == 0) {
+				offset_ms = playout.offset_ms;
+				CHECK(offset_ms == start_ms + HAPTIC_PLAYOUT_DELAY_MS - 70000,
+						"anchored at offset %lu", (unsigned long)offset_ms);
+			}
+			next++;
+		}
+		haptic_playout_tick(&playout, now);
+
+		/* The frame due now, if any */
+		for (idx = 0; idx < next; idx++) {
+			const haptic_batch_t *batch = &batches[idx];
+			uint32_t first = batch->base_ms + offset_ms;
+			uint32_t frame;
+
+			if ((int32_t)(now - first) < 0 || now - first >= 20 * 5) {
+				continue;
+			}
+			frame = (now - first) / 5;
+			CHECK(!memcmp(playout.current, batch->frames[frame].intensity, 3),
+					"jitter %lu: at %lu ms the motors are at %u, frame %u of batch %u is %u",
+					(unsigned long)jitter_ms, (unsigned long)now, playout.current[0], frame, idx,
+					batch->frames[frame].intensity[0]);
+			checked++;
+		}
+	}
+	CHECK(checked >= (count - 1) * 20, "only %u frames checked", checked);
+	CHECK(playout.offset_ms == offset_ms, "the anchor moved with the jitter");
+	CHECK(playout.late_frames == 0 && playout.replaced_frames == 0 && playout.resyncs == 0 &&
+			playout.sequence_gaps == 0 && playout.overflow_frames == 0,
+			"jitter %lu: %lu late, %lu replaced, %lu resyncs, %lu gaps, %lu overflows",
+			(unsigned long)jitter_ms, (unsigned long)playout.late_frames,
+			(unsigned long)playout.replaced_frames, (unsigned long)playout.resyncs,
+			(unsigned long)playout.sequence_gaps, (unsigned long)playout.overflow_frames);
+	CHECK(playout.batches == count, "%lu batches", (unsigned long)playout.batches);
+}
+
+static void check_queue(void)
+{
+	haptic_playout_t playout;
+	haptic_batch_t batch;
+	uint32_t due;
+
+	/* A newer timeline replaces the queued frames from its start on */
+	haptic_playout_reset(&playout);
+	make_batch(&batch, 1, 1000, 10, 10, 2);
+	haptic_playout_submit(&playout, &batch, 50000);
+	make_batch(&batch, 2, 1050, 10, 10, 2);
+	haptic_playout_submit(&playout, &batch, 50010);
+	CHECK(playout.replaced_frames == 5, "%lu frames replaced, 5 overlapped",
+			(unsigned long)playout.replaced_frames);
+	CHECK(playout.count == 15, "%u frames queued", playout.count);
+	CHECK(playout.sequence_gaps == 0, "consecutive batches counted as a gap");
+
+	/* A skipped sequence number */
+	make_batch(&batch, 4, 1200, 2, 10, 2);
+	haptic_playout_submit(&playout, &batch, 50020);
+	CHECK(playout.sequence_gaps == 1, "%lu sequence gaps", (unsigned long)playout.sequence_gaps);
+
+	/* Three full batches without a tick overflow the queue by one */
+	haptic_playout_reset(&playout);
+	make_batch(&batch, 0, 0, HAPTIC_BATCH_MAX_FRAMES, 1, 1);
+	haptic_playout_submit(&playout, &batch, 1000);
+	make_batch(&batch, 1, HAPTIC_BATCH_MAX_FRAMES, HAPTIC_BATCH_MAX_FRAMES, 1, 1);
+	haptic_playout_submit(&playout, &batch, 1000);
+	make_batch(&batch, 2, 2 * HAPTIC_BATCH_MAX_FRAMES, HAPTIC_BATCH_MAX_FRAMES, 1, 1);
+	haptic_playout_submit(&playout, &batch, 1000);
+	CHECK(playout.count == HAPTIC_PLAYOUT_DEPTH, "%u frames queued", playout.count);
+	CHECK(playout.overflow_frames == HAPTIC_BATCH_MAX_FRAMES, "%lu overflows",
+			(unsigned long)playout.overflow_frames);
+	CHECK(playout.frames[playout.head].due_ms == playout.offset_ms + HAPTIC_BATCH_MAX_FRAMES,
+			"the oldest frames were not the ones dropped");
+
+	/* The sender clock jumps ahead: the batch is played a playout delay
+	 * after it arrived rather than in ten seconds */
+	haptic_playout_reset(&playout);
+	make_batch(&batch, 0, 1000, 4, 10, 1);
+	haptic_playout_submit(&playout, &batch, 20000);
+	make_batch(&batch, 1, 11000, 4, 10, 1);
+	haptic_playout_submit(&playout, &batch, 20040);
+	CHECK(playout.resyncs == 1, "%lu resyncs after a jump ahead", (unsigned long)playout.resyncs);
+	due = playout.frames[(playout.head + playout.count - 4) % HAPTIC_PLAYOUT_DEPTH].due_ms;
+	CHECK(due == 20040 + HAPTIC_PLAYOUT_DELAY_MS, "after the jump the batch is due at %lu",
+			(unsigned long)due);
+
+	/* And back: a timeline far in the past is re-anchored too */
+	make_batch(&batch, 2, 100, 4, 10, 1);
+	haptic_playout_submit(&playout, &batch, 20100);
+	CHECK(playout.resyncs == 2, "%lu resyncs after a jump back", (unsigned long)playout.resyncs);
+	CHECK(playout.late_frames == 0, "%lu frames late after a resync", (unsigned long)playout.late_frames);
+
+	/* A batch that arrives after its frames are due counts them late */
+	haptic_playout_reset(&playout);
+	make_batch(&batch, 0, 1000, 2, 10, 1);
+	haptic_playout_submit(&playout, &batch, 5000);
+	make_batch(&batch, 1, 1100, 4, 10, 1);
+	haptic_playout_submit(&playout, &batch, 5000 + 100 + HAPTIC_PLAYOUT_DELAY_MS + 25);
+	CHECK(playout.late_frames == 3, "%lu late frames", (unsigned long)playout.late_frames);
+}
+
+/* Once the queue runs dry the motors hold, after at most the
+ * extrapolation time, and one underrun is counted per dry spell */
+static void check_underrun(void)
+{
+	haptic_playout_t playout;
+	haptic_batch_t batch;
+	uint32_t now;
+	uint8_t held;
+
+	haptic_playout_reset(&playout);
+	make_batch(&batch, 0, 1000, 4, 20, 1);
+	batch.frames[2].intensity[0] = 100;
+	batch.frames[3].intensity[0] = 100;
+	haptic_playout_submit(&playout, &batch, 3000);
+	for (now = 3000; now < 3400; now += TICK_MS) {
+		haptic_playout_tick(&playout, now);
+	}
+	held = playout.current[0];
+	CHECK(held == 100, "a flat timeline drifted to %u", held);
+	CHECK(playout.underruns == 1, "%lu underruns", (unsigned long)playout.underruns);
+	CHECK(!haptic_playout_extrapolating(&playout, now), "still extrapolating after %lu ms",
+			(unsigned long)(now - playout.from_ms));
+	CHECK(!haptic_playout_pending(&playout), "frames pending after the timeline");
+
+	/* The next timeline ends the dry spell */
+	make_batch(&batch, 1, 1400, 2, 20, 1);
+	haptic_playout_submit(&playout, &batch, now);
+	CHECK(haptic_playout_pending(&playout), "nothing pending after a batch");
+	for (; now < 3800; now += TICK_MS) {
+		haptic_playout_tick(&playout, now);
+	}
+	CHECK(playout.underruns == 2, "%lu underruns after two dry spells", (unsigned long)playout.underruns);
+}
+
+/* Set-point spacing of the trace, with steps longer than the interpolation */
+static const uint16_t trace_gap[] = {7, 20, 33, 10, 60, 100, 101, 150, 5, 45};
+
+/* Sender time and levels of every set-point of the trace */
+static void make_trace(uint32_t *time, uint8_t (*level)[2])
+{
+	uint32_t seed = 12345;
+	unsigned idx;
+
+	time[0] = 0;
+	for (idx = 0; idx < TRACE_POINTS; idx++) {
+		if (idx) {
+			time[idx] = time[idx - 1] + trace_gap[idx % (sizeof(trace_gap) / sizeof(trace_gap[0]))];
+		}
+		seed = seed * 1103515245 + 12345;
+		level[idx][0] = (uint8_t)(seed >> 16);
+		/* Full swings on the second motor */
+		level[idx][1] = (idx % 2) ? 255 : 0;
+	}
+}
+
+/* Frames first..first + count - 1 of a trace as one batch */
+static void make_trace_batch(haptic_batch_t *batch, uint8_t sequence, uint32_t sender_ms,
+		const uint32_t *time, uint8_t (*level)[2], unsigned first, unsigned count)
+{
+	unsigned idx;
+
+	memset(batch, 0, sizeof(*batch));
+	batch->sequence = sequence;
+	batch->base_ms = sender_ms + time[first];
+	batch->motor_count = 2;
+	batch->frame_count = (uint8_t)count;
+	for (idx = 0; idx < count; idx++) {
+		batch->frames[idx].offset_ms = (uint16_t)(time[first + idx] - time[first]);
+		memcpy(batch->frames[idx].intensity, level[first + idx], 2);
+	}
+}
+
+/* A trace of set-points streamed ahead of time: between two set-points the
+ * motors follow the line joining them, or hold the first one when they are
+ * too far apart, and they are exactly at every set-point when it is due */
+static void check_interpolation(uint32_t start_ms, uint32_t sender_ms)
+{
+	haptic_playout_t playout;
+	haptic_batch_t batch;
+	uint32_t time[TRACE_POINTS];
+	uint8_t level[TRACE_POINTS][2];
+	uint32_t due0 = start_ms + HAPTIC_PLAYOUT_DELAY_MS;
+	unsigned sent = 0;
+	unsigned reached = 0;
+	uint32_t t;
+
+	make_trace(time, level);
+	haptic_playout_reset(&playout);
+
+	for (t = 0; t < time[TRACE_POINTS - 1] + HAPTIC_PLAYOUT_DELAY_MS + TICK_MS; t += TICK_MS) {
+		uint32_t now = start_ms + t;
+		uint8_t motor;
+
+		/* Each batch is sent when the previous one starts its last frame,
+		 * the delay ahead of it being due */
+		if ((sent < TRACE_POINTS) && (!sent || (t >= time[sent - 1]))) {
+			unsigned count = TRACE_POINTS - sent;
+
+			count = (count > TRACE_FRAMES) ? TRACE_FRAMES : count;
+			make_trace_batch(&batch, (uint8_t)(sent / TRACE_FRAMES), sender_ms, time, level, sent, count);
+			haptic_playout_submit(&playout, &batch, now);
+			sent += count;
+		}
+		haptic_playout_tick(&playout, now);
+
+		while ((reached < TRACE_POINTS) && ((int32_t)(now - (due0 + time[reached])) >= 0)) {
+			reached++;
+		}
+		if (!reached || (reached == TRACE_POINTS)) {
+			continue;
+		}
+
+		for (motor = 0; motor < 2; motor++) {
+			uint32_t from = due0 + time[reached - 1];
+			uint32_t span = time[reached] - time[reached - 1];
+			double expected = level[reached - 1][motor];
+
+			if (span <= HAPTIC_PLAYOUT_INTERP_MAX_MS) {
+				expected += ((double)level[reached][motor] - level[reached - 1][motor])
+						* (now - from) / span;
+			}
+			if (now == from) {
+				CHECK(playout.current[motor] == level[reached - 1][motor],
+						"start 0x%08lx, %lu ms: motor %u at %u on set-point %u of %u",
+						(unsigned long)start_ms, (unsigned long)t, motor, playout.current[motor],
+						reached - 1, level[reached - 1][motor]);
+			}
+			CHECK((playout.current[motor] > expected - 2) && (playout.current[motor] < expected + 2),
+					"start 0x%08lx, %lu ms: motor %u at %u, expected %.1f after set-point %u",
+					(unsigned long)start_ms, (unsigned long)t, motor, playout.current[motor],
+					expected, reached - 1);
+		}
+	}
+	CHECK(reached == TRACE_POINTS, "%u of %u set-points reached", reached, TRACE_POINTS);
+	/* The queue only runs dry after the last set-point */
+	CHECK((playout.underruns == 1) && (playout.late_frames == 0) && (playout.resyncs == 0),
+			"start 0x%08lx: %lu underruns, %lu late, %lu resyncs", (unsigned long)start_ms,
+			(unsigned long)playout.underruns, (unsigned long)playout.late_frames,
+			(unsigned long)playout.resyncs);
+}
+
+/* A rising and a falling trend that runs dry: the motors follow it for
+ * HAPTIC_PLAYOUT_EXTRAPOLATE_MS, clamped, then hold; a late timeline
+ * then starts from the held levels */
+static void check_extrapolation(uint32_t start_ms, uint32_t sender_ms)
+{
+	static const uint32_t time[] = {0, 20, 40, 140, 160};
+	static uint8_t level[][2] = {
+		{10, 200}, {50, 150}, {90, 100}, {30, 30}, {30, 30}
+	};
+	haptic_playout_t playout;
+	haptic_batch_t batch;
+	uint32_t last = start_ms + HAPTIC_PLAYOUT_DELAY_MS + time[2];
+	uint32_t late_ms = last + 70;
+	uint8_t held[2] = {0, 0};
+	uint32_t t;
+
+	haptic_playout_reset(&playout);
+	make_trace_batch(&batch, 0, sender_ms, time, level, 0, 3);
+	haptic_playout_submit(&playout, &batch, start_ms);
+
+	for (t = 0; t < HAPTIC_PLAYOUT_DELAY_MS + time[4] + 50; t += TICK_MS) {
+		uint32_t now = start_ms + t;
+		uint32_t elapsed = now - last;
+
+		if (now == late_ms) {
+			make_trace_batch(&batch, 1, sender_ms, time, level, 3, 2);
+			haptic_playout_submit(&playout, &batch, now);
+		}
+		haptic_playout_tick(&playout, now);
+
+		if ((int32_t)(now - last) < 0) {
+			continue;
+		}
+		if ((int32_t)(now - late_ms) < 0) {
+			uint32_t trend = (elapsed > HAPTIC_PLAYOUT_EXTRAPOLATE_MS) ?
+					HAPTIC_PLAYOUT_EXTRAPOLATE_MS : elapsed;
+			int32_t up = 90 + 2 * (int32_t)trend;
+			int32_t down = 100 - (5 * (int32_t)trend) / 2;
+
+			CHECK((playout.current[0] == up) && (playout.current[1] == ((down < 0) ? 0 : down)),
+					"start 0x%08lx, %lu ms past the last set-point: motors at %u %u",
+					(unsigned long)start_ms, (unsigned long)elapsed, playout.current[0],
+					playout.current[1]);
+			CHECK(haptic_playout_extrapolating(&playout, now) ==
+					(elapsed < HAPTIC_PLAYOUT_EXTRAPOLATE_MS),
+					"start 0x%08lx, %lu ms past the last set-point: extrapolating %d",
+					(unsigned long)start_ms, (unsigned long)elapsed,
+					haptic_playout_extrapolating(&playout, now));
+			memcpy(held, playout.current, sizeof(held));
+		} else if (now == late_ms) {
+			/* No jump back to the last set-point */
+			CHECK(!memcmp(playout.current, held, sizeof(held)),
+					"start 0x%08lx: late timeline moved the motors to %u %u",
+					(unsigned long)start_ms, playout.current[0], playout.current[1]);
+		} else if ((int32_t)(now - (start_ms + HAPTIC_PLAYOUT_DELAY_MS + time[3])) < 0) {
+			/* Straight from the held levels to the late set-point */
+			uint32_t span = start_ms + HAPTIC_PLAYOUT_DELAY_MS + time[3] - late_ms;
+			uint8_t motor;
+
+			for (motor = 0; motor < 2; motor++) {
+				double expected = held[motor] + ((double)level[3][motor] - held[motor])
+						* (now - late_ms) / span;
+
+				CHECK((playout.current[motor] > expected - 2) &&
+						(playout.current[motor] < expected + 2),
+						"start 0x%08lx, %lu ms after the late timeline: motor %u at %u, expected %.1f",
+						(unsigned long)start_ms, (unsigned long)(now - late_ms), motor,
+						playout.current[motor], expected);
+			}
+		}
+	}
+	CHECK(!memcmp(playout.current, level[4], 2), "start 0x%08lx: motors end at %u %u",
+			(unsigned long)start_ms, playout.current[0], playout.current[1]);
+	CHECK(playout.underruns == 2, "start 0x%08lx: %lu underruns", (unsigned long)start_ms,
+			(unsigned long)playout.underruns);
+}
+
+int main(int argc, char **argv)
+{
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-r") && (arg + 1 < argc)) {
+			srand((unsigned)atoi(argv[++arg]));
+		} else {
+			fprintf(stderr, "usage: %s [-r seed]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	check_frames_per_mtu();
+	check_round_trip();
+	check_jitter(10000, 0);
+	check_jitter(10000, HAPTIC_PLAYOUT_DELAY_MS - TICK_MS);
+	check_queue();
+	check_underrun();
+
+	/* Both clocks wrapping in every part of the traces */
+	{
+		uint32_t wrap;
+
+		check_interpolation(10000, 70000);
+		check_extrapolation(10000, 70000);
+		for (wrap = 0; wrap <= 3000; wrap += TICK_MS) {
+			check_interpolation((uint32_t)(0 - wrap), (uint32_t)(0 - 2 * wrap - 1));
+			check_extrapolation((uint32_t)(0 - wrap), (uint32_t)(0 - 2 * wrap - 1));
+		}
+	}
+
+	return check_report();
+}
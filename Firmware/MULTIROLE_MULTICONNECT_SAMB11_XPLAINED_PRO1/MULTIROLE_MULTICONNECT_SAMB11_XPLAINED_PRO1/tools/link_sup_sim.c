@@ -0,0 +1,239 @@
+/**
+ * \file
+ *
+ * \brief Link loss simulation of the haptic link supervisor
+ *
+ * Runs link_supervisor.c on the host through a scripted link, ticked like
+ * the firmware every TICK_MS:
+ *
+ *   connect, frames, stall -> fade -> off, disconnect -> loss pattern,
+ *   reconnect, first frame, frames, disconnect without a stall, reconnect
+ *   in the middle of the pattern, frames
+ *
+ * The motor output of every tick is compared with the one expected from the
+ * script, the recovery metrics with the outage durations, and every change
+ * of the output must have been announced by link_sup_next_event(). The
+ * script is run from time 0 and again with the millisecond clock wrapping
+ * at every TICK_MS step of it, so each phase also runs across the wrap.
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o link_sup_sim link_sup_sim.c ../src/link_supervisor.c
+ *   ./link_sup_sim [-v]
+ *
+ * Options:
+ *   -v  print the output changes of the run from time 0
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "link_supervisor.h"
+#include "stubs/check.h"
+
+/* Firmware tick the application runs the supervisor at */
+#define TICK_MS                 (5)
+
+#define MOTORS                  (4)
+
+/* Script, milliseconds from the start */
+#define CONNECT1_MS             (100)
+#define FRAMES1_MS              (200)
+#define LAST_FRAME1_MS          (1000)
+#define DISCONNECT1_MS          (2000)
+#define CONNECT2_MS             (15000)
+#define FRAMES2_MS              (15300)
+#define LAST_FRAME2_MS          (16000)
+#define DISCONNECT2_MS          (16010)
+#define CONNECT3_MS             (16500)
+#define FRAMES3_MS              (16600)
+#define END_MS                  (17000)
+#define FRAME_PERIOD_MS         (20)
+
+static uint8_t playout_level(uint8_t motor)
+{
+	return (uint8_t)(60 + 60 * motor);
+}
+
+static bool in_range(uint32_t t, uint32_t from, uint32_t to)
+{
+	return (t >= from) && (t < to);
+}
+
+static bool is_frame(uint32_t t)
+{
+	return ((in_range(t, FRAMES1_MS, LAST_FRAME1_MS + 1)) ||
+			(in_range(t, FRAMES2_MS, LAST_FRAME2_MS + 1)) ||
+			(in_range(t, FRAMES3_MS, END_MS))) &&
+			(((t - FRAMES1_MS) % FRAME_PERIOD_MS) == 0);
+}
+
+/* Loss pattern written out from the header's description */
+static uint8_t expected_pattern(uint32_t t)
+{
+	uint32_t repeat;
+	uint32_t pulse;
+
+	for (repeat = 0; repeat < LINK_SUP_PATTERN_REPEATS; repeat++) {
+		for (pulse = 0; pulse < LINK_SUP_PULSES; pulse++) {
+			uint32_t start = repeat * LINK_SUP_PATTERN_PERIOD_MS
+					+ pulse * 2 * LINK_SUP_PULSE_MS;
+
+			if (in_range(t, start, start + LINK_SUP_PULSE_MS)) {
+				return LINK_SUP_PULSE_LEVEL;
+			}
+		}
+	}
+	return 0;
+}
+
+static uint8_t expected_output(uint32_t t, uint8_t motor)
+{
+	uint32_t fade_ms = LAST_FRAME1_MS + LINK_SUP_FRAME_TIMEOUT_MS;
+
+	if (in_range(t, FRAMES1_MS, fade_ms) ||
+			in_range(t, FRAMES2_MS, DISCONNECT2_MS) ||
+			in_range(t, FRAMES3_MS, END_MS)) {
+		return playout_level(motor);
+	}
+	if (in_range(t, fade_ms, fade_ms + LINK_SUP_FADE_MS)) {
+		return (uint8_t)(playout_level(motor)
+				* (LINK_SUP_FADE_MS - (t - fade_ms)) / LINK_SUP_FADE_MS);
+	}
+	if (in_range(t, DISCONNECT1_MS, CONNECT2_MS)) {
+		return expected_pattern(t - DISCONNECT1_MS);
+	}
+	if (in_range(t, DISCONNECT2_MS, CONNECT3_MS)) {
+		return expected_pattern(t - DISCONNECT2_MS);
+	}
+	return 0;
+}
+
+/* Runs the script with the clock at base_ms at its start */
+static void run(uint32_t base_ms, bool verbose)
+{
+	link_sup_t sup;
+	uint8_t level[MOTORS];
+	uint8_t out[MOTORS];
+	uint8_t last[MOTORS];
+	bool announced = false;
+	uint32_t when_ms = 0;
+	uint32_t t;
+	uint8_t motor;
+
+	for (motor = 0; motor < MOTORS; motor++) {
+		level[motor] = playout_level(motor);
+	}
+	memset(last, 0, sizeof(last));
+	link_sup_init(&sup, base_ms);
+
+	for (t = 0; t < END_MS; t += TICK_MS) {
+		uint32_t now = base_ms + t;
+		bool event = true;
+
+		if (t == CONNECT1_MS || t == CONNECT2_MS || t == CONNECT3_MS) {
+			link_sup_connected(&sup, now);
+		} else if (t == DISCONNECT1_MS || t == DISCONNECT2_MS) {
+			link_sup_disconnected(&sup, now);
+		} else if (is_frame(t)) {
+			bool recovered = link_sup_frame(&sup, now);
+
+			CHECK(recovered == ((t == FRAMES2_MS) || (t == FRAMES3_MS)),
+					"base 0x%08lx, %lu ms: frame recovered %d", (unsigned long)base_ms,
+					(unsigned long)t, recovered);
+		} else {
+			event = false;
+		}
+
+		link_sup_apply(&sup, now, level, out, MOTORS);
+
+		for (motor = 0; motor < MOTORS; motor++) {
+			CHECK(out[motor] == expected_output(t, motor),
+					"base 0x%08lx, %lu ms: motor %u at %u, expected %u", (unsigned long)base_ms,
+					(unsigned long)t, motor, out[motor], expected_output(t, motor));
+		}
+
+		/* Without an event the output only changes when it was announced */
+		if (!event && memcmp(out, last, sizeof(out))) {
+			CHECK(announced && ((int32_t)(when_ms - now) <= 0),
+					"base 0x%08lx, %lu ms: change not announced", (unsigned long)base_ms,
+					(unsigned long)t);
+		}
+		if (verbose && memcmp(out, last, sizeof(out))) {
+			printf("%6lu ms  state %d  motors %3u %3u %3u %3u\n", (unsigned long)t,
+					sup.state, out[0], out[1], out[2], out[3]);
+		}
+
+		memcpy(last, out, sizeof(out));
+		announced = link_sup_next_event(&sup, now, &when_ms);
+		if (announced) {
+			CHECK((int32_t)(when_ms - now) >= 0, "base 0x%08lx, %lu ms: next event in the past",
+					(unsigned long)base_ms, (unsigned long)t);
+		}
+	}
+
+	/* The stall started the first outage, the disconnect the second */
+	CHECK(sup.stalls == 1, "%lu stalls", (unsigned long)sup.stalls);
+	CHECK(sup.disconnects == 2, "%lu disconnects", (unsigned long)sup.disconnects);
+	CHECK(sup.recoveries == 2, "%lu recoveries", (unsigned long)sup.recoveries);
+	CHECK(sup.last_reconnect_ms == CONNECT3_MS - DISCONNECT2_MS, "base 0x%08lx: reconnect after %lu ms",
+			(unsigned long)base_ms, (unsigned long)sup.last_reconnect_ms);
+	CHECK(sup.last_recovery_ms == FRAMES3_MS - DISCONNECT2_MS, "base 0x%08lx: recovery after %lu ms",
+			(unsigned long)base_ms, (unsigned long)sup.last_recovery_ms);
+	CHECK(sup.max_recovery_ms == FRAMES2_MS - LAST_FRAME1_MS, "base 0x%08lx: longest recovery %lu ms",
+			(unsigned long)base_ms, (unsigned long)sup.max_recovery_ms);
+	CHECK(sup.total_recovery_ms == (FRAMES2_MS - LAST_FRAME1_MS) + (FRAMES3_MS - DISCONNECT2_MS),
+			"base 0x%08lx: total recovery %lu ms", (unsigned long)base_ms,
+			(unsigned long)sup.total_recovery_ms);
+
+	if (verbose) {
+		printf("stalls %lu, disconnects %lu, recoveries %lu, recovery max %lu ms, total %lu ms\n",
+				(unsigned long)sup.stalls, (unsigned long)sup.disconnects,
+				(unsigned long)sup.recoveries, (unsigned long)sup.max_recovery_ms,
+				(unsigned long)sup.total_recovery_ms);
+	}
+}
+
+/* The reconnect time of the first outage, checked before the second */
+static void check_first_outage(uint32_t base_ms)
+{
+	link_sup_t sup;
+	uint8_t level[MOTORS] = {0};
+
+	link_sup_init(&sup, base_ms);
+	link_sup_connected(&sup, base_ms + CONNECT1_MS);
+	CHECK(sup.last_reconnect_ms == 0, "reconnect time without an outage");
+	link_sup_frame(&sup, base_ms + LAST_FRAME1_MS);
+	/* The stall is noticed on the next tick, however late */
+	link_sup_apply(&sup, base_ms + DISCONNECT1_MS - TICK_MS, level, level, MOTORS);
+	CHECK(sup.stalls == 1, "stall not noticed");
+	link_sup_disconnected(&sup, base_ms + DISCONNECT1_MS);
+	link_sup_connected(&sup, base_ms + CONNECT2_MS);
+	CHECK(sup.last_reconnect_ms == CONNECT2_MS - LAST_FRAME1_MS,
+			"base 0x%08lx: reconnect %lu ms after the stall", (unsigned long)base_ms,
+			(unsigned long)sup.last_reconnect_ms);
+
+	/* Disconnect while down counts once */
+	link_sup_disconnected(&sup, base_ms + CONNECT2_MS + 10);
+	link_sup_disconnected(&sup, base_ms + CONNECT2_MS + 20);
+	CHECK(sup.disconnects == 2, "%lu disconnects", (unsigned long)sup.disconnects);
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+	uint32_t wrap;
+
+	if (!check_verbose_arg(argc, argv, &verbose)) {
+		return 2;
+	}
+
+	run(0, verbose);
+	check_first_outage(0);
+	for (wrap = 0; wrap <= END_MS; wrap += TICK_MS) {
+		run((uint32_t)(0 - wrap), false);
+		check_first_outage((uint32_t)(0 - wrap));
+	}
+
+	return check_report();
+}
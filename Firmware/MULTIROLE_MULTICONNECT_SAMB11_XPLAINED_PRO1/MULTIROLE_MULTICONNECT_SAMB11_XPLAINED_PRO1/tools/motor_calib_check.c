@@ -0,0 +1,326 @@
+/**
+ * \file
+ *
+ * \brief Host check of the motor calibration tables, messages and image
+ *
+ * Runs motor_calib.c on the host against tables written out by hand:
+ *
+ *  - the linear map: level 0 off, level 1 at the minimum duty, level 255
+ *    at 1023, monotonic, and spot values
+ *  - duty tables built from a straight and a convex response curve: spot
+ *    values, monotonic, level 1 at start_duty and level 255 at sat_duty,
+ *    and the straight curve within one duty step of the linear map
+ *  - message encode and decode round trips: the bytes come back unchanged
+ *    and the duties within the message resolution
+ *  - the clear message, and the length, type, motor, range and monotonic
+ *    checks of a message and of a curve
+ *  - the stored image: checksum of an empty image, set and clear, and an
+ *    image read back with a flipped byte, erased flash, another magic or
+ *    version, or a curve that is not monotonic is rejected and cleared
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o motor_calib_check motor_calib_check.c
+ *       ../src/motor_calib.c
+ *   ./motor_calib_check [-v]
+ *
+ * Options:
+ *   -v  print the duty tables
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "motor_calib.h"
+#include "stubs/check.h"
+
+/* Duty of one step of a message byte, 1023 / 255 rounded up */
+#define DUTY_STEP               (5)
+
+/* Fletcher-16 of an empty image, worked out by hand over its bytes */
+#define EMPTY_IMAGE_CHECKSUM    (0x9791)
+
+typedef struct spot {
+	uint8_t level;
+	uint16_t duty;
+} spot_t;
+
+static const spot_t linear_spots[] = {
+	{ 0, 0 }, { 1, 300 }, { 2, 302 }, { 128, 661 }, { 254, 1020 }, { 255, 1023 }
+};
+
+/* Points 0, 17, .. 255 */
+static const spot_t straight_spots[] = {
+	{ 0, 0 }, { 1, 200 }, { 128, 600 }, { 255, 1000 }
+};
+
+static const uint8_t convex_points[MOTOR_CALIB_POINTS] = {
+	0, 2, 6, 12, 20, 30, 42, 56, 72, 90, 110, 132, 156, 182, 210, 255
+};
+
+static const spot_t convex_spots[] = {
+	{ 0, 0 }, { 1, 250 }, { 2, 250 }, { 64, 302 }, { 128, 438 },
+	{ 192, 658 }, { 254, 992 }, { 255, 1000 }
+};
+
+static void print_table(const char *name, const uint16_t *duty)
+{
+	unsigned level;
+
+	printf("%s:", name);
+	for (level = 0; level < MOTOR_CALIB_LEVELS; level++) {
+		printf("%s%4u", (level % 16) ? " " : "\n  ", duty[level]);
+	}
+	printf("\n");
+}
+
+static void check_table(const char *name, const uint16_t *duty,
+		const spot_t *spot, unsigned spots)
+{
+	unsigned idx;
+
+	for (idx = 0; idx < spots; idx++) {
+		CHECK(duty[spot[idx].level] == spot[idx].duty, "%s: level %u duty %u, expected %u",
+				name, spot[idx].level, duty[spot[idx].level], spot[idx].duty);
+	}
+	for (idx = 2; idx < MOTOR_CALIB_LEVELS; idx++) {
+		CHECK(duty[idx] >= duty[idx - 1], "%s: level %u duty %u below %u",
+				name, idx, duty[idx], duty[idx - 1]);
+	}
+	CHECK(duty[MOTOR_CALIB_LEVELS - 1] <= MOTOR_CALIB_DUTY_MAX, "%s: duty %u",
+			name, duty[MOTOR_CALIB_LEVELS - 1]);
+}
+
+static void straight_curve(motor_calib_curve_t *curve, uint16_t start, uint16_t sat)
+{
+	uint8_t idx;
+
+	curve->start_duty = start;
+	curve->sat_duty = sat;
+	for (idx = 0; idx < MOTOR_CALIB_POINTS; idx++) {
+		curve->point[idx] = (uint8_t)(idx * 17);
+	}
+}
+
+static void check_tables(bool verbose)
+{
+	uint16_t duty[MOTOR_CALIB_LEVELS];
+	uint16_t linear[MOTOR_CALIB_LEVELS];
+	motor_calib_curve_t curve;
+	unsigned level;
+
+	motor_calib_linear(300, duty);
+	check_table("linear", duty, linear_spots, sizeof(linear_spots) / sizeof(linear_spots[0]));
+	if (verbose) {
+		print_table("linear 300", duty);
+	}
+
+	/* A minimum above the range drives every level at full duty */
+	motor_calib_linear(2000, duty);
+	CHECK((duty[0] == 0) && (duty[1] == MOTOR_CALIB_DUTY_MAX) &&
+			(duty[255] == MOTOR_CALIB_DUTY_MAX), "linear 2000: %u %u %u",
+			duty[0], duty[1], duty[255]);
+
+	straight_curve(&curve, 200, 1000);
+	motor_calib_build(&curve, duty);
+	check_table("straight", duty, straight_spots,
+			sizeof(straight_spots) / sizeof(straight_spots[0]));
+	if (verbose) {
+		print_table("straight 200..1000", duty);
+	}
+
+	/* Up to saturation the straight curve is the linear map */
+	straight_curve(&curve, 300, MOTOR_CALIB_DUTY_MAX);
+	motor_calib_build(&curve, duty);
+	motor_calib_linear(300, linear);
+	for (level = 0; level < MOTOR_CALIB_LEVELS; level++) {
+		CHECK((duty[level] <= linear[level] + 1) && (linear[level] <= duty[level] + 1),
+				"straight: level %u duty %u, linear %u", level, duty[level], linear[level]);
+	}
+
+	curve.start_duty = 250;
+	curve.sat_duty = 1000;
+	memcpy(curve.point, convex_points, sizeof(curve.point));
+	motor_calib_build(&curve, duty);
+	check_table("convex", duty, convex_spots, sizeof(convex_spots) / sizeof(convex_spots[0]));
+	if (verbose) {
+		print_table("convex 250..1000", duty);
+	}
+
+	/* A flat curve holds start_duty on every level */
+	memset(curve.point, 0, sizeof(curve.point));
+	motor_calib_build(&curve, duty);
+	CHECK((duty[1] == 250) && (duty[255] == 250), "flat: %u..%u", duty[1], duty[255]);
+}
+
+static void check_messages(void)
+{
+	uint8_t buf[MOTOR_CALIB_MSG_SIZE + 1];
+	uint8_t again[MOTOR_CALIB_MSG_SIZE];
+	motor_calib_curve_t curve;
+	motor_calib_curve_t decoded;
+	uint16_t start;
+	uint8_t motor;
+	bool clear;
+
+	memset(buf, 0, sizeof(buf));
+	memcpy(curve.point, convex_points, sizeof(curve.point));
+	curve.sat_duty = 900;
+	CHECK(motor_calib_encode(0, &curve, buf, MOTOR_CALIB_MSG_SIZE - 1) == 0,
+			"encode into a short buffer");
+
+	/* Every start duty comes back within a step, and the bytes unchanged */
+	for (start = 0; start <= curve.sat_duty; start++) {
+		curve.start_duty = start;
+		CHECK(motor_calib_encode(2, &curve, buf, sizeof(buf)) == MOTOR_CALIB_MSG_SIZE,
+				"encode start %u", start);
+		CHECK((buf[0] == MOTOR_CALIB_MSG) && (buf[1] == 2), "header %02X %02X", buf[0], buf[1]);
+		CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE, &motor, &clear, &decoded) ==
+				MOTOR_CALIB_OK, "decode start %u", start);
+		CHECK((motor == 2) && !clear, "start %u: motor %u clear %d", start, motor, clear);
+		CHECK((decoded.start_duty + DUTY_STEP / 2 >= start) &&
+				(decoded.start_duty <= start + DUTY_STEP / 2),
+				"start %u decoded %u", start, decoded.start_duty);
+		CHECK((decoded.sat_duty + DUTY_STEP / 2 >= curve.sat_duty) &&
+				(decoded.sat_duty <= curve.sat_duty + DUTY_STEP / 2),
+				"sat %u decoded %u", curve.sat_duty, decoded.sat_duty);
+		CHECK(!memcmp(decoded.point, convex_points, sizeof(decoded.point)),
+				"start %u: points", start);
+		motor_calib_encode(2, &decoded, again, sizeof(again));
+		CHECK(!memcmp(again, buf, MOTOR_CALIB_MSG_SIZE), "start %u: encoded again", start);
+	}
+
+	/* Byte ends: 255 is full duty */
+	curve.start_duty = MOTOR_CALIB_DUTY_MAX;
+	curve.sat_duty = MOTOR_CALIB_DUTY_MAX;
+	motor_calib_encode(MOTOR_CALIB_ALL_MOTORS, &curve, buf, sizeof(buf));
+	CHECK((buf[2] == 255) && (buf[3] == 255), "full duty bytes %u %u", buf[2], buf[3]);
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_OK, "decode full duty");
+	CHECK((motor == MOTOR_CALIB_ALL_MOTORS) && (decoded.start_duty == MOTOR_CALIB_DUTY_MAX) &&
+			(decoded.sat_duty == MOTOR_CALIB_DUTY_MAX), "full duty: motor %u %u..%u",
+			motor, decoded.start_duty, decoded.sat_duty);
+
+	/* Clear, the points are not looked at */
+	buf[2] = 0;
+	buf[3] = 0;
+	buf[4] = 200;
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_OK, "decode clear");
+	CHECK(clear, "clear not seen");
+
+	motor_calib_encode(1, &curve, buf, sizeof(buf));
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE - 1, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_ERR_LENGTH, "short message");
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE + 1, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_ERR_LENGTH, "long message");
+	buf[0] = MOTOR_CALIB_MSG + 1;
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_ERR_TYPE, "type");
+	buf[0] = MOTOR_CALIB_MSG;
+	buf[1] = MOTOR_CALIB_MOTORS;
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_ERR_MOTOR, "motor %u", buf[1]);
+	buf[1] = 0;
+	buf[2] = 200;
+	buf[3] = 100;
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_ERR_RANGE, "start above saturation");
+	buf[3] = 200;
+	buf[4 + 7] = buf[4 + 6] - 1;
+	CHECK(motor_calib_decode(buf, MOTOR_CALIB_MSG_SIZE, &motor, &clear, &decoded) ==
+			MOTOR_CALIB_ERR_CURVE, "falling point");
+
+	straight_curve(&curve, 100, MOTOR_CALIB_DUTY_MAX + 1);
+	CHECK(motor_calib_check(&curve) == MOTOR_CALIB_ERR_RANGE, "saturation above the range");
+	curve.sat_duty = MOTOR_CALIB_DUTY_MAX;
+	CHECK(motor_calib_check(&curve) == MOTOR_CALIB_OK, "straight curve");
+	curve.point[MOTOR_CALIB_POINTS - 1] = curve.point[MOTOR_CALIB_POINTS - 2] - 1;
+	CHECK(motor_calib_check(&curve) == MOTOR_CALIB_ERR_CURVE, "falling last point");
+}
+
+static bool image_empty(const motor_calib_image_t *image)
+{
+	motor_calib_image_t empty;
+
+	motor_calib_image_init(&empty);
+	return !memcmp(image, &empty, sizeof(empty));
+}
+
+static void check_image(void)
+{
+	motor_calib_image_t image;
+	motor_calib_image_t saved;
+	motor_calib_curve_t curve;
+	unsigned idx;
+
+	motor_calib_image_init(&image);
+	CHECK((image.magic == MOTOR_CALIB_MAGIC) && (image.version == MOTOR_CALIB_VERSION) &&
+			(image.valid_mask == 0), "empty image %04X %u %02X",
+			image.magic, image.version, image.valid_mask);
+	CHECK(image.checksum == EMPTY_IMAGE_CHECKSUM, "empty image checksum %04X", image.checksum);
+	CHECK(motor_calib_restore(&image), "empty image rejected");
+
+	straight_curve(&curve, 200, 1000);
+	motor_calib_image_set(&image, 2, &curve);
+	memcpy(curve.point, convex_points, sizeof(curve.point));
+	motor_calib_image_set(&image, 0, &curve);
+	motor_calib_image_set(&image, MOTOR_CALIB_MOTORS, &curve);
+	CHECK(image.valid_mask == 0x05, "mask %02X", image.valid_mask);
+	saved = image;
+	CHECK(motor_calib_restore(&image), "set image rejected");
+	CHECK(!memcmp(&image, &saved, sizeof(image)), "set image changed");
+	CHECK(!memcmp(image.curve[0].point, convex_points, sizeof(convex_points)) &&
+			(image.curve[2].start_duty == 200), "curves not kept");
+
+	motor_calib_image_set(&image, 0, NULL);
+	CHECK(image.valid_mask == 0x04, "mask %02X after a clear", image.valid_mask);
+	CHECK(motor_calib_restore(&image), "cleared image rejected");
+
+	/* Any flipped bit is caught by the checksum */
+	saved = image;
+	for (idx = 0; idx < sizeof(image) * 8; idx++) {
+		image = saved;
+		((uint8_t *)&image)[idx / 8] ^= (uint8_t)(1 << (idx % 8));
+		CHECK(!motor_calib_restore(&image), "bit %u flipped accepted", idx);
+		CHECK(image_empty(&image), "bit %u flipped: image not cleared", idx);
+	}
+
+	/* Erased flash */
+	memset(&image, 0xFF, sizeof(image));
+	CHECK(!motor_calib_restore(&image) && image_empty(&image), "erased image");
+
+	/* A sealed image of another version */
+	image = saved;
+	image.version = MOTOR_CALIB_VERSION + 1;
+	motor_calib_image_set(&image, 1, NULL);
+	CHECK(!motor_calib_restore(&image) && image_empty(&image), "version %u",
+			MOTOR_CALIB_VERSION + 1);
+
+	image = saved;
+	image.magic = (uint16_t)~MOTOR_CALIB_MAGIC;
+	motor_calib_image_set(&image, 1, NULL);
+	CHECK(!motor_calib_restore(&image) && image_empty(&image), "magic");
+
+	/* A sealed curve that fails the check, an image set does not check */
+	image = saved;
+	straight_curve(&curve, 200, 1000);
+	curve.point[3] = 0;
+	motor_calib_image_set(&image, 3, &curve);
+	CHECK(!motor_calib_restore(&image) && image_empty(&image), "falling curve");
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+
+	if (!check_verbose_arg(argc, argv, &verbose)) {
+		return 2;
+	}
+
+	check_tables(verbose);
+	check_messages();
+	check_image();
+
+	return check_report();
+}
@@ -0,0 +1,443 @@
+/**
+ * \file
+ *
+ * \brief Host check of the motor driver against stubbed PWM and GPIO registers
+ *
+ * Runs motor_drv.c and motor_ctrl.c on the host against the register and
+ * driver stubs in stubs/, through a timeline of levels set every TICK_MS:
+ *
+ *  - the PWM control word of a driven motor: enable, period, clock and the
+ *    duty in AGCDATA_IN, 0..1023, with level 1 at the minimum duty and
+ *    level 255 at 1023
+ *  - the pins of a braked and a coasting motor, and a zero control word
+ *  - only the motors whose output changed are written, and a duty change
+ *    only writes the register, never the pins
+ *  - after every driver call the H-bridge never sees its static input high
+ *    with the PWM input possibly low (reverse drive), and the PWM pin is
+ *    only muxed to the channel once its control word is written
+ *  - stop mode changes, calibration curves, and a resume after the
+ *    registers were lost in sleep
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -Istubs -I../src -I../src/config
+ *       -I../src/ASF/sam0/utils/cmsis/samb11/include -o motor_drv_check
+ *       motor_drv_check.c stubs/asf_stub.c ../src/motor_drv.c
+ *       ../src/motor_ctrl.c ../src/motor_calib.c
+ *   ./motor_drv_check [-v]
+ *
+ * Options:
+ *   -v  print the control words of the timeline
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <asf.h>
+#include "conf_motor.h"
+#include "motor_drv.h"
+#include "stubs/check.h"
+
+/* Firmware tick the application sets the motors at */
+#define TICK_MS                 (5)
+
+#define MOTORS                  (4)
+
+#define TIMELINE_MS             (2000)
+
+static const uint8_t pwm_pin[MOTORS] = {
+	CONF_MOTOR_PWM_PIN_0, CONF_MOTOR_PWM_PIN_1,
+	CONF_MOTOR_PWM_PIN_2, CONF_MOTOR_PWM_PIN_3
+};
+
+static const uint8_t static_pin[MOTORS] = {
+	CONF_MOTOR_STATIC_PIN_0, CONF_MOTOR_STATIC_PIN_1,
+	CONF_MOTOR_STATIC_PIN_2, CONF_MOTOR_STATIC_PIN_3
+};
+
+/* Fields of a PWM control word, from the component header layout */
+static uint16_t agcdata(uint32_t word)
+{
+	return (uint16_t)((word & LPMCU_MISC_REGS_PWM_1_CONTROL_AGCDATA_IN_Msk)
+			>> LPMCU_MISC_REGS_PWM_1_CONTROL_AGCDATA_IN_Pos);
+}
+
+static bool pwm_enabled(uint32_t word)
+{
+	return (word & LPMCU_MISC_REGS_PWM_1_CONTROL_PWM_EN) != 0;
+}
+
+static uint32_t pwm_word(uint8_t motor)
+{
+	return *(&stub_lpmcu_misc_regs.PWM_1_CONTROL.reg + motor);
+}
+
+static uint16_t megamux(uint8_t motor)
+{
+	return (uint16_t)(((MEGAMUX_PWM1_OUT + motor) << 8) | 1);
+}
+
+/* Duty of a level with the linear map, written out from motor_ctrl.h */
+static uint16_t expected_duty(uint8_t level)
+{
+	return (uint16_t)(CONF_MOTOR_MIN_DUTY + (level - 1)
+			* (MOTOR_CTRL_DUTY_MAX - CONF_MOTOR_MIN_DUTY) / 254);
+}
+
+/* Whether the PWM input of the bridge can be low: the pin carries the
+ * channel, or it is a GPIO driven low */
+static bool pwm_input_may_be_low(const stub_pin_t *pin, uint8_t motor)
+{
+	if (pin[pwm_pin[motor]].pinmux == megamux(motor)) {
+		return true;
+	}
+	return !pin[pwm_pin[motor]].level;
+}
+
+/* Replays the log of a driver call on a copy of the pins from before it */
+static void check_log(const char *what, const stub_pin_t *before)
+{
+	stub_pin_t pin[STUB_PINS];
+	unsigned idx;
+	uint8_t motor;
+
+	memcpy(pin, before, sizeof(pin));
+	CHECK(stub_log_count <= STUB_LOG_SIZE, "%s: %u calls", what, stub_log_count);
+
+	for (idx = 0; (idx < stub_log_count) && (idx < STUB_LOG_SIZE); idx++) {
+		const stub_event_t *event = &stub_log[idx];
+
+		if (event->target < STUB_PINS) {
+			if (event->call == STUB_CALL_PIN_LEVEL) {
+				pin[event->target].level = (event->value != 0);
+			} else if (event->call == STUB_CALL_PINMUX) {
+				pin[event->target].pinmux = event->value;
+			}
+		}
+
+		for (motor = 0; motor < MOTORS; motor++) {
+			if ((event->call == STUB_CALL_PINMUX) && (event->target == pwm_pin[motor]) &&
+					(event->value == megamux(motor))) {
+				CHECK(pwm_enabled(event->pwm_control[motor]),
+						"%s: motor %u muxed to a disabled channel", what, motor);
+			}
+			if (pin[static_pin[motor]].output && pin[pwm_pin[motor]].output) {
+				CHECK(!(pin[static_pin[motor]].level && pwm_input_may_be_low(pin, motor)),
+						"%s: motor %u reverse driven after call %u", what, motor, idx);
+			}
+		}
+	}
+}
+
+/* Registers and pins of a motor for its level */
+static void check_motor(const char *what, uint8_t motor, uint8_t level, uint16_t duty,
+		motor_stop_mode_t stop_mode)
+{
+	uint32_t word = pwm_word(motor);
+	const stub_pin_t *pwm = &stub_pin[pwm_pin[motor]];
+	const stub_pin_t *stat = &stub_pin[static_pin[motor]];
+
+	CHECK(pwm->output && stat->output, "%s: motor %u pins not outputs", what, motor);
+
+	if (level) {
+		uint32_t expected = LPMCU_MISC_REGS_PWM_1_CONTROL_PWM_EN |
+				LPMCU_MISC_REGS_PWM_1_CONTROL_SAMPLE_METHOD_0 |
+				LPMCU_MISC_REGS_PWM_1_CONTROL_PWM_PERIOD(CONF_MOTOR_PWM_PERIOD) |
+				LPMCU_MISC_REGS_PWM_1_CONTROL_CLOCK_SEL(CONF_MOTOR_PWM_CLOCK_SEL);
+
+		CHECK(agcdata(word) == duty, "%s: motor %u level %u duty %u, expected %u", what,
+				motor, level, agcdata(word), duty);
+		CHECK((word & ~LPMCU_MISC_REGS_PWM_1_CONTROL_AGCDATA_IN_Msk) == expected,
+				"%s: motor %u control word 0x%08lx", what, motor, (unsigned long)word);
+		CHECK(pwm->pinmux == megamux(motor), "%s: motor %u PWM pin mux 0x%04x", what,
+				motor, pwm->pinmux);
+		CHECK(!stat->level, "%s: motor %u static input high while driving", what, motor);
+	} else {
+		bool brake = (stop_mode == MOTOR_STOP_BRAKE);
+
+		CHECK(word == 0, "%s: motor %u stopped with control word 0x%08lx", what, motor,
+				(unsigned long)word);
+		CHECK(pwm->pinmux == 0, "%s: motor %u stopped with PWM pin mux 0x%04x", what,
+				motor, pwm->pinmux);
+		CHECK((pwm->level == brake) && (stat->level == brake),
+				"%s: motor %u stopped with inputs %d %d, %s", what, motor, pwm->level,
+				stat->level, brake ? "brake" : "coast");
+	}
+}
+
+/* Whether the log of the last call touched a pin of the motor */
+static bool pins_written(uint8_t motor)
+{
+	unsigned idx;
+
+	for (idx = 0; (idx < stub_log_count) && (idx < STUB_LOG_SIZE); idx++) {
+		if ((stub_log[idx].call != STUB_CALL_CLOCK_ENABLE) &&
+				((stub_log[idx].target == pwm_pin[motor]) ||
+				(stub_log[idx].target == static_pin[motor]))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Level of every motor at a time of the timeline */
+static uint8_t timeline_level(uint32_t t, uint8_t motor)
+{
+	switch (motor) {
+	case 0:
+		/* Ramp through every level and back to 0 */
+		return (uint8_t)((t / TICK_MS) % 256);
+	case 1:
+		/* Constant, set once */
+		return (t >= 100) ? 200 : 0;
+	case 2:
+		/* 50 ms pulses, every other one at level 1 */
+		if (((t / 50) % 2) == 0) {
+			return 0;
+		}
+		return (((t / 100) % 2) == 0) ? 1 : 255;
+	default:
+		/* Steps of two levels, a duty change on every tick */
+		return (uint8_t)(128 + ((t / TICK_MS) % 2) * 2);
+	}
+}
+
+static void check_timeline(bool verbose)
+{
+	uint8_t level[MOTORS] = {0};
+	uint8_t last[MOTORS] = {0};
+	stub_pin_t before[STUB_PINS];
+	uint32_t t;
+	uint8_t motor;
+
+	stub_reset();
+	motor_drv_init(MOTORS);
+
+	for (t = 0; t < TIMELINE_MS; t += TICK_MS) {
+		uint32_t words[MOTORS];
+		uint32_t sum = 0;
+
+		for (motor = 0; motor < MOTORS; motor++) {
+			words[motor] = pwm_word(motor);
+			level[motor] = timeline_level(t, motor);
+		}
+
+		memcpy(before, stub_pin, sizeof(before));
+		stub_log_clear();
+		motor_drv_set(level);
+		check_log("timeline", before);
+
+		for (motor = 0; motor < MOTORS; motor++) {
+			uint16_t duty = level[motor] ? expected_duty(level[motor]) : 0;
+
+			check_motor("timeline", motor, level[motor], duty, CONF_MOTOR_STOP_MODE);
+			sum += duty;
+
+			if (level[motor] == last[motor]) {
+				CHECK(!pins_written(motor) && (pwm_word(motor) == words[motor]),
+						"%lu ms: motor %u written without a change", (unsigned long)t, motor);
+			} else if (level[motor] && last[motor]) {
+				CHECK(!pins_written(motor), "%lu ms: motor %u pins written on a duty change",
+						(unsigned long)t, motor);
+			}
+		}
+		CHECK(motor_drv_duty_sum() == sum, "%lu ms: duty sum %lu, expected %lu",
+				(unsigned long)t, (unsigned long)motor_drv_duty_sum(), (unsigned long)sum);
+
+		if (verbose) {
+			printf("%5lu ms  %08lx %08lx %08lx %08lx\n", (unsigned long)t,
+					(unsigned long)pwm_word(0), (unsigned long)pwm_word(1),
+					(unsigned long)pwm_word(2), (unsigned long)pwm_word(3));
+		}
+		memcpy(last, level, sizeof(last));
+	}
+}
+
+static void check_duty_range(void)
+{
+	uint8_t level[MOTORS] = {1, 2, 254, 255};
+	uint16_t prev = 0;
+	uint16_t value;
+
+	stub_reset();
+	motor_drv_init(MOTORS);
+	motor_drv_set(level);
+
+	CHECK(agcdata(pwm_word(0)) == CONF_MOTOR_MIN_DUTY, "level 1 at duty %u", agcdata(pwm_word(0)));
+	CHECK(agcdata(pwm_word(3)) == MOTOR_CTRL_DUTY_MAX, "level 255 at duty %u", agcdata(pwm_word(3)));
+	CHECK(agcdata(pwm_word(1)) > agcdata(pwm_word(0)), "level 2 not above level 1");
+	CHECK(agcdata(pwm_word(3)) > agcdata(pwm_word(2)), "level 255 not above level 254");
+
+	/* Full scale fills the 10-bit field and leaves the clock selection */
+	CHECK(LPMCU_MISC_REGS_PWM_1_CONTROL_AGCDATA_IN(MOTOR_CTRL_DUTY_MAX) ==
+			LPMCU_MISC_REGS_PWM_1_CONTROL_AGCDATA_IN_Msk, "duty 1023 does not fill AGCDATA_IN");
+	CHECK(((pwm_word(3) & LPMCU_MISC_REGS_PWM_1_CONTROL_CLOCK_SEL_Msk)
+			>> LPMCU_MISC_REGS_PWM_1_CONTROL_CLOCK_SEL_Pos) == CONF_MOTOR_PWM_CLOCK_SEL,
+			"full duty changed the clock selection");
+
+	/* Every level on one motor: increasing, within the field */
+	for (value = 1; value < 256; value++) {
+		level[0] = (uint8_t)value;
+		motor_drv_set(level);
+		CHECK(agcdata(pwm_word(0)) == expected_duty((uint8_t)value), "level %u at duty %u",
+				value, agcdata(pwm_word(0)));
+		CHECK(agcdata(pwm_word(0)) >= prev, "level %u below level %u", value, value - 1);
+		prev = agcdata(pwm_word(0));
+	}
+}
+
+static void check_init(void)
+{
+	uint8_t level[MOTORS] = {0};
+	unsigned idx;
+	unsigned clocks = 0;
+	uint8_t motor;
+
+	/* Registers left running by a previous image */
+	stub_reset();
+	stub_lpmcu_misc_regs.PWM_3_CONTROL.reg = LPMCU_MISC_REGS_PWM_1_CONTROL_PWM_EN;
+	motor_drv_init(2);
+
+	for (idx = 0; idx < stub_log_count; idx++) {
+		if (stub_log[idx].call == STUB_CALL_CLOCK_ENABLE) {
+			CHECK(stub_log[idx].target == PERIPHERAL_PWM1 + clocks, "clock %u enabled",
+					stub_log[idx].target);
+			clocks++;
+		}
+	}
+	CHECK(clocks == 2, "%u clocks enabled for 2 motors", clocks);
+	for (motor = 0; motor < 2; motor++) {
+		check_motor("init", motor, 0, 0, CONF_MOTOR_STOP_MODE);
+	}
+	CHECK(!stub_pin[pwm_pin[2]].output && !stub_pin[static_pin[3]].output,
+			"pins of unused motors configured");
+
+	level[0] = 10;
+	level[2] = 10;
+	stub_log_clear();
+	motor_drv_set(level);
+	CHECK(pins_written(0) && !pins_written(2) && !pins_written(3), "unused motors written");
+	CHECK(pwm_word(2) == LPMCU_MISC_REGS_PWM_1_CONTROL_PWM_EN, "unused channel written");
+}
+
+static void check_stop_mode(void)
+{
+	uint8_t level[MOTORS] = {0, 80, 0, 0};
+	stub_pin_t before[STUB_PINS];
+	uint8_t motor;
+
+	stub_reset();
+	motor_drv_init(MOTORS);
+	motor_drv_set(level);
+
+	memcpy(before, stub_pin, sizeof(before));
+	stub_log_clear();
+	motor_drv_set_stop_mode(MOTOR_STOP_COAST);
+	check_log("coast", before);
+	CHECK(!pins_written(1), "driven motor written on a stop mode change");
+	for (motor = 0; motor < MOTORS; motor++) {
+		check_motor("coast", motor, level[motor], expected_duty(80), MOTOR_STOP_COAST);
+	}
+
+	/* Coast to drive to coast, and back to brake */
+	level[0] = 255;
+	memcpy(before, stub_pin, sizeof(before));
+	stub_log_clear();
+	motor_drv_set(level);
+	check_log("coast to drive", before);
+	check_motor("coast to drive", 0, 255, MOTOR_CTRL_DUTY_MAX, MOTOR_STOP_COAST);
+
+	level[0] = 0;
+	memcpy(before, stub_pin, sizeof(before));
+	stub_log_clear();
+	motor_drv_set(level);
+	check_log("drive to coast", before);
+	check_motor("drive to coast", 0, 0, 0, MOTOR_STOP_COAST);
+
+	memcpy(before, stub_pin, sizeof(before));
+	stub_log_clear();
+	motor_drv_set_stop_mode(MOTOR_STOP_BRAKE);
+	check_log("brake", before);
+	for (motor = 0; motor < MOTORS; motor++) {
+		check_motor("brake", motor, level[motor], expected_duty(80), MOTOR_STOP_BRAKE);
+	}
+}
+
+static void check_curve(void)
+{
+	motor_calib_curve_t curve;
+	uint8_t level[MOTORS] = {1, 1, 255, 0};
+	uint8_t idx;
+
+	stub_reset();
+	motor_drv_init(MOTORS);
+	motor_drv_set(level);
+
+	curve.start_duty = 200;
+	curve.sat_duty = 900;
+	for (idx = 0; idx < MOTOR_CALIB_POINTS; idx++) {
+		curve.point[idx] = (uint8_t)(idx * 17);
+	}
+
+	stub_log_clear();
+	motor_drv_set_curve(0, &curve);
+	CHECK(agcdata(pwm_word(0)) == 200, "calibrated level 1 at duty %u", agcdata(pwm_word(0)));
+	CHECK(agcdata(pwm_word(1)) == CONF_MOTOR_MIN_DUTY, "other motor recalibrated");
+	CHECK(!pins_written(0), "pins written on a calibration of a driven motor");
+
+	motor_drv_set_curve(2, &curve);
+	CHECK(agcdata(pwm_word(2)) == 900, "calibrated level 255 at duty %u", agcdata(pwm_word(2)));
+
+	/* A stopped motor keeps its pins, out of range motors are ignored */
+	stub_log_clear();
+	motor_drv_set_curve(3, &curve);
+	motor_drv_set_curve(MOTORS, &curve);
+	CHECK(stub_log_count == 0, "%u calls for a stopped or missing motor", stub_log_count);
+
+	motor_drv_set_curve(0, NULL);
+	CHECK(agcdata(pwm_word(0)) == CONF_MOTOR_MIN_DUTY, "linear map not restored");
+}
+
+static void check_resume(void)
+{
+	uint8_t level[MOTORS] = {0, 40, 255, 0};
+	stub_pin_t before[STUB_PINS];
+	uint8_t motor;
+
+	stub_reset();
+	motor_drv_init(MOTORS);
+	motor_drv_set(level);
+
+	/* Sleep loses the registers and the pin configuration */
+	stub_reset();
+	memcpy(before, stub_pin, sizeof(before));
+	motor_drv_resume();
+	check_log("resume", before);
+	for (motor = 0; motor < MOTORS; motor++) {
+		check_motor("resume", motor, level[motor], level[motor] ? expected_duty(level[motor]) : 0,
+				MOTOR_STOP_BRAKE);
+	}
+
+	/* Levels are kept: setting them again writes nothing */
+	stub_log_clear();
+	motor_drv_set(level);
+	CHECK(stub_log_count == 0, "%u calls after resume without a change", stub_log_count);
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+
+	if (!check_verbose_arg(argc, argv, &verbose)) {
+		return 2;
+	}
+
+	check_init();
+	check_duty_range();
+	check_timeline(verbose);
+	check_stop_mode();
+	check_curve();
+	check_resume();
+
+	return check_report();
+}
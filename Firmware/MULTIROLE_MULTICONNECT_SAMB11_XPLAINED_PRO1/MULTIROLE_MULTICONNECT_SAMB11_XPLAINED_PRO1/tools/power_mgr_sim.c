@@ -0,0 +1,441 @@
+/**
+ * \file
+ *
+ * \brief Scripted activity simulation of the power manager and the sleep tick
+ *
+ * Runs power_mgr.c and the tick of timer_hw.c on the host against the timer
+ * stubs in stubs/, with a model of the platform: while the tick runs its
+ * interrupt fires every CONF_TIMER_TICK_MS, while the MCU sleeps the AON
+ * sleep timer counts down at CONF_AON_SLEEP_CLK_HZ until it expires or a
+ * radio event wakes the MCU. The power task of haptic_app.c is followed on
+ * every wakeup: resume the tick, update the state, suspend for the next
+ * deadline. The script:
+ *
+ *   motors, work, quiet through the holdoff into SLEEP, a deadline closer
+ *   than POWER_MGR_MIN_SLEEP_MS at the wakeup, work ending just before a
+ *   deadline, 30 s of connection events every 30 ms, quiet without and
+ *   with deadlines beyond CONF_AON_SLEEP_MAX_MS, motors again
+ *
+ * Checked on every update and wakeup:
+ *
+ *  - the state against the rules in power_mgr.h, the holdoff announced by
+ *    power_mgr_next_event(), SLEEP entered when the holdoff ends and not
+ *    while a deadline is closer than POWER_MGR_MIN_SLEEP_MS
+ *  - the AON count programmed for the deadline, clamped to
+ *    CONF_AON_SLEEP_MAX_MS, and the tick stopped while suspended
+ *  - the millisecond clock after every resume: the ticks plus all sleep
+ *    clock counts converted at once, so the fraction carried from resume
+ *    to resume loses nothing, and within a few sleep clocks of real time
+ *  - the residency and entries of every state
+ *
+ * The script runs from time 0 and again with the millisecond clock wrapping
+ * during its connection events and its long sleeps.
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -Istubs -I../src -I../src/config
+ *       -I../src/ASF/thirdparty/wireless/ble_smart_sdk/services
+ *       -I../src/ASF/sam0/utils/cmsis/samb11/include -o power_mgr_sim
+ *       power_mgr_sim.c stubs/asf_stub.c ../src/power_mgr.c
+ *   ./power_mgr_sim [-v]
+ *
+ * Options:
+ *   -v  print the state changes and sleeps of the run from time 0
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "power_mgr.h"
+
+/* The tick's statics are part of what is checked */
+#include "timer_hw.c"
+#include "stubs/check.h"
+
+#define US_PER_MS               (1000ull)
+
+/* Script, real milliseconds from the start */
+#define MOTORS_END_MS           (300)
+#define BUSY_END_MS             (400)
+#define BUSY2_MS                (2500)
+#define BUSY2_END_MS            (2600)
+#define EVENTS_MS               (5000)
+#define EVENTS_END_MS           (35000)
+#define EVENT_INTERVAL_MS       (30)
+#define MOTORS2_MS              (410000)
+#define MOTORS2_END_MS          (410100)
+#define END_MS                  (411000)
+
+/* Deadlines of the application, local milliseconds from the start */
+static const uint32_t deadline[] = {2000, 2660, 400000};
+
+#define DEADLINES               (sizeof(deadline) / sizeof(deadline[0]))
+
+typedef struct sim {
+	uint32_t base_ms;
+	bool verbose;
+	power_mgr_t pm;
+	/* real time and the platform model */
+	uint64_t real_us;
+	uint64_t next_tick_us;
+	uint64_t sleep_us;
+	uint32_t sleep_count;
+	/* what the clock must add up to */
+	uint32_t ticks;
+	uint64_t sleep_clocks;
+	unsigned radio_wakes;
+	unsigned aon_wakes;
+	bool aon_wakeup;
+	unsigned suspends;
+	/* expected state machine */
+	bool quiet;
+	uint32_t quiet_ms;
+	uint32_t first_sleep_ms;
+	uint32_t refusals;
+	uint32_t entries[POWER_STATE_COUNT];
+} sim_t;
+
+static bool in_range(uint64_t t_us, uint32_t from_ms, uint32_t to_ms)
+{
+	return (t_us >= from_ms * US_PER_MS) && (t_us < to_ms * US_PER_MS);
+}
+
+static bool motors_at(uint64_t t_us)
+{
+	return in_range(t_us, 0, MOTORS_END_MS) || in_range(t_us, MOTORS2_MS, MOTORS2_END_MS);
+}
+
+static bool busy_at(uint64_t t_us)
+{
+	return in_range(t_us, MOTORS_END_MS, BUSY_END_MS) || in_range(t_us, BUSY2_MS, BUSY2_END_MS);
+}
+
+/* Next radio event after t_us that wakes the MCU: the connection events,
+ * and the messages that start the activity */
+static uint64_t next_radio_us(uint64_t t_us)
+{
+	static const uint32_t start[] = {BUSY2_MS, MOTORS2_MS};
+	uint64_t next = (uint64_t)END_MS * US_PER_MS;
+	unsigned idx;
+
+	if (t_us < (uint64_t)EVENTS_END_MS * US_PER_MS) {
+		uint64_t event = (uint64_t)EVENTS_MS * US_PER_MS;
+
+		if (t_us >= event) {
+			event += ((t_us - event) / (EVENT_INTERVAL_MS * US_PER_MS) + 1)
+					* EVENT_INTERVAL_MS * US_PER_MS;
+		}
+		next = event;
+	}
+	for (idx = 0; idx < sizeof(start) / sizeof(start[0]); idx++) {
+		if ((start[idx] * US_PER_MS > t_us) && (start[idx] * US_PER_MS < next)) {
+			next = start[idx] * US_PER_MS;
+		}
+	}
+	return next;
+}
+
+/* First deadline after now, as the application arms it */
+static bool next_deadline(const sim_t *sim, uint32_t now_ms, uint32_t *wake_ms)
+{
+	unsigned idx;
+
+	for (idx = 0; idx < DEADLINES; idx++) {
+		uint32_t when = sim->base_ms + deadline[idx];
+
+		if ((int32_t)(when - now_ms) > 0) {
+			*wake_ms = when;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* What the clock must read: every tick, and all sleep clocks converted at
+ * once */
+static uint32_t expected_ms(const sim_t *sim)
+{
+	return sim->base_ms + sim->ticks * CONF_TIMER_TICK_MS
+			+ (uint32_t)((sim->sleep_clocks * 1000) >> CONF_AON_SLEEP_CLK_BITS);
+}
+
+/* State from the rules in power_mgr.h */
+static power_state_t expected_state(sim_t *sim, uint32_t now_ms, bool motors, bool busy,
+		bool armed, uint32_t wake_ms)
+{
+	if (motors || busy) {
+		sim->quiet = false;
+		return motors ? POWER_ACTIVE : POWER_IDLE;
+	}
+	if (!sim->quiet) {
+		sim->quiet = true;
+		sim->quiet_ms = now_ms;
+	}
+	if (now_ms - sim->quiet_ms < POWER_MGR_SLEEP_HOLDOFF_MS) {
+		return POWER_IDLE;
+	}
+	if (armed && ((int32_t)(wake_ms - now_ms) < POWER_MGR_MIN_SLEEP_MS)) {
+		sim->refusals++;
+		return POWER_IDLE;
+	}
+	return POWER_SLEEP;
+}
+
+static void check_suspended(const sim_t *sim, uint32_t now_ms, bool armed, uint32_t wake_ms)
+{
+	uint32_t sleep_ms = armed ? (wake_ms - now_ms) : 0;
+	uint32_t count;
+
+	if ((sleep_ms == 0) || (sleep_ms > CONF_AON_SLEEP_MAX_MS)) {
+		sleep_ms = CONF_AON_SLEEP_MAX_MS;
+	}
+	count = (uint32_t)(((uint64_t)sleep_ms << CONF_AON_SLEEP_CLK_BITS) / 1000);
+
+	CHECK(!stub_timer.enabled, "base 0x%08lx, %lu ms: tick running while suspended",
+			(unsigned long)sim->base_ms, (unsigned long)(now_ms - sim->base_ms));
+	CHECK(AON_SLEEP_TIMER0->SINGLE_COUNT_DURATION.reg == count,
+			"base 0x%08lx, %lu ms: %lu sleep clocks for %lu ms", (unsigned long)sim->base_ms,
+			(unsigned long)(now_ms - sim->base_ms),
+			(unsigned long)AON_SLEEP_TIMER0->SINGLE_COUNT_DURATION.reg, (unsigned long)sleep_ms);
+	CHECK(AON_SLEEP_TIMER0->CONTROL.reg == AON_SLEEP_TIMER_CONTROL_SINGLE_COUNT_ENABLE,
+			"sleep timer control 0x%08lx", (unsigned long)AON_SLEEP_TIMER0->CONTROL.reg);
+	CHECK(count <= ((uint64_t)CONF_AON_SLEEP_MAX_MS << CONF_AON_SLEEP_CLK_BITS) / 1000,
+			"sleep count %lu beyond the longest suspend", (unsigned long)count);
+}
+
+/* The power task of haptic_app.c on a wakeup or a tick */
+static void power_task(sim_t *sim)
+{
+	uint32_t now_ms;
+	uint32_t wake_ms = 0;
+	uint32_t when_ms;
+	power_state_t previous = sim->pm.state;
+	power_state_t expected;
+	bool motors = motors_at(sim->real_us);
+	bool busy = busy_at(sim->real_us);
+	bool armed;
+
+	if (hw_tick_resume()) {
+		uint32_t real_ms = (uint32_t)(sim->real_us / US_PER_MS);
+
+		CHECK(hw_tick_get_ms() == expected_ms(sim), "base 0x%08lx: clock at %lu after %lu clocks, expected %lu",
+				(unsigned long)sim->base_ms, (unsigned long)(hw_tick_get_ms() - sim->base_ms),
+				(unsigned long)sim->sleep_clocks, (unsigned long)(expected_ms(sim) - sim->base_ms));
+		/* Behind real time by the partial sleep clocks of the radio wakes */
+		CHECK((real_ms - (hw_tick_get_ms() - sim->base_ms)) <=
+				1 + (sim->radio_wakes * 1000 >> CONF_AON_SLEEP_CLK_BITS) + 1,
+				"base 0x%08lx: clock at %lu ms, real %lu ms", (unsigned long)sim->base_ms,
+				(unsigned long)(hw_tick_get_ms() - sim->base_ms), (unsigned long)real_ms);
+		CHECK(stub_timer.enabled && (AON_SLEEP_TIMER0->CONTROL.reg == 0),
+				"tick not restarted, sleep timer control 0x%08lx",
+				(unsigned long)AON_SLEEP_TIMER0->CONTROL.reg);
+		sim->next_tick_us = sim->real_us + CONF_TIMER_TICK_MS * US_PER_MS;
+	}
+	CHECK(stub_timer.enabled, "base 0x%08lx: power task without the tick", (unsigned long)sim->base_ms);
+
+	now_ms = hw_tick_get_ms();
+	armed = next_deadline(sim, now_ms, &wake_ms);
+	expected = expected_state(sim, now_ms, motors, busy, armed, wake_ms);
+
+	power_mgr_update(&sim->pm, now_ms, motors, busy, armed, wake_ms);
+	CHECK(sim->pm.state == expected, "base 0x%08lx, %lu ms: state %d, expected %d",
+			(unsigned long)sim->base_ms, (unsigned long)(now_ms - sim->base_ms), sim->pm.state,
+			expected);
+
+	if (sim->pm.state != previous) {
+		sim->entries[sim->pm.state]++;
+		if ((sim->pm.state == POWER_SLEEP) && (sim->first_sleep_ms == 0)) {
+			sim->first_sleep_ms = now_ms - sim->base_ms;
+		}
+		if (sim->verbose) {
+			printf("%8lu ms  state %d -> %d\n", (unsigned long)(now_ms - sim->base_ms),
+					previous, sim->pm.state);
+		}
+	}
+
+	/* The holdoff is announced while it runs */
+	if ((sim->pm.state == POWER_IDLE) && sim->quiet) {
+		CHECK(power_mgr_next_event(&sim->pm, &when_ms) &&
+				(when_ms == sim->quiet_ms + POWER_MGR_SLEEP_HOLDOFF_MS),
+				"base 0x%08lx, %lu ms: holdoff end not announced", (unsigned long)sim->base_ms,
+				(unsigned long)(now_ms - sim->base_ms));
+	} else {
+		CHECK(!power_mgr_next_event(&sim->pm, &when_ms), "base 0x%08lx, %lu ms: event announced in state %d",
+				(unsigned long)sim->base_ms, (unsigned long)(now_ms - sim->base_ms), sim->pm.state);
+	}
+
+	if (sim->pm.state == POWER_SLEEP) {
+		hw_tick_suspend(armed ? (wake_ms - now_ms) : 0);
+		check_suspended(sim, now_ms, armed, wake_ms);
+		sim->sleep_us = sim->real_us;
+		sim->sleep_count = AON_SLEEP_TIMER0->SINGLE_COUNT_DURATION.reg;
+		sim->suspends++;
+		/* not the sleeps between connection events */
+		if (sim->verbose && ((previous != POWER_SLEEP) || sim->aon_wakeup)) {
+			printf("%8lu ms  suspend for %lu ms\n", (unsigned long)(now_ms - sim->base_ms),
+					(unsigned long)(armed ? wake_ms - now_ms : 0));
+		}
+	}
+}
+
+/* Sleep until the sleep timer expires or a radio event comes first */
+static void sleep_until_wakeup(sim_t *sim)
+{
+	uint64_t expiry_us = sim->sleep_us
+			+ (((uint64_t)sim->sleep_count * 1000000) + CONF_AON_SLEEP_CLK_HZ - 1)
+			/ CONF_AON_SLEEP_CLK_HZ;
+	uint64_t radio_us = next_radio_us(sim->sleep_us);
+	uint32_t clocks;
+
+	if (expiry_us <= radio_us) {
+		clocks = sim->sleep_count;
+		sim->real_us = expiry_us;
+		sim->aon_wakeup = true;
+		sim->aon_wakes++;
+		hw_tick_aon_handler();
+		CHECK(AON_SLEEP_TIMER0->CONTROL.reg & AON_SLEEP_TIMER_CONTROL_IRQ_CLEAR,
+				"sleep timer interrupt not cleared");
+	} else {
+		clocks = (uint32_t)(((radio_us - sim->sleep_us) * CONF_AON_SLEEP_CLK_HZ) / 1000000);
+		sim->real_us = radio_us;
+		sim->radio_wakes++;
+		sim->aon_wakeup = false;
+	}
+	/* The counter counts down from the programmed duration */
+	*(volatile uint32_t *)&AON_SLEEP_TIMER0->CURRENT_COUNT_VALUE.reg = sim->sleep_count - clocks;
+	sim->sleep_clocks += clocks;
+}
+
+static void run(uint32_t base_ms, bool verbose)
+{
+	uint32_t residency[POWER_STATE_COUNT];
+	uint8_t record[POWER_MGR_RECORD_SIZE];
+	uint32_t total = 0;
+	unsigned plf_msgs;
+	sim_t sim;
+	uint8_t state;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.base_ms = base_ms;
+	sim.verbose = verbose;
+	sim.entries[POWER_ACTIVE] = 1;
+
+	stub_reset();
+	hw_tick_ms = base_ms;
+	hw_tick_suspended = false;
+	hw_tick_sleep_frac = 0;
+	hw_tick_init(NULL);
+	CHECK(stub_aon_isr && stub_timer.enabled, "tick not started");
+	CHECK(!hw_tick_resume(), "resumed without a suspend");
+	power_mgr_init(&sim.pm, hw_tick_get_ms());
+	sim.next_tick_us = CONF_TIMER_TICK_MS * US_PER_MS;
+
+	while (sim.real_us < (uint64_t)END_MS * US_PER_MS) {
+		if (stub_timer.enabled) {
+			sim.real_us = sim.next_tick_us;
+			sim.next_tick_us += CONF_TIMER_TICK_MS * US_PER_MS;
+			stub_timer.callback();
+			sim.ticks++;
+		} else if (sim.sleep_count == 0) {
+			/* would wake at once, forever */
+			CHECK(false, "base 0x%08lx: suspended without a sleep count", (unsigned long)base_ms);
+			break;
+		} else {
+			sleep_until_wakeup(&sim);
+		}
+		power_task(&sim);
+	}
+
+	/* Quiet after the work at 400 ms, asleep once the holdoff is over */
+	CHECK(sim.first_sleep_ms == BUSY_END_MS + POWER_MGR_SLEEP_HOLDOFF_MS, "base 0x%08lx: first sleep at %lu ms",
+			(unsigned long)base_ms, (unsigned long)sim.first_sleep_ms);
+	/* Woken just before the 2000 ms deadline, and the holdoff of the work at
+	 * 2600 ms ending 10 ms before the 2660 ms one */
+	CHECK(sim.refusals >= 3, "base 0x%08lx: %lu sleeps refused for a close deadline",
+			(unsigned long)base_ms, (unsigned long)sim.refusals);
+	CHECK(sim.aon_wakes >= 4, "base 0x%08lx: %u sleep timer wakeups", (unsigned long)base_ms, sim.aon_wakes);
+	CHECK(sim.radio_wakes >= (EVENTS_END_MS - EVENTS_MS) / EVENT_INTERVAL_MS,
+			"base 0x%08lx: %u radio wakeups", (unsigned long)base_ms, sim.radio_wakes);
+
+	/* The wakeup messages of the sleep timer */
+	plf_msgs = stub_plf_int_msgs;
+	CHECK(plf_msgs == sim.aon_wakes, "%u wakeup messages for %u sleep timer wakeups", plf_msgs,
+			sim.aon_wakes);
+
+	power_mgr_residency(&sim.pm, hw_tick_get_ms(), residency);
+	for (state = 0; state < POWER_STATE_COUNT; state++) {
+		total += residency[state];
+		CHECK(sim.pm.entries[state] == sim.entries[state], "base 0x%08lx: %u entries into %u, expected %lu",
+				(unsigned long)base_ms, sim.pm.entries[state], state, (unsigned long)sim.entries[state]);
+	}
+	CHECK(total == hw_tick_get_ms() - base_ms, "base 0x%08lx: residency %lu ms of %lu",
+			(unsigned long)base_ms, (unsigned long)total, (unsigned long)(hw_tick_get_ms() - base_ms));
+	CHECK(residency[POWER_SLEEP] > (END_MS - 2000) * 99ull / 100, "base 0x%08lx: %lu ms asleep",
+			(unsigned long)base_ms, (unsigned long)residency[POWER_SLEEP]);
+
+	CHECK(power_mgr_encode(&sim.pm, hw_tick_get_ms(), record, sizeof(record) - 1) == 0,
+			"record written to a short buffer");
+	CHECK(power_mgr_encode(&sim.pm, hw_tick_get_ms(), record, sizeof(record)) == POWER_MGR_RECORD_SIZE,
+			"record not written");
+	CHECK((record[0] == POWER_MGR_RECORD) && (record[1] == sim.pm.state), "record header %u %u",
+			record[0], record[1]);
+	for (state = 0; state < POWER_STATE_COUNT; state++) {
+		const uint8_t *field = &record[2 + state * 6];
+		uint32_t ms = field[0] | (field[1] << 8) | ((uint32_t)field[2] << 16) | ((uint32_t)field[3] << 24);
+
+		CHECK((ms == residency[state]) && ((field[4] | (field[5] << 8)) == sim.pm.entries[state]),
+				"record of state %u", state);
+	}
+
+	if (verbose) {
+		printf("clock %lu ms, real %lu ms, %u suspends, %u radio and %u timer wakeups\n",
+				(unsigned long)(hw_tick_get_ms() - base_ms), (unsigned long)(sim.real_us / US_PER_MS),
+				sim.suspends, sim.radio_wakes, sim.aon_wakes);
+		printf("residency ms: active %lu, idle %lu, sleep %lu\n", (unsigned long)residency[0],
+				(unsigned long)residency[1], (unsigned long)residency[2]);
+	}
+}
+
+/* The count of a sleep of each length, around the longest one */
+static void check_clamp(void)
+{
+	static const uint32_t sleep_ms[] = {0, 1, 20, 999, 1000, 65000, CONF_AON_SLEEP_MAX_MS - 1,
+			CONF_AON_SLEEP_MAX_MS, CONF_AON_SLEEP_MAX_MS + 1, 0x7FFFFFFF, 0xFFFFFFFF};
+	unsigned idx;
+
+	for (idx = 0; idx < sizeof(sleep_ms) / sizeof(sleep_ms[0]); idx++) {
+		uint32_t ms = sleep_ms[idx];
+		uint32_t expected;
+
+		stub_reset();
+		hw_tick_suspended = false;
+		hw_tick_init(NULL);
+		hw_tick_suspend(ms);
+		if ((ms == 0) || (ms > CONF_AON_SLEEP_MAX_MS)) {
+			ms = CONF_AON_SLEEP_MAX_MS;
+		}
+		expected = (uint32_t)(((uint64_t)ms * CONF_AON_SLEEP_CLK_HZ) / 1000);
+		CHECK(AON_SLEEP_TIMER0->SINGLE_COUNT_DURATION.reg == expected, "suspend(%lu): %lu clocks, expected %lu",
+				(unsigned long)sleep_ms[idx], (unsigned long)AON_SLEEP_TIMER0->SINGLE_COUNT_DURATION.reg,
+				(unsigned long)expected);
+		hw_tick_resume();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+
+	if (!check_verbose_arg(argc, argv, &verbose)) {
+		return 2;
+	}
+
+	check_clamp();
+	run(0, verbose);
+	/* Wrapping in the connection events, and in the long sleeps */
+	run((uint32_t)(0 - 20000), false);
+	run((uint32_t)(0 - 200000), false);
+	run((uint32_t)(0 - 335001), false);
+
+	return check_report();
+}
@@ -0,0 +1,807 @@
+/**
+ * \file
+ *
+ * \brief Host simulation of the Perception central against a virtual reporter
+ *
+ * Runs pxp_monitor.c and ble_manager.c unchanged on the host. The BLE stack
+ * and the platform timer are the stubs in stubs/ble_stub.c, which answer
+ * every request with the events the stack would send on a virtual clock and
+ * play a Perception reporter that advertises, bonds, streams the haptic
+ * timeline and changes its attribute table when told. The main loop of
+ * multirole_multiconnect.c is followed: the BLE event task, the trace drain
+ * over the diagnostics characteristic and the connection timeout and scan
+ * backoff on the timer.
+ *
+ * Scenarios, each a script of timed actions:
+ *
+ *  - first connection: one discovery, Service Changed indications and the
+ *    timeline notifications enabled, bonded, the timeline flowing, the
+ *    trace reaching the reporter, the closer non-Perception advertiser
+ *    never connected to
+ *  - bonded reconnection after a link loss: no discovery, the cached
+ *    handles used, set up in well under half the first connection's time
+ *  - the reporter adds a Battery service while away: the cached CCCD write
+ *    is rejected and one rediscovery follows
+ *  - the reporter adds a characteristic before the timeline while away:
+ *    the cached CCCD write lands on the wrong characteristic and succeeds,
+ *    the Service Changed indication after encryption brings one
+ *    rediscovery and the timeline CCCD is written at its new handle
+ *  - the cached CCCD write call fails: one rediscovery
+ *  - the first discovery call fails: discovered once bonded
+ *  - the reporter away for a minute: the scans back off and it is
+ *    reconnected within the longest backoff of its return
+ *  - a link loss at every event of the first connection's setup, and of
+ *    the setup of the reconnection to a changed table
+ *
+ * Checked in every scenario: the timeline sequence numbers never repeat or
+ * go back, no discovery is started while another is queued, and the
+ * timeline flows at the end.
+ *
+ * Each scenario runs in its own process, the sources keep their state in
+ * statics. The event structures fit BLE_EVENT_PARAM_MAX_SIZE with the
+ * short enums of the target ABI, hence -fshort-enums. Handler timing is
+ * the host time ble_event_task() spends on each event after the stub
+ * delivered it.
+ *
+ * Build and run on the host:
+ *
+ *   SDK=../src/ASF/thirdparty/wireless/ble_smart_sdk
+ *   cc -std=c99 -fshort-enums -DSTUB_CONSOLE -DIMMEDIATE_ALERT_SERVICE
+ *       -DTX_POWER_SERVICE -DIAS_GATT_CLIENT -DPROXIMITY_MONITOR
+ *       -DBATTERY_SERVICE -DLINK_LOSS_SERVICE -DTXPS_GATT_CLIENT
+ *       -DLLS_GATT_CLIENT -DBLE_DEVICE_ROLE=BLE_ROLE_ALL -Istubs -I../src
+ *       -I../src/config -I$SDK/inc -I$SDK/ble_services/ble_mgr
+ *       -I$SDK/ble_profiles/pxp_monitor
+ *       -I$SDK/ble_services/tx_power -I$SDK/ble_services/link_loss
+ *       -I$SDK/ble_services/immediate_alert -I$SDK/services -I$SDK/utils
+ *       -I../src/ASF/sam0/utils/cmsis/samb11/include -o pxp_sim pxp_sim.c
+ *       stubs/ble_stub.c stubs/asf_stub.c
+ *       $SDK/ble_services/ble_mgr/ble_manager.c
+ *       $SDK/ble_profiles/pxp_monitor/pxp_monitor.c ../src/gatt_cache.c
+ *       ../src/adv_parse.c ../src/scan_sched.c ../src/trace_ring.c
+ *   ./pxp_sim [-v] [-s script]
+ *
+ * Options:
+ *   -v         print the console, the events and the handler timing
+ *   -s script  replay a script instead of the scenarios, one action a line:
+ *
+ *     <ms> advertise on|off     the reporter advertises or stops
+ *     <ms> layout base|battery|levels
+ *     <ms> loss [<events>]      lose the link now or after more events
+ *     <ms> fail <call> <status> fail the next call, <call> as in ble_stub.h
+ *                               without BLE_STUB_CALL_, e.g. write 0x01
+ *     <ms> expect flowing       the timeline reaches the central
+ *     <ms> end
+ *
+ *   Lines starting with # are comments.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+/* Before asf.h maps printf to the console of the sources */
+#include "stubs/check.h"
+#include <asf.h>
+#include "ble_stub.h"
+#include "ble_manager.h"
+#include "pxp_monitor.h"
+#include "trace_ring.h"
+
+/* The simulation's own output */
+#undef printf
+
+#define US_PER_MS                       (1000ull)
+
+/* Events a scenario may take, a loop in the central stops it */
+#define SIM_EVENTS_MAX                  (200000)
+
+/* Link loss sweep, past the events of a connection setup */
+#define SIM_SWEEP_EVENTS                (100)
+
+/* The timeline is flowing when one arrived in the last notify periods */
+#define SIM_FLOWING_US                  (3 * BLE_STUB_NOTIFY_PERIOD_US)
+
+#define SIM_ACTIONS                     (128)
+
+#define SIM_TIMED_EVENTS                (24)
+
+/* Trace packets sent per main loop pass, APP_TRACE_DRAIN_PACKETS */
+#define SIM_TRACE_DRAIN_PACKETS         (4)
+
+extern gatt_perception_char_handler_t perception_handle;
+extern volatile uint8_t pxp_connect_request_flag;
+extern ble_connected_dev_info_t ble_dev_info[BLE_MAX_DEVICE_CONNECTED];
+
+typedef enum {
+	ACT_ADVERTISE,
+	ACT_LAYOUT,
+	ACT_LOSS,
+	ACT_FAIL,
+	ACT_EXPECT_FLOWING,
+	ACT_END
+} act_t;
+
+typedef struct action {
+	uint32_t ms;
+	act_t act;
+	int arg;
+	int arg2;
+} action_t;
+
+typedef struct timed {
+	at_ble_events_t event;
+	unsigned count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+} timed_t;
+
+typedef struct sim {
+	bool verbose;
+	const char *name;
+	/* link loss once this many events were delivered, 0 for none */
+	unsigned loss_at;
+	/* the timer of the main loop expired */
+	bool app_timer_done;
+	/* connection setup, from the connected event to the first timeline */
+	uint64_t connected_us;
+	bool setting_up;
+	uint64_t first_setup_us;
+	uint64_t last_setup_us;
+	unsigned setup_events;
+	unsigned setups;
+	/* timelines at the central */
+	uint32_t last_seq;
+	unsigned timelines;
+	unsigned seq_errors;
+	uint64_t last_timeline_us;
+	/* handler timing */
+	bool timing;
+	at_ble_events_t event;
+	struct timespec start;
+	timed_t timed[SIM_TIMED_EVENTS];
+	unsigned timed_events;
+} sim_t;
+
+static sim_t sim;
+
+typedef struct scenario {
+	const char *name;
+	const action_t *action;
+	void (*check)(void);
+} scenario_t;
+
+/*- Platform ---------------------------------------------------------------*/
+int stub_console_printf(const char *format, ...)
+{
+	va_list args;
+	int n = 0;
+
+	if (sim.verbose) {
+		va_start(args, format);
+		n = vprintf(format, args);
+		va_end(args);
+	}
+	return n;
+}
+
+static uint32_t sim_clock(void)
+{
+	return (uint32_t)ble_stub.now_us;
+}
+
+/* hw_timer_start() counts seconds */
+static void sim_timer_start(uint32_t delay)
+{
+	if (delay == 0) {
+		delay = 1;
+	}
+	ble_stub_timer_start(delay * 1000000ull);
+}
+
+static void sim_timer_stop(void)
+{
+	ble_stub_timer_stop();
+}
+
+/* timer_callback_handler() */
+static void sim_timer_expired(void)
+{
+	sim_timer_stop();
+	sim.app_timer_done = true;
+}
+
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000ull +
+			(uint64_t)now.tv_nsec - (uint64_t)start->tv_nsec;
+}
+
+static void sim_delivered(at_ble_events_t event, const void *params)
+{
+	UNUSED(params);
+	if (sim.verbose) {
+		printf("\r\n%10.3f ms  %s", (double)ble_stub.now_us / US_PER_MS,
+				ble_stub_event_name(event));
+	}
+	if (event == AT_BLE_CONNECTED) {
+		sim.connected_us = ble_stub.now_us;
+		sim.setting_up = true;
+		sim.setup_events = ble_stub.events;
+	}
+	if ((sim.loss_at != 0) && (ble_stub.events + 1 >= sim.loss_at)) {
+		sim.loss_at = 0;
+		if (sim.verbose) {
+			printf("\r\n%10.3f ms  link lost", (double)ble_stub.now_us / US_PER_MS);
+		}
+		ble_stub_link_loss();
+	}
+	sim.event = event;
+	sim.timing = true;
+	clock_gettime(CLOCK_MONOTONIC, &sim.start);
+}
+
+static void sim_timed(void)
+{
+	uint64_t ns;
+	unsigned idx;
+
+	if (!sim.timing) {
+		return;
+	}
+	ns = elapsed_ns(&sim.start);
+	sim.timing = false;
+	for (idx = 0; idx < sim.timed_events; idx++) {
+		if (sim.timed[idx].event == sim.event) {
+			break;
+		}
+	}
+	if (idx == sim.timed_events) {
+		if (idx == SIM_TIMED_EVENTS) {
+			return;
+		}
+		sim.timed[idx].event = sim.event;
+		sim.timed_events++;
+	}
+	sim.timed[idx].count++;
+	sim.timed[idx].total_ns += ns;
+	if (ns > sim.timed[idx].max_ns) {
+		sim.timed[idx].max_ns = ns;
+	}
+}
+
+static void sim_timeline(const uint8_t *value, uint16_t len)
+{
+	uint32_t seq;
+
+	CHECK(len == 4, "timeline of %u bytes", (unsigned)len);
+	if (len < 4) {
+		return;
+	}
+	seq = (uint32_t)value[0] | ((uint32_t)value[1] << 8) |
+			((uint32_t)value[2] << 16) | ((uint32_t)value[3] << 24);
+	if ((sim.timelines > 0) && (seq <= sim.last_seq)) {
+		sim.seq_errors++;
+	}
+	sim.last_seq = seq;
+	sim.timelines++;
+	sim.last_timeline_us = ble_stub.now_us;
+	if (sim.setting_up) {
+		sim.setting_up = false;
+		sim.last_setup_us = ble_stub.now_us - sim.connected_us;
+		if (sim.setups++ == 0) {
+			sim.first_setup_us = sim.last_setup_us;
+		}
+		sim.setup_events = ble_stub.events - sim.setup_events;
+	}
+}
+
+/*- Main loop --------------------------------------------------------------*/
+/* app_trace_task() */
+static void sim_trace_task(void)
+{
+	uint8_t packet[TRACE_PACKET_SIZE];
+	uint8_t records;
+	uint8_t idx;
+
+	for (idx = 0; idx < SIM_TRACE_DRAIN_PACKETS; idx++) {
+		records = trace_ring_encode(packet, sizeof(packet));
+		if (records == 0) {
+			break;
+		}
+		if (pxp_monitor_diag_write(packet, TRACE_PACKET_LEN(records)) != AT_BLE_SUCCESS) {
+			break;
+		}
+		trace_ring_consume(records);
+	}
+}
+
+/* The application task of main() */
+static void sim_app_task(void)
+{
+	at_ble_disconnected_t fail;
+
+	if (!sim.app_timer_done) {
+		return;
+	}
+	if (pxp_connect_request_flag == PXP_DEV_CONNECTING) {
+		fail.reason = AT_BLE_TERMINATED_BY_USER;
+		fail.handle = ble_dev_info[0].conn_info.handle;
+		pxp_connect_request_flag = PXP_DEV_UNCONNECTED;
+		if (at_ble_connect_cancel() == AT_BLE_SUCCESS) {
+			pxp_disconnect_event_handler(&fail);
+		}
+	} else if (pxp_connect_request_flag == PXP_DEV_SCAN_BACKOFF) {
+		pxp_monitor_start_scan();
+	}
+	sim.app_timer_done = false;
+}
+
+static void sim_start(const char *name, bool verbose)
+{
+	memset(&sim, 0, sizeof(sim));
+	sim.name = name;
+	sim.verbose = verbose;
+	stub_reset();
+	ble_stub_reset();
+	ble_stub.delivered = sim_delivered;
+	ble_stub.timer_expired = sim_timer_expired;
+
+	trace_ring_init(sim_clock);
+	ble_device_init(NULL);
+	pxp_monitor_init(NULL);
+	register_haptic_timeline_cb(sim_timeline);
+	pxp_monitor_auto_scan();
+	register_hw_timer_start_func_cb(sim_timer_start);
+	register_hw_timer_stop_func_cb(sim_timer_stop);
+}
+
+static void sim_run(uint64_t until_us)
+{
+	ble_stub.until_us = until_us;
+	while ((ble_stub.now_us < until_us) && (ble_stub.events < SIM_EVENTS_MAX)) {
+		ble_event_task(BLE_EVENT_TIMEOUT);
+		sim_timed();
+		sim_trace_task();
+		sim_app_task();
+	}
+	CHECK(ble_stub.events < SIM_EVENTS_MAX, "%s: %u events by %lu ms", sim.name,
+			ble_stub.events, (unsigned long)(ble_stub.now_us / US_PER_MS));
+}
+
+static bool sim_flowing(void)
+{
+	return ((perception_handle.handles_state == PXP_HANDLES_DISCOVERED) ||
+			(perception_handle.handles_state == PXP_HANDLES_CACHED)) &&
+			(sim.timelines > 0) &&
+			(sim.last_timeline_us + SIM_FLOWING_US >= ble_stub.now_us);
+}
+
+static void sim_act(const action_t *action)
+{
+	switch (action->act) {
+	case ACT_ADVERTISE:
+		ble_stub_advertise(action->arg != 0);
+		break;
+	case ACT_LAYOUT:
+		ble_stub_layout((ble_stub_layout_t)action->arg);
+		break;
+	case ACT_LOSS:
+		if (action->arg == 0) {
+			ble_stub_link_loss();
+		} else {
+			sim.loss_at = ble_stub.events + (unsigned)action->arg;
+		}
+		break;
+	case ACT_FAIL:
+		ble_stub_fail((ble_stub_call_t)action->arg, (at_ble_status_t)action->arg2);
+		break;
+	case ACT_EXPECT_FLOWING:
+		CHECK(sim_flowing(), "%s: timeline not flowing at %lu ms, last at %lu ms",
+				sim.name, (unsigned long)action->ms,
+				(unsigned long)(sim.last_timeline_us / US_PER_MS));
+		break;
+	case ACT_END:
+		break;
+	}
+}
+
+static void sim_print(void)
+{
+	unsigned idx;
+
+	printf("%s: %u connections, %u discoveries, %u indications, %u timelines, "
+			"%u trace packets, setup %lu ms\n", sim.name,
+			ble_stub_reporter.connections, ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER],
+			ble_stub_reporter.indications, sim.timelines, ble_stub_reporter.trace_packets,
+			(unsigned long)(sim.last_setup_us / US_PER_MS));
+	for (idx = 0; idx < sim.timed_events; idx++) {
+		printf("  %-26s %6u events, mean %6lu ns, max %8lu ns\n",
+				ble_stub_event_name(sim.timed[idx].event), sim.timed[idx].count,
+				(unsigned long)(sim.timed[idx].total_ns / sim.timed[idx].count),
+				(unsigned long)sim.timed[idx].max_ns);
+	}
+}
+
+/* Runs the actions of a scenario and the checks every scenario gets */
+static void sim_script(const action_t *action)
+{
+	for (; ; action++) {
+		sim_run(action->ms * US_PER_MS);
+		sim_act(action);
+		if (action->act == ACT_END) {
+			break;
+		}
+	}
+	CHECK(sim.seq_errors == 0, "%s: %u timelines out of sequence", sim.name,
+			sim.seq_errors);
+	CHECK(ble_stub.discovery_overlaps == 0, "%s: %u discoveries started while "
+			"one was queued", sim.name, ble_stub.discovery_overlaps);
+	CHECK(sim_flowing(), "%s: timeline not flowing at the end", sim.name);
+}
+
+/*- Scenarios --------------------------------------------------------------*/
+#define AWAY(ms)                                                        \
+	{(ms), ACT_ADVERTISE, 0, 0},                                        \
+	{(ms), ACT_LOSS, 0, 0}
+
+static const action_t first_actions[] = {
+	{5000, ACT_EXPECT_FLOWING, 0, 0},
+	{5000, ACT_END, 0, 0}
+};
+
+static void first_check(void)
+{
+	CHECK(ble_stub.calls[BLE_STUB_CALL_CONNECT] == 1, "first: %u connects",
+			ble_stub.calls[BLE_STUB_CALL_CONNECT]);
+	CHECK(ble_stub_reporter.connections == 1, "first: %u connections",
+			ble_stub_reporter.connections);
+	CHECK(ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER] == 1, "first: %u discoveries",
+			ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER]);
+	CHECK(ble_stub_reporter.bonded, "first: not bonded");
+	CHECK(ble_stub.mtu == BLE_STUB_MTU, "first: MTU %u", ble_stub.mtu);
+	CHECK(ble_stub_cccd(SERVICE_CHANGED_CHAR_UUID) == PXP_CCCD_INDICATE,
+			"first: Service Changed CCCD %04X", ble_stub_cccd(SERVICE_CHANGED_CHAR_UUID));
+	CHECK(ble_stub_cccd(HAPTIC_TIMELINE_CHAR_UUID) == PERCEPTION_CCCD_NOTIFY,
+			"first: timeline CCCD %04X", ble_stub_cccd(HAPTIC_TIMELINE_CHAR_UUID));
+	CHECK(perception_handle.timeline_cccd_handle ==
+			ble_stub_handle(HAPTIC_TIMELINE_CHAR_UUID, BLE_STUB_CCCD),
+			"first: timeline CCCD handle %u", perception_handle.timeline_cccd_handle);
+	CHECK(ble_stub_reporter.trace_packets > 0, "first: no trace packets");
+	CHECK(sim.setups == 1, "first: %u setups", sim.setups);
+	CHECK(sim.setup_events < SIM_SWEEP_EVENTS, "first: setup takes %u events, "
+			"the sweep %u", sim.setup_events, SIM_SWEEP_EVENTS);
+}
+
+static const action_t reconnect_actions[] = {
+	{5000, ACT_LOSS, 0, 0},
+	{10000, ACT_EXPECT_FLOWING, 0, 0},
+	{10000, ACT_END, 0, 0}
+};
+
+static void reconnect_check(void)
+{
+	CHECK(ble_stub_reporter.connections == 2, "reconnect: %u connections",
+			ble_stub_reporter.connections);
+	CHECK(ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER] == 1,
+			"reconnect: %u discoveries", ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER]);
+	CHECK(perception_handle.handles_state == PXP_HANDLES_CACHED,
+			"reconnect: handles state %u", perception_handle.handles_state);
+	CHECK(sim.last_setup_us * 2 < sim.first_setup_us, "reconnect: setup %lu us, "
+			"first %lu us", (unsigned long)sim.last_setup_us,
+			(unsigned long)sim.first_setup_us);
+}
+
+static const action_t battery_actions[] = {
+	AWAY(5000),
+	{7000, ACT_LAYOUT, BLE_STUB_LAYOUT_BATTERY, 0},
+	{8000, ACT_ADVERTISE, 1, 0},
+	{15000, ACT_EXPECT_FLOWING, 0, 0},
+	{15000, ACT_END, 0, 0}
+};
+
+static void layout_check(void)
+{
+	CHECK(ble_stub_reporter.connections == 2, "%s: %u connections", sim.name,
+			ble_stub_reporter.connections);
+	CHECK(ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER] == 2, "%s: %u discoveries",
+			sim.name, ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER]);
+	CHECK(perception_handle.timeline_cccd_handle ==
+			ble_stub_handle(HAPTIC_TIMELINE_CHAR_UUID, BLE_STUB_CCCD),
+			"%s: timeline CCCD handle %u, reporter %u", sim.name,
+			perception_handle.timeline_cccd_handle,
+			ble_stub_handle(HAPTIC_TIMELINE_CHAR_UUID, BLE_STUB_CCCD));
+	CHECK(ble_stub_cccd(HAPTIC_TIMELINE_CHAR_UUID) == PERCEPTION_CCCD_NOTIFY,
+			"%s: timeline CCCD %04X", sim.name, ble_stub_cccd(HAPTIC_TIMELINE_CHAR_UUID));
+}
+
+static const action_t levels_actions[] = {
+	AWAY(5000),
+	{7000, ACT_LAYOUT, BLE_STUB_LAYOUT_LEVELS, 0},
+	{8000, ACT_ADVERTISE, 1, 0},
+	{15000, ACT_EXPECT_FLOWING, 0, 0},
+	{15000, ACT_END, 0, 0}
+};
+
+static void levels_check(void)
+{
+	layout_check();
+	CHECK(ble_stub_reporter.indications == 1, "levels: %u indications",
+			ble_stub_reporter.indications);
+}
+
+static const action_t write_fail_actions[] = {
+	{5000, ACT_LOSS, 0, 0},
+	/* the cached CCCD write of the reconnection */
+	{5000, ACT_FAIL, BLE_STUB_CALL_WRITE, AT_BLE_FAILURE},
+	{10000, ACT_EXPECT_FLOWING, 0, 0},
+	{10000, ACT_END, 0, 0}
+};
+
+static void write_fail_check(void)
+{
+	CHECK(ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER] == 2,
+			"write fail: %u discoveries", ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER]);
+}
+
+static const action_t discover_fail_actions[] = {
+	{0, ACT_FAIL, BLE_STUB_CALL_SERVICE_DISCOVER, AT_BLE_FAILURE},
+	{5000, ACT_EXPECT_FLOWING, 0, 0},
+	{5000, ACT_END, 0, 0}
+};
+
+static void discover_fail_check(void)
+{
+	CHECK(ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER] == 2,
+			"discover fail: %u discoveries", ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER]);
+	CHECK(perception_handle.handles_state == PXP_HANDLES_DISCOVERED,
+			"discover fail: handles state %u", perception_handle.handles_state);
+}
+
+#define AWAY_END_MS                     (65000)
+
+static const action_t away_actions[] = {
+	AWAY(5000),
+	{AWAY_END_MS, ACT_ADVERTISE, 1, 0},
+	{AWAY_END_MS + 40000, ACT_EXPECT_FLOWING, 0, 0},
+	{AWAY_END_MS + 40000, ACT_END, 0, 0}
+};
+
+static void away_check(void)
+{
+	uint64_t back_us = AWAY_END_MS * US_PER_MS;
+	uint64_t bound_us = (PXP_SCAN_BACKOFF_MAX + PXP_AUTO_SCAN_TIMEOUT + 1) * 1000000ull;
+
+	CHECK(ble_stub_reporter.connections == 2, "away: %u connections",
+			ble_stub_reporter.connections);
+	CHECK((sim.connected_us >= back_us) && (sim.connected_us - back_us <= bound_us),
+			"away: reconnected at %lu ms", (unsigned long)(sim.connected_us / US_PER_MS));
+	/* 5 fast scans, then backing off to the longest interval */
+	CHECK(ble_stub.calls[BLE_STUB_CALL_SCAN_START] < 20, "away: %u scans",
+			ble_stub.calls[BLE_STUB_CALL_SCAN_START]);
+	CHECK(ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER] == 1, "away: %u discoveries",
+			ble_stub.calls[BLE_STUB_CALL_SERVICE_DISCOVER]);
+}
+
+static const scenario_t scenarios[] = {
+	{"first", first_actions, first_check},
+	{"reconnect", reconnect_actions, reconnect_check},
+	{"battery", battery_actions, layout_check},
+	{"levels", levels_actions, levels_check},
+	{"write fail", write_fail_actions, write_fail_check},
+	{"discover fail", discover_fail_actions, discover_fail_check},
+	{"away", away_actions, away_check}
+};
+
+#define SCENARIOS                       (sizeof(scenarios) / sizeof(scenarios[0]))
+
+/* Link loss at an event of the first setup */
+static action_t sweep_first_actions[] = {
+	{0, ACT_LOSS, 0, 0},
+	{15000, ACT_EXPECT_FLOWING, 0, 0},
+	{15000, ACT_END, 0, 0}
+};
+
+/* Link loss at an event of the setup of the reconnection to a changed
+ * table */
+static action_t sweep_levels_actions[] = {
+	AWAY(5000),
+	{7000, ACT_LAYOUT, BLE_STUB_LAYOUT_LEVELS, 0},
+	{8000, ACT_ADVERTISE, 1, 0},
+	{8000, ACT_LOSS, 0, 0},
+	{25000, ACT_EXPECT_FLOWING, 0, 0},
+	{25000, ACT_END, 0, 0}
+};
+
+/* Runs a scenario in a child process and adds its failures */
+static void run(const char *name, const action_t *action, void (*check)(void),
+		bool verbose, bool summary)
+{
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(2);
+	}
+	if (pid == 0) {
+		sim_start(name, verbose);
+		sim_script(action);
+		if (check != NULL) {
+			check();
+		}
+		if (verbose || summary) {
+			sim_print();
+		}
+		fflush(stdout);
+		_exit((check_failures > 100) ? 100 : check_failures);
+	}
+	if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status)) {
+		CHECK(false, "%s: the simulation crashed", name);
+		return;
+	}
+	check_failures += WEXITSTATUS(status);
+}
+
+static void run_sweep(const char *name, action_t *action, uint8_t loss_idx)
+{
+	char sweep_name[48];
+	int k;
+
+	for (k = 1; k <= SIM_SWEEP_EVENTS; k++) {
+		snprintf(sweep_name, sizeof(sweep_name), "%s loss at event %d", name, k);
+		action[loss_idx].arg = k;
+		run(sweep_name, action, NULL, false, false);
+	}
+}
+
+/*- Script -----------------------------------------------------------------*/
+static const char *const call_names[BLE_STUB_CALLS] = {
+	"scan_start", "scan_stop", "connect", "connect_cancel", "disconnect",
+	"exchange_mtu", "authenticate", "encryption_start", "service_discover",
+	"char_discover", "desc_discover", "read", "write"
+};
+
+static const char *const layout_names[] = {"base", "battery", "levels"};
+
+static int lookup(const char *word, const char *const *names, int count)
+{
+	int idx;
+
+	for (idx = 0; idx < count; idx++) {
+		if (!strcasecmp(word, names[idx])) {
+			return idx;
+		}
+	}
+	return -1;
+}
+
+static int parse_script(const char *path, action_t *action, int max)
+{
+	char line[128];
+	char word[32];
+	char arg[32];
+	unsigned long ms;
+	long value;
+	int fields;
+	int lineno = 0;
+	int count = 0;
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		lineno++;
+		if ((line[0] == '#') || (line[strspn(line, " \t\r\n")] == '\0')) {
+			continue;
+		}
+		if (count == max - 1) {
+			fprintf(stderr, "%s:%d: too many actions\n", path, lineno);
+			break;
+		}
+		memset(&action[count], 0, sizeof(action[count]));
+		arg[0] = '\0';
+		value = 0;
+		fields = sscanf(line, "%lu %31s %31s %li", &ms, word, arg, &value);
+		if (fields < 2) {
+			goto bad;
+		}
+		action[count].ms = (uint32_t)ms;
+		if (!strcmp(word, "advertise") && (fields == 3) &&
+				(!strcmp(arg, "on") || !strcmp(arg, "off"))) {
+			action[count].act = ACT_ADVERTISE;
+			action[count].arg = !strcmp(arg, "on");
+		} else if (!strcmp(word, "layout") && (fields == 3) &&
+				(lookup(arg, layout_names, 3) >= 0)) {
+			action[count].act = ACT_LAYOUT;
+			action[count].arg = lookup(arg, layout_names, 3);
+		} else if (!strcmp(word, "loss") && (fields <= 3)) {
+			action[count].act = ACT_LOSS;
+			action[count].arg = (fields == 3) ? atoi(arg) : 0;
+		} else if (!strcmp(word, "fail") && (fields == 4) &&
+				(lookup(arg, call_names, BLE_STUB_CALLS) >= 0)) {
+			action[count].act = ACT_FAIL;
+			action[count].arg = lookup(arg, call_names, BLE_STUB_CALLS);
+			action[count].arg2 = (int)value;
+		} else if (!strcmp(word, "expect") && (fields == 3) && !strcmp(arg, "flowing")) {
+			action[count].act = ACT_EXPECT_FLOWING;
+		} else if (!strcmp(word, "end") && (fields == 2)) {
+			action[count].act = ACT_END;
+		} else {
+			goto bad;
+		}
+		if ((count > 0) && (action[count].ms < action[count - 1].ms)) {
+			fprintf(stderr, "%s:%d: time goes back\n", path, lineno);
+			fclose(file);
+			return -1;
+		}
+		count++;
+		if (action[count - 1].act == ACT_END) {
+			break;
+		}
+	}
+	fclose(file);
+	if ((count == 0) || (action[count - 1].act != ACT_END)) {
+		/* ends with the last action */
+		action[count].ms = (count > 0) ? action[count - 1].ms : 0;
+		action[count].act = ACT_END;
+		count++;
+	}
+	return count;
+
+bad:
+	fprintf(stderr, "%s:%d: bad action: %s", path, lineno, line);
+	fclose(file);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	static action_t script[SIM_ACTIONS];
+	const char *script_path = NULL;
+	bool verbose = false;
+	unsigned idx;
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-v")) {
+			verbose = true;
+		} else if (!strcmp(argv[arg], "-s") && (arg + 1 < argc)) {
+			script_path = argv[++arg];
+		} else {
+			fprintf(stderr, "usage: %s [-v] [-s script]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (script_path != NULL) {
+		if (parse_script(script_path, script, SIM_ACTIONS) < 0) {
+			return 2;
+		}
+		run(script_path, script, NULL, verbose, true);
+	} else {
+		for (idx = 0; idx < SCENARIOS; idx++) {
+			run(scenarios[idx].name, scenarios[idx].action, scenarios[idx].check,
+					verbose, false);
+		}
+		run_sweep("first", sweep_first_actions, 0);
+		run_sweep("levels", sweep_levels_actions, 4);
+	}
+
+	return check_report();
+}
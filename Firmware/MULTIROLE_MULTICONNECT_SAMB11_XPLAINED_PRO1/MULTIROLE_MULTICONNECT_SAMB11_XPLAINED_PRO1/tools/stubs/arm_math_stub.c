@@ -0,0 +1,102 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the CMSIS-DSP q15 routines of haptic_filter.c
+ *
+ * The tree carries the CMSIS-DSP headers and the prebuilt Cortex-M0
+ * library only, not the DSP_Lib sources the library is built from. These
+ * are the Cortex-M0 code paths (ARM_MATH_CM0_FAMILY) of those sources, at
+ * the V1.4.4 of the arm_math.h in the tree, reduced to their arithmetic:
+ * the q63 accumulator of the DF1 biquad shifted by 15 - postShift, and the
+ * 16 bit saturation of __SSAT() from arm_math.h on every result.
+ *
+ * Build with -DARM_MATH_CM0 and ../src/ASF/thirdparty/CMSIS/Include on the
+ * include path; the CMSIS sources of the same version, where available,
+ * link in its place.
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include "arm_math.h"
+
+void arm_biquad_cascade_df1_init_q15(arm_biquad_casd_df1_inst_q15 *S,
+		uint8_t numStages, q15_t *pCoeffs, q15_t *pState, int8_t postShift)
+{
+	S->numStages = (int8_t)numStages;
+	S->postShift = postShift;
+	S->pCoeffs = pCoeffs;
+	memset(pState, 0, 4u * numStages * sizeof(q15_t));
+	S->pState = pState;
+}
+
+void arm_biquad_cascade_df1_q15(const arm_biquad_casd_df1_inst_q15 *S,
+		q15_t *pSrc, q15_t *pDst, uint32_t blockSize)
+{
+	q15_t *pIn = pSrc;
+	q15_t *pState = S->pState;
+	q15_t *pCoeffs = S->pCoeffs;
+	int32_t shift = 15 - S->postShift;
+	uint32_t stage = (uint32_t)S->numStages;
+
+	do {
+		/* {b0, 0, b1, b2, a1, a2}, the 0 is for the SIMD paths */
+		q15_t b0 = pCoeffs[0];
+		q15_t b1 = pCoeffs[2];
+		q15_t b2 = pCoeffs[3];
+		q15_t a1 = pCoeffs[4];
+		q15_t a2 = pCoeffs[5];
+		q15_t Xn1 = pState[0];
+		q15_t Xn2 = pState[1];
+		q15_t Yn1 = pState[2];
+		q15_t Yn2 = pState[3];
+		q15_t *pOut = pDst;
+		uint32_t sample;
+
+		pCoeffs += 6;
+		for (sample = 0; sample < blockSize; sample++) {
+			q15_t Xn = *pIn++;
+			q63_t acc;
+
+			acc = (q31_t)b0 * Xn;
+			acc += (q31_t)b1 * Xn1;
+			acc += (q31_t)b2 * Xn2;
+			acc += (q31_t)a1 * Yn1;
+			acc += (q31_t)a2 * Yn2;
+			acc = __SSAT((q31_t)(acc >> shift), 16);
+
+			Xn2 = Xn1;
+			Xn1 = Xn;
+			Yn2 = Yn1;
+			Yn1 = (q15_t)acc;
+			*pOut++ = (q15_t)acc;
+		}
+
+		/* The next stage filters the output of this one */
+		pIn = pDst;
+		*pState++ = Xn1;
+		*pState++ = Xn2;
+		*pState++ = Yn1;
+		*pState++ = Yn2;
+	} while (--stage);
+}
+
+void arm_add_q15(q15_t *pSrcA, q15_t *pSrcB, q15_t *pDst, uint32_t blockSize)
+{
+	while (blockSize--) {
+		*pDst++ = (q15_t)__SSAT((q31_t)*pSrcA++ + *pSrcB++, 16);
+	}
+}
+
+void arm_sub_q15(q15_t *pSrcA, q15_t *pSrcB, q15_t *pDst, uint32_t blockSize)
+{
+	while (blockSize--) {
+		*pDst++ = (q15_t)__SSAT((q31_t)*pSrcA++ - *pSrcB++, 16);
+	}
+}
+
+void arm_mult_q15(q15_t *pSrcA, q15_t *pSrcB, q15_t *pDst, uint32_t blockSize)
+{
+	while (blockSize--) {
+		*pDst++ = (q15_t)__SSAT(((q31_t)*pSrcA++ * *pSrcB++) >> 15, 16);
+	}
+}
@@ -0,0 +1,235 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the ASF drivers
+ *
+ * Lets firmware sources that include <asf.h> build on the host for the
+ * checks in tools/. The register blocks use the real CMSIS component
+ * layouts, backed by host memory instead of the peripherals, and the
+ * driver calls are recorded in stub_log together with the PWM control
+ * registers at the time of the call, so a check can follow the order in
+ * which pins and registers changed.
+ *
+ * Only what the host checked sources use is provided. Put the stub
+ * directory first on the include path:
+ *
+ *   -Istubs -I../src -I../src/config -I../src/ASF/sam0/utils/cmsis/samb11/include
+ */
+
+#ifndef STUB_ASF_H_INCLUDED
+#define STUB_ASF_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*- compiler.h -------------------------------------------------------------*/
+#include "../../src/ASF/sam0/utils/preprocessor/preprocessor.h"
+
+#define UNUSED(v)                       (void)(v)
+
+/* The console of a host simulation, printf of the sources goes through
+ * stub_console_printf() which the simulation defines */
+#ifdef STUB_CONSOLE
+int stub_console_printf(const char *format, ...);
+#define printf                          stub_console_printf
+#endif
+
+/*- CMSIS ------------------------------------------------------------------*/
+#define __I                             volatile const
+#define __O                             volatile
+#define __IO                            volatile
+
+typedef volatile const uint32_t RoReg;
+typedef volatile const uint16_t RoReg16;
+typedef volatile const uint8_t  RoReg8;
+typedef volatile       uint32_t WoReg;
+typedef volatile       uint16_t WoReg16;
+typedef volatile       uint8_t  WoReg8;
+typedef volatile       uint32_t RwReg;
+typedef volatile       uint16_t RwReg16;
+typedef volatile       uint8_t  RwReg8;
+
+#include "component/aon_sleep_timer.h"
+#include "component/lpmcu_misc_regs.h"
+#include "pio/pio_samb11g18a.h"
+
+extern AonSleepTimer stub_aon_sleep_timer;
+extern LpmcuMiscRegs stub_lpmcu_misc_regs;
+
+#define AON_SLEEP_TIMER0                (&stub_aon_sleep_timer)
+#define LPMCU_MISC_REGS0                (&stub_lpmcu_misc_regs)
+
+typedef enum IRQn {
+	DUALTIMER0_IRQn = 14,
+	TIMER0_IRQn = 26,
+	AON_SLEEP_TIMER_IRQn = 27
+} IRQn_Type;
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+
+/*- status_codes.h ---------------------------------------------------------*/
+enum status_code {
+	STATUS_OK = 0x00
+};
+
+/*- system_sam_b.h ---------------------------------------------------------*/
+enum system_peripheral {
+	PERIPHERAL_PWM1 = 33,
+	PERIPHERAL_PWM2,
+	PERIPHERAL_PWM3,
+	PERIPHERAL_PWM4
+};
+
+enum ram_isr_table_index {
+	RAM_ISR_TABLE_AON_SLEEP_TIMER_INDEX = 43
+};
+
+enum status_code system_clock_peripheral_enable(enum system_peripheral peripheral);
+/* The table takes 32-bit addresses, which a host function pointer does not
+ * fit; only the registration is recorded, a check that needs the handler
+ * includes the source that defines it */
+#define system_register_isr(isr_index, isr_address) stub_register_isr(isr_index)
+
+void stub_register_isr(enum ram_isr_table_index isr_index);
+
+/*- timer.h ----------------------------------------------------------------*/
+typedef void (*timer_callback_t)(void);
+
+struct timer_config {
+	uint32_t reload_value;
+	bool interrupt_enable;
+};
+
+void timer_get_config_defaults(struct timer_config *config);
+void timer_init(const struct timer_config *config);
+uint32_t timer_get_value(void);
+void timer_enable(void);
+void timer_disable(void);
+void timer_register_callback(timer_callback_t fun);
+
+/*- dualtimer.h ------------------------------------------------------------*/
+typedef void (*dualtimer_callback_t)(void);
+
+enum dualtimer_timer {
+	DUALTIMER_TIMER1 = 0,
+	DUALTIMER_TIMER2,
+};
+
+enum dualtimer_set_register {
+	DUALTIMER_SET_CURRUNT_REG = 0,
+	DUALTIMER_SET_BG_REG,
+};
+
+struct dualtimer_private_config {
+	bool timer_enable;
+	uint32_t load_value;
+};
+
+struct dualtimer_config {
+	struct dualtimer_private_config timer1;
+	struct dualtimer_private_config timer2;
+};
+
+void dualtimer_get_config_defaults(struct dualtimer_config *config);
+void dualtimer_init(const struct dualtimer_config *config);
+void dualtimer_set_counter(enum dualtimer_timer timer,
+		enum dualtimer_set_register cur_bg, uint32_t value);
+void dualtimer_enable(enum dualtimer_timer timer);
+void dualtimer_disable(enum dualtimer_timer timer);
+void dualtimer_register_callback(enum dualtimer_timer timer, dualtimer_callback_t fun);
+
+/*- platform.h -------------------------------------------------------------*/
+void send_plf_int_msg_ind(uint8_t intr_index, uint8_t callback_id, void *data,
+		uint16_t data_len);
+
+/*- gpio.h -----------------------------------------------------------------*/
+enum gpio_pin_dir {
+	GPIO_PIN_DIR_INPUT,
+	GPIO_PIN_DIR_OUTPUT,
+};
+
+enum gpio_pin_pull {
+	GPIO_PIN_PULL_NONE,
+	GPIO_PIN_PULL_UP,
+	GPIO_PIN_PULL_DOWN,
+};
+
+struct gpio_config {
+	enum gpio_pin_dir direction;
+	enum gpio_pin_pull input_pull;
+	bool powersave;
+	bool aon_wakeup;
+};
+
+void gpio_get_config_defaults(struct gpio_config *const config);
+enum status_code gpio_pin_set_config(const uint8_t gpio_pin,
+		const struct gpio_config *config);
+void gpio_pin_set_output_level(const uint8_t gpio_pin, const bool level);
+void gpio_pinmux_cofiguration(const uint8_t gpio_pin, uint16_t pinmux_sel);
+
+/*- Recording --------------------------------------------------------------*/
+#define STUB_PINS                       (32)
+
+#define STUB_LOG_SIZE                   (256)
+
+typedef enum {
+	STUB_CALL_CLOCK_ENABLE,
+	STUB_CALL_PIN_CONFIG,
+	STUB_CALL_PIN_LEVEL,
+	STUB_CALL_PINMUX
+} stub_call_t;
+
+typedef struct stub_event {
+	stub_call_t call;
+	/* pin or peripheral */
+	uint8_t target;
+	/* level, pin mux selection or direction */
+	uint16_t value;
+	/* PWM1..PWM4 control registers when the call was made */
+	uint32_t pwm_control[4];
+} stub_event_t;
+
+typedef struct stub_pin {
+	bool output;
+	bool level;
+	uint16_t pinmux;
+} stub_pin_t;
+
+/* TIMER0 as the tick left it */
+typedef struct stub_timer {
+	bool enabled;
+	uint32_t reload_value;
+	/* down counter within the period, set by the check */
+	uint32_t value;
+	timer_callback_t callback;
+	/* timer_init() calls */
+	unsigned inits;
+} stub_timer_t;
+
+extern stub_pin_t stub_pin[STUB_PINS];
+
+extern stub_timer_t stub_timer;
+
+/* An AON sleep timer interrupt handler was registered */
+extern bool stub_aon_isr;
+
+/* send_plf_int_msg_ind() calls, the event loop wakeups */
+extern unsigned stub_plf_int_msgs;
+
+extern stub_event_t stub_log[STUB_LOG_SIZE];
+
+/* Calls recorded since stub_reset(), those past STUB_LOG_SIZE are counted
+ * but not kept */
+extern unsigned stub_log_count;
+
+/**@brief Clear the registers, the pins, the timers and the log
+ */
+void stub_reset(void);
+
+/**@brief Clear the log only
+ */
+void stub_log_clear(void);
+
+#endif /* STUB_ASF_H_INCLUDED */
@@ -0,0 +1,188 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the ASF drivers
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <string.h>
+#include <asf.h>
+
+AonSleepTimer stub_aon_sleep_timer;
+
+LpmcuMiscRegs stub_lpmcu_misc_regs;
+
+stub_pin_t stub_pin[STUB_PINS];
+
+stub_timer_t stub_timer;
+
+bool stub_aon_isr;
+
+unsigned stub_plf_int_msgs;
+
+stub_event_t stub_log[STUB_LOG_SIZE];
+
+unsigned stub_log_count;
+
+static void stub_record(stub_call_t call, uint8_t target, uint16_t value)
+{
+	if (stub_log_count < STUB_LOG_SIZE) {
+		stub_event_t *event = &stub_log[stub_log_count];
+
+		event->call = call;
+		event->target = target;
+		event->value = value;
+		event->pwm_control[0] = stub_lpmcu_misc_regs.PWM_1_CONTROL.reg;
+		event->pwm_control[1] = stub_lpmcu_misc_regs.PWM_2_CONTROL.reg;
+		event->pwm_control[2] = stub_lpmcu_misc_regs.PWM_3_CONTROL.reg;
+		event->pwm_control[3] = stub_lpmcu_misc_regs.PWM_4_CONTROL.reg;
+	}
+	stub_log_count++;
+}
+
+void stub_reset(void)
+{
+	memset((void *)&stub_aon_sleep_timer, 0, sizeof(stub_aon_sleep_timer));
+	memset((void *)&stub_lpmcu_misc_regs, 0, sizeof(stub_lpmcu_misc_regs));
+	memset(stub_pin, 0, sizeof(stub_pin));
+	memset(&stub_timer, 0, sizeof(stub_timer));
+	stub_aon_isr = false;
+	stub_plf_int_msgs = 0;
+	stub_log_clear();
+}
+
+void stub_log_clear(void)
+{
+	memset(stub_log, 0, sizeof(stub_log));
+	stub_log_count = 0;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+	(void)irq;
+}
+
+void stub_register_isr(enum ram_isr_table_index isr_index)
+{
+	if (isr_index == RAM_ISR_TABLE_AON_SLEEP_TIMER_INDEX) {
+		stub_aon_isr = true;
+	}
+}
+
+enum status_code system_clock_peripheral_enable(enum system_peripheral peripheral)
+{
+	stub_record(STUB_CALL_CLOCK_ENABLE, (uint8_t)peripheral, 1);
+	return STATUS_OK;
+}
+
+void gpio_get_config_defaults(struct gpio_config *const config)
+{
+	config->direction = GPIO_PIN_DIR_INPUT;
+	config->input_pull = GPIO_PIN_PULL_UP;
+	config->powersave = false;
+	config->aon_wakeup = false;
+}
+
+enum status_code gpio_pin_set_config(const uint8_t gpio_pin,
+		const struct gpio_config *config)
+{
+	if (gpio_pin < STUB_PINS) {
+		stub_pin[gpio_pin].output = (config->direction == GPIO_PIN_DIR_OUTPUT);
+	}
+	stub_record(STUB_CALL_PIN_CONFIG, gpio_pin, (uint16_t)config->direction);
+	return STATUS_OK;
+}
+
+void gpio_pin_set_output_level(const uint8_t gpio_pin, const bool level)
+{
+	if (gpio_pin < STUB_PINS) {
+		stub_pin[gpio_pin].level = level;
+	}
+	stub_record(STUB_CALL_PIN_LEVEL, gpio_pin, level);
+}
+
+void gpio_pinmux_cofiguration(const uint8_t gpio_pin, uint16_t pinmux_sel)
+{
+	if (gpio_pin < STUB_PINS) {
+		stub_pin[gpio_pin].pinmux = pinmux_sel;
+	}
+	stub_record(STUB_CALL_PINMUX, gpio_pin, pinmux_sel);
+}
+
+void timer_get_config_defaults(struct timer_config *config)
+{
+	config->reload_value = 0;
+	config->interrupt_enable = true;
+}
+
+void timer_init(const struct timer_config *config)
+{
+	stub_timer.reload_value = config->reload_value;
+	stub_timer.value = config->reload_value;
+	stub_timer.inits++;
+}
+
+uint32_t timer_get_value(void)
+{
+	return stub_timer.value;
+}
+
+void timer_enable(void)
+{
+	stub_timer.enabled = true;
+}
+
+void timer_disable(void)
+{
+	stub_timer.enabled = false;
+}
+
+void timer_register_callback(timer_callback_t fun)
+{
+	stub_timer.callback = fun;
+}
+
+void dualtimer_get_config_defaults(struct dualtimer_config *config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+void dualtimer_init(const struct dualtimer_config *config)
+{
+	(void)config;
+}
+
+void dualtimer_set_counter(enum dualtimer_timer timer,
+		enum dualtimer_set_register cur_bg, uint32_t value)
+{
+	(void)timer;
+	(void)cur_bg;
+	(void)value;
+}
+
+void dualtimer_enable(enum dualtimer_timer timer)
+{
+	(void)timer;
+}
+
+void dualtimer_disable(enum dualtimer_timer timer)
+{
+	(void)timer;
+}
+
+void dualtimer_register_callback(enum dualtimer_timer timer, dualtimer_callback_t fun)
+{
+	(void)timer;
+	(void)fun;
+}
+
+void send_plf_int_msg_ind(uint8_t intr_index, uint8_t callback_id, void *data,
+		uint16_t data_len)
+{
+	(void)intr_index;
+	(void)callback_id;
+	(void)data;
+	(void)data_len;
+	stub_plf_int_msgs++;
+}
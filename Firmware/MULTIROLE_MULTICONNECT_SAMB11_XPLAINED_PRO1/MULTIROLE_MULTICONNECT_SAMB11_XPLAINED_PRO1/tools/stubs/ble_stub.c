@@ -0,0 +1,1222 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the BLE stack with a scripted Perception reporter
+ *
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <asf.h>
+#include "ble_stub.h"
+#include "ble_manager.h"
+#include "console_serial.h"
+#include "trace_ring.h"
+
+#define PROP_READ                       (0x02)
+#define PROP_WRITE_NO_RESP              (0x04)
+#define PROP_WRITE                      (0x08)
+#define PROP_NOTIFY                     (0x10)
+#define PROP_INDICATE                   (0x20)
+
+#define CCCD_NOTIFY                     (0x0001)
+#define CCCD_INDICATE                   (0x0002)
+
+/* Bytes kept of a write command */
+#define WRITE_DATA_MAX                  (32)
+
+/* Connection interval in 1.25 ms units and supervision timeout in 10 ms
+ * units, as reported in the connected event */
+#define CONN_INTERVAL                   (BLE_STUB_INTERVAL_US / 1250)
+#define CONN_SUP_TO                     (BLE_STUB_SUPERVISION_US / 10000)
+
+typedef union ble_stub_params {
+	at_ble_scan_info_t scan_info;
+	at_ble_scan_report_t scan_report;
+	at_ble_connected_t connected;
+	at_ble_disconnected_t disconnected;
+	at_ble_slave_sec_request_t sec_request;
+	at_ble_pair_done_t pair_done;
+	at_ble_encryption_status_changed_t encryption;
+	at_ble_mtu_changed_ind_t mtu;
+	at_ble_cmd_complete_event_t complete;
+	at_ble_primary_service_found_t service;
+	at_ble_characteristic_found_t characteristic;
+	at_ble_descriptor_found_t descriptor;
+	at_ble_characteristic_read_response_t read;
+	at_ble_characteristic_write_response_t write;
+	at_ble_notification_recieved_t notification;
+	at_ble_indication_recieved_t indication;
+} ble_stub_params_t;
+
+typedef struct ble_stub_entry {
+	bool used;
+	uint64_t due_us;
+	/* posting order of events due at the same time */
+	uint32_t seq;
+	at_ble_events_t event;
+	/* belongs to the connection, dropped when the link goes */
+	bool link;
+	/* completes a discovery procedure */
+	bool ends_discovery;
+	/* what the request did at the reporter, applied on delivery */
+	uint16_t write_handle;
+	uint8_t write_data[WRITE_DATA_MAX];
+	uint8_t write_len;
+	uint16_t len;
+	ble_stub_params_t params;
+} ble_stub_entry_t;
+
+ble_stub_stack_t ble_stub;
+
+ble_stub_reporter_t ble_stub_reporter;
+
+static ble_stub_entry_t queue[BLE_STUB_QUEUE];
+
+static uint32_t queue_seq;
+
+/* MTU the central asked for in its device configuration */
+static uint16_t central_mtu;
+
+/* advertisers reported in the current scan, duplicates are filtered */
+static bool scan_reported_reporter;
+static bool scan_reported_neighbour;
+static uint16_t scan_interval;
+static uint16_t scan_window;
+
+static bool indication_queued;
+
+static const at_ble_addr_t neighbour_addr = {
+	AT_BLE_ADDRESS_PUBLIC, {0x01, 0x02, 0x03, 0x04, 0x05, 0x06}
+};
+
+/* Flags, complete list of 16-bit UUIDs, complete local name */
+static const uint8_t reporter_adv[] = {
+	0x02, 0x01, 0x06,
+	0x03, 0x03, (uint8_t)PERCEPTION_SERVICE_UUID, (uint8_t)(PERCEPTION_SERVICE_UUID >> 8),
+	0x0B, 0x09, 'P', 'e', 'r', 'c', 'e', 'p', 't', 'i', 'o', 'n'
+};
+
+/* A heart rate band */
+static const uint8_t neighbour_adv[] = {
+	0x02, 0x01, 0x06,
+	0x03, 0x03, 0x0D, 0x18,
+	0x05, 0x09, 'B', 'a', 'n', 'd'
+};
+
+static ble_stub_params_t *post(at_ble_events_t event, uint64_t due_us, bool link,
+		uint16_t len)
+{
+	uint8_t idx;
+
+	/* The events have the target's layout only with short enums */
+	if (len > BLE_EVENT_PARAM_MAX_SIZE) {
+		fprintf(stderr, "ble_stub: %u bytes of event parameters, build with "
+				"-fshort-enums\n", (unsigned)len);
+		abort();
+	}
+	for (idx = 0; idx < BLE_STUB_QUEUE; idx++) {
+		if (!queue[idx].used) {
+			memset(&queue[idx], 0, sizeof(queue[idx]));
+			queue[idx].used = true;
+			queue[idx].due_us = due_us;
+			queue[idx].seq = queue_seq++;
+			queue[idx].event = event;
+			queue[idx].link = link;
+			queue[idx].len = len;
+			return &queue[idx].params;
+		}
+	}
+	fprintf(stderr, "ble_stub: event queue full\n");
+	abort();
+}
+
+static ble_stub_entry_t *entry_of(ble_stub_params_t *params)
+{
+	return (ble_stub_entry_t *)((uint8_t *)params - offsetof(ble_stub_entry_t, params));
+}
+
+static void remove_events(at_ble_events_t event)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < BLE_STUB_QUEUE; idx++) {
+		if (queue[idx].used && (queue[idx].event == event)) {
+			queue[idx].used = false;
+		}
+	}
+}
+
+/* Nothing more gets through on the link */
+static void flush_link(void)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < BLE_STUB_QUEUE; idx++) {
+		if (queue[idx].used && queue[idx].link) {
+			queue[idx].used = false;
+		}
+	}
+	ble_stub.gatt_busy_us = ble_stub.now_us;
+	ble_stub.discoveries = 0;
+	ble_stub.tx_buffers = 0;
+	ble_stub_reporter.timeline_queued = false;
+	indication_queued = false;
+}
+
+/* Due time of the next GATT request of the link */
+static uint64_t att_slot(void)
+{
+	uint64_t start = ble_stub.gatt_busy_us;
+
+	if (start < ble_stub.now_us) {
+		start = ble_stub.now_us;
+	}
+	ble_stub.gatt_busy_us = start + BLE_STUB_INTERVAL_US;
+	return ble_stub.gatt_busy_us;
+}
+
+static at_ble_status_t call(ble_stub_call_t which)
+{
+	at_ble_status_t status = ble_stub.fail[which];
+
+	ble_stub.calls[which]++;
+	ble_stub.fail[which] = AT_BLE_SUCCESS;
+	return status;
+}
+
+static bool same_addr(const at_ble_addr_t *a, const at_ble_addr_t *b)
+{
+	return (a->type == b->type) && !memcmp(a->addr, b->addr, AT_BLE_ADDR_LEN);
+}
+
+static void uuid16(at_ble_uuid_t *uuid, uint16_t value)
+{
+	memset(uuid, 0, sizeof(*uuid));
+	uuid->type = AT_BLE_UUID_16;
+	uuid->uuid[0] = (uint8_t)value;
+	uuid->uuid[1] = (uint8_t)(value >> 8);
+}
+
+/*- Attribute table --------------------------------------------------------*/
+static void table_add(ble_stub_attr_t *attr, uint8_t *attrs, uint16_t type,
+		uint16_t uuid, uint8_t properties)
+{
+	if (*attrs >= BLE_STUB_ATTRS) {
+		fprintf(stderr, "ble_stub: attribute table full\n");
+		abort();
+	}
+	attr[*attrs].handle = (uint16_t)(*attrs + 1);
+	attr[*attrs].type = type;
+	attr[*attrs].uuid = uuid;
+	attr[*attrs].properties = properties;
+	attr[*attrs].cccd = 0;
+	(*attrs)++;
+}
+
+static void table_char(ble_stub_attr_t *attr, uint8_t *attrs, uint16_t uuid,
+		uint8_t properties)
+{
+	table_add(attr, attrs, BLE_STUB_CHARACTERISTIC, uuid, properties);
+	table_add(attr, attrs, uuid, uuid, properties);
+	if (properties & (PROP_NOTIFY | PROP_INDICATE)) {
+		table_add(attr, attrs, BLE_STUB_CCCD, uuid, PROP_READ | PROP_WRITE);
+	}
+}
+
+static void table_build(ble_stub_attr_t *attr, uint8_t *attrs, ble_stub_layout_t layout)
+{
+	*attrs = 0;
+	table_add(attr, attrs, BLE_STUB_PRIMARY_SERVICE, BLE_STUB_GAP_SERVICE_UUID, 0);
+	table_char(attr, attrs, BLE_STUB_DEVICE_NAME_UUID, PROP_READ);
+	table_char(attr, attrs, BLE_STUB_APPEARANCE_UUID, PROP_READ);
+	table_add(attr, attrs, BLE_STUB_PRIMARY_SERVICE, GENERIC_ATTRIBUTE_SERVICE_UUID, 0);
+	table_char(attr, attrs, SERVICE_CHANGED_CHAR_UUID, PROP_INDICATE);
+	if (layout == BLE_STUB_LAYOUT_BATTERY) {
+		table_add(attr, attrs, BLE_STUB_PRIMARY_SERVICE, BLE_STUB_BATTERY_SERVICE_UUID, 0);
+		table_char(attr, attrs, BLE_STUB_BATTERY_LEVEL_UUID, PROP_READ | PROP_NOTIFY);
+	}
+	table_add(attr, attrs, BLE_STUB_PRIMARY_SERVICE, PERCEPTION_SERVICE_UUID, 0);
+	table_char(attr, attrs, VIBE1_INTENSITY_CHAR_UUID, PROP_READ | PROP_WRITE);
+	table_char(attr, attrs, VIBE2_INTENSITY_CHAR_UUID, PROP_READ | PROP_WRITE);
+	table_char(attr, attrs, VIBE3_INTENSITY_CHAR_UUID, PROP_READ | PROP_WRITE);
+	table_char(attr, attrs, VIBE4_INTENSITY_CHAR_UUID, PROP_READ | PROP_WRITE);
+	if (layout == BLE_STUB_LAYOUT_LEVELS) {
+		table_char(attr, attrs, BLE_STUB_MOTOR_LEVELS_UUID, PROP_READ | PROP_NOTIFY);
+	}
+	table_char(attr, attrs, HAPTIC_TIMELINE_CHAR_UUID, PROP_NOTIFY);
+	table_char(attr, attrs, PERCEPTION_DIAG_CHAR_UUID, PROP_WRITE_NO_RESP);
+}
+
+static ble_stub_attr_t *attr_at(uint16_t handle)
+{
+	if ((handle == 0) || (handle > ble_stub_reporter.attrs)) {
+		return NULL;
+	}
+	return &ble_stub_reporter.attr[handle - 1];
+}
+
+static ble_stub_attr_t *cccd_of(uint16_t char_uuid)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < ble_stub_reporter.attrs; idx++) {
+		if ((ble_stub_reporter.attr[idx].type == BLE_STUB_CCCD) &&
+				(ble_stub_reporter.attr[idx].uuid == char_uuid)) {
+			return &ble_stub_reporter.attr[idx];
+		}
+	}
+	return NULL;
+}
+
+/* End of the service declared at idx */
+static uint16_t service_end(uint8_t idx)
+{
+	for (idx++; idx < ble_stub_reporter.attrs; idx++) {
+		if (ble_stub_reporter.attr[idx].type == BLE_STUB_PRIMARY_SERVICE) {
+			return (uint16_t)(ble_stub_reporter.attr[idx].handle - 1);
+		}
+	}
+	return 0xFFFF;
+}
+
+uint16_t ble_stub_handle(uint16_t char_uuid, uint16_t type)
+{
+	ble_stub_attr_t *attr;
+	uint8_t idx;
+
+	if (type == BLE_STUB_CCCD) {
+		attr = cccd_of(char_uuid);
+		return attr ? attr->handle : 0;
+	}
+	for (idx = 0; idx < ble_stub_reporter.attrs; idx++) {
+		if (ble_stub_reporter.attr[idx].type == char_uuid) {
+			return ble_stub_reporter.attr[idx].handle;
+		}
+	}
+	return 0;
+}
+
+uint16_t ble_stub_cccd(uint16_t char_uuid)
+{
+	ble_stub_attr_t *attr = cccd_of(char_uuid);
+
+	return attr ? attr->cccd : 0;
+}
+
+/*- Reporter ---------------------------------------------------------------*/
+static bool reporter_link_up(void)
+{
+	return ble_stub.connected && !ble_stub.link_lost;
+}
+
+/* Service Changed goes to a central that enabled it on this connection,
+ * or to the bonded central once the link is encrypted again */
+static void reporter_indicate_changes(void)
+{
+	ble_stub_attr_t *cccd = cccd_of(SERVICE_CHANGED_CHAR_UUID);
+	ble_stub_params_t *p;
+
+	if (!reporter_link_up() || indication_queued ||
+			(ble_stub_reporter.changed_start == 0) ||
+			(cccd == NULL) || !(cccd->cccd & CCCD_INDICATE) ||
+			(ble_stub_reporter.bonded && !ble_stub_reporter.encrypted)) {
+		return;
+	}
+	p = post(AT_BLE_INDICATION_RECIEVED, ble_stub.now_us + BLE_STUB_INTERVAL_US,
+			true, sizeof(p->indication));
+	p->indication.conn_handle = BLE_STUB_CONN_HANDLE;
+	p->indication.char_handle = ble_stub_handle(SERVICE_CHANGED_CHAR_UUID,
+			SERVICE_CHANGED_CHAR_UUID);
+	p->indication.char_len = 4;
+	p->indication.char_value[0] = (uint8_t)ble_stub_reporter.changed_start;
+	p->indication.char_value[1] = (uint8_t)(ble_stub_reporter.changed_start >> 8);
+	p->indication.char_value[2] = (uint8_t)ble_stub_reporter.changed_end;
+	p->indication.char_value[3] = (uint8_t)(ble_stub_reporter.changed_end >> 8);
+	indication_queued = true;
+}
+
+static void reporter_queue_timeline(void)
+{
+	ble_stub_params_t *p;
+	uint32_t seq = ble_stub_reporter.timeline_seq;
+
+	if (!reporter_link_up() || ble_stub_reporter.timeline_queued ||
+			!(ble_stub_cccd(HAPTIC_TIMELINE_CHAR_UUID) & CCCD_NOTIFY)) {
+		return;
+	}
+	p = post(AT_BLE_NOTIFICATION_RECIEVED, ble_stub.now_us + BLE_STUB_NOTIFY_PERIOD_US,
+			true, sizeof(p->notification));
+	p->notification.conn_handle = BLE_STUB_CONN_HANDLE;
+	p->notification.char_handle = ble_stub_handle(HAPTIC_TIMELINE_CHAR_UUID,
+			HAPTIC_TIMELINE_CHAR_UUID);
+	p->notification.char_len = 4;
+	p->notification.char_value[0] = (uint8_t)seq;
+	p->notification.char_value[1] = (uint8_t)(seq >> 8);
+	p->notification.char_value[2] = (uint8_t)(seq >> 16);
+	p->notification.char_value[3] = (uint8_t)(seq >> 24);
+	ble_stub_reporter.timeline_queued = true;
+}
+
+static void reporter_scan_info(const at_ble_addr_t *addr, const uint8_t *adv,
+		uint8_t adv_len, int8_t rssi, uint64_t delay_us)
+{
+	ble_stub_params_t *p;
+
+	p = post(AT_BLE_SCAN_INFO, ble_stub.now_us + delay_us, false, sizeof(p->scan_info));
+	p->scan_info.type = AT_BLE_ADV_TYPE_UNDIRECTED;
+	p->scan_info.dev_addr = *addr;
+	memcpy(p->scan_info.adv_data, adv, adv_len);
+	p->scan_info.adv_data_len = adv_len;
+	p->scan_info.rssi = rssi;
+}
+
+/* An advertiser is heard after a few advertising intervals, more of them
+ * when the scan is duty cycled */
+static uint64_t scan_delay_us(void)
+{
+	uint64_t delay = BLE_STUB_ADV_INTERVAL_US / 2;
+
+	if ((scan_window != 0) && (scan_window < scan_interval)) {
+		delay = delay * scan_interval / scan_window;
+	}
+	return delay;
+}
+
+static void reporter_heard(void)
+{
+	if (ble_stub.scanning && ble_stub_reporter.advertising && !scan_reported_reporter) {
+		reporter_scan_info(&ble_stub_reporter.addr, reporter_adv, sizeof(reporter_adv),
+				ble_stub_reporter.rssi, scan_delay_us());
+		scan_reported_reporter = true;
+	}
+	if (ble_stub.scanning && ble_stub.neighbour && !scan_reported_neighbour) {
+		/* closer, heard first */
+		reporter_scan_info(&neighbour_addr, neighbour_adv, sizeof(neighbour_adv),
+				-40, scan_delay_us() / 2);
+		scan_reported_neighbour = true;
+	}
+}
+
+static void reporter_connectable(void)
+{
+	ble_stub_params_t *p;
+	uint8_t idx;
+
+	if (!ble_stub.connecting || !ble_stub_reporter.advertising ||
+			!same_addr(&ble_stub.connect_addr, &ble_stub_reporter.addr)) {
+		return;
+	}
+	for (idx = 0; idx < BLE_STUB_QUEUE; idx++) {
+		if (queue[idx].used && (queue[idx].event == AT_BLE_CONNECTED)) {
+			return;
+		}
+	}
+	p = post(AT_BLE_CONNECTED, ble_stub.now_us + BLE_STUB_ADV_INTERVAL_US, false,
+			sizeof(p->connected));
+	p->connected.peer_addr = ble_stub_reporter.addr;
+	p->connected.handle = BLE_STUB_CONN_HANDLE;
+	p->connected.conn_status = AT_BLE_SUCCESS;
+	p->connected.conn_params.con_interval = CONN_INTERVAL;
+	p->connected.conn_params.con_latency = 0;
+	p->connected.conn_params.sup_to = CONN_SUP_TO;
+}
+
+static void reporter_write(uint16_t handle, const uint8_t *data, uint8_t len)
+{
+	ble_stub_attr_t *attr = attr_at(handle);
+	trace_rec_t rec[TRACE_PACKET_SIZE / TRACE_RECORD_SIZE];
+	uint8_t seq;
+	int records;
+
+	if (attr == NULL) {
+		return;
+	}
+	if ((attr->type == BLE_STUB_CCCD) && (len >= 2)) {
+		attr->cccd = (uint16_t)(data[0] | (data[1] << 8));
+		reporter_queue_timeline();
+		reporter_indicate_changes();
+	} else if (attr->type == PERCEPTION_DIAG_CHAR_UUID) {
+		records = trace_ring_decode(data, len, &seq, rec,
+				sizeof(rec) / sizeof(rec[0]));
+		if (records >= 0) {
+			ble_stub_reporter.trace_packets++;
+			ble_stub_reporter.trace_records += (unsigned)records;
+		}
+	}
+}
+
+/* Applies what an event means for the stack and the reporter once the
+ * central sees it */
+static void deliver(ble_stub_entry_t *entry)
+{
+	ble_stub_params_t *p = &entry->params;
+	ble_stub_params_t *next;
+	uint8_t idx;
+
+	if (entry->ends_discovery && (ble_stub.discoveries > 0)) {
+		ble_stub.discoveries--;
+	}
+
+	switch (entry->event) {
+	case AT_BLE_SCAN_REPORT:
+		ble_stub.scanning = false;
+		break;
+
+	case AT_BLE_CONNECTED:
+		ble_stub.connecting = false;
+		ble_stub.connected = true;
+		ble_stub.link_lost = false;
+		ble_stub.gatt_busy_us = ble_stub.now_us;
+		ble_stub.mtu = AT_MTU_VAL_MIN;
+		ble_stub_reporter.connected = true;
+		ble_stub_reporter.advertising = false;
+		ble_stub_reporter.encrypted = false;
+		ble_stub_reporter.connections++;
+		/* The reporter wants a bonded link */
+		next = post(AT_BLE_SLAVE_SEC_REQUEST, ble_stub.now_us + 2 * BLE_STUB_INTERVAL_US,
+				true, sizeof(next->sec_request));
+		next->sec_request.handle = BLE_STUB_CONN_HANDLE;
+		next->sec_request.status = AT_BLE_SUCCESS;
+		next->sec_request.bond = true;
+		next->sec_request.mitm_protection = false;
+		/* A bonded central keeps its configuration */
+		reporter_queue_timeline();
+		break;
+
+	case AT_BLE_DISCONNECTED:
+		flush_link();
+		ble_stub.connected = false;
+		ble_stub.link_lost = false;
+		ble_stub.mtu = AT_MTU_VAL_MIN;
+		ble_stub_reporter.connected = false;
+		ble_stub_reporter.encrypted = false;
+		if (!ble_stub_reporter.bonded) {
+			for (idx = 0; idx < ble_stub_reporter.attrs; idx++) {
+				ble_stub_reporter.attr[idx].cccd = 0;
+			}
+		}
+		ble_stub_reporter.advertising = ble_stub_reporter.readvertise;
+		reporter_heard();
+		reporter_connectable();
+		break;
+
+	case AT_BLE_PAIR_DONE:
+		if (p->pair_done.status == AT_BLE_SUCCESS) {
+			ble_stub_reporter.bonded = true;
+			ble_stub_reporter.encrypted = true;
+			reporter_indicate_changes();
+		}
+		break;
+
+	case AT_BLE_ENCRYPTION_STATUS_CHANGED:
+		if (p->encryption.status == AT_BLE_SUCCESS) {
+			ble_stub_reporter.encrypted = true;
+			reporter_indicate_changes();
+		}
+		break;
+
+	case AT_BLE_MTU_CHANGED_INDICATION:
+		ble_stub.mtu = p->mtu.mtu_value;
+		break;
+
+	case AT_BLE_CHARACTERISTIC_WRITE_RESPONSE:
+		if (p->write.status == AT_BLE_SUCCESS) {
+			reporter_write(entry->write_handle, entry->write_data, entry->write_len);
+		}
+		break;
+
+	case AT_BLE_CHARACTERISTIC_WRITE_CMD_CMP:
+		if (ble_stub.tx_buffers > 0) {
+			ble_stub.tx_buffers--;
+		}
+		reporter_write(entry->write_handle, entry->write_data, entry->write_len);
+		break;
+
+	case AT_BLE_NOTIFICATION_RECIEVED:
+		ble_stub_reporter.timeline_queued = false;
+		ble_stub_reporter.timelines++;
+		ble_stub_reporter.timeline_seq++;
+		reporter_queue_timeline();
+		break;
+
+	case AT_BLE_INDICATION_RECIEVED:
+		indication_queued = false;
+		ble_stub_reporter.indications++;
+		ble_stub_reporter.changed_start = 0;
+		ble_stub_reporter.changed_end = 0;
+		break;
+
+	case AT_PLATFORM_EVENT:
+		if (ble_stub.timer_expired != NULL) {
+			ble_stub.timer_expired();
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*- Simulation control -----------------------------------------------------*/
+void ble_stub_reset(void)
+{
+	static const at_ble_addr_t reporter_addr = {
+		AT_BLE_ADDRESS_PUBLIC, {0x66, 0x55, 0x44, 0x33, 0x22, 0x11}
+	};
+
+	memset(queue, 0, sizeof(queue));
+	queue_seq = 0;
+	memset(&ble_stub, 0, sizeof(ble_stub));
+	ble_stub.mtu = AT_MTU_VAL_MIN;
+	ble_stub.neighbour = true;
+	central_mtu = AT_MTU_VAL_MIN;
+	scan_reported_reporter = false;
+	scan_reported_neighbour = false;
+	indication_queued = false;
+
+	memset(&ble_stub_reporter, 0, sizeof(ble_stub_reporter));
+	ble_stub_reporter.addr = reporter_addr;
+	ble_stub_reporter.rssi = -50;
+	ble_stub_reporter.advertising = true;
+	ble_stub_reporter.readvertise = true;
+	ble_stub_reporter.layout = BLE_STUB_LAYOUT_BASE;
+	table_build(ble_stub_reporter.attr, &ble_stub_reporter.attrs, BLE_STUB_LAYOUT_BASE);
+}
+
+void ble_stub_layout(ble_stub_layout_t layout)
+{
+	ble_stub_attr_t attr[BLE_STUB_ATTRS];
+	ble_stub_attr_t *old;
+	uint8_t attrs;
+	uint8_t idx;
+	uint16_t first = 0;
+
+	table_build(attr, &attrs, layout);
+	for (idx = 0; idx < attrs; idx++) {
+		old = attr_at(attr[idx].handle);
+		if ((first == 0) && ((old == NULL) || (old->type != attr[idx].type) ||
+				(old->uuid != attr[idx].uuid))) {
+			first = attr[idx].handle;
+		}
+	}
+	if ((first == 0) && (attrs != ble_stub_reporter.attrs)) {
+		first = (uint16_t)(attrs + 1);
+	}
+	/* The configuration of the characteristics that stay is kept */
+	for (idx = 0; idx < attrs; idx++) {
+		if ((attr[idx].type == BLE_STUB_CCCD) && (cccd_of(attr[idx].uuid) != NULL)) {
+			attr[idx].cccd = cccd_of(attr[idx].uuid)->cccd;
+		}
+	}
+	memcpy(ble_stub_reporter.attr, attr, sizeof(attr));
+	ble_stub_reporter.attrs = attrs;
+	ble_stub_reporter.layout = layout;
+
+	if ((first != 0) && (ble_stub_reporter.bonded || ble_stub_reporter.connected)) {
+		if ((ble_stub_reporter.changed_start == 0) ||
+				(first < ble_stub_reporter.changed_start)) {
+			ble_stub_reporter.changed_start = first;
+		}
+		ble_stub_reporter.changed_end = 0xFFFF;
+		reporter_indicate_changes();
+	}
+}
+
+void ble_stub_advertise(bool on)
+{
+	uint8_t idx;
+
+	ble_stub_reporter.readvertise = on;
+	ble_stub_reporter.advertising = on && !ble_stub_reporter.connected;
+	if (ble_stub_reporter.advertising) {
+		reporter_heard();
+		reporter_connectable();
+	} else {
+		for (idx = 0; idx < BLE_STUB_QUEUE; idx++) {
+			if (queue[idx].used && (queue[idx].event == AT_BLE_CONNECTED)) {
+				queue[idx].used = false;
+			}
+		}
+	}
+}
+
+void ble_stub_link_loss(void)
+{
+	ble_stub_params_t *p;
+
+	if (!ble_stub.connected || ble_stub.link_lost) {
+		return;
+	}
+	flush_link();
+	ble_stub.link_lost = true;
+	p = post(AT_BLE_DISCONNECTED, ble_stub.now_us + BLE_STUB_SUPERVISION_US, false,
+			sizeof(p->disconnected));
+	p->disconnected.handle = BLE_STUB_CONN_HANDLE;
+	p->disconnected.reason = AT_BLE_SUPERVISION_TIMEOUT;
+}
+
+void ble_stub_fail(ble_stub_call_t which, at_ble_status_t status)
+{
+	ble_stub.fail[which] = status;
+}
+
+void ble_stub_timer_start(uint64_t us)
+{
+	remove_events(AT_PLATFORM_EVENT);
+	post(AT_PLATFORM_EVENT, ble_stub.now_us + us, false, 0);
+}
+
+void ble_stub_timer_stop(void)
+{
+	remove_events(AT_PLATFORM_EVENT);
+}
+
+const char *ble_stub_event_name(at_ble_events_t event)
+{
+	switch (event) {
+	case AT_BLE_SCAN_INFO: return "SCAN_INFO";
+	case AT_BLE_SCAN_REPORT: return "SCAN_REPORT";
+	case AT_BLE_CONNECTED: return "CONNECTED";
+	case AT_BLE_DISCONNECTED: return "DISCONNECTED";
+	case AT_BLE_PAIR_DONE: return "PAIR_DONE";
+	case AT_BLE_SLAVE_SEC_REQUEST: return "SLAVE_SEC_REQUEST";
+	case AT_BLE_ENCRYPTION_STATUS_CHANGED: return "ENCRYPTION_STATUS_CHANGED";
+	case AT_BLE_PRIMARY_SERVICE_FOUND: return "PRIMARY_SERVICE_FOUND";
+	case AT_BLE_CHARACTERISTIC_FOUND: return "CHARACTERISTIC_FOUND";
+	case AT_BLE_DESCRIPTOR_FOUND: return "DESCRIPTOR_FOUND";
+	case AT_BLE_DISCOVERY_COMPLETE: return "DISCOVERY_COMPLETE";
+	case AT_BLE_CHARACTERISTIC_READ_RESPONSE: return "READ_RESPONSE";
+	case AT_BLE_CHARACTERISTIC_WRITE_RESPONSE: return "WRITE_RESPONSE";
+	case AT_BLE_NOTIFICATION_RECIEVED: return "NOTIFICATION";
+	case AT_BLE_INDICATION_RECIEVED: return "INDICATION";
+	case AT_BLE_MTU_CHANGED_INDICATION: return "MTU_CHANGED_INDICATION";
+	case AT_BLE_MTU_CHANGED_CMD_COMPLETE: return "MTU_CHANGED_CMD_COMPLETE";
+	case AT_BLE_CHARACTERISTIC_WRITE_CMD_CMP: return "WRITE_CMD_CMP";
+	case AT_PLATFORM_EVENT: return "PLATFORM_EVENT";
+	default: return "EVENT";
+	}
+}
+
+/*- at_ble_api.h -----------------------------------------------------------*/
+at_ble_status_t at_ble_event_get(at_ble_events_t *event, void *params,
+		uint32_t timeout)
+{
+	ble_stub_entry_t *next = NULL;
+	ble_stub_entry_t entry;
+	uint8_t idx;
+
+	UNUSED(timeout);
+	for (idx = 0; idx < BLE_STUB_QUEUE; idx++) {
+		if (queue[idx].used && ((next == NULL) || (queue[idx].due_us < next->due_us) ||
+				((queue[idx].due_us == next->due_us) && (queue[idx].seq < next->seq)))) {
+			next = &queue[idx];
+		}
+	}
+	if ((next == NULL) || (next->due_us > ble_stub.until_us)) {
+		if (ble_stub.now_us < ble_stub.until_us) {
+			ble_stub.now_us = ble_stub.until_us;
+		}
+		return AT_BLE_TIMEOUT;
+	}
+
+	entry = *next;
+	next->used = false;
+	if (ble_stub.now_us < entry.due_us) {
+		ble_stub.now_us = entry.due_us;
+	}
+	*event = entry.event;
+	memcpy(params, &entry.params, entry.len);
+	deliver(&entry);
+	ble_stub.events++;
+	if (ble_stub.delivered != NULL) {
+		ble_stub.delivered(*event, params);
+	}
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_init(at_ble_init_config_t *args)
+{
+	UNUSED(args);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_addr_get(at_ble_addr_t *address)
+{
+	static const at_ble_addr_t central_addr = {
+		AT_BLE_ADDRESS_PUBLIC, {0xAB, 0xCD, 0xEF, 0xAB, 0xCD, 0xEF}
+	};
+
+	*address = central_addr;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_addr_set(at_ble_addr_t *address)
+{
+	UNUSED(address);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_set_dev_config(at_ble_dev_config_t *config)
+{
+	central_mtu = config->max_mtu;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_device_name_set(uint8_t *dev_name, uint8_t len)
+{
+	UNUSED(dev_name);
+	UNUSED(len);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_adv_data_set(uint8_t const *const adv_data,
+		uint8_t adv_data_len, uint8_t const *const scan_resp_data,
+		uint8_t scan_response_data_len)
+{
+	UNUSED(adv_data);
+	UNUSED(adv_data_len);
+	UNUSED(scan_resp_data);
+	UNUSED(scan_response_data_len);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_scan_start(uint16_t interval, uint16_t window,
+		uint16_t timeout, at_ble_scan_type_t type, at_ble_scan_mode_t mode,
+		bool filter_whitelist, bool filter_dublicates)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_SCAN_START);
+	ble_stub_params_t *p;
+
+	UNUSED(type);
+	UNUSED(mode);
+	UNUSED(filter_whitelist);
+	UNUSED(filter_dublicates);
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (ble_stub.scanning || ble_stub.connecting) {
+		return AT_BLE_INVALID_STATE;
+	}
+	ble_stub.scanning = true;
+	scan_interval = interval;
+	scan_window = window;
+	scan_reported_reporter = false;
+	scan_reported_neighbour = false;
+	reporter_heard();
+	if (timeout != 0) {
+		p = post(AT_BLE_SCAN_REPORT, ble_stub.now_us + timeout * 1000000ull, false,
+				sizeof(p->scan_report));
+		p->scan_report.status = AT_BLE_SUCCESS;
+	}
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_scan_stop(void)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_SCAN_STOP);
+
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.scanning) {
+		return AT_BLE_INVALID_STATE;
+	}
+	remove_events(AT_BLE_SCAN_INFO);
+	remove_events(AT_BLE_SCAN_REPORT);
+	ble_stub.scanning = false;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_connect(at_ble_addr_t peers[], uint8_t peer_count,
+		uint16_t scan_interval, uint16_t scan_window,
+		at_ble_connection_params_t *connection_params)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_CONNECT);
+
+	UNUSED(scan_interval);
+	UNUSED(scan_window);
+	UNUSED(connection_params);
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if ((peer_count == 0) || ble_stub.connecting || ble_stub.connected ||
+			ble_stub.scanning) {
+		return AT_BLE_INVALID_STATE;
+	}
+	ble_stub.connecting = true;
+	ble_stub.connect_addr = peers[0];
+	reporter_connectable();
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_connect_cancel(void)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_CONNECT_CANCEL);
+
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connecting) {
+		return AT_BLE_INVALID_STATE;
+	}
+	remove_events(AT_BLE_CONNECTED);
+	ble_stub.connecting = false;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_disconnect(at_ble_handle_t handle, at_ble_disconnect_reason_t reason)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_DISCONNECT);
+	ble_stub_params_t *p;
+
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connected || (handle != BLE_STUB_CONN_HANDLE)) {
+		return AT_BLE_INVALID_STATE;
+	}
+	if (ble_stub.link_lost) {
+		return AT_BLE_SUCCESS;
+	}
+	flush_link();
+	ble_stub.link_lost = true;
+	p = post(AT_BLE_DISCONNECTED, ble_stub.now_us + BLE_STUB_INTERVAL_US, false,
+			sizeof(p->disconnected));
+	p->disconnected.handle = handle;
+	p->disconnected.reason = (uint8_t)reason;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_conn_update_reply(at_ble_handle_t handle, bool accept,
+		uint16_t ce_len_min, uint16_t ce_len_max)
+{
+	UNUSED(handle);
+	UNUSED(accept);
+	UNUSED(ce_len_min);
+	UNUSED(ce_len_max);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_exchange_mtu(at_ble_handle_t conn_handle)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_EXCHANGE_MTU);
+	ble_stub_params_t *p;
+	uint64_t due;
+
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connected) {
+		return AT_BLE_INVALID_STATE;
+	}
+	if (ble_stub.link_lost) {
+		return AT_BLE_SUCCESS;
+	}
+	due = att_slot();
+	p = post(AT_BLE_MTU_CHANGED_INDICATION, due, true, sizeof(p->mtu));
+	p->mtu.conhdl = conn_handle;
+	p->mtu.mtu_value = (central_mtu < BLE_STUB_MTU) ? central_mtu : BLE_STUB_MTU;
+	p = post(AT_BLE_MTU_CHANGED_CMD_COMPLETE, due, true, sizeof(p->complete));
+	p->complete.conn_handle = conn_handle;
+	p->complete.status = AT_BLE_SUCCESS;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_send_slave_sec_request(at_ble_handle_t conn_handle,
+		bool mitm_protection, bool bond)
+{
+	UNUSED(conn_handle);
+	UNUSED(mitm_protection);
+	UNUSED(bond);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_authenticate(at_ble_handle_t conn_handle,
+		at_ble_pair_features_t *features, at_ble_LTK_t *ltk, at_ble_CSRK_t *csrk)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_AUTHENTICATE);
+	ble_stub_params_t *p;
+
+	UNUSED(features);
+	UNUSED(ltk);
+	UNUSED(csrk);
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connected) {
+		return AT_BLE_INVALID_STATE;
+	}
+	if (ble_stub.link_lost) {
+		return AT_BLE_SUCCESS;
+	}
+	p = post(AT_BLE_PAIR_DONE,
+			ble_stub.now_us + BLE_STUB_PAIRING_INTERVALS * BLE_STUB_INTERVAL_US,
+			true, sizeof(p->pair_done));
+	p->pair_done.handle = conn_handle;
+	p->pair_done.status = AT_BLE_SUCCESS;
+	p->pair_done.auth = AT_BLE_AUTH_NO_MITM_BOND;
+	memset(p->pair_done.peer_ltk.key, 0x5A, AT_BLE_MAX_KEY_LEN);
+	p->pair_done.peer_ltk.key_size = AT_BLE_MAX_KEY_LEN;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_encryption_start(at_ble_handle_t conn_handle,
+		at_ble_LTK_t *key, at_ble_auth_t auth)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_ENCRYPTION_START);
+	ble_stub_params_t *p;
+
+	UNUSED(key);
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connected) {
+		return AT_BLE_INVALID_STATE;
+	}
+	if (ble_stub.link_lost) {
+		return AT_BLE_SUCCESS;
+	}
+	p = post(AT_BLE_ENCRYPTION_STATUS_CHANGED,
+			ble_stub.now_us + BLE_STUB_ENCRYPTION_INTERVALS * BLE_STUB_INTERVAL_US,
+			true, sizeof(p->encryption));
+	p->encryption.handle = conn_handle;
+	/* A reporter that lost the bond has no key */
+	p->encryption.status = ble_stub_reporter.bonded ? AT_BLE_SUCCESS : AT_BLE_FAILURE;
+	p->encryption.authen = auth;
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_encryption_request_reply(at_ble_handle_t conn_handle,
+		at_ble_auth_t auth, bool key_found, at_ble_LTK_t *key)
+{
+	UNUSED(conn_handle);
+	UNUSED(auth);
+	UNUSED(key_found);
+	UNUSED(key);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_pair_key_reply(at_ble_handle_t conn_handle,
+		at_ble_pair_key_type_t type, uint8_t *key)
+{
+	UNUSED(conn_handle);
+	UNUSED(type);
+	UNUSED(key);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_random_address_resolve(uint8_t nb_key, at_ble_addr_t *rand_addr,
+		uint8_t *irk_key)
+{
+	UNUSED(nb_key);
+	UNUSED(rand_addr);
+	UNUSED(irk_key);
+	return AT_BLE_FAILURE;
+}
+
+/* Starts a discovery procedure, the stack queues it behind the others */
+static at_ble_status_t discovery_start(ble_stub_call_t which)
+{
+	at_ble_status_t status = call(which);
+
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connected) {
+		return AT_BLE_INVALID_STATE;
+	}
+	if (ble_stub.link_lost) {
+		return AT_BLE_SUCCESS;
+	}
+	if (ble_stub.discoveries > 0) {
+		ble_stub.discovery_overlaps++;
+	}
+	ble_stub.discoveries++;
+	return AT_BLE_SUCCESS;
+}
+
+/* One round trip more for the Attribute Not Found that ends a discovery */
+static void discovery_complete(at_ble_handle_t conn_handle)
+{
+	ble_stub_params_t *p;
+
+	p = post(AT_BLE_DISCOVERY_COMPLETE, att_slot(), true, sizeof(p->complete));
+	p->complete.conn_handle = conn_handle;
+	p->complete.status = AT_BLE_ATT_ATTRIBUTE_NOT_FOUND;
+	entry_of(p)->ends_discovery = true;
+}
+
+at_ble_status_t at_ble_primary_service_discover_all(at_ble_handle_t conn_handle,
+		at_ble_handle_t start_handle, at_ble_handle_t end_handle)
+{
+	at_ble_status_t status = discovery_start(BLE_STUB_CALL_SERVICE_DISCOVER);
+	ble_stub_attr_t *attr;
+	ble_stub_params_t *p;
+	uint8_t idx;
+
+	if ((status != AT_BLE_SUCCESS) || ble_stub.link_lost) {
+		return status;
+	}
+	for (idx = 0; idx < ble_stub_reporter.attrs; idx++) {
+		attr = &ble_stub_reporter.attr[idx];
+		if ((attr->type == BLE_STUB_PRIMARY_SERVICE) &&
+				(attr->handle >= start_handle) && (attr->handle <= end_handle)) {
+			p = post(AT_BLE_PRIMARY_SERVICE_FOUND, att_slot(), true, sizeof(p->service));
+			p->service.conn_handle = conn_handle;
+			p->service.start_handle = attr->handle;
+			p->service.end_handle = service_end(idx);
+			uuid16(&p->service.service_uuid, attr->uuid);
+		}
+	}
+	discovery_complete(conn_handle);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_characteristic_discover_all(at_ble_handle_t conn_handle,
+		at_ble_handle_t start_handle, at_ble_handle_t end_handle)
+{
+	at_ble_status_t status = discovery_start(BLE_STUB_CALL_CHAR_DISCOVER);
+	ble_stub_attr_t *attr;
+	ble_stub_params_t *p;
+	uint8_t idx;
+
+	if ((status != AT_BLE_SUCCESS) || ble_stub.link_lost) {
+		return status;
+	}
+	for (idx = 0; idx < ble_stub_reporter.attrs; idx++) {
+		attr = &ble_stub_reporter.attr[idx];
+		if ((attr->type == BLE_STUB_CHARACTERISTIC) &&
+				(attr->handle >= start_handle) && (attr->handle <= end_handle)) {
+			p = post(AT_BLE_CHARACTERISTIC_FOUND, att_slot(), true,
+					sizeof(p->characteristic));
+			p->characteristic.conn_handle = conn_handle;
+			p->characteristic.char_handle = attr->handle;
+			p->characteristic.value_handle = (at_ble_handle_t)(attr->handle + 1);
+			p->characteristic.properties = attr->properties;
+			uuid16(&p->characteristic.char_uuid, attr->uuid);
+		}
+	}
+	discovery_complete(conn_handle);
+	return AT_BLE_SUCCESS;
+}
+
+/* Find Information reports every attribute in the range with its type */
+at_ble_status_t at_ble_descriptor_discover_all(at_ble_handle_t conn_handle,
+		at_ble_handle_t start_handle, at_ble_handle_t end_handle)
+{
+	at_ble_status_t status = discovery_start(BLE_STUB_CALL_DESC_DISCOVER);
+	ble_stub_attr_t *attr;
+	ble_stub_params_t *p;
+	uint8_t idx;
+
+	if ((status != AT_BLE_SUCCESS) || ble_stub.link_lost) {
+		return status;
+	}
+	for (idx = 0; idx < ble_stub_reporter.attrs; idx++) {
+		attr = &ble_stub_reporter.attr[idx];
+		if ((attr->handle >= start_handle) && (attr->handle <= end_handle)) {
+			p = post(AT_BLE_DESCRIPTOR_FOUND, att_slot(), true, sizeof(p->descriptor));
+			p->descriptor.conn_handle = conn_handle;
+			p->descriptor.desc_handle = attr->handle;
+			uuid16(&p->descriptor.desc_uuid, attr->type);
+		}
+	}
+	discovery_complete(conn_handle);
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_characteristic_read(at_ble_handle_t conn_handle,
+		at_ble_handle_t char_handle, uint16_t offset, uint16_t length)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_READ);
+	ble_stub_params_t *p;
+
+	UNUSED(offset);
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connected) {
+		return AT_BLE_INVALID_STATE;
+	}
+	if (ble_stub.link_lost) {
+		return AT_BLE_SUCCESS;
+	}
+	p = post(AT_BLE_CHARACTERISTIC_READ_RESPONSE, att_slot(), true, sizeof(p->read));
+	p->read.conn_handle = conn_handle;
+	p->read.char_handle = char_handle;
+	if (attr_at(char_handle) == NULL) {
+		p->read.status = AT_BLE_ATT_INVALID_HANDLE;
+	} else {
+		p->read.status = AT_BLE_SUCCESS;
+		p->read.char_len = (length < 6) ? length : 6;
+		p->read.char_value[0] = (uint8_t)char_handle;
+		p->read.char_value[1] = (uint8_t)(char_handle >> 8);
+	}
+	return AT_BLE_SUCCESS;
+}
+
+at_ble_status_t at_ble_characteristic_write(at_ble_handle_t conn_handle,
+		at_ble_handle_t char_handle, uint16_t offset, uint16_t length, uint8_t *data,
+		bool signed_write, bool with_response)
+{
+	at_ble_status_t status = call(BLE_STUB_CALL_WRITE);
+	ble_stub_attr_t *attr = attr_at(char_handle);
+	ble_stub_entry_t *entry;
+	ble_stub_params_t *p;
+
+	UNUSED(offset);
+	UNUSED(signed_write);
+	if (status != AT_BLE_SUCCESS) {
+		return status;
+	}
+	if (!ble_stub.connected) {
+		return AT_BLE_INVALID_STATE;
+	}
+	if (!with_response && (ble_stub.tx_buffers >= BLE_STUB_TX_BUFFERS)) {
+		return AT_BLE_BUSY;
+	}
+	if (ble_stub.link_lost) {
+		return AT_BLE_SUCCESS;
+	}
+
+	if (with_response) {
+		p = post(AT_BLE_CHARACTERISTIC_WRITE_RESPONSE, att_slot(), true, sizeof(p->write));
+		p->write.conn_handle = conn_handle;
+		p->write.char_handle = char_handle;
+		if (attr == NULL) {
+			p->write.status = AT_BLE_ATT_INVALID_HANDLE;
+		} else if ((attr->type == BLE_STUB_PRIMARY_SERVICE) ||
+				(attr->type == BLE_STUB_CHARACTERISTIC) ||
+				((attr->type != BLE_STUB_CCCD) && !(attr->properties & PROP_WRITE))) {
+			p->write.status = AT_BLE_ATT_WRITE_NOT_PERMITTED;
+		} else {
+			p->write.status = AT_BLE_SUCCESS;
+		}
+	} else {
+		/* Sent in the next connection event, outside the request queue */
+		ble_stub.tx_buffers++;
+		p = post(AT_BLE_CHARACTERISTIC_WRITE_CMD_CMP,
+				ble_stub.now_us + BLE_STUB_INTERVAL_US, true, sizeof(p->complete));
+		p->complete.conn_handle = conn_handle;
+		p->complete.status = AT_BLE_SUCCESS;
+	}
+	entry = entry_of(p);
+	entry->write_handle = char_handle;
+	entry->write_len = (uint8_t)((length < WRITE_DATA_MAX) ? length : WRITE_DATA_MAX);
+	memcpy(entry->write_data, data, entry->write_len);
+	return AT_BLE_SUCCESS;
+}
+
+/*- console_serial.h -------------------------------------------------------*/
+int getchar_b11(void)
+{
+	return 's';
+}
+
+int getchar_b11_timeout(unsigned int sec)
+{
+	UNUSED(sec);
+	return 0;
+}
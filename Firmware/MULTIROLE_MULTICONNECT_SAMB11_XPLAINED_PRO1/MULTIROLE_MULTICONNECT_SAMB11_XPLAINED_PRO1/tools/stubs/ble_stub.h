@@ -0,0 +1,225 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the BLE stack with a scripted Perception reporter
+ *
+ * Implements the at_ble_* calls of ble_manager.c and pxp_monitor.c against
+ * a virtual microsecond clock and one simulated reporter, so the Perception
+ * central runs unchanged on the host. Requests are answered through
+ * at_ble_event_get() with the events the stack would send. The stack
+ * queues the GATT requests of the link and serves them in order, one ATT
+ * round trip per connection interval.
+ *
+ * The reporter advertises the Perception service and asks for bonding once
+ * connected. It keeps the bond and, for a bonded central, the CCCD values
+ * across connections, as a bonded GATT server must. When its attribute
+ * table changes it indicates the changed range on Service Changed: right
+ * away to a connected central that enabled the indications, otherwise to
+ * the bonded central once the next connection is encrypted. It sends a
+ * haptic timeline, a 4 byte sequence number, every notify period while the
+ * timeline CCCD enables notifications, and decodes the trace packets
+ * written to its diagnostics characteristic.
+ *
+ * A non-Perception device advertises next to it, closer, to check the
+ * central's advertiser selection.
+ *
+ * Faults: the next call of an at_ble function fails with a given status,
+ * the link is lost, the reporter stops advertising or changes its table.
+ *
+ * Put the stub directory first on the include path, with the SDK include
+ * directories after it.
+ */
+
+#ifndef BLE_STUB_H_INCLUDED
+#define BLE_STUB_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "at_ble_api.h"
+
+/* Only link of the central */
+#define BLE_STUB_CONN_HANDLE            (0)
+
+/* One ATT request and its response */
+#define BLE_STUB_INTERVAL_US            (30000ull)
+
+#define BLE_STUB_ADV_INTERVAL_US        (100000ull)
+
+/* GAP_SUPERVISION_TIMOUT */
+#define BLE_STUB_SUPERVISION_US         (1000000ull)
+
+/* Connection events taken by the security procedures */
+#define BLE_STUB_PAIRING_INTERVALS      (4)
+#define BLE_STUB_ENCRYPTION_INTERVALS   (2)
+
+/* Write commands the link buffers, AT_BLE_BUSY beyond */
+#define BLE_STUB_TX_BUFFERS             (4)
+
+/* MTU the reporter accepts */
+#define BLE_STUB_MTU                    (185)
+
+#define BLE_STUB_NOTIFY_PERIOD_US       (100000ull)
+
+#define BLE_STUB_ATTRS                  (40)
+
+#define BLE_STUB_QUEUE                  (64)
+
+/* UUIDs of the reporter's table besides those in ble_manager.h */
+#define BLE_STUB_GAP_SERVICE_UUID       (0x1800)
+#define BLE_STUB_DEVICE_NAME_UUID       (0x2A00)
+#define BLE_STUB_APPEARANCE_UUID        (0x2A01)
+#define BLE_STUB_BATTERY_SERVICE_UUID   (0x180F)
+#define BLE_STUB_BATTERY_LEVEL_UUID     (0x2A19)
+#define BLE_STUB_MOTOR_LEVELS_UUID      (0x7A11)
+
+#define BLE_STUB_PRIMARY_SERVICE        (0x2800)
+#define BLE_STUB_CHARACTERISTIC         (0x2803)
+#define BLE_STUB_CCCD                   (0x2902)
+
+typedef enum {
+	/* GAP, GATT with Service Changed, Perception */
+	BLE_STUB_LAYOUT_BASE = 0,
+	/* a Battery service before Perception, every Perception handle moves
+	 * and the cached timeline CCCD handle becomes a declaration */
+	BLE_STUB_LAYOUT_BATTERY,
+	/* a notifying characteristic before the timeline, the cached timeline
+	 * CCCD handle becomes the CCCD of the new characteristic */
+	BLE_STUB_LAYOUT_LEVELS
+} ble_stub_layout_t;
+
+typedef enum {
+	BLE_STUB_CALL_SCAN_START = 0,
+	BLE_STUB_CALL_SCAN_STOP,
+	BLE_STUB_CALL_CONNECT,
+	BLE_STUB_CALL_CONNECT_CANCEL,
+	BLE_STUB_CALL_DISCONNECT,
+	BLE_STUB_CALL_EXCHANGE_MTU,
+	BLE_STUB_CALL_AUTHENTICATE,
+	BLE_STUB_CALL_ENCRYPTION_START,
+	BLE_STUB_CALL_SERVICE_DISCOVER,
+	BLE_STUB_CALL_CHAR_DISCOVER,
+	BLE_STUB_CALL_DESC_DISCOVER,
+	BLE_STUB_CALL_READ,
+	BLE_STUB_CALL_WRITE,
+	BLE_STUB_CALLS
+} ble_stub_call_t;
+
+typedef struct ble_stub_attr {
+	uint16_t handle;
+	/* BLE_STUB_PRIMARY_SERVICE, BLE_STUB_CHARACTERISTIC, BLE_STUB_CCCD or
+	 * the characteristic UUID for a value */
+	uint16_t type;
+	/* declared service or characteristic UUID */
+	uint16_t uuid;
+	uint8_t properties;
+	/* CCCD value */
+	uint16_t cccd;
+} ble_stub_attr_t;
+
+typedef struct ble_stub_reporter {
+	at_ble_addr_t addr;
+	int8_t rssi;
+	bool advertising;
+	/* advertise again when the link is gone */
+	bool readvertise;
+	bool connected;
+	bool encrypted;
+	/* keys exchanged with the central, kept across connections */
+	bool bonded;
+	ble_stub_layout_t layout;
+	ble_stub_attr_t attr[BLE_STUB_ATTRS];
+	uint8_t attrs;
+	/* changed range still to indicate, changed_start 0 if none */
+	uint16_t changed_start;
+	uint16_t changed_end;
+	/* sequence number of the next timeline */
+	uint32_t timeline_seq;
+	bool timeline_queued;
+	/* statistics */
+	unsigned connections;
+	unsigned timelines;
+	unsigned indications;
+	unsigned trace_packets;
+	unsigned trace_records;
+} ble_stub_reporter_t;
+
+typedef struct ble_stub_stack {
+	uint64_t now_us;
+	/* at_ble_event_get() delivers no event due after this time */
+	uint64_t until_us;
+	bool scanning;
+	bool connecting;
+	at_ble_addr_t connect_addr;
+	bool connected;
+	/* lost, the stack still takes requests until the supervision timeout */
+	bool link_lost;
+	uint16_t mtu;
+	/* the GATT requests queued so far are served by then */
+	uint64_t gatt_busy_us;
+	/* discovery procedures queued and not completed */
+	uint8_t discoveries;
+	/* a discovery started while another was queued */
+	unsigned discovery_overlaps;
+	uint8_t tx_buffers;
+	bool neighbour;
+	unsigned calls[BLE_STUB_CALLS];
+	/* status of the next call, AT_BLE_SUCCESS for none */
+	at_ble_status_t fail[BLE_STUB_CALLS];
+	/* events delivered */
+	unsigned events;
+	/* called before at_ble_event_get() returns an event */
+	void (*delivered)(at_ble_events_t event, const void *params);
+	/* the timer of hw_timer_start() expired */
+	void (*timer_expired)(void);
+} ble_stub_stack_t;
+
+extern ble_stub_stack_t ble_stub;
+
+extern ble_stub_reporter_t ble_stub_reporter;
+
+/**@brief Empty the queue, reset the stack and the reporter, advertising
+ * the base layout, and the neighbour advertising
+ */
+void ble_stub_reset(void);
+
+/**@brief Change the reporter's attribute table
+ */
+void ble_stub_layout(ble_stub_layout_t layout);
+
+/**@brief Start or stop the reporter's advertising
+ */
+void ble_stub_advertise(bool on);
+
+/**@brief Lose the link, the stack reports it after the supervision timeout
+ */
+void ble_stub_link_loss(void);
+
+/**@brief Fail the next call of an at_ble function with status
+ */
+void ble_stub_fail(ble_stub_call_t call, at_ble_status_t status);
+
+/**@brief Start the one-shot timer behind hw_timer_start(), a restart
+ * replaces the running one
+ */
+void ble_stub_timer_start(uint64_t us);
+
+void ble_stub_timer_stop(void);
+
+/**@brief Handle of an attribute of the reporter's current table
+ *
+ * @param[in] type BLE_STUB_CCCD for the CCCD of the characteristic, else
+ * its value
+ *
+ * @return 0 if the table has no such attribute
+ */
+uint16_t ble_stub_handle(uint16_t char_uuid, uint16_t type);
+
+/**@brief CCCD value of a characteristic in the reporter's current table
+ */
+uint16_t ble_stub_cccd(uint16_t char_uuid);
+
+/**@brief Name of an event for the logs
+ */
+const char *ble_stub_event_name(at_ble_events_t event);
+
+#endif /* BLE_STUB_H_INCLUDED */
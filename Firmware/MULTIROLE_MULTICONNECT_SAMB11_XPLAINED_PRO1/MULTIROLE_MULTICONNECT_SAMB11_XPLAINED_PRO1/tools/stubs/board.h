@@ -0,0 +1,14 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the board definitions
+ *
+ * The pin numbers come from the part's pio header, included by asf.h.
+ */
+
+#ifndef STUB_BOARD_H_INCLUDED
+#define STUB_BOARD_H_INCLUDED
+
+#include <asf.h>
+
+#endif /* STUB_BOARD_H_INCLUDED */
@@ -0,0 +1,60 @@
+/**
+ * \file
+ *
+ * \brief Checks of the host tools
+ *
+ * CHECK() counts a condition that does not hold and prints the first
+ * CHECK_PRINTED of them with their line. check_report() ends a tool: it
+ * prints the failure count and returns the exit status, 1 if any check
+ * failed. check_verbose_arg() parses the [-v] command line of the tools
+ * that take nothing else.
+ *
+ * Header only, each tool is one translation unit.
+ */
+
+#ifndef CHECK_H_INCLUDED
+#define CHECK_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Failures printed, the rest are only counted */
+#define CHECK_PRINTED           (20)
+
+static int check_failures = 0;
+
+#define CHECK(condition, ...)                                           \
+	do {                                                                \
+		if (!(condition)) {                                             \
+			if (check_failures++ < CHECK_PRINTED) {                     \
+				fprintf(stderr, "line %d: failed: ", __LINE__);         \
+				fprintf(stderr, __VA_ARGS__);                           \
+				fprintf(stderr, "\n");                                  \
+			}                                                           \
+		}                                                               \
+	} while (0)
+
+/* Prints the result, returns the exit status */
+static inline int check_report(void)
+{
+	if (check_failures) {
+		printf("%d checks FAILED\n", check_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
+
+/* Sets verbose for -v; prints the usage and returns false on anything else */
+static inline bool check_verbose_arg(int argc, char **argv, bool *verbose)
+{
+	if ((argc > 2) || ((argc == 2) && strcmp(argv[1], "-v"))) {
+		fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+		return false;
+	}
+	*verbose = (argc == 2);
+	return true;
+}
+
+#endif /* CHECK_H_INCLUDED */
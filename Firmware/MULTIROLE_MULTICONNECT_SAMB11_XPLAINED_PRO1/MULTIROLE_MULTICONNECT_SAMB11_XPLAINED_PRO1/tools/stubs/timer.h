@@ -0,0 +1,15 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the timer driver header
+ *
+ * The declarations are in asf.h, as on the target where asf.h includes
+ * the driver headers.
+ */
+
+#ifndef STUB_TIMER_H_INCLUDED
+#define STUB_TIMER_H_INCLUDED
+
+#include <asf.h>
+
+#endif /* STUB_TIMER_H_INCLUDED */
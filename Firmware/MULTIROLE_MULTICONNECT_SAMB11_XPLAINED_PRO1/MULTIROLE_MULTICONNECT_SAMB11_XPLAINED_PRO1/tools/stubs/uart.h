@@ -0,0 +1,15 @@
+/**
+ * \file
+ *
+ * \brief Host stand-in for the UART driver declarations
+ *
+ */
+
+#ifndef STUB_UART_H_INCLUDED
+#define STUB_UART_H_INCLUDED
+
+struct uart_module;
+
+typedef void (*uart_callback_t)(struct uart_module *const module);
+
+#endif /* STUB_UART_H_INCLUDED */
@@ -0,0 +1,218 @@
+/**
+ * \file
+ *
+ * \brief Host simulation of the phone to wearable clock sync
+ *
+ * Runs time_sync.c against a simulated phone whose crystal runs at a
+ * different rate, over a link that only moves packets at BLE connection
+ * events and adds random processing delay on both sides, optionally with
+ * timeline notifications streaming at the same time. Prints the error
+ * of the wearable's estimate of the phone clock after every round and a
+ * summary: how long the first sync took and the error, sampled every
+ * millisecond of true time, once the drift is estimated.
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o time_sync_sim time_sync_sim.c ../src/time_sync.c -lm
+ *   ./time_sync_sim [-p ppm] [-i interval_ms] [-j jitter_us] [-l loss_pct]
+ *                   [-n timeline_ms] [-t seconds] [-r seed] [-q]
+ *
+ *   -p  phone clock rate minus wearable clock rate, default 80 ppm
+ *   -i  connection interval, default 30 ms
+ *   -j  largest processing delay on each side, default 2000 us
+ *   -l  packets lost in each direction, default 5 %
+ *   -n  period of timeline notifications, default none
+ *   -t  simulated time, default 600 s
+ *   -r  random seed
+ *   -q  print the summary only
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "time_sync.h"
+
+/* Simulation step, true time */
+#define STEP_US                 (100)
+
+/* Error is summarized once the drift had this long to settle */
+#define SETTLE_US               (120000000ULL)
+
+typedef struct sim_packet {
+	bool queued;
+	/* true time the packet goes out and arrives */
+	uint64_t send_us;
+	uint64_t arrive_us;
+	uint8_t len;
+	uint8_t data[TIME_SYNC_REPLY_SIZE];
+} sim_packet_t;
+
+static double phone_ppm = 80.0;
+static uint64_t interval_us = 30000;
+static uint32_t jitter_us = 2000;
+static int loss_pct = 5;
+static uint64_t timeline_us = 0;
+
+/* Phone clock at a true time, an arbitrary epoch apart from the wearable */
+static uint64_t phone_clock(uint64_t true_us)
+{
+	return 123456789012ULL + true_us + (uint64_t)llround(true_us * phone_ppm * 1e-6);
+}
+
+static uint64_t wearable_clock(uint64_t true_us)
+{
+	return 5000000ULL + true_us;
+}
+
+static uint32_t random_us(uint32_t max_us)
+{
+	return max_us ? (uint32_t)(rand() % (max_us + 1)) : 0;
+}
+
+/* Next connection event after a true time, plus the receiver's delay */
+static bool sim_send(sim_packet_t *packet, uint64_t now_us,
+		const uint8_t *data, uint8_t len)
+{
+	uint64_t event_us = ((now_us / interval_us) + 1) * interval_us;
+
+	if ((rand() % 100) < loss_pct) {
+		return false;
+	}
+	packet->queued = true;
+	packet->send_us = event_us;
+	packet->arrive_us = event_us + random_us(jitter_us);
+	packet->len = len;
+	memcpy(packet->data, data, len);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	time_sync_t sync;
+	sim_packet_t request = { 0 };
+	sim_packet_t reply = { 0 };
+	sim_packet_t timeline = { 0 };
+	uint64_t next_timeline_us = 0;
+	uint64_t duration_us = 600000000ULL;
+	uint64_t now_us;
+	uint64_t synced_us = 0;
+	uint16_t rounds = 0;
+	bool quiet = false;
+	double max_error = 0;
+	double sum_error = 0;
+	uint32_t error_count = 0;
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-p") && (arg + 1 < argc)) {
+			phone_ppm = atof(argv[++arg]);
+		} else if (!strcmp(argv[arg], "-i") && (arg + 1 < argc)) {
+			interval_us = strtoull(argv[++arg], NULL, 10) * 1000;
+		} else if (!strcmp(argv[arg], "-j") && (arg + 1 < argc)) {
+			jitter_us = (uint32_t)strtoul(argv[++arg], NULL, 10);
+		} else if (!strcmp(argv[arg], "-l") && (arg + 1 < argc)) {
+			loss_pct = atoi(argv[++arg]);
+		} else if (!strcmp(argv[arg], "-n") && (arg + 1 < argc)) {
+			timeline_us = strtoull(argv[++arg], NULL, 10) * 1000;
+		} else if (!strcmp(argv[arg], "-t") && (arg + 1 < argc)) {
+			duration_us = strtoull(argv[++arg], NULL, 10) * 1000000;
+		} else if (!strcmp(argv[arg], "-r") && (arg + 1 < argc)) {
+			srand((unsigned)atoi(argv[++arg]));
+		} else if (!strcmp(argv[arg], "-q")) {
+			quiet = true;
+		} else {
+			fprintf(stderr, "usage: %s [-p ppm] [-i interval_ms] [-j jitter_us] "
+					"[-l loss_pct] [-n timeline_ms] [-t seconds] [-r seed] [-q]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (interval_us == 0) {
+		interval_us = 1000;
+	}
+
+	time_sync_init(&sync, wearable_clock(0));
+
+	for (now_us = 0; now_us < duration_us; now_us += STEP_US) {
+		uint64_t local_us = wearable_clock(now_us);
+		bool notified = false;
+		uint8_t data[TIME_SYNC_REPLY_SIZE];
+		uint8_t len;
+
+		if (timeline_us && (now_us >= next_timeline_us)) {
+			next_timeline_us = now_us + timeline_us;
+			sim_send(&timeline, now_us, data, 0);
+		}
+		if (timeline.queued && (now_us >= timeline.arrive_us)) {
+			timeline.queued = false;
+			time_sync_event(&sync, local_us);
+			notified = true;
+		}
+
+		/* The phone answers right away, its reply waits for the next event */
+		if (request.queued && (now_us >= request.arrive_us)) {
+			uint64_t t2_us = phone_clock(now_us);
+			uint64_t t3_us = phone_clock(now_us + random_us(jitter_us / 4));
+
+			len = time_sync_encode_reply(request.data, request.len,
+					t2_us, t3_us, data, sizeof(data));
+			request.queued = false;
+			sim_send(&reply, now_us, data, len);
+		}
+
+		if (reply.queued && (now_us >= reply.arrive_us)) {
+			reply.queued = false;
+			time_sync_reply(&sync, reply.data, reply.len, local_us);
+			notified = true;
+		}
+
+		/* Like the application: after every notification and by the
+		 * deadline */
+		if (notified ||
+				((int64_t)(time_sync_next_poll(&sync) - local_us) <= 0)) {
+			len = time_sync_poll(&sync, local_us, data, sizeof(data));
+			if (len) {
+				sim_send(&request, now_us, data, len);
+			}
+		}
+
+		if (sync.synced && ((now_us % 1000) == 0)) {
+			uint64_t remote_us;
+			double error;
+
+			if (!synced_us) {
+				synced_us = now_us;
+			}
+			time_sync_to_remote(&sync, local_us, &remote_us);
+			error = (double)(int64_t)(remote_us - phone_clock(now_us));
+			if (now_us >= SETTLE_US) {
+				sum_error += fabs(error);
+				if (fabs(error) > max_error) {
+					max_error = fabs(error);
+				}
+				error_count++;
+			}
+			if (!quiet && (sync.rounds != rounds)) {
+				rounds = sync.rounds;
+				printf("%8.3f s  round %3u  error %+8.0f us  delay %6u us  drift %+7.2f ppm\n",
+						now_us / 1e6, rounds, error, sync.last_delay_us,
+						sync.drift_ppb / 1e3);
+			}
+		}
+	}
+
+	printf("\nphone %+.1f ppm, interval %llu ms, jitter %u us, loss %d %%\n",
+			phone_ppm, (unsigned long long)(interval_us / 1000), jitter_us,
+			loss_pct);
+	printf("first sync after %.3f s, %u rounds, %u samples, %u unaligned, %u rejected, %u steps\n",
+			synced_us / 1e6, sync.rounds, sync.samples, sync.unaligned,
+			sync.rejected, sync.steps);
+	printf("drift estimate %+.2f ppm\n", sync.drift_ppb / 1e3);
+	if (error_count) {
+		printf("after %llu s: mean error %.0f us, max %.0f us\n",
+				(unsigned long long)(SETTLE_US / 1000000), sum_error / error_count,
+				max_error);
+	}
+	return 0;
+}
@@ -0,0 +1,289 @@
+/**
+ * \file
+ *
+ * \brief Host decoder for the wearable event trace
+ *
+ * Reads the Viewer log, picks the "TRACE <hex>" lines the app prints for
+ * every trace packet it receives on the diagnostics characteristic and
+ * prints the events with the formats of trace_ids.h. The time between the
+ * begin and end events of TRACE_SPAN_LIST is summarized as a histogram per
+ * span and 8-bit argument, e.g. per BLE event type.
+ *
+ * Build and run on the host:
+ *
+ *   cc -std=c99 -I../src -o trace_decode trace_decode.c ../src/trace_ring.c
+ *   ./trace_decode [-d wearable] [-s] [log]
+ *
+ *   -d  only decode the lines of this wearable id
+ *   -s  print the span histograms only
+ *
+ * Packets lost on the way show up as gaps in the packet sequence.
+ */
+
+/*- Includes ---------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "trace_ring.h"
+
+#define MAX_PACKET_RECORDS      (32)
+#define HIST_BUCKETS            (32)
+#define MAX_LINE                (1024)
+
+#define TRACE_ID_FORMAT(name, format)   format,
+
+static const char *trace_formats[TRACE_ID_COUNT] = {
+	TRACE_ID_LIST(TRACE_ID_FORMAT)
+};
+
+typedef struct span_def {
+	uint8_t begin;
+	uint8_t end;
+	const char *name;
+} span_def_t;
+
+#define TRACE_SPAN_DEF(begin, end, name)        { begin, end, name },
+
+static const span_def_t spans[] = {
+	TRACE_SPAN_LIST(TRACE_SPAN_DEF)
+};
+
+#define SPAN_COUNT      (sizeof(spans) / sizeof(spans[0]))
+
+typedef struct span_stat {
+	bool open;
+	uint64_t begin_us;
+	uint32_t count;
+	uint64_t sum_us;
+	uint64_t min_us;
+	uint64_t max_us;
+	/* bucket n counts durations in [2^n, 2^(n+1)) us, bucket 0 also 0 */
+	uint32_t hist[HIST_BUCKETS];
+} span_stat_t;
+
+static span_stat_t span_stats[SPAN_COUNT][256];
+
+static bool have_packet = false;
+static uint8_t last_seq;
+static bool have_time = false;
+static uint32_t last_time_us;
+static uint64_t time_us;
+static uint64_t first_us;
+static uint64_t prev_us;
+static uint32_t lost_packets = 0;
+static uint32_t records = 0;
+
+static int parse_hex(const char *text, uint8_t *buf, int buf_len)
+{
+	int len = 0;
+
+	while (isxdigit((unsigned char)text[0]) && isxdigit((unsigned char)text[1])) {
+		char byte[3] = { text[0], text[1], 0 };
+
+		if (len == buf_len) {
+			return -1;
+		}
+		buf[len++] = (uint8_t)strtoul(byte, NULL, 16);
+		text += 2;
+	}
+	return len;
+}
+
+static int bucket_of(uint64_t us)
+{
+	int bucket = 0;
+
+	while ((us >>= 1) && (bucket < HIST_BUCKETS - 1)) {
+		bucket++;
+	}
+	return bucket;
+}
+
+static void span_event(const trace_rec_t *rec)
+{
+	unsigned idx;
+
+	for (idx = 0; idx < SPAN_COUNT; idx++) {
+		span_stat_t *stat = &span_stats[idx][rec->arg8];
+
+		if (rec->id == spans[idx].begin) {
+			stat->open = true;
+			stat->begin_us = time_us;
+		} else if ((rec->id == spans[idx].end) && stat->open) {
+			uint64_t us = time_us - stat->begin_us;
+
+			stat->open = false;
+			if ((stat->count == 0) || (us < stat->min_us)) {
+				stat->min_us = us;
+			}
+			if (us > stat->max_us) {
+				stat->max_us = us;
+			}
+			stat->count++;
+			stat->sum_us += us;
+			stat->hist[bucket_of(us)]++;
+		}
+	}
+}
+
+static void record_event(const trace_rec_t *rec, bool quiet)
+{
+	/* 32-bit microseconds wrap every 71 minutes */
+	if (!have_time) {
+		time_us = rec->time_us;
+		first_us = time_us;
+		prev_us = time_us;
+		have_time = true;
+	} else {
+		time_us += (uint32_t)(rec->time_us - last_time_us);
+	}
+	last_time_us = rec->time_us;
+	records++;
+
+	span_event(rec);
+
+	if (quiet) {
+		return;
+	}
+
+	printf("%12.6f  %+9.3f ms  ", (time_us - first_us) / 1e6,
+			(time_us - prev_us) / 1e3);
+	if (rec->id < TRACE_ID_COUNT) {
+		printf(trace_formats[rec->id], rec->arg8, rec->arg16);
+	} else {
+		printf("unknown id %u: %u %u", rec->id, rec->arg8, rec->arg16);
+	}
+	printf("\n");
+	prev_us = time_us;
+}
+
+static void packet_received(const uint8_t *buf, int len, bool quiet)
+{
+	trace_rec_t rec[MAX_PACKET_RECORDS];
+	uint8_t seq;
+	int count;
+	int idx;
+
+	count = trace_ring_decode(buf, (uint16_t)len, &seq, rec, MAX_PACKET_RECORDS);
+	if (count < 0) {
+		fprintf(stderr, "malformed trace packet, %d bytes\n", len);
+		return;
+	}
+
+	if (have_packet && (seq != (uint8_t)(last_seq + 1))) {
+		uint8_t lost = (uint8_t)(seq - last_seq - 1);
+
+		lost_packets += lost;
+		if (!quiet) {
+			printf("--- %u packets lost ---\n", lost);
+		}
+		/* A span across the gap would be measured wrong */
+		for (idx = 0; idx < (int)SPAN_COUNT; idx++) {
+			int arg;
+
+			for (arg = 0; arg < 256; arg++) {
+				span_stats[idx][arg].open = false;
+			}
+		}
+	}
+	have_packet = true;
+	last_seq = seq;
+
+	for (idx = 0; idx < count; idx++) {
+		record_event(&rec[idx], quiet);
+	}
+}
+
+static void print_histograms(void)
+{
+	unsigned idx;
+	int arg;
+	int bucket;
+
+	printf("\n%u records, %u packets lost\n", records, lost_packets);
+
+	for (idx = 0; idx < SPAN_COUNT; idx++) {
+		for (arg = 0; arg < 256; arg++) {
+			const span_stat_t *stat = &span_stats[idx][arg];
+			uint32_t peak = 0;
+
+			if (stat->count == 0) {
+				continue;
+			}
+
+			printf("\n%s %d: %u spans, min %llu us, avg %llu us, max %llu us\n",
+					spans[idx].name, arg, stat->count,
+					(unsigned long long)stat->min_us,
+					(unsigned long long)(stat->sum_us / stat->count),
+					(unsigned long long)stat->max_us);
+
+			for (bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+				if (stat->hist[bucket] > peak) {
+					peak = stat->hist[bucket];
+				}
+			}
+			for (bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+				int width;
+
+				if (stat->hist[bucket] == 0) {
+					continue;
+				}
+				width = (int)((stat->hist[bucket] * 50ull + peak - 1) / peak);
+				printf("  < %10llu us %8u  %.*s\n", 2ull << bucket,
+						stat->hist[bucket], width,
+						"##################################################");
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in = stdin;
+	const char *device = NULL;
+	char device_tag[64];
+	bool quiet = false;
+	char line[MAX_LINE];
+	uint8_t packet[TRACE_PACKET_LEN(MAX_PACKET_RECORDS)];
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-d") && (arg + 1 < argc)) {
+			device = argv[++arg];
+		} else if (!strcmp(argv[arg], "-s")) {
+			quiet = true;
+		} else if (argv[arg][0] == '-') {
+			fprintf(stderr, "usage: %s [-d wearable] [-s] [log]\n", argv[0]);
+			return 2;
+		} else if ((in = fopen(argv[arg], "r")) == NULL) {
+			perror(argv[arg]);
+			return 1;
+		}
+	}
+
+	if (device) {
+		snprintf(device_tag, sizeof(device_tag), "Wearable %s:", device);
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		const char *hex = strstr(line, "TRACE ");
+		int len;
+
+		if (!hex || (device && !strstr(line, device_tag))) {
+			continue;
+		}
+		len = parse_hex(hex + 6, packet, sizeof(packet));
+		if (len < 0) {
+			fprintf(stderr, "trace packet too long\n");
+			continue;
+		}
+		packet_received(packet, len, quiet);
+	}
+
+	print_histograms();
+	if (in != stdin) {
+		fclose(in);
+	}
+	return 0;
+}
@@ -0,0 +1,170 @@
+//
+//  CommandRing.h
+//  UnboundedTracker
+//
+//  Bounded single producer, single consumer queue of commands that never
+//  blocks the producer. When the ring is full the drop policy decides what
+//  is lost: the oldest queued command, so the consumer always gets the most
+//  recent one, or the command being pushed. Both are counted.
+//
+//  Every slot carries a sequence number, as in D. Vyukov's bounded queue:
+//  slot i holds command n when its sequence is n + 1 and is free for
+//  command n when it is n. Dropping the oldest command means the producer
+//  claims the head like the consumer does, with a compare and swap, and
+//  puts the new command in its place; whichever side loses the swap moves
+//  on. The only wait is the producer finding its slot still being moved out
+//  by the consumer; it retries a bounded number of times, then drops the
+//  new command instead.
+//
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+enum CommandDropPolicy
+{
+    CommandDropOldest,
+    CommandDropNewest
+};
+
+// T must be default constructible and move assignable; a slot is reset to
+// T() once its command is taken so it keeps no references alive.
+template <typename T, size_t Capacity>
+class CommandRing
+{
+    static_assert(Capacity >= 2, "a command ring needs at least two slots");
+
+public:
+    explicit CommandRing(CommandDropPolicy policy = CommandDropOldest)
+        : _policy(policy), _droppedOldest(0), _droppedNewest(0)
+    {
+        for (size_t i = 0; i < Capacity; i++)
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        _head.value.store(0, std::memory_order_relaxed);
+        _tail.value.store(0, std::memory_order_relaxed);
+    }
+
+    static size_t capacity() { return Capacity; }
+
+    // Producer only.
+    void setDropPolicy(CommandDropPolicy policy) { _policy = policy; }
+    CommandDropPolicy dropPolicy() const { return _policy; }
+
+    // Producer only. False when the command itself was dropped; with
+    // CommandDropOldest that only happens while the consumer is moving the
+    // command out of the one slot the producer needs.
+    bool push(T&& command)
+    {
+        size_t tail = _tail.value.load(std::memory_order_relaxed);
+        Slot& slot = _slots[tail % Capacity];
+
+        for (int attempt = 0; attempt < MaxAttempts; attempt++)
+        {
+            if (slot.sequence.load(std::memory_order_acquire) == tail)
+            {
+                publish(slot, tail, std::move(command));
+                return true;
+            }
+
+            // Full: the slot holds command tail - Capacity.
+            if (_policy == CommandDropNewest)
+                break;
+
+            size_t oldest = tail - Capacity;
+            size_t head = _head.value.load(std::memory_order_acquire);
+            if (head == oldest &&
+                _head.value.compare_exchange_strong(head, oldest + 1, std::memory_order_acq_rel))
+            {
+                // Ours now; the assignment releases the dropped command.
+                _droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                publish(slot, tail, std::move(command));
+                return true;
+            }
+            // The consumer took it and is moving it out.
+        }
+
+        _droppedNewest.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Consumer only. Commands come out in the order they were pushed.
+    bool pop(T& command)
+    {
+        size_t head = _head.value.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = _slots[head % Capacity];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence == head + 1)
+            {
+                if (_head.value.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel,
+                                                      std::memory_order_relaxed))
+                {
+                    command = std::move(slot.command);
+                    slot.command = T();
+                    slot.sequence.store(head + Capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence == head)
+            {
+                return false;
+            }
+            else
+            {
+                // The producer dropped this one and reused the slot.
+                head = _head.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Any thread, a snapshot.
+    size_t size() const
+    {
+        size_t head = _head.value.load(std::memory_order_acquire);
+        size_t tail = _tail.value.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    uint64_t droppedOldest() const { return _droppedOldest.load(std::memory_order_relaxed); }
+    uint64_t droppedNewest() const { return _droppedNewest.load(std::memory_order_relaxed); }
+
+private:
+    // Retries of a push while the consumer finishes with the slot.
+    static const int MaxAttempts = 64;
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T command;
+    };
+
+    void publish(Slot& slot, size_t tail, T&& command)
+    {
+        slot.command = std::move(command);
+        slot.sequence.store(tail + 1, std::memory_order_release);
+        _tail.value.store(tail + 1, std::memory_order_release);
+    }
+
+    CommandRing(const CommandRing&);
+    CommandRing& operator=(const CommandRing&);
+
+    // Head and tail are written by different threads, so each gets a cache
+    // line of its own.
+    struct Index
+    {
+        char padding[64];
+        std::atomic<size_t> value;
+    };
+
+    Slot _slots[Capacity];
+    Index _head;
+    Index _tail;
+
+    CommandDropPolicy _policy;
+    std::atomic<uint64_t> _droppedOldest;
+    std::atomic<uint64_t> _droppedNewest;
+};
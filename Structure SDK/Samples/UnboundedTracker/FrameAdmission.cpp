@@ -0,0 +1,148 @@
+//
+//  FrameAdmission.cpp
+//  UnboundedTracker
+//
+
+#include "FrameAdmission.h"
+#include <algorithm>
+#include <math.h>
+
+FrameAdmission::FrameAdmission(const FrameAdmissionSettings& settings)
+    : _settings(settings)
+{
+    Estimate* estimates[] = { &_full, &_half };
+    for (Estimate* estimate : estimates)
+    {
+        estimate->mean.store(0, std::memory_order_relaxed);
+        estimate->deviation.store(0, std::memory_order_relaxed);
+        estimate->measured.store(false, std::memory_order_relaxed);
+        estimate->lastSample.store(-1, std::memory_order_relaxed);
+    }
+    _trackingStart.store(-1, std::memory_order_relaxed);
+    _trackingDownsampled.store(false, std::memory_order_relaxed);
+    _renderInterval.store(0, std::memory_order_relaxed);
+    _previousRender = -1;
+    _previousArrival = -1;
+    _submitted.store(0, std::memory_order_relaxed);
+    _downsampled.store(0, std::memory_order_relaxed);
+    _skipped.store(0, std::memory_order_relaxed);
+}
+
+void FrameAdmission::update(Estimate& estimate, double sample, double now)
+{
+    double previous = estimate.lastSample.load(std::memory_order_relaxed);
+    estimate.lastSample.store(now, std::memory_order_relaxed);
+    if (!estimate.measured.load(std::memory_order_relaxed))
+    {
+        estimate.mean.store(sample, std::memory_order_relaxed);
+        estimate.deviation.store(0, std::memory_order_relaxed);
+        estimate.measured.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    double gap = std::max(now - previous, 0.) / _settings.budgetSeconds;
+    double alpha = 1 - pow(1 - _settings.smoothing, std::max(gap, 1.));
+    double mean = estimate.mean.load(std::memory_order_relaxed);
+    double deviation = estimate.deviation.load(std::memory_order_relaxed);
+    estimate.deviation.store((1 - alpha) * deviation + alpha * fabs(sample - mean), std::memory_order_relaxed);
+    estimate.mean.store((1 - alpha) * mean + alpha * sample, std::memory_order_relaxed);
+}
+
+double FrameAdmission::expectedCost(const Estimate& estimate) const
+{
+    return estimate.mean.load(std::memory_order_relaxed) +
+           _settings.deviationWeight * estimate.deviation.load(std::memory_order_relaxed);
+}
+
+FrameAdmissionDecision FrameAdmission::admit(double now, size_t queuedFrames)
+{
+    bool batched = _previousArrival >= 0 && now - _previousArrival < _settings.minimumIntervalSeconds;
+    _previousArrival = now;
+    if (batched)
+    {
+        _skipped.fetch_add(1, std::memory_order_relaxed);
+        return FrameSkip;
+    }
+
+    // Nothing measured yet: track at full resolution to find out.
+    if (!_full.measured.load(std::memory_order_relaxed))
+    {
+        _submitted.fetch_add(1, std::memory_order_relaxed);
+        return FrameSubmit;
+    }
+
+    double fullCost = expectedCost(_full);
+    double halfCost = _half.measured.load(std::memory_order_relaxed) ? expectedCost(_half)
+                                                                     : fullCost * _settings.downsampleCostRatio;
+
+    // Work ahead of this frame: what is left of the current one, and the
+    // queued ones, counted at full cost.
+    double backlog = queuedFrames * fullCost;
+    double start = _trackingStart.load(std::memory_order_acquire);
+    if (start >= 0)
+    {
+        double cost = _trackingDownsampled.load(std::memory_order_relaxed) ? halfCost : fullCost;
+        backlog += std::max(0., start + cost - now);
+    }
+
+    double budget = _settings.budgetSeconds;
+    double renderInterval = _renderInterval.load(std::memory_order_relaxed);
+    double renderLoad = renderInterval / _settings.renderIntervalSeconds;
+    if (renderLoad > _settings.renderOverloadRatio)
+        budget *= _settings.renderOverloadRatio / renderLoad;
+
+    bool probe = backlog == 0 &&
+                 now - _full.lastSample.load(std::memory_order_relaxed) > _settings.probeIntervalSeconds;
+
+    FrameAdmissionDecision decision;
+    if (backlog + fullCost <= budget || probe)
+        decision = FrameSubmit;
+    else if (backlog + halfCost <= budget || backlog == 0)
+        decision = FrameDownsample;
+    else
+        decision = FrameSkip;
+
+    std::atomic<uint64_t>& counter = decision == FrameSubmit ? _submitted :
+                                     decision == FrameDownsample ? _downsampled : _skipped;
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return decision;
+}
+
+void FrameAdmission::frameStarted(double now, bool downsampled)
+{
+    _trackingDownsampled.store(downsampled, std::memory_order_relaxed);
+    _trackingStart.store(now, std::memory_order_release);
+}
+
+void FrameAdmission::frameTracked(double now)
+{
+    double start = _trackingStart.exchange(-1, std::memory_order_acq_rel);
+    if (start < 0)
+        return;
+    update(_trackingDownsampled.load(std::memory_order_relaxed) ? _half : _full, now - start, now);
+}
+
+void FrameAdmission::renderFrame(double now)
+{
+    if (_previousRender >= 0)
+    {
+        double interval = now - _previousRender;
+        double average = _renderInterval.load(std::memory_order_relaxed);
+        double alpha = _settings.smoothing;
+        _renderInterval.store(average == 0 ? interval : (1 - alpha) * average + alpha * interval,
+                              std::memory_order_relaxed);
+    }
+    _previousRender = now;
+}
+
+FrameAdmissionStats FrameAdmission::stats() const
+{
+    FrameAdmissionStats stats;
+    stats.submitted = _submitted.load(std::memory_order_relaxed);
+    stats.downsampled = _downsampled.load(std::memory_order_relaxed);
+    stats.skipped = _skipped.load(std::memory_order_relaxed);
+    stats.fullCostSeconds = _full.mean.load(std::memory_order_relaxed);
+    stats.halfCostSeconds = _half.mean.load(std::memory_order_relaxed);
+    stats.renderIntervalSeconds = _renderInterval.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,125 @@
+//
+//  FrameAdmission.h
+//  UnboundedTracker
+//
+//  Decides for every depth frame whether the tracker gets it at full
+//  resolution, at half resolution or not at all. The tracker's cost per
+//  frame is measured as it runs and tracked with exponentially weighted
+//  averages of the mean and the deviation, one pair per resolution. A frame
+//  is submitted when, behind the work already queued, it is expected to be
+//  tracked within the deadline budget; downsampled when only the half
+//  resolution frame would make it; skipped otherwise, unless the tracker is
+//  idle and it would only go to waste. A full frame now and then keeps the
+//  full cost estimate current while frames are being downsampled.
+//
+//  The render thread reports its frames as well. While it runs slower than
+//  its target the budget shrinks by the same proportion, since the tracker
+//  competes with it for the same cores.
+//
+//  admit() is called by the thread delivering the sensor frames,
+//  frameStarted() and frameTracked() by the tracker thread and renderFrame()
+//  by the render thread; all times are in seconds on one monotonic clock.
+//
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+enum FrameAdmissionDecision
+{
+    FrameSubmit,
+    FrameDownsample,
+    FrameSkip
+};
+
+struct FrameAdmissionSettings
+{
+    // Tracking a frame should be done by the time the next one arrives.
+    double budgetSeconds = 1/30.;
+
+    // Weight of a new cost sample in the averages, one budget after the
+    // previous one.
+    double smoothing = 0.1;
+
+    // The expected cost is the mean plus this many mean deviations.
+    double deviationWeight = 2.;
+
+    // Cost of a half resolution frame relative to a full one, until measured.
+    double downsampleCostRatio = 0.4;
+
+    // While frames are downsampled the full cost is not measured; an idle
+    // tracker gets a full frame after this long to measure it again.
+    double probeIntervalSeconds = 1.;
+
+    // The render thread aims at this interval, and is overloaded beyond
+    // overloadRatio times it.
+    double renderIntervalSeconds = 1/60.;
+    double renderOverloadRatio = 1.25;
+
+    // Frames that arrive in a batch, sooner than this after the previous one,
+    // are skipped so the render thread does not starve.
+    double minimumIntervalSeconds = 0.005;
+};
+
+struct FrameAdmissionStats
+{
+    uint64_t submitted;
+    uint64_t downsampled;
+    uint64_t skipped;
+
+    // Current estimates, 0 before the first measurement.
+    double fullCostSeconds;
+    double halfCostSeconds;
+    double renderIntervalSeconds;
+};
+
+class FrameAdmission
+{
+public:
+    explicit FrameAdmission(const FrameAdmissionSettings& settings = FrameAdmissionSettings());
+
+    // queuedFrames are the frames waiting for the tracker, not counting the
+    // one it is working on.
+    FrameAdmissionDecision admit(double now, size_t queuedFrames);
+
+    void frameStarted(double now, bool downsampled);
+    void frameTracked(double now);
+
+    void renderFrame(double now);
+
+    FrameAdmissionStats stats() const;
+
+private:
+    // Exponentially weighted mean and mean deviation of a cost. The weight
+    // of a sample grows with the time since the previous one, so a sample
+    // after a long gap mostly replaces what is known.
+    struct Estimate
+    {
+        std::atomic<double> mean;
+        std::atomic<double> deviation;
+        std::atomic<bool> measured;
+        std::atomic<double> lastSample;
+    };
+
+    void update(Estimate& estimate, double sample, double now);
+    double expectedCost(const Estimate& estimate) const;
+
+    FrameAdmissionSettings _settings;
+
+    Estimate _full;
+    Estimate _half;
+
+    // Start of the frame being tracked, negative when idle.
+    std::atomic<double> _trackingStart;
+    std::atomic<bool> _trackingDownsampled;
+
+    std::atomic<double> _renderInterval;
+    double _previousRender;
+
+    double _previousArrival;
+    std::atomic<uint64_t> _submitted;
+    std::atomic<uint64_t> _downsampled;
+    std::atomic<uint64_t> _skipped;
+};
@@ -18,9 +18,9 @@ Game motion is out-of-sync from real world motion because of movements in the ga
   - running into (game) walls
   - we exaggerate horizontal motion 2.5x relative to vertical motion
   
-We output game camera motion as a basic csv format, to [DATE]GameCameraPoses.log. These will be loaded on startup for replay.
+We record both as compressed pose streams (PoseStream.h) in [DATE].CameraPoses.pstream. A PoseRecorder queues the poses and a worker thread encodes and writes them, so recording does no file I/O on the render thread. The game camera stream of the last log is loaded on startup for replay, which follows the recorded times; older [DATE].GameCameraPoses.plog binary and [DATE].GameCameraPoses.log text logs still load.
   
-We output tracker motion in the .dae format, to [DATE]WorldCameraPoses.dae. This can be loaded in an external 3D editor such as MODO or Maya as a camera path. 
+When the recording stops, we export the tracker motion in the .dae format, to [DATE].WorldCameraPoses.dae, in the background. This can be loaded in an external 3D editor such as MODO or Maya as a camera path. 
  
 Both Motion logs are accessible from iTunes Files Sharing.
 */
@@ -7,7 +7,18 @@
 #import "MotionLogs.h"
 #import "SCNTools.h"
 
-#import <fstream>
+#include "PoseLog.h"
+#include "PoseRecorder.h"
+#include "PoseStream.h"
+
+#import <vector>
+
+// The streams of a recording (PoseStream.h).
+enum
+{
+    MotionLogGameCameraStream = 0,
+    MotionLogTrackerStream = 1
+};
 
 /**
  ObjMatrix is a helper object for converting GLKMatrix4 from row-major to column major.
@@ -84,17 +95,19 @@
 //=====================================================
 
 /**
- MotionLog represent an individual motion log
+ MotionLog represent an individual motion log, played back by time.
  */
 @interface MotionLog : NSObject
 {
     SCNNode *pointerNode;
     NSMutableArray *pathNodes;
-    float *times;
-    SCNMatrix4 *transforms;
-    int motionDataIndex;
-    int motionDataCount;
     NSTimeInterval _startTime;
+
+    // Poses of a binary log, mapped by the reader, or of a pose stream or an
+    // older text log, decoded.
+    PoseLogReader _reader;
+    std::vector<PoseLogRecord> _records;
+    PoseTrack _track;
 }
 - (id)initWithLogFilePath:(NSString*)filePath;
 - (void)addIndicatorNode:(SCNNode*)indicatorNode toRootNode:(SCNNode*)rootNode;
@@ -110,7 +123,38 @@
 - (id)initWithLogFilePath:(NSString*)filePath
 {
     self = [super init];
+    if (!self)
+        return nil;
+    
+    if ([filePath hasSuffix:@".plog"])
+    {
+        if (!_reader.open(filePath.fileSystemRepresentation))
+        {
+            NSLog(@"Motion Log error: %@ is not a pose log", filePath);
+            return nil;
+        }
+        if (_reader.truncated())
+            NSLog(@"Motion Log warning: %@ was not closed, playing its complete poses", filePath);
+        _track = _reader.track();
+        return self;
+    }
     
+    if ([filePath hasSuffix:@".pstream"])
+    {
+        PoseStreamReader reader;
+        if (!reader.open(filePath.fileSystemRepresentation) || !reader.read(MotionLogGameCameraStream, _records))
+        {
+            NSLog(@"Motion Log error: %@ is not a pose stream", filePath);
+            return nil;
+        }
+        if (reader.truncated())
+            NSLog(@"Motion Log warning: %@ was not closed, playing its complete blocks", filePath);
+        if (!_records.empty())
+            _track = PoseTrack(&_records[0], _records.size());
+        return self;
+    }
+    
+    // Text logs recorded before the binary format.
     NSStringEncoding encoding;
     NSError *error;
     NSString *fileContents = [NSString stringWithContentsOfFile:filePath usedEncoding:&encoding error:&error];
@@ -123,44 +167,30 @@
         return nil;
     }
     
-    times = new float[lines.count];
-    transforms = new SCNMatrix4[lines.count];
-    
-    motionDataCount = 0;
+    _records.reserve(lines.count);
     for (id line in lines)
     {
         NSArray *lineComponents = [line componentsSeparatedByString:@" "];
         
-        if (lineComponents.count < 16)
+        if (lineComponents.count < 17)
             continue;
         
-        float time = [lineComponents[0] intValue]/1000.0;
-        SCNMatrix4 transform;
-        transform.m11 = [lineComponents[1] floatValue];
-        transform.m12 = [lineComponents[2] floatValue];
-        transform.m13 = [lineComponents[3] floatValue];
-        transform.m14 = [lineComponents[4] floatValue];
-        
-        transform.m21 = [lineComponents[5] floatValue];
-        transform.m22 = [lineComponents[6] floatValue];
-        transform.m23 = [lineComponents[7] floatValue];
-        transform.m24 = [lineComponents[8] floatValue];
-        
-        transform.m31 = [lineComponents[9] floatValue];
-        transform.m32 = [lineComponents[10] floatValue];
-        transform.m33 = [lineComponents[11] floatValue];
-        transform.m34 = [lineComponents[12] floatValue];
+        double time = [lineComponents[0] intValue]/1000.0;
         
-        transform.m41 = [lineComponents[13] floatValue];
-        transform.m42 = [lineComponents[14] floatValue];
-        transform.m43 = [lineComponents[15] floatValue];
-        transform.m44 = [lineComponents[16] floatValue];
+        // m11 to m44 of the SCNMatrix4, the column major layout of GLKMatrix4.
+        GLKMatrix4 transform;
+        for (int i = 0; i < 16; i++)
+            transform.m[i] = [lineComponents[i + 1] floatValue];
         
-        times[motionDataCount] = time;
-        transforms[motionDataCount] = transform;
-        motionDataCount++;
+        // The playback searches by time, which has to increase.
+        if (!_records.empty() && time <= _records.back().time)
+            continue;
+        _records.push_back(PoseLogRecord::make(time, Pose::fromMatrix(transform.m)));
     }
     
+    if (!_records.empty())
+        _track = PoseTrack(&_records[0], _records.size());
+    
     return self;
 }
 
@@ -170,18 +200,28 @@
     for (id pathNode in pathNodes)
         [pathNode removeFromParentNode];
     [pathNodes removeAllObjects];
-    delete[] times;
-    delete[] transforms;
+}
+
+- (SCNMatrix4)transformOfPose:(const Pose&)pose
+{
+    GLKMatrix4 transform;
+    pose.toMatrix(transform.m);
+    return SCNMatrix4FromGLKMatrix4(transform);
+}
+
+- (SCNMatrix4)transformAtIndex:(size_t)index
+{
+    return [self transformOfPose:_track[index].pose()];
 }
 
 - (void)addIndicatorNode:(SCNNode*)indicatorNode toRootNode:(SCNNode*)rootNode
 {
-    if (motionDataCount == 0)
+    if (_track.empty())
         return;
     
     pointerNode = indicatorNode;
     [rootNode addChildNode:pointerNode];
-    [pointerNode setTransform:transforms[0]];
+    [pointerNode setTransform:[self transformAtIndex:0]];
     
     pathNodes = [[NSMutableArray alloc] init];
     SCNNode *startEndMarker = [SCNNode nodeWithGeometry:[SCNBox boxWithWidth:0.2 height:0.2 length:0.2 chamferRadius:0]];
@@ -189,64 +229,63 @@
     
     SCNNode *startMarker = [startEndMarker copy];
     [rootNode addChildNode:startMarker];
-    [startMarker setTransform:transforms[0]];
+    [startMarker setTransform:[self transformAtIndex:0]];
     [pathNodes addObject:startMarker];
     
     SCNNode *endMarker = [startEndMarker copy];
     [rootNode addChildNode:endMarker];
-    [endMarker setTransform:transforms[motionDataCount - 1]];
+    [endMarker setTransform:[self transformAtIndex:_track.size() - 1]];
     [pathNodes addObject:endMarker];
     
-    const int MARKER_FREQ = 2;
-    for (int i = MARKER_FREQ; i < motionDataCount - 1; i += MARKER_FREQ)
+    const size_t MARKER_FREQ = 2;
+    for (size_t i = MARKER_FREQ; i + 1 < _track.size(); i += MARKER_FREQ)
     {
-        SCNVector3 delta = [SCNTools subtractVector:[SCNTools getPositionFromTransform:transforms[i - 1]]
-                                         fromVector:[SCNTools getPositionFromTransform:transforms[i + 1]]];
+        SCNVector3 delta = [SCNTools subtractVector:[SCNTools getPositionFromTransform:[self transformAtIndex:i - 1]]
+                                         fromVector:[SCNTools getPositionFromTransform:[self transformAtIndex:i + 1]]];
         float speed = [SCNTools vectorMagnitude:delta];
         float markerRadius = 0.05 - fminf(speed*0.05, 0.01);
         
         SCNNode *pathMarker = [SCNNode nodeWithGeometry:[SCNSphere sphereWithRadius:markerRadius]];
         [pathMarker.geometry.firstMaterial.emission setContents:[UIColor whiteColor]];
         [rootNode addChildNode:pathMarker];
-        [pathMarker setTransform:transforms[i]];
+        [pathMarker setTransform:[self transformAtIndex:i]];
         [pathNodes addObject:pathMarker];
     }
 }
 
 - (void)beginAtTime:(NSTimeInterval)startTime
 {
-    motionDataIndex = 0;
     _startTime = startTime;
     
-    if (motionDataCount > 0)
-        [pointerNode setTransform:transforms[0]];
+    if (!_track.empty())
+        [pointerNode setTransform:[self transformAtIndex:0]];
 }
 
 - (void)updateAtTime:(NSTimeInterval)time
 {
-    if (motionDataCount == 0 ||
-        motionDataIndex >= motionDataCount - 1)
+    if (_track.empty())
         return;
     
-    motionDataIndex++;
-    
-    if (motionDataIndex >= motionDataCount - 1)
+    // Play back at the pace of the recording, whatever the frame rate, interpolating
+    // between the recorded poses.
+    double logTime = _track.firstTime() + (time - _startTime);
+    if (logTime >= _track.lastTime())
     {
         pointerNode.geometry.firstMaterial.emission.contents = [UIColor whiteColor];
+        return;
     }
-    else
-    {
-        [pointerNode setTransform:transforms[motionDataIndex]];
-    }
+    
+    Pose pose;
+    _track.sample(logTime, pose);
+    [pointerNode setTransform:[self transformOfPose:pose]];
 }
 
 - (void)reset
 {
-    if (motionDataCount == 0)
+    if (_track.empty())
         return;
     
-    motionDataIndex = 0;
-    [pointerNode setTransform:transforms[motionDataIndex]];
+    [pointerNode setTransform:[self transformAtIndex:0]];
 }
 
 @end
@@ -255,8 +294,11 @@
 
 @implementation MotionLogs
 
-std::ofstream gameCameraPosesLogFile;
-std::ofstream trackerEstimatesLogFile;
+// Both the game camera and the tracker poses, encoded and written off the
+// render thread.
+PoseRecorder poseRecorder;
+NSString *recordingPath;
+NSString *recordingDate;
 
 BOOL playbackHasBegun = NO;
 
@@ -264,10 +306,6 @@ NSMutableArray *motionLogs;
 NSArray *motionLogFiles;
 
 BOOL recordingMotionLog = NO;
-BOOL recordingStartTimeStarted;
-NSMutableArray *transforms;
-double recordingStartTime;
-double lastTime;
 
 SCNNode *pointerParentNode;
 SCNNode *rootNode;
@@ -283,9 +321,12 @@ UIButton *playMotionLogsButton;
 {
     motionLogs = [[NSMutableArray alloc] init];
     
-    // Check iTunes File System for logs of the form <timestamp>.gameCameraPoses.log
+    // Check iTunes File System for logs of the form <timestamp>.CameraPoses.pstream, or
+    // <timestamp>.GameCameraPoses.plog and <timestamp>.GameCameraPoses.log for the older
+    // binary and text logs. The timestamps sort by name.
     NSArray *dirFiles = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:[self motionLogsDirectory] error:nil];
-    motionLogFiles = [dirFiles filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self ENDSWITH '.GameCameraPoses.log'"]];
+    motionLogFiles = [dirFiles filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self ENDSWITH '.CameraPoses.pstream' OR self ENDSWITH '.GameCameraPoses.plog' OR self ENDSWITH '.GameCameraPoses.log'"]];
+    motionLogFiles = [motionLogFiles sortedArrayUsingSelector:@selector(compare:)];
     
     if (motionLogFiles.count == 0)
         return;
@@ -293,8 +334,11 @@ UIButton *playMotionLogsButton;
     // WARNING: if you want to load a bunch of motion logs, we recommend a dispatch_async
     MotionLog *motionLog = [[MotionLog alloc] initWithLogFilePath:[NSString stringWithFormat:@"%@/%@",
                                                                    [self motionLogsDirectory], motionLogFiles.lastObject]];
-    [motionLogs addObject:motionLog];
-    [motionLog addIndicatorNode:[pointerParentNode clone] toRootNode:rootNode];
+    if (motionLog)
+    {
+        [motionLogs addObject:motionLog];
+        [motionLog addIndicatorNode:[pointerParentNode clone] toRootNode:rootNode];
+    }
     
     [playMotionLogsButton setHidden:([MotionLogs getLogCount] == 0)];
     [playMotionLogsButton setTitle:[NSString stringWithFormat:@"Play Last Path (of %i)", [MotionLogs getLogCount]] forState:UIControlStateNormal];
@@ -363,7 +407,8 @@ UIButton *playMotionLogsButton;
 
 #pragma mark - Logging input
 
-// Recording the matrix of the camera POV each time stamp here
+// Recording the matrix of the camera POV each time stamp here. Recording only
+// queues the pose; it never waits on the file.
 + (void)logGameCameraPose:(SCNMatrix4)povTransform atTime:(double)timestamp
 {
     if(!recordingMotionLog)
@@ -371,24 +416,7 @@ UIButton *playMotionLogsButton;
         return;
     }
     
-    int msTimestamp = int(1e3*timestamp);
-    
-    if (!gameCameraPosesLogFile.is_open())
-    {
-        NSString* date = [self MakeLongTimeStamp:@"YYYYMMdd_HHmmss"];
-        NSString* logPath = [NSString stringWithFormat:@"%@/%@.GameCameraPoses.log",
-                             [self motionLogsDirectory],
-                             date];
-
-        gameCameraPosesLogFile.open ([logPath UTF8String]);
-    }
-    
-    gameCameraPosesLogFile << msTimestamp << " ";
-    gameCameraPosesLogFile
-    << povTransform.m11 << " " << povTransform.m12 << " " << povTransform.m13 << " " << povTransform.m14 << " "
-    << povTransform.m21 << " " << povTransform.m22 << " " << povTransform.m23 << " " << povTransform.m24 << " "
-    << povTransform.m31 << " " << povTransform.m32 << " " << povTransform.m33 << " " << povTransform.m34 << " "
-    << povTransform.m41 << " " << povTransform.m42 << " " << povTransform.m43 << " " << povTransform.m44 << std::endl;
+    poseRecorder.record(MotionLogGameCameraStream, timestamp, Pose::fromMatrix(SCNMatrix4ToGLKMatrix4(povTransform).m));
 }
 
 + (void)logTrackerPose:(GLKMatrix4)povTransform atTime:(double)timestamp
@@ -398,28 +426,27 @@ UIButton *playMotionLogsButton;
         return;
     }
     
-    if(!recordingStartTimeStarted)
-    {
-        recordingStartTime = timestamp;
-        recordingStartTimeStarted = YES;
-        lastTime = 0;
-    }
-    
-    double frameTime = (double)(timestamp - recordingStartTime);
-    if(frameTime > 0.0 && frameTime > lastTime)
-    {
-        //skip duplicate frame times
-        lastTime = frameTime;
-        [transforms addObject:[[ObjMatrix alloc] initWithGLKMatrix4:povTransform atTime:frameTime]];
-    }
+    poseRecorder.record(MotionLogTrackerStream, timestamp, Pose::fromMatrix(povTransform.m));
 }
 
 + (void) startMotionLogRecording
 {
+    if(recordingMotionLog)
+        return;
+    
+    recordingDate = [self MakeLongTimeStamp:@"YYYYMMdd_HHmmss"];
+    recordingPath = [NSString stringWithFormat:@"%@/%@.CameraPoses.pstream",
+                     [self motionLogsDirectory],
+                     recordingDate];
+    
+    if (!poseRecorder.start([recordingPath UTF8String], [[NSDate date] timeIntervalSince1970]))
+    {
+        NSLog(@"Motion Log error: cannot create %@", recordingPath);
+        return;
+    }
+    
     //allow tracker to start updating.
     recordingMotionLog = YES;
-    recordingStartTimeStarted = NO;
-    transforms = [[NSMutableArray alloc] init];
 }
 
 /// When the recording stops we write the dae collada file to the iOS file directory
@@ -428,38 +455,54 @@ UIButton *playMotionLogsButton;
     if(!recordingMotionLog)
         return;
     
-    if (!trackerEstimatesLogFile.is_open())
+    recordingMotionLog = NO;
+    if (!poseRecorder.stop())
+        NSLog(@"Motion Log error: the camera poses could not all be written");
+    
+    PoseRecorderStats stats = poseRecorder.stats();
+    if (stats.dropped > 0)
+        NSLog(@"Motion Log warning: %llu of %llu camera poses dropped", stats.dropped, stats.dropped + stats.recorded);
+    
+    // Formatting the collada file takes a while for a long recording.
+    NSString *logPath = recordingPath;
+    NSString *date = recordingDate;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        [self exportTrackerPosesOfLog:logPath dateString:date];
+    });
+    
+    [self refreshLogs];
+}
+
+// Writes the tracker poses of a recording as [DATE].WorldCameraPoses.dae, the times
+// counted from the first pose.
++ (void) exportTrackerPosesOfLog:(NSString*)logPath dateString:(NSString*)date
+{
+    std::vector<PoseLogRecord> records;
+    PoseStreamReader reader;
+    if (!reader.open([logPath UTF8String]) || !reader.read(MotionLogTrackerStream, records) || records.empty())
+        return;
+    
+    NSMutableArray *transforms = [[NSMutableArray alloc] initWithCapacity:records.size()];
+    for (size_t i = 0; i < records.size(); i++)
     {
-        NSString* date = [self MakeLongTimeStamp:@"YYYYMMdd_HHmmss"];
-        NSString* logPath = [NSString stringWithFormat:@"%@/%@.WorldCameraPoses.dae",
-                             [self motionLogsDirectory],
-                             date];
-        
-        trackerEstimatesLogFile.open([logPath UTF8String]);
-        
-        if(trackerEstimatesLogFile.is_open())
-        {
-            trackerEstimatesLogFile << [[MotionLogs writeColladaHeaderForFile:logPath dateString:date] UTF8String];
-            
-            trackerEstimatesLogFile << [[MotionLogs writeAnimationTimeLine:transforms] UTF8String];
-            
-            trackerEstimatesLogFile << [[MotionLogs writeTransformOutput:transforms] UTF8String];
-            
-            trackerEstimatesLogFile << [[MotionLogs writeInterpolations:(int)[transforms count]]UTF8String];
-            
-            ObjMatrix *oMat = [transforms objectAtIndex:0];
-            GLKMatrix4 gMat = [oMat getMatrix];
-            
-            trackerEstimatesLogFile << [[MotionLogs closeAnimationMatrix:gMat] UTF8String];
-            
-            trackerEstimatesLogFile.close();
-        }
+        GLKMatrix4 transform;
+        records[i].pose().toMatrix(transform.m);
+        [transforms addObject:[[ObjMatrix alloc] initWithGLKMatrix4:transform atTime:records[i].time - records[0].time]];
     }
     
-    gameCameraPosesLogFile.close();
-    recordingMotionLog = NO;
+    NSString *daePath = [NSString stringWithFormat:@"%@/%@.WorldCameraPoses.dae",
+                         [self motionLogsDirectory],
+                         date];
     
-    [self refreshLogs];
+    NSMutableString *dae = [MotionLogs writeColladaHeaderForFile:daePath dateString:date];
+    [dae appendString:[MotionLogs writeAnimationTimeLine:transforms]];
+    [dae appendString:[MotionLogs writeTransformOutput:transforms]];
+    [dae appendString:[MotionLogs writeInterpolations:(int)[transforms count]]];
+    [dae appendString:[MotionLogs closeAnimationMatrix:[[transforms objectAtIndex:0] getMatrix]]];
+    
+    NSError *error;
+    if (![dae writeToFile:daePath atomically:YES encoding:NSUTF8StringEncoding error:&error])
+        NSLog(@"Motion Log error: %@", error);
 }
 
 + (BOOL) isRecording
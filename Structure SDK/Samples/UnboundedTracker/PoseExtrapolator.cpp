@@ -0,0 +1,189 @@
+//
+//  PoseExtrapolator.cpp
+//  UnboundedTracker
+//
+
+#include "PoseExtrapolator.h"
+#include <algorithm>
+
+PoseExtrapolator::PoseExtrapolator(const PoseExtrapolatorSettings& settings)
+    : _settings(settings)
+{
+    reset();
+}
+
+void PoseExtrapolator::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _firstMotion = 0;
+    _motionCount = 0;
+    _hasPose = false;
+    _poseTime = -1;
+    _pose = Pose();
+    _velocity = Vector3();
+    _gyroBias = Vector3();
+    _correctionTime = -1;
+    _correctionRotation = Quaternion();
+    _correctionTranslation = Vector3();
+    _stats = PoseExtrapolatorStats();
+}
+
+void PoseExtrapolator::addMotion(double timestamp, const Vector3& rotationRate, const Vector3& userAcceleration)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_motionCount > 0 && timestamp <= motion(_motionCount - 1).time)
+        return;
+
+    if (_motionCount == MotionCapacity)
+    {
+        _firstMotion = (_firstMotion + 1) % MotionCapacity;
+        _motionCount--;
+        _stats.droppedMotionSamples++;
+    }
+    MotionSample& sample = _motion[(_firstMotion + _motionCount) % MotionCapacity];
+    sample.time = timestamp;
+    sample.rotationRate = _settings.imuToCamera.rotate(rotationRate);
+    sample.acceleration = _settings.imuToCamera.rotate(userAcceleration) * _settings.gravity;
+    _motionCount++;
+    _stats.motionSamples++;
+}
+
+Pose PoseExtrapolator::integrate(double time, Vector3* velocity) const
+{
+    Pose pose = _pose;
+    Vector3 v = _velocity;
+    double t = _poseTime;
+
+    // The sample in effect at t is the last one before it, or the first one.
+    size_t i = 0;
+    while (i + 1 < _motionCount && motion(i + 1).time <= t)
+        i++;
+
+    if (_motionCount == 0)
+    {
+        pose.translation += v * std::max(time - t, 0.);
+    }
+    while (_motionCount > 0 && t < time)
+    {
+        const MotionSample& sample = motion(i);
+        double end = i + 1 < _motionCount ? std::min(motion(i + 1).time, time) : time;
+        double dt = end - t;
+        if (dt > 0)
+        {
+            // Each sample holds until the next one.
+            Vector3 a = _settings.useAccelerometer ? pose.rotation.rotate(sample.acceleration) : Vector3();
+            pose.translation += v * dt + a * (dt * dt / 2);
+            v += a * dt;
+            Vector3 rate = sample.rotationRate - _gyroBias;
+            pose.rotation = (pose.rotation * Quaternion::fromRotationVector(rate * dt)).normalized();
+            t = end;
+        }
+        if (i + 1 < _motionCount)
+            i++;
+    }
+
+    if (velocity)
+        *velocity = v;
+    return pose;
+}
+
+double PoseExtrapolator::limitedTime(double time) const
+{
+    double limit = _poseTime + _settings.maxHorizonSeconds;
+    if (_motionCount > 0)
+        limit = std::min(limit, motion(_motionCount - 1).time + _settings.maxMotionGapSeconds);
+    return std::max(std::min(time, limit), _poseTime);
+}
+
+Pose PoseExtrapolator::predictLocked(double time) const
+{
+    Pose pose = integrate(limitedTime(time), NULL);
+    if (_settings.correctionSeconds > 0 && _correctionTime >= 0)
+    {
+        double elapsed = std::max(time - _correctionTime, 0.);
+        double left = exp(-elapsed / _settings.correctionSeconds);
+        Quaternion rotation = Quaternion::fromRotationVector(_correctionRotation.rotationVector() * left);
+        pose.rotation = (rotation * pose.rotation).normalized();
+        pose.translation += _correctionTranslation * left;
+    }
+    return pose;
+}
+
+bool PoseExtrapolator::predict(double time, Pose& pose) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_hasPose)
+        return false;
+    pose = predictLocked(time);
+    return true;
+}
+
+void PoseExtrapolator::dropMotionBefore(double time)
+{
+    // Keep the last sample before time, it holds at time.
+    while (_motionCount > 1 && motion(1).time <= time)
+    {
+        _firstMotion = (_firstMotion + 1) % MotionCapacity;
+        _motionCount--;
+    }
+}
+
+void PoseExtrapolator::setTrackerPose(double timestamp, const Pose& pose)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.trackerPoses++;
+
+    if (!_hasPose || timestamp <= _poseTime || timestamp - _poseTime > _settings.maxPoseGapSeconds)
+    {
+        // Nothing to go on: start over from this pose, at rest.
+        _hasPose = true;
+        _poseTime = timestamp;
+        _pose = pose;
+        _velocity = Vector3();
+        _correctionTime = -1;
+        dropMotionBefore(timestamp);
+        return;
+    }
+
+    // Where the prediction, before any smoothing, had the camera at this time.
+    double dt = timestamp - _poseTime;
+    Vector3 predictedVelocity;
+    Pose predicted = integrate(timestamp, &predictedVelocity);
+    Vector3 rotationError = (predicted.rotation.conjugate() * pose.rotation).rotationVector();
+    Vector3 translationError = pose.translation - predicted.translation;
+    _stats.translationError = translationError.norm();
+    _stats.angleError = rotationError.norm();
+
+    // What is being shown now, to spread the jump from it to the new prediction.
+    double now = _motionCount > 0 ? std::max(motion(_motionCount - 1).time, timestamp) : timestamp;
+    Pose shown = predictLocked(now);
+
+    // Integrating rate - bias over dt left rotationError, in the camera frame,
+    // so the bias is rotationError / dt too high.
+    _gyroBias = (_gyroBias - rotationError * (_settings.gyroBiasCorrection / dt)).clamped(_settings.maxGyroBias);
+    _velocity = (predictedVelocity + translationError * (_settings.velocityCorrection / dt)).clamped(_settings.maxSpeed);
+
+    _poseTime = timestamp;
+    _pose = pose;
+    dropMotionBefore(timestamp);
+
+    _correctionTime = -1;
+    if (_settings.correctionSeconds > 0)
+    {
+        Pose corrected = predictLocked(now);
+        _correctionRotation = (shown.rotation * corrected.rotation.conjugate()).normalized();
+        _correctionTranslation = shown.translation - corrected.translation;
+        if (_correctionTranslation.norm() < _settings.snapTranslation &&
+            _correctionRotation.angle() < _settings.snapAngle)
+            _correctionTime = now;
+    }
+}
+
+PoseExtrapolatorStats PoseExtrapolator::stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    PoseExtrapolatorStats stats = _stats;
+    stats.velocity = _velocity;
+    stats.gyroBias = _gyroBias;
+    return stats;
+}
@@ -0,0 +1,146 @@
+//
+//  PoseExtrapolator.h
+//  UnboundedTracker
+//
+//  Predicts the camera pose at the time a frame is displayed from the last
+//  tracker pose and the motion samples since. The tracker pose is that of a
+//  depth frame captured a frame or two earlier; the gyroscope rates are
+//  integrated on top of its rotation and the user acceleration, twice, on
+//  top of its position and the velocity estimated at that time.
+//
+//  The drift is kept bounded:
+//    - every tracker pose replaces the integrated one, and the difference
+//      between the two at that time corrects the velocity and a gyroscope
+//      bias estimate, the bias clamped to a plausible size
+//    - the prediction never reaches further than a horizon past the tracker
+//      pose, nor much further than the last motion sample
+//    - the jump a new tracker pose makes in the prediction is spread over a
+//      short time, unless it is large enough to be a relocalization
+//
+//  addMotion() is called by the CoreMotion queue, setTrackerPose() by the
+//  tracker thread and predict() by the render thread. All times are in
+//  seconds on the clock of the depth frame and CoreMotion timestamps.
+//
+
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include "PoseMath.h"
+
+struct PoseExtrapolatorSettings
+{
+    // From the CoreMotion device frame to the camera frame of the tracker
+    // poses (x right, y down, z forward in the landscape image with the home
+    // button on the right): (x, y, z) -> (-y, -x, -z).
+    Quaternion imuToCamera = Quaternion(0, M_SQRT1_2, -M_SQRT1_2, 0);
+
+    // CoreMotion reports accelerations in g.
+    double gravity = 9.80665;
+
+    // Double integrating the accelerometer is only worth it over a short
+    // time; without it the velocity from the tracker poses is kept constant.
+    bool useAccelerometer = true;
+
+    // The prediction stops this long after the tracker pose, and this long
+    // after the last motion sample.
+    double maxHorizonSeconds = 0.15;
+    double maxMotionGapSeconds = 0.04;
+
+    // A tracker pose further apart from the previous one starts over.
+    double maxPoseGapSeconds = 0.5;
+
+    // Share of the position error at a tracker pose that goes into the
+    // velocity, the error spread over the time since the previous pose. The
+    // velocity is clamped to a walking person's.
+    double velocityCorrection = 0.5;
+    double maxSpeed = 3.;
+
+    // Share of the rotation error at a tracker pose that goes into the
+    // gyroscope bias, likewise, and the largest bias believed.
+    double gyroBiasCorrection = 0.05;
+    double maxGyroBias = 0.02;
+
+    // Time constant over which the jump of a new tracker pose is spread, 0
+    // to apply it at once. Jumps beyond the snap limits are always applied
+    // at once.
+    double correctionSeconds = 0.03;
+    double snapTranslation = 0.1;
+    double snapAngle = 0.2;
+};
+
+struct PoseExtrapolatorStats
+{
+    uint64_t trackerPoses;
+    uint64_t motionSamples;
+    uint64_t droppedMotionSamples;
+
+    // Error of the prediction at the time of the last tracker pose, meters
+    // and radians.
+    double translationError;
+    double angleError;
+
+    Vector3 velocity;
+    Vector3 gyroBias;
+};
+
+class PoseExtrapolator
+{
+public:
+    explicit PoseExtrapolator(const PoseExtrapolatorSettings& settings = PoseExtrapolatorSettings());
+
+    void reset();
+
+    // A CoreMotion device motion sample in the device frame: rotation rate in
+    // radians per second and user acceleration, without gravity, in g.
+    void addMotion(double timestamp, const Vector3& rotationRate, const Vector3& userAcceleration);
+
+    // Camera to world pose estimated by the tracker for the frame captured
+    // at timestamp.
+    void setTrackerPose(double timestamp, const Pose& pose);
+
+    // False until there is a tracker pose.
+    bool predict(double time, Pose& pose) const;
+
+    PoseExtrapolatorStats stats() const;
+
+private:
+    // In the camera frame, in radians per second and meters per second squared.
+    struct MotionSample
+    {
+        double time;
+        Vector3 rotationRate;
+        Vector3 acceleration;
+    };
+
+    static const size_t MotionCapacity = 128;
+
+    const MotionSample& motion(size_t i) const { return _motion[(_firstMotion + i) % MotionCapacity]; }
+
+    // Tracker pose integrated up to time; velocity at time if asked for.
+    Pose integrate(double time, Vector3* velocity) const;
+    double limitedTime(double time) const;
+    Pose predictLocked(double time) const;
+    void dropMotionBefore(double time);
+
+    PoseExtrapolatorSettings _settings;
+    mutable std::mutex _mutex;
+
+    MotionSample _motion[MotionCapacity];
+    size_t _firstMotion;
+    size_t _motionCount;
+
+    bool _hasPose;
+    double _poseTime;
+    Pose _pose;
+    Vector3 _velocity;
+    Vector3 _gyroBias;
+
+    // What is left of the jump at _correctionTime, in the world frame.
+    double _correctionTime;
+    Quaternion _correctionRotation;
+    Vector3 _correctionTranslation;
+
+    PoseExtrapolatorStats _stats;
+};
@@ -0,0 +1,178 @@
+//
+//  PoseLog.cpp
+//  UnboundedTracker
+//
+
+#include "PoseLog.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Pose PoseLogRecord::pose() const
+{
+    return Pose(Quaternion(rotation[0], rotation[1], rotation[2], rotation[3]),
+                Vector3(translation[0], translation[1], translation[2]));
+}
+
+PoseLogRecord PoseLogRecord::make(double time, const Pose& pose)
+{
+    PoseLogRecord record;
+    record.time = time;
+    record.rotation[0] = (float)pose.rotation.w;
+    record.rotation[1] = (float)pose.rotation.x;
+    record.rotation[2] = (float)pose.rotation.y;
+    record.rotation[3] = (float)pose.rotation.z;
+    record.translation[0] = (float)pose.translation.x;
+    record.translation[1] = (float)pose.translation.y;
+    record.translation[2] = (float)pose.translation.z;
+    record.reserved = 0;
+    return record;
+}
+
+size_t PoseTrack::find(double time) const
+{
+    const PoseLogRecord* after = std::upper_bound(_records, _records + _count, time,
+                                                  [](double t, const PoseLogRecord& r) { return t < r.time; });
+    return after == _records ? 0 : (size_t)(after - _records) - 1;
+}
+
+bool PoseTrack::sample(double time, Pose& pose) const
+{
+    if (_count == 0)
+        return false;
+
+    size_t i = find(time);
+    const PoseLogRecord& before = _records[i];
+    if (time <= before.time || i + 1 == _count)
+    {
+        pose = before.pose();
+        return true;
+    }
+    const PoseLogRecord& after = _records[i + 1];
+    pose = Pose::interpolate(before.pose(), after.pose(), (time - before.time) / (after.time - before.time));
+    return true;
+}
+
+PoseLogWriter::PoseLogWriter()
+    : _file(NULL), _failed(false), _count(0), _lastTime(0)
+{
+}
+
+PoseLogWriter::~PoseLogWriter()
+{
+    close();
+}
+
+bool PoseLogWriter::open(const char* path, double created)
+{
+    close();
+
+    _file = fopen(path, "wb");
+    if (!_file)
+        return false;
+    _failed = false;
+    _count = 0;
+
+    PoseLogHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = POSE_LOG_MAGIC;
+    header.version = POSE_LOG_VERSION;
+    header.headerSize = sizeof(header);
+    header.recordSize = sizeof(PoseLogRecord);
+    header.created = created;
+    if (fwrite(&header, sizeof(header), 1, _file) != 1)
+        _failed = true;
+    return !_failed;
+}
+
+bool PoseLogWriter::close()
+{
+    if (!_file)
+        return true;
+    if (fclose(_file) != 0)
+        _failed = true;
+    _file = NULL;
+    return !_failed;
+}
+
+bool PoseLogWriter::append(double time, const Pose& pose)
+{
+    if (!_file || _failed || (_count > 0 && time <= _lastTime))
+        return false;
+
+    PoseLogRecord record = PoseLogRecord::make(time, pose);
+    if (fwrite(&record, sizeof(record), 1, _file) != 1)
+    {
+        _failed = true;
+        return false;
+    }
+    _lastTime = time;
+    _count++;
+    return true;
+}
+
+PoseLogReader::PoseLogReader()
+    : _fd(-1), _data(NULL), _size(0), _truncated(false)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+PoseLogReader::~PoseLogReader()
+{
+    close();
+}
+
+bool PoseLogReader::open(const char* path)
+{
+    close();
+
+    _fd = ::open(path, O_RDONLY);
+    if (_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || (size_t)st.st_size < sizeof(PoseLogHeader))
+    {
+        close();
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    _data = (const uint8_t*)data;
+    _size = (size_t)st.st_size;
+
+    memcpy(&_header, _data, sizeof(_header));
+    if (_header.magic != POSE_LOG_MAGIC || _header.version != POSE_LOG_VERSION ||
+        _header.headerSize < sizeof(_header) || _header.headerSize % 8 ||
+        _header.recordSize != sizeof(PoseLogRecord) || _header.headerSize > _size)
+    {
+        close();
+        return false;
+    }
+
+    size_t bytes = _size - _header.headerSize;
+    _truncated = bytes % sizeof(PoseLogRecord) != 0;
+    _track = PoseTrack((const PoseLogRecord*)(_data + _header.headerSize), bytes / sizeof(PoseLogRecord));
+    return true;
+}
+
+void PoseLogReader::close()
+{
+    if (_data)
+        munmap((void*)_data, _size);
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+    _data = NULL;
+    _size = 0;
+    _truncated = false;
+    _track = PoseTrack();
+}
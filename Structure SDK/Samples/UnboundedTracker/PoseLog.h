@@ -0,0 +1,149 @@
+//
+//  PoseLog.h
+//  UnboundedTracker
+//
+//  Binary log of timed camera poses, the game camera path MotionLogs records
+//  and plays back.
+//
+//  file     PoseLogHeader, then PoseLogRecord after PoseLogRecord
+//
+//  Records are appended as they are recorded, with strictly increasing
+//  times, and have a fixed size, so the file needs no index: a reader maps
+//  it and binary searches the records by time. A log that was not closed is
+//  read up to its last complete record. All fields are little endian, the
+//  byte order of both the iOS devices and the hosts the tools run on, so the
+//  structures are written as they are.
+//
+//  A pose is stored as a rotation and a translation; a scale in the matrix
+//  it was made from is not kept.
+//
+//  POSIX C++ without Apple frameworks so it builds and runs on a host.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "PoseMath.h"
+
+#define POSE_LOG_MAGIC 0x534f5050u   // "PPOS"
+#define POSE_LOG_VERSION 1
+
+struct PoseLogHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t recordSize;
+    uint32_t flags;
+    // Wall clock time the recording started, seconds since 1970.
+    double created;
+    uint64_t reserved;
+};
+
+struct PoseLogRecord
+{
+    // Seconds, on the clock of the recorder.
+    double time;
+    // Unit quaternion w, x, y, z.
+    float rotation[4];
+    float translation[3];
+    uint32_t reserved;
+
+    Pose pose() const;
+    static PoseLogRecord make(double time, const Pose& pose);
+};
+
+static_assert(sizeof(PoseLogHeader) == 32, "pose log header layout");
+static_assert(sizeof(PoseLogRecord) == 40, "pose log record layout");
+
+// Records sorted by time, from a log mapping or in memory; it does not own
+// them.
+class PoseTrack
+{
+public:
+    PoseTrack() : _records(NULL), _count(0) {}
+    PoseTrack(const PoseLogRecord* records, size_t count) : _records(records), _count(count) {}
+
+    size_t size() const { return _count; }
+    bool empty() const { return _count == 0; }
+    const PoseLogRecord& operator[](size_t i) const { return _records[i]; }
+    double firstTime() const { return _count ? _records[0].time : 0; }
+    double lastTime() const { return _count ? _records[_count - 1].time : 0; }
+
+    // Index of the last record at or before time, 0 when there is none,
+    // found with a binary search.
+    size_t find(double time) const;
+
+    // Pose at time, interpolated between the records around it and held
+    // before the first and after the last. False when empty.
+    bool sample(double time, Pose& pose) const;
+
+private:
+    const PoseLogRecord* _records;
+    size_t _count;
+};
+
+// Appends to a log as the poses come; the records go through the stdio
+// buffer. Not thread safe.
+class PoseLogWriter
+{
+public:
+    PoseLogWriter();
+    ~PoseLogWriter();
+
+    // Returns false if the file cannot be created.
+    bool open(const char* path, double created);
+
+    // Returns false if any write of the log failed.
+    bool close();
+    bool isOpen() const { return _file != NULL; }
+
+    // Poses not later than the previous one are skipped. Returns false if
+    // the pose was skipped or could not be written.
+    bool append(double time, const Pose& pose);
+
+    size_t count() const { return _count; }
+
+private:
+    PoseLogWriter(const PoseLogWriter&);
+    PoseLogWriter& operator=(const PoseLogWriter&);
+
+    FILE* _file;
+    bool _failed;
+    size_t _count;
+    double _lastTime;
+};
+
+// Maps a log read only; the records are used in place.
+class PoseLogReader
+{
+public:
+    PoseLogReader();
+    ~PoseLogReader();
+
+    // Returns false if the file cannot be mapped or is not a pose log.
+    bool open(const char* path);
+    void close();
+    bool isOpen() const { return _data != NULL; }
+
+    const PoseLogHeader& header() const { return _header; }
+    size_t fileSize() const { return _size; }
+
+    // The log was not closed, or was cut short, in the middle of a record.
+    bool truncated() const { return _truncated; }
+
+    PoseTrack track() const { return _track; }
+
+private:
+    PoseLogReader(const PoseLogReader&);
+    PoseLogReader& operator=(const PoseLogReader&);
+
+    int _fd;
+    const uint8_t* _data;
+    size_t _size;
+    bool _truncated;
+    PoseLogHeader _header;
+    PoseTrack _track;
+};
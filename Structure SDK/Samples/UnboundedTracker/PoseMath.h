@@ -0,0 +1,183 @@
+//
+//  PoseMath.h
+//  UnboundedTracker
+//
+//  Vectors, unit quaternions and rigid poses in double precision, as far as
+//  the pose extrapolation and the motion logs need them. A pose maps camera
+//  coordinates to world coordinates, like the camera poses of STTracker, and
+//  converts to and from their column major 4x4 matrices.
+//
+
+#pragma once
+
+#include <math.h>
+
+struct Vector3
+{
+    double x = 0, y = 0, z = 0;
+
+    Vector3() {}
+    Vector3(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
+
+    Vector3 operator+(const Vector3& v) const { return Vector3(x + v.x, y + v.y, z + v.z); }
+    Vector3 operator-(const Vector3& v) const { return Vector3(x - v.x, y - v.y, z - v.z); }
+    Vector3 operator-() const { return Vector3(-x, -y, -z); }
+    Vector3 operator*(double s) const { return Vector3(x * s, y * s, z * s); }
+    Vector3& operator+=(const Vector3& v) { x += v.x; y += v.y; z += v.z; return *this; }
+    Vector3& operator-=(const Vector3& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+
+    double dot(const Vector3& v) const { return x * v.x + y * v.y + z * v.z; }
+    Vector3 cross(const Vector3& v) const { return Vector3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+    double norm() const { return sqrt(dot(*this)); }
+
+    // Scaled down to at most the given length.
+    Vector3 clamped(double length) const
+    {
+        double n = norm();
+        return n > length ? *this * (length / n) : *this;
+    }
+};
+
+struct Quaternion
+{
+    double w = 1, x = 0, y = 0, z = 0;
+
+    Quaternion() {}
+    Quaternion(double w_, double x_, double y_, double z_) : w(w_), x(x_), y(y_), z(z_) {}
+
+    Quaternion operator*(const Quaternion& q) const
+    {
+        return Quaternion(w * q.w - x * q.x - y * q.y - z * q.z,
+                          w * q.x + x * q.w + y * q.z - z * q.y,
+                          w * q.y - x * q.z + y * q.w + z * q.x,
+                          w * q.z + x * q.y - y * q.x + z * q.w);
+    }
+
+    // The inverse of a unit quaternion.
+    Quaternion conjugate() const { return Quaternion(w, -x, -y, -z); }
+
+    Quaternion normalized() const
+    {
+        double n = sqrt(w * w + x * x + y * y + z * z);
+        return n > 0 ? Quaternion(w / n, x / n, y / n, z / n) : Quaternion();
+    }
+
+    Vector3 rotate(const Vector3& v) const
+    {
+        // v + 2w (u x v) + 2 u x (u x v), u the vector part.
+        Vector3 u(x, y, z);
+        Vector3 t = u.cross(v) * 2;
+        return v + t * w + u.cross(t);
+    }
+
+    // Rotation by the angle |v| around v, the exponential map.
+    static Quaternion fromRotationVector(const Vector3& v)
+    {
+        double angle = v.norm();
+        if (angle < 1e-9)
+            return Quaternion(1, v.x / 2, v.y / 2, v.z / 2).normalized();
+        double s = sin(angle / 2) / angle;
+        return Quaternion(cos(angle / 2), v.x * s, v.y * s, v.z * s);
+    }
+
+    // Inverse of fromRotationVector, the angle in [0, pi].
+    Vector3 rotationVector() const
+    {
+        Quaternion q = w < 0 ? Quaternion(-w, -x, -y, -z) : *this;
+        double s = sqrt(q.x * q.x + q.y * q.y + q.z * q.z);
+        if (s < 1e-9)
+            return Vector3(q.x * 2, q.y * 2, q.z * 2);
+        double scale = 2 * atan2(s, q.w) / s;
+        return Vector3(q.x * scale, q.y * scale, q.z * scale);
+    }
+
+    double angle() const { return rotationVector().norm(); }
+
+    static Quaternion slerp(const Quaternion& a, Quaternion b, double t)
+    {
+        double d = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+        if (d < 0)
+        {
+            b = Quaternion(-b.w, -b.x, -b.y, -b.z);
+            d = -d;
+        }
+        if (d > 0.9995)
+            return Quaternion(a.w + t * (b.w - a.w), a.x + t * (b.x - a.x),
+                              a.y + t * (b.y - a.y), a.z + t * (b.z - a.z)).normalized();
+        double theta = acos(d);
+        double sa = sin((1 - t) * theta) / sin(theta);
+        double sb = sin(t * theta) / sin(theta);
+        return Quaternion(sa * a.w + sb * b.w, sa * a.x + sb * b.x, sa * a.y + sb * b.y, sa * a.z + sb * b.z);
+    }
+};
+
+struct Pose
+{
+    Quaternion rotation;
+    Vector3 translation;
+
+    Pose() {}
+    Pose(const Quaternion& r, const Vector3& t) : rotation(r), translation(t) {}
+
+    // From a column major rigid transform; the rotation part is assumed
+    // orthonormal.
+    static Pose fromMatrix(const float m[16])
+    {
+        // Element (row r, column c) is m[4 * c + r].
+        double r00 = m[0], r10 = m[1], r20 = m[2];
+        double r01 = m[4], r11 = m[5], r21 = m[6];
+        double r02 = m[8], r12 = m[9], r22 = m[10];
+
+        Quaternion q;
+        double trace = r00 + r11 + r22;
+        if (trace > 0)
+        {
+            double s = 2 * sqrt(trace + 1);
+            q = Quaternion(s / 4, (r21 - r12) / s, (r02 - r20) / s, (r10 - r01) / s);
+        }
+        else if (r00 > r11 && r00 > r22)
+        {
+            double s = 2 * sqrt(1 + r00 - r11 - r22);
+            q = Quaternion((r21 - r12) / s, s / 4, (r01 + r10) / s, (r02 + r20) / s);
+        }
+        else if (r11 > r22)
+        {
+            double s = 2 * sqrt(1 + r11 - r00 - r22);
+            q = Quaternion((r02 - r20) / s, (r01 + r10) / s, s / 4, (r12 + r21) / s);
+        }
+        else
+        {
+            double s = 2 * sqrt(1 + r22 - r00 - r11);
+            q = Quaternion((r10 - r01) / s, (r02 + r20) / s, (r12 + r21) / s, s / 4);
+        }
+        return Pose(q.normalized(), Vector3(m[12], m[13], m[14]));
+    }
+
+    void toMatrix(float m[16]) const
+    {
+        const Quaternion& q = rotation;
+        m[0] = 1 - 2 * (q.y * q.y + q.z * q.z);
+        m[1] = 2 * (q.x * q.y + q.w * q.z);
+        m[2] = 2 * (q.x * q.z - q.w * q.y);
+        m[3] = 0;
+        m[4] = 2 * (q.x * q.y - q.w * q.z);
+        m[5] = 1 - 2 * (q.x * q.x + q.z * q.z);
+        m[6] = 2 * (q.y * q.z + q.w * q.x);
+        m[7] = 0;
+        m[8] = 2 * (q.x * q.z + q.w * q.y);
+        m[9] = 2 * (q.y * q.z - q.w * q.x);
+        m[10] = 1 - 2 * (q.x * q.x + q.y * q.y);
+        m[11] = 0;
+        m[12] = translation.x;
+        m[13] = translation.y;
+        m[14] = translation.z;
+        m[15] = 1;
+    }
+
+    // Between a and b, t from 0 to 1.
+    static Pose interpolate(const Pose& a, const Pose& b, double t)
+    {
+        return Pose(Quaternion::slerp(a.rotation, b.rotation, t),
+                    a.translation + (b.translation - a.translation) * t);
+    }
+};
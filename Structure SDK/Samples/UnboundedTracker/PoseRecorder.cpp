@@ -0,0 +1,109 @@
+//
+//  PoseRecorder.cpp
+//  UnboundedTracker
+//
+
+#include "PoseRecorder.h"
+#include <chrono>
+
+PoseRecorder::PoseRecorder(const PoseStreamSettings& settings)
+    : _ring(CommandDropNewest), _writer(settings), _recording(false), _stopping(false),
+      _droppedBefore(0), _recorded(0), _skipped(0), _bytesWritten(0), _longestWriteSeconds(0)
+{
+}
+
+PoseRecorder::~PoseRecorder()
+{
+    stop();
+}
+
+bool PoseRecorder::start(const char* path, double created)
+{
+    stop();
+
+    // Samples pushed while the last recording stopped belong to no log.
+    Sample stale;
+    while (_ring.pop(stale))
+    {
+    }
+
+    if (!_writer.open(path, created))
+        return false;
+
+    _droppedBefore = _ring.droppedNewest();
+    _recorded.store(0, std::memory_order_relaxed);
+    _skipped.store(0, std::memory_order_relaxed);
+    _bytesWritten.store(_writer.bytesWritten(), std::memory_order_relaxed);
+    _longestWriteSeconds.store(0, std::memory_order_relaxed);
+
+    _stopping.store(false, std::memory_order_relaxed);
+    _worker = std::thread(&PoseRecorder::run, this);
+    _recording.store(true, std::memory_order_release);
+    return true;
+}
+
+bool PoseRecorder::stop()
+{
+    if (!_worker.joinable())
+        return true;
+
+    _recording.store(false, std::memory_order_release);
+    _stopping.store(true, std::memory_order_release);
+    _worker.join();
+
+    bool written = _writer.close();
+    _bytesWritten.store(_writer.bytesWritten(), std::memory_order_relaxed);
+    return written;
+}
+
+bool PoseRecorder::record(uint8_t stream, double time, const Pose& pose)
+{
+    if (!_recording.load(std::memory_order_acquire))
+        return false;
+
+    Sample sample;
+    sample.stream = stream;
+    sample.time = time;
+    sample.pose = pose;
+    return _ring.push(std::move(sample));
+}
+
+PoseRecorderStats PoseRecorder::stats() const
+{
+    PoseRecorderStats stats;
+    stats.recorded = _recorded.load(std::memory_order_relaxed);
+    stats.dropped = _ring.droppedNewest() - _droppedBefore;
+    stats.skipped = _skipped.load(std::memory_order_relaxed);
+    stats.bytesWritten = _bytesWritten.load(std::memory_order_relaxed);
+    stats.longestWriteSeconds = _longestWriteSeconds.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void PoseRecorder::run()
+{
+    while (!_stopping.load(std::memory_order_acquire))
+    {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(WakeMilliseconds));
+    }
+    drain();
+}
+
+void PoseRecorder::drain()
+{
+    Sample sample;
+    while (_ring.pop(sample))
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        bool appended = _writer.append(sample.stream, sample.time, sample.pose);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        if (appended)
+            _recorded.fetch_add(1, std::memory_order_relaxed);
+        else
+            _skipped.fetch_add(1, std::memory_order_relaxed);
+        if (seconds > _longestWriteSeconds.load(std::memory_order_relaxed))
+            _longestWriteSeconds.store(seconds, std::memory_order_relaxed);
+    }
+    _bytesWritten.store(_writer.bytesWritten(), std::memory_order_relaxed);
+}
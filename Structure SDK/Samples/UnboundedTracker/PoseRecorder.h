@@ -0,0 +1,87 @@
+//
+//  PoseRecorder.h
+//  UnboundedTracker
+//
+//  Records timed poses to a compressed pose stream (PoseStream.h) without
+//  doing any encoding or file I/O on the thread that produces them. A
+//  sample is copied into a preallocated ring; a worker thread wakes every
+//  few milliseconds, encodes what is queued and writes whole blocks. When
+//  the ring is full the new sample is dropped and counted, so the producer
+//  never waits on the disk.
+//
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include "CommandRing.h"
+#include "PoseMath.h"
+#include "PoseStream.h"
+
+struct PoseRecorderStats
+{
+    uint64_t recorded = 0;
+    // Samples lost to a full ring, and samples the writer skipped because
+    // their time did not increase.
+    uint64_t dropped = 0;
+    uint64_t skipped = 0;
+    uint64_t bytesWritten = 0;
+    // Longest the worker spent on one sample, a block write included.
+    double longestWriteSeconds = 0;
+};
+
+class PoseRecorder
+{
+public:
+    explicit PoseRecorder(const PoseStreamSettings& settings = PoseStreamSettings());
+    ~PoseRecorder();
+
+    // Creates the log and starts the worker. Returns false if the file
+    // cannot be created.
+    bool start(const char* path, double created);
+
+    // Writes what is queued, closes the log and joins the worker. Returns
+    // false if any write failed.
+    bool stop();
+
+    bool isRecording() const { return _recording.load(std::memory_order_acquire); }
+
+    // One producer thread. Returns false when not recording or the sample
+    // was dropped.
+    bool record(uint8_t stream, double time, const Pose& pose);
+
+    // Counters of the current or last recording; any thread.
+    PoseRecorderStats stats() const;
+
+private:
+    PoseRecorder(const PoseRecorder&);
+    PoseRecorder& operator=(const PoseRecorder&);
+
+    struct Sample
+    {
+        uint8_t stream = 0;
+        double time = 0;
+        Pose pose;
+    };
+
+    // Nearly three seconds of a 60 Hz game camera and a 30 Hz tracker,
+    // against a worker that wakes every 10 ms.
+    static const size_t RingSlots = 256;
+    static const int WakeMilliseconds = 10;
+
+    void run();
+    void drain();
+
+    CommandRing<Sample, RingSlots> _ring;
+    PoseStreamWriter _writer;
+    std::thread _worker;
+    std::atomic<bool> _recording;
+    std::atomic<bool> _stopping;
+
+    uint64_t _droppedBefore;
+    std::atomic<uint64_t> _recorded;
+    std::atomic<uint64_t> _skipped;
+    std::atomic<uint64_t> _bytesWritten;
+    std::atomic<double> _longestWriteSeconds;
+};
@@ -0,0 +1,368 @@
+//
+//  PoseStream.cpp
+//  UnboundedTracker
+//
+
+#include "PoseStream.h"
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Tag, time, three rotation and three translation varints of ten bytes at most.
+static const size_t maxSampleBytes = 1 + 7 * 10;
+
+static void putVarint(std::vector<uint8_t>& bytes, int64_t value)
+{
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    while (zigzag >= 0x80)
+    {
+        bytes.push_back((uint8_t)(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    bytes.push_back((uint8_t)zigzag);
+}
+
+static bool getVarint(const uint8_t*& at, const uint8_t* end, int64_t& value)
+{
+    uint64_t zigzag = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (at == end)
+            return false;
+        uint8_t byte = *at++;
+        zigzag |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// The smallest three components of q, scaled so +-1/sqrt(2) fills the bits;
+// the largest one is made positive and left out.
+static int quantizeRotation(const Quaternion& q, int bits, int32_t components[3])
+{
+    double v[4] = { q.w, q.x, q.y, q.z };
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+    {
+        if (fabs(v[i]) > fabs(v[largest]))
+            largest = i;
+    }
+    double sign = v[largest] < 0 ? -1 : 1;
+    double scale = ((1 << (bits - 1)) - 1) / M_SQRT1_2;
+    for (int i = 0, k = 0; i < 4; i++)
+    {
+        if (i != largest)
+            components[k++] = (int32_t)lround(sign * v[i] * scale);
+    }
+    return largest;
+}
+
+static Quaternion dequantizeRotation(int largest, const int32_t components[3], int bits)
+{
+    double scale = M_SQRT1_2 / ((1 << (bits - 1)) - 1);
+    double v[4];
+    double sum = 0;
+    for (int i = 0, k = 0; i < 4; i++)
+    {
+        if (i == largest)
+            continue;
+        v[i] = components[k++] * scale;
+        sum += v[i] * v[i];
+    }
+    v[largest] = sqrt(sum < 1 ? 1 - sum : 0);
+    return Quaternion(v[0], v[1], v[2], v[3]).normalized();
+}
+
+PoseStreamWriter::PoseStreamWriter(const PoseStreamSettings& settings)
+    : _settings(settings), _file(NULL), _failed(false), _samples(0), _bytesWritten(0)
+{
+    // Room for a full block, so appending never allocates.
+    for (int i = 0; i < POSE_STREAM_COUNT; i++)
+    {
+        _blocks[i].bytes.reserve(_settings.maxBlockSamples * maxSampleBytes);
+        _blocks[i].count = 0;
+    }
+}
+
+PoseStreamWriter::~PoseStreamWriter()
+{
+    close();
+}
+
+bool PoseStreamWriter::open(const char* path, double created)
+{
+    close();
+
+    _file = fopen(path, "wb");
+    if (!_file)
+        return false;
+    _failed = false;
+    _samples = 0;
+    _bytesWritten = 0;
+    for (int i = 0; i < POSE_STREAM_COUNT; i++)
+    {
+        _blocks[i].bytes.clear();
+        _blocks[i].count = 0;
+    }
+
+    PoseStreamHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = POSE_STREAM_MAGIC;
+    header.version = POSE_STREAM_VERSION;
+    header.headerSize = sizeof(header);
+    header.quaternionBits = _settings.quaternionBits;
+    header.created = created;
+    header.timeUnit = _settings.timeUnit;
+    header.translationUnit = _settings.translationUnit;
+    if (fwrite(&header, sizeof(header), 1, _file) != 1)
+        _failed = true;
+    _bytesWritten = sizeof(header);
+    return !_failed;
+}
+
+bool PoseStreamWriter::close()
+{
+    if (!_file)
+        return true;
+    for (int i = 0; i < POSE_STREAM_COUNT; i++)
+        writeBlock((uint8_t)i);
+    if (fclose(_file) != 0)
+        _failed = true;
+    _file = NULL;
+    return !_failed;
+}
+
+bool PoseStreamWriter::writeBlock(uint8_t stream)
+{
+    Block& block = _blocks[stream];
+    if (block.count == 0)
+        return true;
+
+    PoseStreamBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = POSE_STREAM_BLOCK_MAGIC;
+    header.stream = stream;
+    header.count = block.count;
+    header.size = (uint32_t)block.bytes.size();
+    header.firstTime = block.firstTime;
+    header.lastTime = block.firstTime + block.lastTicks * _settings.timeUnit;
+
+    // Whole blocks only, so a crash does not leave half of one behind the last.
+    if (!_failed && (fwrite(&header, sizeof(header), 1, _file) != 1 ||
+                     fwrite(&block.bytes[0], 1, block.bytes.size(), _file) != block.bytes.size() ||
+                     fflush(_file) != 0))
+        _failed = true;
+    _bytesWritten += sizeof(header) + block.bytes.size();
+
+    block.bytes.clear();
+    block.count = 0;
+    return !_failed;
+}
+
+bool PoseStreamWriter::append(uint8_t stream, double time, const Pose& pose)
+{
+    if (!_file || _failed || stream >= POSE_STREAM_COUNT)
+        return false;
+
+    Block& block = _blocks[stream];
+    if (block.count > 0 && time <= block.firstTime + block.lastTicks * _settings.timeUnit)
+        return false;
+    if (block.count == _settings.maxBlockSamples ||
+        (block.count > 0 && time - block.firstTime >= _settings.maxBlockSeconds))
+    {
+        if (!writeBlock(stream))
+            return false;
+    }
+
+    int32_t rotation[3];
+    int largest = quantizeRotation(pose.rotation, _settings.quaternionBits, rotation);
+    int64_t translation[3] = {
+        llround(pose.translation.x / _settings.translationUnit),
+        llround(pose.translation.y / _settings.translationUnit),
+        llround(pose.translation.z / _settings.translationUnit),
+    };
+
+    if (block.count == 0)
+    {
+        block.firstTime = time;
+        block.bytes.push_back((uint8_t)(largest | PoseStreamAbsoluteRotation));
+        for (int i = 0; i < 3; i++)
+            putVarint(block.bytes, rotation[i]);
+        for (int i = 0; i < 3; i++)
+            putVarint(block.bytes, translation[i]);
+        block.lastTicks = 0;
+        block.lastStep = 0;
+        for (int i = 0; i < 3; i++)
+            block.previousTranslation[i] = translation[i];
+    }
+    else
+    {
+        int64_t ticks = llround((time - block.firstTime) / _settings.timeUnit);
+        if (ticks <= block.lastTicks)
+            return false;
+
+        bool absolute = largest != block.largest;
+        block.bytes.push_back((uint8_t)(largest | (absolute ? PoseStreamAbsoluteRotation : 0)));
+        int64_t step = ticks - block.lastTicks;
+        putVarint(block.bytes, step - block.lastStep);
+        for (int i = 0; i < 3; i++)
+            putVarint(block.bytes, absolute ? rotation[i] : (int64_t)rotation[i] - block.rotation[i]);
+        for (int i = 0; i < 3; i++)
+        {
+            int64_t predicted = 2 * block.translation[i] - block.previousTranslation[i];
+            putVarint(block.bytes, translation[i] - predicted);
+            block.previousTranslation[i] = block.translation[i];
+        }
+        block.lastTicks = ticks;
+        block.lastStep = step;
+    }
+
+    block.largest = largest;
+    for (int i = 0; i < 3; i++)
+    {
+        block.rotation[i] = rotation[i];
+        block.translation[i] = translation[i];
+    }
+    block.count++;
+    _samples++;
+    return true;
+}
+
+PoseStreamReader::PoseStreamReader()
+    : _fd(-1), _data(NULL), _size(0), _truncated(false)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+PoseStreamReader::~PoseStreamReader()
+{
+    close();
+}
+
+bool PoseStreamReader::open(const char* path)
+{
+    close();
+
+    _fd = ::open(path, O_RDONLY);
+    if (_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || (size_t)st.st_size < sizeof(PoseStreamHeader))
+    {
+        close();
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    _data = (const uint8_t*)data;
+    _size = (size_t)st.st_size;
+
+    memcpy(&_header, _data, sizeof(_header));
+    if (_header.magic != POSE_STREAM_MAGIC || _header.version != POSE_STREAM_VERSION ||
+        _header.headerSize < sizeof(_header) || _header.headerSize > _size ||
+        _header.quaternionBits < 2 || _header.quaternionBits > 30 ||
+        !(_header.timeUnit > 0) || !(_header.translationUnit > 0))
+    {
+        close();
+        return false;
+    }
+
+    // Walk the blocks up to the first one that is not whole.
+    size_t offset = _header.headerSize;
+    while (offset + sizeof(PoseStreamBlockHeader) <= _size)
+    {
+        PoseStreamBlockHeader block;
+        memcpy(&block, _data + offset, sizeof(block));
+        if (block.magic != POSE_STREAM_BLOCK_MAGIC || block.stream >= POSE_STREAM_COUNT ||
+            block.size > _size - offset - sizeof(block))
+            break;
+        _blocks.push_back(offset);
+        offset += sizeof(block) + block.size;
+    }
+    _truncated = offset != _size;
+    return true;
+}
+
+void PoseStreamReader::close()
+{
+    if (_data)
+        munmap((void*)_data, _size);
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+    _data = NULL;
+    _size = 0;
+    _truncated = false;
+    _blocks.clear();
+}
+
+bool PoseStreamReader::read(uint8_t stream, std::vector<PoseLogRecord>& records) const
+{
+    int bits = (int)_header.quaternionBits;
+    double timeUnit = _header.timeUnit;
+    double translationUnit = _header.translationUnit;
+
+    for (size_t b = 0; b < _blocks.size(); b++)
+    {
+        PoseStreamBlockHeader block;
+        memcpy(&block, _data + _blocks[b], sizeof(block));
+        if (block.stream != stream)
+            continue;
+
+        const uint8_t* at = _data + _blocks[b] + sizeof(block);
+        const uint8_t* end = at + block.size;
+        int64_t ticks = 0, step = 0;
+        int32_t rotation[3] = { 0, 0, 0 };
+        int64_t translation[3] = { 0, 0, 0 };
+        int64_t previousTranslation[3] = { 0, 0, 0 };
+
+        for (uint16_t n = 0; n < block.count; n++)
+        {
+            if (at == end)
+                return false;
+            uint8_t tag = *at++;
+            int64_t value;
+
+            if (n > 0)
+            {
+                if (!getVarint(at, end, value))
+                    return false;
+                step += value;
+                ticks += step;
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                if (!getVarint(at, end, value))
+                    return false;
+                rotation[i] = (int32_t)((tag & PoseStreamAbsoluteRotation) ? value : rotation[i] + value);
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                if (!getVarint(at, end, value))
+                    return false;
+                int64_t predicted = n == 0 ? 0 : 2 * translation[i] - previousTranslation[i];
+                previousTranslation[i] = n == 0 ? value : translation[i];
+                translation[i] = predicted + value;
+            }
+
+            Pose pose(dequantizeRotation(tag & PoseStreamLargestMask, rotation, bits),
+                      Vector3(translation[0] * translationUnit, translation[1] * translationUnit,
+                              translation[2] * translationUnit));
+            records.push_back(PoseLogRecord::make(block.firstTime + ticks * timeUnit, pose));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,179 @@
+//
+//  PoseStream.h
+//  UnboundedTracker
+//
+//  Compressed log of timed camera poses, several streams of them in one
+//  file, as MotionLogs records the game camera and the tracker together.
+//
+//  file     PoseStreamHeader, then blocks
+//  block    PoseStreamBlockHeader, then the samples of one stream
+//
+//  A block starts over from absolute values so it decodes on its own, and
+//  is written whole; a log that was not closed reads up to its last block.
+//  The blocks of a stream are in time order. Each sample is
+//
+//    tag          one byte, the index of the largest quaternion component,
+//                 plus PoseStreamAbsoluteRotation when the others are not
+//                 deltas
+//    time         change of the time step, in timeUnit ticks
+//    rotation     the three smaller quaternion components, quantized to
+//                 quaternionBits, as deltas to the previous sample
+//    translation  fixed point in translationUnit, as the difference to the
+//                 position extrapolated from the previous two samples
+//
+//  all as zigzag varints, except the tag. The first sample of a block has
+//  the absolute rotation and translation and the time of the block header.
+//  Header fields are little endian, the byte order of both the iOS devices
+//  and the hosts the tools run on, so the structures are written as they
+//  are.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "PoseLog.h"
+#include "PoseMath.h"
+
+#define POSE_STREAM_MAGIC 0x5a535050u         // "PPSZ"
+#define POSE_STREAM_BLOCK_MAGIC 0x4b4c4250u   // "PBLK"
+#define POSE_STREAM_VERSION 1
+
+// Streams per file.
+#define POSE_STREAM_COUNT 4
+
+enum PoseStreamTag
+{
+    PoseStreamLargestMask = 3,
+    PoseStreamAbsoluteRotation = 4
+};
+
+struct PoseStreamHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t flags;
+    uint32_t quaternionBits;
+    // Wall clock time the recording started, seconds since 1970.
+    double created;
+    double timeUnit;
+    double translationUnit;
+};
+
+struct PoseStreamBlockHeader
+{
+    uint32_t magic;
+    uint8_t stream;
+    uint8_t reserved8;
+    uint16_t count;
+    // Bytes of samples following this header.
+    uint32_t size;
+    uint32_t reserved;
+    double firstTime;
+    double lastTime;
+};
+
+static_assert(sizeof(PoseStreamHeader) == 40, "pose stream header layout");
+static_assert(sizeof(PoseStreamBlockHeader) == 32, "pose stream block header layout");
+
+struct PoseStreamSettings
+{
+    // A microsecond, and a tenth of a millimeter; with 15 bits the rotation
+    // is within 0.01 degrees.
+    double timeUnit = 1e-6;
+    double translationUnit = 1e-4;
+    int quaternionBits = 15;
+
+    // A block is written when it is this full or this long; the longer, the
+    // more a crash loses.
+    size_t maxBlockSamples = 256;
+    double maxBlockSeconds = 2.;
+};
+
+// Encodes samples into blocks and writes a block at a time. Not thread safe.
+class PoseStreamWriter
+{
+public:
+    explicit PoseStreamWriter(const PoseStreamSettings& settings = PoseStreamSettings());
+    ~PoseStreamWriter();
+
+    // Returns false if the file cannot be created.
+    bool open(const char* path, double created);
+
+    // Writes the open blocks. Returns false if any write of the log failed.
+    bool close();
+    bool isOpen() const { return _file != NULL; }
+
+    // Samples not later than the previous one of their stream, after the
+    // time is quantized, are skipped. Returns false if the sample was
+    // skipped or a block could not be written.
+    bool append(uint8_t stream, double time, const Pose& pose);
+
+    uint64_t samples() const { return _samples; }
+    uint64_t bytesWritten() const { return _bytesWritten; }
+
+private:
+    PoseStreamWriter(const PoseStreamWriter&);
+    PoseStreamWriter& operator=(const PoseStreamWriter&);
+
+    struct Block
+    {
+        std::vector<uint8_t> bytes;
+        uint16_t count;
+        double firstTime;
+        int64_t lastTicks;
+        int64_t lastStep;
+        int largest;
+        int32_t rotation[3];
+        int64_t translation[3];
+        int64_t previousTranslation[3];
+    };
+
+    bool writeBlock(uint8_t stream);
+
+    PoseStreamSettings _settings;
+    FILE* _file;
+    bool _failed;
+    uint64_t _samples;
+    uint64_t _bytesWritten;
+    Block _blocks[POSE_STREAM_COUNT];
+};
+
+// Maps a log read only and decodes its streams.
+class PoseStreamReader
+{
+public:
+    PoseStreamReader();
+    ~PoseStreamReader();
+
+    // Returns false if the file cannot be mapped or is not a pose stream.
+    bool open(const char* path);
+    void close();
+    bool isOpen() const { return _data != NULL; }
+
+    const PoseStreamHeader& header() const { return _header; }
+    size_t fileSize() const { return _size; }
+    size_t blockCount() const { return _blocks.size(); }
+
+    // The log ends in an incomplete or damaged block.
+    bool truncated() const { return _truncated; }
+
+    // Appends the samples of a stream, in time order, to records. Returns
+    // false if a block does not decode.
+    bool read(uint8_t stream, std::vector<PoseLogRecord>& records) const;
+
+private:
+    PoseStreamReader(const PoseStreamReader&);
+    PoseStreamReader& operator=(const PoseStreamReader&);
+
+    int _fd;
+    const uint8_t* _data;
+    size_t _size;
+    bool _truncated;
+    PoseStreamHeader _header;
+    // Offsets of the block headers.
+    std::vector<size_t> _blocks;
+};
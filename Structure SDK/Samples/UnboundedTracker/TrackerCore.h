@@ -0,0 +1,393 @@
+//
+//  TrackerCore.h
+//  UnboundedTracker
+//
+//  The thread a tracker runs on, without the tracker: commands queued
+//  through lock-free rings (CommandRing.h), run in the order they were
+//  queued on a std::thread, each result published as the last update for
+//  other threads to read or wait for. Frame admission (FrameAdmission.h)
+//  measures the tracker's cost as it runs. TrackerThread puts STTracker
+//  behind it; tools/tracker_core_bench.cpp a mock.
+//
+//  The backend is default constructible and provides
+//
+//    typedef ... Frame;    what a depth frame command carries, default
+//                          constructible and move assignable
+//    typedef ... Pose;     an initial pose
+//    typedef ... Update;   the result of a command, with a double timestamp
+//                          that is negative for no pose
+//
+//    double now();         monotonic seconds, the clock of the arrival times
+//    template <typename Step> void runStep(const Step& step);
+//                          calls step() on the tracker thread, with whatever
+//                          has to be set up around it
+//    void reset(Update& update);
+//    void setInitialPose(const Pose& pose, double timestamp, Update& update);
+//    void track(Frame& frame, double arrivalTime, bool downsampled, Update& update);
+//
+//  all called on the tracker thread.
+//
+//  Commands are queued from one thread, the one delivering the sensor
+//  frames; the updates can be read from any.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include "CommandRing.h"
+#include "FrameAdmission.h"
+
+struct TrackerCoreStats
+{
+    uint64_t framesQueued;
+    uint64_t framesTracked;
+    uint64_t controlsRun;
+    uint64_t droppedOldestFrames;
+    uint64_t droppedNewestFrames;
+
+    // Times the tracker thread went to sleep with nothing to do.
+    uint64_t sleeps;
+
+    uint64_t updatesPublished;
+    uint64_t waitTimeouts;
+    // Locks of the last update that found it taken.
+    uint64_t updateLockContended;
+};
+
+template <typename Backend>
+class TrackerCore
+{
+public:
+    typedef typename Backend::Frame Frame;
+    typedef typename Backend::Pose Pose;
+    typedef typename Backend::Update Update;
+
+    explicit TrackerCore(const FrameAdmissionSettings& admissionSettings = FrameAdmissionSettings())
+        : _controls(CommandDropNewest), _nextSequence(0), _running(false), _stopping(false), _sleeping(false),
+          _admission(admissionSettings), _framesQueued(0), _framesTracked(0), _controlsRun(0), _sleeps(0),
+          _updatesPublished(0), _waitTimeouts(0), _updateLockContended(0)
+    {
+    }
+
+    ~TrackerCore() { stop(); }
+
+    // Change it only while stopped, or what the backend makes thread safe.
+    Backend& backend() { return _backend; }
+
+    void start()
+    {
+        if (_thread.joinable())
+            return;
+        _stopping.store(false, std::memory_order_relaxed);
+        _running.store(true, std::memory_order_release);
+        _thread = std::thread(&TrackerCore::run, this);
+    }
+
+    // Returns once the command being run is done. Queued commands are
+    // dropped, releasing what they hold.
+    void stop()
+    {
+        if (!_thread.joinable())
+            return;
+        _stopping.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(_wakeMutex);
+        }
+        _wake.notify_one();
+        _thread.join();
+        _running.store(false, std::memory_order_release);
+
+        Command pending;
+        while (_frames.pop(pending))
+            pending = Command();
+        while (_controls.pop(pending))
+            pending = Command();
+    }
+
+    bool isRunning() const { return _running.load(std::memory_order_acquire); }
+
+    void reset()
+    {
+        Command command;
+        command.action = ActionReset;
+        queueControl(command);
+    }
+
+    void setInitialPose(const Pose& pose, double timestamp)
+    {
+        Command command;
+        command.action = ActionSetInitialPose;
+        command.pose = pose;
+        command.timestamp = timestamp;
+        queueControl(command);
+    }
+
+    // Never waits: when the ring is full either the oldest queued frame or
+    // this one goes, as frameDropPolicy says. Returns false for this one.
+    bool queueFrame(Frame&& frame, double arrivalTime, bool downsampled)
+    {
+        Command command;
+        command.action = ActionTrackFrame;
+        command.sequence = _nextSequence++;
+        command.frame = std::move(frame);
+        command.arrivalTime = arrivalTime;
+        command.downsampled = downsampled;
+
+        if (!_frames.push(std::move(command)))
+            return false;
+        _framesQueued.fetch_add(1, std::memory_order_relaxed);
+        wake();
+        return true;
+    }
+
+    // Whether a frame arriving now should be queued, at which resolution.
+    FrameAdmissionDecision admit(double arrivalTime) { return _admission.admit(arrivalTime, _frames.size()); }
+
+    // Called by the render thread once per frame.
+    void renderedFrame(double time) { _admission.renderFrame(time); }
+
+    // CommandDropOldest by default, so the tracker always gets the most
+    // recent frame. Set from the queuing thread.
+    CommandDropPolicy frameDropPolicy() const { return _frames.dropPolicy(); }
+    void setFrameDropPolicy(CommandDropPolicy policy) { _frames.setDropPolicy(policy); }
+
+    FrameAdmissionStats admissionStats() const { return _admission.stats(); }
+
+    TrackerCoreStats stats() const
+    {
+        TrackerCoreStats stats;
+        stats.framesQueued = _framesQueued.load(std::memory_order_relaxed);
+        stats.framesTracked = _framesTracked.load(std::memory_order_relaxed);
+        stats.controlsRun = _controlsRun.load(std::memory_order_relaxed);
+        stats.droppedOldestFrames = _frames.droppedOldest();
+        stats.droppedNewestFrames = _frames.droppedNewest();
+        stats.sleeps = _sleeps.load(std::memory_order_relaxed);
+        stats.updatesPublished = _updatesPublished.load(std::memory_order_relaxed);
+        stats.waitTimeouts = _waitTimeouts.load(std::memory_order_relaxed);
+        stats.updateLockContended = _updateLockContended.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    Update lastUpdate() const
+    {
+        std::unique_lock<std::mutex> lock = lockUpdate();
+        return _lastUpdate;
+    }
+
+    // The last update once it is more recent than timestamp, or at the
+    // latest after maxWaitSeconds.
+    Update waitForUpdateMoreRecentThan(double timestamp, double maxWaitSeconds) const
+    {
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(maxWaitSeconds));
+
+        std::unique_lock<std::mutex> lock = lockUpdate();
+        while (_lastUpdate.timestamp < timestamp + 1e-7)
+        {
+            if (_updateChanged.wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                _waitTimeouts.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        return _lastUpdate;
+    }
+
+private:
+    enum Action
+    {
+        ActionNone,
+        ActionReset,
+        ActionSetInitialPose,
+        ActionTrackFrame
+    };
+
+    struct Command
+    {
+        Action action = ActionNone;
+
+        // Position among all the commands queued, frames or not.
+        uint64_t sequence = 0;
+
+        // ActionTrackFrame
+        Frame frame;
+        // When the frame was admitted, and whether at half resolution.
+        double arrivalTime = -1.;
+        bool downsampled = false;
+
+        // ActionSetInitialPose
+        Pose pose;
+        double timestamp = -1.;
+    };
+
+    // One frame waiting while another is tracked. Anything older is stale by
+    // the time the tracker gets to it, and would hold on to color buffers of
+    // the AVFoundation pool.
+    static const size_t FrameSlots = 2;
+
+    // Resets and initial poses are never dropped, the ring only has to absorb
+    // a burst.
+    static const size_t ControlSlots = 8;
+
+    // The longest the thread sleeps without looking for commands.
+    static const int SleepMilliseconds = 100;
+
+    void queueControl(Command& command)
+    {
+        command.sequence = _nextSequence++;
+
+        // The ring only fills up when the tracker thread stalls on a burst of
+        // control commands, waiting for it then is what the callers always
+        // did. A stopped thread will not read the command anyway.
+        while (!_controls.push(std::move(command)) && isRunning())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        wake();
+    }
+
+    // The queuing side of sleep(): the mutex is only taken when the tracker
+    // thread is asleep or about to be.
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_sleeping.load(std::memory_order_relaxed))
+            return;
+        {
+            std::lock_guard<std::mutex> lock(_wakeMutex);
+        }
+        _wake.notify_one();
+    }
+
+    void sleep()
+    {
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_frames.size() == 0 && _controls.size() == 0 && !_stopping.load(std::memory_order_acquire))
+        {
+            _sleeps.fetch_add(1, std::memory_order_relaxed);
+            _wake.wait_for(lock, std::chrono::milliseconds(SleepMilliseconds));
+        }
+        _sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    void run()
+    {
+        // Commands taken out of the rings but not run yet. The sequence
+        // numbers restore the order in which frames and control commands
+        // were queued.
+        Command nextFrame;
+        Command nextControl;
+        bool hasFrame = false;
+        bool hasControl = false;
+
+        while (!_stopping.load(std::memory_order_acquire))
+        {
+            _backend.runStep([&]() {
+                if (!hasControl)
+                    hasControl = _controls.pop(nextControl);
+                if (!hasFrame)
+                    hasFrame = _frames.pop(nextFrame);
+
+                if (hasControl && (!hasFrame || nextControl.sequence < nextFrame.sequence))
+                {
+                    runControl(nextControl);
+                    nextControl = Command();
+                    hasControl = false;
+                }
+                else if (hasFrame)
+                {
+                    track(nextFrame);
+                    nextFrame = Command(); // make sure we don't keep handles on sample buffers, etc.
+                    hasFrame = false;
+                }
+                else
+                {
+                    sleep();
+                }
+            });
+        }
+    }
+
+    void runControl(Command& command)
+    {
+        Update update;
+        if (command.action == ActionReset)
+            _backend.reset(update);
+        else if (command.action == ActionSetInitialPose)
+            _backend.setInitialPose(command.pose, command.timestamp, update);
+        else
+            return;
+        _controlsRun.fetch_add(1, std::memory_order_relaxed);
+        publish(update);
+    }
+
+    void track(Command& command)
+    {
+        Update update;
+        _admission.frameStarted(_backend.now(), command.downsampled);
+        _backend.track(command.frame, command.arrivalTime, command.downsampled, update);
+        _admission.frameTracked(_backend.now());
+        _framesTracked.fetch_add(1, std::memory_order_relaxed);
+        publish(update);
+    }
+
+    void publish(const Update& update)
+    {
+        {
+            std::unique_lock<std::mutex> lock = lockUpdate();
+            _lastUpdate = update;
+        }
+        _updatesPublished.fetch_add(1, std::memory_order_relaxed);
+        _updateChanged.notify_all();
+    }
+
+    std::unique_lock<std::mutex> lockUpdate() const
+    {
+        std::unique_lock<std::mutex> lock(_updateMutex, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            _updateLockContended.fetch_add(1, std::memory_order_relaxed);
+            lock.lock();
+        }
+        return lock;
+    }
+
+    TrackerCore(const TrackerCore&);
+    TrackerCore& operator=(const TrackerCore&);
+
+    Backend _backend;
+
+    // Frames and control commands are queued separately so that frames can
+    // be dropped without ever losing a reset.
+    CommandRing<Command, FrameSlots> _frames;
+    CommandRing<Command, ControlSlots> _controls;
+    uint64_t _nextSequence;
+
+    std::thread _thread;
+    std::atomic<bool> _running;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _sleeping;
+    std::mutex _wakeMutex;
+    std::condition_variable _wake;
+
+    FrameAdmission _admission;
+
+    Update _lastUpdate;
+    mutable std::mutex _updateMutex;
+    mutable std::condition_variable _updateChanged;
+
+    std::atomic<uint64_t> _framesQueued;
+    std::atomic<uint64_t> _framesTracked;
+    std::atomic<uint64_t> _controlsRun;
+    std::atomic<uint64_t> _sleeps;
+    std::atomic<uint64_t> _updatesPublished;
+    mutable std::atomic<uint64_t> _waitTimeouts;
+    mutable std::atomic<uint64_t> _updateLockContended;
+};
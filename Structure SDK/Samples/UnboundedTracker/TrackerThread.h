@@ -8,6 +8,12 @@
 
 #import <Structure/StructureSLAM.h>
 
+#include "CommandRing.h"
+#include "FrameAdmission.h"
+#include "PoseExtrapolator.h"
+#include "TrackerCore.h"
+#include "TrackingBudget.h"
+
 struct TrackerUpdate
 {
     double timestamp = -1.0;
@@ -21,18 +27,50 @@ struct TrackerUpdate
  * We use a separate thread for the tracker to make sure we do not block the SceneKit
  * thread for too long, and do not keep the main thread too busy so it can still dispatch
  * events.
+ *
+ * The threading is TrackerCore's (TrackerCore.h), with STTracker as its backend.
+ * Commands reach the thread through lock-free rings, so queuing a frame never waits for
+ * the tracker. Frames beyond what the ring holds are dropped according to frameDropPolicy
+ * and counted. All commands have to be queued from the same thread, the one delivering
+ * the sensor frames.
  */
 @interface TrackerThread : NSObject
 @property (nonatomic,readwrite) STTracker* tracker;
 @property (nonatomic,readwrite) double threadPriority;
 @property (nonatomic,readonly) TrackerUpdate lastUpdate;
 
+// CommandDropOldest by default, so the tracker always gets the most recent frame.
+@property (nonatomic,readwrite) CommandDropPolicy frameDropPolicy;
+@property (nonatomic,readonly) uint64_t droppedOldestFrames;
+@property (nonatomic,readonly) uint64_t droppedNewestFrames;
+
+@property (nonatomic,readonly) FrameAdmissionStats admissionStats;
+@property (nonatomic,readonly) TrackerCoreStats coreStats;
+@property (nonatomic,readonly) PoseExtrapolatorStats extrapolatorStats;
+@property (nonatomic,readonly) TrackingBudgetStats budgetStats;
+
 -(void) start;
 -(void) stop;
 -(void) reset;
 
 -(void) setInitialTrackerPose:(GLKMatrix4)newPose timestamp:(double)timestamp;
 -(void) updateWithMotion:(CMDeviceMotion*)motion;
--(bool) updateWithDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame maxWaitTimeSeconds:(double)waitTime;
+-(bool) updateWithDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame;
+
+// Queues the frame at full or half resolution, or skips it, depending on what the tracker
+// is expected to manage within a frame without holding up the render thread, and on how
+// little it needs while tracking is good and the device moves slowly (TrackingBudget.h).
+// The arrival time is on the clock of CACurrentMediaTime(). Returns what became of the frame,
+// FrameSkip as well when the ring turned it away.
+-(FrameAdmissionDecision) admitDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame arrivalTime:(double)arrivalTime;
+
+// To be called by the render thread once per frame, with the SceneKit renderer time.
+-(void) renderedFrameAtTime:(NSTimeInterval)time;
+
+// Camera pose at a time past the last update, on the clock of CACurrentMediaTime(),
+// extrapolated from the last tracker pose with the motion passed to updateWithMotion:.
+// Returns false when there is no pose to extrapolate from.
+-(bool) predictCameraPose:(GLKMatrix4*)cameraPose atTime:(double)time;
+
 -(TrackerUpdate) waitForUpdateMoreRecentThan:(NSTimeInterval)timestamp maxWaitTimeSeconds:(double)waitTime;
 @end
@@ -6,47 +6,140 @@
 
 #import "TrackerThread.h"
 
-struct TrackerCommand
+#import <QuartzCore/QuartzCore.h>
+
+// Set to 1 to log the timing trace tools/admission_sim.cpp replays.
+#define TRACKER_TIMING_LOG 0
+
+// Set to 1 to log the motion, statuses and poses tools/pose_extrapolation_bench.cpp and
+// tools/tracking_budget_sim.cpp replay.
+#define TRACKER_MOTION_LOG 0
+
+// The frames a depth frame command holds.
+struct TrackerFrame
 {
-    enum Action
-    {
-        ActionNone,
-        ActionReset,
-        ActionSetInitialPose,
-        ActionProcessNextFrame
-    };
+    STDepthFrame* depthFrame = nil;
+    STColorFrame* colorFrame = nil;
+};
+
+// STTracker behind TrackerCore, see TrackerCore.h.
+struct STTrackerBackend
+{
+    typedef TrackerFrame Frame;
+    typedef GLKMatrix4 Pose;
+    typedef TrackerUpdate Update;
     
-    bool finished () const { return action == ActionNone || isProcessed; }
+    STTracker* tracker = nil;
+    PoseExtrapolator* extrapolator = nullptr;
+    TrackingBudget* budget = nullptr;
     
-    Action action = ActionNone;
+    // Set from any thread, applied by the tracker thread before its next step.
+    std::atomic<double> threadPriority;
+    double appliedThreadPriority = -1.;
     
-    // For TrackerCommandProcessNextFrame command
-    STDepthFrame* depthFrame;
-    STColorFrame* colorFrame;
+    STTrackerBackend() : threadPriority(0.5) {}
     
-    // For setInitialPose command.
-    GLKMatrix4 cameraPose;
+    double now() const { return CACurrentMediaTime(); }
     
-    double timestamp = -1.;
+    template <typename Step> void runStep(const Step& step)
+    {
+        // We need an autoreleasepool to capture autorelease objects, otherwise they won't be
+        // garbage collected before the thread exits.
+        @autoreleasepool
+        {
+            double priority = threadPriority.load(std::memory_order_relaxed);
+            if (priority != appliedThreadPriority)
+            {
+                [NSThread setThreadPriority:priority];
+                appliedThreadPriority = priority;
+            }
+            step();
+        }
+    }
     
-    bool isProcessed = false;
+    void reset(TrackerUpdate& update)
+    {
+        [tracker reset];
+        extrapolator->reset();
+        budget->reset();
+        update = TrackerUpdate();
+    }
+    
+    void setInitialPose(const GLKMatrix4& cameraPose, double timestamp, TrackerUpdate& update)
+    {
+        tracker.initialCameraPose = cameraPose;
+        extrapolator->setTrackerPose(timestamp, ::Pose::fromMatrix(cameraPose.m));
+        
+        update = TrackerUpdate();
+        update.cameraPose = cameraPose;
+        update.timestamp = timestamp;
+        update.couldEstimatePose = true;
+        update.trackerStatus = STTrackerStatusGood;
+        update.trackingError = nil;
+    }
+    
+    void track(TrackerFrame& frame, double arrivalTime, bool downsampled, TrackerUpdate& update)
+    {
+        NSError* trackerError = nil;
+        
+        update.timestamp = frame.depthFrame.timestamp;
+        
+        // First try to estimate the 3D pose of the new frame.
+#if TRACKER_TIMING_LOG
+        double start = CACurrentMediaTime();
+#endif
+        bool trackingOk = [tracker updateCameraPoseWithDepthFrame:frame.depthFrame
+                                                       colorFrame:frame.colorFrame
+                                                            error:&trackerError];
+#if TRACKER_TIMING_LOG
+        // Only the cost of the resolution used is known.
+        double end = CACurrentMediaTime();
+        NSLog(@"TIMING frame %.6f %.6f %.6f", arrivalTime,
+              downsampled ? -1. : end - start, downsampled ? end - start : -1.);
+#else
+        (void)arrivalTime;
+#endif
+        
+        update.trackerStatus = tracker.status;
+        update.trackingError = trackerError;
+        
+        // When the quality was poor, we could still get a pose.
+        update.couldEstimatePose = trackingOk || trackerError.code == STErrorTrackerPoorQuality;
+        
+        // STTrackerQuality is a setting rather than a measurement, so the status is what tells
+        // how well the tracker is doing.
+        budget->trackerStatus(update.couldEstimatePose && update.trackerStatus == STTrackerStatusGood);
+        
+#if TRACKER_MOTION_LOG
+        NSLog(@"MOTION status %.6f %d", update.timestamp, update.couldEstimatePose ? (int)update.trackerStatus : -1);
+#endif
+        
+        if (update.couldEstimatePose)
+        {
+            update.cameraPose = tracker.lastFrameCameraPose;
+            ::Pose pose = ::Pose::fromMatrix(update.cameraPose.m);
+            ::Pose predicted;
+            if (extrapolator->predict(update.timestamp, predicted))
+                budget->poseTracked(downsampled, predicted, pose);
+            extrapolator->setTrackerPose(update.timestamp, pose);
+            
+#if TRACKER_MOTION_LOG
+            const float* m = update.cameraPose.m;
+            NSLog(@"MOTION pose %.6f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f", update.timestamp,
+                  m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8], m[9], m[10], m[11], m[12], m[13], m[14], m[15]);
+#endif
+        }
+    }
 };
 
 @interface TrackerThread ()
 {
-    STTracker* _tracker;
-
-    NSThread* _trackerThread;
-
-    TrackerCommand _nextCommand;
-    NSCondition* _nextCommandChangedCondition;
-    
-    TrackerUpdate _lastUpdate;
-    NSCondition* _lastUpdateChangedCondition;
+    TrackerCore<STTrackerBackend> _core;
+    PoseExtrapolator _extrapolator;
+    TrackingBudget _budget;
 }
 
--(void) threadMain;
--(void)estimateNewPose:(const TrackerCommand&)command;
+-(bool) queueDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame arrivalTime:(double)arrivalTime downsampled:(bool)downsampled;
 @end
 
 @implementation TrackerThread
@@ -56,9 +149,8 @@ struct TrackerCommand
     self = [super init];
     if (self)
     {
-        _nextCommandChangedCondition = [[NSCondition alloc] init];
-        _lastUpdateChangedCondition = [[NSCondition alloc] init];
-        _trackerThread = [[NSThread alloc] initWithTarget:self selector:@selector(threadMain) object:nil];
+        _core.backend().extrapolator = &_extrapolator;
+        _core.backend().budget = &_budget;
     }
     return self;
 }
@@ -70,25 +162,22 @@ struct TrackerCommand
 
 -(TrackerUpdate)lastUpdate
 {
-    [_lastUpdateChangedCondition lock];
-    TrackerUpdate lastUpdateCopy = _lastUpdate;
-    [_lastUpdateChangedCondition unlock];
-    return lastUpdateCopy;
+    return _core.lastUpdate();
 }
 
 -(STTracker*)tracker
 {
-    return _tracker;
+    return _core.backend().tracker;
 }
 
 -(void)setTracker:(STTracker *)newTracker
 {
-    bool wasRunning = _trackerThread.isExecuting;
+    bool wasRunning = _core.isRunning();
     
     if (wasRunning)
         [self stop];
     
-    _tracker = newTracker;
+    _core.backend().tracker = newTracker;
     
     if (newTracker != nil && wasRunning)
         [self start];
@@ -96,245 +185,150 @@ struct TrackerCommand
 
 -(double) threadPriority
 {
-    return _trackerThread.threadPriority;
+    return _core.backend().threadPriority.load(std::memory_order_relaxed);
 }
 
 -(void) setThreadPriority:(double)threadPriority
 {
-    _trackerThread.threadPriority = threadPriority;
+    _core.backend().threadPriority.store(threadPriority, std::memory_order_relaxed);
+}
+
+-(CommandDropPolicy) frameDropPolicy
+{
+    return _core.frameDropPolicy();
+}
+
+-(void) setFrameDropPolicy:(CommandDropPolicy)frameDropPolicy
+{
+    _core.setFrameDropPolicy(frameDropPolicy);
+}
+
+-(uint64_t) droppedOldestFrames
+{
+    return _core.stats().droppedOldestFrames;
+}
+
+-(uint64_t) droppedNewestFrames
+{
+    return _core.stats().droppedNewestFrames;
+}
+
+-(FrameAdmissionStats) admissionStats
+{
+    return _core.admissionStats();
+}
+
+-(TrackerCoreStats) coreStats
+{
+    return _core.stats();
 }
 
 -(void) start
 {
-    if (_trackerThread.isExecuting)
-    {
-        return;
-    }
-    
-    [_trackerThread start];
-    
-    // We could use a condition here. We just want to wait until the thread finished.
-    while (!_trackerThread.isExecuting)
-        [NSThread sleepForTimeInterval:0.005]; // sleep for 5 ms.
+    _core.start();
 }
 
 -(void) stop
 {
-    [_trackerThread cancel];
-    
-    {
-        [_nextCommandChangedCondition lock];
-        _nextCommand.action = TrackerCommand::ActionNone;
-        [_nextCommandChangedCondition signal];
-        [_nextCommandChangedCondition unlock];
-    }
-    
-    if (_trackerThread.isFinished)
-        return;
-    
-    // We could use a condition here. We just want to wait until the thread finished.
-    while (!_trackerThread.isFinished)
-        [NSThread sleepForTimeInterval:0.005]; // sleep for 5 ms.
+    _core.stop();
 }
 
 -(void) reset
 {
-    [_nextCommandChangedCondition lock];
-    while (!_nextCommand.finished())
-        [_nextCommandChangedCondition wait];
-    
-    _nextCommand = TrackerCommand ();
-    _nextCommand.action = TrackerCommand::ActionReset;
-    [_nextCommandChangedCondition signal];
-    
-    [_nextCommandChangedCondition unlock];
+    _core.reset();
 }
 
 -(void) setInitialTrackerPose:(GLKMatrix4)newPose timestamp:(double)timestamp
 {
-    [_nextCommandChangedCondition lock];
-    
-    // Make sure the previous frame is processed.
-    while (!_nextCommand.finished())
-        [_nextCommandChangedCondition wait];
-    
-    _nextCommand.action = TrackerCommand::ActionSetInitialPose;
-    _nextCommand.cameraPose = newPose;
-    _nextCommand.isProcessed = false;
-    _nextCommand.depthFrame = nil;
-    _nextCommand.colorFrame = nil;
-    _nextCommand.timestamp = timestamp;
-    
-    [_nextCommandChangedCondition signal];
-    [_nextCommandChangedCondition unlock];
+    _core.setInitialPose(newPose, timestamp);
 }
 
 -(void) updateWithMotion:(CMDeviceMotion*)motion
 {
     // CoreMotion updates are thread safe in STTracker.
-    [_tracker updateCameraPoseWithMotion:motion];
+    [_core.backend().tracker updateCameraPoseWithMotion:motion];
+    
+    Vector3 rotationRate(motion.rotationRate.x, motion.rotationRate.y, motion.rotationRate.z);
+    Vector3 userAcceleration(motion.userAcceleration.x, motion.userAcceleration.y, motion.userAcceleration.z);
+    _extrapolator.addMotion(motion.timestamp, rotationRate, userAcceleration);
+    _budget.addMotion(motion.timestamp, rotationRate, userAcceleration);
+    
+#if TRACKER_MOTION_LOG
+    NSLog(@"MOTION imu %.6f %.6f %.6f %.6f %.6f %.6f %.6f", motion.timestamp,
+          rotationRate.x, rotationRate.y, rotationRate.z,
+          userAcceleration.x, userAcceleration.y, userAcceleration.z);
+#endif
 }
 
--(bool) updateWithDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame maxWaitTimeSeconds:(double)waitTime
+-(bool) predictCameraPose:(GLKMatrix4*)cameraPose atTime:(double)time
 {
-    [_nextCommandChangedCondition lock];
-    
-    // Make sure the previous frame is processed.
-    {
-        NSDate* timeoutDate = [NSDate dateWithTimeIntervalSinceNow:waitTime];
-        bool didTimeout = false;
-        while (!didTimeout && !_nextCommand.finished())
-        {
-            didTimeout = ([_nextCommandChangedCondition waitUntilDate:timeoutDate] == NO);
-        }
-        
-        if (didTimeout)
-        {
-            [_nextCommandChangedCondition unlock];
-            return false;
-        }
-    }
-    
-    _nextCommand.action = TrackerCommand::ActionProcessNextFrame;
-    _nextCommand.isProcessed = false;
-    _nextCommand.timestamp = depthFrame.timestamp;
-    _nextCommand.depthFrame = [depthFrame copy];
-    _nextCommand.colorFrame = colorFrame;
-    
-    [_nextCommandChangedCondition signal];
-    [_nextCommandChangedCondition unlock];
+    Pose pose;
+    if (!_extrapolator.predict(time, pose))
+        return false;
+    pose.toMatrix(cameraPose->m);
     return true;
 }
 
--(TrackerUpdate) waitForUpdateMoreRecentThan:(NSTimeInterval)timestamp maxWaitTimeSeconds:(double)waitTime
+-(PoseExtrapolatorStats) extrapolatorStats
 {
-    [_lastUpdateChangedCondition lock];
+    return _extrapolator.stats();
+}
 
+-(TrackingBudgetStats) budgetStats
+{
+    return _budget.stats();
+}
+
+-(bool) updateWithDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame
+{
+    return [self queueDepthFrame:depthFrame colorFrame:colorFrame arrivalTime:CACurrentMediaTime() downsampled:false];
+}
+
+-(FrameAdmissionDecision) admitDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame arrivalTime:(double)arrivalTime
+{
+    // The budget goes first, so the frames it skips do not count as arrivals for the admission. Its counters
+    // take the decision admission leaves, and a frame the full ring turns away counts as skipped.
+    FrameAdmissionDecision decision = _budget.admit(depthFrame.timestamp);
+    if (decision != FrameSkip)
     {
-        NSDate* timeoutDate = [NSDate dateWithTimeIntervalSinceNow:waitTime];
-        bool didTimeout = false;
-        while (!didTimeout && _lastUpdate.timestamp < (timestamp + 1e-7))
-        {
-            didTimeout = ([_lastUpdateChangedCondition waitUntilDate:timeoutDate] == NO);
-        }
+        FrameAdmissionDecision admission = _core.admit(arrivalTime);
+        if (admission != FrameSubmit)
+            decision = admission;
     }
-
-    TrackerUpdate lastUpdateCopy = _lastUpdate;
-    [_lastUpdateChangedCondition unlock];
     
-    return lastUpdateCopy;
+    if (decision == FrameSubmit &&
+        ![self queueDepthFrame:depthFrame colorFrame:colorFrame arrivalTime:arrivalTime downsampled:false])
+        decision = FrameSkip;
+    else if (decision == FrameDownsample &&
+             ![self queueDepthFrame:depthFrame.halfResolutionDepthFrame colorFrame:colorFrame arrivalTime:arrivalTime downsampled:true])
+        decision = FrameSkip;
+    
+    FrameAdmissionStats costs = _core.admissionStats();
+    _budget.committed(decision, costs.fullCostSeconds, costs.halfCostSeconds);
+    return decision;
 }
 
--(void) threadMain
+-(void) renderedFrameAtTime:(NSTimeInterval)time
 {
-    while (!_trackerThread.cancelled)
-    {
-        // We need an autoreleasepool to capture autorelease objects, otherwise they won't be
-        // garbage collected before the thread exits.
-        @autoreleasepool
-        {
-            [_nextCommandChangedCondition lock];
-            
-            if (_nextCommand.finished())
-                [_nextCommandChangedCondition wait];
-            
-            TrackerCommand currentCommand = _nextCommand;
-            
-            _nextCommand = TrackerCommand(); // make sure we don't keep handles on sample buffers, etc.
-            _nextCommand.isProcessed = true;
-            [_nextCommandChangedCondition signal];
-            [_nextCommandChangedCondition unlock];
-            
-            // Nothing to process? Let's wait for the next command.
-            if (currentCommand.isProcessed)
-            {
-                continue;
-            }
-            
-            switch (currentCommand.action)
-            {
-                case TrackerCommand::ActionNone:
-                {
-                    break;
-                }
-                    
-                case TrackerCommand::ActionReset:
-                {
-                    [_tracker reset];
-                    {
-                        [_lastUpdateChangedCondition lock];
-                        _lastUpdate = TrackerUpdate();
-                        [_lastUpdateChangedCondition signal];
-                        [_lastUpdateChangedCondition unlock];
-                    }
-                    break;
-                }
-                    
-                case TrackerCommand::ActionSetInitialPose:
-                {
-                    _tracker.initialCameraPose = currentCommand.cameraPose;
-                    {
-                        [_lastUpdateChangedCondition lock];
-                        
-                        _lastUpdate = TrackerUpdate();
-                        _lastUpdate.cameraPose = currentCommand.cameraPose;
-                        _lastUpdate.timestamp = currentCommand.timestamp;
-                        _lastUpdate.couldEstimatePose = true;
-                        _lastUpdate.trackerStatus = STTrackerStatusGood;
-                        _lastUpdate.trackingError = nil;
-                        
-                        [_lastUpdateChangedCondition signal];
-                        [_lastUpdateChangedCondition unlock];
-                    }
-                    break;
-                }
-                    
-                case TrackerCommand::ActionProcessNextFrame:
-                {
-                    [self estimateNewPose:currentCommand];
-                    if (currentCommand.colorFrame)
-                        currentCommand.colorFrame = nil;
-                    if (currentCommand.depthFrame)
-                        currentCommand.depthFrame = nil;
-                    break;
-                }
-                    
-                default:
-                    break;
-            };
-            
-            currentCommand.isProcessed = true;
-        }
-    } // autoreleasepool
+    _core.renderedFrame(time);
+#if TRACKER_TIMING_LOG
+    NSLog(@"TIMING render %.6f", time);
+#endif
 }
 
--(void) estimateNewPose:(const TrackerCommand&)command
+-(bool) queueDepthFrame:(STDepthFrame*)depthFrame colorFrame:(STColorFrame*)colorFrame arrivalTime:(double)arrivalTime downsampled:(bool)downsampled
 {
-    NSError* trackerError = nil;
-    
-    TrackerUpdate newTrackerUpdate;
-    newTrackerUpdate.timestamp = command.depthFrame.timestamp;
-    
-    // First try to estimate the 3D pose of the new frame.
-    bool trackingOk = [_tracker updateCameraPoseWithDepthFrame:command.depthFrame
-                                                    colorFrame:command.colorFrame
-                                                         error:&trackerError];
-    
-    newTrackerUpdate.trackerStatus = _tracker.status;
-    newTrackerUpdate.trackingError = trackerError;
-    
-    // When the quality was poor, we could still get a pose.
-    newTrackerUpdate.couldEstimatePose = trackingOk || trackerError.code == STErrorTrackerPoorQuality;
-    
-    if (newTrackerUpdate.couldEstimatePose)
-        newTrackerUpdate.cameraPose = _tracker.lastFrameCameraPose;
-    
-    {
-        [_lastUpdateChangedCondition lock];
-        _lastUpdate = newTrackerUpdate;
-        [_lastUpdateChangedCondition signal];
-        [_lastUpdateChangedCondition unlock];
-    }
+    // We need to take a copy of the depth frame since it won't survive the callback scope.
+    // However the color frame will live long enough since the AVFoundation pool is quite big.
+    TrackerFrame frame;
+    frame.depthFrame = [depthFrame copy];
+    frame.colorFrame = colorFrame;
+    return _core.queueFrame(std::move(frame), arrivalTime, downsampled);
+}
+
+-(TrackerUpdate) waitForUpdateMoreRecentThan:(NSTimeInterval)timestamp maxWaitTimeSeconds:(double)waitTime
+{
+    return _core.waitForUpdateMoreRecentThan(timestamp, waitTime);
 }
 
 @end // TrackerThread
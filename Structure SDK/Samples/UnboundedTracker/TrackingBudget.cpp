@@ -0,0 +1,161 @@
+//
+//  TrackingBudget.cpp
+//  UnboundedTracker
+//
+
+#include "TrackingBudget.h"
+#include <algorithm>
+
+TrackingBudget::TrackingBudget(const TrackingBudgetSettings& settings)
+    : _settings(settings), _calmSince(-1), _reducedFrame(0)
+{
+    _settings.reducedStride = std::max(_settings.reducedStride, 1u);
+    _peakRotationRate.store(0, std::memory_order_relaxed);
+    _peakAcceleration.store(0, std::memory_order_relaxed);
+    _lastMotion.store(-1, std::memory_order_relaxed);
+    _good.store(false, std::memory_order_relaxed);
+    _statusDropped.store(false, std::memory_order_relaxed);
+    _level.store(TrackingBudgetFull, std::memory_order_relaxed);
+
+    std::atomic<uint64_t>* counters[] = { &_fullFrames, &_halfFrames, &_skippedFrames, &_fastMotionRestores,
+                                          &_statusRestores, &_fullPoses, &_halfPoses };
+    for (std::atomic<uint64_t>* counter : counters)
+        counter->store(0, std::memory_order_relaxed);
+    std::atomic<double>* sums[] = { &_cpuSavedSeconds, &_fullTranslationError, &_fullAngleError,
+                                    &_halfTranslationError, &_halfAngleError };
+    for (std::atomic<double>* sum : sums)
+        sum->store(0, std::memory_order_relaxed);
+}
+
+void TrackingBudget::raise(std::atomic<double>& peak, double value)
+{
+    double current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void TrackingBudget::reset()
+{
+    _good.store(false, std::memory_order_relaxed);
+    _statusDropped.store(true, std::memory_order_relaxed);
+}
+
+void TrackingBudget::addMotion(double timestamp, const Vector3& rotationRate, const Vector3& userAcceleration)
+{
+    raise(_peakRotationRate, rotationRate.norm());
+    raise(_peakAcceleration, userAcceleration.norm());
+    _lastMotion.store(timestamp, std::memory_order_relaxed);
+}
+
+void TrackingBudget::trackerStatus(bool good)
+{
+    if (!good)
+        _statusDropped.store(true, std::memory_order_relaxed);
+    _good.store(good, std::memory_order_relaxed);
+}
+
+void TrackingBudget::poseTracked(bool downsampled, const Pose& predicted, const Pose& tracked)
+{
+    double translationError = (tracked.translation - predicted.translation).norm();
+    double angleError = (predicted.rotation.conjugate() * tracked.rotation).angle();
+
+    // Only the tracker thread adds to these.
+    std::atomic<uint64_t>& poses = downsampled ? _halfPoses : _fullPoses;
+    std::atomic<double>& translation = downsampled ? _halfTranslationError : _fullTranslationError;
+    std::atomic<double>& angle = downsampled ? _halfAngleError : _fullAngleError;
+    translation.store(translation.load(std::memory_order_relaxed) + translationError, std::memory_order_relaxed);
+    angle.store(angle.load(std::memory_order_relaxed) + angleError, std::memory_order_relaxed);
+    poses.fetch_add(1, std::memory_order_relaxed);
+}
+
+FrameAdmissionDecision TrackingBudget::admit(double timestamp)
+{
+    double rotationRate = _peakRotationRate.exchange(0, std::memory_order_relaxed);
+    double acceleration = _peakAcceleration.exchange(0, std::memory_order_relaxed);
+    double lastMotion = _lastMotion.load(std::memory_order_relaxed);
+    bool statusDropped = _statusDropped.exchange(false, std::memory_order_relaxed);
+    bool good = _good.load(std::memory_order_relaxed) && !statusDropped;
+
+    bool fast = lastMotion < 0 || timestamp - lastMotion > _settings.maxMotionGapSeconds ||
+                rotationRate > _settings.fastRotationRate || acceleration > _settings.fastAcceleration;
+    bool slow = !fast && rotationRate <= _settings.slowRotationRate && acceleration <= _settings.slowAcceleration;
+
+    int level = _level.load(std::memory_order_relaxed);
+    if (!good || fast)
+    {
+        if (level != TrackingBudgetFull)
+        {
+            std::atomic<uint64_t>& restores = good ? _fastMotionRestores : _statusRestores;
+            restores.fetch_add(1, std::memory_order_relaxed);
+        }
+        level = TrackingBudgetFull;
+        _calmSince = -1;
+    }
+    else if (!slow)
+    {
+        level = std::min(level, (int)TrackingBudgetHalf);
+        _calmSince = -1;
+    }
+    else
+    {
+        if (_calmSince < 0)
+            _calmSince = timestamp;
+        double calm = timestamp - _calmSince;
+        if (calm >= _settings.reducedSeconds && level != TrackingBudgetReduced)
+        {
+            level = TrackingBudgetReduced;
+            _reducedFrame = 0;
+        }
+        else if (calm >= _settings.halfSeconds && level == TrackingBudgetFull)
+            level = TrackingBudgetHalf;
+    }
+    _level.store(level, std::memory_order_relaxed);
+
+    FrameAdmissionDecision decision = FrameSubmit;
+    if (level == TrackingBudgetHalf)
+        decision = FrameDownsample;
+    else if (level == TrackingBudgetReduced)
+        decision = _reducedFrame++ % _settings.reducedStride == 0 ? FrameDownsample : FrameSkip;
+    return decision;
+}
+
+void TrackingBudget::committed(FrameAdmissionDecision decision, double fullCostSeconds, double halfCostSeconds)
+{
+    double saved = 0;
+    if (decision == FrameSubmit)
+        _fullFrames.fetch_add(1, std::memory_order_relaxed);
+    else if (decision == FrameDownsample)
+    {
+        _halfFrames.fetch_add(1, std::memory_order_relaxed);
+        saved = std::max(fullCostSeconds - halfCostSeconds, 0.);
+    }
+    else
+    {
+        _skippedFrames.fetch_add(1, std::memory_order_relaxed);
+        saved = fullCostSeconds;
+    }
+    _cpuSavedSeconds.store(_cpuSavedSeconds.load(std::memory_order_relaxed) + saved, std::memory_order_relaxed);
+}
+
+TrackingBudgetStats TrackingBudget::stats() const
+{
+    TrackingBudgetStats stats;
+    stats.level = (TrackingBudgetLevel)_level.load(std::memory_order_relaxed);
+    stats.fullFrames = _fullFrames.load(std::memory_order_relaxed);
+    stats.halfFrames = _halfFrames.load(std::memory_order_relaxed);
+    stats.skippedFrames = _skippedFrames.load(std::memory_order_relaxed);
+    stats.fastMotionRestores = _fastMotionRestores.load(std::memory_order_relaxed);
+    stats.statusRestores = _statusRestores.load(std::memory_order_relaxed);
+    stats.cpuSavedSeconds = _cpuSavedSeconds.load(std::memory_order_relaxed);
+
+    stats.fullPoses = _fullPoses.load(std::memory_order_relaxed);
+    stats.halfPoses = _halfPoses.load(std::memory_order_relaxed);
+    double fullPoses = std::max(stats.fullPoses, (uint64_t)1);
+    double halfPoses = std::max(stats.halfPoses, (uint64_t)1);
+    stats.fullTranslationError = _fullTranslationError.load(std::memory_order_relaxed) / fullPoses;
+    stats.fullAngleError = _fullAngleError.load(std::memory_order_relaxed) / fullPoses;
+    stats.halfTranslationError = _halfTranslationError.load(std::memory_order_relaxed) / halfPoses;
+    stats.halfAngleError = _halfAngleError.load(std::memory_order_relaxed) / halfPoses;
+    return stats;
+}
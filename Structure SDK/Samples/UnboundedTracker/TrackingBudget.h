@@ -0,0 +1,161 @@
+//
+//  TrackingBudget.h
+//  UnboundedTracker
+//
+//  Spends less of the tracker on depth frames while tracking is easy. With
+//  the tracker status good and the device moving slowly for a while, depth
+//  frames are tracked at half resolution; after a longer calm only one in a
+//  few is tracked, still at half resolution, and the rest are skipped. The
+//  first frame after fast motion, a gap in the motion samples or a tracker
+//  status other than good is tracked at full resolution again, and the calm
+//  has to build up anew before the budget relaxes.
+//
+//  Motion between the slow and the fast thresholds keeps the budget where it
+//  is, apart from going back from the reduced rate to every frame, so it
+//  does not flip back and forth on the way.
+//
+//  The counters weigh the CPU saved, from the frame costs FrameAdmission
+//  measures, against the pose error, measured as the distance between the
+//  extrapolated pose and the tracker pose when it comes in, separately for
+//  frames tracked at full and at half resolution.
+//
+//  The frame counters and the CPU saved count the final decision for every
+//  frame, passed to committed() once FrameAdmission had its say, so a frame
+//  the budget lets through and admission skips or downsamples counts as
+//  skipped or half.
+//
+//  addMotion() is called by the CoreMotion queue, trackerStatus() and
+//  poseTracked() by the tracker thread and admit() and committed() by the
+//  thread delivering the sensor frames. All times are in seconds on the clock of the depth
+//  frame and CoreMotion timestamps.
+//
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "FrameAdmission.h"
+#include "PoseMath.h"
+
+enum TrackingBudgetLevel
+{
+    TrackingBudgetFull,
+    TrackingBudgetHalf,
+    TrackingBudgetReduced
+};
+
+struct TrackingBudgetSettings
+{
+    // Peak rotation rate in radians per second and user acceleration in g
+    // since the previous frame. Below both slow limits the motion is slow,
+    // above either fast limit it is fast.
+    double slowRotationRate = 0.5;
+    double slowAcceleration = 0.05;
+    double fastRotationRate = 1.5;
+    double fastAcceleration = 0.25;
+
+    // Good tracking and slow motion for this long relax the budget to half
+    // resolution, and for reducedSeconds to the reduced rate.
+    double halfSeconds = 0.5;
+    double reducedSeconds = 2.;
+
+    // At the reduced rate one frame in this many is tracked.
+    unsigned reducedStride = 2;
+
+    // Without a motion sample for this long the motion is unknown, and
+    // taken for fast.
+    double maxMotionGapSeconds = 0.1;
+};
+
+struct TrackingBudgetStats
+{
+    TrackingBudgetLevel level;
+
+    uint64_t fullFrames;
+    uint64_t halfFrames;
+    uint64_t skippedFrames;
+
+    // Times the budget went back to full resolution, and why.
+    uint64_t fastMotionRestores;
+    uint64_t statusRestores;
+
+    // Tracker time saved against tracking every frame at full resolution,
+    // by the budget and FrameAdmission together.
+    double cpuSavedSeconds;
+
+    // Mean error of the extrapolated pose against the tracker pose, meters
+    // and radians, over the poses of frames tracked at full and at half
+    // resolution.
+    uint64_t fullPoses;
+    double fullTranslationError;
+    double fullAngleError;
+    uint64_t halfPoses;
+    double halfTranslationError;
+    double halfAngleError;
+};
+
+class TrackingBudget
+{
+public:
+    explicit TrackingBudget(const TrackingBudgetSettings& settings = TrackingBudgetSettings());
+
+    // Back to full resolution until the tracker is good again, for a reset
+    // of the tracker.
+    void reset();
+
+    // A CoreMotion device motion sample: rotation rate in radians per second
+    // and user acceleration, without gravity, in g.
+    void addMotion(double timestamp, const Vector3& rotationRate, const Vector3& userAcceleration);
+
+    // Whether the tracker estimated the pose of the last frame with a good
+    // status.
+    void trackerStatus(bool good);
+
+    // The pose the extrapolator predicted for a tracked frame, and the one
+    // the tracker estimated.
+    void poseTracked(bool downsampled, const Pose& predicted, const Pose& tracked);
+
+    // FrameSubmit, FrameDownsample or FrameSkip for the depth frame captured
+    // at timestamp, before FrameAdmission.
+    FrameAdmissionDecision admit(double timestamp);
+
+    // What became of the frame after FrameAdmission, once per frame. The
+    // costs are FrameAdmission's estimates, 0 when unknown.
+    void committed(FrameAdmissionDecision decision, double fullCostSeconds, double halfCostSeconds);
+
+    TrackingBudgetStats stats() const;
+
+private:
+    static void raise(std::atomic<double>& peak, double value);
+
+    TrackingBudgetSettings _settings;
+
+    // Peaks since the previous frame, and the time of the last sample.
+    std::atomic<double> _peakRotationRate;
+    std::atomic<double> _peakAcceleration;
+    std::atomic<double> _lastMotion;
+
+    // A status other than good since the previous frame clears _good and
+    // sets _statusDropped, so even a short drop is seen.
+    std::atomic<bool> _good;
+    std::atomic<bool> _statusDropped;
+
+    // Owned by the thread calling admit() and committed().
+    double _calmSince;
+    unsigned _reducedFrame;
+
+    std::atomic<int> _level;
+    std::atomic<uint64_t> _fullFrames;
+    std::atomic<uint64_t> _halfFrames;
+    std::atomic<uint64_t> _skippedFrames;
+    std::atomic<uint64_t> _fastMotionRestores;
+    std::atomic<uint64_t> _statusRestores;
+    std::atomic<double> _cpuSavedSeconds;
+
+    std::atomic<uint64_t> _fullPoses;
+    std::atomic<double> _fullTranslationError;
+    std::atomic<double> _fullAngleError;
+    std::atomic<uint64_t> _halfPoses;
+    std::atomic<double> _halfTranslationError;
+    std::atomic<double> _halfAngleError;
+};
@@ -142,7 +142,7 @@ namespace
     
     // If the sensor is disconnected, we don't want the panning to slow down.
     // Never wait for more than 25 ms. We probably dropped a frame if this happens.
-    int maxWaitTime = [self isStructureConnectedAndCharged] ? 0.025: 0.0166;
+    double maxWaitTime = [self isStructureConnectedAndCharged] ? 0.025: 0.0166;
     newTrackerUpdate = [_slamState.trackerThread waitForUpdateMoreRecentThan:previousTimestamp maxWaitTimeSeconds:maxWaitTime];
 
     // Motion Logging
@@ -213,20 +213,11 @@ namespace
             }
             else
             {
-                double newTimestamp = nowInSeconds();
-                // This test is trying to avoid processing frames which arrive in batch. Sometimes scheduling becomes messy
-                // and instead of getting a frame after 33ms, we get no frames for 66ms, and then two frames at the same time.
-                // Trying to process them both will make the SceneKit thread starve, so we'll just skip one if we receive two
-                // frames in less than 5 milliseconds.
-                if (_slamState.previousFrameTimestamp < 0 || (newTimestamp - _slamState.previousFrameTimestamp) > 0.005)
-                {
-                    const int timeoutSeconds = 20/1000.; // don't allow it to eat more than 20ms of the main thread.
-
-                    // We need to take a copy of the depth frame since it won't survive the callback scope.
-                    // However the color frame will live long enough since the AVFoundation pool is quite big.
-                    [_slamState.trackerThread updateWithDepthFrame:[depthFrame copy] colorFrame:colorFrame maxWaitTimeSeconds:timeoutSeconds];
-                }
-                _slamState.previousFrameTimestamp = newTimestamp;
+                // Sometimes scheduling becomes messy and instead of getting a frame after 33ms, we get no
+                // frames for 66ms, and then two frames at the same time. The frame admission skips the
+                // second one so the SceneKit thread does not starve, and skips or downsamples frames the
+                // tracker would not get through in time. This never waits for the tracker.
+                [_slamState.trackerThread admitDepthFrame:depthFrame colorFrame:colorFrame arrivalTime:nowInSeconds()];
             }
         }
     }
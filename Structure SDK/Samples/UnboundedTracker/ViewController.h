@@ -45,12 +45,14 @@ struct SlamData
     
     TrackerUpdate lastSceneKitTrackerUpdateProcessed;
     
+    // A frame rendered in updateAtTime: shows up about one refresh later, the player is
+    // placed at the camera pose predicted for then.
+    const double displayLatencySeconds = 1./60.;
+    
     TrackerThread* trackerThread = nil;
     
     // OpenGL context.
     EAGLContext *context = nil;
-    
-    double previousFrameTimestamp = -1.0;
 };
 
 /*
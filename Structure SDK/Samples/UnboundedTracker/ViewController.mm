@@ -171,6 +171,9 @@ struct TrackingErrorMessageState
     // Otherwise there is a risk the tracker will lag behind and slow down everything.
     _slamState.trackerThread.threadPriority = [NSThread currentThread].threadPriority;
     
+    // The frame admission backs off when the tracker keeps this thread from its frame rate.
+    [_slamState.trackerThread renderedFrameAtTime:time];
+    
     if (_needsFullGameStateReset)
     {
         _needsFullGameStateReset = false;
@@ -191,7 +194,14 @@ struct TrackingErrorMessageState
         
         if (_slamState.lastSceneKitTrackerUpdateProcessed.couldEstimatePose)
         {
-            [self updatePlayerWithTrackerPose:_slamState.lastSceneKitTrackerUpdateProcessed locked:_viewLocked deltaTime:_timeTracker.lastIntervalBetweenUpdates()];
+            // The tracker pose is that of a depth frame captured a while ago, move it on to
+            // when this frame will be displayed.
+            TrackerUpdate displayedUpdate = _slamState.lastSceneKitTrackerUpdateProcessed;
+            GLKMatrix4 predictedPose;
+            if ([_slamState.trackerThread predictCameraPose:&predictedPose atTime:time + _slamState.displayLatencySeconds])
+                displayedUpdate.cameraPose = predictedPose;
+            
+            [self updatePlayerWithTrackerPose:displayedUpdate locked:_viewLocked deltaTime:_timeTracker.lastIntervalBetweenUpdates()];
         }
         else
         {
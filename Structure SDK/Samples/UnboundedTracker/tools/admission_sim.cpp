@@ -0,0 +1,331 @@
+//
+//  admission_sim.cpp
+//  UnboundedTracker
+//
+//  Replays a timing trace through a model of TrackerThread, once with the
+//  old rule (skip a frame arriving within 5 ms of the previous one, submit
+//  everything else) and once with FrameAdmission.h, and compares
+//
+//    - what happened to the frames: tracked, downsampled, skipped, or
+//      dropped from the two frame ring
+//    - capture to pose latency of the tracked frames, and how many missed
+//      the deadline budget
+//    - age of the newest pose at every rendered frame
+//    - the share of the time the tracker was busy
+//
+//  The trace has one event per line, times and costs in seconds:
+//
+//    frame <arrival> <full cost> <half cost>
+//    render <time>
+//
+//  An unknown cost is -1 and is derived from the other one. Lines may carry
+//  any prefix up to "TIMING ", so a device log written with
+//  TRACKER_TIMING_LOG set in TrackerThread.mm can be used as it is. The
+//  render times are replayed as recorded; the model does not slow the
+//  render thread down when the tracker competes with it.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -I.. -o admission_sim admission_sim.cpp ../FrameAdmission.cpp
+//    ./admission_sim [-s seconds] [-w trace] [trace]
+//
+//    -s  simulate this many seconds of a synthetic trace instead of reading one
+//    -w  also write the synthetic trace there
+//
+
+#include <algorithm>
+#include <deque>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "FrameAdmission.h"
+
+// Frames the ring of TrackerThread.mm holds.
+#define FRAME_SLOTS 2
+
+struct Event
+{
+    double time;
+    bool render;
+    double fullCost;
+    double halfCost;
+};
+
+struct Queued
+{
+    double arrival;
+    double cost;
+    bool downsampled;
+};
+
+struct Outcome
+{
+    unsigned submitted = 0;
+    unsigned downsampled = 0;
+    unsigned skipped = 0;
+    unsigned dropped = 0;
+    unsigned late = 0;
+    double busy = 0;
+    std::vector<double> latency;
+    std::vector<double> poseAge;
+};
+
+static bool readTrace(FILE *in, std::vector<Event> &events)
+{
+    char line[256];
+    unsigned number = 0;
+    while (fgets(line, sizeof(line), in))
+    {
+        number++;
+        const char *at = strstr(line, "TIMING ");
+        at = at ? at + strlen("TIMING ") : line;
+        while (*at == ' ' || *at == '\t')
+            at++;
+        if (*at == '#' || *at == '\n' || *at == 0)
+            continue;
+
+        Event event;
+        event.fullCost = event.halfCost = -1;
+        if (sscanf(at, "render %lf", &event.time) == 1)
+        {
+            event.render = true;
+        }
+        else if (sscanf(at, "frame %lf %lf %lf", &event.time, &event.fullCost, &event.halfCost) == 3 &&
+                 (event.fullCost > 0 || event.halfCost > 0))
+        {
+            event.render = false;
+        }
+        else
+        {
+            fprintf(stderr, "line %u: not an event\n", number);
+            return false;
+        }
+        events.push_back(event);
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+        return a.time < b.time;
+    });
+    return !events.empty();
+}
+
+// 30 Hz depth with jitter and the odd batch of two, a tracker that gets
+// slower in busy scenes, and a render thread that is overloaded now and then.
+static void synthesize(double seconds, std::vector<Event> &events)
+{
+    srand(7);
+    double arrival = 0;
+    while (arrival < seconds)
+    {
+        double jitter = (rand() % 2000 - 1000) * 1e-6;
+        bool batch = rand() % 40 == 0;
+        double gap = batch ? 0.066 : 1 / 30.;
+        arrival += gap + jitter;
+
+        bool busyScene = fmod(arrival, 10.) > 6.;
+        double full = (busyScene ? 0.034 : 0.018) + (rand() % 8000) * 1e-6;
+        Event frame = { arrival, false, full, full * (0.35 + (rand() % 100) * 1e-3) };
+        events.push_back(frame);
+        if (batch)
+        {
+            frame.time += 0.002;
+            events.push_back(frame);
+        }
+    }
+
+    double render = 0;
+    while (render < seconds)
+    {
+        bool overloaded = fmod(render, 7.) > 5.;
+        render += (overloaded ? 0.026 : 1 / 60.) + (rand() % 1000) * 1e-6;
+        Event event = { render, true, -1, -1 };
+        events.push_back(event);
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+        return a.time < b.time;
+    });
+}
+
+static Outcome simulate(const std::vector<Event> &events, bool adaptive)
+{
+    FrameAdmissionSettings settings;
+    FrameAdmission admission(settings);
+    Outcome outcome;
+    std::deque<Queued> ring;
+    bool tracking = false;
+    Queued current;
+    double finish = 0;
+    double lastPoseArrival = -1;
+    double previousArrival = -1;
+
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const Event &event = events[i];
+
+        // Let the tracker run up to the event.
+        while (tracking && finish <= event.time)
+        {
+            admission.frameTracked(finish);
+            outcome.latency.push_back(finish - current.arrival);
+            if (finish > current.arrival + settings.budgetSeconds)
+                outcome.late++;
+            lastPoseArrival = std::max(lastPoseArrival, current.arrival);
+            tracking = !ring.empty();
+            if (tracking)
+            {
+                current = ring.front();
+                ring.pop_front();
+                admission.frameStarted(finish, current.downsampled);
+                outcome.busy += current.cost;
+                finish += current.cost;
+            }
+        }
+
+        if (event.render)
+        {
+            admission.renderFrame(event.time);
+            if (lastPoseArrival >= 0)
+                outcome.poseAge.push_back(event.time - lastPoseArrival);
+            continue;
+        }
+
+        FrameAdmissionDecision decision;
+        if (adaptive)
+        {
+            decision = admission.admit(event.time, ring.size());
+        }
+        else
+        {
+            bool batched = previousArrival >= 0 && event.time - previousArrival < 0.005;
+            decision = batched ? FrameSkip : FrameSubmit;
+        }
+        previousArrival = event.time;
+        if (decision == FrameSkip)
+        {
+            outcome.skipped++;
+            continue;
+        }
+
+        double ratio = settings.downsampleCostRatio;
+        Queued frame;
+        frame.arrival = event.time;
+        frame.downsampled = decision == FrameDownsample;
+        if (frame.downsampled)
+            frame.cost = event.halfCost > 0 ? event.halfCost : event.fullCost * ratio;
+        else
+            frame.cost = event.fullCost > 0 ? event.fullCost : event.halfCost / ratio;
+        if (frame.downsampled)
+            outcome.downsampled++;
+        else
+            outcome.submitted++;
+
+        if (!tracking)
+        {
+            tracking = true;
+            current = frame;
+            admission.frameStarted(event.time, current.downsampled);
+            outcome.busy += current.cost;
+            finish = event.time + current.cost;
+            continue;
+        }
+        if (ring.size() == FRAME_SLOTS)
+        {
+            ring.pop_front();
+            outcome.dropped++;
+        }
+        ring.push_back(frame);
+    }
+    return outcome;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(p * (values.size() - 1) + 0.5)];
+}
+
+static void report(const char *name, const Outcome &outcome, double span)
+{
+    printf("%-9s %6u %6u %6u %6u %7.1f %7.1f %7.1f %6.1f%% %7.1f %7.1f %6.1f%%\n", name,
+           outcome.submitted, outcome.downsampled, outcome.skipped, outcome.dropped,
+           percentile(outcome.latency, 0.5) * 1e3, percentile(outcome.latency, 0.95) * 1e3,
+           percentile(outcome.latency, 1) * 1e3,
+           outcome.latency.empty() ? 0. : 100. * outcome.late / outcome.latency.size(),
+           percentile(outcome.poseAge, 0.5) * 1e3, percentile(outcome.poseAge, 0.95) * 1e3,
+           span > 0 ? 100. * outcome.busy / span : 0.);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 0;
+    const char *tracePath = NULL;
+    const char *writePath = NULL;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            seconds = atof(argv[++arg]);
+        else if (!strcmp(argv[arg], "-w") && arg + 1 < argc)
+            writePath = argv[++arg];
+        else if (argv[arg][0] != '-' && !tracePath)
+            tracePath = argv[arg];
+        else
+        {
+            fprintf(stderr, "usage: %s [-s seconds] [-w trace] [trace]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Event> events;
+    if (seconds > 0)
+    {
+        synthesize(seconds, events);
+        if (writePath)
+        {
+            FILE *out = fopen(writePath, "w");
+            if (!out)
+            {
+                perror(writePath);
+                return 1;
+            }
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                if (events[i].render)
+                    fprintf(out, "render %.6f\n", events[i].time);
+                else
+                    fprintf(out, "frame %.6f %.6f %.6f\n", events[i].time, events[i].fullCost, events[i].halfCost);
+            }
+            fclose(out);
+        }
+    }
+    else
+    {
+        FILE *in = tracePath ? fopen(tracePath, "r") : stdin;
+        if (!in)
+        {
+            perror(tracePath);
+            return 1;
+        }
+        bool ok = readTrace(in, events);
+        if (in != stdin)
+            fclose(in);
+        if (!ok)
+        {
+            fprintf(stderr, "no events in the trace\n");
+            return 1;
+        }
+    }
+
+    double span = events.back().time - events.front().time;
+    printf("%.1f s, %zu events\n", span, events.size());
+    printf("%-9s %6s %6s %6s %6s %7s %7s %7s %7s %7s %7s %7s\n", "policy", "full", "half", "skip", "drop",
+           "lat p50", "lat p95", "lat max", "late", "age p50", "age p95", "busy");
+    report("batch 5ms", simulate(events, false), span);
+    report("adaptive", simulate(events, true), span);
+    printf("latency and pose age in ms, late = tracked after the %.0f ms budget\n",
+           FrameAdmissionSettings().budgetSeconds * 1e3);
+    return 0;
+}
@@ -0,0 +1,215 @@
+//
+//  command_ring_bench.cpp
+//  UnboundedTracker
+//
+//  Stress test and latency benchmark of CommandRing.h on a host. A producer
+//  thread pushes numbered commands as fast as it can, or at a fixed period,
+//  while a consumer thread pops them and spends a configurable time on each,
+//  for both drop policies. Every run checks that
+//
+//    - commands come out in push order, each at most once
+//    - delivered plus dropped commands add up to the pushed ones
+//    - with CommandDropOldest the last command pushed is delivered
+//    - no command is still referenced once the ring is drained
+//
+//  and reports the time a push takes and the age of the commands delivered.
+//  The exit status is 1 when a check fails.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -pthread -I.. -o command_ring_bench command_ring_bench.cpp
+//    ./command_ring_bench [-n commands] [-p period_us]
+//
+//    -n  commands per run, default 1000000
+//    -p  time between pushes in microseconds, default 0 (back to back)
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "CommandRing.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Stands in for the depth and color frames a tracker command holds.
+static std::atomic<long> liveFrames(0);
+
+struct Frame
+{
+    Frame() { liveFrames++; }
+    ~Frame() { liveFrames--; }
+};
+
+struct Command
+{
+    uint64_t sequence = 0;
+    Clock::time_point pushed;
+    std::shared_ptr<Frame> frame;
+};
+
+struct Run
+{
+    CommandDropPolicy policy;
+    int workUs;
+};
+
+struct Report
+{
+    uint64_t delivered;
+    uint64_t droppedOldest;
+    uint64_t droppedNewest;
+    std::vector<double> pushNs;
+    std::vector<double> ageUs;
+    int failures;
+};
+
+static void spin(int microseconds)
+{
+    Clock::time_point end = Clock::now() + std::chrono::microseconds(microseconds);
+    while (Clock::now() < end)
+        ;
+}
+
+static double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static Report run(const Run &setup, uint64_t count, int periodUs)
+{
+    typedef CommandRing<Command, 4> Ring;
+    std::unique_ptr<Ring> ring(new Ring(setup.policy));
+    std::atomic<bool> producing(true);
+    Report report;
+    report.delivered = 0;
+    report.droppedOldest = 0;
+    report.droppedNewest = 0;
+    report.failures = 0;
+    report.pushNs.reserve(count);
+    report.ageUs.reserve(count);
+    uint64_t lastDelivered = 0;
+
+    std::thread consumer([&]() {
+        Command command;
+        uint64_t previous = 0;
+        for (;;)
+        {
+            bool done = !producing.load(std::memory_order_acquire);
+            if (!ring->pop(command))
+            {
+                if (done)
+                    break;
+                std::this_thread::yield();
+                continue;
+            }
+
+            report.ageUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - command.pushed).count());
+            if (command.sequence <= previous || !command.frame)
+            {
+                if (report.failures++ < 5)
+                    fprintf(stderr, "command %llu delivered after %llu\n",
+                            (unsigned long long)command.sequence, (unsigned long long)previous);
+            }
+            previous = command.sequence;
+            report.delivered++;
+            command = Command();
+            spin(setup.workUs);
+        }
+        lastDelivered = previous;
+    });
+
+    for (uint64_t sequence = 1; sequence <= count; sequence++)
+    {
+        Command command;
+        command.sequence = sequence;
+        command.frame = std::make_shared<Frame>();
+        Clock::time_point start = Clock::now();
+        command.pushed = start;
+        ring->push(std::move(command));
+        report.pushNs.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+        if (periodUs)
+            spin(periodUs);
+    }
+    producing.store(false, std::memory_order_release);
+    consumer.join();
+
+    report.droppedOldest = ring->droppedOldest();
+    report.droppedNewest = ring->droppedNewest();
+    if (report.delivered + report.droppedOldest + report.droppedNewest != count)
+    {
+        fprintf(stderr, "%llu delivered and %llu dropped of %llu\n", (unsigned long long)report.delivered,
+                (unsigned long long)(report.droppedOldest + report.droppedNewest), (unsigned long long)count);
+        report.failures++;
+    }
+    if (setup.policy == CommandDropOldest && report.droppedNewest == 0 && lastDelivered != count)
+    {
+        fprintf(stderr, "last command %llu not delivered\n", (unsigned long long)count);
+        report.failures++;
+    }
+    if (liveFrames.load() != 0)
+    {
+        fprintf(stderr, "%ld frames still referenced\n", liveFrames.load());
+        report.failures++;
+    }
+    return report;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t count = 1000000;
+    int periodUs = 0;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+        {
+            count = strtoull(argv[++arg], NULL, 10);
+        }
+        else if (!strcmp(argv[arg], "-p") && arg + 1 < argc)
+        {
+            periodUs = atoi(argv[++arg]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n commands] [-p period_us]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count == 0)
+    {
+        fprintf(stderr, "nothing to push\n");
+        return 2;
+    }
+
+    const Run runs[] = {
+        { CommandDropOldest, 0 }, { CommandDropOldest, 2 }, { CommandDropOldest, 50 },
+        { CommandDropNewest, 0 }, { CommandDropNewest, 2 }, { CommandDropNewest, 50 },
+    };
+
+    int failures = 0;
+    printf("%-7s %6s %10s %10s %10s %9s %9s %9s %10s %10s\n", "policy", "work", "delivered",
+           "drop old", "drop new", "push p50", "push p99", "push max", "age p50", "age p99");
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+    {
+        Report report = run(runs[i], count, periodUs);
+        double pushMax = report.pushNs.empty() ? 0 : *std::max_element(report.pushNs.begin(), report.pushNs.end());
+        printf("%-7s %4dus %10llu %10llu %10llu %7.0fns %7.0fns %7.0fns %8.1fus %8.1fus%s\n",
+               runs[i].policy == CommandDropOldest ? "oldest" : "newest", runs[i].workUs,
+               (unsigned long long)report.delivered, (unsigned long long)report.droppedOldest,
+               (unsigned long long)report.droppedNewest, percentile(report.pushNs, 0.5),
+               percentile(report.pushNs, 0.99), pushMax, percentile(report.ageUs, 0.5),
+               percentile(report.ageUs, 0.99), report.failures ? "  FAILED" : "");
+        failures += report.failures;
+    }
+    return failures ? 1 : 0;
+}
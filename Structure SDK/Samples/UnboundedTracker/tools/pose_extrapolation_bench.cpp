@@ -0,0 +1,447 @@
+//
+//  pose_extrapolation_bench.cpp
+//  UnboundedTracker
+//
+//  Accuracy and cost of PoseExtrapolator.h on a host. A motion log is
+//  replayed as the app sees it: motion samples as they are measured, tracker
+//  poses a tracking latency after their depth frame was captured, and a
+//  render frame at 60 Hz that wants the pose at its display time. Four ways
+//  to get that pose are compared against the true one:
+//
+//    latest    the newest tracker pose, what the renderer used before
+//    velocity  the newest tracker pose moved on at the velocity and the
+//              angular velocity between the last two
+//    gyro      PoseExtrapolator without the accelerometer
+//    imu       PoseExtrapolator
+//
+//  reporting the translation and angle errors, and the jitter: how far the
+//  change from one render frame to the next is off the true change. The
+//  time an extrapolator call takes is measured as well.
+//
+//  The log has one sample per line, times in seconds:
+//
+//    imu <time> <rotation rate x y z> <user acceleration x y z>
+//    pose <time> <camera to world matrix, 16 values, column major>
+//
+//  with the CoreMotion device motion in its device frame, in rad/s and g, and
+//  the tracker poses as STTracker reports them. Lines may carry any prefix up
+//  to "MOTION ", so a device log written with TRACKER_MOTION_LOG set in
+//  TrackerThread.mm can be used as it is. The truth is then the tracker poses
+//  themselves, interpolated; a synthetic log is compared against the exact
+//  trajectory it was made from.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -I.. -o pose_extrapolation_bench pose_extrapolation_bench.cpp ../PoseExtrapolator.cpp
+//    ./pose_extrapolation_bench [-l latency_ms] [-d display_ms] [-s seconds] [-w log] [log]
+//
+//    -l  capture to tracker pose latency, default 40 ms
+//    -d  render to display latency, default 16.7 ms
+//    -s  simulate this many seconds of hand held motion instead of reading a log
+//    -w  also write the synthetic log there
+//
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "PoseExtrapolator.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct MotionEntry
+{
+    double time;
+    Vector3 rotationRate;
+    Vector3 userAcceleration;
+};
+
+struct PoseEntry
+{
+    double time;
+    Pose pose;
+};
+
+struct Log
+{
+    std::vector<MotionEntry> motion;
+    std::vector<PoseEntry> poses;
+
+    // Sorted by time; the poses themselves for a recorded log.
+    std::vector<PoseEntry> truth;
+};
+
+enum Method
+{
+    MethodLatest,
+    MethodVelocity,
+    MethodGyro,
+    MethodImu
+};
+
+struct Errors
+{
+    std::vector<double> translation;
+    std::vector<double> angle;
+    std::vector<double> jitter;
+    double addMotionNs = 0;
+    double setPoseNs = 0;
+    double predictNs = 0;
+};
+
+static bool readLog(FILE *in, Log &log)
+{
+    char line[512];
+    unsigned number = 0;
+    while (fgets(line, sizeof(line), in))
+    {
+        number++;
+        const char *at = strstr(line, "MOTION ");
+        at = at ? at + strlen("MOTION ") : line;
+        while (*at == ' ' || *at == '\t')
+            at++;
+        if (*at == '#' || *at == '\n' || *at == 0)
+            continue;
+
+        MotionEntry motion;
+        PoseEntry pose;
+        float m[16];
+        if (sscanf(at, "imu %lf %lf %lf %lf %lf %lf %lf", &motion.time,
+                   &motion.rotationRate.x, &motion.rotationRate.y, &motion.rotationRate.z,
+                   &motion.userAcceleration.x, &motion.userAcceleration.y, &motion.userAcceleration.z) == 7)
+        {
+            log.motion.push_back(motion);
+        }
+        else if (sscanf(at, "pose %lf %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f", &pose.time,
+                        &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &m[6], &m[7],
+                        &m[8], &m[9], &m[10], &m[11], &m[12], &m[13], &m[14], &m[15]) == 17)
+        {
+            pose.pose = Pose::fromMatrix(m);
+            log.poses.push_back(pose);
+        }
+        else
+        {
+            fprintf(stderr, "line %u: not a sample\n", number);
+            return false;
+        }
+    }
+    std::stable_sort(log.motion.begin(), log.motion.end(), [](const MotionEntry &a, const MotionEntry &b) {
+        return a.time < b.time;
+    });
+    std::stable_sort(log.poses.begin(), log.poses.end(), [](const PoseEntry &a, const PoseEntry &b) {
+        return a.time < b.time;
+    });
+    log.truth = log.poses;
+    return log.poses.size() >= 2;
+}
+
+static double gaussian()
+{
+    double u = (rand() + 1.) / (RAND_MAX + 2.);
+    double v = (rand() + 1.) / (RAND_MAX + 2.);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// Someone looking around and stepping about with the device in their hands:
+// sums of sines in the position and in the angular velocity, a gyroscope and
+// an accelerometer with bias and noise at 100 Hz, and tracker poses with
+// noise at 30 Hz, give or take a millisecond.
+static void synthesize(double seconds, Log &log)
+{
+    srand(11);
+    PoseExtrapolatorSettings settings;
+    Quaternion cameraToImu = settings.imuToCamera.conjugate();
+
+    const double step = 0.001;
+    const double positionAmplitude[3][2] = { { 0.4, 0.05 }, { 0.1, 0.02 }, { 0.5, 0.05 } };
+    const double positionFrequency[3][2] = { { 0.2, 1.1 }, { 0.5, 1.7 }, { 0.15, 0.9 } };
+    const double rateAmplitude[3][2] = { { 0.6, 0.3 }, { 1.2, 0.4 }, { 0.3, 0.2 } };
+    const double rateFrequency[3][2] = { { 0.4, 1.9 }, { 0.25, 1.3 }, { 0.6, 2.3 } };
+
+    Vector3 gyroBias(0.008, -0.006, 0.004);
+    Vector3 accelerometerBias(0.004, -0.003, 0.002);
+    Quaternion rotation;
+    double nextMotion = 0;
+    double nextPose = 0;
+
+    for (double t = 0; t < seconds; t += step)
+    {
+        double p[3], a[3], w[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            p[axis] = a[axis] = w[axis] = 0;
+            for (int k = 0; k < 2; k++)
+            {
+                double omega = 2 * M_PI * positionFrequency[axis][k];
+                p[axis] += positionAmplitude[axis][k] * sin(omega * t + axis);
+                a[axis] -= positionAmplitude[axis][k] * omega * omega * sin(omega * t + axis);
+                w[axis] += rateAmplitude[axis][k] * sin(2 * M_PI * rateFrequency[axis][k] * t + 2 * axis);
+            }
+        }
+        Vector3 position(p[0], p[1], p[2]);
+        Vector3 acceleration(a[0], a[1], a[2]);
+        Vector3 rate(w[0], w[1], w[2]);
+
+        PoseEntry truth = { t, Pose(rotation, position) };
+        log.truth.push_back(truth);
+
+        if (t >= nextMotion)
+        {
+            Vector3 noise(gaussian(), gaussian(), gaussian());
+            Vector3 accelerometerNoise(gaussian(), gaussian(), gaussian());
+            MotionEntry motion;
+            motion.time = t;
+            motion.rotationRate = cameraToImu.rotate(rate) + gyroBias + noise * 0.004;
+            motion.userAcceleration = cameraToImu.rotate(rotation.conjugate().rotate(acceleration)) *
+                                      (1 / settings.gravity) + accelerometerBias + accelerometerNoise * 0.008;
+            log.motion.push_back(motion);
+            nextMotion += 0.01;
+        }
+        if (t >= nextPose)
+        {
+            Vector3 angleNoise(gaussian(), gaussian(), gaussian());
+            Vector3 positionNoise(gaussian(), gaussian(), gaussian());
+            PoseEntry pose = { t, Pose(rotation * Quaternion::fromRotationVector(angleNoise * 0.001),
+                                       position + positionNoise * 0.001) };
+            log.poses.push_back(pose);
+            nextPose += 1 / 30. + (rand() % 2000 - 1000) * 1e-6;
+        }
+
+        rotation = (rotation * Quaternion::fromRotationVector(rate * step)).normalized();
+    }
+}
+
+static bool writeLog(const char *path, const Log &log)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        perror(path);
+        return false;
+    }
+    size_t m = 0, p = 0;
+    while (m < log.motion.size() || p < log.poses.size())
+    {
+        if (p == log.poses.size() || (m < log.motion.size() && log.motion[m].time <= log.poses[p].time))
+        {
+            const MotionEntry &e = log.motion[m++];
+            fprintf(out, "imu %.6f %.6f %.6f %.6f %.6f %.6f %.6f\n", e.time, e.rotationRate.x, e.rotationRate.y,
+                    e.rotationRate.z, e.userAcceleration.x, e.userAcceleration.y, e.userAcceleration.z);
+        }
+        else
+        {
+            float matrix[16];
+            log.poses[p].pose.toMatrix(matrix);
+            fprintf(out, "pose %.6f", log.poses[p++].time);
+            for (int i = 0; i < 16; i++)
+                fprintf(out, " %.6f", matrix[i]);
+            fprintf(out, "\n");
+        }
+    }
+    fclose(out);
+    return true;
+}
+
+// False outside the truth, or in a gap of it.
+static bool truthAt(const std::vector<PoseEntry> &truth, double time, Pose &pose)
+{
+    std::vector<PoseEntry>::const_iterator after = std::lower_bound(
+        truth.begin(), truth.end(), time, [](const PoseEntry &e, double t) { return e.time < t; });
+    if (after == truth.begin() || after == truth.end())
+        return false;
+    const PoseEntry &before = *(after - 1);
+    if (after->time - before.time > 0.1)
+        return false;
+    pose = Pose::interpolate(before.pose, after->pose, (time - before.time) / (after->time - before.time));
+    return true;
+}
+
+static double nanoseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static Errors replay(const Log &log, Method method, double latency, double displayLatency)
+{
+    PoseExtrapolatorSettings settings;
+    settings.useAccelerometer = method == MethodImu;
+    PoseExtrapolator extrapolator(settings);
+    Errors errors;
+    size_t motionCalls = 0, poseCalls = 0, predictCalls = 0;
+
+    size_t m = 0, p = 0;
+    size_t known = 0; // tracker poses delivered so far
+    bool havePrevious = false;
+    Pose previousShown, previousTruth;
+
+    double end = std::min(log.truth.back().time, log.poses.back().time + latency);
+    for (double render = log.poses.front().time + latency; render < end; render += 1 / 60.)
+    {
+        // Deliver what arrived by now, in order.
+        for (;;)
+        {
+            bool motionNext = m < log.motion.size() && log.motion[m].time <= render;
+            bool poseNext = p < log.poses.size() && log.poses[p].time + latency <= render;
+            if (motionNext && (!poseNext || log.motion[m].time <= log.poses[p].time + latency))
+            {
+                const MotionEntry &e = log.motion[m++];
+                Clock::time_point start = Clock::now();
+                extrapolator.addMotion(e.time, e.rotationRate, e.userAcceleration);
+                errors.addMotionNs += nanoseconds(start);
+                motionCalls++;
+            }
+            else if (poseNext)
+            {
+                const PoseEntry &e = log.poses[p++];
+                known = p;
+                Clock::time_point start = Clock::now();
+                extrapolator.setTrackerPose(e.time, e.pose);
+                errors.setPoseNs += nanoseconds(start);
+                poseCalls++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        if (known == 0)
+            continue;
+
+        double display = render + displayLatency;
+        const PoseEntry &last = log.poses[known - 1];
+        Pose shown = last.pose;
+        if (method == MethodVelocity && known >= 2)
+        {
+            const PoseEntry &first = log.poses[known - 2];
+            double dt = last.time - first.time;
+            double h = std::min(display - last.time, settings.maxHorizonSeconds);
+            Vector3 rate = (first.pose.rotation.conjugate() * last.pose.rotation).rotationVector() * (1 / dt);
+            shown.rotation = last.pose.rotation * Quaternion::fromRotationVector(rate * h);
+            shown.translation = last.pose.translation + (last.pose.translation - first.pose.translation) * (h / dt);
+        }
+        else if (method == MethodGyro || method == MethodImu)
+        {
+            Clock::time_point start = Clock::now();
+            extrapolator.predict(display, shown);
+            errors.predictNs += nanoseconds(start);
+            predictCalls++;
+        }
+
+        Pose truth;
+        if (!truthAt(log.truth, display, truth))
+        {
+            havePrevious = false;
+            continue;
+        }
+        errors.translation.push_back((shown.translation - truth.translation).norm());
+        errors.angle.push_back((shown.rotation.conjugate() * truth.rotation).angle());
+        if (havePrevious)
+        {
+            Vector3 shownStep = shown.translation - previousShown.translation;
+            Vector3 truthStep = truth.translation - previousTruth.translation;
+            errors.jitter.push_back((shownStep - truthStep).norm());
+        }
+        havePrevious = true;
+        previousShown = shown;
+        previousTruth = truth;
+    }
+
+    errors.addMotionNs /= std::max<size_t>(motionCalls, 1);
+    errors.setPoseNs /= std::max<size_t>(poseCalls, 1);
+    errors.predictNs /= std::max<size_t>(predictCalls, 1);
+    return errors;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(p * (values.size() - 1) + 0.5)];
+}
+
+static double mean(const std::vector<double> &values)
+{
+    double sum = 0;
+    for (double value : values)
+        sum += value;
+    return values.empty() ? 0 : sum / values.size();
+}
+
+int main(int argc, char **argv)
+{
+    double latency = 0.040;
+    double displayLatency = 1 / 60.;
+    double seconds = 0;
+    const char *logPath = NULL;
+    const char *writePath = NULL;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-l") && arg + 1 < argc)
+            latency = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-d") && arg + 1 < argc)
+            displayLatency = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            seconds = atof(argv[++arg]);
+        else if (!strcmp(argv[arg], "-w") && arg + 1 < argc)
+            writePath = argv[++arg];
+        else if (argv[arg][0] != '-' && !logPath)
+            logPath = argv[arg];
+        else
+        {
+            fprintf(stderr, "usage: %s [-l latency_ms] [-d display_ms] [-s seconds] [-w log] [log]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Log log;
+    if (seconds > 0)
+    {
+        synthesize(seconds, log);
+        if (writePath && !writeLog(writePath, log))
+            return 1;
+    }
+    else
+    {
+        FILE *in = logPath ? fopen(logPath, "r") : stdin;
+        if (!in)
+        {
+            perror(logPath);
+            return 1;
+        }
+        bool ok = readLog(in, log);
+        if (in != stdin)
+            fclose(in);
+        if (!ok)
+        {
+            fprintf(stderr, "not enough tracker poses in the log\n");
+            return 1;
+        }
+    }
+
+    printf("%.1f s, %zu motion samples, %zu tracker poses, %.0f ms to the pose, %.1f ms to the display\n",
+           log.poses.back().time - log.poses.front().time, log.motion.size(), log.poses.size(),
+           latency * 1e3, displayLatency * 1e3);
+    printf("%-9s %8s %8s %8s %8s %8s %8s %9s %9s\n", "method", "mm mean", "mm p95", "mm max",
+           "deg mean", "deg p95", "deg max", "jit p95", "ns/call");
+
+    const char *names[] = { "latest", "velocity", "gyro", "imu" };
+    for (int method = MethodLatest; method <= MethodImu; method++)
+    {
+        Errors errors = replay(log, (Method)method, latency, displayLatency);
+        const double degrees = 180 / M_PI;
+        printf("%-9s %8.1f %8.1f %8.1f %8.2f %8.2f %8.2f %7.2fmm", names[method],
+               mean(errors.translation) * 1e3, percentile(errors.translation, 0.95) * 1e3,
+               percentile(errors.translation, 1) * 1e3, mean(errors.angle) * degrees,
+               percentile(errors.angle, 0.95) * degrees, percentile(errors.angle, 1) * degrees,
+               percentile(errors.jitter, 0.95) * 1e3);
+        if (method >= MethodGyro)
+            printf("  motion %.0f, pose %.0f, predict %.0f", errors.addMotionNs, errors.setPoseNs, errors.predictNs);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,359 @@
+//
+//  pose_log_bench.cpp
+//  UnboundedTracker
+//
+//  Checks and benchmark of PoseLog.h on a host. A path of poses is written
+//  to a pose log and read back, checking that
+//
+//    - every record comes back as written, within float precision
+//    - find() agrees with a linear search, at and between the record times
+//    - sample() returns the records at their times, interpolates between
+//      them and holds the ends
+//    - the writer skips poses that are not later than the previous one
+//    - a log cut in the middle of a record is read up to the record before
+//    - an empty log reads as empty, and a file that is not a log is refused
+//
+//  The same path is also written as the text log MotionLogs used to record,
+//  a time in milliseconds and the 16 values of the matrix per line, to
+//  compare the file sizes and the time it takes to load either, and the
+//  time a lookup by time takes. The exit status is 1 when a check fails.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -I.. -o pose_log_bench pose_log_bench.cpp ../PoseLog.cpp
+//    ./pose_log_bench [-n poses] [-d directory]
+//
+//    -n  poses in the path, default 200000, an hour at 60 Hz is 216000
+//    -d  where to write the logs, default /tmp
+//
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "PoseLog.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                            \
+    do                                                   \
+    {                                                    \
+        if (!(condition))                                \
+        {                                                \
+            if (failures++ < 10)                         \
+            {                                            \
+                fprintf(stderr, "failed: " __VA_ARGS__); \
+                fprintf(stderr, "\n");                   \
+            }                                            \
+        }                                                \
+    } while (0)
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// The translation tolerance grows with the distance from the origin, as the
+// precision of a float does.
+static bool samePose(const Pose &a, const Pose &b, double tolerance)
+{
+    double scale = std::max(1., b.translation.norm());
+    return (a.translation - b.translation).norm() <= tolerance * scale &&
+           (a.rotation.conjugate() * b.rotation).angle() <= tolerance;
+}
+
+// Someone walking around for a while at 60 Hz, the frame times jittering.
+static void makePath(size_t count, std::vector<double> &times, std::vector<Pose> &poses)
+{
+    srand(5);
+    double t = 0;
+    Quaternion rotation;
+    Vector3 position;
+    for (size_t i = 0; i < count; i++)
+    {
+        t += 1 / 60. + (rand() % 2000 - 1000) * 1e-6;
+        Vector3 turn(sin(t * 0.7) * 0.02, sin(t * 0.3) * 0.03, sin(t * 1.1) * 0.01);
+        rotation = (rotation * Quaternion::fromRotationVector(turn)).normalized();
+        position += rotation.rotate(Vector3(0, 0, -0.02));
+        times.push_back(t);
+        poses.push_back(Pose(rotation, position));
+    }
+}
+
+static long fileSize(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static bool copyPrefix(const std::string &from, const std::string &to, long bytes)
+{
+    FILE *in = fopen(from.c_str(), "rb");
+    FILE *out = fopen(to.c_str(), "wb");
+    std::vector<char> buffer(bytes > 0 ? bytes : 1);
+    bool ok = in && out && fread(&buffer[0], 1, bytes, in) == (size_t)bytes &&
+              fwrite(&buffer[0], 1, bytes, out) == (size_t)bytes;
+    if (in)
+        fclose(in);
+    if (out)
+        fclose(out);
+    return ok;
+}
+
+static void checkLog(const std::string &path, const std::vector<double> &times, const std::vector<Pose> &poses)
+{
+    PoseLogReader reader;
+    CHECK(reader.open(path.c_str()), "cannot open %s", path.c_str());
+    PoseTrack track = reader.track();
+    CHECK(!reader.truncated(), "complete log read as truncated");
+    CHECK(track.size() == times.size(), "%zu records read of %zu", track.size(), times.size());
+    if (track.size() != times.size())
+        return;
+
+    for (size_t i = 0; i < track.size(); i++)
+    {
+        CHECK(track[i].time == times[i], "record %zu at %f, written at %f", i, track[i].time, times[i]);
+        CHECK(samePose(track[i].pose(), poses[i], 1e-6), "record %zu differs", i);
+    }
+
+    // Every record time, and halfway to the next one.
+    Pose pose;
+    for (size_t i = 0; i < track.size(); i++)
+    {
+        CHECK(track.find(times[i]) == i, "find(%f) is %zu, not %zu", times[i], track.find(times[i]), i);
+        CHECK(track.sample(times[i], pose) && samePose(pose, track[i].pose(), 1e-9), "sample at record %zu", i);
+        if (i + 1 < track.size())
+        {
+            double middle = (times[i] + times[i + 1]) / 2;
+            Pose expected = Pose::interpolate(track[i].pose(), track[i + 1].pose(), 0.5);
+            CHECK(track.find(middle) == i, "find between records %zu and %zu", i, i + 1);
+            CHECK(track.sample(middle, pose) && samePose(pose, expected, 1e-9), "sample between records %zu and %zu",
+                  i, i + 1);
+        }
+    }
+
+    // Random times against a linear search, outside the log too.
+    for (int n = 0; n < 1000; n++)
+    {
+        double t = times.front() - 1 + (times.back() - times.front() + 2) * rand() / RAND_MAX;
+        size_t expected = 0;
+        while (expected + 1 < times.size() && times[expected + 1] <= t)
+            expected++;
+        CHECK(track.find(t) == expected, "find(%f) is %zu, not %zu", t, track.find(t), expected);
+    }
+
+    CHECK(track.sample(times.front() - 10, pose) && samePose(pose, track[0].pose(), 1e-9), "before the first record");
+    CHECK(track.sample(times.back() + 10, pose) && samePose(pose, track[track.size() - 1].pose(), 1e-9),
+          "after the last record");
+}
+
+static void checkEdges(const std::string &directory, const std::string &path, size_t count)
+{
+    // Cut in the middle of the last record.
+    std::string cut = directory + "/pose_log_bench_cut.plog";
+    long size = fileSize(path);
+    CHECK(copyPrefix(path, cut, size - 13), "cannot copy %s", path.c_str());
+    PoseLogReader reader;
+    CHECK(reader.open(cut.c_str()), "cannot open the cut log");
+    CHECK(reader.truncated(), "cut log not read as truncated");
+    CHECK(reader.track().size() == count - 1, "cut log has %zu records, not %zu", reader.track().size(), count - 1);
+    reader.close();
+    remove(cut.c_str());
+
+    // Out of order and repeated times, and an empty log.
+    std::string empty = directory + "/pose_log_bench_empty.plog";
+    PoseLogWriter writer;
+    CHECK(writer.open(empty.c_str(), 0), "cannot create %s", empty.c_str());
+    CHECK(writer.append(1, Pose()), "first pose skipped");
+    CHECK(!writer.append(1, Pose()), "repeated time written");
+    CHECK(!writer.append(0.5, Pose()), "earlier time written");
+    CHECK(writer.count() == 1 && writer.close(), "skipped poses counted");
+    CHECK(writer.open(empty.c_str(), 0) && writer.close(), "cannot rewrite %s", empty.c_str());
+    Pose pose;
+    CHECK(reader.open(empty.c_str()) && reader.track().empty() && !reader.track().sample(0, pose),
+          "empty log not empty");
+    reader.close();
+    remove(empty.c_str());
+
+    // Not a pose log.
+    std::string text = directory + "/pose_log_bench_not.plog";
+    FILE *file = fopen(text.c_str(), "w");
+    if (file)
+    {
+        fprintf(file, "0 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1\n0 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1\n");
+        fclose(file);
+    }
+    CHECK(!reader.open(text.c_str()), "text file read as a pose log");
+    remove(text.c_str());
+}
+
+// The old text log and its loader: the whole file in memory, split into
+// lines and the lines into values.
+static void writeText(const std::string &path, const std::vector<double> &times, const std::vector<Pose> &poses)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+        return;
+    for (size_t i = 0; i < times.size(); i++)
+    {
+        float m[16];
+        poses[i].toMatrix(m);
+        fprintf(file, "%d", int(1e3 * times[i]));
+        for (int k = 0; k < 16; k++)
+            fprintf(file, " %g", m[k]);
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
+
+static size_t parseText(const std::string &path, std::vector<float> &times, std::vector<float> &matrices)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return 0;
+    std::string contents;
+    char buffer[1 << 16];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, read);
+    fclose(file);
+
+    size_t count = 0;
+    size_t start = 0;
+    while (start < contents.size())
+    {
+        size_t end = contents.find('\n', start);
+        if (end == std::string::npos)
+            end = contents.size();
+        std::string line = contents.substr(start, end - start);
+        start = end + 1;
+
+        std::vector<std::string> components;
+        size_t from = 0;
+        for (;;)
+        {
+            size_t space = line.find(' ', from);
+            components.push_back(line.substr(from, space == std::string::npos ? std::string::npos : space - from));
+            if (space == std::string::npos)
+                break;
+            from = space + 1;
+        }
+        if (components.size() < 17)
+            continue;
+
+        times.push_back(atoi(components[0].c_str()) / 1000.f);
+        for (int k = 1; k <= 16; k++)
+            matrices.push_back(strtof(components[k].c_str(), NULL));
+        count++;
+    }
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = 200000;
+    std::string directory = "/tmp";
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+            count = strtoul(argv[++arg], NULL, 10);
+        else if (!strcmp(argv[arg], "-d") && arg + 1 < argc)
+            directory = argv[++arg];
+        else
+        {
+            fprintf(stderr, "usage: %s [-n poses] [-d directory]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count < 2)
+    {
+        fprintf(stderr, "need at least two poses\n");
+        return 2;
+    }
+
+    std::vector<double> times;
+    std::vector<Pose> poses;
+    makePath(count, times, poses);
+
+    std::string binaryPath = directory + "/pose_log_bench.plog";
+    std::string textPath = directory + "/pose_log_bench.log";
+
+    Clock::time_point start = Clock::now();
+    PoseLogWriter writer;
+    if (!writer.open(binaryPath.c_str(), 0))
+    {
+        perror(binaryPath.c_str());
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++)
+        writer.append(times[i], poses[i]);
+    CHECK(writer.close(), "writing %s failed", binaryPath.c_str());
+    double binaryWriteMs = milliseconds(start);
+
+    start = Clock::now();
+    writeText(textPath, times, poses);
+    double textWriteMs = milliseconds(start);
+
+    checkLog(binaryPath, times, poses);
+    checkEdges(directory, binaryPath, count);
+
+    // Loading: parse every line of the text, map the binary log and touch
+    // every record once, as drawing the path markers does.
+    std::vector<float> textTimes, textMatrices;
+    start = Clock::now();
+    size_t parsed = parseText(textPath, textTimes, textMatrices);
+    double textLoadMs = milliseconds(start);
+    CHECK(parsed == count, "%zu text lines parsed of %zu", parsed, count);
+
+    start = Clock::now();
+    PoseLogReader reader;
+    reader.open(binaryPath.c_str());
+    double openMs = milliseconds(start);
+    PoseTrack track = reader.track();
+    double sum = 0;
+    for (size_t i = 0; i < track.size(); i++)
+        sum += track[i].translation[0];
+    double binaryLoadMs = milliseconds(start);
+
+    // Playback lookups at random times.
+    const int lookups = 1000000;
+    std::vector<double> queries(lookups);
+    for (int i = 0; i < lookups; i++)
+        queries[i] = track.firstTime() + (track.lastTime() - track.firstTime()) * rand() / RAND_MAX;
+    Pose pose;
+    start = Clock::now();
+    for (int i = 0; i < lookups; i++)
+    {
+        track.sample(queries[i], pose);
+        sum += pose.translation.x;
+    }
+    double sampleNs = milliseconds(start) * 1e6 / lookups;
+
+    long textSize = fileSize(textPath);
+    long binarySize = fileSize(binaryPath);
+    printf("%zu poses over %.0f s (checksum %g)\n", count, times.back() - times.front(), sum);
+    printf("%-7s %10s %9s %10s %10s %11s\n", "format", "bytes", "B/pose", "write ms", "load ms", "ns/pose");
+    printf("%-7s %10ld %9.1f %10.1f %10.1f %11.1f\n", "text", textSize, (double)textSize / count, textWriteMs,
+           textLoadMs, textLoadMs * 1e6 / count);
+    printf("%-7s %10ld %9.1f %10.1f %10.1f %11.1f\n", "binary", binarySize, (double)binarySize / count,
+           binaryWriteMs, binaryLoadMs, binaryLoadMs * 1e6 / count);
+    printf("map %.3f ms, sample at a time %.0f ns\n", openMs, sampleNs);
+
+    remove(textPath.c_str());
+    remove(binaryPath.c_str());
+    if (failures)
+        printf("%d checks FAILED\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,500 @@
+//
+//  pose_recorder_bench.cpp
+//  UnboundedTracker
+//
+//  Benchmark and checks of PoseRecorder.h and PoseStream.h on a host. A
+//  recording session is replayed as MotionLogs sees it, a 60 Hz game camera
+//  and a 30 Hz tracker, and each sample is handed to a recorder the way the
+//  render loop would, timing every call. The recorders are
+//
+//    text      the text logs MotionLogs first wrote, an ofstream per stream
+//              and std::endl after every line
+//    plog      a binary pose log (PoseLog.h) per stream, written in place
+//    stream    the compressed pose stream, encoded and written in place
+//    recorder  the same stream through PoseRecorder's ring and worker
+//
+//  and the table shows the bytes per sample and how long the producer was
+//  held, the worst call being the stall a frame would see. The samples are
+//  pushed faster than in the app, one every -p microseconds, to run a long
+//  session in seconds; with -l a second thread keeps writing and syncing
+//  files in the same directory, as other apps do to the same flash.
+//
+//  The recorder's log is then read back, checking that every sample is
+//  there, in order, within the quantization of the stream, that a log cut
+//  inside its last block reads up to the block before, and that a file
+//  that is not a pose stream is refused. The exit status is 1 when a check
+//  fails.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -pthread -I.. -o pose_recorder_bench pose_recorder_bench.cpp
+//        ../PoseRecorder.cpp ../PoseStream.cpp ../PoseLog.cpp
+//    ./pose_recorder_bench [-s seconds] [-p microseconds] [-l] [-d directory]
+//
+//    -s  length of the session, default 600
+//    -p  time between two samples pushed, default 100
+//    -l  load the disk from another thread while recording
+//    -d  where to write the logs, default /tmp
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "PoseLog.h"
+#include "PoseRecorder.h"
+#include "PoseStream.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                            \
+    do                                                   \
+    {                                                    \
+        if (!(condition))                                \
+        {                                                \
+            if (failures++ < 10)                         \
+            {                                            \
+                fprintf(stderr, "failed: " __VA_ARGS__); \
+                fprintf(stderr, "\n");                   \
+            }                                            \
+        }                                                \
+    } while (0)
+
+enum
+{
+    GameCameraStream = 0,
+    TrackerStream = 1
+};
+
+struct Sample
+{
+    uint8_t stream;
+    double time;
+    Pose pose;
+};
+
+// Someone walking around, the game camera at 60 Hz with the frame times
+// jittering and the tracker at 30 Hz a few milliseconds off, in a world
+// scaled up 2.5 times as the game does.
+static void makeSession(double seconds, std::vector<Sample> &samples)
+{
+    srand(7);
+    double t = 0;
+    Quaternion rotation;
+    Vector3 position;
+    for (int frame = 0; t < seconds; frame++)
+    {
+        t += 1 / 60. + (rand() % 2000 - 1000) * 1e-6;
+        Vector3 turn(sin(t * 0.7) * 0.02, sin(t * 0.3) * 0.03, sin(t * 1.1) * 0.01);
+        rotation = (rotation * Quaternion::fromRotationVector(turn)).normalized();
+        position += rotation.rotate(Vector3(0, 0, -0.02));
+
+        Sample game = { GameCameraStream, t, Pose(rotation, position * 2.5) };
+        samples.push_back(game);
+        if (frame % 2 == 0)
+        {
+            Sample tracker = { TrackerStream, t + 0.003, Pose(rotation, position) };
+            samples.push_back(tracker);
+        }
+    }
+}
+
+static long fileSize(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static bool copyPrefix(const std::string &from, const std::string &to, long bytes)
+{
+    FILE *in = fopen(from.c_str(), "rb");
+    FILE *out = fopen(to.c_str(), "wb");
+    std::vector<char> buffer(bytes > 0 ? bytes : 1);
+    bool ok = in && out && fread(&buffer[0], 1, bytes, in) == (size_t)bytes &&
+              fwrite(&buffer[0], 1, bytes, out) == (size_t)bytes;
+    if (in)
+        fclose(in);
+    if (out)
+        fclose(out);
+    return ok;
+}
+
+class Recorder
+{
+public:
+    virtual ~Recorder() {}
+    virtual bool open(const std::string &base) = 0;
+    virtual void record(const Sample &sample) = 0;
+    virtual bool close() = 0;
+    // Bytes of all its files.
+    virtual long size() = 0;
+};
+
+class TextRecorder : public Recorder
+{
+public:
+    bool open(const std::string &base)
+    {
+        for (int s = 0; s < 2; s++)
+        {
+            _paths[s] = base + (s == GameCameraStream ? ".GameCameraPoses.log" : ".Tracker.log");
+            _files[s].open(_paths[s].c_str());
+        }
+        return _files[0].is_open() && _files[1].is_open();
+    }
+
+    void record(const Sample &sample)
+    {
+        float m[16];
+        sample.pose.toMatrix(m);
+        std::ofstream &file = _files[sample.stream];
+        file << int(1e3 * sample.time) << " ";
+        file << m[0] << " " << m[1] << " " << m[2] << " " << m[3] << " " << m[4] << " " << m[5] << " " << m[6]
+             << " " << m[7] << " " << m[8] << " " << m[9] << " " << m[10] << " " << m[11] << " " << m[12] << " "
+             << m[13] << " " << m[14] << " " << m[15] << std::endl;
+    }
+
+    bool close()
+    {
+        _files[0].close();
+        _files[1].close();
+        return !_files[0].fail() && !_files[1].fail();
+    }
+
+    long size() { return fileSize(_paths[0]) + fileSize(_paths[1]); }
+
+private:
+    std::string _paths[2];
+    std::ofstream _files[2];
+};
+
+class PoseLogRecorder : public Recorder
+{
+public:
+    bool open(const std::string &base)
+    {
+        bool opened = true;
+        for (int s = 0; s < 2; s++)
+        {
+            _paths[s] = base + (s == GameCameraStream ? ".GameCameraPoses.plog" : ".Tracker.plog");
+            opened = _writers[s].open(_paths[s].c_str(), 0) && opened;
+        }
+        return opened;
+    }
+
+    void record(const Sample &sample) { _writers[sample.stream].append(sample.time, sample.pose); }
+
+    bool close()
+    {
+        bool closed = _writers[0].close();
+        return _writers[1].close() && closed;
+    }
+
+    long size() { return fileSize(_paths[0]) + fileSize(_paths[1]); }
+
+private:
+    std::string _paths[2];
+    PoseLogWriter _writers[2];
+};
+
+class StreamRecorder : public Recorder
+{
+public:
+    bool open(const std::string &base)
+    {
+        _path = base + ".stream.pstream";
+        return _writer.open(_path.c_str(), 0);
+    }
+
+    void record(const Sample &sample) { _writer.append(sample.stream, sample.time, sample.pose); }
+    bool close() { return _writer.close(); }
+    long size() { return fileSize(_path); }
+
+private:
+    std::string _path;
+    PoseStreamWriter _writer;
+};
+
+class RingRecorder : public Recorder
+{
+public:
+    bool open(const std::string &base)
+    {
+        _path = base + ".pstream";
+        return _recorder.start(_path.c_str(), 0);
+    }
+
+    void record(const Sample &sample) { _recorder.record(sample.stream, sample.time, sample.pose); }
+    bool close() { return _recorder.stop(); }
+    long size() { return fileSize(_path); }
+
+    const std::string &path() const { return _path; }
+    PoseRecorderStats stats() const { return _recorder.stats(); }
+
+private:
+    std::string _path;
+    PoseRecorder _recorder;
+};
+
+// Writes and syncs a megabyte at a time until stopped.
+static void loadDisk(const std::string &path, const std::atomic<bool> &stop)
+{
+    std::vector<char> chunk(1 << 20, 'x');
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+    for (int n = 0; !stop.load(); n++)
+    {
+        if (n % 64 == 0)
+            ftruncate(fd, 0), lseek(fd, 0, SEEK_SET);
+        if (write(fd, &chunk[0], chunk.size()) < 0)
+            break;
+        fsync(fd);
+    }
+    close(fd);
+    remove(path.c_str());
+}
+
+struct Result
+{
+    long bytes;
+    double p50, p99, worst;
+    bool closed;
+};
+
+static Result run(Recorder &recorder, const std::string &base, const std::vector<Sample> &samples, double period)
+{
+    Result result = { 0, 0, 0, 0, false };
+    if (!recorder.open(base))
+    {
+        perror(base.c_str());
+        return result;
+    }
+
+    std::vector<double> calls(samples.size());
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(
+                                            std::chrono::duration<double>(i * period));
+        while (Clock::now() < due)
+        {
+        }
+        Clock::time_point before = Clock::now();
+        recorder.record(samples[i]);
+        calls[i] = std::chrono::duration<double, std::micro>(Clock::now() - before).count();
+    }
+    result.closed = recorder.close();
+    result.bytes = recorder.size();
+
+    std::sort(calls.begin(), calls.end());
+    result.p50 = calls[calls.size() / 2];
+    result.p99 = calls[calls.size() * 99 / 100];
+    result.worst = calls.back();
+    return result;
+}
+
+// The samples of a stream that were recorded, in order and within the
+// quantization of the log. Returns how many were read.
+static size_t checkStream(const PoseStreamReader &reader, uint8_t stream, const std::vector<Sample> &samples,
+                          double &translationError, double &angleError)
+{
+    std::vector<const Sample *> expected;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (samples[i].stream == stream)
+            expected.push_back(&samples[i]);
+    }
+
+    std::vector<PoseLogRecord> records;
+    CHECK(reader.read(stream, records), "stream %d does not decode", stream);
+
+    // Dropped samples leave gaps, so each record is matched by its time.
+    const PoseStreamHeader &header = reader.header();
+    size_t next = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        while (next < expected.size() && expected[next]->time < records[i].time - header.timeUnit)
+            next++;
+        CHECK(next < expected.size() && fabs(expected[next]->time - records[i].time) <= header.timeUnit,
+              "stream %d sample %zu at %f was not recorded", stream, i, records[i].time);
+        if (next == expected.size())
+            break;
+
+        Pose pose = records[i].pose();
+        const Sample &sample = *expected[next++];
+        double translation = (pose.translation - sample.pose.translation).norm();
+        double angle = (pose.rotation.conjugate() * sample.pose.rotation).angle();
+        translationError = std::max(translationError, translation);
+        angleError = std::max(angleError, angle);
+
+        // Half a unit on each axis, plus the float of the decoded record.
+        double translationLimit = header.translationUnit + 2e-7 * sample.pose.translation.norm();
+        CHECK(translation <= translationLimit, "stream %d sample %zu off by %g m", stream, i, translation);
+        CHECK(angle <= 2e-4, "stream %d sample %zu off by %g rad", stream, i, angle);
+    }
+    return records.size();
+}
+
+static void checkEdges(const std::string &directory, const std::string &path)
+{
+    PoseStreamReader reader;
+    CHECK(reader.open(path.c_str()) && reader.blockCount() > 1, "cannot open %s", path.c_str());
+    std::vector<PoseLogRecord> all, tracker;
+    reader.read(GameCameraStream, all);
+    reader.read(TrackerStream, tracker);
+    size_t blocks = reader.blockCount();
+    reader.close();
+
+    // Cut inside the last block.
+    std::string cut = directory + "/pose_recorder_bench_cut.pstream";
+    CHECK(copyPrefix(path, cut, fileSize(path) - 5), "cannot copy %s", path.c_str());
+    std::vector<PoseLogRecord> game, cutTracker;
+    CHECK(reader.open(cut.c_str()) && reader.truncated() && reader.blockCount() == blocks - 1,
+          "cut log not read up to its last block");
+    CHECK(reader.read(GameCameraStream, game) && reader.read(TrackerStream, cutTracker), "cut log does not decode");
+    CHECK(game.size() + cutTracker.size() < all.size() + tracker.size() && game.size() <= all.size() &&
+              cutTracker.size() <= tracker.size(),
+          "cut log has more samples than the log");
+    reader.close();
+    remove(cut.c_str());
+
+    // Repeated and earlier times, and an empty log.
+    std::string empty = directory + "/pose_recorder_bench_empty.pstream";
+    PoseStreamWriter writer;
+    CHECK(writer.open(empty.c_str(), 0), "cannot create %s", empty.c_str());
+    CHECK(writer.append(0, 1, Pose()) && writer.append(1, 1, Pose()), "first samples skipped");
+    CHECK(!writer.append(0, 1, Pose()) && !writer.append(0, 0.5, Pose()) && !writer.append(0, 1 + 1e-8, Pose()),
+          "time not later written");
+    CHECK(!writer.append(POSE_STREAM_COUNT, 2, Pose()), "stream out of range written");
+    CHECK(writer.samples() == 2 && writer.close(), "skipped samples counted");
+    CHECK(writer.open(empty.c_str(), 0) && writer.close(), "cannot rewrite %s", empty.c_str());
+    std::vector<PoseLogRecord> none;
+    CHECK(reader.open(empty.c_str()) && !reader.truncated() && reader.blockCount() == 0 &&
+              reader.read(0, none) && none.empty(),
+          "empty log not empty");
+    reader.close();
+    remove(empty.c_str());
+
+    // Not a pose stream.
+    std::string text = directory + "/pose_recorder_bench_not.pstream";
+    FILE *file = fopen(text.c_str(), "w");
+    if (file)
+    {
+        fprintf(file, "0 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1\n0 1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1\n");
+        fclose(file);
+    }
+    CHECK(!reader.open(text.c_str()), "text file read as a pose stream");
+    remove(text.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 600;
+    double period = 100e-6;
+    bool load = false;
+    std::string directory = "/tmp";
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            seconds = atof(argv[++arg]);
+        else if (!strcmp(argv[arg], "-p") && arg + 1 < argc)
+            period = atof(argv[++arg]) * 1e-6;
+        else if (!strcmp(argv[arg], "-l"))
+            load = true;
+        else if (!strcmp(argv[arg], "-d") && arg + 1 < argc)
+            directory = argv[++arg];
+        else
+        {
+            fprintf(stderr, "usage: %s [-s seconds] [-p microseconds] [-l] [-d directory]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!(seconds >= 10) || !(period >= 0))
+    {
+        fprintf(stderr, "need a session of 10 s or more\n");
+        return 2;
+    }
+
+    std::vector<Sample> samples;
+    makeSession(seconds, samples);
+
+    std::atomic<bool> stopLoad(false);
+    std::thread loader;
+    if (load)
+        loader = std::thread(loadDisk, directory + "/pose_recorder_bench_load", std::ref(stopLoad));
+
+    const char *names[] = { "text", "plog", "stream", "recorder" };
+    TextRecorder text;
+    PoseLogRecorder plog;
+    StreamRecorder stream;
+    RingRecorder recorder;
+    Recorder *recorders[] = { &text, &plog, &stream, &recorder };
+    std::string base = directory + "/pose_recorder_bench";
+
+    Result results[4];
+    for (int r = 0; r < 4; r++)
+    {
+        results[r] = run(*recorders[r], base, samples, period);
+        CHECK(results[r].closed, "%s: writing failed", names[r]);
+    }
+
+    if (load)
+    {
+        stopLoad.store(true);
+        loader.join();
+    }
+
+    // Only a loaded disk may hold the worker long enough to fill the ring.
+    PoseRecorderStats stats = recorder.stats();
+    CHECK(stats.skipped == 0 && stats.recorded + stats.dropped == samples.size() && (load || stats.dropped == 0),
+          "recorder wrote %llu samples of %zu, dropped %llu, skipped %llu", (unsigned long long)stats.recorded,
+          samples.size(), (unsigned long long)stats.dropped, (unsigned long long)stats.skipped);
+
+    double translationError = 0, angleError = 0;
+    PoseStreamReader reader;
+    CHECK(reader.open(recorder.path().c_str()) && !reader.truncated(), "cannot read %s", recorder.path().c_str());
+    if (reader.isOpen())
+    {
+        size_t read = checkStream(reader, GameCameraStream, samples, translationError, angleError) +
+                      checkStream(reader, TrackerStream, samples, translationError, angleError);
+        CHECK(read == stats.recorded, "%zu samples read of %llu recorded", read, (unsigned long long)stats.recorded);
+    }
+    checkEdges(directory, recorder.path());
+
+    printf("%zu samples over %.0f s, one pushed every %.0f us%s\n", samples.size(), seconds, period * 1e6,
+           load ? ", disk loaded" : "");
+    printf("%-9s %10s %10s %9s %9s %10s\n", "recorder", "bytes", "B/sample", "p50 us", "p99 us", "worst us");
+    for (int r = 0; r < 4; r++)
+        printf("%-9s %10ld %10.1f %9.2f %9.2f %10.1f\n", names[r], results[r].bytes,
+               (double)results[r].bytes / samples.size(), results[r].p50, results[r].p99, results[r].worst);
+    printf("recorder worker: longest write %.1f us, %llu dropped\n", stats.longestWriteSeconds * 1e6,
+           (unsigned long long)stats.dropped);
+    printf("decoded: max translation error %.3f mm, max angle error %.4f deg\n", translationError * 1e3,
+           angleError * 180 / M_PI);
+
+    const char *suffixes[] = { ".GameCameraPoses.log", ".Tracker.log", ".GameCameraPoses.plog", ".Tracker.plog",
+                               ".stream.pstream", ".pstream" };
+    for (int s = 0; s < 6; s++)
+        remove((base + suffixes[s]).c_str());
+    if (failures)
+        printf("%d checks FAILED\n", failures);
+    return failures ? 1 : 0;
+}
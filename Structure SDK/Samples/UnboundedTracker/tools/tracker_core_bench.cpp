@@ -0,0 +1,357 @@
+//
+//  tracker_core_bench.cpp
+//  UnboundedTracker
+//
+//  Benchmark and checks of TrackerCore.h on a host, with a mock tracker that
+//  spins for a configurable time per frame. For every pair of a sensor rate
+//  and a render rate a producer thread queues frames, with a reset and an
+//  initial pose now and then as the app queues them, while a consumer
+//  thread waits for each new update the way the render loop does, at most
+//  25 ms per render frame. Every run checks that
+//
+//    - commands run in the order they were queued, each at most once
+//    - tracked and dropped frames add up to the queued ones, and the last
+//      frame queued is tracked
+//    - a waiting consumer never gets an update older than it asked for
+//      unless the wait timed out
+//    - no frame is still referenced once the core has stopped
+//
+//  and reports the poses tracked per second, the frames dropped, how long
+//  the consumer waited, how late it woke after an update was published,
+//  and how often the lock of the last update was found taken. The exit
+//  status is 1 when a check fails.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -pthread -I.. -o tracker_core_bench tracker_core_bench.cpp ../FrameAdmission.cpp
+//    ./tracker_core_bench [-c compute_ms] [-j jitter_ms] [-t seconds]
+//
+//    -c  time the mock tracker spends on a frame, default 20
+//    -j  random variation of that time, default 5
+//    -t  length of each run, default 2
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "TrackerCore.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                            \
+    do                                                   \
+    {                                                    \
+        if (!(condition))                                \
+        {                                                \
+            if (failures++ < 10)                         \
+            {                                            \
+                fprintf(stderr, "failed: " __VA_ARGS__); \
+                fprintf(stderr, "\n");                   \
+            }                                            \
+        }                                                \
+    } while (0)
+
+static double seconds()
+{
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+// The mock tracker's work.
+static void spinUntil(double time)
+{
+    while (seconds() < time)
+    {
+    }
+}
+
+static void sleepUntil(double time)
+{
+    double left = time - seconds();
+    if (left > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(left));
+}
+
+// Stands in for the depth and color frames: the buffer is shared with the
+// producer, which checks that nothing holds it once the core has stopped.
+struct MockFrame
+{
+    uint64_t order = 0;
+    double timestamp = -1;
+    std::shared_ptr<int> buffer;
+};
+
+struct MockPose
+{
+    uint64_t order = 0;
+};
+
+struct MockUpdate
+{
+    double timestamp = -1;
+    // When the update was made, on seconds().
+    double madeAt = -1;
+    uint64_t order = 0;
+};
+
+class MockBackend
+{
+public:
+    typedef MockFrame Frame;
+    typedef MockPose Pose;
+    typedef MockUpdate Update;
+
+    double computeSeconds = 0.02;
+    double jitterSeconds = 0.005;
+
+    // Commands that ran out of the order they were queued in.
+    std::atomic<uint64_t> outOfOrder;
+    uint64_t lastOrder = 0;
+    std::mt19937 random;
+
+    MockBackend() : outOfOrder(0), random(3) {}
+
+    double now() const { return seconds(); }
+
+    template <typename Step> void runStep(const Step& step) { step(); }
+
+    void reset(MockUpdate& update)
+    {
+        update = MockUpdate();
+        update.madeAt = seconds();
+    }
+
+    void setInitialPose(const MockPose& pose, double timestamp, MockUpdate& update)
+    {
+        ran(pose.order);
+        update.timestamp = timestamp;
+        update.order = pose.order;
+        update.madeAt = seconds();
+    }
+
+    void track(MockFrame& frame, double, bool, MockUpdate& update)
+    {
+        ran(frame.order);
+        double jitter = std::uniform_real_distribution<double>(-jitterSeconds, jitterSeconds)(random);
+        spinUntil(seconds() + std::max(0., computeSeconds + jitter));
+        update.timestamp = frame.timestamp;
+        update.order = frame.order;
+        update.madeAt = seconds();
+    }
+
+private:
+    void ran(uint64_t order)
+    {
+        if (order <= lastOrder)
+            outOfOrder.fetch_add(1, std::memory_order_relaxed);
+        lastOrder = order;
+    }
+};
+
+struct Result
+{
+    double posesPerSecond;
+    uint64_t dropped;
+    double waitP50, waitP99;
+    double wakeP50, wakeP99, wakeWorst;
+    double timeoutShare;
+    double contendedPerSecond;
+    double queueWorst;
+};
+
+static double percentile(std::vector<double>& values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+static Result run(double sensorRate, double renderRate, double computeSeconds, double jitterSeconds, double duration)
+{
+    TrackerCore<MockBackend> core;
+    core.backend().computeSeconds = computeSeconds;
+    core.backend().jitterSeconds = jitterSeconds;
+    core.start();
+
+    std::shared_ptr<int> buffer = std::make_shared<int>(0);
+    std::atomic<bool> producing(true);
+    std::atomic<uint64_t> lastQueued(0);
+    double queueWorst = 0;
+
+    // The sensor thread: a frame per period, and every two seconds a reset
+    // followed by an initial pose, like a relocalization.
+    std::thread producer([&]() {
+        double start = seconds();
+        uint64_t order = 0;
+        for (int n = 0; seconds() - start < duration; n++)
+        {
+            sleepUntil(start + n / sensorRate);
+            double timestamp = seconds();
+            if (n > 0 && n % (int)(2 * sensorRate) == 0)
+            {
+                MockPose pose;
+                pose.order = ++order;
+                core.reset();
+                core.setInitialPose(pose, timestamp);
+                continue;
+            }
+            MockFrame frame;
+            frame.order = ++order;
+            frame.timestamp = timestamp;
+            frame.buffer = buffer;
+            double before = seconds();
+            if (core.queueFrame(std::move(frame), timestamp, false))
+                lastQueued.store(order);
+            queueWorst = std::max(queueWorst, seconds() - before);
+        }
+        producing.store(false);
+    });
+
+    // The render loop: wait for an update more recent than the last one, at
+    // most 25 ms, once per render frame.
+    std::vector<double> waits, wakes;
+    uint64_t timeouts = 0, renders = 0;
+    double previous = -1;
+    double start = seconds();
+    for (int n = 0; producing.load(); n++)
+    {
+        sleepUntil(start + n / renderRate);
+        double before = seconds();
+        MockUpdate update = core.waitForUpdateMoreRecentThan(previous, 0.025);
+        double after = seconds();
+        renders++;
+        waits.push_back(after - before);
+        if (update.timestamp < previous + 1e-7)
+        {
+            timeouts++;
+            CHECK(after - before >= 0.025 - 1e-3, "wait returned an old update after %.1f ms", (after - before) * 1e3);
+            continue;
+        }
+        // Woken by the publication rather than finding the update there.
+        if (update.madeAt > before)
+            wakes.push_back(after - update.madeAt);
+        previous = update.timestamp;
+    }
+    producer.join();
+
+    // The last frame queued is tracked even if others were dropped.
+    double deadline = seconds() + 1;
+    while (core.lastUpdate().order < lastQueued.load() && seconds() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK(core.lastUpdate().order >= lastQueued.load(), "last frame %llu not tracked, last update %llu",
+          (unsigned long long)lastQueued.load(), (unsigned long long)core.lastUpdate().order);
+    core.stop();
+
+    TrackerCoreStats stats = core.stats();
+    CHECK(core.backend().outOfOrder.load() == 0, "%llu commands out of order",
+          (unsigned long long)core.backend().outOfOrder.load());
+    CHECK(stats.framesTracked + stats.droppedOldestFrames == stats.framesQueued,
+          "%llu frames tracked and %llu dropped of %llu queued", (unsigned long long)stats.framesTracked,
+          (unsigned long long)stats.droppedOldestFrames, (unsigned long long)stats.framesQueued);
+    CHECK(buffer.use_count() == 1, "%ld references to the frames left", buffer.use_count() - 1);
+
+    Result result;
+    result.posesPerSecond = stats.framesTracked / duration;
+    result.dropped = stats.droppedOldestFrames + stats.droppedNewestFrames;
+    result.waitP50 = percentile(waits, 0.5) * 1e3;
+    result.waitP99 = percentile(waits, 0.99) * 1e3;
+    result.wakeP50 = percentile(wakes, 0.5) * 1e6;
+    result.wakeP99 = percentile(wakes, 0.99) * 1e6;
+    result.wakeWorst = wakes.empty() ? 0 : wakes.back() * 1e6;
+    result.timeoutShare = renders ? (double)timeouts / renders : 0;
+    result.contendedPerSecond = stats.updateLockContended / duration;
+    result.queueWorst = queueWorst * 1e6;
+    return result;
+}
+
+// Restarting, and stopping with frames still queued.
+static void checkRestart()
+{
+    TrackerCore<MockBackend> core;
+    core.backend().computeSeconds = 0.01;
+    core.backend().jitterSeconds = 0;
+    std::shared_ptr<int> buffer = std::make_shared<int>(0);
+    for (int round = 0; round < 3; round++)
+    {
+        core.start();
+        CHECK(core.isRunning(), "not running after start");
+        for (int n = 0; n < 5; n++)
+        {
+            MockFrame frame;
+            frame.order = round * 10 + n + 1;
+            frame.timestamp = frame.order;
+            frame.buffer = buffer;
+            core.queueFrame(std::move(frame), seconds(), false);
+        }
+        core.stop();
+        CHECK(!core.isRunning(), "running after stop");
+        CHECK(buffer.use_count() == 1, "stopped core holds %ld frames", buffer.use_count() - 1);
+    }
+
+    // A stopped core times out without an update.
+    double before = seconds();
+    core.waitForUpdateMoreRecentThan(1e9, 0.01);
+    CHECK(seconds() - before >= 0.009, "wait on a stopped core returned early");
+}
+
+int main(int argc, char** argv)
+{
+    double computeSeconds = 0.02;
+    double jitterSeconds = 0.005;
+    double duration = 2;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-c") && arg + 1 < argc)
+            computeSeconds = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-j") && arg + 1 < argc)
+            jitterSeconds = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-t") && arg + 1 < argc)
+            duration = atof(argv[++arg]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-c compute_ms] [-j jitter_ms] [-t seconds]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!(computeSeconds >= 0) || !(jitterSeconds >= 0) || !(duration > 0.5))
+    {
+        fprintf(stderr, "need times of 0 or more and runs longer than half a second\n");
+        return 2;
+    }
+
+    checkRestart();
+
+    printf("mock tracker %.1f +- %.1f ms per frame, %.1f s per run\n", computeSeconds * 1e3, jitterSeconds * 1e3,
+           duration);
+    printf("%6s %6s %8s %8s %8s %8s %8s %8s %8s %8s %8s %9s\n", "sensor", "render", "poses/s", "dropped",
+           "wait p50", "wait p99", "timeouts", "wake p50", "wake p99", "wake max", "locks/s", "queue max");
+    printf("%6s %6s %8s %8s %8s %8s %8s %8s %8s %8s %8s %9s\n", "Hz", "Hz", "", "", "ms", "ms", "", "us", "us", "us",
+           "taken", "us");
+
+    const double sensorRates[] = { 30, 60, 240 };
+    const double renderRates[] = { 30, 60, 240 };
+    for (double sensorRate : sensorRates)
+    {
+        for (double renderRate : renderRates)
+        {
+            Result r = run(sensorRate, renderRate, computeSeconds, jitterSeconds, duration);
+            printf("%6.0f %6.0f %8.1f %8llu %8.2f %8.2f %7.0f%% %8.1f %8.1f %8.1f %8.1f %9.1f\n", sensorRate,
+                   renderRate, r.posesPerSecond, (unsigned long long)r.dropped, r.waitP50, r.waitP99,
+                   r.timeoutShare * 100, r.wakeP50, r.wakeP99, r.wakeWorst, r.contendedPerSecond, r.queueWorst);
+        }
+    }
+
+    if (failures)
+        printf("%d checks FAILED\n", failures);
+    return failures ? 1 : 0;
+}
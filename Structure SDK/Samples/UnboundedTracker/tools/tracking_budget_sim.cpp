@@ -0,0 +1,672 @@
+//
+//  tracking_budget_sim.cpp
+//  UnboundedTracker
+//
+//  Replays a motion log through TrackingBudget.h on a host and weighs the
+//  tracker time it saves against the pose error it costs. Motion samples
+//  reach the budget and a PoseExtrapolator as they are measured; every
+//  depth frame is admitted by the budget and then by FrameAdmission as it
+//  arrives, as TrackerThread.mm does, and goes to a tracker that takes one
+//  frame at a time. The status and pose of a tracked frame come back a
+//  tracking latency after capture, or when the tracker is done if that is
+//  later. A render frame at 60 Hz compares the extrapolated pose at its
+//  display time with the true one. The budget is compared with tracking every frame at full
+//  resolution:
+//
+//    full      every frame at full resolution
+//    half      the budget without the reduced rate
+//    budget/2  the budget, tracking one frame in two at the reduced rate
+//    budget/3  the same, one in three
+//
+//  A pose tracked at half resolution gets some noise on top of what the log
+//  has, as a stand in for the accuracy lost. Every run checks that
+//
+//    - the frame after fast motion, a gap in the motion samples or a status
+//      other than good is tracked at full resolution
+//    - the frames and the CPU saved the budget reports match what became of
+//      the frames after FrameAdmission
+//
+//  and the synthetic session has to get the budget to relax at all, and is
+//  run once more with a tracker too slow for every frame, where
+//  FrameAdmission has to skip or downsample frames the budget let through. The exit
+//  status is 1 when a check fails.
+//
+//  The log has one sample per line, times in seconds:
+//
+//    imu <time> <rotation rate x y z> <user acceleration x y z>
+//    status <time> <STTrackerStatus, -1 when there was no pose>
+//    pose <time> <camera to world matrix, 16 values, column major>
+//
+//  as TrackerThread.mm writes it with TRACKER_MOTION_LOG set; lines may carry
+//  any prefix up to "MOTION ". A log without status lines has a frame with a
+//  good status at every pose. The truth is then the tracker poses
+//  themselves, interpolated; a synthetic session, of stillness, slow pans,
+//  fast turns, walking and a stretch of poor tracking, is compared against
+//  the exact trajectory it was made from.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -I.. -o tracking_budget_sim tracking_budget_sim.cpp ../TrackingBudget.cpp ../FrameAdmission.cpp ../PoseExtrapolator.cpp
+//    ./tracking_budget_sim [-f full_ms] [-h half_ms] [-l latency_ms] [-n noise_mm] [-s seconds] [log]
+//
+//    -f  tracker time of a full resolution frame, default 20 ms
+//    -h  tracker time of a half resolution frame, default 8 ms
+//    -l  capture to tracker pose latency, default 40 ms
+//    -n  extra noise of a half resolution pose, mm and mrad, default 1
+//    -s  simulate this many seconds instead of reading a log
+//
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "FrameAdmission.h"
+#include "PoseExtrapolator.h"
+#include "TrackingBudget.h"
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                            \
+    do                                                   \
+    {                                                    \
+        if (!(condition))                                \
+        {                                                \
+            if (failures++ < 10)                         \
+            {                                            \
+                fprintf(stderr, "failed: " __VA_ARGS__); \
+                fprintf(stderr, "\n");                   \
+            }                                            \
+        }                                                \
+    } while (0)
+
+struct MotionEntry
+{
+    double time;
+    Vector3 rotationRate;
+    Vector3 userAcceleration;
+};
+
+struct PoseEntry
+{
+    double time;
+    Pose pose;
+};
+
+struct FrameEntry
+{
+    double time;
+    int status;
+    bool hasPose;
+    Pose pose;
+};
+
+struct Log
+{
+    std::vector<MotionEntry> motion;
+    std::vector<FrameEntry> frames;
+
+    // Sorted by time; the poses themselves for a recorded log.
+    std::vector<PoseEntry> truth;
+};
+
+static bool readLog(FILE *in, Log &log)
+{
+    char line[512];
+    unsigned number = 0;
+    std::vector<PoseEntry> poses;
+    std::vector<FrameEntry> statuses;
+    while (fgets(line, sizeof(line), in))
+    {
+        number++;
+        const char *at = strstr(line, "MOTION ");
+        at = at ? at + strlen("MOTION ") : line;
+        while (*at == ' ' || *at == '\t')
+            at++;
+        if (*at == '#' || *at == '\n' || *at == 0)
+            continue;
+
+        MotionEntry motion;
+        PoseEntry pose;
+        FrameEntry frame;
+        float m[16];
+        if (sscanf(at, "imu %lf %lf %lf %lf %lf %lf %lf", &motion.time,
+                   &motion.rotationRate.x, &motion.rotationRate.y, &motion.rotationRate.z,
+                   &motion.userAcceleration.x, &motion.userAcceleration.y, &motion.userAcceleration.z) == 7)
+        {
+            log.motion.push_back(motion);
+        }
+        else if (sscanf(at, "status %lf %d", &frame.time, &frame.status) == 2)
+        {
+            frame.hasPose = false;
+            statuses.push_back(frame);
+        }
+        else if (sscanf(at, "pose %lf %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f", &pose.time,
+                        &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &m[6], &m[7],
+                        &m[8], &m[9], &m[10], &m[11], &m[12], &m[13], &m[14], &m[15]) == 17)
+        {
+            pose.pose = Pose::fromMatrix(m);
+            poses.push_back(pose);
+        }
+        else
+        {
+            fprintf(stderr, "line %u: not a sample\n", number);
+            return false;
+        }
+    }
+    std::stable_sort(log.motion.begin(), log.motion.end(), [](const MotionEntry &a, const MotionEntry &b) {
+        return a.time < b.time;
+    });
+    std::stable_sort(poses.begin(), poses.end(), [](const PoseEntry &a, const PoseEntry &b) {
+        return a.time < b.time;
+    });
+    std::stable_sort(statuses.begin(), statuses.end(), [](const FrameEntry &a, const FrameEntry &b) {
+        return a.time < b.time;
+    });
+
+    // A pose belongs to the status logged for the same frame.
+    if (statuses.empty())
+    {
+        for (const PoseEntry &pose : poses)
+        {
+            FrameEntry frame = { pose.time, 0, true, pose.pose };
+            log.frames.push_back(frame);
+        }
+    }
+    else
+    {
+        size_t p = 0;
+        for (FrameEntry frame : statuses)
+        {
+            while (p < poses.size() && poses[p].time < frame.time - 1e-6)
+                p++;
+            if (p < poses.size() && poses[p].time <= frame.time + 1e-6)
+            {
+                frame.hasPose = true;
+                frame.pose = poses[p].pose;
+            }
+            log.frames.push_back(frame);
+        }
+    }
+    log.truth = poses;
+    return poses.size() >= 2;
+}
+
+static double gaussian()
+{
+    double u = (rand() + 1.) / (RAND_MAX + 2.);
+    double v = (rand() + 1.) / (RAND_MAX + 2.);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+struct Phase
+{
+    double seconds;
+    // Peak rotation rate, mostly about the vertical axis, and peak
+    // displacement, mostly vertical, with their frequencies.
+    double rate;
+    double rateFrequency;
+    double position;
+    double positionFrequency;
+    // Poor tracking for the middle of the phase.
+    bool poorTracking;
+};
+
+// A session cycling through holding still, panning slowly, turning fast,
+// holding still while tracking goes poor for a moment, and walking.
+static const Phase phases[] = {
+    { 3.0, 0.05, 0.3, 0.002, 0.3, false },
+    { 3.0, 0.30, 0.2, 0.010, 0.2, false },
+    { 1.0, 2.50, 0.5, 0.050, 0.5, false },
+    { 2.5, 0.05, 0.3, 0.002, 0.3, true },
+    { 2.5, 0.30, 0.4, 0.012, 1.8, false },
+};
+static const size_t phaseCount = sizeof(phases) / sizeof(phases[0]);
+
+// The phase at time t, blended into the next one over its last 0.3 s, and
+// whether tracking is poor then.
+static Phase phaseAt(double t, bool &poorTracking)
+{
+    double cycle = 0;
+    for (size_t i = 0; i < phaseCount; i++)
+        cycle += phases[i].seconds;
+    double at = fmod(t, cycle);
+    size_t i = 0;
+    while (at >= phases[i].seconds)
+        at -= phases[i++].seconds;
+
+    const Phase &phase = phases[i];
+    const Phase &next = phases[(i + 1) % phaseCount];
+    poorTracking = phase.poorTracking && fabs(at - phase.seconds / 2) < 0.3;
+
+    const double blend = 0.3;
+    double w = at > phase.seconds - blend ? 0.5 - 0.5 * cos(M_PI * (at - phase.seconds + blend) / blend) : 0;
+    Phase blended = phase;
+    blended.rate = (1 - w) * phase.rate + w * next.rate;
+    blended.rateFrequency = (1 - w) * phase.rateFrequency + w * next.rateFrequency;
+    blended.position = (1 - w) * phase.position + w * next.position;
+    blended.positionFrequency = (1 - w) * phase.positionFrequency + w * next.positionFrequency;
+    return blended;
+}
+
+// The motion at 100 Hz with gyroscope and accelerometer bias and noise, and
+// a depth frame at 30 Hz, give or take a millisecond. While tracking is poor
+// the status is dodgy, the poses are noisier and every third frame has none.
+static void synthesize(double seconds, Log &log)
+{
+    srand(13);
+    PoseExtrapolatorSettings settings;
+    Quaternion cameraToImu = settings.imuToCamera.conjugate();
+
+    const double step = 0.001;
+    const double rateWeight[3] = { 0.3, 1, 0.2 };
+    const double positionWeight[3] = { 0.5, 1, 0.5 };
+
+    Vector3 gyroBias(0.008, -0.006, 0.004);
+    Vector3 accelerometerBias(0.004, -0.003, 0.002);
+    Quaternion rotation;
+    double ratePhase = 0, positionPhase = 0;
+    Vector3 previousPosition[2];
+    double nextMotion = 0;
+    double nextFrame = 0;
+    unsigned poorFrames = 0;
+
+    for (int n = 0; n * step < seconds; n++)
+    {
+        double t = n * step;
+        bool poorTracking;
+        Phase phase = phaseAt(t, poorTracking);
+        ratePhase += 2 * M_PI * phase.rateFrequency * step;
+        positionPhase += 2 * M_PI * phase.positionFrequency * step;
+
+        double p[3], w[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            w[axis] = phase.rate * rateWeight[axis] * sin(ratePhase * (1 + 0.3 * axis) + axis);
+            p[axis] = phase.position * positionWeight[axis] * sin(positionPhase * (1 + 0.2 * axis) + 2 * axis);
+        }
+        Vector3 position(p[0], p[1], p[2]);
+        Vector3 rate(w[0], w[1], w[2]);
+        Vector3 acceleration = n >= 2 ? (position - previousPosition[0] * 2 + previousPosition[1]) * (1 / (step * step))
+                                      : Vector3();
+        previousPosition[1] = previousPosition[0];
+        previousPosition[0] = position;
+
+        PoseEntry truth = { t, Pose(rotation, position) };
+        log.truth.push_back(truth);
+
+        if (t >= nextMotion)
+        {
+            Vector3 noise(gaussian(), gaussian(), gaussian());
+            Vector3 accelerometerNoise(gaussian(), gaussian(), gaussian());
+            MotionEntry motion;
+            motion.time = t;
+            motion.rotationRate = cameraToImu.rotate(rate) + gyroBias + noise * 0.004;
+            motion.userAcceleration = cameraToImu.rotate(rotation.conjugate().rotate(acceleration)) *
+                                      (1 / settings.gravity) + accelerometerBias + accelerometerNoise * 0.008;
+            log.motion.push_back(motion);
+            nextMotion += 0.01;
+        }
+        if (t >= nextFrame)
+        {
+            double noise = poorTracking ? 0.005 : 0.001;
+            Vector3 angleNoise(gaussian(), gaussian(), gaussian());
+            Vector3 positionNoise(gaussian(), gaussian(), gaussian());
+            FrameEntry frame;
+            frame.time = t;
+            frame.status = poorTracking ? 1 : 0;
+            frame.hasPose = !(poorTracking && poorFrames++ % 3 == 2);
+            if (!frame.hasPose)
+                frame.status = -1;
+            frame.pose = Pose(rotation * Quaternion::fromRotationVector(angleNoise * noise),
+                              position + positionNoise * noise);
+            log.frames.push_back(frame);
+            nextFrame += 1 / 30. + (rand() % 2000 - 1000) * 1e-6;
+        }
+
+        rotation = (rotation * Quaternion::fromRotationVector(rate * step)).normalized();
+    }
+}
+
+// False outside the truth, or in a gap of it.
+static bool truthAt(const std::vector<PoseEntry> &truth, double time, Pose &pose)
+{
+    std::vector<PoseEntry>::const_iterator after = std::lower_bound(
+        truth.begin(), truth.end(), time, [](const PoseEntry &e, double t) { return e.time < t; });
+    if (after == truth.begin() || after == truth.end())
+        return false;
+    const PoseEntry &before = *(after - 1);
+    if (after->time - before.time > 0.1)
+        return false;
+    pose = Pose::interpolate(before.pose, after->pose, (time - before.time) / (after->time - before.time));
+    return true;
+}
+
+enum Strategy
+{
+    StrategyFull,
+    StrategyHalf,
+    StrategyBudget2,
+    StrategyBudget3
+};
+
+struct Costs
+{
+    double fullSeconds;
+    double halfSeconds;
+    double latency;
+    double halfNoise;
+};
+
+struct Result
+{
+    uint64_t full, half, skipped;
+
+    // Frames the budget let through that FrameAdmission skipped or
+    // downsampled.
+    uint64_t admissionReduced;
+    double trackerSeconds;
+    std::vector<double> translation;
+    std::vector<double> angle;
+    TrackingBudgetStats stats;
+};
+
+// A tracked frame whose status and pose come back later.
+struct Pending
+{
+    double time;
+    size_t frame;
+    bool downsampled;
+};
+
+// A frame queued for the tracker, which takes one at a time.
+struct TrackerJob
+{
+    double start;
+    double end;
+    bool downsampled;
+};
+
+static Result replay(const Log &log, Strategy strategy, const Costs &costs)
+{
+    TrackingBudgetSettings settings;
+    if (strategy == StrategyHalf)
+        settings.reducedSeconds = INFINITY;
+    settings.reducedStride = strategy == StrategyBudget3 ? 3 : 2;
+    TrackingBudget budget(settings);
+    FrameAdmission admission;
+    PoseExtrapolator extrapolator;
+
+    Result result;
+    result.full = result.half = result.skipped = result.admissionReduced = 0;
+    result.trackerSeconds = 0;
+    std::vector<Pending> pending;
+    std::vector<TrackerJob> jobs;
+    double trackerFree = -INFINITY;
+    srand(17);
+
+    // What the budget has seen since the previous frame, to check its
+    // decisions against.
+    double peakRate = 0, peakAcceleration = 0, lastMotion = -1;
+    bool poorSince = true;
+
+    size_t m = 0, f = 0, p = 0, started = 0, finished = 0;
+    double start = log.frames.front().time;
+    double end = std::min(log.truth.back().time, log.frames.back().time);
+    for (double render = start + costs.latency; render < end; render += 1 / 60.)
+    {
+        admission.renderFrame(render);
+        for (;;)
+        {
+            double motionTime = m < log.motion.size() ? log.motion[m].time : INFINITY;
+            double frameTime = f < log.frames.size() ? log.frames[f].time : INFINITY;
+            double pendingTime = p < pending.size() ? pending[p].time : INFINITY;
+            double startTime = started < jobs.size() ? jobs[started].start : INFINITY;
+            double endTime = finished < started ? jobs[finished].end : INFINITY;
+            double next = std::min(std::min(motionTime, frameTime), std::min(pendingTime, std::min(startTime, endTime)));
+            if (next > render)
+                break;
+
+            if (next == endTime)
+            {
+                admission.frameTracked(jobs[finished++].end);
+            }
+            else if (next == startTime)
+            {
+                const TrackerJob &job = jobs[started++];
+                admission.frameStarted(job.start, job.downsampled);
+            }
+            else if (next == motionTime)
+            {
+                const MotionEntry &e = log.motion[m++];
+                extrapolator.addMotion(e.time, e.rotationRate, e.userAcceleration);
+                budget.addMotion(e.time, e.rotationRate, e.userAcceleration);
+                peakRate = std::max(peakRate, e.rotationRate.norm());
+                peakAcceleration = std::max(peakAcceleration, e.userAcceleration.norm());
+                lastMotion = e.time;
+            }
+            else if (next == pendingTime)
+            {
+                const Pending &done = pending[p++];
+                const FrameEntry &frame = log.frames[done.frame];
+                bool good = frame.hasPose && frame.status == 0;
+                budget.trackerStatus(good);
+                poorSince = poorSince || !good;
+                if (frame.hasPose)
+                {
+                    Pose pose = frame.pose;
+                    if (done.downsampled)
+                    {
+                        Vector3 angleNoise(gaussian(), gaussian(), gaussian());
+                        Vector3 positionNoise(gaussian(), gaussian(), gaussian());
+                        pose.rotation = pose.rotation * Quaternion::fromRotationVector(angleNoise * costs.halfNoise);
+                        pose.translation = pose.translation + positionNoise * costs.halfNoise;
+                    }
+                    Pose predicted;
+                    if (extrapolator.predict(frame.time, predicted))
+                        budget.poseTracked(done.downsampled, predicted, pose);
+                    extrapolator.setTrackerPose(frame.time, pose);
+                }
+            }
+            else
+            {
+                const FrameEntry &frame = log.frames[f];
+                FrameAdmissionDecision decision = FrameSubmit;
+                if (strategy != StrategyFull)
+                    decision = budget.admit(frame.time);
+
+                const TrackingBudgetSettings &s = settings;
+                bool mustTrack = poorSince || lastMotion < 0 || frame.time - lastMotion > s.maxMotionGapSeconds ||
+                                 peakRate > s.fastRotationRate || peakAcceleration > s.fastAcceleration;
+                if (strategy != StrategyFull)
+                    CHECK(!mustTrack || decision == FrameSubmit, "frame at %.3f s relaxed after fast motion or "
+                          "poor tracking: rate %.2f, acceleration %.2f, poor %d", frame.time, peakRate,
+                          peakAcceleration, poorSince);
+                peakRate = peakAcceleration = 0;
+                poorSince = false;
+
+                // As TrackerThread.mm: the frames the budget skips are no
+                // arrivals for the admission, which may skip or downsample
+                // the rest.
+                if (decision != FrameSkip)
+                {
+                    FrameAdmissionDecision admitted = admission.admit(frame.time, jobs.size() - started);
+                    if (admitted != FrameSubmit)
+                    {
+                        result.admissionReduced += admitted != decision;
+                        decision = admitted;
+                    }
+                }
+                if (strategy != StrategyFull)
+                    budget.committed(decision, costs.fullSeconds, costs.halfSeconds);
+
+                if (decision != FrameSkip)
+                {
+                    bool downsampled = decision == FrameDownsample;
+                    double cost = downsampled ? costs.halfSeconds : costs.fullSeconds;
+                    result.trackerSeconds += cost;
+                    (downsampled ? result.half : result.full)++;
+                    TrackerJob job = { std::max(frame.time, trackerFree), 0, downsampled };
+                    job.end = trackerFree = job.start + cost;
+                    jobs.push_back(job);
+                    Pending tracked = { std::max(frame.time + costs.latency, job.end), f, downsampled };
+                    pending.push_back(tracked);
+                }
+                else
+                {
+                    result.skipped++;
+                }
+                f++;
+            }
+        }
+
+        Pose shown, truth;
+        double display = render + 1 / 60.;
+        if (!extrapolator.predict(display, shown) || !truthAt(log.truth, display, truth))
+            continue;
+        result.translation.push_back((shown.translation - truth.translation).norm());
+        result.angle.push_back((shown.rotation.conjugate() * truth.rotation).angle());
+    }
+
+    result.stats = budget.stats();
+    if (strategy != StrategyFull)
+    {
+        CHECK(result.stats.fullFrames == result.full && result.stats.halfFrames == result.half &&
+              result.stats.skippedFrames == result.skipped, "budget reports %llu/%llu/%llu full/half/skipped frames, "
+              "%llu/%llu/%llu were", (unsigned long long)result.stats.fullFrames,
+              (unsigned long long)result.stats.halfFrames, (unsigned long long)result.stats.skippedFrames,
+              (unsigned long long)result.full, (unsigned long long)result.half, (unsigned long long)result.skipped);
+        double saved = (result.full + result.half + result.skipped) * costs.fullSeconds - result.trackerSeconds;
+        CHECK(fabs(result.stats.cpuSavedSeconds - saved) < 1e-6, "budget reports %.3f s saved, %.3f s were",
+              result.stats.cpuSavedSeconds, saved);
+    }
+    return result;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(p * (values.size() - 1) + 0.5)];
+}
+
+static double mean(const std::vector<double> &values)
+{
+    double sum = 0;
+    for (double value : values)
+        sum += value;
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static void printResult(const char *name, const Result &r, const Costs &costs, double duration)
+{
+    const double degrees = 180 / M_PI;
+    uint64_t frames = r.full + r.half + r.skipped;
+    double saved = std::max(1 - r.trackerSeconds / (frames * costs.fullSeconds), 0.);
+    printf("%-9s %6llu %6llu %6llu %6.1f%% %5.0f%% %7.2f %7.2f %7.2f %8.3f %8.3f %8llu %5.2f/%.2f\n", name,
+           (unsigned long long)r.full, (unsigned long long)r.half, (unsigned long long)r.skipped,
+           r.trackerSeconds / duration * 100, saved * 100, mean(r.translation) * 1e3,
+           percentile(r.translation, 0.95) * 1e3, percentile(r.translation, 0.99) * 1e3, mean(r.angle) * degrees,
+           percentile(r.angle, 0.99) * degrees, (unsigned long long)(r.stats.fastMotionRestores + r.stats.statusRestores),
+           r.stats.fullTranslationError * 1e3, r.stats.halfTranslationError * 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    Costs costs = { 0.020, 0.008, 0.040, 0.001 };
+    double seconds = 0;
+    const char *logPath = NULL;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-f") && arg + 1 < argc)
+            costs.fullSeconds = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-h") && arg + 1 < argc)
+            costs.halfSeconds = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-l") && arg + 1 < argc)
+            costs.latency = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+            costs.halfNoise = atof(argv[++arg]) * 1e-3;
+        else if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            seconds = atof(argv[++arg]);
+        else if (argv[arg][0] != '-' && !logPath)
+            logPath = argv[arg];
+        else
+        {
+            fprintf(stderr, "usage: %s [-f full_ms] [-h half_ms] [-l latency_ms] [-n noise_mm] [-s seconds] [log]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (!(costs.fullSeconds > 0) || !(costs.halfSeconds >= 0) || !(costs.latency >= 0) || !(costs.halfNoise >= 0))
+    {
+        fprintf(stderr, "need a full frame time above 0 and other times and the noise of 0 or more\n");
+        return 2;
+    }
+
+    Log log;
+    if (seconds > 0)
+    {
+        synthesize(seconds, log);
+    }
+    else
+    {
+        FILE *in = logPath ? fopen(logPath, "r") : stdin;
+        if (!in)
+        {
+            perror(logPath);
+            return 1;
+        }
+        bool ok = readLog(in, log);
+        if (in != stdin)
+            fclose(in);
+        if (!ok)
+        {
+            fprintf(stderr, "not enough tracker poses in the log\n");
+            return 1;
+        }
+    }
+    if (log.frames.size() < 2)
+    {
+        fprintf(stderr, "not enough frames\n");
+        return 1;
+    }
+
+    double duration = log.frames.back().time - log.frames.front().time;
+    printf("%.1f s, %zu motion samples, %zu frames, %.1f/%.1f ms a full/half frame, %.0f ms to the pose\n", duration,
+           log.motion.size(), log.frames.size(), costs.fullSeconds * 1e3, costs.halfSeconds * 1e3,
+           costs.latency * 1e3);
+    printf("%-9s %6s %6s %6s %7s %6s %7s %7s %7s %8s %8s %8s %9s\n", "strategy", "full", "half", "skip", "cpu %",
+           "saved", "mm mean", "mm p95", "mm p99", "deg mean", "deg p99", "restores", "mm full/half");
+
+    const char *names[] = { "full", "half", "budget/2", "budget/3" };
+    for (int strategy = StrategyFull; strategy <= StrategyBudget3; strategy++)
+    {
+        Result r = replay(log, (Strategy)strategy, costs);
+        printResult(names[strategy], r, costs, duration);
+        if (seconds > 0 && strategy == StrategyBudget2)
+            CHECK(r.half > 0 && r.skipped > 0, "the budget never relaxed: %llu half, %llu skipped",
+                  (unsigned long long)r.half, (unsigned long long)r.skipped);
+    }
+
+    // A tracker slower than the frame rate, so FrameAdmission has its say on
+    // the frames the budget lets through, and the budget has to count them
+    // as they end up.
+    if (seconds > 0)
+    {
+        Costs slow = costs;
+        slow.fullSeconds = std::max(costs.fullSeconds, 0.045);
+        slow.halfSeconds = std::max(costs.halfSeconds, 0.015);
+        Result r = replay(log, StrategyBudget2, slow);
+        printf("with a %.1f/%.1f ms tracker, admission reduced %llu frames the budget let through:\n",
+               slow.fullSeconds * 1e3, slow.halfSeconds * 1e3, (unsigned long long)r.admissionReduced);
+        printResult(names[StrategyBudget2], r, slow, duration);
+        CHECK(r.admissionReduced > 0, "admission never reduced a frame the budget let through");
+    }
+
+    if (failures)
+        printf("%d checks FAILED\n", failures);
+    return failures ? 1 : 0;
+}
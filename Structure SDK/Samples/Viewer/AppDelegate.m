@@ -27,6 +27,7 @@
     self.window.backgroundColor = [UIColor whiteColor];
     
     self.viewController = [[ViewController alloc] init];
+    self.viewController.peripheral = self.peripheral;
     self.window.rootViewController = self.viewController;
     
     [self.window makeKeyAndVisible];
@@ -54,6 +55,9 @@
     self.peripheral.vb2UUID = [CBUUID UUIDWithString:VB2_UUID];
     self.peripheral.vb3UUID = [CBUUID UUIDWithString:VB3_UUID];
     self.peripheral.vb4UUID = [CBUUID UUIDWithString:VB4_UUID];
+    self.peripheral.timelineUUID = [CBUUID UUIDWithString:TIMELINE_UUID];
+    self.peripheral.layoutUUID = [CBUUID UUIDWithString:LAYOUT_UUID];
+    self.peripheral.diagnosticsUUID = [CBUUID UUIDWithString:DIAG_UUID];
     
     [self.peripheral startAdvertising];
     
@@ -98,6 +102,7 @@
     } else {
         self.viewController = [[ViewController alloc] initWithNibName:@"ViewController_iPad" bundle:nil];
     }
+    self.viewController.peripheral = self.peripheral;
     self.window.rootViewController = self.viewController;
     [self.window makeKeyAndVisible];
 
@@ -157,6 +162,10 @@
         data = @"Vibe 3";
     } else if ([characteristic.UUID.UUIDString isEqual:VB4_UUID]) {
         data = @"Vibe 4";
+    } else if ([characteristic.UUID.UUIDString isEqual:TIMELINE_UUID]) {
+        // Timeline notifications are binary batches, no greeting.
+        [self.viewController wearableDidSubscribe:central];
+        return;
     } else {
         data = @"Not a matching characteristic";
     }
@@ -167,10 +176,32 @@
     [self.viewController centralDidConnect];
 }
 
-- (void)peripheralServer:(LXCBPeripheralServer *)peripheral centralDidUnsubscribe:(CBCentral *)central {
+- (void)peripheralServer:(LXCBPeripheralServer *)peripheral
+   centralDidUnsubscribe:(CBCentral *)central
+    chosenCharacteristic:(CBCharacteristic *)characteristic {
+    if ([characteristic.UUID.UUIDString isEqual:TIMELINE_UUID]) {
+        [self.viewController wearableDidUnsubscribe:central];
+        return;
+    }
     [self.viewController centralDidDisconnect];
     
 }
 
+- (BOOL)peripheralServer:(LXCBPeripheralServer *)peripheral
+                 central:(CBCentral *)central
+          didWriteLayout:(NSData *)layout {
+    return [self.viewController wearable:central didWriteLayout:layout];
+}
+
+- (void)peripheralServer:(LXCBPeripheralServer *)peripheral
+                 central:(CBCentral *)central
+     didWriteDiagnostics:(NSData *)record {
+    [self.viewController wearable:central didReportDiagnostics:record];
+}
+
+- (void)peripheralServerIsReadyToUpdateSubscribers:(LXCBPeripheralServer *)peripheral {
+    [self.viewController flushHapticTimelines];
+}
+
 
 @end
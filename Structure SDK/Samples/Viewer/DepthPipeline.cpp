@@ -0,0 +1,122 @@
+//
+//  DepthPipeline.cpp
+//  Perception
+//
+
+#include "DepthPipeline.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace perception {
+
+DepthColorizer::DepthColorizer()
+{
+    for (int i = 0; i <= DEPTH_MAX_SHIFT; i++)
+    {
+        float v = i / (float)DEPTH_MAX_SHIFT;
+        v = powf(v, 3) * 6;
+        _linearize[i] = (uint16_t)(v * 6 * 256);
+    }
+}
+
+void DepthColorizer::linearize(const uint16_t *shift, size_t count, uint16_t *linear) const
+{
+    for (size_t i = 0; i < count; i++)
+        linear[i] = _linearize[std::min<uint16_t>(shift[i], DEPTH_MAX_SHIFT)];
+}
+
+void DepthColorizer::colorize(const uint16_t *shift, size_t count, uint8_t *rgba) const
+{
+    for (size_t i = 0; i < count; i++, rgba += 4)
+    {
+        // We should not get higher values than DEPTH_MAX_SHIFT, but let's
+        // stay on the safe side.
+        int linearizedDepth = _linearize[std::min<uint16_t>(shift[i], DEPTH_MAX_SHIFT)];
+        int lowerByte = linearizedDepth & 0xff;
+        int upperByte = linearizedDepth >> 8;
+
+        uint8_t r, g, b;
+        switch (upperByte)
+        {
+            case 0: r = 255; g = 255 - lowerByte; b = 255 - lowerByte; break;
+            case 1: r = 255; g = lowerByte; b = 0; break;
+            case 2: r = 255 - lowerByte; g = 255; b = 0; break;
+            case 3: r = 0; g = 255; b = lowerByte; break;
+            case 4: r = 0; g = 255 - lowerByte; b = 255; break;
+            case 5: r = 0; g = 0; b = 255 - lowerByte; break;
+            default: r = 0; g = 0; b = 0; break;
+        }
+        rgba[0] = r;
+        rgba[1] = g;
+        rgba[2] = b;
+        rgba[3] = 255;
+    }
+}
+
+NearestDepth findNearestDepth(const float *depthMm, size_t count)
+{
+    NearestDepth nearest;
+    nearest.found = false;
+    nearest.depthMm = 0;
+    nearest.pixel = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // Converting NaN to int is undefined; the phone's ARM cores give 0,
+        // which the test below already skips.
+        float value = depthMm[i];
+        if (isnan(value))
+            continue;
+        int depth = (int)value;
+        if (depth != 0 && (!nearest.found || depth < nearest.depthMm))
+        {
+            nearest.found = true;
+            nearest.depthMm = depth;
+            nearest.pixel = i;
+        }
+    }
+    return nearest;
+}
+
+int depthIntensity(const NearestDepth &nearest)
+{
+    int depth = nearest.depthMm;
+    if (!nearest.found || depth < MIN_DEPTH)
+        return 10;
+    if (depth < MAX_DEPTH / 3)
+        return 9;
+    if (depth < MAX_DEPTH / 2)
+        return 8;
+    if (depth < (2 * MAX_DEPTH) / 3)
+        return 7;
+    if (depth < (5 * MAX_DEPTH) / 6)
+        return 6;
+    if (depth < MAX_DEPTH)
+        return 5;
+    return 0;
+}
+
+HapticZone depthZone(size_t pixel, size_t cols)
+{
+    size_t row = pixel / cols;
+    size_t col = pixel % cols;
+
+    int zone = row < HOR_CENTER_LINE ? HapticZoneTopRight : HapticZoneTopLeft;
+    if (col >= TOP_CNTR_EDGE && col <= BOTTOM_CNTR_EDGE)
+        zone += HapticZoneCenterLeft - HapticZoneTopLeft;
+    else if (col > BOTTOM_CNTR_EDGE)
+        zone += HapticZoneBottomLeft - HapticZoneTopLeft;
+    return (HapticZone)zone;
+}
+
+ZoneFrame depthZones(const NearestDepth &nearest, size_t cols)
+{
+    ZoneFrame zones;
+    memset(&zones, 0, sizeof(zones));
+    int intensity = std::min(std::max(depthIntensity(nearest), 0), MAX_INTENSITY);
+    zones.level[depthZone(nearest.pixel, cols)] = (uint8_t)(intensity * 255 / MAX_INTENSITY);
+    return zones;
+}
+
+} // namespace perception
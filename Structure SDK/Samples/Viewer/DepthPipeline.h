@@ -0,0 +1,79 @@
+//
+//  DepthPipeline.h
+//  Perception
+//
+//  The per-frame work of the Viewer between the sensor and the haptic
+//  router: the shift image colored for display, and the nearest depth of
+//  the frame reduced to one intensity in one zone. Kept apart from the view
+//  controller so tools/pipeline_bench.cpp measures the same code.
+//
+
+#ifndef DepthPipeline_h
+#define DepthPipeline_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "HapticRouter.h"
+
+namespace perception {
+
+// Largest shift value the sensor reports.
+#define DEPTH_MAX_SHIFT 2048
+
+// Zone boundaries in pixels of the 320x240 depth image: columns split it
+// into top, center and bottom, rows into right and left, as seen by the
+// wearer holding the phone in landscape.
+#define TOP_CNTR_EDGE 80
+#define BOTTOM_CNTR_EDGE 140
+#define HOR_CENTER_LINE 120
+
+// Depth range in millimeters mapped onto intensities 5 to MAX_INTENSITY;
+// nothing nearer than MAX_DEPTH leaves the motors off.
+#define MAX_DEPTH 1000
+#define MIN_DEPTH 250
+#define MAX_INTENSITY 10
+
+// Same result as [STDepthAsRgba convertDepthFrameToRgba] with the
+// STDepthToRgbaStrategyRedToBlueGradient strategy, adapted from the
+// libfreenect glview example.
+class DepthColorizer
+{
+public:
+    DepthColorizer();
+
+    // Shift values to depth that varies about linearly with distance, the
+    // upper byte picks a base color and the lower byte blends to the next.
+    void linearize(const uint16_t *shift, size_t count, uint16_t *linear) const;
+
+    // RGBA pixels, from white (closest) through red, yellow, green, cyan and
+    // blue to black (farthest).
+    void colorize(const uint16_t *shift, size_t count, uint8_t *rgba) const;
+
+private:
+    uint16_t _linearize[DEPTH_MAX_SHIFT + 1];
+};
+
+struct NearestDepth
+{
+    bool found;
+    // Whole millimeters, truncated.
+    int depthMm;
+    size_t pixel;
+};
+
+// Nearest pixel with depth; NaN and depths below 1 mm count as none.
+NearestDepth findNearestDepth(const float *depthMm, size_t count);
+
+// 0 (off) to MAX_INTENSITY; a frame without any depth is treated as an
+// obstacle right in front of the sensor.
+int depthIntensity(const NearestDepth &nearest);
+
+HapticZone depthZone(size_t pixel, size_t cols);
+
+// The zone frame of one depth frame: the intensity of the nearest depth in
+// its zone, every other zone off.
+ZoneFrame depthZones(const NearestDepth &nearest, size_t cols);
+
+} // namespace perception
+
+#endif /* DepthPipeline_h */
@@ -0,0 +1,224 @@
+//
+//  HapticRouter.cpp
+//  Perception
+//
+
+#include "HapticRouter.h"
+#include <algorithm>
+#include <string.h>
+
+namespace perception {
+
+WearableLayout WearableLayout::quadrants()
+{
+    WearableLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.motorCount = 4;
+    layout.zoneMask[0] = HAPTIC_ZONE_BIT(HapticZoneTopLeft) | HAPTIC_ZONE_BIT(HapticZoneCenterLeft);
+    layout.zoneMask[1] = HAPTIC_ZONE_BIT(HapticZoneTopRight) | HAPTIC_ZONE_BIT(HapticZoneCenterRight);
+    layout.zoneMask[2] = HAPTIC_ZONE_BIT(HapticZoneBottomLeft) | HAPTIC_ZONE_BIT(HapticZoneCenterLeft);
+    layout.zoneMask[3] = HAPTIC_ZONE_BIT(HapticZoneBottomRight) | HAPTIC_ZONE_BIT(HapticZoneCenterRight);
+    return layout;
+}
+
+bool WearableLayout::decode(const uint8_t *data, size_t length)
+{
+    if (length < HAPTIC_LAYOUT_HEADER_SIZE || data[0] != HAPTIC_LAYOUT_VERSION)
+        return false;
+
+    uint8_t count = data[1];
+    if (count == 0 || count > HAPTIC_BATCH_MAX_MOTORS || length != (size_t)(HAPTIC_LAYOUT_HEADER_SIZE + count))
+        return false;
+
+    for (uint8_t m = 0; m < count; m++)
+    {
+        if (data[HAPTIC_LAYOUT_HEADER_SIZE + m] >> HapticZoneCount)
+            return false;
+    }
+
+    memset(zoneMask, 0, sizeof(zoneMask));
+    memcpy(zoneMask, data + HAPTIC_LAYOUT_HEADER_SIZE, count);
+    motorCount = count;
+    return true;
+}
+
+HapticRouter::HapticRouter(int windowMs, int stepMs, int rampMs)
+    : _windowMs(windowMs), _stepMs(stepMs), _rampMs(std::max(rampMs, 1)), _nextFlush(0)
+{
+}
+
+HapticRouter::Device *HapticRouter::find(DeviceId device)
+{
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        if (_devices[i].id == device)
+            return &_devices[i];
+    }
+    return NULL;
+}
+
+const HapticRouter::Device *HapticRouter::find(DeviceId device) const
+{
+    return const_cast<HapticRouter *>(this)->find(device);
+}
+
+int HapticRouter::capacity(const WearableLayout &layout, uint16_t attMtu) const
+{
+    return std::min<int>(_windowMs / _stepMs + 1, haptic_batch_frames_per_mtu(attMtu, layout.motorCount));
+}
+
+void HapticRouter::addDevice(DeviceId device, const WearableLayout &layout, uint16_t attMtu)
+{
+    Device *entry = find(device);
+    if (!entry)
+    {
+        _devices.push_back(Device());
+        entry = &_devices.back();
+    }
+
+    memset(entry, 0, sizeof(Device));
+    entry->id = device;
+    entry->layout = layout;
+    entry->attMtu = attMtu;
+    entry->framesPerBatch = capacity(layout, attMtu);
+}
+
+void HapticRouter::removeDevice(DeviceId device)
+{
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        if (_devices[i].id == device)
+        {
+            _devices.erase(_devices.begin() + i);
+            if (_nextFlush > i)
+                _nextFlush--;
+            return;
+        }
+    }
+}
+
+bool HapticRouter::setLayout(DeviceId device, const WearableLayout &layout)
+{
+    Device *entry = find(device);
+    if (!entry)
+        return false;
+
+    // The frame capacity depends on the motor count. The wearable starts
+    // from rest with the new motor assignment.
+    addDevice(device, layout, entry->attMtu);
+    return true;
+}
+
+bool HapticRouter::setMtu(DeviceId device, uint16_t attMtu)
+{
+    Device *entry = find(device);
+    if (!entry || entry->attMtu == attMtu)
+        return false;
+
+    // Levels and sequence carry on, only the next timeline changes size.
+    int frames = capacity(entry->layout, attMtu);
+    bool changed = frames != entry->framesPerBatch;
+    entry->attMtu = attMtu;
+    entry->framesPerBatch = frames;
+    return changed;
+}
+
+int HapticRouter::framesPerBatch(DeviceId device) const
+{
+    const Device *entry = find(device);
+    return entry ? entry->framesPerBatch : 0;
+}
+
+void HapticRouter::encode(Device &device, const ZoneFrame &frame, uint32_t baseMs)
+{
+    int frameCount = device.framesPerBatch;
+    device.pending = false;
+    if (frameCount < 1)
+        return;
+
+    for (uint8_t m = 0; m < device.layout.motorCount; m++)
+    {
+        uint8_t target = 0;
+        for (int z = 0; z < HapticZoneCount; z++)
+        {
+            if (device.layout.zoneMask[m] & HAPTIC_ZONE_BIT(z))
+                target = std::max(target, frame.level[z]);
+        }
+        device.target[m] = target;
+    }
+
+    // Spread the window over the frames that fit the link. A single frame
+    // cannot ramp: it sets the target levels at once and the wearable holds
+    // them.
+    int stepMs = frameCount > 1 ? _windowMs / (frameCount - 1) : 0;
+
+    haptic_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.sequence = device.sequence;
+    batch.base_ms = baseMs;
+    batch.motor_count = device.layout.motorCount;
+    batch.frame_count = frameCount;
+
+    for (int f = 0; f < frameCount; f++)
+    {
+        int offsetMs = f * stepMs;
+        int ramp = frameCount > 1 ? std::min(offsetMs, _rampMs) : _rampMs;
+        batch.frames[f].offset_ms = offsetMs;
+        for (uint8_t m = 0; m < device.layout.motorCount; m++)
+        {
+            int delta = device.target[m] - device.level[m];
+            batch.frames[f].intensity[m] = (uint8_t)(device.level[m] + delta * ramp / _rampMs);
+        }
+    }
+
+    device.length = haptic_batch_encode(&batch, device.packet, sizeof(device.packet));
+    device.pending = device.length != 0;
+}
+
+void HapticRouter::update(const ZoneFrame &frame, uint32_t baseMs)
+{
+    for (size_t i = 0; i < _devices.size(); i++)
+        encode(_devices[i], frame, baseMs);
+}
+
+size_t HapticRouter::flush(const Sender &send)
+{
+    size_t sent = 0;
+    size_t count = _devices.size();
+    size_t start = _nextFlush;
+
+    for (size_t n = 0; n < count; n++)
+    {
+        size_t i = (start + n) % count;
+        Device &device = _devices[i];
+        if (!device.pending)
+            continue;
+
+        if (!send(device.id, device.packet, device.length))
+        {
+            // Resume with this device once the radio drained its queue.
+            _nextFlush = i;
+            return sent;
+        }
+
+        // The wearable ramps from these levels on the next timeline.
+        memcpy(device.level, device.target, sizeof(device.level));
+        device.sequence++;
+        device.pending = false;
+        sent++;
+        _nextFlush = (i + 1) % count;
+    }
+    return sent;
+}
+
+bool HapticRouter::hasPending() const
+{
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        if (_devices[i].pending)
+            return true;
+    }
+    return false;
+}
+
+} // namespace perception
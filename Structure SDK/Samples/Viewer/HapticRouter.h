@@ -0,0 +1,134 @@
+//
+//  HapticRouter.h
+//  Perception
+//
+//  Routes one zone frame per depth update to every connected wearable.
+//
+//  The depth pipeline describes what it sees as intensities for a fixed set
+//  of zones around the wearer. Each wearable (belt, wristband, cane handle,
+//  ...) reports its own motor layout: how many motors it has and which
+//  zones drive each motor. On every update the router builds one haptic
+//  timeline per wearable from the same zone frame, encodes it with
+//  haptic_batch.h at the size of that wearable's link, and keeps it in the
+//  wearable's outbox. flush() then hands all pending timelines to the radio
+//  in one pass so they share the next connection events; a newer update
+//  replaces a timeline that was not sent yet.
+//
+
+#ifndef HapticRouter_h
+#define HapticRouter_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include "haptic_batch.h"
+
+namespace perception {
+
+// Zones of the depth image, as seen by the wearer.
+enum HapticZone
+{
+    HapticZoneTopLeft,
+    HapticZoneTopRight,
+    HapticZoneCenterLeft,
+    HapticZoneCenterRight,
+    HapticZoneBottomLeft,
+    HapticZoneBottomRight,
+    HapticZoneCount
+};
+
+#define HAPTIC_ZONE_BIT(zone) (1u << (zone))
+
+// Layout characteristic payload written by a wearable:
+//   version (HAPTIC_LAYOUT_VERSION), motor count M, M zone masks
+#define HAPTIC_LAYOUT_VERSION 1
+#define HAPTIC_LAYOUT_HEADER_SIZE 2
+
+struct WearableLayout
+{
+    uint8_t motorCount;
+    // Zones driving each motor; the motor follows the strongest of them.
+    uint8_t zoneMask[HAPTIC_BATCH_MAX_MOTORS];
+
+    // The original four motor wearable: one motor per quadrant, the center
+    // zones drive both motors on their side.
+    static WearableLayout quadrants();
+
+    // Returns false if the payload is not a valid layout.
+    bool decode(const uint8_t *data, size_t length);
+};
+
+// Zone intensities for one depth update, 0 (off) to 255 (full).
+struct ZoneFrame
+{
+    uint8_t level[HapticZoneCount];
+};
+
+class HapticRouter
+{
+public:
+    typedef uint32_t DeviceId;
+
+    // Returns true if the packet was queued, false if the transmit queue is
+    // full and the flush should stop.
+    typedef std::function<bool(DeviceId device, const uint8_t *data, uint16_t length)> Sender;
+
+    // Timelines span windowMs in steps of stepMs, fewer if the link MTU is
+    // small: the motors ramp to the new levels over rampMs and hold. A link
+    // that fits a single frame gets the new levels as one step.
+    HapticRouter(int windowMs, int stepMs, int rampMs);
+
+    // attMtu is the negotiated ATT MTU of the wearable's link.
+    void addDevice(DeviceId device, const WearableLayout &layout, uint16_t attMtu);
+    void removeDevice(DeviceId device);
+    bool setLayout(DeviceId device, const WearableLayout &layout);
+    size_t deviceCount() const { return _devices.size(); }
+
+    // For an MTU exchange that completes after the subscription. Returns
+    // true if the frames per timeline changed.
+    bool setMtu(DeviceId device, uint16_t attMtu);
+
+    // Frames per timeline of the device, 0 if none fits or it is unknown.
+    int framesPerBatch(DeviceId device) const;
+
+    // Encodes the next timeline of every device into its outbox.
+    void update(const ZoneFrame &frame, uint32_t baseMs);
+
+    // Sends pending timelines, starting after the device served last so a
+    // full queue does not starve the same wearable every time. Returns the
+    // number of timelines sent.
+    size_t flush(const Sender &send);
+    bool hasPending() const;
+
+private:
+    struct Device
+    {
+        DeviceId id;
+        WearableLayout layout;
+        uint16_t attMtu;
+        uint8_t framesPerBatch;
+        // Levels the wearable reached with the last timeline it was sent.
+        uint8_t level[HAPTIC_BATCH_MAX_MOTORS];
+        uint8_t sequence;
+        bool pending;
+        uint8_t target[HAPTIC_BATCH_MAX_MOTORS];
+        uint16_t length;
+        uint8_t packet[HAPTIC_BATCH_SIZE(HAPTIC_BATCH_MAX_FRAMES, HAPTIC_BATCH_MAX_MOTORS)];
+    };
+
+    Device *find(DeviceId device);
+    const Device *find(DeviceId device) const;
+    int capacity(const WearableLayout &layout, uint16_t attMtu) const;
+    void encode(Device &device, const ZoneFrame &frame, uint32_t baseMs);
+
+    int _windowMs;
+    int _stepMs;
+    int _rampMs;
+    size_t _nextFlush;
+    std::vector<Device> _devices;
+};
+
+} // namespace perception
+
+#endif /* HapticRouter_h */
@@ -9,7 +9,13 @@
 // a Bluetooth Peripheral (Server) that contains one primary |service|.
 //
 // The service has four readable |characteristics| that is
-// referenced by distinct UUIDs.
+// referenced by distinct UUIDs, plus a notify-only haptic timeline
+// characteristic that carries encoded haptic batches (see haptic_batch.h)
+// and a writable layout characteristic where each wearable describes its
+// motors (see HapticRouter.h). Several wearables may subscribe at once;
+// timelines are addressed to one central each. Wearables report counters
+// such as their power state residency as write commands to the
+// diagnostics characteristic.
 //
 // Any Bluetooth 4.0 LE Central (aka. Client) that reads to this peripheral
 // will cause a delegate message to be sent. This in turn will allow the
@@ -24,6 +30,9 @@
 @property(nonatomic, strong) CBUUID *vb2UUID;
 @property(nonatomic, strong) CBUUID *vb3UUID;
 @property(nonatomic, strong) CBUUID *vb4UUID;
+@property(nonatomic, strong) CBUUID *timelineUUID;
+@property(nonatomic, strong) CBUUID *layoutUUID;
+@property(nonatomic, strong) CBUUID *diagnosticsUUID;
 
 // Returns YES if Bluetooth 4 LE is supported on this operation system.
 + (BOOL)isBluetoothSupported;
@@ -32,6 +41,14 @@
 
 - (void)sendToSubscribers:(NSData *)data chosenCharacteristic:(CBCharacteristic *)characteristic;
 
+// Largest value that fits one notification to |central|, i.e. the
+// negotiated ATT MTU minus the notification header.
+- (NSUInteger)maximumTimelineLengthForCentral:(CBCentral *)central;
+
+// Notifies one timeline subscriber. Returns NO if the transmit queue is full;
+// peripheralServerIsReadyToUpdateSubscribers: follows once it drained.
+- (BOOL)sendHapticTimeline:(NSData *)data toCentral:(CBCentral *)central;
+
 // Called by the application if it enters the background.
 - (void)applicationDidEnterBackground;
 
@@ -51,6 +68,15 @@
 // Called when the peripheral receives a new subscriber.
 - (void)peripheralServer:(LXCBPeripheralServer *)peripheral centralDidSubscribe:(CBCentral *)central chosenCharacteristic:(CBCharacteristic *)characteristic;
 
-- (void)peripheralServer:(LXCBPeripheralServer *)peripheral centralDidUnsubscribe:(CBCentral *)central;
+- (void)peripheralServer:(LXCBPeripheralServer *)peripheral centralDidUnsubscribe:(CBCentral *)central chosenCharacteristic:(CBCharacteristic *)characteristic;
+
+// Called when a wearable writes its motor layout. Return NO to reject it.
+- (BOOL)peripheralServer:(LXCBPeripheralServer *)peripheral central:(CBCentral *)central didWriteLayout:(NSData *)layout;
+
+// Called for every diagnostics record a wearable writes.
+- (void)peripheralServer:(LXCBPeripheralServer *)peripheral central:(CBCentral *)central didWriteDiagnostics:(NSData *)record;
+
+// Called when the transmit queue has room again after a failed send.
+- (void)peripheralServerIsReadyToUpdateSubscribers:(LXCBPeripheralServer *)peripheral;
 
 @end
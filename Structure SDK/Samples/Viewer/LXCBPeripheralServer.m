@@ -1,7 +1,12 @@
 #import <CoreBluetooth/CoreBluetooth.h>
+#import <QuartzCore/QuartzCore.h>
 #import "LXCBPeripheralServer.h"
 #import "UUIDs.h"
 #import "VIBE_GLOBALS.h"
+#include "time_sync.h"
+
+// ATT_MTU 23 minus the 3 byte notification header.
+static const NSUInteger kDefaultUpdateValueLength = 20;
 
 NSData *vb1Data;
 NSData *vb2Data;
@@ -17,6 +22,9 @@ NSData *vb4Data;
 @property(nonatomic, strong) CBMutableCharacteristic *vb2;
 @property(nonatomic, strong) CBMutableCharacteristic *vb3;
 @property(nonatomic, strong) CBMutableCharacteristic *vb4;
+@property(nonatomic, strong) CBMutableCharacteristic *timeline;
+@property(nonatomic, strong) CBMutableCharacteristic *layout;
+@property(nonatomic, strong) CBMutableCharacteristic *diagnostics;
 @property(nonatomic, assign) BOOL serviceRequiresRegistration;
 @property(nonatomic, strong) CBMutableService *service;
 @property(nonatomic, strong) NSData *pendingData;
@@ -97,9 +105,34 @@ NSData *vb4Data;
                  value:nil
            permissions:CBAttributePermissionsReadable];
 
+  // The haptic timeline is pushed to the wearable, it is never read.
+  self.timeline =
+      [[CBMutableCharacteristic alloc]
+          initWithType:self.timelineUUID
+            properties:CBCharacteristicPropertyNotify
+                 value:nil
+           permissions:CBAttributePermissionsReadable];
+
+  // Each wearable writes its motor layout once after connecting.
+  self.layout =
+      [[CBMutableCharacteristic alloc]
+          initWithType:self.layoutUUID
+            properties:CBCharacteristicPropertyWrite
+                 value:nil
+           permissions:CBAttributePermissionsWriteable];
+
+  // Wearables push diagnostics records without waiting for a response.
+  self.diagnostics =
+      [[CBMutableCharacteristic alloc]
+          initWithType:self.diagnosticsUUID
+            properties:CBCharacteristicPropertyWriteWithoutResponse
+                 value:nil
+           permissions:CBAttributePermissionsWriteable];
+
   // Assign the characteristic.
   self.service.characteristics =
-      [NSArray arrayWithObjects:self.vb1, self.vb2, self.vb3, self.vb4, nil];
+      [NSArray arrayWithObjects:self.vb1, self.vb2, self.vb3, self.vb4,
+                                self.timeline, self.layout, self.diagnostics, nil];
 
   // Add the service to the peripheral manager.
   [self.peripheral addService:self.service];
@@ -162,6 +195,52 @@ NSData *vb4Data;
   }
 }
 
+- (NSUInteger)maximumTimelineLengthForCentral:(CBCentral *)central {
+  // The central requested the MTU exchange on connect; iOS reports the
+  // agreed size through maximumUpdateValueLength (iOS 9 and later).
+  if ([central respondsToSelector:@selector(maximumUpdateValueLength)]) {
+    return central.maximumUpdateValueLength;
+  }
+  return kDefaultUpdateValueLength;
+}
+
+- (BOOL)sendHapticTimeline:(NSData *)data toCentral:(CBCentral *)central {
+  if (data.length > [self maximumTimelineLengthForCentral:central]) {
+    NSLog(@"sendHapticTimeline: %lu bytes exceeds the %lu byte limit",
+          (unsigned long)data.length,
+          (unsigned long)[self maximumTimelineLengthForCentral:central]);
+    return NO;
+  }
+
+  // A timeline that cannot be queued is stale by the time the next one
+  // arrives, so unlike sendToSubscribers it is not buffered here; the
+  // caller keeps only the newest timeline per wearable and retries.
+  return [self.peripheral updateValue:data
+                    forCharacteristic:self.timeline
+                 onSubscribedCentrals:@[central]];
+}
+
+- (void)replyToTimeSync:(NSData *)request
+              receivedAt:(uint64_t)receivedUs
+               toCentral:(CBCentral *)central {
+  // Answered here rather than by the delegate so the turnaround stays short.
+  // The reply shares the timeline characteristic; if it cannot be queued
+  // the wearable's round simply has one sample less.
+  uint8_t reply[TIME_SYNC_REPLY_SIZE];
+  uint64_t sentUs = (uint64_t)(CACurrentMediaTime() * 1e6);
+  uint8_t length = time_sync_encode_reply((const uint8_t *)request.bytes,
+                                          (uint16_t)request.length,
+                                          receivedUs, sentUs,
+                                          reply, sizeof(reply));
+  if (length == 0) {
+    NSLog(@"replyToTimeSync: malformed request %@", request);
+    return;
+  }
+  [self.peripheral updateValue:[NSData dataWithBytes:reply length:length]
+             forCharacteristic:self.timeline
+          onSubscribedCentrals:@[central]];
+}
+
 - (void)applicationDidEnterBackground {
   // Deliberately continue advertising so that it still remains discoverable.
 }
@@ -229,6 +308,10 @@ NSData *vb4Data;
                   central:(CBCentral *)central
 didSubscribeToCharacteristic:(CBCharacteristic *)characteristic {
   NSLog(@"didSubscribe: %@", characteristic.UUID);
+  if ([characteristic.UUID isEqual:self.timelineUUID]) {
+    NSLog(@"didSubscribe: timeline, %lu byte notifications",
+          (unsigned long)[self maximumTimelineLengthForCentral:central]);
+  }
   //LXCBLog(@"didSubscribe: - Central: %@", central.UUID);
   [self.delegate peripheralServer:self centralDidSubscribe:central chosenCharacteristic:characteristic];
 }
@@ -237,7 +320,7 @@ didSubscribeToCharacteristic:(CBCharacteristic *)characteristic {
                   central:(CBCentral *)central
 didUnsubscribeFromCharacteristic:(CBCharacteristic *)characteristic {
   //LXCBLog(@"didUnsubscribe: %@", central.UUID);
-  [self.delegate peripheralServer:self centralDidUnsubscribe:central];
+  [self.delegate peripheralServer:self centralDidUnsubscribe:central chosenCharacteristic:characteristic];
 }
 
 - (void)peripheralManagerDidStartAdvertising:(CBPeripheralManager *)peripheral
@@ -258,6 +341,60 @@ didUnsubscribeFromCharacteristic:(CBCharacteristic *)characteristic {
     self.pendingCharacteristic = nil;
     [self sendToSubscribers:data chosenCharacteristic:characteristic];
   }
+  [self.delegate peripheralServerIsReadyToUpdateSubscribers:self];
+}
+
+- (void)peripheralManager:(CBPeripheralManager *)peripheral
+  didReceiveWriteRequests:(NSArray *)requests {
+  // Stamped first: the wearable's clock sync counts everything after this
+  // as turnaround on the phone.
+  uint64_t receivedUs = (uint64_t)(CACurrentMediaTime() * 1e6);
+
+  // Diagnostics arrive as write commands, which take no response.
+  NSMutableArray *writes = [NSMutableArray arrayWithCapacity:requests.count];
+  for (CBATTRequest *request in requests) {
+    if ([request.characteristic.UUID isEqual:self.diagnostics.UUID]) {
+      const uint8_t *bytes = (const uint8_t *)request.value.bytes;
+      if (request.value.length && bytes[0] == TIME_SYNC_REQUEST) {
+        [self replyToTimeSync:request.value
+                    receivedAt:receivedUs
+                     toCentral:request.central];
+        continue;
+      }
+      [self.delegate peripheralServer:self
+                              central:request.central
+                  didWriteDiagnostics:request.value];
+    } else {
+      [writes addObject:request];
+    }
+  }
+  if (writes.count == 0) {
+    return;
+  }
+  requests = writes;
+
+  // The requests are handled as a whole: one response, for the first one.
+  for (CBATTRequest *request in requests) {
+    if (![request.characteristic.UUID isEqual:self.layout.UUID]) {
+      [peripheral respondToRequest:requests.firstObject
+                        withResult:CBATTErrorWriteNotPermitted];
+      return;
+    }
+    if (request.offset != 0) {
+      [peripheral respondToRequest:requests.firstObject
+                        withResult:CBATTErrorInvalidOffset];
+      return;
+    }
+    if (![self.delegate peripheralServer:self
+                                 central:request.central
+                          didWriteLayout:request.value]) {
+      NSLog(@"didReceiveWriteRequests: rejected layout %@", request.value);
+      [peripheral respondToRequest:requests.firstObject
+                        withResult:CBATTErrorInvalidAttributeValueLength];
+      return;
+    }
+  }
+  [peripheral respondToRequest:requests.firstObject withResult:CBATTErrorSuccess];
 }
 
 - (void)peripheralManager:(CBPeripheralManager *)peripheral
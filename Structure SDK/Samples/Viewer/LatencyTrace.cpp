@@ -0,0 +1,157 @@
+//
+//  LatencyTrace.cpp
+//  Perception
+//
+
+#include "LatencyTrace.h"
+#include <stdio.h>
+#include <string.h>
+#include "haptic_batch.h"
+
+namespace perception {
+
+static long long micros(double seconds)
+{
+    return (long long)(seconds * 1e6 + (seconds < 0 ? -0.5 : 0.5));
+}
+
+LatencyTrace::LatencyTrace()
+    : _nextFrame(0)
+{
+    memset(_frames, 0, sizeof(_frames));
+}
+
+void LatencyTrace::frameProcessed(double capture, double processStart, double processEnd, uint32_t baseMs)
+{
+    Frame &frame = _frames[_nextFrame];
+    frame.valid = true;
+    frame.baseMs = baseMs;
+    frame.capture = capture;
+    frame.processStart = processStart;
+    frame.processEnd = processEnd;
+    _nextFrame = (_nextFrame + 1) % FrameSlots;
+}
+
+LatencyTrace::Batch *LatencyTrace::batch(uint32_t device, const uint8_t *packet, uint16_t length)
+{
+    if (length < HAPTIC_BATCH_HEADER_SIZE || packet[0] != HAPTIC_BATCH_VERSION)
+        return NULL;
+
+    Device *entry = NULL;
+    for (size_t i = 0; i < _devices.size() && !entry; i++)
+    {
+        if (_devices[i].id == device)
+            entry = &_devices[i];
+    }
+    if (!entry)
+    {
+        _devices.push_back(Device());
+        entry = &_devices.back();
+        memset(entry, 0, sizeof(Device));
+        entry->id = device;
+    }
+
+    uint8_t sequence = packet[1];
+    uint32_t baseMs = packet[2] | (packet[3] << 8) | (packet[4] << 16) | ((uint32_t)packet[5] << 24);
+    Batch &slot = entry->batches[sequence % BatchSlots];
+    if (!slot.valid || slot.sequence != sequence || slot.baseMs != baseMs)
+    {
+        memset(&slot, 0, sizeof(slot));
+        slot.valid = true;
+        slot.sequence = sequence;
+        slot.baseMs = baseMs;
+    }
+    return &slot;
+}
+
+void LatencyTrace::enqueued(uint32_t device, const uint8_t *packet, uint16_t length, double now)
+{
+    Batch *slot = batch(device, packet, length);
+    if (slot && slot->enqueue == 0)
+        slot->enqueue = now;
+}
+
+void LatencyTrace::sent(uint32_t device, const uint8_t *packet, uint16_t length, double now)
+{
+    Batch *slot = batch(device, packet, length);
+    if (slot)
+    {
+        if (slot->enqueue == 0)
+            slot->enqueue = now;
+        slot->sent = now;
+    }
+}
+
+bool LatencyTrace::echoed(uint32_t device, const latency_echo_entry_t &echo, LatencySample &sample)
+{
+    const Batch *slot = NULL;
+    for (size_t i = 0; i < _devices.size() && !slot; i++)
+    {
+        if (_devices[i].id == device)
+            slot = &_devices[i].batches[echo.sequence % BatchSlots];
+    }
+    if (!slot || !slot->valid || slot->sequence != echo.sequence || slot->sent == 0)
+        return false;
+
+    const Frame *frame = NULL;
+    for (size_t i = 0; i < FrameSlots && !frame; i++)
+    {
+        if (_frames[i].valid && _frames[i].baseMs == slot->baseMs)
+            frame = &_frames[i];
+    }
+    if (!frame)
+        return false;
+
+    sample.device = device;
+    sample.sequence = echo.sequence;
+    sample.flags = echo.flags;
+    sample.capture = frame->capture;
+    sample.processStart = frame->processStart;
+    sample.processEnd = frame->processEnd;
+    sample.enqueue = slot->enqueue;
+    sample.sent = slot->sent;
+    sample.arrival = echo.arrival_us * 1e-6;
+    sample.actuation = sample.arrival + echo.actuation_us * 1e-6;
+    return true;
+}
+
+void LatencyTrace::removeDevice(uint32_t device)
+{
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        if (_devices[i].id == device)
+        {
+            _devices.erase(_devices.begin() + i);
+            return;
+        }
+    }
+}
+
+int LatencyTrace::format(const LatencySample &sample, char *buffer, size_t length)
+{
+    int written = snprintf(buffer, length,
+                           "LATENCY seq=%u flags=%u start=%lld end=%lld enqueue=%lld sent=%lld",
+                           sample.sequence, sample.flags,
+                           micros(sample.processStart - sample.capture),
+                           micros(sample.processEnd - sample.capture),
+                           micros(sample.enqueue - sample.capture),
+                           micros(sample.sent - sample.capture));
+    if (written < 0 || (size_t)written >= length)
+        return written;
+
+    // Without the phone clock only the wearable's own span is known.
+    if (sample.flags & LATENCY_ECHO_FLAG_SYNCED)
+    {
+        written += snprintf(buffer + written, length - written, " arrival=%lld actuation=%lld",
+                            micros(sample.arrival - sample.capture),
+                            micros(sample.actuation - sample.capture));
+    }
+    else
+    {
+        written += snprintf(buffer + written, length - written, " hold=%lld",
+                            micros(sample.actuation - sample.arrival));
+    }
+    return written;
+}
+
+} // namespace perception
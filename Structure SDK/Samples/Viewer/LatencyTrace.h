@@ -0,0 +1,106 @@
+//
+//  LatencyTrace.h
+//  Perception
+//
+//  Follows depth frames from the sensor to the motors. The Viewer stamps
+//  each frame when it was captured, when processing started and ended and,
+//  per wearable, when its timeline was first offered to the radio and when
+//  the notification was accepted. The wearable echoes when a sampled
+//  timeline arrived and when its first frame was played (latency_echo.h);
+//  the echo completes the trace of that frame.
+//
+//  Timelines are matched to their frame by the base time the router
+//  stamped them with, echoes to their timeline by device and batch
+//  sequence. Only the last few frames and timelines are kept, a late echo
+//  finds nothing and is dropped.
+//
+
+#ifndef LatencyTrace_h
+#define LatencyTrace_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "latency_echo.h"
+
+namespace perception {
+
+// One frame on its way to one wearable. Times are seconds on the phone
+// uptime clock (CACurrentMediaTime), as is the depth frame timestamp.
+struct LatencySample
+{
+    uint32_t device;
+    uint8_t sequence;
+    // LATENCY_ECHO_FLAG_* of the echo.
+    uint8_t flags;
+    double capture;
+    double processStart;
+    double processEnd;
+    double enqueue;
+    double sent;
+    // On the phone clock only with LATENCY_ECHO_FLAG_SYNCED.
+    double arrival;
+    double actuation;
+};
+
+class LatencyTrace
+{
+public:
+    LatencyTrace();
+
+    // A frame was turned into timelines stamped with baseMs.
+    void frameProcessed(double capture, double processStart, double processEnd, uint32_t baseMs);
+
+    // The timeline packet was offered to the radio; only the first attempt
+    // of a packet counts.
+    void enqueued(uint32_t device, const uint8_t *packet, uint16_t length, double now);
+
+    // The radio accepted the timeline packet.
+    void sent(uint32_t device, const uint8_t *packet, uint16_t length, double now);
+
+    // Returns true and the whole trace if the echo matches a timeline.
+    bool echoed(uint32_t device, const latency_echo_entry_t &echo, LatencySample &sample);
+
+    void removeDevice(uint32_t device);
+
+    // Log line of a sample: "LATENCY seq=... flags=..." followed by the
+    // stages in microseconds since capture, see tools/latency_report.cpp.
+    static int format(const LatencySample &sample, char *buffer, size_t length);
+
+private:
+    enum { FrameSlots = 16, BatchSlots = 32 };
+
+    struct Frame
+    {
+        bool valid;
+        uint32_t baseMs;
+        double capture;
+        double processStart;
+        double processEnd;
+    };
+
+    struct Batch
+    {
+        bool valid;
+        uint8_t sequence;
+        uint32_t baseMs;
+        double enqueue;
+        double sent;
+    };
+
+    struct Device
+    {
+        uint32_t id;
+        Batch batches[BatchSlots];
+    };
+
+    Batch *batch(uint32_t device, const uint8_t *packet, uint16_t length);
+
+    Frame _frames[FrameSlots];
+    size_t _nextFrame;
+    std::vector<Device> _devices;
+};
+
+} // namespace perception
+
+#endif /* LatencyTrace_h */
@@ -0,0 +1,159 @@
+//
+//  SessionFormat.h
+//  Perception
+//
+//  Layout of a recorded session: every depth frame, IMU sample, zone frame
+//  and haptic timeline of a Viewer run, so the haptic pipeline can be
+//  replayed and measured without a Structure Sensor.
+//
+//  file     SessionFileHeader, chunks, index, SessionFooter
+//  chunk    SessionChunkHeader, then the records, deflated as a whole when
+//           SessionChunkDeflate is set
+//  record   SessionRecordHeader, then the payload of its type
+//  index    one SessionIndexEntry per chunk
+//
+//  Records appear in the order they were written; timestamps are seconds
+//  on the device's uptime clock (CACurrentMediaTime). Chunks, records and
+//  depth planes start on SESSION_ALIGN byte boundaries so a reader can use
+//  the planes of an uncompressed chunk straight from a memory mapping. All
+//  fields are little endian, the byte order of both the phone and the
+//  hosts the tools run on, so the structures are written as they are.
+//
+//  A recording that was not closed has no index; readers rebuild it by
+//  walking the chunk headers up to the last complete chunk.
+//
+
+#ifndef SessionFormat_h
+#define SessionFormat_h
+
+#include <stdint.h>
+
+namespace perception {
+
+#define SESSION_MAGIC 0x53455350u          // "PSES"
+#define SESSION_CHUNK_MAGIC 0x4b4e4843u    // "CHNK"
+#define SESSION_FOOTER_MAGIC 0x444e4550u   // "PEND"
+#define SESSION_VERSION 1
+#define SESSION_ALIGN 8
+
+// Records buffered before a chunk is written, about a dozen raw depth
+// frames; a chunk is the unit of compression and of random access.
+#define SESSION_CHUNK_BYTES (4u << 20)
+
+#define SESSION_ALIGNED(size) (((size) + SESSION_ALIGN - 1) & ~(uint32_t)(SESSION_ALIGN - 1))
+
+enum SessionRecordType
+{
+    SessionRecordDepth = 1,
+    SessionRecordImu,
+    SessionRecordZones,
+    SessionRecordHaptic
+};
+
+enum SessionDepthEncoding
+{
+    SessionDepthRaw = 0,
+    // Planes hold the difference to the pixel on the left, which deflates
+    // about twice as well as the values.
+    SessionDepthDelta
+};
+
+enum SessionChunkFlags
+{
+    SessionChunkDeflate = 1
+};
+
+struct SessionFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t flags;
+    // Most bytes of records in a chunk, unless it holds a single record.
+    uint32_t chunkBytes;
+    // Wall clock time the recording started, seconds since 1970.
+    double created;
+    uint64_t reserved;
+};
+
+struct SessionChunkHeader
+{
+    uint32_t magic;
+    uint32_t flags;
+    // Bytes following this header in the file, a multiple of SESSION_ALIGN.
+    uint32_t storedSize;
+    // Bytes of records once inflated.
+    uint32_t rawSize;
+    uint32_t recordCount;
+    uint32_t reserved;
+    double firstTimestamp;
+    double lastTimestamp;
+};
+
+struct SessionRecordHeader
+{
+    uint8_t type;
+    // SessionDepthEncoding for depth records, 0 otherwise.
+    uint8_t encoding;
+    uint16_t reserved;
+    // Payload bytes, padded to SESSION_ALIGN in the chunk.
+    uint32_t size;
+    double timestamp;
+};
+
+// Depth payload: this header, then width * height depth values in whole
+// millimeters (0 where the sensor has none), then as many raw shift values,
+// each plane padded to SESSION_ALIGN.
+struct SessionDepthHeader
+{
+    uint16_t width;
+    uint16_t height;
+    uint32_t reserved;
+};
+
+// IMU payload: acceleration including gravity in g, rotation rate in rad/s,
+// device axes as reported by Core Motion.
+struct SessionImuSample
+{
+    float accel[3];
+    float gyro[3];
+};
+
+// Zones payload: zone count, then one level per zone (HapticRouter.h).
+
+// Haptic payload: this header, then the haptic_batch.h packet as queued for
+// the wearable.
+struct SessionHapticHeader
+{
+    uint32_t device;
+    uint16_t length;
+    uint16_t reserved;
+};
+
+struct SessionIndexEntry
+{
+    // File offset of the SessionChunkHeader.
+    uint64_t offset;
+    uint32_t storedSize;
+    uint32_t recordCount;
+    double firstTimestamp;
+    double lastTimestamp;
+};
+
+struct SessionFooter
+{
+    uint64_t indexOffset;
+    uint32_t chunkCount;
+    uint32_t magic;
+};
+
+static_assert(sizeof(SessionFileHeader) == 32, "session file header layout");
+static_assert(sizeof(SessionChunkHeader) == 40, "session chunk header layout");
+static_assert(sizeof(SessionRecordHeader) == 16, "session record header layout");
+static_assert(sizeof(SessionDepthHeader) == 8, "session depth header layout");
+static_assert(sizeof(SessionIndexEntry) == 32, "session index entry layout");
+static_assert(sizeof(SessionFooter) == 16, "session footer layout");
+
+} // namespace perception
+
+#endif /* SessionFormat_h */
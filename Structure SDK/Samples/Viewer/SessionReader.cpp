@@ -0,0 +1,310 @@
+//
+//  SessionReader.cpp
+//  Perception
+//
+
+#include "SessionReader.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace perception {
+
+static const size_t kNoChunk = (size_t)-1;
+
+// Deflate cannot shrink data more than about 1032 to 1.
+static const uint64_t kMaxDeflateRatio = 1032;
+
+// Undoes the left neighbour differences of the writer.
+static void deltaDecode(uint16_t *plane, uint16_t width, uint16_t height)
+{
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint16_t *row = plane + (size_t)y * width;
+        for (uint32_t x = 1; x < width; x++)
+            row[x] = (uint16_t)(row[x] + row[x - 1]);
+    }
+}
+
+SessionReader::SessionReader()
+    : _fd(-1), _data(NULL), _size(0), _recovered(false), _inflatedChunk(kNoChunk)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+SessionReader::~SessionReader()
+{
+    close();
+}
+
+bool SessionReader::open(const char *path)
+{
+    close();
+
+    _fd = ::open(path, O_RDONLY);
+    if (_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || (size_t)st.st_size < sizeof(SessionFileHeader))
+    {
+        close();
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    _data = (const uint8_t *)data;
+    _size = (size_t)st.st_size;
+
+    memcpy(&_header, _data, sizeof(_header));
+    if (_header.magic != SESSION_MAGIC || _header.version != SESSION_VERSION ||
+        _header.headerSize < sizeof(_header) || _header.headerSize % SESSION_ALIGN)
+    {
+        close();
+        return false;
+    }
+
+    _recovered = !readIndex();
+    if (_recovered)
+        rebuildIndex();
+    return true;
+}
+
+void SessionReader::close()
+{
+    if (_data)
+        munmap((void *)_data, _size);
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+    _data = NULL;
+    _size = 0;
+    _recovered = false;
+    _index.clear();
+    _inflatedChunk = kNoChunk;
+    _inflated.clear();
+}
+
+bool SessionReader::readIndex()
+{
+    SessionFooter footer;
+    if (_size < _header.headerSize + sizeof(footer))
+        return false;
+
+    memcpy(&footer, _data + _size - sizeof(footer), sizeof(footer));
+    if (footer.magic != SESSION_FOOTER_MAGIC ||
+        footer.indexOffset < _header.headerSize ||
+        footer.indexOffset + (uint64_t)footer.chunkCount * sizeof(SessionIndexEntry) + sizeof(footer) != _size)
+        return false;
+
+    _index.resize(footer.chunkCount);
+    if (footer.chunkCount)
+        memcpy(&_index[0], _data + footer.indexOffset, footer.chunkCount * sizeof(SessionIndexEntry));
+
+    for (size_t i = 0; i < _index.size(); i++)
+    {
+        SessionChunkHeader header;
+        if (!readChunkHeader(_index[i].offset, footer.indexOffset, header) ||
+            header.storedSize != _index[i].storedSize)
+        {
+            _index.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SessionReader::readChunkHeader(uint64_t offset, uint64_t end, SessionChunkHeader &header) const
+{
+    if (offset % SESSION_ALIGN || end > _size || offset > end || end - offset < sizeof(header))
+        return false;
+
+    memcpy(&header, _data + offset, sizeof(header));
+    if (header.magic != SESSION_CHUNK_MAGIC || header.storedSize % SESSION_ALIGN ||
+        offset + sizeof(header) + header.storedSize > end)
+        return false;
+
+    // Records of a raw chunk are stored as they are. The writer starts a
+    // new chunk rather than grow one past chunkBytes, unless a single record
+    // is larger, so a damaged header cannot have the reader inflate
+    // gigabytes.
+    if (!(header.flags & SessionChunkDeflate))
+        return header.rawSize == header.storedSize;
+    if (header.rawSize > _header.chunkBytes && header.recordCount != 1)
+        return false;
+    return header.rawSize <= header.storedSize * kMaxDeflateRatio;
+}
+
+void SessionReader::rebuildIndex()
+{
+    _index.clear();
+
+    uint64_t offset = _header.headerSize;
+    SessionChunkHeader header;
+    while (readChunkHeader(offset, _size, header))
+    {
+        SessionIndexEntry entry;
+        entry.offset = offset;
+        entry.storedSize = header.storedSize;
+        entry.recordCount = header.recordCount;
+        entry.firstTimestamp = header.firstTimestamp;
+        entry.lastTimestamp = header.lastTimestamp;
+        _index.push_back(entry);
+        offset += sizeof(header) + header.storedSize;
+    }
+}
+
+double SessionReader::firstTimestamp() const
+{
+    return _index.empty() ? 0 : _index.front().firstTimestamp;
+}
+
+double SessionReader::lastTimestamp() const
+{
+    return _index.empty() ? 0 : _index.back().lastTimestamp;
+}
+
+SessionReader::Cursor SessionReader::begin() const
+{
+    Cursor cursor = { 0, 0 };
+    return cursor;
+}
+
+SessionReader::Cursor SessionReader::seek(double timestamp)
+{
+    // Last chunk starting at or before the timestamp.
+    size_t low = 0;
+    size_t high = _index.size();
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (_index[mid].firstTimestamp <= timestamp)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    Cursor cursor = { low ? low - 1 : 0, 0 };
+    Cursor at = cursor;
+    SessionRecord record;
+    while (next(cursor, record))
+    {
+        if (record.timestamp >= timestamp)
+            return at;
+        at = cursor;
+    }
+    return cursor;
+}
+
+const uint8_t *SessionReader::loadChunk(size_t chunk, uint32_t &size)
+{
+    const SessionIndexEntry &entry = _index[chunk];
+    SessionChunkHeader header;
+    if (!readChunkHeader(entry.offset, _size, header) || header.storedSize != entry.storedSize)
+        return NULL;
+    const uint8_t *stored = _data + entry.offset + sizeof(header);
+
+    if (!(header.flags & SessionChunkDeflate))
+    {
+        size = header.storedSize;
+        return stored;
+    }
+
+    if (_inflatedChunk != chunk)
+    {
+        _inflatedChunk = kNoChunk;
+        _inflated.resize(SESSION_ALIGNED(header.rawSize));
+        uLongf inflatedSize = header.rawSize;
+        if (uncompress(&_inflated[0], &inflatedSize, stored, header.storedSize) != Z_OK ||
+            inflatedSize != header.rawSize)
+            return NULL;
+        _inflatedChunk = chunk;
+    }
+    size = header.rawSize;
+    return &_inflated[0];
+}
+
+bool SessionReader::next(Cursor &cursor, SessionRecord &record)
+{
+    while (cursor.chunk < _index.size())
+    {
+        uint32_t size;
+        const uint8_t *records = loadChunk(cursor.chunk, size);
+        if (!records)
+            return false;
+
+        if (cursor.offset + sizeof(SessionRecordHeader) > size)
+        {
+            cursor.chunk++;
+            cursor.offset = 0;
+            continue;
+        }
+
+        SessionRecordHeader header;
+        memcpy(&header, records + cursor.offset, sizeof(header));
+        uint32_t payload = cursor.offset + sizeof(header);
+        if (header.size > size - payload)
+            return false;
+
+        record.type = (SessionRecordType)header.type;
+        record.encoding = header.encoding;
+        record.timestamp = header.timestamp;
+        record.payload = records + payload;
+        record.size = header.size;
+        cursor.offset = payload + SESSION_ALIGNED(header.size);
+        return true;
+    }
+    return false;
+}
+
+bool SessionReader::depth(const SessionRecord &record, SessionDepthView &view)
+{
+    if (record.type != SessionRecordDepth || record.size < sizeof(SessionDepthHeader))
+        return false;
+
+    // Two planes of 65535 x 65535 values do not fit 32 bits; sized in 64
+    // bits and checked against the record before anything is read.
+    SessionDepthHeader header;
+    memcpy(&header, record.payload, sizeof(header));
+    uint64_t pixels = (uint64_t)header.width * header.height;
+    uint64_t planeSize = (pixels * sizeof(uint16_t) + SESSION_ALIGN - 1) & ~(uint64_t)(SESSION_ALIGN - 1);
+    if (sizeof(header) + 2 * planeSize > record.size)
+        return false;
+
+    const uint16_t *depthMm = (const uint16_t *)(record.payload + sizeof(header));
+    const uint16_t *shift = (const uint16_t *)(record.payload + sizeof(header) + planeSize);
+    view.width = header.width;
+    view.height = header.height;
+
+    if (record.encoding == SessionDepthRaw)
+    {
+        view.depthMm = depthMm;
+        view.shift = shift;
+        return true;
+    }
+    if (record.encoding != SessionDepthDelta)
+        return false;
+
+    _depthPlanes.resize(2 * (size_t)pixels);
+    uint16_t *planes = _depthPlanes.empty() ? NULL : &_depthPlanes[0];
+    if (planes)
+    {
+        memcpy(planes, depthMm, (size_t)pixels * sizeof(uint16_t));
+        memcpy(planes + pixels, shift, (size_t)pixels * sizeof(uint16_t));
+        deltaDecode(planes, header.width, header.height);
+        deltaDecode(planes + pixels, header.width, header.height);
+    }
+    view.depthMm = planes;
+    view.shift = planes + pixels;
+    return true;
+}
+
+} // namespace perception
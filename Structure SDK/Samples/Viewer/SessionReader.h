@@ -0,0 +1,110 @@
+//
+//  SessionReader.h
+//  Perception
+//
+//  Reads a recording of SessionFormat.h through a read-only memory mapping.
+//  The chunk index gives random access by time; the records of an
+//  uncompressed chunk, depth planes included, are used in place without a
+//  copy. A deflated chunk is inflated into a buffer of the reader once,
+//  when the first of its records is reached.
+//
+//  POSIX C++ without Apple frameworks, for the replay tools on a host.
+//
+
+#ifndef SessionReader_h
+#define SessionReader_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "SessionFormat.h"
+
+namespace perception {
+
+struct SessionRecord
+{
+    SessionRecordType type;
+    uint8_t encoding;
+    double timestamp;
+    const uint8_t *payload;
+    uint32_t size;
+};
+
+struct SessionDepthView
+{
+    uint16_t width;
+    uint16_t height;
+    // Whole millimeters, 0 where there is no depth.
+    const uint16_t *depthMm;
+    const uint16_t *shift;
+};
+
+class SessionReader
+{
+public:
+    // Position of the next record to read.
+    struct Cursor
+    {
+        size_t chunk;
+        uint32_t offset;
+    };
+
+    SessionReader();
+    ~SessionReader();
+
+    // Returns false if the file cannot be mapped or is not a recording.
+    bool open(const char *path);
+    void close();
+    bool isOpen() const { return _data != NULL; }
+
+    // The recording was not closed; the index was rebuilt up to the last
+    // complete chunk.
+    bool recovered() const { return _recovered; }
+
+    const SessionFileHeader &header() const { return _header; }
+    size_t fileSize() const { return _size; }
+    size_t chunkCount() const { return _index.size(); }
+    const SessionIndexEntry &chunk(size_t chunk) const { return _index[chunk]; }
+    double firstTimestamp() const;
+    double lastTimestamp() const;
+
+    Cursor begin() const;
+
+    // Cursor at the first record at or after timestamp, found with a binary
+    // search over the index.
+    Cursor seek(double timestamp);
+
+    // Reads the record at the cursor and moves past it. The payload stays
+    // valid until a record of another deflated chunk is read. Returns false
+    // at the end of the recording or on a damaged chunk.
+    bool next(Cursor &cursor, SessionRecord &record);
+
+    // Planes of a depth record; delta coded planes are decoded into a
+    // buffer of the reader that the next call reuses.
+    bool depth(const SessionRecord &record, SessionDepthView &view);
+
+private:
+    bool readIndex();
+    void rebuildIndex();
+    // Reads the chunk header at offset and checks it describes a chunk
+    // that ends by end.
+    bool readChunkHeader(uint64_t offset, uint64_t end, SessionChunkHeader &header) const;
+    const uint8_t *loadChunk(size_t chunk, uint32_t &size);
+
+    int _fd;
+    const uint8_t *_data;
+    size_t _size;
+    bool _recovered;
+    SessionFileHeader _header;
+    std::vector<SessionIndexEntry> _index;
+
+    // Inflated records of the deflated chunk read last.
+    size_t _inflatedChunk;
+    std::vector<uint8_t> _inflated;
+
+    std::vector<uint16_t> _depthPlanes;
+};
+
+} // namespace perception
+
+#endif /* SessionReader_h */
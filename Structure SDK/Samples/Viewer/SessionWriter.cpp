@@ -0,0 +1,261 @@
+//
+//  SessionWriter.cpp
+//  Perception
+//
+
+#include "SessionWriter.h"
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+namespace perception {
+
+// Each value becomes the difference to its left neighbour, in place.
+static void deltaEncode(uint16_t *plane, uint16_t width, uint16_t height)
+{
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint16_t *row = plane + (size_t)y * width;
+        for (uint32_t x = width; x > 1; x--)
+            row[x - 1] = (uint16_t)(row[x - 1] - row[x - 2]);
+    }
+}
+
+SessionWriter::SessionWriter()
+    : _file(NULL), _compressDepth(false), _failed(false), _chunkBytes(SESSION_CHUNK_BYTES),
+      _offset(0), _rawBytes(0), _recordCount(0), _chunkRecords(0),
+      _firstTimestamp(0), _lastTimestamp(0)
+{
+}
+
+SessionWriter::~SessionWriter()
+{
+    close();
+}
+
+bool SessionWriter::open(const char *path, bool compressDepth, uint32_t chunkBytes)
+{
+    close();
+
+    _file = fopen(path, "wb");
+    if (!_file)
+        return false;
+
+    _compressDepth = compressDepth;
+    _failed = false;
+    _chunkBytes = chunkBytes;
+    _offset = 0;
+    _rawBytes = 0;
+    _recordCount = 0;
+    _chunk.clear();
+    _chunk.reserve(chunkBytes + (chunkBytes >> 2));
+    _chunkRecords = 0;
+    _index.clear();
+
+    SessionFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SESSION_MAGIC;
+    header.version = SESSION_VERSION;
+    header.headerSize = sizeof(header);
+    header.flags = compressDepth ? SessionChunkDeflate : 0;
+    header.chunkBytes = chunkBytes;
+    header.created = (double)time(NULL);
+    return writeBytes(&header, sizeof(header));
+}
+
+bool SessionWriter::close()
+{
+    if (!_file)
+        return false;
+
+    writeChunk();
+
+    SessionFooter footer;
+    footer.indexOffset = _offset;
+    footer.chunkCount = (uint32_t)_index.size();
+    footer.magic = SESSION_FOOTER_MAGIC;
+    if (!_index.empty())
+        writeBytes(&_index[0], _index.size() * sizeof(SessionIndexEntry));
+    writeBytes(&footer, sizeof(footer));
+
+    if (fclose(_file) != 0)
+        _failed = true;
+    _file = NULL;
+    _index.clear();
+    return !_failed;
+}
+
+bool SessionWriter::writeBytes(const void *data, size_t size)
+{
+    if (_failed || fwrite(data, 1, size, _file) != size)
+    {
+        _failed = true;
+        return false;
+    }
+    _offset += size;
+    return true;
+}
+
+uint8_t *SessionWriter::beginRecord(SessionRecordType type, uint8_t encoding, double timestamp, uint32_t size)
+{
+    if (!_file || _failed)
+        return NULL;
+
+    // A chunk only grows past chunkBytes with a single record, which bounds
+    // what a reader inflates.
+    if (_chunkRecords && _chunk.size() + sizeof(SessionRecordHeader) + SESSION_ALIGNED(size) > _chunkBytes &&
+        !writeChunk())
+        return NULL;
+
+    SessionRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = type;
+    header.encoding = encoding;
+    header.size = size;
+    header.timestamp = timestamp;
+
+    size_t start = _chunk.size();
+    _chunk.resize(start + sizeof(header) + SESSION_ALIGNED(size), 0);
+    memcpy(&_chunk[start], &header, sizeof(header));
+
+    if (_chunkRecords == 0)
+        _firstTimestamp = timestamp;
+    _lastTimestamp = timestamp;
+    _chunkRecords++;
+    _recordCount++;
+    return &_chunk[start + sizeof(header)];
+}
+
+bool SessionWriter::endRecord()
+{
+    if (_chunk.size() < _chunkBytes)
+        return !_failed;
+    return writeChunk();
+}
+
+bool SessionWriter::writeChunk()
+{
+    if (_chunkRecords == 0)
+        return !_failed;
+
+    SessionChunkHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SESSION_CHUNK_MAGIC;
+    header.rawSize = (uint32_t)_chunk.size();
+    header.recordCount = _chunkRecords;
+    header.firstTimestamp = _firstTimestamp;
+    header.lastTimestamp = _lastTimestamp;
+
+    const uint8_t *data = &_chunk[0];
+    uint32_t size = header.rawSize;
+    if (_compressDepth)
+    {
+        // The fastest level keeps up with the sensor on the phone; the
+        // delta filter does most of the work on depth.
+        uLongf deflatedSize = compressBound(size);
+        _deflated.resize(SESSION_ALIGNED((uint32_t)deflatedSize));
+        if (compress2(&_deflated[0], &deflatedSize, data, size, Z_BEST_SPEED) == Z_OK &&
+            deflatedSize < size)
+        {
+            header.flags |= SessionChunkDeflate;
+            memset(&_deflated[deflatedSize], 0, _deflated.size() - deflatedSize);
+            data = &_deflated[0];
+            size = (uint32_t)deflatedSize;
+        }
+    }
+    header.storedSize = SESSION_ALIGNED(size);
+
+    SessionIndexEntry entry;
+    entry.offset = _offset;
+    entry.storedSize = header.storedSize;
+    entry.recordCount = header.recordCount;
+    entry.firstTimestamp = header.firstTimestamp;
+    entry.lastTimestamp = header.lastTimestamp;
+
+    // Raw chunks are padded already, every record is.
+    writeBytes(&header, sizeof(header));
+    writeBytes(data, header.storedSize);
+    if (!_failed)
+        _index.push_back(entry);
+
+    _rawBytes += header.rawSize;
+    _chunk.clear();
+    _chunkRecords = 0;
+    return !_failed;
+}
+
+bool SessionWriter::writeDepth(double timestamp, uint16_t width, uint16_t height,
+                               const float *depthMm, const uint16_t *shift)
+{
+    // A record holds at most 4 GB, less than two planes of the largest
+    // frame the header can describe.
+    uint32_t pixels = (uint32_t)width * height;
+    if ((uint64_t)pixels * sizeof(uint16_t) > (UINT32_MAX - sizeof(SessionDepthHeader)) / 2 - SESSION_ALIGN)
+        return false;
+    uint32_t planeSize = SESSION_ALIGNED(pixels * (uint32_t)sizeof(uint16_t));
+    uint8_t encoding = _compressDepth ? SessionDepthDelta : SessionDepthRaw;
+    uint8_t *payload = beginRecord(SessionRecordDepth, encoding, timestamp,
+                                   sizeof(SessionDepthHeader) + 2 * planeSize);
+    if (!payload)
+        return false;
+
+    SessionDepthHeader header;
+    memset(&header, 0, sizeof(header));
+    header.width = width;
+    header.height = height;
+    memcpy(payload, &header, sizeof(header));
+
+    uint16_t *depthPlane = (uint16_t *)(payload + sizeof(header));
+    uint16_t *shiftPlane = (uint16_t *)(payload + sizeof(header) + planeSize);
+    for (uint32_t i = 0; i < pixels; i++)
+    {
+        // Truncated like the pipeline does; NaN has no depth.
+        float mm = depthMm[i];
+        depthPlane[i] = (mm >= 0 && mm < 65535.0f) ? (uint16_t)mm : (mm >= 65535.0f ? 65535 : 0);
+    }
+    memcpy(shiftPlane, shift, pixels * sizeof(uint16_t));
+
+    if (encoding == SessionDepthDelta)
+    {
+        deltaEncode(depthPlane, width, height);
+        deltaEncode(shiftPlane, width, height);
+    }
+    return endRecord();
+}
+
+bool SessionWriter::writeImu(double timestamp, const SessionImuSample &sample)
+{
+    uint8_t *payload = beginRecord(SessionRecordImu, 0, timestamp, sizeof(sample));
+    if (!payload)
+        return false;
+    memcpy(payload, &sample, sizeof(sample));
+    return endRecord();
+}
+
+bool SessionWriter::writeZones(double timestamp, const uint8_t *level, uint8_t count)
+{
+    uint8_t *payload = beginRecord(SessionRecordZones, 0, timestamp, 1 + count);
+    if (!payload)
+        return false;
+    payload[0] = count;
+    memcpy(payload + 1, level, count);
+    return endRecord();
+}
+
+bool SessionWriter::writeHaptic(double timestamp, uint32_t device, const uint8_t *packet, uint16_t length)
+{
+    uint8_t *payload = beginRecord(SessionRecordHaptic, 0, timestamp,
+                                   sizeof(SessionHapticHeader) + length);
+    if (!payload)
+        return false;
+
+    SessionHapticHeader header;
+    memset(&header, 0, sizeof(header));
+    header.device = device;
+    header.length = length;
+    memcpy(payload, &header, sizeof(header));
+    memcpy(payload + sizeof(header), packet, length);
+    return endRecord();
+}
+
+} // namespace perception
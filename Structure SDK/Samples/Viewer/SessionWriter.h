@@ -0,0 +1,77 @@
+//
+//  SessionWriter.h
+//  Perception
+//
+//  Records a session in the format of SessionFormat.h. Records are
+//  collected in memory and written a chunk at a time, deflated with zlib
+//  when depth compression is on; the index is written by close().
+//
+//  Not thread safe: the Viewer calls it from one serial queue, away from
+//  the depth and Bluetooth callbacks.
+//
+
+#ifndef SessionWriter_h
+#define SessionWriter_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "SessionFormat.h"
+
+namespace perception {
+
+class SessionWriter
+{
+public:
+    SessionWriter();
+    ~SessionWriter();
+
+    // chunkBytes bounds the records of a chunk; a larger record is written
+    // in a chunk of its own. Returns false if the file cannot be created.
+    bool open(const char *path, bool compressDepth, uint32_t chunkBytes = SESSION_CHUNK_BYTES);
+
+    // Writes the pending chunk and the index. Returns false if any write of
+    // the recording failed.
+    bool close();
+    bool isOpen() const { return _file != NULL; }
+
+    // depthMm as delivered by the sensor, NaN where there is no depth; it
+    // is stored in whole millimeters, the resolution the pipeline uses.
+    bool writeDepth(double timestamp, uint16_t width, uint16_t height,
+                    const float *depthMm, const uint16_t *shift);
+    bool writeImu(double timestamp, const SessionImuSample &sample);
+    bool writeZones(double timestamp, const uint8_t *level, uint8_t count);
+    bool writeHaptic(double timestamp, uint32_t device, const uint8_t *packet, uint16_t length);
+
+    uint64_t bytesWritten() const { return _offset; }
+    uint64_t rawBytes() const { return _rawBytes; }
+    uint32_t recordCount() const { return _recordCount; }
+
+private:
+    uint8_t *beginRecord(SessionRecordType type, uint8_t encoding, double timestamp, uint32_t size);
+    bool endRecord();
+    bool writeChunk();
+    bool writeBytes(const void *data, size_t size);
+
+    FILE *_file;
+    bool _compressDepth;
+    bool _failed;
+    uint32_t _chunkBytes;
+    uint64_t _offset;
+    uint64_t _rawBytes;
+    uint32_t _recordCount;
+
+    // Records of the chunk being filled.
+    std::vector<uint8_t> _chunk;
+    uint32_t _chunkRecords;
+    double _firstTimestamp;
+    double _lastTimestamp;
+    std::vector<uint8_t> _deflated;
+
+    std::vector<SessionIndexEntry> _index;
+};
+
+} // namespace perception
+
+#endif /* SessionWriter_h */
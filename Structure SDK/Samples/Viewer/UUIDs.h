@@ -15,6 +15,9 @@
 #define VB2_UUID        @"706E"
 #define VB3_UUID        @"3AA4"
 #define VB4_UUID        @"E7CA"
+#define TIMELINE_UUID   @"5B7C"
+#define LAYOUT_UUID     @"1A70"
+#define DIAG_UUID       @"D1A6"
 
 //self.peripheral.serviceUUID = [CBUUID UUIDWithString:@"63146596-6BB6-4229-9928-C2F8C3B20C01"];
 //self.peripheral.vb1UUID = [CBUUID UUIDWithString:@"420107B0-06BF-40C3-B977-6A0EEEC2A3DC"];
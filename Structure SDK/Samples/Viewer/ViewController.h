@@ -8,11 +8,22 @@
 #define HAS_LIBCXX
 #import <Structure/Structure.h>
 
+@class LXCBPeripheralServer;
+@class CBCentral;
+
 @interface ViewController : UIViewController <STSensorControllerDelegate>
 
 @property (strong) UILabel *label;
+@property (nonatomic, weak) LXCBPeripheralServer *peripheral;
 
 - (void)centralDidConnect;
 - (void)centralDidDisconnect;
 
+// Haptic timeline fan-out, one entry per subscribed wearable.
+- (void)wearableDidSubscribe:(CBCentral *)central;
+- (void)wearableDidUnsubscribe:(CBCentral *)central;
+- (BOOL)wearable:(CBCentral *)central didWriteLayout:(NSData *)layout;
+- (void)wearable:(CBCentral *)central didReportDiagnostics:(NSData *)record;
+- (void)flushHapticTimelines;
+
 @end
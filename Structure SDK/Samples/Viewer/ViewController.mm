@@ -7,15 +7,33 @@
 
 #import "ViewController.h"
 #import "VIBE_GLOBALS.h"
+#import "LXCBPeripheralServer.h"
 #import <AVFoundation/AVFoundation.h>
+#import <CoreMotion/CoreMotion.h>
+#import <QuartzCore/QuartzCore.h>
 #import <Structure/StructureSLAM.h>
 #include <algorithm>
-
-#define TOP_CNTR_EDGE 80
-#define BOTTOM_CNTR_EDGE 140
-#define HOR_CENTER_LINE 120
-#define MAX_DEPTH 1000
-#define MIN_DEPTH 250
+#include <memory>
+#include "haptic_batch.h"
+#include "HapticRouter.h"
+#include "DepthPipeline.h"
+#include "SessionWriter.h"
+#include "LatencyTrace.h"
+#include "power_mgr.h"
+#include "battery_gov.h"
+#include "trace_ring.h"
+#include "latency_echo.h"
+
+// Haptic timeline sent with every depth frame to every wearable: the motors
+// ramp from the previous level to the new one over HAPTIC_RAMP_MS and hold
+// until the end of the HAPTIC_TIMELINE_MS window. The next frame's timeline
+// replaces whatever part of this one the wearable has not played yet.
+#define HAPTIC_TIMELINE_MS 100
+#define HAPTIC_TIMELINE_STEP_MS 10
+#define HAPTIC_RAMP_MS 30
+
+// Core Motion rate of the IMU samples in a session recording.
+#define SESSION_IMU_HZ 100
 
 NSData *vb1Data;
 NSData *vb2Data;
@@ -59,8 +77,9 @@ struct AppStatus
     //UIImageView *_normalsImageView;
     //UIImageView *_colorImageView;
     
-    uint16_t *_linearizeBuffer;
+    perception::DepthColorizer _colorizer;
     uint8_t *_coloredDepthBuffer;
+    size_t _coloredDepthPixels;
     uint8_t *_normalsBuffer;
 
     STNormalEstimator *_normalsEstimator;
@@ -69,11 +88,35 @@ struct AppStatus
     
     AppStatus _appStatus;
     
+    std::unique_ptr<perception::HapticRouter> _hapticRouter;
+    // Subscribed wearables by router device id.
+    NSMutableDictionary *_wearables;
+    // Layouts written by wearables, by central identifier; kept across
+    // reconnections.
+    NSMutableDictionary *_wearableLayouts;
+    perception::HapticRouter::DeviceId _nextWearableId;
+
+    // Session recording, toggled with a long press. The writer is only
+    // used on _recordQueue so compression stays off the sensor callbacks.
+    std::unique_ptr<perception::SessionWriter> _recorder;
+    dispatch_queue_t _recordQueue;
+    CMMotionManager *_motionManager;
+    BOOL _recording;
+
+    // Sensor to motor stamps of the frames in flight; the depth frame being
+    // processed is captured at _frameCapture, processing began at _frameStart.
+    perception::LatencyTrace _latency;
+    double _frameCapture;
+    double _frameStart;
 }
 
 - (BOOL)connectAndStartStreaming;
 - (void)convertDepthtoVibeIntensity:(STDepthFrame *)depthFrame;
+- (perception::HapticRouter &)hapticRouter;
+- (void)sendHapticZones:(const perception::ZoneFrame &)zones;
 - (void)renderDepthFrame:(STDepthFrame*)depthFrame;
+- (void)toggleRecording:(UILongPressGestureRecognizer *)gesture;
+- (void)recordDepthFrame:(STDepthFrame *)depthFrame;
 //- (void)renderNormalsFrame:(STDepthFrame*)normalsFrame;
 //- (void)renderColorFrame:(CMSampleBufferRef)sampleBuffer;
 - (void)setupColorCamera;
@@ -100,6 +143,154 @@ struct AppStatus
 }
 
 
+- (perception::HapticRouter &)hapticRouter {
+    if (!_hapticRouter)
+    {
+        _hapticRouter.reset(new perception::HapticRouter(HAPTIC_TIMELINE_MS, HAPTIC_TIMELINE_STEP_MS, HAPTIC_RAMP_MS));
+        _wearables = [NSMutableDictionary dictionary];
+        _wearableLayouts = [NSMutableDictionary dictionary];
+    }
+    return *_hapticRouter;
+}
+
+- (NSNumber *)wearableIdForCentral:(CBCentral *)central {
+    for (NSNumber *device in _wearables)
+    {
+        if ([[_wearables[device] identifier] isEqual:central.identifier])
+            return device;
+    }
+    return nil;
+}
+
+- (void)wearableDidSubscribe:(CBCentral *)central {
+    perception::HapticRouter &router = [self hapticRouter];
+    perception::WearableLayout layout = perception::WearableLayout::quadrants();
+    NSData *written = _wearableLayouts[central.identifier];
+    if (written)
+        layout.decode((const uint8_t *)written.bytes, written.length);
+    
+    NSNumber *device = [self wearableIdForCentral:central];
+    if (!device)
+        device = @(_nextWearableId++);
+    _wearables[device] = central;
+    
+    router.addDevice(device.unsignedIntValue, layout, [self attMtuForCentral:central]);
+    NSLog(@"Wearable %@: %d motors, %lu wearables", device, layout.motorCount, (unsigned long)router.deviceCount());
+    [self logCapacityOfWearable:device];
+    [self centralDidConnect];
+}
+
+- (uint16_t)attMtuForCentral:(CBCentral *)central {
+    NSUInteger length = [_peripheral maximumTimelineLengthForCentral:central];
+    return (uint16_t)std::min<NSUInteger>(length + HAPTIC_BATCH_ATT_OVERHEAD, UINT16_MAX);
+}
+
+- (void)logCapacityOfWearable:(NSNumber *)device {
+    int frames = [self hapticRouter].framesPerBatch(device.unsignedIntValue);
+    uint16_t mtu = [self attMtuForCentral:_wearables[device]];
+    if (frames == 0)
+        NSLog(@"Wearable %@: MTU %u fits no frame, nothing is sent", device, mtu);
+    else if (frames == 1)
+        NSLog(@"Wearable %@: MTU %u fits one frame, levels step without a ramp", device, mtu);
+    else
+        NSLog(@"Wearable %@: MTU %u, %d frames per timeline", device, mtu, frames);
+}
+
+- (void)wearableDidUnsubscribe:(CBCentral *)central {
+    NSNumber *device = [self wearableIdForCentral:central];
+    if (device)
+    {
+        [self hapticRouter].removeDevice(device.unsignedIntValue);
+        _latency.removeDevice(device.unsignedIntValue);
+        [_wearables removeObjectForKey:device];
+    }
+    [self centralDidDisconnect];
+}
+
+- (BOOL)wearable:(CBCentral *)central didWriteLayout:(NSData *)data {
+    perception::WearableLayout layout;
+    if (!layout.decode((const uint8_t *)data.bytes, data.length))
+        return NO;
+    
+    perception::HapticRouter &router = [self hapticRouter];
+    _wearableLayouts[central.identifier] = [data copy];
+    
+    // The layout may come before or after the timeline subscription.
+    NSNumber *device = [self wearableIdForCentral:central];
+    if (device && router.setLayout(device.unsignedIntValue, layout))
+        [self logCapacityOfWearable:device];
+    return YES;
+}
+
+- (void)wearable:(CBCentral *)central didReportDiagnostics:(NSData *)record {
+    const uint8_t *bytes = (const uint8_t *)record.bytes;
+    if (record.length > 0 && bytes[0] == TRACE_RECORD)
+    {
+        // Event trace packets are decoded offline: grep the log for TRACE
+        // lines and feed them to tools/trace_decode in the firmware tree.
+        NSMutableString *hex = [NSMutableString stringWithCapacity:record.length * 2];
+        for (NSUInteger i = 0; i < record.length; i++)
+            [hex appendFormat:@"%02x", bytes[i]];
+        NSLog(@"Wearable %@: TRACE %@", [self wearableIdForCentral:central], hex);
+        return;
+    }
+    
+    latency_echo_entry_t echo;
+    if (latency_echo_decode(bytes, (uint16_t)record.length, &echo))
+    {
+        // One LATENCY line per sampled frame, summarized offline by
+        // tools/latency_report; echoes of timelines no longer known are
+        // dropped.
+        NSNumber *device = [self wearableIdForCentral:central];
+        perception::LatencySample sample;
+        if (device && _latency.echoed(device.unsignedIntValue, echo, sample))
+        {
+            char line[192];
+            perception::LatencyTrace::format(sample, line, sizeof(line));
+            NSLog(@"Wearable %@: %s", device, line);
+        }
+        return;
+    }
+    
+    if (record.length == BATTERY_GOV_RECORD_SIZE && bytes[0] == BATTERY_GOV_RECORD)
+    {
+        // Estimated on the wearable from the motor duty, see battery_gov.h.
+        // Without a gauge the count starts over at every reset of the
+        // wearable, the level is then only as good as the assumed start.
+        uint16_t runtimeMin = bytes[2] | (bytes[3] << 8);
+        uint32_t averageUa = bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) | ((uint32_t)bytes[7] << 24);
+        uint16_t elapsedMin = bytes[10] | (bytes[11] << 8);
+        NSString *source = (bytes[9] & BATTERY_GOV_FLAG_ESTIMATED) ?
+            [NSString stringWithFormat:@"estimated, since reset %u min ago", elapsedMin] :
+            @"measured";
+        NSLog(@"Wearable %@: battery %u%% (%@), %u min left at %u uA, motor budget %u%%",
+              [self wearableIdForCentral:central], bytes[1], source, runtimeMin,
+              averageUa, bytes[8]);
+        return;
+    }
+    
+    if (record.length != POWER_MGR_RECORD_SIZE || bytes[0] != POWER_MGR_RECORD)
+    {
+        NSLog(@"Wearable %@: diagnostics %@", [self wearableIdForCentral:central], record);
+        return;
+    }
+    
+    // Per state: residency in ms, then the number of entries.
+    uint32_t residencyMs[POWER_STATE_COUNT];
+    uint16_t entries[POWER_STATE_COUNT];
+    for (int s = 0; s < POWER_STATE_COUNT; s++)
+    {
+        const uint8_t *field = bytes + 2 + s * 6;
+        residencyMs[s] = field[0] | (field[1] << 8) | (field[2] << 16) | ((uint32_t)field[3] << 24);
+        entries[s] = field[4] | (field[5] << 8);
+    }
+    NSLog(@"Wearable %@: state %d, active %u ms (%u), idle %u ms (%u), sleep %u ms (%u)",
+          [self wearableIdForCentral:central], bytes[1],
+          residencyMs[POWER_ACTIVE], entries[POWER_ACTIVE],
+          residencyMs[POWER_IDLE], entries[POWER_IDLE],
+          residencyMs[POWER_SLEEP], entries[POWER_SLEEP]);
+}
+
 - (void)centralDidDisconnect {
     // Pulse the screen red.
     [UIView animateWithDuration:0.1
@@ -149,8 +340,8 @@ struct AppStatus
     /*CGRect colorFrame = self.view.frame;
     colorFrame.size.height /= 2;*/
     
-    _linearizeBuffer = NULL;
     _coloredDepthBuffer = NULL;
+    _coloredDepthPixels = 0;
     _normalsBuffer = NULL;
 
     _depthImageView = [[UIImageView alloc] initWithFrame:depthFrame];
@@ -166,13 +357,14 @@ struct AppStatus
     [self.view addSubview:_colorImageView];*/
 
     [self setupColorCamera];
+
+    _recordQueue = dispatch_queue_create("Viewer.SessionRecorder", DISPATCH_QUEUE_SERIAL);
+    [self.view addGestureRecognizer:[[UILongPressGestureRecognizer alloc] initWithTarget:self
+                                                                                   action:@selector(toggleRecording:)]];
 }
 
 - (void)dealloc
 {
-    if (_linearizeBuffer)
-        free(_linearizeBuffer);
-    
     if (_coloredDepthBuffer)
         free(_coloredDepthBuffer);
     
@@ -412,6 +604,7 @@ struct AppStatus
 
 - (void)sensorDidOutputDepthFrame:(STDepthFrame *)depthFrame
 {
+    [self recordDepthFrame:depthFrame];
     [self renderDepthFrame:depthFrame];
     [self convertDepthtoVibeIntensity:depthFrame];
     //[self renderNormalsFrame:depthFrame];
@@ -424,6 +617,7 @@ struct AppStatus
 - (void)sensorDidOutputSynchronizedDepthFrame:(STDepthFrame *)depthFrame
                                 andColorFrame:(STColorFrame *)colorFrame
 {
+    [self recordDepthFrame:depthFrame];
     [self renderDepthFrame:depthFrame];
     [self convertDepthtoVibeIntensity:depthFrame];
     //[self renderNormalsFrame:depthFrame];
@@ -434,215 +628,53 @@ struct AppStatus
 #pragma mark -
 #pragma mark Rendering
 
-const uint16_t maxShiftValue = 2048;
-
-- (void)populateLinearizeBuffer
-{
-    _linearizeBuffer = (uint16_t*)malloc((maxShiftValue + 1) * sizeof(uint16_t));
-    
-    for (int i=0; i <= maxShiftValue; i++)
-    {
-        float v = i/ (float)maxShiftValue;
-        v = powf(v, 3)* 6;
-        _linearizeBuffer[i] = v*6*256;
-    }
-}
-
-// This function is equivalent to calling [STDepthAsRgba convertDepthFrameToRgba] with the
-// STDepthToRgbaStrategyRedToBlueGradient strategy. Not using the SDK here for didactic purposes.
-- (void)convertShiftToRGBA:(const uint16_t*)shiftValues depthValuesCount:(size_t)depthValuesCount
-{
-    int valSize = sizeof(shiftValues);
-    
-    for (size_t i = 0; i < depthValuesCount; i++)
-    {
-        // We should not get higher values than maxShiftValue, but let's stay on the safe side.
-        uint16_t boundedShift = std::min (shiftValues[i], maxShiftValue);
-        
-        // Use a lookup table to make the non-linear input values vary more linearly with metric depth
-        int linearizedDepth = _linearizeBuffer[boundedShift];
-        
-        // Use the upper byte of the linearized shift value to choose a base color
-        // Base colors range from: (closest) White, Red, Orange, Yellow, Green, Cyan, Blue, Black (farthest)
-        int lowerByte = (linearizedDepth & 0xff);
-        
-        // Use the lower byte to scale between the base colors
-        int upperByte = (linearizedDepth >> 8);
-        
-        switch (upperByte)
-        {
-            case 0:
-                _coloredDepthBuffer[4*i+0] = 255;
-                _coloredDepthBuffer[4*i+1] = 255-lowerByte;
-                _coloredDepthBuffer[4*i+2] = 255-lowerByte;
-                _coloredDepthBuffer[4*i+3] = 255;
-                break;
-            case 1:
-                _coloredDepthBuffer[4*i+0] = 255;
-                _coloredDepthBuffer[4*i+1] = lowerByte;
-                _coloredDepthBuffer[4*i+2] = 0;
-                break;
-            case 2:
-                _coloredDepthBuffer[4*i+0] = 255-lowerByte;
-                _coloredDepthBuffer[4*i+1] = 255;
-                _coloredDepthBuffer[4*i+2] = 0;
-                break;
-            case 3:
-                _coloredDepthBuffer[4*i+0] = 0;
-                _coloredDepthBuffer[4*i+1] = 255;
-                _coloredDepthBuffer[4*i+2] = lowerByte;
-                break;
-            case 4:
-                _coloredDepthBuffer[4*i+0] = 0;
-                _coloredDepthBuffer[4*i+1] = 255-lowerByte;
-                _coloredDepthBuffer[4*i+2] = 255;
-                break;
-            case 5:
-                _coloredDepthBuffer[4*i+0] = 0;
-                _coloredDepthBuffer[4*i+1] = 0;
-                _coloredDepthBuffer[4*i+2] = 255-lowerByte;
-                break;
-            default:
-                _coloredDepthBuffer[4*i+0] = 0;
-                _coloredDepthBuffer[4*i+1] = 0;
-                _coloredDepthBuffer[4*i+2] = 0;
-                break;
-        }
-    }
-}
-
-
 -(void) convertDepthtoVibeIntensity:(STDepthFrame *)depthFrame
 {
-    //SHIT
-    size_t cols = depthFrame.width;
-    size_t rows = depthFrame.height;
-    float* depthValues = depthFrame.depthInMillimeters;
-    int minDepth = 20000000;
-    int min_pixel = 0;
-    for (int i = 0; i < cols*rows; i++)
-    {
-        int depthValue = (int)depthValues[i];
-        if(depthValue < minDepth & depthValue != isnan(depthValue))
-        {
-            minDepth = depthValue;
-            min_pixel = i;
-        }
-    }
-    int row = min_pixel / cols;
-    int col = min_pixel % cols;
-    
-    // Categorization at Pixel Level
-    NSString *ver = @"TOP"; //Top, Center, or Bottom
-    
-    if (col < TOP_CNTR_EDGE) {
-        ver = @"TOP";
-    }
-    else if (col >= TOP_CNTR_EDGE & col <= BOTTOM_CNTR_EDGE) {
-        ver = @"CENTER";
-    }
-    else {
-        ver = @"BOTTOM";
-    }
-    
-    
-    NSString *hor = @"LEFT"; //Left or Right
-    
-    if (row < HOR_CENTER_LINE) {
-        hor = @"RIGHT";
-    }
-    else {
-        hor = @"LEFT";
-    }
-    
-    // Categorization of Depth
-    int intensity = 0;
-    
-    // very close = black out on color frame
-    if (minDepth == 20000000) {
-        intensity = 10;
-    }
-    else if (minDepth < MIN_DEPTH) {
-        intensity = 10;
-    }
-    else if (minDepth < ((1 * MAX_DEPTH)/3) && minDepth >= MIN_DEPTH) {
-        intensity = 9;
-    }
-    else if (minDepth < ((1 * MAX_DEPTH)/2) && minDepth >= ((1 * MAX_DEPTH)/3)) {
-        intensity = 8;
-    }
-    else if (minDepth < ((2 * MAX_DEPTH)/3) && minDepth >= ((1 * MAX_DEPTH)/2)) {
-        intensity = 7;
-    }
-    else if (minDepth < ((5 * MAX_DEPTH)/6) && minDepth >= ((2 * MAX_DEPTH)/3)) {
-        intensity = 6;
-    }
-    else if (minDepth < MAX_DEPTH && minDepth >= ((5 * MAX_DEPTH)/6)) {
-        intensity = 5;
-    }
-    // far
-    else {
-        intensity = 0;
-    }
+    _frameCapture = depthFrame.timestamp;
+    _frameStart = CACurrentMediaTime();
+
+    size_t pixels = depthFrame.width * depthFrame.height;
+    perception::NearestDepth nearest = perception::findNearestDepth(depthFrame.depthInMillimeters, pixels);
+    int intensity = perception::depthIntensity(nearest);
+    perception::HapticZone zone = perception::depthZone(nearest.pixel, depthFrame.width);
 
     int vb1_intensity = 0;
     int vb2_intensity = 0;
     int vb3_intensity = 0;
     int vb4_intensity = 0;
     
-    // Categorization of Vibe motors
-    if ([ver isEqualToString:@"TOP"] & [hor isEqualToString:@"LEFT"] )  //TOP LEFT
-    {
-        vb1_intensity = intensity;
-        vb2_intensity = 0;
-        vb3_intensity = 0;
-        vb4_intensity = 0;
-    }
-    else if ([ver isEqualToString:@"TOP"] & [hor isEqualToString:@"RIGHT"] )  //TOP RIGHT
-    {
-        vb1_intensity = 0;
-        vb2_intensity = intensity;
-        vb3_intensity = 0;
-        vb4_intensity = 0;
-    }
-    else if ([ver isEqualToString:@"BOTTOM"] & [hor isEqualToString:@"LEFT"] )  //BOTTOM LEFT
-    {
-        vb1_intensity = 0;
-        vb2_intensity = 0;
-        vb3_intensity = intensity;
-        vb4_intensity = 0;
-    }
-    else if ([ver isEqualToString:@"BOTTOM"] & [hor isEqualToString:@"RIGHT"] )// BOTTOM RIGHT
-    {
-        vb1_intensity = 0;
-        vb2_intensity = 0;
-        vb3_intensity = 0;
-        vb4_intensity = intensity;
-    }
-    
-    else if ([ver isEqualToString:@"CENTER"] & [hor isEqualToString:@"LEFT"] )  //CENTER LEFT
-    {
-        vb1_intensity = intensity;
-        vb2_intensity = 0;
-        vb3_intensity = intensity;
-        vb4_intensity = 0;
-    }
-     else if ([ver isEqualToString:@"CENTER"] & [hor isEqualToString:@"RIGHT"] )// CENTER RIGHT
+    // Categorization of Vibe motors, the center zones drive both motors on
+    // their side
+    switch (zone)
     {
-        vb1_intensity = 0;
-        vb2_intensity = intensity;
-        vb3_intensity = 0;
-        vb4_intensity = intensity;
-    }
-    else { // Exception Case
-        vb1_intensity = 0;
-        vb2_intensity = 0;
-        vb3_intensity = 0;
-        vb4_intensity = 0;
+        case perception::HapticZoneTopLeft:
+            vb1_intensity = intensity;
+            break;
+        case perception::HapticZoneTopRight:
+            vb2_intensity = intensity;
+            break;
+        case perception::HapticZoneBottomLeft:
+            vb3_intensity = intensity;
+            break;
+        case perception::HapticZoneBottomRight:
+            vb4_intensity = intensity;
+            break;
+        case perception::HapticZoneCenterLeft:
+            vb1_intensity = intensity;
+            vb3_intensity = intensity;
+            break;
+        case perception::HapticZoneCenterRight:
+            vb2_intensity = intensity;
+            vb4_intensity = intensity;
+            break;
+        default:
+            break;
     }
 
-    
-    NSLog(@"( %d mm) at %@ & %@:: vb1=%d, vb2=%d, vb3=%d, vb4=%d", minDepth, ver, hor, vb1_intensity, vb2_intensity, vb3_intensity, vb4_intensity);
+    static NSString *const zoneNames[perception::HapticZoneCount] = {
+        @"TOP & LEFT", @"TOP & RIGHT", @"CENTER & LEFT", @"CENTER & RIGHT", @"BOTTOM & LEFT", @"BOTTOM & RIGHT"
+    };
+    NSLog(@"( %d mm) at %@:: vb1=%d, vb2=%d, vb3=%d, vb4=%d", nearest.depthMm, zoneNames[zone], vb1_intensity, vb2_intensity, vb3_intensity, vb4_intensity);
 
     //      deliver intensity values to BLE
     //
@@ -657,25 +689,171 @@ const uint16_t maxShiftValue = 2048;
     vb2Data = [NSData dataWithBytes:& vb2_intensity length:sizeof(vb2_intensity)];
     vb3Data = [NSData dataWithBytes:& vb3_intensity length:sizeof(vb3_intensity)];
     vb4Data = [NSData dataWithBytes:& vb4_intensity length:sizeof(vb4_intensity)];
+    
+    // One zone frame for all wearables, each maps it onto its own motors.
+    [self sendHapticZones:perception::depthZones(nearest, depthFrame.width)];
 }
 
+- (void)sendHapticZones:(const perception::ZoneFrame &)zones
+{
+    if (_recording)
+    {
+        double timestamp = CACurrentMediaTime();
+        perception::ZoneFrame frame = zones;
+        dispatch_async(_recordQueue, ^{
+            if (_recorder)
+                _recorder->writeZones(timestamp, frame.level, perception::HapticZoneCount);
+        });
+    }
+
+    perception::HapticRouter &router = [self hapticRouter];
+    if (router.deviceCount() == 0)
+        return;
+    
+    // The MTU exchange may complete after the subscription.
+    for (NSNumber *device in _wearables)
+    {
+        if (router.setMtu(device.unsignedIntValue, [self attMtuForCentral:_wearables[device]]))
+            [self logCapacityOfWearable:device];
+    }
+    
+    uint32_t baseMs = (uint32_t)(uint64_t)(CACurrentMediaTime() * 1000.0);
+    router.update(zones, baseMs);
+    _latency.frameProcessed(_frameCapture, _frameStart, CACurrentMediaTime(), baseMs);
+    [self flushHapticTimelines];
+}
+
+- (void)flushHapticTimelines
+{
+    // Queue every wearable's timeline back to back so they leave in the
+    // same connection events. What does not fit waits for the ready
+    // callback, or is replaced by the next depth frame.
+    LXCBPeripheralServer *peripheral = _peripheral;
+    NSDictionary *wearables = _wearables;
+    dispatch_queue_t recordQueue = _recording ? _recordQueue : nil;
+    [self hapticRouter].flush([self, peripheral, wearables, recordQueue](perception::HapticRouter::DeviceId device, const uint8_t *data, uint16_t length) -> bool {
+        CBCentral *central = wearables[@(device)];
+        NSData *packet = [NSData dataWithBytes:data length:length];
+        if (!central)
+            return false;
+        self->_latency.enqueued(device, data, length, CACurrentMediaTime());
+        if (![peripheral sendHapticTimeline:packet toCentral:central])
+            return false;
+        self->_latency.sent(device, data, length, CACurrentMediaTime());
+        if (recordQueue)
+        {
+            double timestamp = CACurrentMediaTime();
+            dispatch_async(recordQueue, ^{
+                if (self->_recorder)
+                    self->_recorder->writeHaptic(timestamp, device, (const uint8_t *)packet.bytes, (uint16_t)packet.length);
+            });
+        }
+        return true;
+    });
+}
+
+#pragma mark -
+#pragma mark Session recording
+
+- (void)toggleRecording:(UILongPressGestureRecognizer *)gesture
+{
+    if (gesture.state != UIGestureRecognizerStateBegan)
+        return;
+
+    if (_recording)
+    {
+        _recording = NO;
+        [_motionManager stopDeviceMotionUpdates];
+        dispatch_async(_recordQueue, ^{
+            if (!_recorder)
+                return;
+            perception::SessionWriter *recorder = _recorder.get();
+            bool ok = recorder->close();
+            NSLog(@"Session recording stopped: %u records, %llu bytes (%llu raw)%@",
+                  recorder->recordCount(), recorder->bytesWritten(), recorder->rawBytes(),
+                  ok ? @"" : @", write failed");
+            _recorder.reset();
+        });
+        [self centralDidConnect];
+        return;
+    }
+
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.dateFormat = @"yyyyMMdd-HHmmss";
+    NSString *documents = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES).firstObject;
+    NSString *path = [documents stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"session-%@.pses", [formatter stringFromDate:[NSDate date]]]];
+
+    std::unique_ptr<perception::SessionWriter> recorder(new perception::SessionWriter());
+    if (!recorder->open(path.fileSystemRepresentation, true))
+    {
+        NSLog(@"Session recording: cannot create %@", path);
+        return;
+    }
+    perception::SessionWriter *writer = recorder.release();
+    dispatch_async(_recordQueue, ^{
+        _recorder.reset(writer);
+    });
+    _recording = YES;
+    NSLog(@"Session recording to %@", path);
+
+    if (!_motionManager)
+        _motionManager = [[CMMotionManager alloc] init];
+    if (_motionManager.deviceMotionAvailable)
+    {
+        _motionManager.deviceMotionUpdateInterval = 1.0 / SESSION_IMU_HZ;
+        NSOperationQueue *motionQueue = [[NSOperationQueue alloc] init];
+        motionQueue.underlyingQueue = _recordQueue;
+        [_motionManager startDeviceMotionUpdatesToQueue:motionQueue withHandler:^(CMDeviceMotion *motion, NSError *error) {
+            if (!motion || !_recorder)
+                return;
+            perception::SessionImuSample sample;
+            sample.accel[0] = motion.gravity.x + motion.userAcceleration.x;
+            sample.accel[1] = motion.gravity.y + motion.userAcceleration.y;
+            sample.accel[2] = motion.gravity.z + motion.userAcceleration.z;
+            sample.gyro[0] = motion.rotationRate.x;
+            sample.gyro[1] = motion.rotationRate.y;
+            sample.gyro[2] = motion.rotationRate.z;
+            _recorder->writeImu(motion.timestamp, sample);
+        }];
+    }
+    [self centralDidConnect];
+}
+
+- (void)recordDepthFrame:(STDepthFrame *)depthFrame
+{
+    if (!_recording)
+        return;
+
+    // The frame's buffers are reused by the SDK; the copies go to the
+    // recording queue.
+    size_t pixels = depthFrame.width * depthFrame.height;
+    NSData *depth = [NSData dataWithBytes:depthFrame.depthInMillimeters length:pixels * sizeof(float)];
+    NSData *shift = [NSData dataWithBytes:depthFrame.shiftData length:pixels * sizeof(uint16_t)];
+    double timestamp = depthFrame.timestamp;
+    uint16_t width = (uint16_t)depthFrame.width;
+    uint16_t height = (uint16_t)depthFrame.height;
+    dispatch_async(_recordQueue, ^{
+        if (_recorder)
+            _recorder->writeDepth(timestamp, width, height, (const float *)depth.bytes, (const uint16_t *)shift.bytes);
+    });
+}
 
 - (void)renderDepthFrame:(STDepthFrame *)depthFrame
 {
     size_t cols = depthFrame.width;
     size_t rows = depthFrame.height;
     
-    if (_linearizeBuffer == NULL || _normalsBuffer == NULL)
+    // Allocated once, not on every frame
+    if (_coloredDepthBuffer == NULL || _coloredDepthPixels != cols * rows)
     {
-        [self populateLinearizeBuffer];
+        free(_coloredDepthBuffer);
         _coloredDepthBuffer = (uint8_t*)malloc(cols * rows * 4);
+        _coloredDepthPixels = cols * rows;
     }
     
     // Conversion of 16-bit non-linear shift depth values to 32-bit RGBA
-    //
-    // Adapted from: https://github.com/OpenKinect/libfreenect/blob/master/examples/glview.c
-    //
-    [self convertShiftToRGBA:depthFrame.shiftData depthValuesCount:cols * rows];
+    _colorizer.colorize(depthFrame.shiftData, cols * rows, _coloredDepthBuffer);
     
     CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
     
@@ -0,0 +1,440 @@
+//
+//  haptic_router_sim.cpp
+//  Perception
+//
+//  Runs HapticRouter.h on a host against simulated wearables and a radio
+//  with a bounded transmit queue, and checks what reaches the air:
+//
+//    mtu       frames per timeline for the usual ATT MTUs and motor counts,
+//              every packet fits its link, a link that fits one frame gets
+//              the target levels as a single step
+//    setmtu    an MTU exchange after the subscription resizes the next
+//              timeline, which ramps on from the levels already sent
+//    content   targets are the strongest zone of each motor, the window is
+//              spread over the frames, the ramp starts from the levels of the
+//              last timeline sent
+//    flush     a full queue stops the flush and the next one resumes after
+//              the wearable served last, so every wearable gets its turn
+//    replace   an update before the flush replaces the unsent timeline,
+//              same sequence, ramping from the last levels sent
+//    layout    setLayout() restarts the wearable from rest with the frame
+//              count of the new motor count
+//
+//  The exit status is 1 when a check fails.
+//
+//  Build and run on the host:
+//
+//    FW=../../../../Firmware/MULTIROLE_MULTICONNECT_SAMB11_XPLAINED_PRO1/MULTIROLE_MULTICONNECT_SAMB11_XPLAINED_PRO1/src
+//    cc -O2 -I$FW -c $FW/haptic_batch.c
+//    c++ -std=c++11 -O2 -I.. -I$FW -o haptic_router_sim haptic_router_sim.cpp ../HapticRouter.cpp haptic_batch.o
+//    ./haptic_router_sim [-v]
+//
+//    -v  print the frame counts per MTU and motor count
+//
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "HapticRouter.h"
+#include "haptic_batch.h"
+
+using namespace perception;
+
+// As the Viewer creates the router.
+static const int WindowMs = 100;
+static const int StepMs = 10;
+static const int RampMs = 30;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                            \
+    do                                                   \
+    {                                                    \
+        if (!(condition))                                \
+        {                                                \
+            if (failures++ < 20)                         \
+            {                                            \
+                fprintf(stderr, "failed: " __VA_ARGS__); \
+                fprintf(stderr, "\n");                   \
+            }                                            \
+        }                                                \
+    } while (0)
+
+struct Packet
+{
+    HapticRouter::DeviceId device;
+    haptic_batch_t batch;
+    uint16_t length;
+};
+
+// The radio: takes up to capacity packets, then reports a full queue.
+struct Radio
+{
+    size_t capacity;
+    std::vector<Packet> sent;
+
+    Radio() : capacity(1000) {}
+
+    HapticRouter::Sender sender()
+    {
+        return [this](HapticRouter::DeviceId device, const uint8_t *data, uint16_t length) {
+            if (capacity == 0)
+                return false;
+            capacity--;
+            Packet packet;
+            packet.device = device;
+            packet.length = length;
+            haptic_batch_status_t status = haptic_batch_decode(data, length, &packet.batch);
+            CHECK(status == HAPTIC_BATCH_OK, "device %u sent a packet the wearable rejects: %d", device, status);
+            sent.push_back(packet);
+            return true;
+        };
+    }
+
+    const Packet *last(HapticRouter::DeviceId device) const
+    {
+        for (size_t i = sent.size(); i-- > 0;)
+        {
+            if (sent[i].device == device)
+                return &sent[i];
+        }
+        return NULL;
+    }
+};
+
+static WearableLayout layoutOf(uint8_t motors)
+{
+    WearableLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.motorCount = motors;
+    for (uint8_t m = 0; m < motors; m++)
+        layout.zoneMask[m] = HAPTIC_ZONE_BIT(m % HapticZoneCount);
+    return layout;
+}
+
+static ZoneFrame zoneFrame(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f)
+{
+    ZoneFrame frame = {{a, b, c, d, e, f}};
+    return frame;
+}
+
+static void checkMtu(bool verbose)
+{
+    static const uint16_t mtus[] = { 23, 27, 64, 104, 185, 247, 517 };
+    const int wanted = WindowMs / StepMs + 1;
+
+    if (verbose)
+    {
+        printf("frames per timeline, %d wanted\nmtu  ", wanted);
+        for (uint8_t motors = 1; motors <= HAPTIC_BATCH_MAX_MOTORS; motors++)
+            printf("%4u", motors);
+        printf(" motors\n");
+    }
+
+    for (uint16_t mtu : mtus)
+    {
+        if (verbose)
+            printf("%3u  ", mtu);
+        for (uint8_t motors = 1; motors <= HAPTIC_BATCH_MAX_MOTORS; motors++)
+        {
+            HapticRouter router(WindowMs, StepMs, RampMs);
+            Radio radio;
+            router.addDevice(1, layoutOf(motors), mtu);
+            router.update(zoneFrame(200, 200, 200, 200, 200, 200), 1000);
+
+            int expected = std::min<int>(wanted, haptic_batch_frames_per_mtu(mtu, motors));
+            CHECK(router.framesPerBatch(1) == expected, "MTU %u, %u motors: %d frames per timeline, expected %d",
+                  mtu, motors, router.framesPerBatch(1), expected);
+            if (expected < 1)
+            {
+                CHECK(!router.hasPending(), "MTU %u, %u motors: timeline without frames", mtu, motors);
+                if (verbose)
+                    printf("%4s", "-");
+                continue;
+            }
+
+            CHECK(router.flush(radio.sender()) == 1, "MTU %u, %u motors: nothing sent", mtu, motors);
+            const Packet *packet = radio.last(1);
+            if (!packet)
+                continue;
+            CHECK(packet->batch.frame_count == expected, "MTU %u, %u motors: %u frames, expected %d", mtu, motors,
+                  packet->batch.frame_count, expected);
+            CHECK(packet->length + HAPTIC_BATCH_ATT_OVERHEAD <= mtu, "MTU %u, %u motors: %u bytes do not fit", mtu,
+                  motors, packet->length);
+            CHECK(packet->batch.motor_count == motors, "MTU %u: %u motors sent for %u", mtu,
+                  packet->batch.motor_count, motors);
+
+            if (expected == 1)
+            {
+                // One frame steps to the target levels at once.
+                const haptic_frame_t &step = packet->batch.frames[0];
+                CHECK(step.offset_ms == 0, "MTU %u, %u motors: step at %u ms", mtu, motors, step.offset_ms);
+                for (uint8_t m = 0; m < motors; m++)
+                    CHECK(step.intensity[m] == 200, "MTU %u, %u motors: motor %u steps to %u", mtu, motors, m,
+                          step.intensity[m]);
+            }
+            else
+            {
+                // The window is covered however few frames fit.
+                uint16_t lastOffset = packet->batch.frames[packet->batch.frame_count - 1].offset_ms;
+                CHECK(lastOffset <= WindowMs && lastOffset > WindowMs - WindowMs / (expected - 1),
+                      "MTU %u, %u motors: timeline ends at %u ms", mtu, motors, lastOffset);
+            }
+            if (verbose)
+                printf("%4u", packet->batch.frame_count);
+        }
+        if (verbose)
+            printf("\n");
+    }
+}
+
+static void checkSetMtu()
+{
+    HapticRouter router(WindowMs, StepMs, RampMs);
+    Radio radio;
+
+    // Subscribed on the default MTU: eight motors fit one frame.
+    router.addDevice(3, layoutOf(8), 23);
+    CHECK(router.framesPerBatch(3) == 1, "MTU 23, 8 motors: %d frames", router.framesPerBatch(3));
+    router.update(zoneFrame(120, 120, 120, 120, 120, 120), 1000);
+    router.flush(radio.sender());
+    const Packet *packet = radio.last(3);
+    CHECK(packet && packet->batch.frame_count == 1 && packet->batch.frames[0].intensity[7] == 120,
+          "MTU 23: one-frame step not sent");
+
+    CHECK(!router.setMtu(3, 23), "same MTU reported as a change");
+    CHECK(!router.setMtu(4, 247), "unknown device accepted");
+    CHECK(router.setMtu(3, 247), "MTU 247 not reported as a change");
+    CHECK(router.framesPerBatch(3) == WindowMs / StepMs + 1, "MTU 247, 8 motors: %d frames",
+          router.framesPerBatch(3));
+
+    router.update(zoneFrame(240, 240, 240, 240, 240, 240), 1100);
+    router.flush(radio.sender());
+    packet = radio.last(3);
+    CHECK(packet && packet->length + HAPTIC_BATCH_ATT_OVERHEAD <= 247, "MTU 247: packet does not fit");
+    if (!packet)
+        return;
+    const haptic_batch_t &batch = packet->batch;
+    CHECK(batch.sequence == 1, "sequence %u after the MTU change", batch.sequence);
+    CHECK(batch.frame_count == WindowMs / StepMs + 1, "%u frames after the MTU change", batch.frame_count);
+    CHECK(batch.frames[0].intensity[0] == 120 && batch.frames[batch.frame_count - 1].intensity[0] == 240,
+          "ramp from %u to %u, expected 120 to 240", batch.frames[0].intensity[0],
+          batch.frames[batch.frame_count - 1].intensity[0]);
+}
+
+static void checkContent()
+{
+    HapticRouter router(WindowMs, StepMs, RampMs);
+    Radio radio;
+    router.addDevice(7, WearableLayout::quadrants(), 247);
+
+    // Center zones drive both motors of their side.
+    router.update(zoneFrame(10, 20, 90, 40, 250, 5), 5000);
+    router.flush(radio.sender());
+    const Packet *packet = radio.last(7);
+    CHECK(packet != NULL, "quadrants: nothing sent");
+    if (!packet)
+        return;
+
+    const haptic_batch_t &first = packet->batch;
+    static const uint8_t targets[4] = { 90, 40, 250, 40 };
+    CHECK(first.base_ms == 5000 && first.sequence == 0, "base %u sequence %u", first.base_ms, first.sequence);
+    CHECK(first.frame_count == WindowMs / StepMs + 1, "%u frames on MTU 247", first.frame_count);
+    for (int f = 0; f < first.frame_count; f++)
+    {
+        int offset = first.frames[f].offset_ms;
+        CHECK(offset == f * StepMs, "frame %d at %d ms", f, offset);
+        for (int m = 0; m < 4; m++)
+        {
+            // From rest to the target over the ramp.
+            int expected = targets[m] * std::min(offset, RampMs) / RampMs;
+            CHECK(first.frames[f].intensity[m] == expected, "frame %d motor %d at %u, expected %d", f, m,
+                  first.frames[f].intensity[m], expected);
+        }
+    }
+
+    // The next timeline ramps from the targets just sent, down as well.
+    router.update(zoneFrame(0, 0, 30, 240, 0, 0), 5100);
+    router.flush(radio.sender());
+    packet = radio.last(7);
+    const haptic_batch_t &second = packet->batch;
+    static const uint8_t next[4] = { 30, 240, 30, 240 };
+    CHECK(second.sequence == 1, "second timeline has sequence %u", second.sequence);
+    for (int m = 0; m < 4; m++)
+    {
+        CHECK(second.frames[0].intensity[m] == targets[m], "motor %d starts at %u, expected %u", m,
+              second.frames[0].intensity[m], targets[m]);
+        CHECK(second.frames[second.frame_count - 1].intensity[m] == next[m], "motor %d ends at %u, expected %u", m,
+              second.frames[second.frame_count - 1].intensity[m], next[m]);
+    }
+}
+
+static void checkFlush()
+{
+    HapticRouter router(WindowMs, StepMs, RampMs);
+    Radio radio;
+    const HapticRouter::DeviceId ids[3] = { 11, 22, 33 };
+    for (HapticRouter::DeviceId id : ids)
+        router.addDevice(id, WearableLayout::quadrants(), 185);
+
+    // The queue is full from the start.
+    router.update(zoneFrame(100, 100, 100, 100, 100, 100), 0);
+    radio.capacity = 0;
+    CHECK(router.flush(radio.sender()) == 0, "sent into a full queue");
+    CHECK(router.hasPending(), "timelines lost on a full queue");
+
+    // Room for one at a time: each flush serves the next wearable.
+    std::vector<HapticRouter::DeviceId> order;
+    for (int round = 0; round < 9; round++)
+    {
+        if (!router.hasPending())
+            router.update(zoneFrame(100, 100, 100, 100, 100, 100), (uint32_t)(round * 100));
+        radio.capacity = 1;
+        CHECK(router.flush(radio.sender()) == 1, "round %d: %zu sent", round, radio.sent.size());
+        order.push_back(radio.sent.back().device);
+    }
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        CHECK(order[i] == ids[i % 3], "flush %zu served device %u, expected %u", i, order[i], ids[i % 3]);
+    }
+
+    // A queue filling in the middle of a flush resumes with the wearable it
+    // stopped at, after the ones it already served.
+    router.update(zoneFrame(50, 50, 50, 50, 50, 50), 2000);
+    radio.sent.clear();
+    radio.capacity = 2;
+    CHECK(router.flush(radio.sender()) == 2, "two slots, %zu sent", radio.sent.size());
+    radio.capacity = 5;
+    CHECK(router.flush(radio.sender()) == 1, "one timeline left, %zu sent in total", radio.sent.size());
+    CHECK(radio.sent.size() == 3 && radio.sent[0].device == 11 && radio.sent[1].device == 22 &&
+              radio.sent[2].device == 33,
+          "split flush out of order");
+    CHECK(!router.hasPending(), "pending after everything was sent");
+
+    // Removing a wearable before the resume point keeps the order.
+    router.update(zoneFrame(60, 60, 60, 60, 60, 60), 2100);
+    radio.sent.clear();
+    radio.capacity = 1;
+    router.flush(radio.sender());
+    router.removeDevice(11);
+    radio.capacity = 5;
+    router.flush(radio.sender());
+    CHECK(radio.sent.size() == 3 && radio.sent[1].device == 22 && radio.sent[2].device == 33,
+          "order after removing a wearable");
+    CHECK(router.deviceCount() == 2, "%zu wearables after the removal", router.deviceCount());
+}
+
+static void checkReplace()
+{
+    HapticRouter router(WindowMs, StepMs, RampMs);
+    Radio radio;
+    router.addDevice(5, WearableLayout::quadrants(), 247);
+
+    router.update(zoneFrame(80, 80, 80, 80, 80, 80), 0);
+    router.flush(radio.sender());
+
+    // Two updates while the radio is busy: only the newer goes out.
+    router.update(zoneFrame(200, 0, 0, 0, 0, 0), 100);
+    router.update(zoneFrame(0, 160, 0, 0, 0, 0), 200);
+    radio.sent.clear();
+    CHECK(router.flush(radio.sender()) == 1, "%zu timelines for one wearable", radio.sent.size());
+    const Packet *packet = radio.last(5);
+    if (!packet)
+        return;
+    const haptic_batch_t &batch = packet->batch;
+    CHECK(batch.base_ms == 200, "the replaced timeline was sent, base %u", batch.base_ms);
+    CHECK(batch.sequence == 1, "sequence %u, the replaced timeline counted", batch.sequence);
+    // The wearable never played 200 on motor 0, it ramps from 80.
+    CHECK(batch.frames[0].intensity[0] == 80 && batch.frames[0].intensity[1] == 80,
+          "ramp starts at %u %u instead of the levels sent", batch.frames[0].intensity[0],
+          batch.frames[0].intensity[1]);
+    CHECK(batch.frames[batch.frame_count - 1].intensity[0] == 0 &&
+              batch.frames[batch.frame_count - 1].intensity[1] == 160,
+          "ends at %u %u", batch.frames[batch.frame_count - 1].intensity[0],
+          batch.frames[batch.frame_count - 1].intensity[1]);
+    CHECK(router.flush(radio.sender()) == 0, "a replaced timeline was sent later");
+}
+
+static void checkLayout()
+{
+    HapticRouter router(WindowMs, StepMs, RampMs);
+    Radio radio;
+    router.addDevice(9, WearableLayout::quadrants(), 64);
+
+    router.update(zoneFrame(255, 255, 255, 255, 255, 255), 0);
+    router.flush(radio.sender());
+    router.update(zoneFrame(255, 255, 255, 255, 255, 255), 100);
+    router.flush(radio.sender());
+    CHECK(radio.last(9) && radio.last(9)->batch.sequence == 1, "two timelines before the layout change");
+
+    // A pending timeline for the old layout is dropped.
+    router.update(zoneFrame(255, 255, 255, 255, 255, 255), 200);
+    WearableLayout belt = layoutOf(8);
+    CHECK(router.setLayout(9, belt), "layout of a known wearable refused");
+    CHECK(!router.hasPending(), "timeline of the old layout still pending");
+
+    router.update(zoneFrame(255, 255, 255, 255, 255, 255), 300);
+    radio.sent.clear();
+    router.flush(radio.sender());
+    const Packet *packet = radio.last(9);
+    CHECK(packet != NULL, "nothing sent after the layout change");
+    if (!packet)
+        return;
+    const haptic_batch_t &batch = packet->batch;
+    CHECK(batch.sequence == 0, "sequence %u after the layout change", batch.sequence);
+    CHECK(batch.motor_count == 8, "%u motors after the layout change", batch.motor_count);
+    CHECK(batch.frame_count == std::min<int>(WindowMs / StepMs + 1, haptic_batch_frames_per_mtu(64, 8)),
+          "%u frames for 8 motors on MTU 64", batch.frame_count);
+    for (int m = 0; m < 8; m++)
+        CHECK(batch.frames[0].intensity[m] == 0, "motor %d starts at %u, not from rest", m,
+              batch.frames[0].intensity[m]);
+
+    // Same MTU kept, unknown wearables refused, bad payloads rejected.
+    CHECK(packet->length + HAPTIC_BATCH_ATT_OVERHEAD <= 64, "%u bytes on MTU 64", packet->length);
+    CHECK(!router.setLayout(99, belt), "layout of an unknown wearable accepted");
+    CHECK(router.deviceCount() == 1, "setLayout added a wearable");
+
+    static const uint8_t good[] = { HAPTIC_LAYOUT_VERSION, 2, 0x05, 0x3A };
+    static const uint8_t badVersion[] = { HAPTIC_LAYOUT_VERSION + 1, 2, 0x05, 0x3A };
+    static const uint8_t badLength[] = { HAPTIC_LAYOUT_VERSION, 3, 0x05, 0x3A };
+    static const uint8_t badZone[] = { HAPTIC_LAYOUT_VERSION, 2, 0x05, 0x40 };
+    static const uint8_t noMotors[] = { HAPTIC_LAYOUT_VERSION, 0 };
+    WearableLayout decoded;
+    CHECK(decoded.decode(good, sizeof(good)) && decoded.motorCount == 2 && decoded.zoneMask[1] == 0x3A,
+          "valid layout payload rejected");
+    CHECK(!decoded.decode(badVersion, sizeof(badVersion)), "layout of another version accepted");
+    CHECK(!decoded.decode(badLength, sizeof(badLength)), "layout with a wrong length accepted");
+    CHECK(!decoded.decode(badZone, sizeof(badZone)), "layout with an unknown zone accepted");
+    CHECK(!decoded.decode(noMotors, sizeof(noMotors)), "layout without motors accepted");
+}
+
+int main(int argc, char **argv)
+{
+    bool verbose = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-v"))
+            verbose = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    checkMtu(verbose);
+    checkSetMtu();
+    checkContent();
+    checkFlush();
+    checkReplace();
+    checkLayout();
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,175 @@
+//
+//  latency_report.cpp
+//  Perception
+//
+//  Summarizes the motion to vibration latency from a Viewer log. Every
+//  LATENCY line (LatencyTrace.h) is one depth frame followed to one
+//  wearable; the report gives percentiles per stage and end to end:
+//
+//    sensor    capture to the start of processing, rendering included
+//    process   depth to zones to encoded timelines
+//    outbox    encoded until first offered to the radio
+//    radio     offered until CoreBluetooth accepted the notification
+//    air       accepted until the wearable received it
+//    playout   received until the output tick that played the first frame,
+//              the playout delay of haptic_playout.h included
+//    total     capture to that output tick
+//
+//  Air and total need the wearable to know the phone clock; samples from
+//  before the clock sync only contribute to the other stages.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -o latency_report latency_report.cpp
+//    ./latency_report [-d wearable] [log]
+//
+//    -d  only the lines of this wearable id
+//
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+enum Stage
+{
+    StageSensor,
+    StageProcess,
+    StageOutbox,
+    StageRadio,
+    StageAir,
+    StagePlayout,
+    StageTotal,
+    StageCount
+};
+
+static const char *stageNames[StageCount] = {
+    "sensor", "process", "outbox", "radio", "air", "playout", "total"
+};
+
+// Flags of latency_echo.h.
+#define FLAG_SYNCED 0x01
+#define FLAG_LATE 0x02
+#define FLAG_UNCHANGED 0x04
+
+static bool field(const char *line, const char *key, long long &value)
+{
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), " %s=", key);
+    const char *at = strstr(line, pattern);
+    if (!at)
+        return false;
+    value = strtoll(at + strlen(pattern), NULL, 10);
+    return true;
+}
+
+static double percentile(const std::vector<long long> &sorted, double p)
+{
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL;
+    FILE *in = stdin;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-d") && arg + 1 < argc)
+        {
+            device = argv[++arg];
+        }
+        else if (argv[arg][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [-d wearable] [log]\n", argv[0]);
+            return 2;
+        }
+        else if (!(in = fopen(argv[arg], "r")))
+        {
+            perror(argv[arg]);
+            return 1;
+        }
+    }
+
+    char prefix[64] = "";
+    if (device)
+        snprintf(prefix, sizeof(prefix), "Wearable %s: LATENCY", device);
+
+    std::vector<long long> stages[StageCount];
+    unsigned samples = 0;
+    unsigned unsynced = 0;
+    unsigned late = 0;
+    unsigned unchanged = 0;
+    unsigned malformed = 0;
+    char line[1024];
+
+    while (fgets(line, sizeof(line), in))
+    {
+        const char *at = strstr(line, "LATENCY seq=");
+        if (!at || (device && !strstr(line, prefix)))
+            continue;
+
+        long long flags, start, end, enqueue, sent;
+        if (!field(at, "flags", flags) || !field(at, "start", start) || !field(at, "end", end) ||
+            !field(at, "enqueue", enqueue) || !field(at, "sent", sent))
+        {
+            malformed++;
+            continue;
+        }
+        samples++;
+        stages[StageSensor].push_back(start);
+        stages[StageProcess].push_back(end - start);
+        stages[StageOutbox].push_back(enqueue - end);
+        stages[StageRadio].push_back(sent - enqueue);
+        if (flags & FLAG_LATE)
+            late++;
+        if (flags & FLAG_UNCHANGED)
+            unchanged++;
+
+        long long arrival, actuation, hold;
+        if ((flags & FLAG_SYNCED) && field(at, "arrival", arrival) && field(at, "actuation", actuation))
+        {
+            stages[StageAir].push_back(arrival - sent);
+            stages[StagePlayout].push_back(actuation - arrival);
+            stages[StageTotal].push_back(actuation);
+        }
+        else if (field(at, "hold", hold))
+        {
+            stages[StagePlayout].push_back(hold);
+            unsynced++;
+        }
+    }
+    if (in != stdin)
+        fclose(in);
+
+    if (!samples)
+    {
+        fprintf(stderr, "no LATENCY lines%s\n", malformed ? ", only malformed ones" : "");
+        return 1;
+    }
+
+    printf("%u samples, %u before the clock sync, %u late, %u without an output change\n",
+           samples, unsynced, late, unchanged);
+    printf("%-8s %8s %8s %8s %8s %8s %8s   ms\n", "stage", "count", "mean", "p50", "p90", "p99", "max");
+    for (int stage = 0; stage < StageCount; stage++)
+    {
+        std::vector<long long> &values = stages[stage];
+        if (values.empty())
+        {
+            printf("%-8s %8u\n", stageNames[stage], 0u);
+            continue;
+        }
+        std::sort(values.begin(), values.end());
+        double sum = 0;
+        for (size_t i = 0; i < values.size(); i++)
+            sum += values[i];
+        printf("%-8s %8zu %8.2f %8.2f %8.2f %8.2f %8.2f\n", stageNames[stage], values.size(),
+               sum / values.size() / 1000.0, percentile(values, 0.5), percentile(values, 0.9),
+               percentile(values, 0.99), values.back() / 1000.0);
+    }
+    if (malformed)
+        printf("%u malformed lines skipped\n", malformed);
+    return 0;
+}
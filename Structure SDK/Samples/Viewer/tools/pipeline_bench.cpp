@@ -0,0 +1,653 @@
+//
+//  pipeline_bench.cpp
+//  Perception
+//
+//  Benchmarks every stage of the depth to haptics path on a host, over the
+//  depth frames of recorded sessions (SessionFormat.h) or synthetic ones:
+//
+//    linearize     shift values through the lookup table (DepthPipeline.h)
+//    shift_to_rgba the display image of the Viewer
+//    nearest_zone  nearest depth reduced to a zone frame
+//    encode        HapticRouter update and flush for two wearables
+//    playout       wearable side: batch decode and the 5 ms playout ticks
+//                  (haptic_playout.h) of one frame period
+//    filter        the output filter of haptic_filter.h over the same ticks,
+//                  only when built with PIPELINE_BENCH_FILTER
+//
+//  Each stage runs over the whole corpus several times; the fastest pass
+//  gives ns/frame, the heap allocations through operator new and, where
+//  perf_event_open() is allowed, the hardware cache misses of that pass.
+//  The results are written as JSON. With -b the run is compared against a
+//  stored result and every stage slower (or missing the cache more) by more
+//  than the threshold, or allocating more, is a regression; the exit status
+//  is then 1 so a build can be gated on it.
+//
+//  Build and run on the host:
+//
+//    FW=../../../../Firmware/MULTIROLE_MULTICONNECT_SAMB11_XPLAINED_PRO1/MULTIROLE_MULTICONNECT_SAMB11_XPLAINED_PRO1/src
+//    cc -O2 -I$FW -c $FW/haptic_batch.c $FW/haptic_playout.c
+//    c++ -std=c++11 -O2 -I.. -I$FW -o pipeline_bench pipeline_bench.cpp
+//        ../DepthPipeline.cpp ../HapticRouter.cpp ../SessionReader.cpp
+//        haptic_batch.o haptic_playout.o -lz
+//    ./pipeline_bench [-n frames] [-p passes] [-o result.json]
+//                     [-b baseline.json] [-t percent] [session.pses ...]
+//
+//    -n  frames to use, synthetic 320x240 frames when no session is given
+//    -p  passes per stage, default 5
+//    -o  write the JSON there instead of stdout
+//    -b  compare with this earlier result
+//    -t  regression threshold in percent, default 10
+//
+//  For the filter stage add -DPIPELINE_BENCH_FILTER -DARM_MATH_CM0
+//  -I$FW/ASF/thirdparty/CMSIS/Include, haptic_filter.c and
+//  $FW/../tools/stubs/arm_math_stub.c, the host build of the CMSIS-DSP
+//  routines it uses (see haptic_filter.h), both compiled with cc like the
+//  other firmware sources; on a 64-bit host arm_math.h also needs
+//  -fpermissive in C++.
+//
+
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <vector>
+#include "DepthPipeline.h"
+#include "HapticRouter.h"
+#include "SessionReader.h"
+#include "haptic_batch.h"
+#include "haptic_playout.h"
+#ifdef PIPELINE_BENCH_FILTER
+#include "haptic_filter.h"
+#include "config/conf_haptic_filter.h"
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace perception;
+
+// Heap allocations of the C++ code under test.
+static size_t allocations;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *block = malloc(size ? size : 1);
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+void operator delete(void *block) noexcept
+{
+    free(block);
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void *block) noexcept
+{
+    free(block);
+}
+
+// Depth frames as the sensor delivers them.
+struct Frame
+{
+    std::vector<float> depthMm;
+    std::vector<uint16_t> shift;
+};
+
+struct Corpus
+{
+    size_t width;
+    size_t height;
+    std::vector<Frame> frames;
+    // Timeline of the first wearable per frame, for the wearable stages.
+    std::vector<std::vector<uint8_t> > packets;
+    std::string source;
+};
+
+struct Result
+{
+    std::string name;
+    double nsPerFrame;
+    double allocsPerFrame;
+    // Negative when the counter is not available.
+    double cacheMissesPerFrame;
+};
+
+// Frame period of the sensor.
+#define FRAME_MS 33
+
+// Tick of the wearable, CONF_TIMER_TICK_MS in the firmware's conf_timer.h;
+// the wearable stages run the ticks that fall in each frame period.
+#define TICK_MS 5
+
+// Ticks of the wearable during frame f, 6 or 7.
+static int frameTicks(size_t f)
+{
+    return (int)(((f + 1) * FRAME_MS) / TICK_MS - (f * FRAME_MS) / TICK_MS);
+}
+
+static volatile uint32_t sink;
+
+static double nowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+class CacheCounter
+{
+public:
+    CacheCounter() : _fd(-1)
+    {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheCounter()
+    {
+#ifdef __linux__
+        if (_fd >= 0)
+            close(_fd);
+#endif
+    }
+
+    bool available() const { return _fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (_fd >= 0)
+        {
+            ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Misses since start().
+    long long stop()
+    {
+        long long count = -1;
+#ifdef __linux__
+        if (_fd >= 0)
+        {
+            ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(_fd, &count, sizeof(count)) != sizeof(count))
+                count = -1;
+        }
+#endif
+        return count;
+    }
+
+private:
+    int _fd;
+};
+
+static void loadSynthetic(Corpus &corpus, size_t count)
+{
+    corpus.width = 320;
+    corpus.height = 240;
+    corpus.source = "synthetic";
+    size_t pixels = corpus.width * corpus.height;
+    uint32_t seed = 1;
+
+    // A floor sloping away, a wall and an obstacle moving across, with the
+    // holes of a real sensor.
+    for (size_t f = 0; f < count; f++)
+    {
+        Frame frame;
+        frame.depthMm.resize(pixels);
+        frame.shift.resize(pixels);
+        for (size_t y = 0; y < corpus.height; y++)
+        {
+            for (size_t x = 0; x < corpus.width; x++)
+            {
+                size_t i = y * corpus.width + x;
+                float depth = y > 160 ? 600.0f + (corpus.height - y) * 40.0f : 2500.0f;
+                size_t obstacleX = (f * 4) % corpus.width;
+                if (x >= obstacleX && x < obstacleX + 40 && y > 60 && y < 140)
+                    depth = 400.0f + (f % 90) * 10.0f;
+                seed = seed * 1103515245u + 12345u;
+                if ((seed >> 16) % 23 == 0)
+                    depth = NAN;
+                frame.depthMm[i] = depth;
+                frame.shift[i] = isnan(depth) ? 2047 : (uint16_t)std::min(2047.0f, 300.0f + depth / 4.0f);
+            }
+        }
+        corpus.frames.push_back(frame);
+    }
+}
+
+static bool loadSession(Corpus &corpus, const char *path, size_t limit)
+{
+    SessionReader reader;
+    if (!reader.open(path))
+    {
+        fprintf(stderr, "%s: not a session recording\n", path);
+        return false;
+    }
+
+    SessionReader::Cursor cursor = reader.begin();
+    SessionRecord record;
+    SessionDepthView view;
+    while (corpus.frames.size() < limit && reader.next(cursor, record))
+    {
+        if (record.type != SessionRecordDepth || !reader.depth(record, view))
+            continue;
+        if (corpus.frames.empty())
+        {
+            corpus.width = view.width;
+            corpus.height = view.height;
+        }
+        else if (view.width != corpus.width || view.height != corpus.height)
+        {
+            continue;
+        }
+
+        size_t pixels = (size_t)view.width * view.height;
+        Frame frame;
+        frame.depthMm.resize(pixels);
+        frame.shift.assign(view.shift, view.shift + pixels);
+        for (size_t i = 0; i < pixels; i++)
+            frame.depthMm[i] = view.depthMm[i] ? (float)view.depthMm[i] : NAN;
+        corpus.frames.push_back(frame);
+    }
+    if (!corpus.source.empty())
+        corpus.source += " ";
+    corpus.source += path;
+    return true;
+}
+
+static HapticRouter makeRouter()
+{
+    HapticRouter router(100, 10, 30);
+    router.addDevice(0, WearableLayout::quadrants(), 185);
+    router.addDevice(1, WearableLayout::quadrants(), 23);
+    return router;
+}
+
+// Timelines of the first wearable for the wearable side stages.
+static void preparePackets(Corpus &corpus)
+{
+    HapticRouter router = makeRouter();
+    for (size_t f = 0; f < corpus.frames.size(); f++)
+    {
+        const Frame &frame = corpus.frames[f];
+        NearestDepth nearest = findNearestDepth(&frame.depthMm[0], frame.depthMm.size());
+        router.update(depthZones(nearest, corpus.width), (uint32_t)(f * FRAME_MS));
+        std::vector<uint8_t> packet;
+        router.flush([&packet](HapticRouter::DeviceId device, const uint8_t *data, uint16_t length) -> bool {
+            if (device == 0)
+                packet.assign(data, data + length);
+            return true;
+        });
+        corpus.packets.push_back(packet);
+    }
+}
+
+// Stages run over every frame of the corpus once per call.
+class Stages
+{
+public:
+    explicit Stages(const Corpus &corpus)
+        : _corpus(corpus), _router(makeRouter()), _baseMs(0), _nowMs(0)
+    {
+        size_t pixels = corpus.width * corpus.height;
+        _linear.resize(pixels);
+        _rgba.resize(pixels * 4);
+        haptic_playout_reset(&_playout);
+#ifdef PIPELINE_BENCH_FILTER
+        static const q15_t coeffs[HAPTIC_FILTER_COEFFS] = CONF_HAPTIC_FILTER_COEFFS;
+        static const q15_t gain[HAPTIC_FILTER_MAX] = CONF_HAPTIC_FILTER_GAIN;
+        haptic_filter_init(&_filter, HAPTIC_FILTER_MAX, coeffs, CONF_HAPTIC_FILTER_MAX_STEP, gain);
+#endif
+    }
+
+    void linearize()
+    {
+        for (size_t f = 0; f < _corpus.frames.size(); f++)
+        {
+            const Frame &frame = _corpus.frames[f];
+            _colorizer.linearize(&frame.shift[0], frame.shift.size(), &_linear[0]);
+            sink += _linear[f % _linear.size()];
+        }
+    }
+
+    void shiftToRgba()
+    {
+        for (size_t f = 0; f < _corpus.frames.size(); f++)
+        {
+            const Frame &frame = _corpus.frames[f];
+            _colorizer.colorize(&frame.shift[0], frame.shift.size(), &_rgba[0]);
+            sink += _rgba[(f * 4) % _rgba.size()];
+        }
+    }
+
+    void nearestZone()
+    {
+        for (size_t f = 0; f < _corpus.frames.size(); f++)
+        {
+            const Frame &frame = _corpus.frames[f];
+            NearestDepth nearest = findNearestDepth(&frame.depthMm[0], frame.depthMm.size());
+            ZoneFrame zones = depthZones(nearest, _corpus.width);
+            sink += zones.level[f % HapticZoneCount];
+        }
+    }
+
+    void encode()
+    {
+        ZoneFrame zones;
+        memset(&zones, 0, sizeof(zones));
+        uint32_t *bytes = (uint32_t *)&sink;
+        for (size_t f = 0; f < _corpus.frames.size(); f++)
+        {
+            zones.level[f % HapticZoneCount] = (uint8_t)(f * 7);
+            _router.update(zones, _baseMs += FRAME_MS);
+            _router.flush([bytes](HapticRouter::DeviceId, const uint8_t *data, uint16_t length) -> bool {
+                *bytes += data[length - 1];
+                return true;
+            });
+        }
+    }
+
+    void playout()
+    {
+        for (size_t f = 0; f < _corpus.packets.size(); f++)
+        {
+            const std::vector<uint8_t> &packet = _corpus.packets[f];
+            if (!packet.empty() &&
+                haptic_batch_decode(&packet[0], (uint16_t)packet.size(), &_batch) == HAPTIC_BATCH_OK)
+                haptic_playout_submit(&_playout, &_batch, _nowMs);
+            for (int tick = 0; tick < frameTicks(f); tick++)
+                sink += haptic_playout_tick(&_playout, _nowMs += TICK_MS);
+        }
+    }
+
+#ifdef PIPELINE_BENCH_FILTER
+    void filter()
+    {
+        uint8_t level[HAPTIC_FILTER_MAX];
+        for (size_t f = 0; f < _corpus.packets.size(); f++)
+        {
+            uint8_t target[HAPTIC_FILTER_MAX] = { (uint8_t)(f * 11), (uint8_t)(f * 3), 0, 255 };
+            for (int tick = 0; tick < frameTicks(f); tick++)
+            {
+                haptic_filter_step(&_filter, target, level);
+                sink += level[tick % HAPTIC_FILTER_MAX];
+            }
+        }
+    }
+#endif
+
+private:
+    const Corpus &_corpus;
+    DepthColorizer _colorizer;
+    std::vector<uint16_t> _linear;
+    std::vector<uint8_t> _rgba;
+    HapticRouter _router;
+    uint32_t _baseMs;
+    haptic_playout_t _playout;
+    haptic_batch_t _batch;
+    uint32_t _nowMs;
+#ifdef PIPELINE_BENCH_FILTER
+    haptic_filter_t _filter;
+#endif
+};
+
+static Result measure(const char *name, Stages &stages, void (Stages::*stage)(), size_t frames,
+                      int passes, CacheCounter &cache)
+{
+    Result best;
+    best.name = name;
+    best.nsPerFrame = -1;
+
+    // One pass to warm the caches and let containers reach their size.
+    (stages.*stage)();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        size_t before = allocations;
+        cache.start();
+        double start = nowNs();
+        (stages.*stage)();
+        double elapsed = nowNs() - start;
+        long long misses = cache.stop();
+
+        double ns = elapsed / frames;
+        if (best.nsPerFrame < 0 || ns < best.nsPerFrame)
+        {
+            best.nsPerFrame = ns;
+            best.allocsPerFrame = (double)(allocations - before) / frames;
+            best.cacheMissesPerFrame = misses < 0 ? -1 : (double)misses / frames;
+        }
+    }
+    return best;
+}
+
+static void writeJson(FILE *out, const Corpus &corpus, int passes, const std::vector<Result> &results)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"corpus\": \"%s\",\n", corpus.source.c_str());
+    fprintf(out, "  \"frames\": %zu,\n", corpus.frames.size());
+    fprintf(out, "  \"width\": %zu,\n", corpus.width);
+    fprintf(out, "  \"height\": %zu,\n", corpus.height);
+    fprintf(out, "  \"passes\": %d,\n", passes);
+    fprintf(out, "  \"stages\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &result = results[i];
+        fprintf(out, "    { \"name\": \"%s\", \"ns_per_frame\": %.1f, \"allocs_per_frame\": %.3f, ",
+                result.name.c_str(), result.nsPerFrame, result.allocsPerFrame);
+        if (result.cacheMissesPerFrame < 0)
+            fprintf(out, "\"cache_misses_per_frame\": null }");
+        else
+            fprintf(out, "\"cache_misses_per_frame\": %.1f }", result.cacheMissesPerFrame);
+        fprintf(out, "%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Number after "key": within text, false for null or a missing key.
+static bool jsonNumber(const std::string &text, const char *key, double &value)
+{
+    std::string pattern = std::string("\"") + key + "\":";
+    size_t at = text.find(pattern);
+    if (at == std::string::npos)
+        return false;
+    const char *start = text.c_str() + at + pattern.size();
+    char *end;
+    value = strtod(start, &end);
+    return end != start;
+}
+
+// Reads back what writeJson() wrote.
+static bool readBaseline(const char *path, std::vector<Result> &results)
+{
+    FILE *in = fopen(path, "r");
+    if (!in)
+    {
+        perror(path);
+        return false;
+    }
+    std::string text;
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        text.append(buffer, length);
+    fclose(in);
+
+    size_t at = 0;
+    while ((at = text.find("{ \"name\": \"", at)) != std::string::npos)
+    {
+        at += strlen("{ \"name\": \"");
+        size_t end = text.find('}', at);
+        std::string entry = text.substr(at, end - at);
+        Result result;
+        result.name = entry.substr(0, entry.find('"'));
+        if (!jsonNumber(entry, "ns_per_frame", result.nsPerFrame))
+            continue;
+        if (!jsonNumber(entry, "allocs_per_frame", result.allocsPerFrame))
+            result.allocsPerFrame = 0;
+        if (!jsonNumber(entry, "cache_misses_per_frame", result.cacheMissesPerFrame))
+            result.cacheMissesPerFrame = -1;
+        results.push_back(result);
+    }
+    if (results.empty())
+        fprintf(stderr, "%s: no stages\n", path);
+    return !results.empty();
+}
+
+// Prints the comparison to stderr; returns the number of regressions.
+static int compare(const std::vector<Result> &baseline, const std::vector<Result> &results, double threshold)
+{
+    int regressions = 0;
+    fprintf(stderr, "%-14s %12s %12s %8s %10s %10s\n", "stage", "base ns", "ns", "change", "allocs", "misses");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &result = results[i];
+        const Result *base = NULL;
+        for (size_t j = 0; j < baseline.size() && !base; j++)
+        {
+            if (baseline[j].name == result.name)
+                base = &baseline[j];
+        }
+        if (!base)
+        {
+            fprintf(stderr, "%-14s %12s %12.1f   new stage\n", result.name.c_str(), "-", result.nsPerFrame);
+            continue;
+        }
+
+        double change = (result.nsPerFrame - base->nsPerFrame) / base->nsPerFrame * 100;
+        bool slower = change > threshold;
+        bool allocating = result.allocsPerFrame > base->allocsPerFrame + 1e-3;
+        bool missing = base->cacheMissesPerFrame > 0 && result.cacheMissesPerFrame >= 0 &&
+            (result.cacheMissesPerFrame - base->cacheMissesPerFrame) / base->cacheMissesPerFrame * 100 > threshold;
+        char misses[16] = "-";
+        if (result.cacheMissesPerFrame >= 0)
+            snprintf(misses, sizeof(misses), "%.1f", result.cacheMissesPerFrame);
+        fprintf(stderr, "%-14s %12.1f %12.1f %+7.1f%% %10.3f %10s%s%s%s\n", result.name.c_str(),
+                base->nsPerFrame, result.nsPerFrame, change, result.allocsPerFrame,
+                misses, slower ? "  SLOWER" : "",
+                allocating ? "  MORE ALLOCATIONS" : "", missing ? "  MORE CACHE MISSES" : "");
+        if (slower || allocating || missing)
+            regressions++;
+    }
+    return regressions;
+}
+
+int main(int argc, char **argv)
+{
+    size_t limit = 300;
+    int passes = 5;
+    double threshold = 10;
+    const char *output = NULL;
+    const char *baselinePath = NULL;
+    Corpus corpus;
+    corpus.width = 0;
+    corpus.height = 0;
+    std::vector<const char *> sessions;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        bool value = arg + 1 < argc;
+        if (!strcmp(argv[arg], "-n") && value)
+            limit = (size_t)atol(argv[++arg]);
+        else if (!strcmp(argv[arg], "-p") && value)
+            passes = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-o") && value)
+            output = argv[++arg];
+        else if (!strcmp(argv[arg], "-b") && value)
+            baselinePath = argv[++arg];
+        else if (!strcmp(argv[arg], "-t") && value)
+            threshold = atof(argv[++arg]);
+        else if (argv[arg][0] != '-')
+            sessions.push_back(argv[arg]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n frames] [-p passes] [-o result.json] "
+                    "[-b baseline.json] [-t percent] [session.pses ...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (limit == 0 || passes < 1)
+    {
+        fprintf(stderr, "frames and passes must be positive\n");
+        return 2;
+    }
+
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        if (!loadSession(corpus, sessions[i], limit))
+            return 1;
+    }
+    if (sessions.empty())
+        loadSynthetic(corpus, limit);
+    if (corpus.frames.empty())
+    {
+        fprintf(stderr, "no depth frames in the corpus\n");
+        return 1;
+    }
+    preparePackets(corpus);
+
+    std::vector<Result> baseline;
+    if (baselinePath && !readBaseline(baselinePath, baseline))
+        return 1;
+
+    CacheCounter cache;
+    if (!cache.available())
+        fprintf(stderr, "cache miss counter not available, see perf_event_paranoid\n");
+
+    Stages stages(corpus);
+    size_t frames = corpus.frames.size();
+    std::vector<Result> results;
+    results.push_back(measure("linearize", stages, &Stages::linearize, frames, passes, cache));
+    results.push_back(measure("shift_to_rgba", stages, &Stages::shiftToRgba, frames, passes, cache));
+    results.push_back(measure("nearest_zone", stages, &Stages::nearestZone, frames, passes, cache));
+    results.push_back(measure("encode", stages, &Stages::encode, frames, passes, cache));
+    results.push_back(measure("playout", stages, &Stages::playout, frames, passes, cache));
+#ifdef PIPELINE_BENCH_FILTER
+    results.push_back(measure("filter", stages, &Stages::filter, frames, passes, cache));
+#endif
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out)
+    {
+        perror(output);
+        return 1;
+    }
+    writeJson(out, corpus, passes, results);
+    if (out != stdout)
+        fclose(out);
+
+    if (baselinePath)
+    {
+        int regressions = compare(baseline, results, threshold);
+        if (regressions)
+        {
+            fprintf(stderr, "%d stages regressed beyond %.0f%%\n", regressions, threshold);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,466 @@
+//
+//  session_check.cpp
+//  Perception
+//
+//  Writes sessions with SessionWriter.h, reads them back with
+//  SessionReader.h on a host and checks the reader turns down what does not
+//  add up instead of reading past the record:
+//
+//    roundtrip  every record comes back as written, raw and deflated, in
+//               one chunk and across many; seek() finds a record by time
+//    depth      depth headers whose planes overflow 32 bits or do not fit
+//               the record are rejected, raw and delta coded
+//    chunks     a damaged chunk header, index entry or inflated size, or a
+//               recording cut short, falls back to the chunk headers and
+//               stops at the damage; a larger record gets a chunk of its own
+//
+//  The exit status is 1 when a check fails.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -I.. -o session_check session_check.cpp ../SessionWriter.cpp ../SessionReader.cpp -lz
+//    ./session_check [-v]
+//
+//    -v  print the size of every recording written and what the reader
+//        finds in each damaged one
+//
+//  The recordings are written to $TMPDIR, /tmp without it, and removed.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "SessionReader.h"
+#include "SessionWriter.h"
+
+using namespace perception;
+
+static const uint16_t Width = 64;
+static const uint16_t Height = 48;
+static const int Frames = 24;
+static const int ZoneCount = 6;
+// Depth, IMU, zones and haptic records per frame.
+static const int RecordsPerFrame = 4;
+
+static int failures = 0;
+static bool verbose = false;
+
+#define CHECK(condition, ...)                            \
+    do                                                   \
+    {                                                    \
+        if (!(condition))                                \
+        {                                                \
+            if (failures++ < 20)                         \
+            {                                            \
+                fprintf(stderr, "failed: " __VA_ARGS__); \
+                fprintf(stderr, "\n");                   \
+            }                                            \
+        }                                                \
+    } while (0)
+
+static std::string tempPath(const char *name)
+{
+    const char *dir = getenv("TMPDIR");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/session_check.%d.%s.pses", dir && *dir ? dir : "/tmp", (int)getpid(), name);
+    return path;
+}
+
+static double timestampOf(int frame, int kind)
+{
+    return 100.0 + frame * 0.033 + kind * 0.001;
+}
+
+// Sensor depth with a hole every 17 pixels, as the pipeline sees it.
+static float depthAt(int frame, uint32_t i)
+{
+    if ((i + frame) % 17 == 0)
+        return NAN;
+    return 300.0f + (i % Width) * 7.25f + (i / Width) + frame * 3;
+}
+
+static uint16_t shiftAt(int frame, uint32_t i)
+{
+    return (uint16_t)(i * 31 + frame * 977);
+}
+
+static uint16_t storedDepthAt(int frame, uint32_t i)
+{
+    float mm = depthAt(frame, i);
+    return mm == mm ? (uint16_t)mm : 0;
+}
+
+static uint16_t hapticLength(int frame)
+{
+    return (uint16_t)(5 + frame % 4);
+}
+
+static bool writeSession(const std::string &path, bool compress, uint32_t chunkBytes)
+{
+    SessionWriter writer;
+    if (!writer.open(path.c_str(), compress, chunkBytes))
+        return false;
+
+    std::vector<float> depth((size_t)Width * Height);
+    std::vector<uint16_t> shift(depth.size());
+    for (int f = 0; f < Frames; f++)
+    {
+        for (uint32_t i = 0; i < depth.size(); i++)
+        {
+            depth[i] = depthAt(f, i);
+            shift[i] = shiftAt(f, i);
+        }
+        writer.writeDepth(timestampOf(f, 0), Width, Height, &depth[0], &shift[0]);
+
+        SessionImuSample sample = {{ (float)f, -(float)f, 1 }, { 0.5f, 0, -0.25f * f }};
+        writer.writeImu(timestampOf(f, 1), sample);
+
+        uint8_t level[ZoneCount];
+        for (int z = 0; z < ZoneCount; z++)
+            level[z] = (uint8_t)(f * 10 + z);
+        writer.writeZones(timestampOf(f, 2), level, ZoneCount);
+
+        uint8_t packet[8];
+        for (int k = 0; k < (int)sizeof(packet); k++)
+            packet[k] = (uint8_t)(f + k);
+        writer.writeHaptic(timestampOf(f, 3), f % 3, packet, hapticLength(f));
+    }
+    return writer.close();
+}
+
+static bool sameDepth(SessionReader &reader, const SessionRecord &record, int frame)
+{
+    SessionDepthView view;
+    if (!reader.depth(record, view) || view.width != Width || view.height != Height)
+        return false;
+    for (uint32_t i = 0; i < (uint32_t)Width * Height; i++)
+    {
+        if (view.depthMm[i] != storedDepthAt(frame, i) || view.shift[i] != shiftAt(frame, i))
+            return false;
+    }
+    return true;
+}
+
+static bool samePayload(const SessionRecord &record, int frame, int kind)
+{
+    if (kind == 1)
+    {
+        SessionImuSample sample;
+        if (record.size != sizeof(sample))
+            return false;
+        memcpy(&sample, record.payload, sizeof(sample));
+        return sample.accel[0] == frame && sample.accel[1] == -frame && sample.gyro[2] == -0.25f * frame;
+    }
+    if (kind == 2)
+    {
+        if (record.size != 1 + ZoneCount || record.payload[0] != ZoneCount)
+            return false;
+        for (int z = 0; z < ZoneCount; z++)
+        {
+            if (record.payload[1 + z] != (uint8_t)(frame * 10 + z))
+                return false;
+        }
+        return true;
+    }
+
+    SessionHapticHeader header;
+    if (record.size != sizeof(header) + hapticLength(frame))
+        return false;
+    memcpy(&header, record.payload, sizeof(header));
+    if (header.device != (uint32_t)frame % 3 || header.length != hapticLength(frame))
+        return false;
+    for (int k = 0; k < header.length; k++)
+    {
+        if (record.payload[sizeof(header) + k] != (uint8_t)(frame + k))
+            return false;
+    }
+    return true;
+}
+
+// Reads from the cursor on and returns the records that match what
+// writeSession() wrote, in order.
+static int readSession(SessionReader &reader, SessionReader::Cursor cursor, int first, const char *label)
+{
+    static const SessionRecordType types[RecordsPerFrame] = {
+        SessionRecordDepth, SessionRecordImu, SessionRecordZones, SessionRecordHaptic
+    };
+
+    SessionRecord record;
+    int n = first;
+    while (reader.next(cursor, record))
+    {
+        int frame = n / RecordsPerFrame;
+        int kind = n % RecordsPerFrame;
+        bool same = frame < Frames && record.type == types[kind] && record.timestamp == timestampOf(frame, kind) &&
+                    (kind == 0 ? sameDepth(reader, record, frame) : samePayload(record, frame, kind));
+        CHECK(same, "%s: record %d differs from the one written", label, n);
+        if (!same)
+            break;
+        n++;
+    }
+    return n - first;
+}
+
+static void checkRoundTrip()
+{
+    // Smaller than a depth record, which then fills a chunk alone.
+    static const uint32_t chunkSizes[] = { SESSION_CHUNK_BYTES, 16384, 4096 };
+    size_t rawSize[2] = { 0, 0 };
+
+    for (int compress = 0; compress < 2; compress++)
+    {
+        for (uint32_t chunkBytes : chunkSizes)
+        {
+            char label[64];
+            snprintf(label, sizeof(label), "%s, %u byte chunks", compress ? "deflated" : "raw", chunkBytes);
+            std::string path = tempPath("roundtrip");
+            CHECK(writeSession(path, compress != 0, chunkBytes), "%s: not written", label);
+
+            SessionReader reader;
+            CHECK(reader.open(path.c_str()), "%s: not opened", label);
+            CHECK(!reader.recovered(), "%s: index rebuilt", label);
+            CHECK(chunkBytes == SESSION_CHUNK_BYTES ? reader.chunkCount() == 1 : reader.chunkCount() > 4,
+                  "%s: %zu chunks", label, reader.chunkCount());
+            CHECK(reader.firstTimestamp() == timestampOf(0, 0) && reader.lastTimestamp() == timestampOf(Frames - 1, 3),
+                  "%s: spans %f to %f", label, reader.firstTimestamp(), reader.lastTimestamp());
+
+            int read = readSession(reader, reader.begin(), 0, label);
+            CHECK(read == Frames * RecordsPerFrame, "%s: %d of %d records read", label, read, Frames * RecordsPerFrame);
+
+            // The haptic record of frame 10 is the first at or after this time.
+            SessionReader::Cursor cursor = reader.seek(timestampOf(10, 2) + 0.0005);
+            read = readSession(reader, cursor, 10 * RecordsPerFrame + 3, label);
+            CHECK(read == (Frames - 10) * RecordsPerFrame - 3, "%s: %d records read after seek", label, read);
+
+            if (chunkBytes == SESSION_CHUNK_BYTES)
+                rawSize[compress] = reader.fileSize();
+            if (verbose)
+                printf("%-28s %7zu bytes, %3zu chunks\n", label, reader.fileSize(), reader.chunkCount());
+            reader.close();
+            unlink(path.c_str());
+        }
+    }
+    CHECK(rawSize[1] < rawSize[0], "deflated recording of %zu bytes, %zu raw", rawSize[1], rawSize[0]);
+}
+
+// A depth payload in a buffer of the tool, decoded through a record that
+// points at it like the reader's records point into the chunk.
+struct DepthPayload
+{
+    std::vector<uint64_t> storage;
+    SessionRecord record;
+
+    DepthPayload(uint8_t encoding, uint16_t width, uint16_t height, uint32_t size)
+        : storage((size + 7) / 8 + 1, 0)
+    {
+        uint8_t *payload = (uint8_t *)&storage[0];
+        SessionDepthHeader header;
+        memset(&header, 0, sizeof(header));
+        header.width = width;
+        header.height = height;
+        memcpy(payload, &header, sizeof(header));
+
+        // Both planes hold the column index of a Width wide frame; left
+        // neighbour differences of 1 decode to it.
+        uint16_t *plane = (uint16_t *)(payload + sizeof(header));
+        size_t values = (storage.size() * sizeof(uint64_t) - sizeof(header)) / sizeof(uint16_t);
+        for (size_t i = 0; i < values; i++)
+        {
+            uint16_t column = (uint16_t)(i % Width);
+            plane[i] = encoding == SessionDepthDelta ? (column ? 1 : 0) : column;
+        }
+
+        record.type = SessionRecordDepth;
+        record.encoding = encoding;
+        record.timestamp = 0;
+        record.payload = payload;
+        record.size = size;
+    }
+};
+
+static void checkDepth()
+{
+    const uint32_t planeSize = SESSION_ALIGNED((uint32_t)Width * Height * sizeof(uint16_t));
+    const uint32_t size = sizeof(SessionDepthHeader) + 2 * planeSize;
+
+    // Planes whose size wraps to 0 and 2 GB in 32 bits, which the record
+    // seemed to hold.
+    static const uint16_t overflow[][2] = { { 65534, 32769 }, { 32768, 32768 }, { 65535, 65535 } };
+
+    for (uint8_t encoding = SessionDepthRaw; encoding <= SessionDepthDelta; encoding++)
+    {
+        const char *label = encoding == SessionDepthRaw ? "raw" : "delta";
+        SessionReader reader;
+        SessionDepthView view;
+
+        DepthPayload valid(encoding, Width, Height, size);
+        CHECK(reader.depth(valid.record, view) && view.width == Width && view.height == Height,
+              "%s %ux%u rejected", label, Width, Height);
+        CHECK(view.depthMm[Width - 1] == Width - 1 && view.shift[Width * Height - 1] == Width - 1,
+              "%s: last column at %u and %u", label, view.depthMm[Width - 1], view.shift[Width * Height - 1]);
+
+        for (size_t i = 0; i < sizeof(overflow) / sizeof(overflow[0]); i++)
+        {
+            DepthPayload wrapped(encoding, overflow[i][0], overflow[i][1], size);
+            CHECK(!reader.depth(wrapped.record, view), "%s %ux%u accepted in %u bytes", label, overflow[i][0],
+                  overflow[i][1], size);
+        }
+
+        DepthPayload taller(encoding, Width, Height + 1, size);
+        CHECK(!reader.depth(taller.record, view), "%s %ux%u accepted in %u bytes", label, Width, Height + 1, size);
+
+        DepthPayload truncated(encoding, Width, Height, size - SESSION_ALIGN);
+        CHECK(!reader.depth(truncated.record, view), "%s %ux%u accepted in %u bytes", label, Width, Height,
+              size - SESSION_ALIGN);
+
+        DepthPayload empty(encoding, Width, Height, sizeof(SessionDepthHeader) - 1);
+        CHECK(!reader.depth(empty.record, view), "%s record without a depth header accepted", label);
+
+        DepthPayload noPixels(encoding, 0, Height, sizeof(SessionDepthHeader));
+        CHECK(reader.depth(noPixels.record, view) && view.width == 0, "%s frame without pixels rejected", label);
+    }
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    data.resize((size_t)ftell(file));
+    fseek(file, 0, SEEK_SET);
+    bool read = fread(&data[0], 1, data.size(), file) == data.size();
+    fclose(file);
+    return read;
+}
+
+static bool writeFile(const std::string &path, const std::vector<uint8_t> &data, size_t size)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(&data[0], 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+template <typename T>
+static void patch(std::vector<uint8_t> &data, uint64_t offset, const T &value)
+{
+    memcpy(&data[(size_t)offset], &value, sizeof(value));
+}
+
+struct Damage
+{
+    const char *name;
+    // The index passes and every chunk is found; records still stop at the
+    // damaged chunk.
+    bool indexKept;
+    // Otherwise the chunk headers are walked up to the damaged one, or
+    // all of them when only the index was damaged.
+    bool stopsAtDamage;
+};
+
+static void checkChunks()
+{
+    std::string path = tempPath("chunks");
+    CHECK(writeSession(path, true, 16384), "chunks: not written");
+
+    SessionReader reader;
+    CHECK(reader.open(path.c_str()) && reader.chunkCount() > 8, "chunks: %zu chunks", reader.chunkCount());
+    std::vector<SessionIndexEntry> index;
+    for (size_t i = 0; i < reader.chunkCount(); i++)
+        index.push_back(reader.chunk(i));
+    reader.close();
+
+    std::vector<uint8_t> file;
+    CHECK(readFile(path, file), "chunks: not read back");
+    unlink(path.c_str());
+    if (index.size() <= 8 || file.empty())
+        return;
+
+    const size_t damaged = 5;
+    const uint64_t chunk = index[damaged].offset;
+    const uint64_t entry = file.size() - sizeof(SessionFooter) + (damaged - index.size()) * sizeof(SessionIndexEntry);
+    SessionChunkHeader header;
+    memcpy(&header, &file[(size_t)chunk], sizeof(header));
+    CHECK(header.flags & SessionChunkDeflate, "chunks: chunk %zu stored raw", damaged);
+
+    int recordsBefore = 0;
+    for (size_t i = 0; i < damaged; i++)
+        recordsBefore += index[i].recordCount;
+
+    static const Damage damages[] = {
+        { "chunk magic", false, true },
+        { "stored size in the index", false, false },
+        { "chunk offset in the index", false, false },
+        { "inflated size of 4 GB", false, true },
+        { "inflated size past chunkBytes", false, true },
+        { "inflated size short of the records", true, true },
+        { "cut before the index", false, true },
+    };
+
+    std::string copy = tempPath("damaged");
+    for (const Damage &damage : damages)
+    {
+        std::vector<uint8_t> bytes = file;
+        size_t size = bytes.size();
+        switch (&damage - damages)
+        {
+            case 0: patch(bytes, chunk, (uint32_t)0x4b4e4858u); break;
+            case 1: patch(bytes, entry + offsetof(SessionIndexEntry, storedSize), header.storedSize - SESSION_ALIGN); break;
+            case 2: patch(bytes, entry, chunk + SESSION_ALIGN); break;
+            case 3: patch(bytes, chunk + offsetof(SessionChunkHeader, rawSize), (uint32_t)0xfffffff8u); break;
+            case 4: patch(bytes, chunk + offsetof(SessionChunkHeader, rawSize), (uint32_t)(16384 + SESSION_ALIGN)); break;
+            case 5: patch(bytes, chunk + offsetof(SessionChunkHeader, rawSize), header.rawSize - SESSION_ALIGN); break;
+            case 6: size = (size_t)chunk + sizeof(header) + header.storedSize / 2; break;
+        }
+        CHECK(writeFile(copy, bytes, size), "%s: not written", damage.name);
+
+        CHECK(reader.open(copy.c_str()), "%s: not opened", damage.name);
+        CHECK(reader.recovered() != damage.indexKept, "%s: index %s", damage.name,
+              damage.indexKept ? "rejected" : "accepted");
+        size_t chunks = damage.stopsAtDamage && !damage.indexKept ? damaged : index.size();
+        CHECK(reader.chunkCount() == chunks, "%s: %zu chunks, expected %zu", damage.name, reader.chunkCount(),
+              chunks);
+
+        // Everything before the damage reads back; the damaged chunk does
+        // not, even when its header passed.
+        int expected = damage.stopsAtDamage ? recordsBefore : Frames * RecordsPerFrame;
+        int read = readSession(reader, reader.begin(), 0, damage.name);
+        CHECK(read == expected, "%s: %d records read, expected %d", damage.name, read, expected);
+        if (verbose)
+            printf("%-36s %2zu chunks, %3d records\n", damage.name, reader.chunkCount(), read);
+        reader.close();
+    }
+    unlink(copy.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-v"))
+            verbose = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    checkRoundTrip();
+    checkDepth();
+    checkChunks();
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+//
+//  session_replay.cpp
+//  Perception
+//
+//  Replays a session recorded by the Viewer (SessionFormat.h) on a host and
+//  summarizes it: records per type, depth frame rate and largest gap, IMU
+//  rate, haptic traffic, nearest depth per frame, compression ratio and how
+//  fast the recording decodes.
+//
+//  Build and run on the host:
+//
+//    c++ -std=c++11 -O2 -I.. -o session_replay session_replay.cpp ../SessionReader.cpp -lz
+//    ./session_replay [-r] [-s seconds] [-v] session.pses
+//
+//    -r  replay in real time, sleeping until each record is due
+//    -s  start this many seconds into the recording
+//    -v  print every record
+//
+//  Without -r the records are read as fast as the reader goes, which is the
+//  decode throughput printed at the end.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SessionReader.h"
+
+using namespace perception;
+
+static double monotonicSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void sleepUntil(double deadline)
+{
+    double wait = deadline - monotonicSeconds();
+    if (wait <= 0)
+        return;
+    struct timespec duration;
+    duration.tv_sec = (time_t)wait;
+    duration.tv_nsec = (long)((wait - duration.tv_sec) * 1e9);
+    nanosleep(&duration, NULL);
+}
+
+static const char *typeName(int type)
+{
+    switch (type)
+    {
+        case SessionRecordDepth: return "depth";
+        case SessionRecordImu: return "imu";
+        case SessionRecordZones: return "zones";
+        case SessionRecordHaptic: return "haptic";
+        default: return "unknown";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool realTime = false;
+    bool verbose = false;
+    double start = 0;
+    const char *path = NULL;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-r"))
+            realTime = true;
+        else if (!strcmp(argv[arg], "-v"))
+            verbose = true;
+        else if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            start = atof(argv[++arg]);
+        else if (argv[arg][0] != '-' && !path)
+            path = argv[arg];
+        else
+            path = NULL, arg = argc;
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s [-r] [-s seconds] [-v] session.pses\n", argv[0]);
+        return 2;
+    }
+
+    SessionReader reader;
+    if (!reader.open(path))
+    {
+        fprintf(stderr, "%s: not a session recording\n", path);
+        return 1;
+    }
+
+    uint64_t stored = 0;
+    uint64_t rawRecords = 0;
+    for (size_t i = 0; i < reader.chunkCount(); i++)
+        stored += reader.chunk(i).storedSize;
+
+    printf("%s: %zu bytes, %zu chunks%s\n", path, reader.fileSize(), reader.chunkCount(),
+           reader.recovered() ? ", index rebuilt (not closed)" : "");
+
+    SessionReader::Cursor cursor = start > 0 ? reader.seek(reader.firstTimestamp() + start) : reader.begin();
+    SessionRecord record;
+    uint32_t count[SessionRecordHaptic + 1] = { 0 };
+    uint64_t hapticBytes = 0;
+    uint32_t damaged = 0;
+    double first = -1;
+    double last = 0;
+    double lastDepth = -1;
+    double maxDepthGap = 0;
+    double nearestSum = 0;
+    uint32_t nearestFrames = 0;
+    double replayStart = monotonicSeconds();
+
+    while (reader.next(cursor, record))
+    {
+        if (first < 0)
+            first = record.timestamp;
+        last = record.timestamp;
+        rawRecords += sizeof(SessionRecordHeader) + SESSION_ALIGNED(record.size);
+        if (realTime)
+            sleepUntil(replayStart + (record.timestamp - first));
+        if (record.type >= SessionRecordDepth && record.type <= SessionRecordHaptic)
+            count[record.type]++;
+
+        if (record.type == SessionRecordDepth)
+        {
+            SessionDepthView view;
+            if (!reader.depth(record, view))
+            {
+                damaged++;
+                continue;
+            }
+            if (lastDepth >= 0 && record.timestamp - lastDepth > maxDepthGap)
+                maxDepthGap = record.timestamp - lastDepth;
+            lastDepth = record.timestamp;
+
+            // Nearest valid depth, what the zones respond to.
+            uint16_t nearest = 0xffff;
+            uint32_t pixels = (uint32_t)view.width * view.height;
+            for (uint32_t i = 0; i < pixels; i++)
+            {
+                if (view.depthMm[i] && view.depthMm[i] < nearest)
+                    nearest = view.depthMm[i];
+            }
+            if (nearest != 0xffff)
+            {
+                nearestSum += nearest;
+                nearestFrames++;
+            }
+            if (verbose)
+                printf("%10.4f depth  %ux%u nearest %u mm\n", record.timestamp - first,
+                       view.width, view.height, nearest == 0xffff ? 0 : nearest);
+        }
+        else if (record.type == SessionRecordImu && record.size >= sizeof(SessionImuSample))
+        {
+            SessionImuSample sample;
+            memcpy(&sample, record.payload, sizeof(sample));
+            if (verbose)
+                printf("%10.4f imu    accel %6.3f %6.3f %6.3f g  gyro %6.3f %6.3f %6.3f rad/s\n",
+                       record.timestamp - first, sample.accel[0], sample.accel[1], sample.accel[2],
+                       sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+        }
+        else if (record.type == SessionRecordZones && record.size >= 1)
+        {
+            if (verbose)
+            {
+                printf("%10.4f zones ", record.timestamp - first);
+                for (uint32_t i = 0; i < record.payload[0] && 1 + i < record.size; i++)
+                    printf(" %3u", record.payload[1 + i]);
+                printf("\n");
+            }
+        }
+        else if (record.type == SessionRecordHaptic && record.size >= sizeof(SessionHapticHeader))
+        {
+            SessionHapticHeader header;
+            memcpy(&header, record.payload, sizeof(header));
+            hapticBytes += header.length;
+            if (verbose)
+                printf("%10.4f haptic device %u, %u bytes\n", record.timestamp - first,
+                       header.device, header.length);
+        }
+    }
+    double elapsed = monotonicSeconds() - replayStart;
+    double duration = first < 0 ? 0 : last - first;
+
+    // next() stops early on a chunk it cannot read.
+    if (cursor.chunk < reader.chunkCount())
+        damaged++;
+
+    printf("duration %.2f s\n", duration);
+    for (int type = SessionRecordDepth; type <= SessionRecordHaptic; type++)
+    {
+        printf("  %-7s %8u records, %7.1f /s\n", typeName(type), count[type],
+               duration > 0 ? count[type] / duration : 0.0);
+    }
+    if (count[SessionRecordDepth] > 1)
+        printf("  depth gap max %.1f ms\n", maxDepthGap * 1000);
+    if (nearestFrames)
+        printf("  nearest depth mean %.0f mm\n", nearestSum / nearestFrames);
+    printf("  haptic %llu bytes\n", (unsigned long long)hapticBytes);
+    if (stored && start <= 0)
+        printf("compression %.2f:1 (%llu bytes of records in %llu)\n", (double)rawRecords / stored,
+               (unsigned long long)rawRecords, (unsigned long long)stored);
+    if (!realTime && elapsed > 0)
+        printf("decoded in %.3f s, %.1f MB/s, %.0fx real time\n", elapsed,
+               rawRecords / elapsed / 1e6, duration / elapsed);
+    if (damaged)
+        printf("damaged records or chunks: %u\n", damaged);
+    return damaged ? 1 : 0;
+}